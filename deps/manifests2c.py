@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# DISTRHO Cardinal Plugin
+# Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as
+# published by the Free Software Foundation; either version 3 of
+# the License, or any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+#
+# For a full copy of the GNU General Public License see the LICENSE file.
+
+# Merges plugin manifests into a single compact JSON object keyed by plugin directory name,
+# embedded as C data so that static plugins load without reading a file per plugin.
+
+import json
+import os
+import sys
+
+# -----------------------------------------------------
+
+def manifests2c(filenames):
+    manifests = {}
+    for filename in filenames:
+        name = os.path.basename(os.path.dirname(os.path.abspath(filename)))
+        with open(filename, 'r', encoding='utf-8') as fhandle:
+            manifests[name] = json.load(fhandle)
+
+    resdata = json.dumps(manifests, separators=(',', ':'), ensure_ascii=False).encode('utf-8')
+
+    print("const unsigned char cardinal_plugin_manifests[] = {\n")
+    for data in resdata:
+        print(" %3u," % data)
+    print("};\n")
+
+    print("const unsigned int cardinal_plugin_manifests_len = %d;\n" % len(resdata))
+
+# -----------------------------------------------------
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        print("Usage: %s <plugin.json> [plugin.json...]" % sys.argv[0])
+        quit()
+
+    manifests2c(sys.argv[1:])
+
+# -----------------------------------------------------
@@ -0,0 +1,265 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# DISTRHO Cardinal Plugin
+# Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as
+# published by the Free Software Foundation; either version 3 of
+# the License, or any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+#
+# For a full copy of the GNU General Public License see the LICENSE file.
+
+# Generates the static plugin registration of a build limited to a list of plugins and models, see PLUGIN_SUBSET.
+# The list has one entry per line, "Plugin" for a whole plugin or "Plugin/Model" for a single model,
+# plugins named by slug or directory, models by slug or by their model variable, "#" starts a comment.
+# Cardinal is always part of the build, its host modules are needed by any patch.
+#
+# "plugins" prints the plugin directories of the subset, "source" prints plugins.cpp with the registration of
+# everything else left out. Unreferenced module objects are then not pulled from plugins.a by the linker.
+#
+# For SHARED_PLUGINS builds, "families" prints the plugin directories registered by plugins.cpp,
+# "shared" prints plugins.cpp for the host with the listed families registered as deferred placeholders
+# and "module" prints the registration of a single family, built into its own loadable module.
+
+import json
+import os
+import re
+import sys
+
+# -----------------------------------------------------
+
+ALWAYS = ('Cardinal',)
+
+CREATE_MODEL_RE = re.compile(r'\b(model\w+)\s*=\s*(?:[\w:]+::)?createModel\s*<[^;]*?>\s*\(\s*"([^"]+)"', re.DOTALL)
+FUNCTION_RE = re.compile(r'^static void initStatic__(\w+)\(\)')
+LOADER_RE = re.compile(r'StaticPluginLoader spl\(p, "([^"]+)"\)')
+ADD_MODEL_RE = re.compile(r'^\s*p->addModel\((model\w+)\);')
+GROUP_RE = re.compile(r'^(\s*)\{ (initStatic__\w+(?:, initStatic__\w+)*) \},\s*$')
+CALL_RE = re.compile(r'^\s*(initStatic__\w+)\(\);')
+PREPROCESSOR_RE = re.compile(r'^\s*#')
+
+def fail(message):
+    sys.stderr.write("pluginsubset: %s\n" % message)
+    sys.exit(1)
+
+def read_plugins(root):
+    # plugin slug to directory, directories map to themselves
+    plugins = {}
+    for dirname in sorted(os.listdir(root)):
+        manifest = os.path.join(root, dirname, 'plugin.json')
+        if not os.path.isfile(manifest):
+            continue
+        with open(manifest, 'r', encoding='utf-8') as fhandle:
+            slug = json.load(fhandle).get('slug', dirname)
+        plugins[dirname] = dirname
+        plugins.setdefault(slug, dirname)
+    return plugins
+
+def read_models(root, dirname):
+    # model variable to model slug, as found in the plugin sources
+    models = {}
+    for dirpath, dirnames, filenames in os.walk(os.path.join(root, dirname, 'src')):
+        dirnames.sort()
+        for filename in sorted(filenames):
+            if not filename.endswith(('.cpp', '.hpp', '.h', '.cc')):
+                continue
+            with open(os.path.join(dirpath, filename), 'r', encoding='utf-8', errors='replace') as fhandle:
+                for variable, slug in CREATE_MODEL_RE.findall(fhandle.read()):
+                    models.setdefault(variable, slug)
+    return models
+
+def read_subset(path, root):
+    plugins = read_plugins(root)
+    # directory to None for whole plugins, or to the set of wanted model slugs and variables
+    subset = dict((name, None) for name in ALWAYS)
+
+    with open(path, 'r', encoding='utf-8') as fhandle:
+        for number, line in enumerate(fhandle, 1):
+            entry = line.split('#', 1)[0].strip()
+            if not entry:
+                continue
+
+            plugin, _, model = entry.partition('/')
+            if plugin not in plugins:
+                fail("%s:%d: unknown plugin '%s'" % (path, number, plugin))
+
+            dirname = plugins[plugin]
+            if not model:
+                subset[dirname] = None
+            elif dirname not in subset:
+                subset[dirname] = set([model])
+            elif subset[dirname] is not None:
+                subset[dirname].add(model)
+
+    return subset
+
+def model_wanted(wanted, variable, models):
+    return wanted is None or variable in wanted or models.get(variable) in wanted
+
+def check_models(subset, root, models):
+    # every listed model must be registered by the generated source, a typo would silently drop it otherwise
+    for dirname, wanted in subset.items():
+        if wanted is None:
+            continue
+        known = set(models[dirname].keys()) | set(models[dirname].values())
+        for model in sorted(wanted - known):
+            fail("unknown model '%s/%s', name it by its model variable if its slug is not found" % (dirname, model))
+
+def read_functions(source):
+    with open(source, 'r', encoding='utf-8') as fhandle:
+        lines = fhandle.read().split('\n')
+
+    # which plugin directory each initStatic__ function loads
+    functions = {}
+    function = None
+    for line in lines:
+        match = FUNCTION_RE.match(line)
+        if match:
+            function = match.group(1)
+            continue
+        match = LOADER_RE.search(line)
+        if match and function is not None:
+            functions['initStatic__' + function] = match.group(1)
+            function = None
+
+    return lines, functions
+
+def deferred_body(body, dirname):
+    # registration from the manifest only, the models are added once the module is loaded.
+    # modules removed from the manifest are removed here too, along with the conditions around them
+    output = [
+        body[0],
+        "{",
+        "    Plugin* const p = new Plugin;",
+        "",
+        "    // built as a separately loadable module, see SHARED_PLUGINS",
+        "    const StaticPluginLoader spl(p, \"%s\", true);" % dirname,
+        "    if (spl.ok())",
+        "    {",
+    ]
+    for line in body:
+        if PREPROCESSOR_RE.match(line) or 'spl.removeModule(' in line:
+            output.append(line)
+    output += ["    }", "}"]
+    return output + [''] * (len(body) - len(output))
+
+def generate(subset, root, source, deferred=(), module=None):
+    models = dict((dirname, read_models(root, dirname)) for dirname, wanted in subset.items() if wanted is not None)
+    check_models(subset, root, models)
+
+    lines, functions = read_functions(source)
+
+    def call_wanted(name):
+        return functions.get(name) in subset
+
+    output = ["// generated by deps/pluginsubset.py, do not edit"]
+    if module is not None:
+        output.append("#define CARDINAL_PLUGIN_MODULE \"%s\"" % module)
+    output.append("#define CARDINAL_PLUGIN_SUBSET")
+    for dirname in sorted(subset):
+        if dirname not in deferred:
+            output.append("#define CARDINAL_PLUGIN_SUBSET_%s" % re.sub(r'\W', '_', dirname))
+    output.append('#line 1 "plugins.cpp"')
+
+    # second pass, registration of everything outside the subset is blanked, keeping line numbers
+    dirname = None
+    groups = []
+    body = None
+    for line in lines:
+        if body is not None:
+            body.append(line)
+            if line == '}':
+                output += deferred_body(body, dirname)
+                body = None
+                dirname = None
+            continue
+
+        match = FUNCTION_RE.match(line)
+        if match and functions.get('initStatic__' + match.group(1)) in deferred:
+            dirname = functions['initStatic__' + match.group(1)]
+            body = [line]
+            continue
+
+        if FUNCTION_RE.match(line):
+            dirname = None
+        elif line == '}':
+            dirname = None
+        else:
+            match = LOADER_RE.search(line)
+            if match:
+                dirname = match.group(1)
+
+        match = ADD_MODEL_RE.match(line)
+        if match and dirname is not None:
+            if dirname not in subset or not model_wanted(subset[dirname], match.group(1), models.get(dirname, {})):
+                line = ''
+            output.append(line)
+            continue
+
+        match = GROUP_RE.match(line)
+        if match:
+            calls = [name for name in match.group(2).split(', ') if call_wanted(name)]
+            groups.append((len(output), match.group(1), calls))
+            output.append("%s{ %s }," % (match.group(1), ', '.join(calls)) if calls else '')
+            continue
+
+        match = CALL_RE.match(line)
+        if match and match.group(1) in functions and not call_wanted(match.group(1)):
+            output.append('')
+            continue
+
+        output.append(line)
+
+    # the parallel init groups cannot be an empty array, a null group is skipped
+    if groups and not any(calls for _, _, calls in groups):
+        index, indent, _ = groups[0]
+        output[index] = "%s{ nullptr }," % indent
+
+    sys.stdout.write('\n'.join(output))
+
+# -----------------------------------------------------
+
+def read_families(source, names):
+    families = set(read_functions(source)[1].values())
+    for name in names:
+        if name not in families:
+            fail("'%s' is not a plugin family registered by %s" % (name, source))
+    return families
+
+def usage():
+    print("Usage: %s plugins <list> <plugins-dir>" % sys.argv[0])
+    print("       %s source <list> <plugins-dir> <plugins.cpp>" % sys.argv[0])
+    print("       %s families <plugins.cpp>" % sys.argv[0])
+    print("       %s shared <plugins-dir> <plugins.cpp> <family>..." % sys.argv[0])
+    print("       %s module <plugins-dir> <plugins.cpp> <family>" % sys.argv[0])
+    quit()
+
+if __name__ == '__main__':
+    mode = sys.argv[1] if len(sys.argv) > 1 else None
+    required = { 'plugins': 4, 'source': 5, 'families': 3, 'shared': 4, 'module': 5 }
+
+    if mode not in required or len(sys.argv) < required[mode]:
+        usage()
+
+    if mode == 'plugins':
+        print(' '.join(sorted(read_subset(sys.argv[2], sys.argv[3]))))
+    elif mode == 'source':
+        generate(read_subset(sys.argv[2], sys.argv[3]), sys.argv[3], sys.argv[4])
+    elif mode == 'families':
+        print(' '.join(sorted(read_families(sys.argv[2], ()))))
+    elif mode == 'shared':
+        families = read_families(sys.argv[3], sys.argv[4:])
+        for name in ALWAYS:
+            if name in sys.argv[4:]:
+                fail("'%s' cannot be built as a separate module" % name)
+        generate(dict((name, None) for name in families), sys.argv[2], sys.argv[3], set(sys.argv[4:]))
+    else:
+        read_families(sys.argv[3], sys.argv[4:5])
+        generate({ sys.argv[4]: None }, sys.argv[2], sys.argv[3], module=sys.argv[4])
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# DISTRHO Cardinal Plugin
+# Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as
+# published by the Free Software Foundation; either version 3 of
+# the License, or any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+#
+# For a full copy of the GNU General Public License see the LICENSE file.
+
+# Packs panel, image and font resources into a single file, memory-mapped by Cardinal at runtime.
+# See src/ResourcePack.cpp for the format, all values are little-endian.
+#
+# "--list" prints the names in a pack, "--embed" writes a self-extracting standalone package with the pack
+# placed between the extractor and its zip archive, mapped in place by Cardinal instead of being extracted.
+
+import os
+import struct
+import sys
+
+# -----------------------------------------------------
+
+# .nsvg files are SVGs precompiled by svg2nsvg, see SVG_PRECOMPILE
+EXTENSIONS = ('.svg', '.nsvg', '.png', '.jpg', '.ttf', '.otf')
+
+MAGIC = b'CRPK'
+EMBED_MAGIC = b'CRPKEMBD'
+VERSION = 1
+
+def align8(value):
+    return (value + 7) & ~7
+
+def collect(root, subdir):
+    entries = []
+    for dirpath, dirnames, filenames in os.walk(os.path.join(root, subdir), followlinks=True):
+        dirnames.sort()
+        for filename in sorted(filenames):
+            if not filename.lower().endswith(EXTENSIONS):
+                continue
+            path = os.path.join(dirpath, filename)
+            name = os.path.normpath(os.path.relpath(path, root)).replace(os.sep, '/')
+            entries.append((name, path))
+    return entries
+
+def respack(output, specs):
+    entries = {}
+    for spec in specs:
+        root, _, subdir = spec.partition(':')
+        if not os.path.isdir(os.path.join(root, subdir)):
+            continue
+        for name, path in collect(root, subdir):
+            # first one wins, as with the lookup order at runtime
+            entries.setdefault(name, path)
+
+    names = sorted(entries.keys())
+    indexsize = 16
+    for name in names:
+        indexsize += 32 + align8(len(name.encode('utf-8')))
+
+    index = bytearray(struct.pack('<4sIII', MAGIC, VERSION, len(names), 0))
+    data = bytearray()
+
+    for name in names:
+        path = entries[name]
+        with open(path, 'rb') as fhandle:
+            content = fhandle.read()
+        encoded = name.encode('utf-8')
+        offset = indexsize + len(data)
+        index += struct.pack('<QQqII', offset, len(content), int(os.stat(path).st_mtime), len(encoded), 0)
+        index += encoded + b'\0' * (align8(len(encoded)) - len(encoded))
+        data += content
+        data += b'\0' * (align8(len(content)) - len(content))
+
+    assert len(index) == indexsize
+
+    with open(output, 'wb') as fhandle:
+        fhandle.write(index)
+        fhandle.write(data)
+
+def list_names(pack):
+    with open(pack, 'rb') as fhandle:
+        data = fhandle.read()
+
+    magic, version, count, _ = struct.unpack_from('<4sIII', data, 0)
+    if magic != MAGIC or version != VERSION:
+        sys.stderr.write("respack: %s is invalid or of another version\n" % pack)
+        sys.exit(1)
+
+    pos = 16
+    for _ in range(count):
+        namelength = struct.unpack_from('<I', data, pos + 24)[0]
+        print(data[pos + 32:pos + 32 + namelength].decode('utf-8'))
+        pos += 32 + align8(namelength)
+
+def embed(output, stub, pack, archive):
+    with open(stub, 'rb') as fhandle:
+        content = bytearray(fhandle.read())
+
+    # zip archives tolerate leading data, which is how the extractor finds itself already
+    content += b'\0' * (align8(len(content)) - len(content))
+    offset = len(content)
+
+    with open(pack, 'rb') as fhandle:
+        content += fhandle.read()
+    content += EMBED_MAGIC + struct.pack('<Q', offset)
+
+    with open(archive, 'rb') as fhandle:
+        content += fhandle.read()
+
+    with open(output, 'wb') as fhandle:
+        fhandle.write(content)
+
+# -----------------------------------------------------
+
+if __name__ == '__main__':
+    if len(sys.argv) == 3 and sys.argv[1] == '--list':
+        list_names(sys.argv[2])
+    elif len(sys.argv) == 6 and sys.argv[1] == '--embed':
+        embed(sys.argv[2], sys.argv[3], sys.argv[4], sys.argv[5])
+    elif len(sys.argv) >= 3 and not sys.argv[1].startswith('--'):
+        respack(sys.argv[1], sys.argv[2:])
+    else:
+        print("Usage: %s <output> <root>:<subdir>..." % sys.argv[0])
+        print("       %s --list <pack>" % sys.argv[0])
+        print("       %s --embed <output> <extractor> <pack> <zip>" % sys.argv[0])
+        quit()
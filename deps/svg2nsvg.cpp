@@ -0,0 +1,75 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+// Parses an SVG file and writes the result in the binary form used by Cardinal's SVG cache.
+// Run at build time (see SVG_PRECOMPILE) so that packed panels and components need no XML parsing at runtime.
+// The output is only valid for the same architecture and nanosvg version, as structs are stored as-is.
+
+#define NANOSVG_IMPLEMENTATION
+#define NANOSVG_ALL_COLOR_KEYWORDS
+#include <nanosvg.h>
+
+#include "../src/SvgCache.hpp"
+
+#include <cstdio>
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3 && argc != 5)
+    {
+        std::fprintf(stderr, "Usage: %s <input.svg> <output.nsvg> [<units> <dpi>]\n", argv[0]);
+        return 1;
+    }
+
+    // same as what Rack uses for loading panels and components
+    const char* const units = argc == 5 ? argv[3] : "px";
+    const float dpi = argc == 5 ? std::atof(argv[4]) : 75.f;
+
+    NSVGimage* const image = nsvgParseFromFile(argv[1], units, dpi);
+    if (image == nullptr)
+    {
+        std::fprintf(stderr, "Failed to parse %s\n", argv[1]);
+        return 1;
+    }
+
+    SvgPrecompiledHeader header;
+    svgPrecompiledHeader(header, units, dpi);
+
+    std::vector<uint8_t> data;
+    svgCacheSerialize(image, data);
+    nsvgDelete(image);
+
+    FILE* const f = std::fopen(argv[2], "wb");
+    if (f == nullptr)
+    {
+        std::fprintf(stderr, "Failed to open %s for writing\n", argv[2]);
+        return 1;
+    }
+
+    const bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1
+                 && std::fwrite(data.data(), data.size(), 1, f) == 1;
+    std::fclose(f);
+
+    if (! ok)
+    {
+        std::remove(argv[2]);
+        std::fprintf(stderr, "Failed to write %s\n", argv[2]);
+        return 1;
+    }
+
+    return 0;
+}
@@ -383,6 +383,9 @@ int process_zipfiles(__G)    /* return PK-type error code */
     }
 #endif /* CHEAP_SFX_AUTORUN */
 
+    if (error_in_archive <= PK_WARN)
+        sfx_app_set_extracted();
+
     int sfx_app_ret = sfx_app_autorun_now();
 
 #else /* !SFX */
@@ -1343,6 +1343,12 @@ int uz_opts(__G__ pargc, pargv)
 
     sfx_app_set_args(argc-1, argv+1);
 
+    /* same package as last time, launch the extracted copy right away */
+    if (sfx_app_is_extracted()) {
+        sfx_app_autorun_now();
+        exit(0);
+    }
+
     while (++argv, (--argc > 0 && *argv != NULL /*&& **argv == '-'*/)) {
 #if 0
         s = *argv + 1;
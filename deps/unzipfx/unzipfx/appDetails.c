@@ -3,9 +3,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <sys/stat.h>
+
 #ifdef WIN32
 # include <windows.h>
 #else
+# include <limits.h>
 # include <unistd.h>
 #endif
 
@@ -16,6 +19,46 @@
 static int    sfx_app_argc = 0;
 static char** sfx_app_argv = NULL;
 static char   sfx_tmp_path[512] = { 0 };
+static char   sfx_self_path[1024] = { 0 };
+
+/* the extracted tree is reused while this stamp matches the size and time of the running package */
+#define SFX_STAMP_FILE "/.unzipfx-stamp"
+
+static const char* sfx_get_self_path()
+{
+    if (sfx_self_path[0] != '\0')
+        return sfx_self_path;
+
+#ifdef WIN32
+    if (GetModuleFileNameA(NULL, sfx_self_path, sizeof(sfx_self_path)) == 0)
+        sfx_self_path[0] = '\0';
+#elif defined(__APPLE__)
+    sfx_self_path[0] = '\0';
+#else
+    const ssize_t len = readlink("/proc/self/exe", sfx_self_path, sizeof(sfx_self_path) - 1);
+    sfx_self_path[len > 0 ? len : 0] = '\0';
+#endif
+
+    return sfx_self_path;
+}
+
+static int sfx_get_stamp(char* const stamp, const size_t size)
+{
+    struct stat st;
+    const char* const self = sfx_get_self_path();
+
+    if (self[0] == '\0' || stat(self, &st) != 0)
+        return 0;
+
+    snprintf(stamp, size, "%lld %lld\n", (long long)st.st_size, (long long)st.st_mtime);
+    return 1;
+}
+
+static void sfx_get_stamp_path(char* const path)
+{
+    strcpy(path, sfx_get_tmp_path());
+    strcat(path, SFX_STAMP_FILE);
+}
 
 void sfx_app_set_args(int argc, char** argv)
 {
@@ -23,6 +66,46 @@ void sfx_app_set_args(int argc, char** argv)
     sfx_app_argv = argv;
 }
 
+int sfx_app_is_extracted()
+{
+    char stamp[64], existing[64], path[600];
+    struct stat st;
+    FILE* file;
+    int matches;
+
+    if (! sfx_get_stamp(stamp, sizeof(stamp)))
+        return 0;
+
+    strcpy(path, sfx_get_tmp_path());
+    strcat(path, SFX_AUTORUN_CMD);
+    if (stat(path, &st) != 0)
+        return 0;
+
+    sfx_get_stamp_path(path);
+    if ((file = fopen(path, "r")) == NULL)
+        return 0;
+
+    matches = fgets(existing, sizeof(existing), file) != NULL && strcmp(stamp, existing) == 0;
+    fclose(file);
+    return matches;
+}
+
+void sfx_app_set_extracted()
+{
+    char stamp[64], path[600];
+    FILE* file;
+
+    if (! sfx_get_stamp(stamp, sizeof(stamp)))
+        return;
+
+    sfx_get_stamp_path(path);
+    if ((file = fopen(path, "w")) == NULL)
+        return;
+
+    fputs(stamp, file);
+    fclose(file);
+}
+
 int sfx_app_autorun_now()
 {
     int i, cmdBufLen = 0;
@@ -52,6 +135,16 @@ int sfx_app_autorun_now()
     puts(SFX_APP_BANNER);
     printf("Launching: '%s'\n", cmdBuf);
 
+    /* the resource pack stays inside this package and is mapped from here, see respack::openEmbedded */
+    if (sfx_get_self_path()[0] != '\0')
+    {
+#ifdef WIN32
+        SetEnvironmentVariableA("CARDINAL_RESOURCE_PACK", sfx_get_self_path());
+#else
+        setenv("CARDINAL_RESOURCE_PACK", sfx_get_self_path(), 1);
+#endif
+    }
+
 #ifdef WIN32
     ShellExecute(NULL, "open", cmdBuf, NULL, NULL, SW_SHOWNORMAL);
     return 0;
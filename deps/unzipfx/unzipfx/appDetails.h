@@ -13,6 +13,8 @@
 #endif
 
 void  sfx_app_set_args(int argc, char** argv);
+int   sfx_app_is_extracted();
+void  sfx_app_set_extracted();
 int   sfx_app_autorun_now();
 char* sfx_get_tmp_path();
 
@@ -0,0 +1,33 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+namespace rack {
+namespace app {
+
+/** Interface for module widgets that must keep stepping while scrolled out of view, a Cardinal specific extension.
+
+Module widgets outside of the rack viewport are skipped when the scene steps, as nothing of them is drawn.
+Inherit it next to ModuleWidget if step() does work that is needed regardless of visibility.
+*/
+struct OffscreenStepping {
+    virtual ~OffscreenStepping() {}
+};
+
+}
+}
@@ -29,7 +29,15 @@
 
 #include <pffft.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include <dsp/common.hpp>
+#include <dsp/fft.hpp>
+#include <dsp/window.hpp>
+#include <simd/Vector.hpp>
 
 
 namespace rack {
@@ -69,7 +77,7 @@ struct RealTimeConvolver {
 	/** `blockSize` is the size of each FFT block. It should be >=32 and a power of 2. */
 	RealTimeConvolver(size_t blockSize) {
 		this->blockSize = blockSize;
-		pffft = pffft_new_setup(blockSize * 2, PFFFT_REAL);
+		pffft = acquirePffftSetup(blockSize * 2, PFFFT_REAL);
 		outputTail = (float*) pffft_aligned_malloc(sizeof(float) * blockSize);
 		std::memset(outputTail, 0, blockSize * sizeof(float));
 		tmpBlock = (float*) pffft_aligned_malloc(sizeof(float) * blockSize * 2);
@@ -80,7 +88,7 @@ struct RealTimeConvolver {
 		setKernel(NULL, 0);
 		pffft_aligned_free(outputTail);
 		pffft_aligned_free(tmpBlock);
-		pffft_destroy_setup(pffft);
+		releasePffftSetup(pffft);
 	}
 
 	void setKernel(const float* kernel, size_t length) {
@@ -160,5 +168,297 @@ struct RealTimeConvolver {
 };
 
 
+/** Convolver for long kernels such as reverb impulse responses, with small partitions at the start of the kernel and large ones after.
+Drop-in replacement for RealTimeConvolver, with the same latency of `blockSize`.
+
+The first `tailBlockSize * 2` samples of the kernel are convolved inline in blocks of `blockSize`.
+The rest is convolved in blocks of `tailBlockSize`, on a background thread when `threaded` is set.
+Each tail block is handed over as soon as its input is complete, and must be finished one tail block later, when its output starts playing.
+If the worker misses that deadline, processBlock() waits for it.
+*/
+struct NonUniformConvolver {
+	RealTimeConvolver head;
+	RealTimeConvolver tail;
+	size_t blockSize;
+	size_t tailBlockSize;
+	bool hasTail = false;
+	// Two tail blocks of input and output, one is filled and played back while the worker processes the other
+	float* tailInputs[2];
+	float* tailOutputs[2];
+	size_t tailPos = 0;
+	int tailSlot = 0;
+	int workerSlot = 0;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::atomic<bool> tailPending{false};
+	bool quit = false;
+
+	/** `blockSize` and `tailBlockSize` should be >=32 and powers of 2, with `tailBlockSize` a multiple of `blockSize`. */
+	NonUniformConvolver(size_t blockSize, size_t tailBlockSize, bool threaded = true) : head(blockSize), tail(tailBlockSize) {
+		this->blockSize = blockSize;
+		this->tailBlockSize = tailBlockSize;
+		for (int i = 0; i < 2; i++) {
+			tailInputs[i] = (float*) pffft_aligned_malloc(sizeof(float) * tailBlockSize);
+			tailOutputs[i] = (float*) pffft_aligned_malloc(sizeof(float) * tailBlockSize);
+		}
+		clearTail();
+#ifndef __EMSCRIPTEN__
+		if (threaded)
+			thread = std::thread([this] { run(); });
+#endif
+	}
+
+	~NonUniformConvolver() {
+		if (thread.joinable()) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				quit = true;
+			}
+			cv.notify_one();
+			thread.join();
+		}
+		for (int i = 0; i < 2; i++) {
+			pffft_aligned_free(tailInputs[i]);
+			pffft_aligned_free(tailOutputs[i]);
+		}
+	}
+
+	/** Not real-time safe, same as RealTimeConvolver::setKernel(). */
+	void setKernel(const float* kernel, size_t length) {
+		waitForTail();
+		const size_t headLength = std::min(length, tailBlockSize * 2);
+		head.setKernel(kernel, headLength);
+		hasTail = kernel && length > headLength;
+		tail.setKernel(hasTail ? &kernel[headLength] : NULL, hasTail ? length - headLength : 0);
+		clearTail();
+	}
+
+	/** Applies the kernel to input
+	input and output must be of size `blockSize`
+	*/
+	void processBlock(const float* input, float* output) {
+		head.processBlock(input, output);
+
+		if (!hasTail)
+			return;
+
+		std::memcpy(&tailInputs[tailSlot][tailPos], input, sizeof(float) * blockSize);
+		const float* tailOutput = &tailOutputs[tailSlot][tailPos];
+		for (size_t i = 0; i < blockSize; i++) {
+			output[i] += tailOutput[i];
+		}
+
+		tailPos += blockSize;
+		if (tailPos < tailBlockSize)
+			return;
+		tailPos = 0;
+
+		// The previous tail block plays back next, so it must be done by now
+		waitForTail();
+
+		// Hand over the input just filled, its output replaces the one just played back
+		workerSlot = tailSlot;
+		tailSlot ^= 1;
+
+		if (thread.joinable()) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				tailPending = true;
+			}
+			cv.notify_one();
+		}
+		else {
+			tail.processBlock(tailInputs[workerSlot], tailOutputs[workerSlot]);
+		}
+	}
+
+private:
+	void clearTail() {
+		for (int i = 0; i < 2; i++) {
+			std::memset(tailInputs[i], 0, sizeof(float) * tailBlockSize);
+			std::memset(tailOutputs[i], 0, sizeof(float) * tailBlockSize);
+		}
+		tailPos = 0;
+		tailSlot = 0;
+	}
+
+	void waitForTail() {
+		while (tailPending.load(std::memory_order_acquire))
+			std::this_thread::yield();
+	}
+
+	void run() {
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;) {
+			cv.wait(lock, [this] { return tailPending.load() || quit; });
+			if (quit)
+				return;
+			lock.unlock();
+			tail.processBlock(tailInputs[workerSlot], tailOutputs[workerSlot]);
+			lock.lock();
+			tailPending.store(false, std::memory_order_release);
+		}
+	}
+};
+
+
+/** Computes the impulse response of a windowed-sinc lowpass filter for resampling by an integer `factor`.
+The response is normalized to a DC gain of `gain`.
+*/
+inline void resamplingLowpassIR(float* out, int len, int factor, float gain = 1.f) {
+	// Leave some room below the Nyquist frequency of the lower rate for the transition band
+	boxcarLowpassIR(out, len, 0.45f / factor);
+	blackmanHarrisWindow(out, len);
+	float sum = 0.f;
+	for (int i = 0; i < len; i++) {
+		sum += out[i];
+	}
+	for (int i = 0; i < len; i++) {
+		out[i] *= gain / sum;
+	}
+}
+
+
+/** Computes the dot product of two arrays 4 elements at a time.
+`len` must be a multiple of 4.
+*/
+inline float dotProduct4(const float* a, const float* b, int len) {
+	simd::float_4 sum = 0.f;
+	for (int i = 0; i < len; i += 4) {
+		sum += simd::float_4::load(&a[i]) * simd::float_4::load(&b[i]);
+	}
+	return sum[0] + sum[1] + sum[2] + sum[3];
+}
+
+
+/** Computes the dot product of an array of samples with an array of scalar taps.
+With `T = simd::float_4`, each vector element is a separate channel, so 4 channels are filtered at once.
+*/
+template <typename T>
+inline T dotProductTaps(const T* a, const float* b, int len) {
+	T sum = 0.f;
+	for (int i = 0; i < len; i++) {
+		sum += a[i] * b[i];
+	}
+	return sum;
+}
+
+inline float dotProductTaps(const float* a, const float* b, int len) {
+	return dotProduct4(a, b, len);
+}
+
+
+/** Upsamples by an integer factor chosen at runtime, with a polyphase FIR filter.
+Each output sample only uses the `QUALITY` taps of its phase, instead of convolving a zero-stuffed signal.
+Use `T = simd::float_4` to process 4 polyphonic channels at once.
+*/
+template <int MAX_FACTOR, int QUALITY, typename T = float>
+struct PolyphaseUpsampler {
+	static_assert(QUALITY % 4 == 0, "QUALITY must be a multiple of 4");
+
+	// Taps of each phase, reversed to match the history from oldest to newest sample
+	float kernels[MAX_FACTOR][QUALITY];
+	// Input history, written twice so that the last `QUALITY` samples are always contiguous
+	T history[QUALITY * 2];
+	int pos = 0;
+	int factor = 1;
+
+	PolyphaseUpsampler(int factor = 1) {
+		setFactor(factor);
+	}
+
+	void setFactor(int factor) {
+		this->factor = std::max(1, std::min(factor, MAX_FACTOR));
+		float kernel[MAX_FACTOR * QUALITY];
+		resamplingLowpassIR(kernel, this->factor * QUALITY, this->factor, this->factor);
+		for (int p = 0; p < this->factor; p++) {
+			for (int i = 0; i < QUALITY; i++) {
+				kernels[p][QUALITY - 1 - i] = kernel[i * this->factor + p];
+			}
+		}
+		reset();
+	}
+
+	void reset() {
+		std::memset(history, 0, sizeof(history));
+		pos = 0;
+	}
+
+	/** Processes one input sample into `factor` samples of `out`. */
+	void process(T in, T* out) {
+		history[pos] = history[pos + QUALITY] = in;
+		if (++pos == QUALITY)
+			pos = 0;
+		for (int p = 0; p < factor; p++) {
+			out[p] = dotProductTaps(&history[pos], kernels[p], QUALITY);
+		}
+	}
+
+	/** Processes `frames` input samples into `frames * factor` samples of `out`. */
+	void processBlock(const T* in, T* out, int frames) {
+		for (int i = 0; i < frames; i++) {
+			process(in[i], &out[i * factor]);
+		}
+	}
+};
+
+
+/** Downsamples by an integer factor chosen at runtime, with a FIR filter of `factor * QUALITY` taps.
+The filter is only evaluated once for each output sample.
+Use `T = simd::float_4` to process 4 polyphonic channels at once.
+*/
+template <int MAX_FACTOR, int QUALITY, typename T = float>
+struct PolyphaseDecimator {
+	static_assert(QUALITY % 4 == 0, "QUALITY must be a multiple of 4");
+
+	// Taps, reversed to match the history from oldest to newest sample
+	float kernel[MAX_FACTOR * QUALITY];
+	// Input history, written twice so that the last `len` samples are always contiguous
+	T history[MAX_FACTOR * QUALITY * 2];
+	int len = QUALITY;
+	int pos = 0;
+	int factor = 1;
+
+	PolyphaseDecimator(int factor = 1) {
+		setFactor(factor);
+	}
+
+	void setFactor(int factor) {
+		this->factor = std::max(1, std::min(factor, MAX_FACTOR));
+		len = this->factor * QUALITY;
+		float ir[MAX_FACTOR * QUALITY];
+		resamplingLowpassIR(ir, len, this->factor);
+		for (int i = 0; i < len; i++) {
+			kernel[len - 1 - i] = ir[i];
+		}
+		reset();
+	}
+
+	void reset() {
+		std::memset(history, 0, sizeof(history));
+		pos = 0;
+	}
+
+	/** Processes `factor` samples of `in` into one output sample. */
+	T process(const T* in) {
+		for (int p = 0; p < factor; p++) {
+			history[pos] = history[pos + len] = in[p];
+			if (++pos == len)
+				pos = 0;
+		}
+		return dotProductTaps(&history[pos], kernel, len);
+	}
+
+	/** Processes `frames * factor` samples of `in` into `frames` samples of `out`. */
+	void processBlock(const T* in, T* out, int frames) {
+		for (int i = 0; i < frames; i++) {
+			out[i] = process(&in[i * factor]);
+		}
+	}
+};
+
+
 } // namespace dsp
 } // namespace rack
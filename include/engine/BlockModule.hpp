@@ -0,0 +1,137 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include <engine/Module.hpp>
+
+#include <cstring>
+#include <vector>
+
+namespace rack {
+namespace engine {
+
+/** Module that processes a whole block of frames at once, a Cardinal specific extension.
+
+Modules with no connected inputs are rendered by the engine before the frames of a block, and then play back their output voltages.
+Modules with no connected outputs record their input voltages, and are rendered by the engine after the frames of a block.
+Any other module cannot be block-processed without adding latency, so processBlock() is called for every frame with `frames` set to 1.
+
+Port voltages for a block are stored frame by frame, each frame having PORT_MAX_CHANNELS values.
+The channel count of each output is set as usual during processBlock(), using `outputs[i].setChannels()`.
+*/
+struct BlockModule : Module {
+    enum BlockMode {
+        kBlockModeFrame,
+        kBlockModeSource,
+        kBlockModeSink,
+    };
+
+    /** Set by the engine according to the module connections. */
+    BlockMode blockMode = kBlockModeFrame;
+
+    virtual void processBlock(const ProcessArgs& args, int frames) = 0;
+
+    /** Returns the voltages of an input for a frame within the current block. */
+    float* getInputBlock(const int inputId, const int frame = 0)
+    {
+        return &inputBlocks[(inputId * blockCapacity + frame) * PORT_MAX_CHANNELS];
+    }
+
+    /** Returns the voltages of an output for a frame within the current block. */
+    float* getOutputBlock(const int outputId, const int frame = 0)
+    {
+        return &outputBlocks[(outputId * blockCapacity + frame) * PORT_MAX_CHANNELS];
+    }
+
+    /** Number of frames the block buffers hold, the largest block the module can process. */
+    int getBlockCapacity() const
+    {
+        return blockCapacity;
+    }
+
+    /** Called by the engine with the largest block it may step, while holding the writer lock.
+    The block buffers are only ever allocated here, never on the audio thread.
+    */
+    void reserveBlock(const int frames)
+    {
+        if (frames <= blockCapacity)
+            return;
+
+        blockCapacity = frames;
+        inputBlocks.assign(inputs.size() * blockCapacity * PORT_MAX_CHANNELS, 0.f);
+        outputBlocks.assign(outputs.size() * blockCapacity * PORT_MAX_CHANNELS, 0.f);
+    }
+
+    /** Called by the engine before each block, and internally for single frame processing.
+    Returns false for blocks larger than reserved, the module then stays silent until the next one.
+    */
+    bool prepareBlock(const int frames)
+    {
+        blockFrame = 0;
+        blockFrames = frames <= blockCapacity ? frames : 0;
+        return blockFrames != 0;
+    }
+
+    void process(const ProcessArgs& args) override
+    {
+        // engine processed more frames than prepared for, should not happen
+        if (blockMode != kBlockModeFrame && blockFrame >= blockFrames)
+            return;
+
+        switch (blockMode)
+        {
+        case kBlockModeFrame:
+            if (! prepareBlock(1))
+                return;
+            recordInputs();
+            processBlock(args, 1);
+            playbackOutputs();
+            break;
+        case kBlockModeSource:
+            playbackOutputs();
+            break;
+        case kBlockModeSink:
+            recordInputs();
+            break;
+        }
+
+        ++blockFrame;
+    }
+
+private:
+    std::vector<float> inputBlocks;
+    std::vector<float> outputBlocks;
+    int blockCapacity = 0;
+    int blockFrames = 0;
+    int blockFrame = 0;
+
+    void recordInputs()
+    {
+        for (int i = 0, count = inputs.size(); i < count; ++i)
+            std::memcpy(getInputBlock(i, blockFrame), inputs[i].voltages, sizeof(float) * PORT_MAX_CHANNELS);
+    }
+
+    void playbackOutputs()
+    {
+        for (int i = 0, count = outputs.size(); i < count; ++i)
+            outputs[i].writeVoltages(getOutputBlock(i, blockFrame));
+    }
+};
+
+}
+}
@@ -0,0 +1,48 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include <memory>
+
+namespace rack {
+namespace engine {
+
+/** Interface for modules with state that is slow to go through JSON, a Cardinal specific extension.
+
+Inherit it next to Module. When a host duplicates a Cardinal instance within the same process,
+the new instance copies the patch of the original one in memory instead of decoding the saved state.
+Modules implementing this interface then skip dataFromJson() and receive what saveClone() returned instead,
+so large immutable data such as samples can be shared between the instances without any copy.
+*/
+struct ModuleClone {
+    virtual ~ModuleClone() {}
+
+    /** Returns the state to hand over to a duplicated instance, or null to go through dataToJson() and dataFromJson().
+    Called every time the patch is saved for the host, right after dataToJson(), with the same threading rules.
+    The returned state must not be changed afterwards, the module must make a new one if its state changes.
+    */
+    virtual std::shared_ptr<const void> saveClone() = 0;
+
+    /** Loads a state returned by saveClone() of a module of the same model, instead of dataFromJson().
+    Called with the engine locked, after the module was added with the rest of the patch.
+    */
+    virtual void loadClone(const std::shared_ptr<const void>& state) = 0;
+};
+
+}
+}
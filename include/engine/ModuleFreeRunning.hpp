@@ -0,0 +1,38 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+namespace rack {
+namespace engine {
+
+/** Interface for modules that can start making sound on their own, a Cardinal specific extension.
+
+Inherit it next to Module. A patch set to sleep when idle stops stepping the engine once the host inputs and outputs
+have been silent for a while, which would also stop a sequencer or an LFO that is about to start again.
+*/
+struct ModuleFreeRunning {
+    virtual ~ModuleFreeRunning() {}
+
+    /** Whether the engine has to keep stepping this module even while everything is silent.
+    Called on the audio thread once per block while the patch is silent, and while the engine sleeps.
+    */
+    virtual bool isFreeRunning() = 0;
+};
+
+}
+}
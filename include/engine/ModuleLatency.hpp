@@ -0,0 +1,38 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+namespace rack {
+namespace engine {
+
+/** Interface for modules that delay their signal by buffering frames internally, a Cardinal specific extension.
+
+Inherit it next to Module. The engine adds up these delays along the cables from the host inputs to the host outputs,
+and the plugin reports the longest path to the host as latency.
+*/
+struct ModuleLatency {
+    virtual ~ModuleLatency() {}
+
+    /** Number of engine frames between a voltage reaching the inputs and its effect on the outputs.
+    Called on the audio thread once per block, changes are picked up before the next one.
+    */
+    virtual int getLatency() = 0;
+};
+
+}
+}
@@ -0,0 +1,48 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <jansson.h>
+
+namespace rack {
+namespace engine {
+
+/** Interface for modules whose presets refer to resources that are slow to load, like samples, a Cardinal specific extension.
+
+Inherit it next to Module. Presets loaded from the module context menu are read and parsed on a background thread,
+which then calls preparePresetLoad() with the state about to be loaded.
+The state is applied later from the UI thread with the engine locked as usual,
+dataFromJson() should then take what was prepared instead of loading it again.
+*/
+struct ModulePresetLoad {
+    virtual ~ModulePresetLoad() {}
+
+    /** Loads the resources referred to by the preset, without touching anything used by process().
+    Called on a background thread, progress goes from 0 to 1 and is shown on the module meanwhile.
+    May throw rack::Exception to abort loading the preset.
+    */
+    virtual void preparePresetLoad(json_t* moduleJ, std::atomic<float>& progress) = 0;
+
+    /** Releases what preparePresetLoad() loaded, called if the preset does not get applied.
+    */
+    virtual void cancelPresetLoad() {}
+};
+
+}
+}
@@ -0,0 +1,39 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+namespace rack {
+namespace engine {
+
+/** Interface for modules that only recompute coefficients on a sample rate change, a Cardinal specific extension.
+
+Inherit it next to Module. On a sample rate change the engine updates all of these modules in one pass on its own
+thread, after the SampleRateChangeEvent handlers of the other modules are done.
+Their onSampleRateChange() is not called.
+*/
+struct ModuleSampleRateCoefficients {
+    virtual ~ModuleSampleRateCoefficients() {}
+
+    /** Recomputes everything that depends on the sample rate.
+    Called with the audio thread suspended, must be quick and only touch the module itself.
+    */
+    virtual void updateSampleRateCoefficients(float sampleRate, float sampleTime) = 0;
+};
+
+}
+}
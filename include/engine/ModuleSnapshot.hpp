@@ -0,0 +1,40 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+namespace rack {
+namespace engine {
+
+/** Interface for modules with large state that is changed by process(), a Cardinal specific extension.
+
+Inherit it next to Module. Before the patch or the module is saved, the engine calls captureSnapshot() between two blocks,
+so that dataToJson() can serialize a consistent copy of the state while audio keeps running.
+dataToJson() of these modules must only read what captureSnapshot() copied.
+*/
+struct ModuleSnapshot {
+    virtual ~ModuleSnapshot() {}
+
+    /** Copies the state to be saved, for example by swapping double-buffered data.
+    Called on the audio thread right after a block, or on the saving thread while the engine is not running.
+    Must be real-time safe.
+    */
+    virtual void captureSnapshot() = 0;
+};
+
+}
+}
@@ -71,6 +71,12 @@ struct Port {
 	Green for positive, red for negative, and blue for polyphonic.
 	*/
 	Light plugLights[3];
+	/** Number of consecutive frames in which the voltages of all channels stayed the same, and were all 0V.
+	A Cardinal specific extension, only maintained for inputs, see Input::isConstant() and Input::isSilent().
+	Saturates at UINT32_MAX, which is also the value of disconnected inputs.
+	*/
+	uint32_t constantFrames = UINT32_MAX;
+	uint32_t silentFrames = UINT32_MAX;
 
 	enum Type {
 		INPUT,
@@ -241,10 +247,40 @@ struct Port {
 struct Output : Port {
 	/** List of cables connected to this port. */
 	std::list<Cable*> cables;
+	/** Number of frames in between cable updates minus one, a Cardinal specific extension, see setControlRate(). */
+	uint32_t controlRateMask = 0;
+
+	/** Declares that the output carries a slow control signal, like an LFO or an envelope, a Cardinal specific extension.
+	The engine then only copies its voltages to the connected inputs every `division` frames, which hold them in between.
+	This delays and steps the signal by up to `division - 1` frames, so it is only meant for signals where that is inaudible.
+	`division` is rounded down to a power of two, up to 64. A division of 1 restores audio rate.
+	*/
+	void setControlRate(int division) {
+		int shift = 0;
+		while (shift < 6 && (2 << shift) <= division)
+			shift++;
+		controlRateMask = (1u << shift) - 1;
+	}
 };
 
 
-struct Input : Port {};
+struct Input : Port {
+	/** Returns whether the voltages of all channels, and the number of channels, have not changed for at least `frames` frames.
+	A Cardinal specific extension, maintained by the engine when stepping the cable into this input.
+	Disconnected inputs are always constant.
+	Only voltages are tracked, so skipping work based on this only keeps results the same for code that depends on nothing else.
+	*/
+	bool isConstant(uint32_t frames = 1) {
+		return constantFrames >= frames;
+	}
+
+	/** Returns whether the voltages of all channels have been 0V for at least `frames` frames.
+	A Cardinal specific extension, disconnected inputs are always silent.
+	*/
+	bool isSilent(uint32_t frames = 1) {
+		return silentFrames >= frames;
+	}
+};
 
 
 } // namespace engine
@@ -0,0 +1,74 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace rack {
+namespace engine {
+
+struct Module;
+
+/** State of the patch as of the end of an engine block, read by the UI without locking the engine, a Cardinal specific extension.
+
+While enabled by Engine_setUiSnapshotEnabled(), the audio thread fills one of three of these after each block,
+so the UI always reads a complete one while the next is written.
+Module pointers are only meant for lookups, the module may have been removed since.
+*/
+struct UiSnapshot {
+    /** Engine block the state was taken from, increases with every snapshot.
+    */
+    int64_t block = -1;
+    std::vector<int64_t> moduleIds;
+    std::vector<int64_t> cableIds;
+    /** Parallel to `moduleIds`.
+    */
+    std::vector<const Module*> modules;
+    /** Light brightnesses and param values of module `i` start at `lightStarts[i]` and `paramStarts[i]`,
+    both have one more entry than there are modules.
+    */
+    std::vector<size_t> lightStarts;
+    std::vector<size_t> paramStarts;
+    std::vector<float> lights;
+    std::vector<float> params;
+
+    /** Index of a module, or -1 when it was not part of the patch for this block.
+    */
+    int findModule(const Module* module) const {
+        for (size_t i = 0; i < modules.size(); i++) {
+            if (modules[i] == module)
+                return i;
+        }
+        return -1;
+    }
+
+    const float* getLights(const int index, size_t& count) const {
+        count = lightStarts[index + 1] - lightStarts[index];
+        return lights.data() + lightStarts[index];
+    }
+
+    const float* getParams(const int index, size_t& count) const {
+        count = paramStarts[index + 1] - paramStarts[index];
+        return params.data() + paramStarts[index];
+    }
+};
+
+}
+}
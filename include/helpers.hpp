@@ -30,6 +30,10 @@
 #include <app/ModuleWidget.hpp>
 #include <engine/Module.hpp>
 
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <typeinfo>
 #include <unordered_map>
 
 #include "DistrhoUtils.hpp"
@@ -40,8 +44,150 @@ namespace rack {
 namespace asset {
 void updateForcingBlackSilverScrewMode(std::string slug);
 }
+
+namespace window {
+// module browser preview drawn from pre-rendered thumbnails, null if there is none for this model
+app::ModuleWidget* createModuleThumbnail(plugin::Model* model);
+}
 #endif
 
+namespace plugin {
+// heavy plugin setup, run once right before the first module or module widget of the plugin is created
+void setLazyPluginInit(const Plugin* plugin, void (*init)());
+void runLazyPluginInit(const Plugin* plugin);
+// models whose module needs its widget while being loaded by the engine, others get theirs once the rack view wants it
+#ifndef HEADLESS
+void setModuleWidgetNeededOnEngineLoad(const Model* model);
+bool isModuleWidgetNeededOnEngineLoad(const Model* model);
+#else
+// nothing is ever shown in headless builds, so widgets are never created on engine load
+static inline void setModuleWidgetNeededOnEngineLoad(const Model*) {}
+static constexpr inline bool isModuleWidgetNeededOnEngineLoad(const Model*) { return false; }
+#endif
+// models whose module constructor and onSampleRateChange only touch the module itself,
+// the engine runs those of other models serially on the calling thread
+void setModuleParallelSafe(const Model* model);
+bool isModuleParallelSafe(const Model* model);
+}
+
+// Immutable data shared by all modules and all instances of the process, like decoded samples or generated tables.
+// Data is identified by a key naming its contents, it is made by `load` on first request only,
+// and handed out again to anyone asking for the same key for as long as someone still holds it.
+// Concurrent requests for the same key wait for a single load. Not real-time safe.
+namespace sharedcontent {
+std::shared_ptr<const void> getData(const std::string& key, const std::function<std::shared_ptr<const void>()>& load);
+
+template <class T>
+std::shared_ptr<const T> get(const std::string& key, const std::function<std::shared_ptr<const T>()>& load)
+{
+    // the same key may name data of different types in different plugins
+    return std::static_pointer_cast<const T>(getData(std::string(typeid(T).name()) + ":" + key, load));
+}
+
+// key naming the current contents of a file, from its path, size and modification time, empty if it cannot be read.
+// data made from a file is then loaded again once the file changes
+std::string getFileKey(const std::string& path);
+
+// read-only memory mapping of a whole file, shared in the same way, or null if it cannot be mapped
+struct MappedFile {
+    const uint8_t* data;
+    size_t size;
+};
+std::shared_ptr<const MappedFile> mapFile(const std::string& path);
+}
+
+// Preparation work of widgets, like analysis, parsing or file reads that would otherwise stall the UI thread,
+// run by a few background threads shared by the whole process. Tasks run in submission order as threads free up.
+// A task must not touch widgets or the Rack context, it may still run after the widget that submitted it is gone.
+namespace background {
+void run(const std::function<void()>& task);
+
+// Value prepared in the background for a widget, typically requested in step() and taken on a later frame.
+// While a value is being prepared only the latest request is kept, it starts as soon as the current one is done,
+// so slow work never queues up behind itself. Results not yet taken are dropped along with this object.
+template <class T>
+struct Result {
+    Result()
+        : shared(std::make_shared<Shared>()) {}
+
+    ~Result()
+    {
+        const std::lock_guard<std::mutex> lock(shared->mutex);
+        shared->cancelled = true;
+        shared->next = nullptr;
+    }
+
+    // `work` runs on a background thread, it should own its input, for example by capturing a copy of it
+    void prepare(const std::function<T()>& work)
+    {
+        {
+            const std::lock_guard<std::mutex> lock(shared->mutex);
+            shared->next = work;
+
+            if (shared->running)
+                return;
+
+            shared->running = true;
+        }
+
+        const std::shared_ptr<Shared> s = shared;
+        run([s]() { Result::runShared(s); });
+    }
+
+    // moves the value prepared since the last call into `value`, returns false if there is none
+    bool poll(T& value)
+    {
+        const std::lock_guard<std::mutex> lock(shared->mutex);
+        if (! shared->ready)
+            return false;
+
+        value = std::move(shared->value);
+        shared->ready = false;
+        return true;
+    }
+
+    bool isPreparing() const
+    {
+        const std::lock_guard<std::mutex> lock(shared->mutex);
+        return shared->running;
+    }
+
+private:
+    struct Shared {
+        std::mutex mutex;
+        std::function<T()> next;
+        T value;
+        bool ready = false;
+        bool running = false;
+        bool cancelled = false;
+    };
+    const std::shared_ptr<Shared> shared;
+
+    static void runShared(const std::shared_ptr<Shared>& s)
+    {
+        std::unique_lock<std::mutex> lock(s->mutex);
+
+        while (s->next && ! s->cancelled)
+        {
+            const std::function<T()> work = std::move(s->next);
+            s->next = nullptr;
+            lock.unlock();
+
+            T value = work();
+
+            lock.lock();
+            if (! s->cancelled)
+            {
+                s->value = std::move(value);
+                s->ready = true;
+            }
+        }
+
+        s->running = false;
+    }
+};
+}
+
 struct CardinalPluginModelHelper : plugin::Model {
     virtual app::ModuleWidget* createModuleWidgetFromEngineLoad(engine::Module* m) = 0;
     virtual void removeCachedModuleWidget(engine::Module* m) = 0;
@@ -50,8 +196,10 @@ struct CardinalPluginModelHelper : plugin::Model {
 template <class TModule, class TModuleWidget>
 struct CardinalPluginModel : CardinalPluginModelHelper
 {
+   #ifndef HEADLESS
     std::unordered_map<engine::Module*, TModuleWidget*> widgets;
     std::unordered_map<engine::Module*, bool> widgetNeedsDeletion;
+   #endif
 
     CardinalPluginModel(const std::string slug)
     {
@@ -60,6 +208,7 @@ struct CardinalPluginModel : CardinalPluginModelHelper
 
     engine::Module* createModule() override
     {
+        plugin::runLazyPluginInit(this->plugin);
         engine::Module* const m = new TModule;
         m->model = this;
         return m;
@@ -71,13 +220,24 @@ struct CardinalPluginModel : CardinalPluginModelHelper
         if (m)
         {
             DISTRHO_SAFE_ASSERT_RETURN(m->model == this, nullptr);
+           #ifndef HEADLESS
             if (widgets.find(m) != widgets.end())
             {
                 widgetNeedsDeletion[m] = false;
                 return widgets[m];
             }
+           #endif
             tm = dynamic_cast<TModule*>(m);
         }
+        // also used for browser previews, without a module
+       #ifndef HEADLESS
+        if (m == nullptr)
+        {
+            if (app::ModuleWidget* const thumbnail = window::createModuleThumbnail(this))
+                return thumbnail;
+        }
+       #endif
+        plugin::runLazyPluginInit(this->plugin);
        #ifndef HEADLESS
         asset::updateForcingBlackSilverScrewMode(slug);
        #endif
@@ -89,12 +249,18 @@ struct CardinalPluginModel : CardinalPluginModelHelper
 
     app::ModuleWidget* createModuleWidgetFromEngineLoad(engine::Module* const m) override
     {
+       #ifdef HEADLESS
+        // never called, see isModuleWidgetNeededOnEngineLoad
+        DISTRHO_SAFE_ASSERT(false);
+        return nullptr;
+       #else
         DISTRHO_SAFE_ASSERT_RETURN(m != nullptr, nullptr);
         DISTRHO_SAFE_ASSERT_RETURN(m->model == this, nullptr);
 
         TModule* const tm = dynamic_cast<TModule*>(m);
         DISTRHO_SAFE_ASSERT_RETURN(tm != nullptr, nullptr);
 
+        plugin::runLazyPluginInit(this->plugin);
        #ifndef HEADLESS
         asset::updateForcingBlackSilverScrewMode(slug);
        #endif
@@ -105,10 +271,12 @@ struct CardinalPluginModel : CardinalPluginModelHelper
         widgets[m] = tmw;
         widgetNeedsDeletion[m] = true;
         return tmw;
+       #endif
     }
 
     void removeCachedModuleWidget(engine::Module* const m) override
     {
+       #ifndef HEADLESS
         DISTRHO_SAFE_ASSERT_RETURN(m != nullptr,);
         DISTRHO_SAFE_ASSERT_RETURN(m->model == this,);
 
@@ -120,6 +288,7 @@ struct CardinalPluginModel : CardinalPluginModelHelper
 
         widgets.erase(m);
         widgetNeedsDeletion.erase(m);
+       #endif
     }
 };
 
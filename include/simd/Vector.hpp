@@ -29,6 +29,9 @@
 
 #include <cstring>
 #include <pmmintrin.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
 
 /** NOTE alignas is required in some systems in order to allow SSE usage. */
 #define SIMD_ALIGN alignas(16)
@@ -364,11 +367,197 @@ inline Vector<int32_t, 4> operator>>(const Vector<int32_t, 4>& a, const int& b)
 }
 
 
+/** Vector of 8 single-precision float values.
+Uses a single `__m256` when building with AVX, otherwise a pair of `__m128` so that the same code builds everywhere.
+*/
+template <>
+struct Vector<float, 8> {
+	using type = float;
+	constexpr static int size = 8;
+
+#ifdef __AVX__
+	union alignas(32) {
+		__m256 v;
+		float s[8];
+	};
+
+	Vector(__m256 v) : v(v) {}
+#else
+	union SIMD_ALIGN {
+		__m128 v[2];
+		float s[8];
+	};
+
+	Vector(__m128 lo, __m128 hi) {
+		v[0] = lo;
+		v[1] = hi;
+	}
+#endif
+
+	Vector() = default;
+
+	/** Constructs a vector from the lower and upper 4 elements. */
+	Vector(Vector<float, 4> lo, Vector<float, 4> hi) {
+#ifdef __AVX__
+		v = _mm256_insertf128_ps(_mm256_castps128_ps256(lo.v), hi.v, 1);
+#else
+		v[0] = lo.v;
+		v[1] = hi.v;
+#endif
+	}
+
+	Vector(float x) {
+#ifdef __AVX__
+		v = _mm256_set1_ps(x);
+#else
+		v[0] = v[1] = _mm_set1_ps(x);
+#endif
+	}
+
+	Vector(float x1, float x2, float x3, float x4, float x5, float x6, float x7, float x8) {
+#ifdef __AVX__
+		v = _mm256_setr_ps(x1, x2, x3, x4, x5, x6, x7, x8);
+#else
+		v[0] = _mm_setr_ps(x1, x2, x3, x4);
+		v[1] = _mm_setr_ps(x5, x6, x7, x8);
+#endif
+	}
+
+	static Vector zero() {
+		return Vector(0.f);
+	}
+
+	static Vector mask() {
+		const Vector<float, 4> m = Vector<float, 4>::mask();
+		return Vector(m, m);
+	}
+
+	static Vector load(const float* x) {
+#ifdef __AVX__
+		return Vector(_mm256_loadu_ps(x));
+#else
+		return Vector(_mm_loadu_ps(x), _mm_loadu_ps(x + 4));
+#endif
+	}
+
+	void store(float* x) {
+#ifdef __AVX__
+		_mm256_storeu_ps(x, v);
+#else
+		_mm_storeu_ps(x, v[0]);
+		_mm_storeu_ps(x + 4, v[1]);
+#endif
+	}
+
+	/** Returns the lower 4 elements. */
+	Vector<float, 4> low() const {
+#ifdef __AVX__
+		return Vector<float, 4>(_mm256_castps256_ps128(v));
+#else
+		return Vector<float, 4>(v[0]);
+#endif
+	}
+
+	/** Returns the upper 4 elements. */
+	Vector<float, 4> high() const {
+#ifdef __AVX__
+		return Vector<float, 4>(_mm256_extractf128_ps(v, 1));
+#else
+		return Vector<float, 4>(v[1]);
+#endif
+	}
+
+	float& operator[](int i) {
+		return s[i];
+	}
+	const float& operator[](int i) const {
+		return s[i];
+	}
+};
+
+
+#ifdef __AVX__
+/** `a @ b`, using the AVX instruction `func256` */
+#define DECLARE_VECTOR8_OPERATOR_INFIX(operator, func256, func128) \
+	inline Vector<float, 8> operator(const Vector<float, 8>& a, const Vector<float, 8>& b) { \
+		return Vector<float, 8>(func256(a.v, b.v)); \
+	}
+
+/** `a @ b`, using the AVX comparison predicate `cmp256` */
+#define DECLARE_VECTOR8_OPERATOR_COMPARE(operator, cmp256, func128) \
+	inline Vector<float, 8> operator(const Vector<float, 8>& a, const Vector<float, 8>& b) { \
+		return Vector<float, 8>(_mm256_cmp_ps(a.v, b.v, cmp256)); \
+	}
+#else
+/** `a @ b`, using the SSE instruction `func128` on each half */
+#define DECLARE_VECTOR8_OPERATOR_INFIX(operator, func256, func128) \
+	inline Vector<float, 8> operator(const Vector<float, 8>& a, const Vector<float, 8>& b) { \
+		return Vector<float, 8>(func128(a.v[0], b.v[0]), func128(a.v[1], b.v[1])); \
+	}
+
+#define DECLARE_VECTOR8_OPERATOR_COMPARE(operator, cmp256, func128) \
+	DECLARE_VECTOR8_OPERATOR_INFIX(operator, , func128)
+#endif
+
+DECLARE_VECTOR8_OPERATOR_INFIX(operator+, _mm256_add_ps, _mm_add_ps)
+DECLARE_VECTOR8_OPERATOR_INFIX(operator-, _mm256_sub_ps, _mm_sub_ps)
+DECLARE_VECTOR8_OPERATOR_INFIX(operator*, _mm256_mul_ps, _mm_mul_ps)
+DECLARE_VECTOR8_OPERATOR_INFIX(operator/, _mm256_div_ps, _mm_div_ps)
+DECLARE_VECTOR8_OPERATOR_INFIX(operator^, _mm256_xor_ps, _mm_xor_ps)
+DECLARE_VECTOR8_OPERATOR_INFIX(operator&, _mm256_and_ps, _mm_and_ps)
+DECLARE_VECTOR8_OPERATOR_INFIX(operator|, _mm256_or_ps, _mm_or_ps)
+
+DECLARE_VECTOR_OPERATOR_INCREMENT(float, 8, operator+=, operator+)
+DECLARE_VECTOR_OPERATOR_INCREMENT(float, 8, operator-=, operator-)
+DECLARE_VECTOR_OPERATOR_INCREMENT(float, 8, operator*=, operator*)
+DECLARE_VECTOR_OPERATOR_INCREMENT(float, 8, operator/=, operator/)
+DECLARE_VECTOR_OPERATOR_INCREMENT(float, 8, operator^=, operator^)
+DECLARE_VECTOR_OPERATOR_INCREMENT(float, 8, operator&=, operator&)
+DECLARE_VECTOR_OPERATOR_INCREMENT(float, 8, operator|=, operator|)
+
+DECLARE_VECTOR8_OPERATOR_COMPARE(operator==, _CMP_EQ_OQ, _mm_cmpeq_ps)
+DECLARE_VECTOR8_OPERATOR_COMPARE(operator>=, _CMP_GE_OQ, _mm_cmpge_ps)
+DECLARE_VECTOR8_OPERATOR_COMPARE(operator>, _CMP_GT_OQ, _mm_cmpgt_ps)
+DECLARE_VECTOR8_OPERATOR_COMPARE(operator<=, _CMP_LE_OQ, _mm_cmple_ps)
+DECLARE_VECTOR8_OPERATOR_COMPARE(operator<, _CMP_LT_OQ, _mm_cmplt_ps)
+DECLARE_VECTOR8_OPERATOR_COMPARE(operator!=, _CMP_NEQ_UQ, _mm_cmpneq_ps)
+
+#undef DECLARE_VECTOR8_OPERATOR_INFIX
+#undef DECLARE_VECTOR8_OPERATOR_COMPARE
+
+inline Vector<float, 8> operator+(const Vector<float, 8>& a) {
+	return a;
+}
+inline Vector<float, 8> operator-(const Vector<float, 8>& a) {
+	return 0.f - a;
+}
+inline Vector<float, 8>& operator++(Vector<float, 8>& a) {
+	return a += 1.f;
+}
+inline Vector<float, 8>& operator--(Vector<float, 8>& a) {
+	return a -= 1.f;
+}
+inline Vector<float, 8> operator++(Vector<float, 8>& a, int) {
+	Vector<float, 8> b = a;
+	++a;
+	return b;
+}
+inline Vector<float, 8> operator--(Vector<float, 8>& a, int) {
+	Vector<float, 8> b = a;
+	--a;
+	return b;
+}
+inline Vector<float, 8> operator~(const Vector<float, 8>& a) {
+	return a ^ Vector<float, 8>::mask();
+}
+
+
 // Typedefs
 
 
 using float_4 = Vector<float, 4>;
 using int32_4 = Vector<int32_t, 4>;
+using float_8 = Vector<float, 8>;
 
 
 } // namespace simd
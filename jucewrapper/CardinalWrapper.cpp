@@ -22,6 +22,10 @@
  #error unwanted macOS version, too new
 #endif
 
+#ifdef __SSE2__
+ #include <emmintrin.h>
+#endif
+
 #define createPlugin createStaticPlugin
 #include "src/DistrhoPluginInternal.hpp"
 #include "src/DistrhoUIInternal.hpp"
@@ -30,6 +34,37 @@ START_NAMESPACE_DISTRHO
 
 // --------------------------------------------------------------------------------------------------------------------
 
+// double precision hosts, the plugin always runs in single precision
+
+static void convertDoubleToFloat(float* const dst, const double* const src, const int numSamples) noexcept
+{
+    int i = 0;
+   #ifdef __SSE2__
+    for (; i + 4 <= numSamples; i += 4)
+        _mm_storeu_ps(dst + i, _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(src + i)),
+                                             _mm_cvtpd_ps(_mm_loadu_pd(src + i + 2))));
+   #endif
+    for (; i < numSamples; ++i)
+        dst[i] = static_cast<float>(src[i]);
+}
+
+static void convertFloatToDouble(double* const dst, const float* const src, const int numSamples) noexcept
+{
+    int i = 0;
+   #ifdef __SSE2__
+    for (; i + 4 <= numSamples; i += 4)
+    {
+        const __m128 v = _mm_loadu_ps(src + i);
+        _mm_storeu_pd(dst + i, _mm_cvtps_pd(v));
+        _mm_storeu_pd(dst + i + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+    }
+   #endif
+    for (; i < numSamples; ++i)
+        dst[i] = src[i];
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
 class ParameterFromDPF : public juce::AudioProcessorParameter
 {
     PluginExporter& plugin;
@@ -256,6 +291,13 @@ class CardinalWrapperProcessor : public juce::AudioProcessor
     TimePosition timePosition;
     const uint32_t parameterCount;
 
+    // MIDI output is written here and swapped with the host buffer, both keep their storage between blocks
+    static constexpr const int kMidiOutputBufferSize = kMaxMidiEvents * 16;
+    juce::MidiBuffer outputMidiMessages;
+
+    // plugin audio for double precision hosts, converted at the boundary
+    juce::AudioBuffer<float> doubleConversionBuffer;
+
     juce::AudioProcessorParameter* bypassParameter;
     juce::MidiBuffer* currentMidiMessages;
     bool* updatedParameters;
@@ -316,6 +358,14 @@ protected:
         plugin.setSampleRate(sampleRate, true);
         plugin.setBufferSize(static_cast<uint32_t>(samplesPerBlock), true);
         plugin.activate();
+
+        outputMidiMessages.ensureSize(kMidiOutputBufferSize);
+
+        if (isUsingDoublePrecision())
+            doubleConversionBuffer.setSize(std::max(getTotalNumInputChannels(), getTotalNumOutputChannels()),
+                                           samplesPerBlock);
+        else
+            doubleConversionBuffer.setSize(0, 0);
     }
 
     void releaseResources() override
@@ -327,102 +377,51 @@ protected:
     {
         const int numSamples = buffer.getNumSamples();
         DISTRHO_SAFE_ASSERT_INT_RETURN(numSamples > 0, numSamples, midiMessages.clear());
+        DISTRHO_SAFE_ASSERT_RETURN(buffer.getNumChannels() >= 2, midiMessages.clear());
 
-        uint32_t midiEventCount = 0;
-
-        for (const juce::MidiMessageMetadata midiMessage : midiMessages)
-        {
-            DISTRHO_SAFE_ASSERT_CONTINUE(midiMessage.numBytes > 0);
-            DISTRHO_SAFE_ASSERT_CONTINUE(midiMessage.samplePosition >= 0);
-
-            if (midiMessage.numBytes > static_cast<int>(MidiEvent::kDataSize))
-                continue;
-
-            MidiEvent& midiEvent(midiEvents[midiEventCount++]);
-
-            midiEvent.frame = static_cast<uint32_t>(midiMessage.samplePosition);
-            midiEvent.size = (static_cast<uint8_t>(midiMessage.numBytes));
-            std::memcpy(midiEvent.data, midiMessage.data, midiEvent.size);
-
-            if (midiEventCount == kMaxMidiEvents)
-                break;
-        }
-
-        midiMessages.clear();
-
-        const juce::ScopedValueSetter<juce::MidiBuffer*> cvs(currentMidiMessages, &midiMessages, nullptr);
-
-        juce::AudioPlayHead* const playhead = getPlayHead();
-        juce::AudioPlayHead::CurrentPositionInfo posInfo;
-
-        if (playhead != nullptr && playhead->getCurrentPosition(posInfo))
-        {
-            timePosition.playing   = posInfo.isPlaying;
-            timePosition.bbt.valid = true;
-
-            // ticksPerBeat is not possible with JUCE
-            timePosition.bbt.ticksPerBeat = 1920.0;
-
-            if (posInfo.timeInSamples >= 0)
-                timePosition.frame = static_cast<uint64_t>(posInfo.timeInSamples);
-            else
-                timePosition.frame = 0;
-
-            // use 4/4 as fallback time signature if not provided by the host
-            if (posInfo.timeSigNumerator == 0)
-                posInfo.timeSigNumerator = 4;
-            if (posInfo.timeSigDenominator == 0)
-                posInfo.timeSigDenominator = 4;
-
-            timePosition.bbt.beatsPerMinute = posInfo.bpm;
-
-            const double ppqPos    = std::abs(posInfo.ppqPosition);
-            const int    ppqPerBar = posInfo.timeSigNumerator * 4 / posInfo.timeSigDenominator;
-            const double barBeats  = (std::fmod(ppqPos, ppqPerBar) / ppqPerBar) * posInfo.timeSigNumerator;
-            const double rest      =  std::fmod(barBeats, 1.0);
-
-            timePosition.bbt.bar         = static_cast<int32_t>(ppqPos) / ppqPerBar + 1;
-            timePosition.bbt.beat        = static_cast<int32_t>(barBeats - rest + 0.5) + 1;
-            timePosition.bbt.tick        = rest * timePosition.bbt.ticksPerBeat;
-            timePosition.bbt.beatsPerBar = posInfo.timeSigNumerator;
-            timePosition.bbt.beatType    = posInfo.timeSigDenominator;
-
-            if (posInfo.ppqPosition < 0.0)
-            {
-                --timePosition.bbt.bar;
-                timePosition.bbt.beat = posInfo.timeSigNumerator - timePosition.bbt.beat + 1;
-                timePosition.bbt.tick = timePosition.bbt.ticksPerBeat - timePosition.bbt.tick - 1;
-            }
+        // host channels are passed through as-is, the plugin handles in-place processing
+        const float* audioBufferIn[18] = {};
+        float* audioBufferOut[18] = {};
 
-            timePosition.bbt.barStartTick = timePosition.bbt.ticksPerBeat*
-                                            timePosition.bbt.beatsPerBar*
-                                            (timePosition.bbt.bar-1);
-        }
-        else
+        for (int i=buffer.getNumChannels(); --i >= 0;)
         {
-            timePosition.frame     = 0;
-            timePosition.playing   = false;
-            timePosition.bbt.valid = false;
+            audioBufferIn[i] = buffer.getReadPointer(i);
+            audioBufferOut[i] = buffer.getWritePointer(i);
         }
 
-        plugin.setTimePosition(timePosition);
+        runPlugin(audioBufferIn, audioBufferOut, numSamples, midiMessages);
+    }
 
-        DISTRHO_SAFE_ASSERT_RETURN(buffer.getNumChannels() >= 2,);
+    void processBlock(juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages) override
+    {
+        const int numSamples = buffer.getNumSamples();
+        const int numChannels = buffer.getNumChannels();
+        DISTRHO_SAFE_ASSERT_INT_RETURN(numSamples > 0, numSamples, midiMessages.clear());
+        DISTRHO_SAFE_ASSERT_RETURN(numChannels >= 2, midiMessages.clear());
+        DISTRHO_SAFE_ASSERT_INT2_RETURN(numChannels <= doubleConversionBuffer.getNumChannels() &&
+                                        numSamples <= doubleConversionBuffer.getNumSamples(),
+                                        numChannels, numSamples, midiMessages.clear());
 
         const float* audioBufferIn[18] = {};
         float* audioBufferOut[18] = {};
 
-        for (int i=buffer.getNumChannels(); --i >= 0;)
+        for (int i=numChannels; --i >= 0;)
         {
-            audioBufferIn[i] = buffer.getReadPointer(i);
-            audioBufferOut[i] = buffer.getWritePointer(i);
+            float* const data = doubleConversionBuffer.getWritePointer(i);
+            convertDoubleToFloat(data, buffer.getReadPointer(i), numSamples);
+            audioBufferIn[i] = audioBufferOut[i] = data;
         }
 
-        plugin.run(audioBufferIn, audioBufferOut, static_cast<uint32_t>(numSamples), midiEvents, midiEventCount);
+        runPlugin(audioBufferIn, audioBufferOut, numSamples, midiMessages);
+
+        for (int i=numChannels; --i >= 0;)
+            convertFloatToDouble(buffer.getWritePointer(i), doubleConversionBuffer.getReadPointer(i), numSamples);
     }
 
-    // fix compiler warning
-    void processBlock(juce::AudioBuffer<double>&, juce::MidiBuffer&) override {}
+    bool supportsDoublePrecisionProcessing() const override
+    {
+        return true;
+    }
 
     double getTailLengthSeconds() const override
     {
@@ -515,6 +514,101 @@ protected:
     }
 
 private:
+    void runPlugin(const float** const audioBufferIn, float** const audioBufferOut, const int numSamples,
+                   juce::MidiBuffer& midiMessages)
+    {
+        uint32_t midiEventCount = 0;
+
+        // sysex data points into the host buffer, which stays untouched until the plugin is done with it
+        for (const juce::MidiMessageMetadata midiMessage : midiMessages)
+        {
+            DISTRHO_SAFE_ASSERT_CONTINUE(midiMessage.numBytes > 0);
+            DISTRHO_SAFE_ASSERT_CONTINUE(midiMessage.samplePosition >= 0);
+
+            MidiEvent& midiEvent(midiEvents[midiEventCount++]);
+
+            midiEvent.frame = static_cast<uint32_t>(midiMessage.samplePosition);
+            midiEvent.size = static_cast<uint32_t>(midiMessage.numBytes);
+
+            if (midiEvent.size > MidiEvent::kDataSize)
+            {
+                midiEvent.dataExt = midiMessage.data;
+            }
+            else
+            {
+                std::memcpy(midiEvent.data, midiMessage.data, midiEvent.size);
+                midiEvent.dataExt = nullptr;
+            }
+
+            if (midiEventCount == kMaxMidiEvents)
+                break;
+        }
+
+        outputMidiMessages.clear();
+        outputMidiMessages.ensureSize(kMidiOutputBufferSize);
+
+        const juce::ScopedValueSetter<juce::MidiBuffer*> cvs(currentMidiMessages, &outputMidiMessages, nullptr);
+
+        juce::AudioPlayHead* const playhead = getPlayHead();
+        juce::AudioPlayHead::CurrentPositionInfo posInfo;
+
+        if (playhead != nullptr && playhead->getCurrentPosition(posInfo))
+        {
+            timePosition.playing   = posInfo.isPlaying;
+            timePosition.bbt.valid = true;
+
+            // ticksPerBeat is not possible with JUCE
+            timePosition.bbt.ticksPerBeat = 1920.0;
+
+            if (posInfo.timeInSamples >= 0)
+                timePosition.frame = static_cast<uint64_t>(posInfo.timeInSamples);
+            else
+                timePosition.frame = 0;
+
+            // use 4/4 as fallback time signature if not provided by the host
+            if (posInfo.timeSigNumerator == 0)
+                posInfo.timeSigNumerator = 4;
+            if (posInfo.timeSigDenominator == 0)
+                posInfo.timeSigDenominator = 4;
+
+            timePosition.bbt.beatsPerMinute = posInfo.bpm;
+
+            const double ppqPos    = std::abs(posInfo.ppqPosition);
+            const int    ppqPerBar = posInfo.timeSigNumerator * 4 / posInfo.timeSigDenominator;
+            const double barBeats  = (std::fmod(ppqPos, ppqPerBar) / ppqPerBar) * posInfo.timeSigNumerator;
+            const double rest      =  std::fmod(barBeats, 1.0);
+
+            timePosition.bbt.bar         = static_cast<int32_t>(ppqPos) / ppqPerBar + 1;
+            timePosition.bbt.beat        = static_cast<int32_t>(barBeats - rest + 0.5) + 1;
+            timePosition.bbt.tick        = rest * timePosition.bbt.ticksPerBeat;
+            timePosition.bbt.beatsPerBar = posInfo.timeSigNumerator;
+            timePosition.bbt.beatType    = posInfo.timeSigDenominator;
+
+            if (posInfo.ppqPosition < 0.0)
+            {
+                --timePosition.bbt.bar;
+                timePosition.bbt.beat = posInfo.timeSigNumerator - timePosition.bbt.beat + 1;
+                timePosition.bbt.tick = timePosition.bbt.ticksPerBeat - timePosition.bbt.tick - 1;
+            }
+
+            timePosition.bbt.barStartTick = timePosition.bbt.ticksPerBeat*
+                                            timePosition.bbt.beatsPerBar*
+                                            (timePosition.bbt.bar-1);
+        }
+        else
+        {
+            timePosition.frame     = 0;
+            timePosition.playing   = false;
+            timePosition.bbt.valid = false;
+        }
+
+        plugin.setTimePosition(timePosition);
+
+        plugin.run(audioBufferIn, audioBufferOut, static_cast<uint32_t>(numSamples), midiEvents, midiEventCount);
+
+        midiMessages.swapWith(outputMidiMessages);
+    }
+
     static bool writeMidiFunc(void* const ptr, const MidiEvent& midiEvent)
     {
         CardinalWrapperProcessor* const processor = static_cast<CardinalWrapperProcessor*>(ptr);
@@ -25,32 +25,9 @@
 #include <time.h>
 #include <sys/time.h>
 
-namespace rack {
-
-static thread_local Context* threadContext = nullptr;
-
-Context* contextGet() {
-    DISTRHO_SAFE_ASSERT(threadContext != nullptr);
-    return threadContext;
-}
-
-#ifdef ARCH_MAC
-__attribute__((optnone))
+#ifndef LV2EXPORT_SHARED_RUNTIME
+# include "runtime.cpp"
 #endif
-void contextSet(Context* context) {
-    threadContext = context;
-}
-
-namespace random {
-
-Xoroshiro128Plus& local() {
-    static Xoroshiro128Plus rng;
-    return rng;
-}
-
-} // namespace random
-
-}
 
 struct PluginLv2 {
     Context context;
@@ -59,6 +36,14 @@ struct PluginLv2 {
     int numInputs, numOutputs, numParams, numLights;
     void** ports;
 
+    // typed audio and CV buffers, kept in sync with ports on connect
+    const float** inputBuffers;
+    float** outputBuffers;
+
+    // per-port voltage scaling, audio ports map [-1, 1] to [-10V, 10V]
+    float* inputGains;
+    float* outputGains;
+
     PluginLv2(double sr)
     {
         rack::random::Xoroshiro128Plus& rng(rack::random::local());
@@ -85,6 +70,15 @@ struct PluginLv2 {
         numParams = module->getNumParams();
         numLights = module->getNumLights();
         ports = new void*[numInputs+numOutputs+numParams+numLights];
+        inputBuffers = new const float*[numInputs];
+        outputBuffers = new float*[numOutputs];
+        inputGains = new float[numInputs];
+        outputGains = new float[numOutputs];
+
+        for (int i=numInputs; --i >=0;)
+            inputGains[i] = kCvInputs[i] ? 1.0f : 10.0f;
+        for (int i=numOutputs; --i >=0;)
+            outputGains[i] = kCvOutputs[i] ? 1.0f : 0.1f;
 
         Module::SampleRateChangeEvent e = { context._engine.sampleRate, 1.0f / context._engine.sampleRate };
         module->onSampleRateChange(e);
@@ -105,16 +99,25 @@ struct PluginLv2 {
                  numInputs, numOutputs, numParams, numLights);
     }
 
-    PluginLv2()
+    ~PluginLv2()
     {
         contextSet(&context);
         delete[] ports;
+        delete[] inputBuffers;
+        delete[] outputBuffers;
+        delete[] inputGains;
+        delete[] outputGains;
         delete module;
     }
 
     void lv2_connect_port(const uint32_t port, void* const dataLocation)
     {
         ports[port] = dataLocation;
+
+        if (port < static_cast<uint32_t>(numInputs))
+            inputBuffers[port] = static_cast<const float*>(dataLocation);
+        else if (port < static_cast<uint32_t>(numInputs + numOutputs))
+            outputBuffers[port - numInputs] = static_cast<float*>(dataLocation);
     }
 
     void lv2_run(const uint32_t sampleCount)
@@ -129,25 +132,19 @@ struct PluginLv2 {
         for (int i=numParams; --i >=0;)
             module->params[i].setValue(*static_cast<const float*>(ports[numInputs+numOutputs+i]));
 
+        // module ports stay the same for the whole block
+        engine::Input* const inputs = module->inputs.data();
+        engine::Output* const outputs = module->outputs.data();
+
         for (uint32_t s=0; s<sampleCount; ++s)
         {
             for (int i=numInputs; --i >=0;)
-            {
-                if (kCvInputs[i])
-                    module->inputs[i].setVoltage(static_cast<const float*>(ports[i])[s]);
-                else
-                    module->inputs[i].setVoltage(static_cast<const float*>(ports[i])[s] * 10.0f);
-            }
+                inputs[i].setVoltage(inputBuffers[i][s] * inputGains[i]);
 
             module->doProcess(args);
 
             for (int i=numOutputs; --i >=0;)
-            {
-                if (kCvOutputs[i])
-                    static_cast<float*>(ports[numInputs+i])[s] = module->outputs[i].getVoltage();
-                else
-                    static_cast<float*>(ports[numInputs+i])[s] = module->outputs[i].getVoltage() * 0.1f;
-            }
+                outputBuffers[i][s] = outputs[i].getVoltage() * outputGains[i];
 
             ++args.frame;
         }
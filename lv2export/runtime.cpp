@@ -0,0 +1,50 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+// Rack runtime shims needed by every exported module.
+// Built into each plugin binary by default, or once as a shared library for all of them with SHARED_RUNTIME=true.
+
+#include "rack.hpp"
+
+#include "DistrhoUtils.hpp"
+
+namespace rack {
+
+static thread_local Context* threadContext = nullptr;
+
+Context* contextGet() {
+    DISTRHO_SAFE_ASSERT(threadContext != nullptr);
+    return threadContext;
+}
+
+#ifdef ARCH_MAC
+__attribute__((optnone))
+#endif
+void contextSet(Context* context) {
+    threadContext = context;
+}
+
+namespace random {
+
+Xoroshiro128Plus& local() {
+    static Xoroshiro128Plus rng;
+    return rng;
+}
+
+} // namespace random
+
+}
@@ -23,9 +23,13 @@
 
 #ifndef HEADLESS
 # include "ImGuiWidget.hpp"
+# include "extra/Mutex.hpp"
 # include "ghc/filesystem.hpp"
+# include <map>
 #endif
 
+#include <sys/stat.h>
+
 #define BUFFER_SIZE 128
 
 // generates a warning if this is defined as anything else
@@ -58,7 +62,7 @@ static void host_ui_closed(NativeHostHandle) {}
 
 // --------------------------------------------------------------------------------------------------------------------
 
-struct CarlaInternalPluginModule : Module, Runner {
+struct CarlaInternalPluginModule : BlockModule, Runner {
     enum ParamIds {
         NUM_PARAMS
     };
@@ -102,6 +106,8 @@ struct CarlaInternalPluginModule : Module, Runner {
     uint32_t lastProcessCounter = 0;
     bool fileChanged = false;
     std::string currentFile;
+    // modification time of currentFile when it was handed to carla, or 0 if not loaded
+    int64_t currentFileTime = 0;
 
     struct {
         float preview[108];
@@ -192,6 +198,28 @@ struct CarlaInternalPluginModule : Module, Runner {
         return &fCarlaTimeInfo;
     }
 
+    static int64_t getFileTime(const char* const path)
+    {
+        struct stat st;
+        return stat(path, &st) == 0 ? static_cast<int64_t>(st.st_mtime) : 0;
+    }
+
+    // decoding long files is slow, skip it if carla already has the same unmodified file loaded,
+    // as happens on undo/redo or when reloading a preset
+    void loadFile(const char* const path)
+    {
+        const int64_t fileTime = getFileTime(path);
+
+        if (fileTime != 0 && fileTime == currentFileTime && currentFile == path)
+            return;
+
+        currentFile = path;
+        currentFileTime = fileTime;
+
+        if (fCarlaPluginHandle != nullptr)
+            fCarlaPluginDescriptor->set_custom_data(fCarlaPluginHandle, "file", path);
+    }
+
     intptr_t hostDispatcher(const NativeHostDispatcherOpcode opcode,
                             const int32_t index, const intptr_t value, void* const ptr, const float opt)
     {
@@ -255,17 +283,15 @@ struct CarlaInternalPluginModule : Module, Runner {
 
             if (filepath[0] != '\0')
             {
-                currentFile = filepath;
+                loadFile(filepath);
                 fileChanged = true;
-
-                if (fCarlaPluginHandle != nullptr)
-                    fCarlaPluginDescriptor->set_custom_data(fCarlaPluginHandle, "file", filepath);
             }
         }
 
         if (! fileChanged)
         {
             currentFile.clear();
+            currentFileTime = 0;
             fileChanged = true;
         }
 
@@ -285,42 +311,55 @@ struct CarlaInternalPluginModule : Module, Runner {
         }
     }
 
-    void process(const ProcessArgs&) override
+    void processBlock(const ProcessArgs&, const int frames) override
     {
         if (fCarlaPluginHandle == nullptr)
             return;
 
-        const unsigned k = audioDataFill++;
+        for (int i = 0; i < frames; ++i)
+        {
+            const unsigned k = audioDataFill++;
+
+            getOutputBlock(0, i)[0] = dataOut[0][k] * 10.0f;
+            getOutputBlock(1, i)[0] = dataOut[1][k] * 10.0f;
+
+            if (audioDataFill == BUFFER_SIZE)
+                processInternalBlock();
+        }
+    }
 
-        outputs[0].setVoltage(dataOut[0][k] * 10.0f);
-        outputs[1].setVoltage(dataOut[1][k] * 10.0f);
+    void processInternalBlock()
+    {
+        const uint32_t processCounter = pcontext->processCounter;
 
-        if (audioDataFill == BUFFER_SIZE)
+        // Update time position if running a new audio block
+        if (lastProcessCounter != processCounter)
+        {
+            lastProcessCounter = processCounter;
+            fCarlaTimeInfo.playing = pcontext->playing;
+            fCarlaTimeInfo.frame = pcontext->frame;
+        }
+        // or advance time by BUFFER_SIZE frames if still under the same audio block
+        else if (fCarlaTimeInfo.playing)
         {
-            const uint32_t processCounter = pcontext->processCounter;
+            fCarlaTimeInfo.frame += BUFFER_SIZE;
+        }
 
-            // Update time position if running a new audio block
-            if (lastProcessCounter != processCounter)
-            {
-                lastProcessCounter = processCounter;
-                fCarlaTimeInfo.playing = pcontext->playing;
-                fCarlaTimeInfo.frame = pcontext->frame;
-            }
-            // or advance time by BUFFER_SIZE frames if still under the same audio block
-            else if (fCarlaTimeInfo.playing)
-            {
-                fCarlaTimeInfo.frame += BUFFER_SIZE;
-            }
+        audioDataFill = 0;
+        fCarlaPluginDescriptor->process(fCarlaPluginHandle, nullptr, dataOutPtr, BUFFER_SIZE, nullptr, 0);
+    }
 
-            audioDataFill = 0;
-            fCarlaPluginDescriptor->process(fCarlaPluginHandle, nullptr, dataOutPtr, BUFFER_SIZE, nullptr, 0);
+    // file info is only needed for drawing, so it is fetched by the widget instead of after every chunk
+    void updateAudioInfo()
+    {
+        if (fCarlaPluginHandle == nullptr)
+            return;
 
-            audioInfo.channels = fCarlaPluginDescriptor->get_parameter_value(fCarlaPluginHandle, 4);
-            audioInfo.bitDepth = fCarlaPluginDescriptor->get_parameter_value(fCarlaPluginHandle, 6);
-            audioInfo.sampleRate = fCarlaPluginDescriptor->get_parameter_value(fCarlaPluginHandle, 7);
-            audioInfo.length = fCarlaPluginDescriptor->get_parameter_value(fCarlaPluginHandle,  8);
-            audioInfo.position = fCarlaPluginDescriptor->get_parameter_value(fCarlaPluginHandle, 9);
-        }
+        audioInfo.channels = fCarlaPluginDescriptor->get_parameter_value(fCarlaPluginHandle, kParameterInfoChannels);
+        audioInfo.bitDepth = fCarlaPluginDescriptor->get_parameter_value(fCarlaPluginHandle, kParameterInfoBitDepth);
+        audioInfo.sampleRate = fCarlaPluginDescriptor->get_parameter_value(fCarlaPluginHandle, kParameterInfoSampleRate);
+        audioInfo.length = fCarlaPluginDescriptor->get_parameter_value(fCarlaPluginHandle, kParameterInfoLength);
+        audioInfo.position = fCarlaPluginDescriptor->get_parameter_value(fCarlaPluginHandle, kParameterInfoPosition);
     }
 
     void onSampleRateChange(const SampleRateChangeEvent& e) override
@@ -375,7 +414,10 @@ static intptr_t host_dispatcher(const NativeHostHandle handle, const NativeHostD
 // --------------------------------------------------------------------------------------------------------------------
 
 #ifndef HEADLESS
-struct AudioFileListWidget : ImGuiWidget {
+struct AudioFileListWidget : ImGuiWidget, Runner {
+    static constexpr const uint kScanBatchSize = 256;
+    static constexpr const double kRefreshInterval = 1.0;
+
     CarlaInternalPluginModule* const module;
 
     bool showError = false;
@@ -386,9 +428,36 @@ struct AudioFileListWidget : ImGuiWidget {
         bool operator<(const ghcFile& other) const noexcept { return base < other.base; }
     };
     std::string currentDirectory;
+    std::string currentFilePath;
+    int64_t currentDirectoryTime = 0;
+    double lastRefreshCheck = 0.0;
     std::vector<ghcFile> currentFiles;
     size_t selectedFile = (size_t)-1;
 
+    // directory listings shared by all instances, valid while the directory modification time is unchanged
+    struct DirectoryListing {
+        int64_t time;
+        std::vector<ghcFile> files;
+    };
+    struct DirectoryCache {
+        Mutex mutex;
+        std::map<std::string, DirectoryListing> listings;
+    };
+
+    static DirectoryCache& getDirectoryCache()
+    {
+        static DirectoryCache cache;
+        return cache;
+    }
+
+    // directory scanning happens in the runner, files are moved into currentFiles as they are found
+    Mutex scanMutex;
+    std::vector<ghcFile> scannedFiles;
+    bool scanFinished = false;
+    ghc::filesystem::directory_iterator scanIterator;
+    bool scanStarted = false;
+    bool scanPending = false;
+
     AudioFileListWidget(CarlaInternalPluginModule* const m)
         : ImGuiWidget(),
           module(m)
@@ -397,6 +466,11 @@ struct AudioFileListWidget : ImGuiWidget {
             reloadDir();
     }
 
+    ~AudioFileListWidget() override
+    {
+        stopRunner();
+    }
+
     void drawImGui() override
     {
         const float scaleFactor = getScaleFactor();
@@ -443,8 +517,8 @@ struct AudioFileListWidget : ImGuiWidget {
                     if (selected && ! wasSelected)
                     {
                         selectedFile = i;
-                        module->currentFile = currentFiles[i].full;
-                        module->fCarlaPluginDescriptor->set_custom_data(module->fCarlaPluginHandle, "file", currentFiles[i].full.c_str());
+                        currentFilePath = currentFiles[i].full;
+                        module->loadFile(currentFiles[i].full.c_str());
                     }
                 }
 
@@ -458,18 +532,37 @@ struct AudioFileListWidget : ImGuiWidget {
     void step() override
     {
         if (module->fileChanged)
+        {
             reloadDir();
+        }
+        else if (! scanPending && ! currentDirectory.empty())
+        {
+            // pick up files being added or removed, the directory modification time changes with them
+            const double time = system::getTime();
+
+            if (time - lastRefreshCheck >= kRefreshInterval)
+            {
+                lastRefreshCheck = time;
+
+                if (getDirectoryTime(currentDirectory) != currentDirectoryTime)
+                    reloadDir();
+            }
+        }
+
+        if (scanPending)
+            collectScannedFiles();
 
         ImGuiWidget::step();
     }
 
-    void reloadDir()
+    static int64_t getDirectoryTime(const std::string& dir)
     {
-        module->fileChanged = false;
-
-        currentFiles.clear();
-        selectedFile = (size_t)-1;
+        struct stat st;
+        return stat(dir.c_str(), &st) == 0 ? static_cast<int64_t>(st.st_mtime) : 0;
+    }
 
+    static bool isSupportedFile(const ghc::filesystem::path& filepath)
+    {
         static constexpr const char* const supportedExtensions[] = {
        #ifdef HAVE_SNDFILE
             ".aif",".aifc",".aiff",".au",".bwf",".flac",".htk",".iff",".mat4",".mat5",".oga",".ogg",".opus",
@@ -478,37 +571,143 @@ struct AudioFileListWidget : ImGuiWidget {
             ".mp3"
         };
 
+        const ghc::filesystem::path extension = filepath.extension();
+
+        for (size_t i=0; i<ARRAY_SIZE(supportedExtensions); ++i)
+        {
+            if (extension.compare(supportedExtensions[i]) == 0)
+                return true;
+        }
+
+        return false;
+    }
+
+    void reloadDir()
+    {
+        module->fileChanged = false;
+
+        stopRunner();
+
+        setDirty(true);
+        currentFiles.clear();
+        selectedFile = (size_t)-1;
+        scannedFiles.clear();
+        scanFinished = false;
+        scanPending = false;
+
         using namespace ghc::filesystem;
         const path currentFile = u8path(module->currentFile);
+        currentFilePath = currentFile.generic_u8string();
         currentDirectory = currentFile.parent_path().generic_u8string();
+        currentDirectoryTime = getDirectoryTime(currentDirectory);
+        lastRefreshCheck = system::getTime();
+
+        if (currentDirectory.empty())
+            return;
+
+        {
+            DirectoryCache& cache(getDirectoryCache());
+            const MutexLocker cml(cache.mutex);
+
+            const auto it = cache.listings.find(currentDirectory);
 
-        directory_iterator it;
+            if (it != cache.listings.end() && it->second.time == currentDirectoryTime)
+            {
+                currentFiles = it->second.files;
+                updateSelectedFile();
+                return;
+            }
+        }
+
+        scanStarted = false;
+        scanPending = true;
+        startRunner();
+    }
 
-        try {
-            it = directory_iterator(u8path(currentDirectory));
-        } DISTRHO_SAFE_EXCEPTION_RETURN("Failed to open current directory",);
+    bool run() override
+    {
+        using namespace ghc::filesystem;
+        std::error_code ec;
 
-        for (directory_iterator itb = begin(it), ite=end(it); itb != ite; ++itb)
+        if (! scanStarted)
         {
-            if (! itb->is_regular_file())
-                continue;
-            const path filepath = itb->path();
-            const path extension = filepath.extension();
-            for (size_t i=0; i<ARRAY_SIZE(supportedExtensions); ++i)
+            scanStarted = true;
+            scanIterator = directory_iterator(u8path(currentDirectory), ec);
+
+            if (ec)
             {
-                if (extension.compare(supportedExtensions[i]) == 0)
-                {
-                    currentFiles.push_back({ filepath.generic_u8string(), filepath.filename().generic_u8string() });
-                    break;
-                }
+                d_stderr2("Failed to open current directory");
+                const MutexLocker cml(scanMutex);
+                scanFinished = true;
+                return false;
             }
         }
 
-        std::sort(currentFiles.begin(), currentFiles.end());
+        std::vector<ghcFile> files;
+        files.reserve(kScanBatchSize);
+
+        for (uint i = 0; i < kScanBatchSize && scanIterator != directory_iterator(); ++i)
+        {
+            if (scanIterator->is_regular_file(ec) && isSupportedFile(scanIterator->path()))
+            {
+                const path filepath = scanIterator->path();
+                files.push_back({ filepath.generic_u8string(), filepath.filename().generic_u8string() });
+            }
+
+            scanIterator.increment(ec);
+
+            if (ec)
+            {
+                scanIterator = directory_iterator();
+                break;
+            }
+        }
+
+        const bool finished = scanIterator == directory_iterator();
+
+        const MutexLocker cml(scanMutex);
+        scannedFiles.insert(scannedFiles.end(), files.begin(), files.end());
+        scanFinished = finished;
+        return ! finished;
+    }
+
+    void collectScannedFiles()
+    {
+        bool finished, changed;
+
+        {
+            const MutexLocker cml(scanMutex);
+            changed = ! scannedFiles.empty();
+            currentFiles.insert(currentFiles.end(), scannedFiles.begin(), scannedFiles.end());
+            scannedFiles.clear();
+            finished = scanFinished;
+        }
+
+        if (! changed && ! finished)
+            return;
+
+        setDirty(true);
+
+        if (finished)
+        {
+            scanPending = false;
+            std::sort(currentFiles.begin(), currentFiles.end());
+
+            DirectoryCache& cache(getDirectoryCache());
+            const MutexLocker cml(cache.mutex);
+            cache.listings[currentDirectory] = { currentDirectoryTime, currentFiles };
+        }
+
+        updateSelectedFile();
+    }
+
+    void updateSelectedFile()
+    {
+        selectedFile = (size_t)-1;
 
         for (size_t index = 0; index < currentFiles.size(); ++index)
         {
-            if (currentFiles[index].full.compare(currentFile) == 0)
+            if (currentFiles[index].full == currentFilePath)
             {
                 selectedFile = index;
                 break;
@@ -531,7 +730,6 @@ struct AudioFileWidget : ModuleWidgetWithSideScrews<23> {
     CarlaInternalPluginModule* const module;
     bool idleCallbackActive = false;
     bool visible = false;
-    float lastPosition = 0.0f;
 
     AudioFileWidget(CarlaInternalPluginModule* const m)
         : module(m)
@@ -556,6 +754,14 @@ struct AudioFileWidget : ModuleWidgetWithSideScrews<23> {
         }
     }
 
+    void step() override
+    {
+        if (module != nullptr)
+            module->updateAudioInfo();
+
+        ModuleWidgetWithSideScrews<23>::step();
+    }
+
     void drawLayer(const DrawArgs& args, int layer) override
     {
         if (layer != 1)
@@ -667,9 +873,8 @@ struct AudioFileWidget : ModuleWidgetWithSideScrews<23> {
                     if (path == nullptr)
                         return;
 
-                    module->currentFile = path;
+                    module->loadFile(path);
                     module->fileChanged = true;
-                    module->fCarlaPluginDescriptor->set_custom_data(module->fCarlaPluginHandle, "file", path);
                     std::free(path);
                 });
             }
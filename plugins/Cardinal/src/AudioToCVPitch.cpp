@@ -68,20 +68,36 @@ struct AudioToCVPitch : Module {
     bool smooth = true;
     int octave = 0;
 
-    float lastKnownPitchInHz = 0.f;
-    float lastKnownPitchConfidence = 0.f;
-
     float lastUsedTolerance = kDefaultTolerance;
-    float lastUsedOutputPitch = 0.f;
-    float lastUsedOutputSignal = 0.f;
 
-    fvec_t* const detectedPitch = new_fvec(1);
-    fvec_t* const inputBuffer = new_fvec(kAubioBufferSize);
-    uint32_t inputBufferPos = 0;
+    // detection state of each polyphonic channel
+    struct Channel {
+        float lastKnownPitchInHz = 0.f;
+        float lastKnownPitchConfidence = 0.f;
+
+        float lastUsedOutputPitch = 0.f;
+        float lastUsedOutputSignal = 0.f;
+
+        fvec_t* const detectedPitch = new_fvec(1);
+        fvec_t* const inputBuffer = new_fvec(kAubioBufferSize);
+        uint32_t inputBufferPos = 0;
 
-    aubio_pitch_t* pitchDetector = nullptr;
+        aubio_pitch_t* pitchDetector = nullptr;
 
-    dsp::SlewLimiter smoothOutputSignal;
+        dsp::SlewLimiter smoothOutputSignal;
+
+        ~Channel()
+        {
+            if (pitchDetector != nullptr)
+                del_aubio_pitch(pitchDetector);
+            del_fvec(detectedPitch);
+            del_fvec(inputBuffer);
+        }
+    } channels[PORT_MAX_CHANNELS];
+
+    // shown on the panel, from the first channel
+    float lastKnownPitchInHz = 0.f;
+    float lastKnownPitchConfidence = 0.f;
 
     AudioToCVPitch()
     {
@@ -93,66 +109,88 @@ struct AudioToCVPitch : Module {
         configParam(PARAM_SENSITIVITY, 0.1f, 99.f, kDefaultSensitivity, "Sensitivity", " %");
         configParam(PARAM_CONFIDENCETHRESHOLD, 0.f, 99.f, kDefaultThreshold, "Confidence Threshold", " %");
         configParam(PARAM_TOLERANCE, 0.f, 99.f,  kDefaultTolerance, "Tolerance", " %");
+
+        resetInputBuffers();
     }
 
-    ~AudioToCVPitch() override
+    // spread the channels over the buffer, so their detections do not all land on the same frame
+    void resetInputBuffers()
     {
-        if (pitchDetector != nullptr)
-            del_aubio_pitch(pitchDetector);
-        del_fvec(detectedPitch);
-        del_fvec(inputBuffer);
+        for (int c = 0; c < PORT_MAX_CHANNELS; ++c)
+            channels[c].inputBufferPos = c * kAubioBufferSize / PORT_MAX_CHANNELS;
     }
 
     void process(const ProcessArgs& args) override
     {
-        float cvPitch = lastUsedOutputPitch;
-        float cvSignal = lastUsedOutputSignal;
-
-        inputBuffer->data[inputBufferPos] = inputs[AUDIO_INPUT].getVoltage() * 0.1f
-                                          * params[PARAM_SENSITIVITY].getValue();
+        const int numChannels = std::max(1, inputs[AUDIO_INPUT].getChannels());
+        const float sensitivity = params[PARAM_SENSITIVITY].getValue();
 
-        if (++inputBufferPos == kAubioBufferSize)
+        const float tolerance = params[PARAM_TOLERANCE].getValue();
+        if (d_isNotEqual(lastUsedTolerance, tolerance))
         {
-            inputBufferPos = 0;
+            lastUsedTolerance = tolerance;
 
-            const float tolerance = params[PARAM_TOLERANCE].getValue();
-            if (d_isNotEqual(lastUsedTolerance, tolerance))
+            for (int c = 0; c < PORT_MAX_CHANNELS; ++c)
             {
-                lastUsedTolerance = tolerance;
-                aubio_pitch_set_tolerance(pitchDetector, tolerance * 0.01f);
+                if (channels[c].pitchDetector != nullptr)
+                    aubio_pitch_set_tolerance(channels[c].pitchDetector, tolerance * 0.01f);
             }
+        }
 
-            aubio_pitch_do(pitchDetector, inputBuffer, detectedPitch);
-            const float detectedPitchInHz = fvec_get_sample(detectedPitch, 0);
-            const float pitchConfidence = aubio_pitch_get_confidence(pitchDetector);
+        for (int c = 0; c < numChannels; ++c)
+        {
+            Channel& ch(channels[c]);
 
-            if (detectedPitchInHz > 0.f && pitchConfidence >=  params[PARAM_CONFIDENCETHRESHOLD].getValue() * 0.01f)
-            {
-                const float linearPitch = 12.f * (log2f(detectedPitchInHz / 440.f) + octave - 5) + 69.f;
-                cvPitch = std::max(-10.f, std::min(10.f, linearPitch * (1.f/12.f)));
-                lastKnownPitchInHz = detectedPitchInHz;
-                cvSignal = 10.f;
-            }
-            else
-            {
-                if (! holdOutputPitch)
-                    lastKnownPitchInHz = cvPitch = 0.0f;
+            float cvPitch = ch.lastUsedOutputPitch;
+            float cvSignal = ch.lastUsedOutputSignal;
+
+            ch.inputBuffer->data[ch.inputBufferPos] = inputs[AUDIO_INPUT].getVoltage(c) * 0.1f * sensitivity;
 
-                cvSignal = 0.f;
+            if (++ch.inputBufferPos == kAubioBufferSize)
+            {
+                ch.inputBufferPos = 0;
+
+                if (ch.pitchDetector != nullptr)
+                {
+                    aubio_pitch_do(ch.pitchDetector, ch.inputBuffer, ch.detectedPitch);
+                    const float detectedPitchInHz = fvec_get_sample(ch.detectedPitch, 0);
+                    const float pitchConfidence = aubio_pitch_get_confidence(ch.pitchDetector);
+
+                    if (detectedPitchInHz > 0.f && pitchConfidence >=  params[PARAM_CONFIDENCETHRESHOLD].getValue() * 0.01f)
+                    {
+                        const float linearPitch = 12.f * (log2f(detectedPitchInHz / 440.f) + octave - 5) + 69.f;
+                        cvPitch = std::max(-10.f, std::min(10.f, linearPitch * (1.f/12.f)));
+                        ch.lastKnownPitchInHz = detectedPitchInHz;
+                        cvSignal = 10.f;
+                    }
+                    else
+                    {
+                        if (! holdOutputPitch)
+                            ch.lastKnownPitchInHz = cvPitch = 0.0f;
+
+                        cvSignal = 0.f;
+                    }
+
+                    ch.lastKnownPitchConfidence = pitchConfidence;
+                    ch.lastUsedOutputPitch = cvPitch;
+                    ch.lastUsedOutputSignal = cvSignal;
+                }
             }
 
-            lastKnownPitchConfidence = pitchConfidence;
-            lastUsedOutputPitch = cvPitch;
-            lastUsedOutputSignal = cvSignal;
+            outputs[CV_PITCH].setVoltage(smooth ? ch.smoothOutputSignal.process(args.sampleTime, cvPitch) : cvPitch, c);
+            outputs[CV_GATE].setVoltage(cvSignal, c);
         }
 
-        outputs[CV_PITCH].setVoltage(smooth ? smoothOutputSignal.process(args.sampleTime, cvPitch) : cvPitch);
-        outputs[CV_GATE].setVoltage(cvSignal);
+        outputs[CV_PITCH].setChannels(numChannels);
+        outputs[CV_GATE].setChannels(numChannels);
+
+        lastKnownPitchInHz = channels[0].lastKnownPitchInHz;
+        lastKnownPitchConfidence = channels[0].lastKnownPitchConfidence;
     }
 
     void onReset() override
     {
-        inputBufferPos = 0;
+        resetInputBuffers();
         smooth = true;
         holdOutputPitch = true;
         octave = 0;
@@ -160,28 +198,33 @@ struct AudioToCVPitch : Module {
 
     void onSampleRateChange(const SampleRateChangeEvent& e) override
     {
-        float tolerance;
+        const double fall = 1.0 / (double(kAubioBufferSize) / e.sampleRate);
 
-        if (pitchDetector != nullptr)
-        {
-            tolerance = aubio_pitch_get_tolerance(pitchDetector);
-            del_aubio_pitch(pitchDetector);
-        }
-        else
+        for (int c = 0; c < PORT_MAX_CHANNELS; ++c)
         {
-            tolerance = kDefaultTolerance * 0.01f;
-        }
+            Channel& ch(channels[c]);
+            float tolerance;
 
-        pitchDetector = new_aubio_pitch("yinfast", kAubioBufferSize, kAubioHopSize, e.sampleRate);
-        DISTRHO_SAFE_ASSERT_RETURN(pitchDetector != nullptr,);
+            if (ch.pitchDetector != nullptr)
+            {
+                tolerance = aubio_pitch_get_tolerance(ch.pitchDetector);
+                del_aubio_pitch(ch.pitchDetector);
+            }
+            else
+            {
+                tolerance = kDefaultTolerance * 0.01f;
+            }
 
-        aubio_pitch_set_silence(pitchDetector, -30.0f);
-        aubio_pitch_set_tolerance(pitchDetector, tolerance);
-        aubio_pitch_set_unit(pitchDetector, "Hz");
+            ch.pitchDetector = new_aubio_pitch("yinfast", kAubioBufferSize, kAubioHopSize, e.sampleRate);
+            DISTRHO_SAFE_ASSERT_CONTINUE(ch.pitchDetector != nullptr);
 
-        const double fall = 1.0 / (double(kAubioBufferSize) / e.sampleRate);
-        smoothOutputSignal.reset();
-        smoothOutputSignal.setRiseFall(fall, fall);
+            aubio_pitch_set_silence(ch.pitchDetector, -30.0f);
+            aubio_pitch_set_tolerance(ch.pitchDetector, tolerance);
+            aubio_pitch_set_unit(ch.pitchDetector, "Hz");
+
+            ch.smoothOutputSignal.reset();
+            ch.smoothOutputSignal.setRiseFall(fall, fall);
+        }
     }
 
     json_t* dataToJson() override
@@ -22,6 +22,7 @@
 #include "CarlaNativePlugin.h"
 #include "CarlaBackendUtils.hpp"
 #include "CarlaEngine.hpp"
+#include "CarlaProjectState.hpp"
 #include "water/streams/MemoryOutputStream.h"
 #include "water/xml/XmlDocument.h"
 
@@ -33,6 +34,7 @@ json_t *jsonp_stringn_nocheck_own(const char* value, size_t len);
 #endif
 
 #define BUFFER_SIZE 128
+#define MAX_BUFFER_SIZE 2048
 
 // generates a warning if this is defined as anything else
 #define CARLA_API
@@ -56,10 +58,11 @@ static intptr_t host_dispatcher(NativeHostHandle handle, NativeHostDispatcherOpc
 
 // --------------------------------------------------------------------------------------------------------------------
 
-struct CarlaModule : Module {
+struct CarlaModule : Module, ModuleLatency {
     enum ParamIds {
         BIPOLAR_INPUTS,
         BIPOLAR_OUTPUTS,
+        HOST_BLOCK_SIZE,
         NUM_PARAMS
     };
     enum InputIds {
@@ -90,14 +93,18 @@ struct CarlaModule : Module {
 
     void* fUI = nullptr;
 
-    float dataIn[NUM_INPUTS][BUFFER_SIZE];
-    float dataOut[NUM_OUTPUTS][BUFFER_SIZE];
+    float dataIn[NUM_INPUTS][MAX_BUFFER_SIZE];
+    float dataOut[NUM_OUTPUTS][MAX_BUFFER_SIZE];
     float* dataInPtr[NUM_INPUTS];
     float* dataOutPtr[NUM_OUTPUTS];
     unsigned audioDataFill = 0;
+    // frames per Carla process call, BUFFER_SIZE or the engine block size
+    unsigned bufferSize = BUFFER_SIZE;
     uint32_t lastProcessCounter = 0;
     CardinalExpanderFromCarlaMIDIToCV* midiOutExpander = nullptr;
     std::string patchStorage;
+    // project saved to the patch storage in the background, see CarlaProjectState
+    CarlaProjectState projectSaveState;
 
 #ifdef CARLA_OS_WIN
     // must keep string pointer valid
@@ -110,6 +117,7 @@ struct CarlaModule : Module {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
         configParam<SwitchQuantity>(BIPOLAR_INPUTS, 0.f, 1.f, 1.f, "Bipolar CV Inputs")->randomizeEnabled = false;
         configParam<SwitchQuantity>(BIPOLAR_OUTPUTS, 0.f, 1.f, 1.f, "Bipolar CV Outputs")->randomizeEnabled = false;
+        configParam<SwitchQuantity>(HOST_BLOCK_SIZE, 0.f, 1.f, 0.f, "Process at host block size")->randomizeEnabled = false;
 
         for (uint i=0; i<NUM_INPUTS; ++i)
             dataInPtr[i] = dataIn[i];
@@ -220,6 +228,8 @@ struct CarlaModule : Module {
 
     ~CarlaModule() override
     {
+        projectSaveState.wait();
+
         if (fCarlaPluginHandle != nullptr)
             fCarlaPluginDescriptor->deactivate(fCarlaPluginHandle);
 
@@ -268,11 +278,37 @@ struct CarlaModule : Module {
         return 0;
     }
 
+    // audio is processed in chunks of bufferSize frames, delaying it by as much
+    int getLatency() override
+    {
+        return bufferSize;
+    }
+
+    // one engine block, following the host buffer size, oversampling and the fixed block size of the patch
+    unsigned getWantedBufferSize() const
+    {
+        if (params[HOST_BLOCK_SIZE].getValue() < 0.5f)
+            return BUFFER_SIZE;
+
+        return std::max(1, std::min(pcontext->engine->getBlockFrames(), MAX_BUFFER_SIZE));
+    }
+
+    void onSave(const SaveEvent&) override
+    {
+        if (fCarlaHostHandle == nullptr)
+            return;
+
+        projectSaveState.startSaving(carla_get_engine_from_handle(fCarlaHostHandle), createPatchStorageDirectory());
+    }
+
     json_t* dataToJson() override
     {
         if (fCarlaHostHandle == nullptr)
             return nullptr;
 
+        if (json_t* const fileJ = projectSaveState.finishSaving())
+            return fileJ;
+
         CarlaEngine* const engine = carla_get_engine_from_handle(fCarlaHostHandle);
 
         water::MemoryOutputStream projectState;
@@ -291,12 +327,12 @@ struct CarlaModule : Module {
         if (fCarlaHostHandle == nullptr)
             return;
 
-        const char* const projectState = json_string_value(rootJ);
-        DISTRHO_SAFE_ASSERT_RETURN(projectState != nullptr,);
+        std::string projectState;
+        DISTRHO_SAFE_ASSERT_RETURN(CarlaProjectState::read(rootJ, getPatchStorageDirectory(), projectState),);
 
         CarlaEngine* const engine = carla_get_engine_from_handle(fCarlaHostHandle);
 
-        water::XmlDocument xml(projectState);
+        water::XmlDocument xml(projectState.c_str());
         engine->loadProjectInternal(xml, true);
     }
 
@@ -313,6 +349,19 @@ struct CarlaModule : Module {
         const float inputOffset = params[BIPOLAR_INPUTS].getValue() > 0.1f ? -5.0f : 0.0f;
         const float outputOffset = params[BIPOLAR_OUTPUTS].getValue() > 0.1f ? -5.0f : 0.0f;
 
+        // buffer size changes only happen in between chunks
+        if (audioDataFill == 0)
+        {
+            const unsigned wantedBufferSize = getWantedBufferSize();
+
+            if (bufferSize != wantedBufferSize)
+            {
+                bufferSize = wantedBufferSize;
+                fCarlaPluginDescriptor->dispatcher(fCarlaPluginHandle, NATIVE_PLUGIN_OPCODE_BUFFER_SIZE_CHANGED,
+                                                   0, bufferSize, nullptr, 0.0f);
+            }
+        }
+
         const unsigned k = audioDataFill++;
 
         for (uint i=0; i<2; ++i)
@@ -325,7 +374,7 @@ struct CarlaModule : Module {
         for (uint i=2; i<NUM_OUTPUTS; ++i)
             outputs[i].setVoltage(dataOut[i][k] + outputOffset);
 
-        if (audioDataFill == BUFFER_SIZE)
+        if (audioDataFill == bufferSize)
         {
             const uint32_t processCounter = pcontext->processCounter;
 
@@ -345,10 +394,10 @@ struct CarlaModule : Module {
                 fCarlaTimeInfo.bbt.ticksPerBeat = pcontext->ticksPerBeat;
                 fCarlaTimeInfo.bbt.beatsPerMinute = pcontext->beatsPerMinute;
             }
-            // or advance time by BUFFER_SIZE frames if still under the same audio block
+            // or advance time by bufferSize frames if still under the same audio block
             else if (fCarlaTimeInfo.playing)
             {
-                fCarlaTimeInfo.frame += BUFFER_SIZE;
+                fCarlaTimeInfo.frame += bufferSize;
 
                 // adjust BBT as well
                 if (fCarlaTimeInfo.bbt.valid)
@@ -359,7 +408,7 @@ struct CarlaModule : Module {
 
                     int32_t newBar = fCarlaTimeInfo.bbt.bar;
                     int32_t newBeat = fCarlaTimeInfo.bbt.beat;
-                    double newTick = fCarlaTimeInfo.bbt.tick + (double)BUFFER_SIZE / samplesPerTick;
+                    double newTick = fCarlaTimeInfo.bbt.tick + (double)bufferSize / samplesPerTick;
 
                     while (newTick >= fCarlaTimeInfo.bbt.ticksPerBeat)
                     {
@@ -383,13 +432,12 @@ struct CarlaModule : Module {
             NativeMidiEvent* midiEvents;
             uint midiEventCount;
 
-            if (CardinalExpanderFromCVToCarlaMIDI* const midiInExpander = leftExpander.module != nullptr && leftExpander.module->model == modelExpanderInputMIDI
-                                                                        ? static_cast<CardinalExpanderFromCVToCarlaMIDI*>(leftExpander.module)
-                                                                        : nullptr)
+            if (leftExpander.module != nullptr && leftExpander.module->model == modelExpanderInputMIDI)
             {
-                midiEvents = midiInExpander->midiEvents;
-                midiEventCount = midiInExpander->midiEventCount;
-                midiInExpander->midiEventCount = midiInExpander->frame = 0;
+                // handed over by the flip requested on the previous frame, untouched by the expander until the next one
+                CardinalExpanderMIDIBlock* const midiBlock = static_cast<CardinalExpanderMIDIBlock*>(leftExpander.module->rightExpander.consumerMessage);
+                midiEvents = midiBlock->midiEvents;
+                midiEventCount = midiBlock->midiEventCount;
             }
             else
             {
@@ -400,11 +448,19 @@ struct CarlaModule : Module {
             if ((midiOutExpander = rightExpander.module != nullptr && rightExpander.module->model == modelExpanderOutputMIDI
                                  ? static_cast<CardinalExpanderFromCarlaMIDIToCV*>(rightExpander.module)
                                  : nullptr))
-                midiOutExpander->midiEventCount = 0;
+                static_cast<CardinalExpanderMIDIBlock*>(midiOutExpander->leftExpander.producerMessage)->midiEventCount = 0;
 
             audioDataFill = 0;
-            fCarlaPluginDescriptor->process(fCarlaPluginHandle, dataInPtr, dataOutPtr, BUFFER_SIZE, midiEvents, midiEventCount);
+            fCarlaPluginDescriptor->process(fCarlaPluginHandle, dataInPtr, dataOutPtr, bufferSize, midiEvents, midiEventCount);
+
+            // play back the new midi output from the next frame on
+            if (midiOutExpander != nullptr)
+                midiOutExpander->leftExpander.requestMessageFlip();
         }
+
+        // take over the midi input one frame before processing, the flip happens in between frames
+        if (audioDataFill + 1 == bufferSize && leftExpander.module != nullptr && leftExpander.module->model == modelExpanderInputMIDI)
+            leftExpander.module->rightExpander.requestMessageFlip();
     }
 
     void onReset() override
@@ -434,7 +490,7 @@ static_assert((int)CarlaModule::NUM_INPUTS == (int)CarlaModule::NUM_OUTPUTS, "in
 
 static uint32_t host_get_buffer_size(const NativeHostHandle handle)
 {
-    return BUFFER_SIZE;
+    return static_cast<CarlaModule*>(handle)->bufferSize;
 }
 
 static double host_get_sample_rate(const NativeHostHandle handle)
@@ -458,10 +514,12 @@ static bool host_write_midi_event(const NativeHostHandle handle, const NativeMid
 {
     if (CardinalExpanderFromCarlaMIDIToCV* const expander = static_cast<CarlaModule*>(handle)->midiOutExpander)
     {
-        if (expander->midiEventCount == CardinalExpanderFromCarlaMIDIToCV::MAX_MIDI_EVENTS)
+        CardinalExpanderMIDIBlock* const midiBlock = static_cast<CardinalExpanderMIDIBlock*>(expander->leftExpander.producerMessage);
+
+        if (midiBlock->midiEventCount == CardinalExpanderMIDIBlock::MAX_MIDI_EVENTS)
             return false;
 
-        NativeMidiEvent& expanderEvent(expander->midiEvents[expander->midiEventCount++]);
+        NativeMidiEvent& expanderEvent(midiBlock->midiEvents[midiBlock->midiEventCount++]);
         carla_copyStruct(expanderEvent, *event);
         return true;
     }
@@ -570,8 +628,10 @@ struct CarlaModuleWidget : ModuleWidgetWith9HP, IdleCallback {
         if (pcontext->window != nullptr)
             carla_set_engine_option(handle, ENGINE_OPTION_FRONTEND_UI_SCALE, pcontext->window->pixelRatio*1000, nullptr);
 
+        // only gives idle time to the plugin windows, which do not need the full idle rate.
+        // those are separate from the rack, so not throttled along with this widget
         if (! idleCallbackActive)
-            idleCallbackActive = pcontext->addIdleCallback(this);
+            idleCallbackActive = pcontext->addIdleCallback(this, 30.0, kIdlePriorityNormal, nullptr);
 
         module->fUI = this;
     }
@@ -702,6 +762,11 @@ struct CarlaModuleWidget : ModuleWidgetWith9HP, IdleCallback {
             [=]() {return module->params[CarlaModule::BIPOLAR_OUTPUTS].getValue() > 0.1f;},
             [=]() {module->params[CarlaModule::BIPOLAR_OUTPUTS].setValue(1.0f - module->params[CarlaModule::BIPOLAR_OUTPUTS].getValue());}
         ));
+
+        menu->addChild(createCheckMenuItem("Process at host block size", "",
+            [=]() {return module->params[CarlaModule::HOST_BLOCK_SIZE].getValue() > 0.5f;},
+            [=]() {module->params[CarlaModule::HOST_BLOCK_SIZE].setValue(1.0f - module->params[CarlaModule::HOST_BLOCK_SIZE].getValue());}
+        ));
     }
 
     void onDoubleClick(const DoubleClickEvent& e) override
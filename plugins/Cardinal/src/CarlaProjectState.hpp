@@ -0,0 +1,124 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include "plugincontext.hpp"
+
+#include "CarlaEngine.hpp"
+#include "water/streams/MemoryOutputStream.h"
+
+#include <cstdio>
+#include <string>
+#include <thread>
+
+// -----------------------------------------------------------------------------------------------------------
+// Hosted projects of the Carla and Ildaeil modules, kept as a file in the module patch storage when the patch is saved.
+// onSave() starts serializing the project on a background thread, so all hosted plugins of a patch are saved at once,
+// and the following dataToJson() on the same thread waits for it and refers to the file instead of inlining a string.
+// Other calls of dataToJson(), like for presets and the clipboard, have no patch storage and keep the inline project.
+
+struct CarlaProjectState {
+    static constexpr const char* const kFilename = "project.carxp";
+
+    std::thread thread;
+    std::thread::id requester;
+    bool written = false;
+
+    ~CarlaProjectState()
+    {
+        wait();
+    }
+
+    void startSaving(CARLA_BACKEND_NAMESPACE::CarlaEngine* const engine, const std::string& storageDir)
+    {
+        wait();
+        requester = std::this_thread::get_id();
+        written = false;
+
+        thread = std::thread([this, engine, path = rack::system::join(storageDir, kFilename)] {
+            rack::system::setThreadName("Carla project save");
+
+            water::MemoryOutputStream projectState;
+            engine->saveProjectInternal(projectState);
+
+            written = writeFile(path, projectState.getData(), projectState.getDataSize());
+        });
+    }
+
+    // reference to the project file saved since onSave(), or null to inline the project as before
+    json_t* finishSaving()
+    {
+        if (! thread.joinable() || requester != std::this_thread::get_id())
+            return nullptr;
+
+        thread.join();
+        requester = std::thread::id();
+
+        if (! written)
+            return nullptr;
+
+        json_t* const rootJ = json_object();
+        json_object_set_new(rootJ, "file", json_string(kFilename));
+        return rootJ;
+    }
+
+    void wait()
+    {
+        if (thread.joinable())
+            thread.join();
+    }
+
+    // project from the module JSON, either inline or as a reference to the project file
+    static bool read(json_t* const rootJ, const std::string& storageDir, std::string& projectState)
+    {
+        if (const char* const inlineState = json_string_value(rootJ))
+        {
+            projectState = inlineState;
+            return true;
+        }
+
+        if (json_string_value(json_object_get(rootJ, "file")) == nullptr)
+            return false;
+
+        const std::string path = rack::system::join(storageDir, kFilename);
+
+        FILE* const f = std::fopen(path.c_str(), "rb");
+        DISTRHO_SAFE_ASSERT_RETURN(f != nullptr, false);
+
+        std::fseek(f, 0, SEEK_END);
+        const long size = std::ftell(f);
+        std::fseek(f, 0, SEEK_SET);
+
+        projectState.resize(size > 0 ? size : 0);
+        const bool ok = size > 0 && std::fread(&projectState[0], size, 1, f) == 1;
+        std::fclose(f);
+
+        return ok;
+    }
+
+private:
+    static bool writeFile(const std::string& path, const void* const data, const size_t size)
+    {
+        FILE* const f = std::fopen(path.c_str(), "wb");
+        DISTRHO_SAFE_ASSERT_RETURN(f != nullptr, false);
+
+        const bool ok = std::fwrite(data, size, 1, f) == 1;
+        std::fclose(f);
+        return ok;
+    }
+};
@@ -46,6 +46,7 @@ TextEditor::TextEditor()
 	, mIgnoreImGuiChild(false)
 	, mShowWhitespaces(true)
 	, mCheckComments(true)
+	, mCheckCommentsFromLine(0)
 	, mStartTime(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count())
 	, mLastClick(-1.0f)
 {
@@ -2143,6 +2144,7 @@ void TextEditor::Colorize(int aFromLine, int aLines)
 	mColorRangeMin = std::max(0, mColorRangeMin);
 	mColorRangeMax = std::max(mColorRangeMin, mColorRangeMax);
 	mCheckComments = true;
+	mCheckCommentsFromLine = std::min(mCheckCommentsFromLine, std::max(0, aFromLine));
 }
 
 void TextEditor::ColorizeRange(int aFromLine, int aToLine)
@@ -2258,6 +2260,7 @@ void TextEditor::ColorizeInternal()
 	if (mLanguageDefinition.mColorize && (mCheckComments || mColorRangeMin < mColorRangeMax))
 	{
 		mCheckComments = false;
+		mCheckCommentsFromLine = std::numeric_limits<int>::max();
 		mColorRangeMin = std::numeric_limits<int>::max();
 		mColorRangeMax = 0;
 		return mLanguageDefinition.mColorize(mLines, mLanguageDefinition.mColorizeData);
@@ -2276,10 +2279,41 @@ void TextEditor::ColorizeInternal()
 		auto concatenate = false;		// '\' on the very end of the line
 		auto currentLine = 0;
 		auto currentIndex = 0;
+
+		// lines before the first changed one keep their state, resume from there
+		mLineCommentStates.resize(endLine);
+
+		if (mCheckCommentsFromLine > 0 && mCheckCommentsFromLine < (int)endLine)
+		{
+			const LineCommentState& state(mLineCommentStates[mCheckCommentsFromLine]);
+			currentLine = mCheckCommentsFromLine;
+			if (state.mInComment)
+			{
+				commentStartLine = currentLine;
+				commentStartIndex = 0;
+			}
+			withinString = state.mWithinString;
+			withinSingleLineComment = state.mWithinSingleLineComment;
+			withinPreproc = state.mWithinPreproc;
+			firstChar = state.mFirstChar;
+			concatenate = state.mConcatenate;
+		}
+
 		while (currentLine < endLine || currentIndex < endIndex)
 		{
 			auto& line = mLines[currentLine];
 
+			if (currentIndex == 0)
+			{
+				LineCommentState& state(mLineCommentStates[currentLine]);
+				state.mInComment = commentStartLine < currentLine || (commentStartLine == currentLine && commentStartIndex == 0);
+				state.mWithinString = withinString;
+				state.mWithinSingleLineComment = withinSingleLineComment;
+				state.mWithinPreproc = withinPreproc;
+				state.mFirstChar = firstChar;
+				state.mConcatenate = concatenate;
+			}
+
 			if (currentIndex == 0 && !concatenate)
 			{
 				withinSingleLineComment = false;
@@ -2390,6 +2424,7 @@ void TextEditor::ColorizeInternal()
 			}
 		}
 		mCheckComments = false;
+		mCheckCommentsFromLine = std::numeric_limits<int>::max();
 	}
 
 	if (mColorRangeMin < mColorRangeMax)
@@ -2754,6 +2789,102 @@ static bool TokenizeCStylePunctuation(const char * in_begin, const char * in_end
 	return false;
 }
 
+static bool TokenizeSingleQuotedString(const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end)
+{
+	const char * p = in_begin;
+
+	if (*p == '\'')
+	{
+		p++;
+
+		while (p < in_end)
+		{
+			// handle end of string
+			if (*p == '\'')
+			{
+				out_begin = in_begin;
+				out_end = p + 1;
+				return true;
+			}
+
+			p++;
+		}
+	}
+
+	return false;
+}
+
+static bool TokenizeCStyle(const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end, TextEditor::PaletteIndex & paletteIndex)
+{
+	typedef TextEditor::PaletteIndex PaletteIndex;
+
+	paletteIndex = PaletteIndex::Max;
+
+	while (in_begin < in_end && isascii(*in_begin) && isblank(*in_begin))
+		in_begin++;
+
+	if (in_begin == in_end)
+	{
+		out_begin = in_end;
+		out_end = in_end;
+		paletteIndex = PaletteIndex::Default;
+	}
+	else if (TokenizeCStyleString(in_begin, in_end, out_begin, out_end))
+		paletteIndex = PaletteIndex::String;
+	else if (TokenizeCStyleCharacterLiteral(in_begin, in_end, out_begin, out_end))
+		paletteIndex = PaletteIndex::CharLiteral;
+	else if (TokenizeCStyleIdentifier(in_begin, in_end, out_begin, out_end))
+		paletteIndex = PaletteIndex::Identifier;
+	else if (TokenizeCStyleNumber(in_begin, in_end, out_begin, out_end))
+		paletteIndex = PaletteIndex::Number;
+	else if (TokenizeCStylePunctuation(in_begin, in_end, out_begin, out_end))
+		paletteIndex = PaletteIndex::Punctuation;
+
+	return paletteIndex != PaletteIndex::Max;
+}
+
+// same as C style, but character literals are colored as strings
+static bool TokenizeAngelScript(const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end, TextEditor::PaletteIndex & paletteIndex)
+{
+	if (!TokenizeCStyle(in_begin, in_end, out_begin, out_end, paletteIndex))
+		return false;
+
+	if (paletteIndex == TextEditor::PaletteIndex::CharLiteral)
+		paletteIndex = TextEditor::PaletteIndex::String;
+
+	return true;
+}
+
+// for languages where both double and single quotes delimit strings, like Lua and SQL
+static bool TokenizeQuotedStringsStyle(const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end, TextEditor::PaletteIndex & paletteIndex)
+{
+	typedef TextEditor::PaletteIndex PaletteIndex;
+
+	paletteIndex = PaletteIndex::Max;
+
+	while (in_begin < in_end && isascii(*in_begin) && isblank(*in_begin))
+		in_begin++;
+
+	if (in_begin == in_end)
+	{
+		out_begin = in_end;
+		out_end = in_end;
+		paletteIndex = PaletteIndex::Default;
+	}
+	else if (TokenizeCStyleString(in_begin, in_end, out_begin, out_end))
+		paletteIndex = PaletteIndex::String;
+	else if (TokenizeSingleQuotedString(in_begin, in_end, out_begin, out_end))
+		paletteIndex = PaletteIndex::String;
+	else if (TokenizeCStyleIdentifier(in_begin, in_end, out_begin, out_end))
+		paletteIndex = PaletteIndex::Identifier;
+	else if (TokenizeCStyleNumber(in_begin, in_end, out_begin, out_end))
+		paletteIndex = PaletteIndex::Number;
+	else if (TokenizeCStylePunctuation(in_begin, in_end, out_begin, out_end))
+		paletteIndex = PaletteIndex::Punctuation;
+
+	return paletteIndex != PaletteIndex::Max;
+}
+
 const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::CPlusPlus()
 {
 	static bool inited = false;
@@ -2782,32 +2913,7 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::CPlusPlus(
 			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
 		}
 
-		langDef.mTokenize = [](const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end, PaletteIndex & paletteIndex) -> bool
-		{
-			paletteIndex = PaletteIndex::Max;
-
-			while (in_begin < in_end && isascii(*in_begin) && isblank(*in_begin))
-				in_begin++;
-
-			if (in_begin == in_end)
-			{
-				out_begin = in_end;
-				out_end = in_end;
-				paletteIndex = PaletteIndex::Default;
-			}
-			else if (TokenizeCStyleString(in_begin, in_end, out_begin, out_end))
-				paletteIndex = PaletteIndex::String;
-			else if (TokenizeCStyleCharacterLiteral(in_begin, in_end, out_begin, out_end))
-				paletteIndex = PaletteIndex::CharLiteral;
-			else if (TokenizeCStyleIdentifier(in_begin, in_end, out_begin, out_end))
-				paletteIndex = PaletteIndex::Identifier;
-			else if (TokenizeCStyleNumber(in_begin, in_end, out_begin, out_end))
-				paletteIndex = PaletteIndex::Number;
-			else if (TokenizeCStylePunctuation(in_begin, in_end, out_begin, out_end))
-				paletteIndex = PaletteIndex::Punctuation;
-
-			return paletteIndex != PaletteIndex::Max;
-		};
+		langDef.mTokenize = TokenizeCStyle;
 
 		langDef.mCommentStart = "/*";
 		langDef.mCommentEnd = "*/";
@@ -2871,15 +2977,7 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::HLSL()
 			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
 		}
 
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[ \\t]*#[ \\t]*[a-zA-Z_]+", PaletteIndex::Preprocessor));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("L?\\\"(\\\\.|[^\\\"])*\\\"", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("\\'\\\\?[^\\']\\'", PaletteIndex::CharLiteral));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?[0-9]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[0-7]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[xX][0-9a-fA-F]+[uU]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[a-zA-Z_][a-zA-Z0-9_]*", PaletteIndex::Identifier));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[\\[\\]\\{\\}\\!\\%\\^\\&\\*\\(\\)\\-\\+\\=\\~\\|\\<\\>\\?\\/\\;\\,\\.]", PaletteIndex::Punctuation));
+		langDef.mTokenize = TokenizeCStyle;
 
 		langDef.mCommentStart = "/*";
 		langDef.mCommentEnd = "*/";
@@ -2920,15 +3018,7 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::GLSL()
 			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
 		}
 
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[ \\t]*#[ \\t]*[a-zA-Z_]+", PaletteIndex::Preprocessor));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("L?\\\"(\\\\.|[^\\\"])*\\\"", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("\\'\\\\?[^\\']\\'", PaletteIndex::CharLiteral));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?[0-9]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[0-7]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[xX][0-9a-fA-F]+[uU]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[a-zA-Z_][a-zA-Z0-9_]*", PaletteIndex::Identifier));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[\\[\\]\\{\\}\\!\\%\\^\\&\\*\\(\\)\\-\\+\\=\\~\\|\\<\\>\\?\\/\\;\\,\\.]", PaletteIndex::Punctuation));
+		langDef.mTokenize = TokenizeCStyle;
 
 		langDef.mCommentStart = "/*";
 		langDef.mCommentEnd = "*/";
@@ -2969,32 +3059,7 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::C()
 			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
 		}
 
-		langDef.mTokenize = [](const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end, PaletteIndex & paletteIndex) -> bool
-		{
-			paletteIndex = PaletteIndex::Max;
-
-			while (in_begin < in_end && isascii(*in_begin) && isblank(*in_begin))
-				in_begin++;
-
-			if (in_begin == in_end)
-			{
-				out_begin = in_end;
-				out_end = in_end;
-				paletteIndex = PaletteIndex::Default;
-			}
-			else if (TokenizeCStyleString(in_begin, in_end, out_begin, out_end))
-				paletteIndex = PaletteIndex::String;
-			else if (TokenizeCStyleCharacterLiteral(in_begin, in_end, out_begin, out_end))
-				paletteIndex = PaletteIndex::CharLiteral;
-			else if (TokenizeCStyleIdentifier(in_begin, in_end, out_begin, out_end))
-				paletteIndex = PaletteIndex::Identifier;
-			else if (TokenizeCStyleNumber(in_begin, in_end, out_begin, out_end))
-				paletteIndex = PaletteIndex::Number;
-			else if (TokenizeCStylePunctuation(in_begin, in_end, out_begin, out_end))
-				paletteIndex = PaletteIndex::Punctuation;
-
-			return paletteIndex != PaletteIndex::Max;
-		};
+		langDef.mTokenize = TokenizeCStyle;
 
 		langDef.mCommentStart = "/*";
 		langDef.mCommentEnd = "*/";
@@ -3051,14 +3116,7 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::SQL()
 			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
 		}
 
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("L?\\\"(\\\\.|[^\\\"])*\\\"", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("\\\'[^\\\']*\\\'", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?[0-9]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[0-7]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[xX][0-9a-fA-F]+[uU]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[a-zA-Z_][a-zA-Z0-9_]*", PaletteIndex::Identifier));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[\\[\\]\\{\\}\\!\\%\\^\\&\\*\\(\\)\\-\\+\\=\\~\\|\\<\\>\\?\\/\\;\\,\\.]", PaletteIndex::Punctuation));
+		langDef.mTokenize = TokenizeQuotedStringsStyle;
 
 		langDef.mCommentStart = "/*";
 		langDef.mCommentEnd = "*/";
@@ -3101,14 +3159,7 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::AngelScrip
 			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
 		}
 
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("L?\\\"(\\\\.|[^\\\"])*\\\"", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("\\'\\\\?[^\\']\\'", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?[0-9]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[0-7]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[xX][0-9a-fA-F]+[uU]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[a-zA-Z_][a-zA-Z0-9_]*", PaletteIndex::Identifier));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[\\[\\]\\{\\}\\!\\%\\^\\&\\*\\(\\)\\-\\+\\=\\~\\|\\<\\>\\?\\/\\;\\,\\.]", PaletteIndex::Punctuation));
+		langDef.mTokenize = TokenizeAngelScript;
 
 		langDef.mCommentStart = "/*";
 		langDef.mCommentEnd = "*/";
@@ -3156,13 +3207,7 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::Lua()
 			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
 		}
 
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("L?\\\"(\\\\.|[^\\\"])*\\\"", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("\\\'[^\\\']*\\\'", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[xX][0-9a-fA-F]+[uU]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?[0-9]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[a-zA-Z_][a-zA-Z0-9_]*", PaletteIndex::Identifier));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[\\[\\]\\{\\}\\!\\%\\^\\&\\*\\(\\)\\-\\+\\=\\~\\|\\<\\>\\?\\/\\;\\,\\.]", PaletteIndex::Punctuation));
+		langDef.mTokenize = TokenizeQuotedStringsStyle;
 
 		langDef.mCommentStart = "--[[";
 		langDef.mCommentEnd = "]]";
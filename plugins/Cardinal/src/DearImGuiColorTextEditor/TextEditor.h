@@ -223,6 +223,7 @@ public:
 	bool IsCursorPositionChanged() const { return mCursorPositionChanged; }
 
 	bool IsColorizerEnabled() const { return mColorizerEnabled; }
+	bool IsColorizing() const { return mColorizerEnabled && (mCheckComments || mColorRangeMin < mColorRangeMax); }
 	void SetColorizerEnable(bool aValue);
 
 	Coordinates GetCursorPosition() const { return GetActualCursorCoordinates(); }
@@ -387,7 +388,20 @@ private:
 	LanguageDefinition mLanguageDefinition;
 	RegexList mRegexList;
 
+	// comment and string state at the start of each line, so comment checks only rescan from the first changed line
+	struct LineCommentState
+	{
+		bool mInComment;
+		bool mWithinString;
+		bool mWithinSingleLineComment;
+		bool mWithinPreproc;
+		bool mFirstChar;
+		bool mConcatenate;
+	};
+
 	bool mCheckComments;
+	int mCheckCommentsFromLine;
+	std::vector<LineCommentState> mLineCommentStates;
 	Breakpoints mBreakpoints;
 	ErrorMarkers mErrorMarkers;
 	ImVec2 mCharAdvance;
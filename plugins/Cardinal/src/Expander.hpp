@@ -27,18 +27,38 @@ struct CardinalExpander : Module {
     static const constexpr int kNumOutputs = numOutputs;
 };
 
-struct CardinalExpanderFromCVToCarlaMIDI : CardinalExpander<6, 0> {
+// MIDI events of one hosted plugin process call, as Rack expander messages.
+// Both expanders own a pair of these, flipped by the engine in between frames whenever requested,
+// so the hosted plugin module and the expander never touch the same events at the same time.
+// Event times are frames relative to the start of the block.
+struct CardinalExpanderMIDIBlock {
     static const constexpr uint MAX_MIDI_EVENTS = 128;
-    // continuously filled up by expander, flushed on each new block frame
-    // frames are related to host block size
-    uint frame, midiEventCount;
+    uint midiEventCount;
     NativeMidiEvent midiEvents[MAX_MIDI_EVENTS];
 };
 
+struct CardinalExpanderFromCVToCarlaMIDI : CardinalExpander<6, 0> {
+    static const constexpr uint MAX_MIDI_EVENTS = CardinalExpanderMIDIBlock::MAX_MIDI_EVENTS;
+    // messages for the module on our right side, filled up by expander one frame at a time,
+    // the module on the right requests a flip one frame before processing each block and reads the consumer side
+    CardinalExpanderMIDIBlock midiBlocks[2] = {};
+
+    CardinalExpanderFromCVToCarlaMIDI()
+    {
+        rightExpander.producerMessage = &midiBlocks[0];
+        rightExpander.consumerMessage = &midiBlocks[1];
+    }
+};
+
 struct CardinalExpanderFromCarlaMIDIToCV : CardinalExpander<0, 6> {
-    static const constexpr uint MAX_MIDI_EVENTS = 128;
-    // filled up by connector-side in bursts, must be reset on next cycle by expander
-    // frames are not related to any particular block size
-    uint midiEventCount;
-    NativeMidiEvent midiEvents[MAX_MIDI_EVENTS];
+    static const constexpr uint MAX_MIDI_EVENTS = CardinalExpanderMIDIBlock::MAX_MIDI_EVENTS;
+    // messages from the module on our left side, filled up by it on each process call followed by a flip,
+    // the consumer side is then played back by expander over the next block
+    CardinalExpanderMIDIBlock midiBlocks[2] = {};
+
+    CardinalExpanderFromCarlaMIDIToCV()
+    {
+        leftExpander.producerMessage = &midiBlocks[0];
+        leftExpander.consumerMessage = &midiBlocks[1];
+    }
 };
@@ -61,6 +61,10 @@ struct CardinalExpanderForInputMIDI : CardinalExpanderFromCVToCarlaMIDI {
     uint8_t channel = 0;
     Module* lastConnectedModule = nullptr;
 
+    // frame within the block being filled, or UINT_MAX while waiting for the expanding side
+    uint frame;
+    const void* lastMidiBlock;
+
     CardinalExpanderForInputMIDI()
     {
         static_assert(NUM_INPUTS == kNumInputs, "Invalid input configuration");
@@ -75,6 +79,32 @@ struct CardinalExpanderForInputMIDI : CardinalExpanderFromCVToCarlaMIDI {
         onReset();
     }
 
+    bool hasRoomForMidiEvents(const uint count) const
+    {
+        if (frame == UINT_MAX)
+            return false;
+
+        const CardinalExpanderMIDIBlock* const midiBlock = static_cast<const CardinalExpanderMIDIBlock*>(rightExpander.producerMessage);
+        return midiBlock->midiEventCount + count <= MAX_MIDI_EVENTS;
+    }
+
+    NativeMidiEvent* getNextMidiEvent()
+    {
+        if (frame == UINT_MAX)
+            return nullptr;
+
+        CardinalExpanderMIDIBlock* const midiBlock = static_cast<CardinalExpanderMIDIBlock*>(rightExpander.producerMessage);
+
+        if (midiBlock->midiEventCount == MAX_MIDI_EVENTS)
+            return nullptr;
+
+        NativeMidiEvent* const m = &midiBlock->midiEvents[midiBlock->midiEventCount++];
+        m->time = frame;
+        m->port = 0;
+        m->size = 3;
+        return m;
+    }
+
     /** Must be called before setNoteGate(). */
     void setVelocity(int8_t vel, int c)
     {
@@ -83,35 +113,34 @@ struct CardinalExpanderForInputMIDI : CardinalExpanderFromCVToCarlaMIDI {
 
     void setNoteGate(int8_t note, bool gate, int c)
     {
-        if (midiEventCount == MAX_MIDI_EVENTS || frame == UINT_MAX)
-            return;
-
         const bool changedNote = gate && gates[c] && (note != notes[c]);
         const bool enabledGate = gate && !gates[c];
         const bool disabledGate = !gate && gates[c];
 
+        // keep the old state until both note off and on fit, so that no note is left hanging
+        if (!hasRoomForMidiEvents((changedNote || disabledGate ? 1 : 0) + (changedNote || enabledGate ? 1 : 0)))
+            return;
+
         if (changedNote || disabledGate)
         {
             // Note off
-            NativeMidiEvent& m(midiEvents[midiEventCount++]);
-            m.time = frame;
-            m.port = 0;
-            m.size = 3;
-            m.data[0] = 0x80 | channel;
-            m.data[1] = notes[c];
-            m.data[2] = vels[c];
+            if (NativeMidiEvent* const m = getNextMidiEvent())
+            {
+                m->data[0] = 0x80 | channel;
+                m->data[1] = notes[c];
+                m->data[2] = vels[c];
+            }
         }
 
         if (changedNote || enabledGate)
         {
             // Note on
-            NativeMidiEvent& m(midiEvents[midiEventCount++]);
-            m.time = frame;
-            m.port = 0;
-            m.size = 3;
-            m.data[0] = 0x90 | channel;
-            m.data[1] = note;
-            m.data[2] = vels[c];
+            if (NativeMidiEvent* const m = getNextMidiEvent())
+            {
+                m->data[0] = 0x90 | channel;
+                m->data[1] = note;
+                m->data[2] = vels[c];
+            }
         }
 
         notes[c] = note;
@@ -125,17 +154,13 @@ struct CardinalExpanderForInputMIDI : CardinalExpanderFromCVToCarlaMIDI {
 
         keyPressures[c] = val;
 
-        if (midiEventCount == MAX_MIDI_EVENTS || frame == UINT_MAX)
-            return;
-
         // Polyphonic key pressure
-        NativeMidiEvent& m(midiEvents[midiEventCount++]);
-        m.time = frame;
-        m.port = 0;
-        m.size = 3;
-        m.data[0] = 0xa0 | channel;
-        m.data[1] = notes[c];
-        m.data[2] = val;
+        if (NativeMidiEvent* const m = getNextMidiEvent())
+        {
+            m->data[0] = 0xa0 | channel;
+            m->data[1] = notes[c];
+            m->data[2] = val;
+        }
     }
 
     void setModWheel(int8_t modwheel)
@@ -145,17 +170,13 @@ struct CardinalExpanderForInputMIDI : CardinalExpanderFromCVToCarlaMIDI {
 
         this->modwheel = modwheel;
 
-        if (midiEventCount == MAX_MIDI_EVENTS || frame == UINT_MAX)
-            return;
-
         // Modulation Wheel (CC1)
-        NativeMidiEvent& m(midiEvents[midiEventCount++]);
-        m.time = frame;
-        m.port = 0;
-        m.size = 3;
-        m.data[0] = 0xb0 | channel;
-        m.data[1] = 1;
-        m.data[2] = modwheel;
+        if (NativeMidiEvent* const m = getNextMidiEvent())
+        {
+            m->data[0] = 0xb0 | channel;
+            m->data[1] = 1;
+            m->data[2] = modwheel;
+        }
     }
 
     void setPitchbend(int16_t pitchbend)
@@ -165,37 +186,27 @@ struct CardinalExpanderForInputMIDI : CardinalExpanderFromCVToCarlaMIDI {
 
         this->pitchbend = pitchbend;
 
-        if (midiEventCount == MAX_MIDI_EVENTS || frame == UINT_MAX)
-            return;
-
         // Pitch Wheel
-        NativeMidiEvent& m(midiEvents[midiEventCount++]);
-        m.time = frame;
-        m.port = 0;
-        m.size = 3;
-        m.data[0] = 0xe0 | channel;
-        m.data[1] = pitchbend & 0x7f;
-        m.data[2] = (pitchbend >> 7) & 0x7f;
+        if (NativeMidiEvent* const m = getNextMidiEvent())
+        {
+            m->data[0] = 0xe0 | channel;
+            m->data[1] = pitchbend & 0x7f;
+            m->data[2] = (pitchbend >> 7) & 0x7f;
+        }
     }
 
     void panic()
     {
-        if (frame != UINT_MAX)
+        // Send all note off commands
+        for (int note = 0; note <= 127; ++note)
         {
-            // Send all note off commands
-            for (int note = 0; note <= 127; ++note)
-            {
-                if (midiEventCount == MAX_MIDI_EVENTS)
-                    break;
-                // Note off
-                NativeMidiEvent& m(midiEvents[midiEventCount++]);
-                m.time = frame;
-                m.port = 0;
-                m.size = 3;
-                m.data[0] = 0x80 | channel;
-                m.data[1] = note;
-                m.data[2] = 0;
-            }
+            // Note off
+            NativeMidiEvent* const m = getNextMidiEvent();
+            if (m == nullptr)
+                break;
+            m->data[0] = 0x80 | channel;
+            m->data[1] = note;
+            m->data[2] = 0;
         }
 
         reset();
@@ -212,13 +223,14 @@ struct CardinalExpanderForInputMIDI : CardinalExpanderFromCVToCarlaMIDI {
         }
         modwheel = -1;
         pitchbend = 0x2000;
-        midiEventCount = 0;
-        frame = UINT_MAX;
     }
 
     void onReset() override
     {
         reset();
+        midiBlocks[0].midiEventCount = midiBlocks[1].midiEventCount = 0;
+        frame = UINT_MAX;
+        lastMidiBlock = rightExpander.producerMessage;
         channel = 0;
         lastConnectedModule = nullptr;
     }
@@ -242,6 +254,14 @@ struct CardinalExpanderForInputMIDI : CardinalExpanderFromCVToCarlaMIDI {
             return;
         }
 
+        // the expanding side has taken the previous block, start filling up a new one
+        if (lastMidiBlock != rightExpander.producerMessage)
+        {
+            lastMidiBlock = rightExpander.producerMessage;
+            static_cast<CardinalExpanderMIDIBlock*>(rightExpander.producerMessage)->midiEventCount = 0;
+            frame = 0;
+        }
+
         // wait until expanding side is ready
         if (frame == UINT_MAX)
             return;
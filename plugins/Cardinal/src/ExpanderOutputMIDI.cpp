@@ -50,7 +50,7 @@ struct CardinalExpanderForOutputMIDI : CardinalExpanderFromCarlaMIDIToCV {
         NUM_LIGHTS
     };
 
-    NativeMidiEvent midiEventsCopy[MAX_MIDI_EVENTS];
+    const void* lastMidiBlock;
     const NativeMidiEvent* midiEventsPtr;
     uint32_t midiEventsLeft;
     uint32_t midiEventFrame;
@@ -106,7 +106,8 @@ struct CardinalExpanderForOutputMIDI : CardinalExpanderFromCarlaMIDIToCV {
     void reset()
     {
         midiEventsPtr = nullptr;
-        midiEventCount = 0;
+        midiBlocks[0].midiEventCount = midiBlocks[1].midiEventCount = 0;
+        lastMidiBlock = leftExpander.consumerMessage;
         midiEventsLeft = 0;
         midiEventFrame = 0;
         channel = 0;
@@ -162,7 +163,7 @@ struct CardinalExpanderForOutputMIDI : CardinalExpanderFromCarlaMIDIToCV {
         if (leftExpander.module == nullptr)
         {
             // something was connected before, but not anymore, reset
-            if (midiEventCount != 0)
+            if (midiEventsPtr != nullptr)
                 onReset();
             return;
         }
@@ -170,20 +171,19 @@ struct CardinalExpanderForOutputMIDI : CardinalExpanderFromCarlaMIDIToCV {
         {
             // whatever we were connected to has changed, reset
             lastConnectedModule = leftExpander.module;
-            if (midiEventCount != 0)
+            if (midiEventsPtr != nullptr)
                 onReset();
             return;
         }
 
-        // check if expanding side has messages for us
-        if (midiEventCount != 0)
+        // check if expanding side has handed over a new block, it stays untouched until the next one
+        if (lastMidiBlock != leftExpander.consumerMessage)
         {
+            const CardinalExpanderMIDIBlock* const midiBlock = static_cast<const CardinalExpanderMIDIBlock*>(leftExpander.consumerMessage);
+            lastMidiBlock = midiBlock;
             midiEventFrame = 0;
-            midiEventsLeft = midiEventCount;
-            midiEventsPtr = midiEventsCopy;
-            std::memcpy(midiEventsCopy, midiEvents, sizeof(NativeMidiEvent)*midiEventCount);
-            // reset as required
-            midiEventCount = 0;
+            midiEventsLeft = midiBlock->midiEventCount;
+            midiEventsPtr = midiBlock->midiEvents;
         }
 
         while (midiEventsLeft != 0)
@@ -24,7 +24,7 @@
 USE_NAMESPACE_DISTRHO;
 
 template<int numIO>
-struct HostAudio : TerminalModule {
+struct HostAudio : TerminalModule, ModuleSampleRateCoefficients {
     CardinalPluginContext* const pcontext;
     const int numParams;
     const int numInputs;
@@ -35,15 +35,30 @@ struct HostAudio : TerminalModule {
     uint32_t dataFrame = 0;
     uint32_t lastProcessCounter = 0;
 
-    // for rack core audio module compatibility
-    dsp::RCFilter dcFilters[numIO];
+    // host audio converted into voltages a chunk of frames at a time, so each frame only indexes into it
+    static constexpr const uint32_t kChunkFrames = 64;
+    alignas(16) float inputVoltages[numIO][kChunkFrames];
+
+    // host outputs claimed by this module for the current block, written directly instead of accumulated
+    bool directOutputs[numIO] = {};
+
+    // for rack core audio module compatibility, 4 channels per filter
+    static constexpr const int kNumFilters = (numIO + 3) / 4;
+    dsp::TRCFilter<simd::float_4> dcFilters[kNumFilters];
     bool dcFilterEnabled = (numIO == 2);
 
+    // per frame input code for the channel count of the variant, chosen once on construction
+    typedef void (HostAudio::*ProcessInputFn)(uint32_t k);
+    const ProcessInputFn processInputFn;
+
     HostAudio()
         : pcontext(static_cast<CardinalPluginContext*>(APP)),
           numParams(numIO == 2 ? 1 : 0),
           numInputs(pcontext->variant == kCardinalVariantMain ? numIO : 2),
-          numOutputs(pcontext->variant == kCardinalVariantSynth ? 0 : pcontext->variant == kCardinalVariantMain ? numIO : 2)
+          numOutputs(pcontext->variant == kCardinalVariantSynth ? 0 : pcontext->variant == kCardinalVariantMain ? numIO : 2),
+          processInputFn(numOutputs == numIO ? &HostAudio::processInput<numIO>
+                       : numOutputs == 2 ? &HostAudio::processInput<2>
+                       : &HostAudio::processInput<0>)
     {
         if (pcontext == nullptr)
             throw rack::Exception("Plugin context is null");
@@ -54,7 +69,7 @@ struct HostAudio : TerminalModule {
             configParam(0, 0.f, 2.f, 1.f, "Level", " dB", -10, 40);
 
         const float sampleTime = pcontext->engine->getSampleTime();
-        for (int i=0; i<numIO; ++i)
+        for (int i=0; i<kNumFilters; ++i)
             dcFilters[i].setCutoffFreq(10.f * sampleTime);
     }
 
@@ -63,10 +78,45 @@ struct HostAudio : TerminalModule {
         dcFilterEnabled = (numIO == 2);
     }
 
-    void onSampleRateChange(const SampleRateChangeEvent& e) override
+    void updateSampleRateCoefficients(float, const float sampleTime) override
     {
-        for (int i=0; i<numIO; ++i)
-            dcFilters[i].setCutoffFreq(10.f * e.sampleTime);
+        for (int i=0; i<kNumFilters; ++i)
+            dcFilters[i].setCutoffFreq(10.f * sampleTime);
+    }
+
+    template<int channels>
+    void convertInputChunk(const uint32_t offset, const uint32_t bufferSize)
+    {
+        const uint32_t remaining = bufferSize - offset;
+        const uint32_t frames = remaining < kChunkFrames ? remaining : kChunkFrames;
+        const float* const* const dataIns = pcontext->dataIns;
+
+        if (bypassed || dataIns == nullptr)
+        {
+            std::memset(inputVoltages, 0, sizeof(float)*kChunkFrames*channels);
+            return;
+        }
+
+        for (int i=0; i<channels; ++i)
+        {
+            float* const voltages = inputVoltages[i];
+
+            // can be null on main variant
+            if (dataIns[i] == nullptr)
+            {
+                std::memset(voltages, 0, sizeof(float)*kChunkFrames);
+                continue;
+            }
+
+            const float* const dataIn = dataIns[i] + offset;
+            uint32_t f = 0;
+
+            for (; f + 4 <= frames; f += 4)
+                (simd::float_4::load(dataIn + f) * 10.0f).store(voltages + f);
+
+            for (; f < frames; ++f)
+                voltages[f] = dataIn[f] * 10.0f;
+        }
     }
 
     void processTerminalInput(const ProcessArgs&) override
@@ -81,6 +131,9 @@ struct HostAudio : TerminalModule {
             dataFrame = 0;
             lastProcessCounter = processCounter;
 
+            if (! bypassed)
+                markHostInputsUsed(pcontext, 0, numOutputs);
+
             if (numIO == 2)
             {
                 in1connected = inputs[0].isConnected();
@@ -92,17 +145,28 @@ struct HostAudio : TerminalModule {
         const uint32_t k = dataFrame;
         DISTRHO_SAFE_ASSERT_INT2_RETURN(k < bufferSize, k, bufferSize,);
 
+        (this->*processInputFn)(k);
+    }
+
+    template<int channels>
+    void processInput(const uint32_t k)
+    {
+        const uint32_t chunkFrame = k % kChunkFrames;
+
+        if (chunkFrame == 0)
+            convertInputChunk<channels>(k, pcontext->bufferSize);
+
         // from host into cardinal, shows as output plug
-        if (bypassed)
-        {
-            for (int i=0; i<numOutputs; ++i)
-                outputs[i].setVoltage(0.0f);
-        }
-        else if (const float* const* const dataIns = pcontext->dataIns)
-        {
-            for (int i=0; i<numOutputs; ++i)
-                outputs[i].setVoltage(dataIns[i][k] * 10.0f);
-        }
+        for (int i=0; i<channels; ++i)
+            outputs[i].setVoltage(inputVoltages[i][chunkFrame]);
+    }
+
+    void writeOutput(float** const dataOuts, const int index, const uint32_t k, const float value)
+    {
+        if (directOutputs[index])
+            dataOuts[index][k] = value;
+        else
+            dataOuts[index][k] += value;
     }
 
     json_t* dataToJson() override
@@ -134,6 +198,11 @@ struct HostAudio2 : HostAudio<2> {
     float gainMeterR = 0.0f;
 #endif
 
+    // level gain, ramped linearly to the level of the block over its frames
+    float gain = 1.0f;
+    float gainStep = 0.0f;
+    bool gainInitialized = false;
+
 #ifndef HEADLESS
     void onReset() override
     {
@@ -141,9 +210,9 @@ struct HostAudio2 : HostAudio<2> {
         resetMeters = true;
     }
 
-    void onSampleRateChange(const SampleRateChangeEvent& e) override
+    void updateSampleRateCoefficients(const float sampleRate, const float sampleTime) override
     {
-        HostAudio<2>::onSampleRateChange(e);
+        HostAudio<2>::updateSampleRateCoefficients(sampleRate, sampleTime);
         resetMeters = true;
     }
 #endif
@@ -172,26 +241,49 @@ struct HostAudio2 : HostAudio<2> {
         if (bypassed)
             return;
 
+        if (k == 0)
+        {
+            directOutputs[0] = in1connected && claimHostOutput(pcontext, 0);
+            directOutputs[1] = claimHostOutput(pcontext, 1);
+
+            // gain (stereo variant only), the level knob is only read once per block
+            const float targetGain = std::pow(params[0].getValue(), 2.f);
+
+            if (gainInitialized)
+            {
+                gainStep = (targetGain - gain) / bufferSize;
+            }
+            else
+            {
+                gain = targetGain;
+                gainStep = 0.0f;
+                gainInitialized = true;
+            }
+        }
+
         float** const dataOuts = pcontext->dataOuts;
 
-        // gain (stereo variant only)
-        const float gain = std::pow(params[0].getValue(), 2.f);
+        gain += gainStep;
 
-        // read stereo values
-        float valueL, valueR;
+        // read stereo values, filtered and scaled together
+        simd::float_4 values(in1connected ? inputs[0].getVoltageSum() * 0.1f : 0.0f,
+                             in2connected ? inputs[1].getVoltageSum() * 0.1f : 0.0f,
+                             0.0f, 0.0f);
 
-        if (in1connected)
+        if (dcFilterEnabled)
         {
-            valueL = inputs[0].getVoltageSum() * 0.1f;
+            dcFilters[0].process(values);
+            values = dcFilters[0].highpass();
+        }
 
-            if (dcFilterEnabled)
-            {
-                dcFilters[0].process(valueL);
-                valueL = dcFilters[0].highpass();
-            }
+        values = simd::clamp(values * gain, -1.0f, 1.0f);
 
-            valueL = clamp(valueL * gain, -1.0f, 1.0f);
-            dataOuts[0][k] += valueL;
+        float valueL, valueR;
+
+        if (in1connected)
+        {
+            valueL = values[0];
+            writeOutput(dataOuts, 0, k, valueL);
         }
         else
         {
@@ -200,21 +292,13 @@ struct HostAudio2 : HostAudio<2> {
 
         if (in2connected)
         {
-            valueR = inputs[1].getVoltageSum() * 0.1f;
-
-            if (dcFilterEnabled)
-            {
-                dcFilters[1].process(valueR);
-                valueR = dcFilters[1].highpass();
-            }
-
-            valueR = clamp(valueR * gain, -1.0f, 1.0f);
-            dataOuts[1][k] += valueR;
+            valueR = values[1];
+            writeOutput(dataOuts, 1, k, valueR);
         }
         else if (in1connected)
         {
             valueR = valueL;
-            dataOuts[1][k] += valueL;
+            writeOutput(dataOuts, 1, k, valueL);
         }
 #ifndef HEADLESS
         else
@@ -249,6 +333,13 @@ struct HostAudio2 : HostAudio<2> {
 struct HostAudio8 : HostAudio<8> {
     // no meters in this variant
 
+    // per frame output code for the channel count of the variant, chosen once on construction
+    typedef void (HostAudio8::*ProcessOutputFn)(uint32_t k);
+    const ProcessOutputFn processOutputFn;
+
+    HostAudio8()
+        : processOutputFn(numInputs == 8 ? &HostAudio8::processOutput<8> : &HostAudio8::processOutput<2>) {}
+
     void processTerminalOutput(const ProcessArgs&) override
     {
         if (pcontext->bypassed)
@@ -263,19 +354,38 @@ struct HostAudio8 : HostAudio<8> {
         if (bypassed)
             return;
 
+        (this->*processOutputFn)(k);
+    }
+
+    template<int channels>
+    void processOutput(const uint32_t k)
+    {
+        if (k == 0)
+        {
+            for (int i=0; i<channels; ++i)
+                directOutputs[i] = claimHostOutput(pcontext, i);
+        }
+
         float** const dataOuts = pcontext->dataOuts;
 
-        for (int i=0; i<numInputs; ++i)
+        // 4 channels at a time
+        for (int g=0; g*4<channels; ++g)
         {
-            float v = inputs[i].getVoltageSum() * 0.1f;
+            simd::float_4 values;
+            for (int c=0; c<4; ++c)
+                values[c] = g*4 + c < channels ? inputs[g*4 + c].getVoltageSum() : 0.0f;
+            values *= 0.1f;
 
             if (dcFilterEnabled)
             {
-                dcFilters[i].process(v);
-                v = dcFilters[i].highpass();
+                dcFilters[g].process(values);
+                values = dcFilters[g].highpass();
             }
 
-            dataOuts[i][k] += clamp(v, -1.0f, 1.0f);
+            values = simd::clamp(values, -1.0f, 1.0f);
+
+            for (int c=0; c<4 && g*4 + c < channels; ++c)
+                writeOutput(dataOuts, g*4 + c, k, values[c]);
         }
     }
 
@@ -26,9 +26,19 @@ USE_NAMESPACE_DISTRHO;
 
 struct HostCV : TerminalModule {
     CardinalPluginContext* const pcontext;
+    // CV ports only exist in the main variant, which does not change during the lifetime of the module
+    const bool hasHostCV;
     bool bypassed = false;
     int dataFrame = 0;
     uint32_t lastProcessCounter = 0;
+    // host outputs claimed by this module for the current block, written directly instead of accumulated
+    bool directOutputs[10] = {};
+
+    // set once per block, ports with nothing to do are skipped on every frame
+    uint32_t activeOutputs = 0;
+    uint32_t activeInputs = 0;
+    float outputOffsets[10] = {};
+    float inputOffsets[10] = {};
 
     enum ParamIds {
         BIPOLAR_INPUTS_1_5,
@@ -48,7 +58,8 @@ struct HostCV : TerminalModule {
     };
 
     HostCV()
-        : pcontext(static_cast<CardinalPluginContext*>(APP))
+        : pcontext(static_cast<CardinalPluginContext*>(APP)),
+          hasHostCV(pcontext != nullptr && pcontext->variant == kCardinalVariantMain)
     {
         if (pcontext == nullptr)
             throw rack::Exception("Plugin context is null");
@@ -62,7 +73,7 @@ struct HostCV : TerminalModule {
 
     void processTerminalInput(const ProcessArgs&) override
     {
-        if (pcontext->variant != kCardinalVariantMain)
+        if (! hasHostCV)
             return;
 
         const uint32_t bufferSize = pcontext->bufferSize;
@@ -74,38 +85,56 @@ struct HostCV : TerminalModule {
             bypassed = isBypassed();
             dataFrame = 0;
             lastProcessCounter = processCounter;
+            startInputBlock();
         }
 
         // only incremented on output
         const uint32_t k = dataFrame;
         DISTRHO_SAFE_ASSERT_RETURN(k < bufferSize,);
 
+        const float* const* const dataIns = pcontext->dataIns;
+
+        for (uint32_t mask = activeOutputs; mask != 0; mask &= mask - 1)
+        {
+            const uint32_t i = __builtin_ctz(mask);
+            outputs[i].setVoltage(dataIns[i+CARDINAL_AUDIO_IO_OFFSET][k] - outputOffsets[i]);
+        }
+    }
+
+    void startInputBlock()
+    {
+        activeOutputs = 0;
+
         if (bypassed)
         {
             for (int i=0; i<10; ++i)
                 outputs[i].setVoltage(0.0f);
+            return;
         }
-        else if (const float* const* const dataIns = pcontext->dataIns)
-        {
-            if (dataIns[CARDINAL_AUDIO_IO_OFFSET] == nullptr)
-                return;
 
-            float outputOffset;
-            outputOffset = params[BIPOLAR_OUTPUTS_1_5].getValue() > 0.1f ? 5.0f : 0.0f;
+        markHostInputsUsed(pcontext, CARDINAL_AUDIO_IO_OFFSET, 10);
+
+        const float* const* const dataIns = pcontext->dataIns;
+
+        if (dataIns == nullptr || dataIns[CARDINAL_AUDIO_IO_OFFSET] == nullptr)
+            return;
 
-            for (int i=0; i<5; ++i)
-                outputs[i].setVoltage(dataIns[i+CARDINAL_AUDIO_IO_OFFSET][k] - outputOffset);
+        const float offset1 = params[BIPOLAR_OUTPUTS_1_5].getValue() > 0.1f ? 5.0f : 0.0f;
+        const float offset2 = params[BIPOLAR_OUTPUTS_6_10].getValue() > 0.1f ? 5.0f : 0.0f;
 
-            outputOffset = params[BIPOLAR_OUTPUTS_6_10].getValue() > 0.1f ? 5.0f : 0.0f;
+        // nothing reads the voltage of unconnected outputs, they get updated again once a cable is added
+        for (int i=0; i<10; ++i)
+        {
+            outputOffsets[i] = i < 5 ? offset1 : offset2;
 
-            for (int i=5; i<10; ++i)
-                outputs[i].setVoltage(dataIns[i+CARDINAL_AUDIO_IO_OFFSET][k] - outputOffset);
+            if (outputs[i].isConnected())
+                activeOutputs |= 1u << i;
         }
     }
 
     void processTerminalOutput(const ProcessArgs&) override
     {
-        if (pcontext->variant != kCardinalVariantMain || pcontext->bypassed)
+        if (! hasHostCV || pcontext->bypassed)
             return;
 
         const uint32_t bufferSize = pcontext->bufferSize;
@@ -122,16 +151,44 @@ struct HostCV : TerminalModule {
         if (dataOuts[CARDINAL_AUDIO_IO_OFFSET] == nullptr)
             return;
 
-        float inputOffset;
-        inputOffset = params[BIPOLAR_INPUTS_1_5].getValue() > 0.1f ? 5.0f : 0.0f;
+        if (k == 0)
+            startOutputBlock();
+
+        for (uint32_t mask = activeInputs; mask != 0; mask &= mask - 1)
+        {
+            const uint32_t i = __builtin_ctz(mask);
+            writeOutput(dataOuts, i, k, inputs[i].getVoltage() + inputOffsets[i]);
+        }
+    }
+
+    void startOutputBlock()
+    {
+        activeInputs = 0;
 
-        for (int i=0; i<5; ++i)
-            dataOuts[i+CARDINAL_AUDIO_IO_OFFSET][k] += inputs[i].getVoltage() + inputOffset;
+        const float offset1 = params[BIPOLAR_INPUTS_1_5].getValue() > 0.1f ? 5.0f : 0.0f;
+        const float offset2 = params[BIPOLAR_INPUTS_6_10].getValue() > 0.1f ? 5.0f : 0.0f;
 
-        inputOffset = params[BIPOLAR_INPUTS_6_10].getValue() > 0.1f ? 5.0f : 0.0f;
+        // unconnected inputs without offset would only add silence, the plugin clears outputs nobody claimed
+        for (int i=0; i<10; ++i)
+        {
+            inputOffsets[i] = i < 5 ? offset1 : offset2;
+
+            if (inputs[i].isConnected() || inputOffsets[i] != 0.0f)
+            {
+                activeInputs |= 1u << i;
+                directOutputs[i] = claimHostOutput(pcontext, i+CARDINAL_AUDIO_IO_OFFSET);
+            }
+        }
+    }
+
+    void writeOutput(float** const dataOuts, const int index, const uint32_t k, const float value)
+    {
+        float* const dataOut = dataOuts[index+CARDINAL_AUDIO_IO_OFFSET];
 
-        for (int i=5; i<10; ++i)
-            dataOuts[i+CARDINAL_AUDIO_IO_OFFSET][k] += inputs[i].getVoltage() + inputOffset;
+        if (directOutputs[index])
+            dataOut[k] = value;
+        else
+            dataOut[k] += value;
     }
 };
 
@@ -35,6 +35,9 @@
 
 USE_NAMESPACE_DISTRHO;
 
+// smoothed values closer than this to their target snap onto it, the exponential filter never reaches it on its own
+static constexpr const float kSmoothingTolerance = 1e-4f;
+
 struct HostMIDICC : TerminalModule {
     enum ParamIds {
         NUM_PARAMS
@@ -60,8 +63,7 @@ struct HostMIDICC : TerminalModule {
     struct MidiInput {
         // Cardinal specific
         CardinalPluginContext* const pcontext;
-        const MidiEvent* midiEvents;
-        uint32_t midiEventsLeft;
+        HostMidiEvents midiEvents;
         uint32_t midiEventFrame;
         uint32_t lastProcessCounter;
         uint8_t channel;
@@ -83,6 +85,18 @@ struct HostMIDICC : TerminalModule {
         bool mpeMode;
         bool lsbMode;
 
+        // Cardinal specific, outputs are only recalculated when their MIDI data or settings change
+        /** [cell][channel], values the filters are converging to */
+        float targets[NUM_OUTPUTS][16];
+        /** [cell][channel], filtered values in volts, as written to the outputs */
+        alignas(16) float voltages[NUM_OUTPUTS][16];
+        uint32_t changedOutputs;
+        uint32_t smoothingOutputs;
+        int8_t lastLearnedCcs[16];
+        bool lastSmooth;
+        bool lastMpeMode;
+        bool lastLsbMode;
+
         MidiInput(CardinalPluginContext* const pc)
             : pcontext(pc)
         {
@@ -97,8 +111,7 @@ struct HostMIDICC : TerminalModule {
 
         void reset()
         {
-            midiEvents = nullptr;
-            midiEventsLeft = 0;
+            midiEvents.clear();
             midiEventFrame = 0;
             lastProcessCounter = 0;
             channel = 0;
@@ -115,6 +128,72 @@ struct HostMIDICC : TerminalModule {
             smooth = true;
             mpeMode = false;
             lsbMode = false;
+
+            // Cardinal specific
+            for (int id = 0; id < NUM_OUTPUTS; ++id)
+            {
+                for (int c = 0; c < 16; ++c)
+                    valueFilters[id][c].out = 0.f;
+            }
+
+            std::memset(targets, 0, sizeof(targets));
+            std::memset(voltages, 0, sizeof(voltages));
+            std::memset(lastLearnedCcs, -1, sizeof(lastLearnedCcs));
+            changedOutputs = (1u << NUM_OUTPUTS) - 1;
+            smoothingOutputs = 0;
+            lastSmooth = smooth;
+            lastMpeMode = mpeMode;
+            lastLsbMode = lsbMode;
+        }
+
+        float getValue(const int id, const int c) const
+        {
+            if (id == CC_OUTPUT_CH_PRESSURE)
+                return static_cast<float>(chPressure[c]) / 128.0f;
+            if (id == CC_OUTPUT_PITCHBEND)
+                return static_cast<float>(pitchbend[c]) / 16384.0f;
+
+            const int8_t cc = lastLearnedCcs[id];
+
+            if (cc < 0)
+                return 0.f;
+
+            int16_t cellValue = int16_t(ccValues[cc][c]) * 128;
+            if (lsbMode && cc < 32)
+                cellValue += ccValues[cc + 32][c];
+
+            // Maximum value for 14-bit CC should be MSB=127 LSB=0, not MSB=127 LSB=127, because this is the maximum value that 7-bit controllers can send.
+            return static_cast<float>(cellValue) / (128.0f * 127.0f);
+        }
+
+        void updateOutput(const int id, const int channels)
+        {
+            // unlearned cells are cleared right away
+            const bool jump = !smooth || (id < 16 && lastLearnedCcs[id] < 0);
+            bool converged = true;
+
+            for (int c = 0; c < channels; ++c)
+            {
+                const float value = getValue(id, c);
+                dsp::ExponentialFilter& filter(valueFilters[id][c]);
+
+                // Detect behavior from MIDI buttons.
+                if (jump || std::fabs(filter.out - value) >= 1.f)
+                    filter.out = value;
+
+                if (std::fabs(filter.out - value) < kSmoothingTolerance)
+                    filter.out = value;
+                else
+                    converged = false;
+
+                targets[id][c] = value;
+                voltages[id][c] = filter.out * 10.f;
+            }
+
+            if (converged)
+                smoothingOutputs &= ~(1u << id);
+            else
+                smoothingOutputs |= 1u << id;
         }
 
         bool process(const ProcessArgs& args, std::vector<rack::engine::Output>& outputs, int8_t learnedCcs[16],
@@ -127,8 +206,7 @@ struct HostMIDICC : TerminalModule {
             if (processCounterChanged)
             {
                 lastProcessCounter = processCounter;
-                midiEvents = pcontext->midiEvents;
-                midiEventsLeft = pcontext->midiEventCount;
+                midiEvents.startBlock(pcontext, channel);
                 midiEventFrame = 0;
             }
 
@@ -138,37 +216,32 @@ struct HostMIDICC : TerminalModule {
                 return false;
             }
 
-            while (midiEventsLeft != 0)
+            while (const MidiEvent* const nextEvent = midiEvents.peek())
             {
-                const MidiEvent& midiEvent(*midiEvents);
+                const MidiEvent& midiEvent(*nextEvent);
 
                 if (midiEvent.frame > midiEventFrame)
                     break;
 
-                ++midiEvents;
-                --midiEventsLeft;
+                midiEvents.pop();
 
                 const uint8_t* const data = midiEvent.size > MidiEvent::kDataSize
                                           ? midiEvent.dataExt
                                           : midiEvent.data;
 
-                if (channel != 0 && data[0] < 0xF0)
-                {
-                    if ((data[0] & 0x0F) != (channel - 1))
-                        continue;
-                }
-
                 const uint8_t status = data[0] & 0xF0;
                 const uint8_t chan = data[0] & 0x0F;
 
                 if (status == 0xD0)
                 {
                     chPressure[chan] = data[1];
+                    changedOutputs |= 1u << CC_OUTPUT_CH_PRESSURE;
                     continue;
                 }
                 if (status == 0xE0)
                 {
                     pitchbend[chan] = (data[2] << 7) | data[1];
+                    changedOutputs |= 1u << CC_OUTPUT_PITCHBEND;
                     continue;
                 }
                 if (status != 0xB0)
@@ -212,98 +285,81 @@ struct HostMIDICC : TerminalModule {
                 {
                     ccValues[cc][c] = value;
                 }
+
+                // Cardinal specific, a new learned CC is picked up below together with all other outputs
+                for (int id = 0; id < 16; ++id)
+                {
+                    const int8_t learnedCc = lastLearnedCcs[id];
+
+                    if (learnedCc == cc || (lsbMode && cc >= 32 && cc < 64 && learnedCc == cc - 32))
+                        changedOutputs |= 1u << id;
+                }
             }
 
             ++midiEventFrame;
 
-            // Rack stuff
-            const int channels = mpeMode ? 16 : 1;
-
-            for (int id = 0; id < 16; ++id)
+            // Cardinal specific, settings can be changed at any time from the UI
+            if (std::memcmp(lastLearnedCcs, learnedCcs, sizeof(lastLearnedCcs)) != 0
+                || lastSmooth != smooth || lastMpeMode != mpeMode || lastLsbMode != lsbMode)
             {
-                if (!outputs[CC_OUTPUT + id].isConnected())
-                    continue;
-                outputs[CC_OUTPUT + id].setChannels(channels);
+                std::memcpy(lastLearnedCcs, learnedCcs, sizeof(lastLearnedCcs));
+                lastSmooth = smooth;
+                lastMpeMode = mpeMode;
+                lastLsbMode = lsbMode;
+                changedOutputs = (1u << NUM_OUTPUTS) - 1;
+            }
 
-                const int8_t cc = learnedCcs[id];
+            const int channels = mpeMode ? 16 : 1;
 
-                if (cc < 0)
+            if (changedOutputs != 0)
+            {
+                for (int id = 0; id < NUM_OUTPUTS; ++id)
                 {
-                    outputs[CC_OUTPUT + id].clearVoltages();
-                    continue;
+                    if (changedOutputs & (1u << id))
+                        updateOutput(id, channels);
                 }
+                changedOutputs = 0;
+            }
 
-                for (int c = 0; c < channels; ++c)
+            // Smooth value with filter, only while it is still converging
+            if (smoothingOutputs != 0)
+            {
+                for (int id = 0; id < NUM_OUTPUTS; ++id)
                 {
-                    int16_t cellValue = int16_t(ccValues[cc][c]) * 128;
-                    if (lsbMode && cc < 32)
-                        cellValue += ccValues[cc + 32][c];
+                    if ((smoothingOutputs & (1u << id)) == 0)
+                        continue;
 
-                    // Maximum value for 14-bit CC should be MSB=127 LSB=0, not MSB=127 LSB=127, because this is the maximum value that 7-bit controllers can send.
-                    const float value = static_cast<float>(cellValue) / (128.0f * 127.0f);
+                    bool converged = true;
 
-                    // Detect behavior from MIDI buttons.
-                    if (smooth && std::fabs(valueFilters[id][c].out - value) < 1.f)
+                    for (int c = 0; c < channels; ++c)
                     {
-                        // Smooth value with filter
-                        valueFilters[id][c].process(args.sampleTime, value);
-                    }
-                    else
-                    {
-                        // Jump value
-                        valueFilters[id][c].out = value;
-                    }
+                        dsp::ExponentialFilter& filter(valueFilters[id][c]);
+                        filter.process(args.sampleTime, targets[id][c]);
 
-                    outputs[CC_OUTPUT + id].setVoltage(valueFilters[id][c].out * 10.f, c);
-                }
-            }
-
-            if (outputs[CC_OUTPUT_CH_PRESSURE].isConnected())
-            {
-                outputs[CC_OUTPUT_CH_PRESSURE].setChannels(channels);
-
-                for (int c = 0; c < channels; ++c)
-                {
-                    const float value = static_cast<float>(chPressure[c]) / 128.0f;
+                        if (std::fabs(filter.out - targets[id][c]) < kSmoothingTolerance)
+                            filter.out = targets[id][c];
+                        else
+                            converged = false;
 
-                    // Detect behavior from MIDI buttons.
-                    if (smooth && std::fabs(valueFilters[CC_OUTPUT_CH_PRESSURE][c].out - value) < 1.f)
-                    {
-                        // Smooth value with filter
-                        valueFilters[CC_OUTPUT_CH_PRESSURE][c].process(args.sampleTime, value);
-                    }
-                    else
-                    {
-                        // Jump value
-                        valueFilters[CC_OUTPUT_CH_PRESSURE][c].out = value;
+                        voltages[id][c] = filter.out * 10.f;
                     }
 
-                    outputs[CC_OUTPUT_CH_PRESSURE].setVoltage(valueFilters[CC_OUTPUT_CH_PRESSURE][c].out * 10.f, c);
+                    if (converged)
+                        smoothingOutputs &= ~(1u << id);
                 }
             }
 
-            if (outputs[CC_OUTPUT_PITCHBEND].isConnected())
+            for (int id = 0; id < NUM_OUTPUTS; ++id)
             {
-                outputs[CC_OUTPUT_PITCHBEND].setChannels(channels);
+                rack::engine::Output& output(outputs[CC_OUTPUT + id]);
 
-                for (int c = 0; c < channels; ++c)
-                {
-                    const float value = static_cast<float>(pitchbend[c]) / 16384.0f;
+                if (!output.isConnected())
+                    continue;
 
-                    // Detect behavior from MIDI buttons.
-                    if (smooth && std::fabs(valueFilters[CC_OUTPUT_PITCHBEND][c].out - value) < 1.f)
-                    {
-                        // Smooth value with filter
-                        valueFilters[CC_OUTPUT_PITCHBEND][c].process(args.sampleTime, value);
-                    }
-                    else
-                    {
-                        // Jump value
-                        valueFilters[CC_OUTPUT_PITCHBEND][c].out = value;
-                    }
+                output.setChannels(channels);
 
-                    outputs[CC_OUTPUT_CH_PRESSURE].setVoltage(valueFilters[CC_OUTPUT_PITCHBEND][c].out * 10.f, c);
-                }
+                for (int c = 0; c < channels; c += 4)
+                    output.setVoltageSimd(simd::float_4::load(voltages[id] + c), c);
             }
 
             return processCounterChanged;
@@ -56,8 +56,7 @@ struct HostMIDIGate : TerminalModule {
     struct MidiInput {
         // Cardinal specific
         CardinalPluginContext* const pcontext;
-        const MidiEvent* midiEvents;
-        uint32_t midiEventsLeft;
+        HostMidiEvents midiEvents;
         uint32_t midiEventFrame;
         uint32_t lastProcessCounter;
         uint8_t channel;
@@ -74,6 +73,13 @@ struct HostMIDIGate : TerminalModule {
 
         bool mpeMode;
 
+        // Cardinal specific, gate voltages are only recalculated on incoming notes
+        /** [cell][channel], as written to the outputs */
+        alignas(16) float voltages[18][16];
+        /** cells with gates still within their minimum length */
+        uint32_t pulsingCells;
+        bool lastVelocityMode;
+
         MidiInput(CardinalPluginContext* const pc)
             : pcontext(pc)
         {
@@ -82,13 +88,13 @@ struct HostMIDIGate : TerminalModule {
 
         void reset()
         {
-            midiEvents = nullptr;
-            midiEventsLeft = 0;
+            midiEvents.clear();
             midiEventFrame = 0;
             lastProcessCounter = 0;
             channel = 0;
             learningId = -1;
             mpeMode = false;
+            lastVelocityMode = false;
             panic();
         }
 
@@ -102,6 +108,15 @@ struct HostMIDIGate : TerminalModule {
                     gateTimes[i][c] = 0.f;
                 }
             }
+
+            // Cardinal specific
+            std::memset(voltages, 0, sizeof(voltages));
+            pulsingCells = 0;
+        }
+
+        float getGateVoltage(const int i, const int c) const
+        {
+            return lastVelocityMode ? velocities[i][c] / 127.f * 10.f : 10.f;
         }
 
         bool process(const ProcessArgs& args, std::vector<rack::engine::Output>& outputs,
@@ -114,8 +129,7 @@ struct HostMIDIGate : TerminalModule {
             if (processCounterChanged)
             {
                 lastProcessCounter = processCounter;
-                midiEvents = pcontext->midiEvents;
-                midiEventsLeft = pcontext->midiEventCount;
+                midiEvents.startBlock(pcontext, channel);
                 midiEventFrame = 0;
             }
 
@@ -125,26 +139,19 @@ struct HostMIDIGate : TerminalModule {
                 return processCounterChanged;
             }
 
-            while (midiEventsLeft != 0)
+            while (const MidiEvent* const nextEvent = midiEvents.peek())
             {
-                const MidiEvent& midiEvent(*midiEvents);
+                const MidiEvent& midiEvent(*nextEvent);
 
                 if (midiEvent.frame > midiEventFrame)
                     break;
 
-                ++midiEvents;
-                --midiEventsLeft;
+                midiEvents.pop();
 
                 const uint8_t* const data = midiEvent.size > MidiEvent::kDataSize
                                           ? midiEvent.dataExt
                                           : midiEvent.data;
 
-                if (channel != 0 && data[0] < 0xF0)
-                {
-                    if ((data[0] & 0x0F) != (channel - 1))
-                        continue;
-                }
-
                 // adapted from Rack
                 switch (data[0] & 0xF0)
                 {
@@ -177,6 +184,8 @@ struct HostMIDIGate : TerminalModule {
                                 gates[id][c] = true;
                                 gateTimes[id][c] = 1e-3f;
                                 velocities[id][c] = data[2];
+                                voltages[id][c] = getGateVoltage(id, c);
+                                pulsingCells |= 1u << id;
                             }
                         }
                         break;
@@ -190,7 +199,12 @@ struct HostMIDIGate : TerminalModule {
                     for (int id = 0; id < 18; ++id)
                     {
                         if (learnedNotes[id] == note)
+                        {
                             gates[id][c] = false;
+                            // Make sure all pulses last longer than 1ms
+                            if (gateTimes[id][c] <= 0.f)
+                                voltages[id][c] = 0.f;
+                        }
                     }
                     break;
                 }
@@ -198,28 +212,64 @@ struct HostMIDIGate : TerminalModule {
 
             ++midiEventFrame;
 
-            // Rack stuff
+            // Cardinal specific, velocity mode can be changed at any time from the UI
+            if (lastVelocityMode != velocityMode)
+            {
+                lastVelocityMode = velocityMode;
+
+                for (int i = 0; i < 18; ++i)
+                {
+                    for (int c = 0; c < 16; ++c)
+                    {
+                        if (gates[i][c] || gateTimes[i][c] > 0.f)
+                            voltages[i][c] = getGateVoltage(i, c);
+                    }
+                }
+            }
+
             const int channels = mpeMode ? 16 : 1;
 
-            for (int i = 0; i < 18; i++)
+            // Make sure all pulses last longer than 1ms, only counted for recently triggered cells
+            if (pulsingCells != 0)
             {
-                outputs[GATE_OUTPUTS + i].setChannels(channels);
-                for (int c = 0; c < channels; c++)
+                for (int i = 0; i < 18; ++i)
                 {
-                    // Make sure all pulses last longer than 1ms
-                    if (gates[i][c] || gateTimes[i][c] > 0.f)
+                    if ((pulsingCells & (1u << i)) == 0)
+                        continue;
+
+                    bool pulsing = false;
+
+                    for (int c = 0; c < channels; ++c)
                     {
-                        float velocity = velocityMode ? (velocities[i][c] / 127.f) : 1.f;
-                        outputs[GATE_OUTPUTS + i].setVoltage(velocity * 10.f, c);
+                        if (gateTimes[i][c] <= 0.f)
+                            continue;
+
                         gateTimes[i][c] -= args.sampleTime;
+
+                        if (gateTimes[i][c] > 0.f)
+                            pulsing = true;
+                        else if (! gates[i][c])
+                            voltages[i][c] = 0.f;
                     }
-                    else
-                    {
-                        outputs[GATE_OUTPUTS + i].setVoltage(0.f, c);
-                    }
+
+                    if (! pulsing)
+                        pulsingCells &= ~(1u << i);
                 }
             }
 
+            for (int i = 0; i < 18; ++i)
+            {
+                rack::engine::Output& output(outputs[GATE_OUTPUTS + i]);
+
+                if (!output.isConnected())
+                    continue;
+
+                output.setChannels(channels);
+
+                for (int c = 0; c < channels; c += 4)
+                    output.setVoltageSimd(simd::float_4::load(voltages[i] + c), c);
+            }
+
             return processCounterChanged;
         }
 
@@ -53,8 +53,7 @@ struct HostMIDIMap : TerminalModule {
 
     // Cardinal specific
     CardinalPluginContext* const pcontext;
-    const MidiEvent* midiEvents;
-    uint32_t midiEventsLeft;
+    HostMidiEvents midiEvents;
     uint32_t midiEventFrame;
     uint32_t lastProcessCounter;
     int nextLearningId;
@@ -84,6 +83,15 @@ struct HostMIDIMap : TerminalModule {
     bool filterInitialized[MAX_MIDI_CONTROL] = {};
     dsp::ClockDivider divider;
 
+    // Cardinal specific
+    /** The maps using each CC number, as bitmasks of map ids, so incoming messages go straight to their maps */
+    uint64_t ccMaps[MAX_MIDI_CONTROL][2] = {};
+    /** Maps to be stepped, because of a new CC value or an initial param value still to be read */
+    uint64_t activeMaps[2] = {};
+    /** Increased whenever maps change, ccMaps is rebuilt on the next step */
+    uint32_t mapsRevision = 0;
+    uint32_t lastMapsRevision = 0;
+
     HostMIDIMap()
         : pcontext(static_cast<CardinalPluginContext*>(APP))
     {
@@ -115,8 +123,7 @@ struct HostMIDIMap : TerminalModule {
 
     void onReset() override
     {
-        midiEvents = nullptr;
-        midiEventsLeft = 0;
+        midiEvents.clear();
         midiEventFrame = 0;
         lastProcessCounter = 0;
         nextLearningId = -1;
@@ -142,8 +149,7 @@ struct HostMIDIMap : TerminalModule {
         {
             bypassed = isBypassed();
             lastProcessCounter = processCounter;
-            midiEvents = pcontext->midiEvents;
-            midiEventsLeft = pcontext->midiEventCount;
+            midiEvents.startBlock(pcontext, channel);
             midiEventFrame = 0;
         }
 
@@ -153,26 +159,22 @@ struct HostMIDIMap : TerminalModule {
             return;
         }
 
-        while (midiEventsLeft != 0)
+        if (lastMapsRevision != mapsRevision)
+            updateCcMaps();
+
+        while (const MidiEvent* const nextEvent = midiEvents.peek())
         {
-            const MidiEvent& midiEvent(*midiEvents);
+            const MidiEvent& midiEvent(*nextEvent);
 
             if (midiEvent.frame > midiEventFrame)
                 break;
 
-            ++midiEvents;
-            --midiEventsLeft;
+            midiEvents.pop();
 
             const uint8_t* const data = midiEvent.size > MidiEvent::kDataSize
                                       ? midiEvent.dataExt
                                       : midiEvent.data;
 
-            if (channel != 0 && data[0] < 0xF0)
-            {
-                if ((data[0] & 0x0F) != (channel - 1))
-                    continue;
-            }
-
             // adapted from Rack
             if ((data[0] & 0xF0) != 0xB0)
                 continue;
@@ -192,71 +194,90 @@ struct HostMIDIMap : TerminalModule {
                 maybeCommitLearn();
                 refreshParamHandleText(learningId);
                 updateMapLen();
+                ++mapsRevision;
+                updateCcMaps();
             }
 
             values[cc] = value;
+            activeMaps[0] |= ccMaps[cc][0];
+            activeMaps[1] |= ccMaps[cc][1];
         }
 
         ++midiEventFrame;
 
-        // Step channels
-        for (int id = 0; id < mapLen; ++id)
-        {
-            const int cc = ccs[id];
-            if (cc < 0)
-                continue;
-
-            // Get Module
-            Module* const module = paramHandles[id].module;
-            if (!module)
-                continue;
-
-            // Get ParamQuantity from ParamHandle
-            const int paramId = paramHandles[id].paramId;
-            ParamQuantity* const paramQuantity = module->paramQuantities[paramId];
-            if (!paramQuantity)
-                continue;
-            if (!paramQuantity->isBounded())
-                continue;
+        // Step channels, only those with something to do
+        const float deltaTime = args.sampleTime * divider.getDivision();
 
-            // Set filter from param value if filter is uninitialized
-            if (!filterInitialized[id])
+        for (int i = 0; i < 2; ++i)
+        {
+            for (uint64_t mask = activeMaps[i]; mask != 0; mask &= mask - 1)
             {
-                valueFilters[id].out = paramQuantity->getScaledValue();
-                filterInitialized[id] = true;
-                continue;
+                const int id = i * 64 + __builtin_ctzll(mask);
+
+                if (!stepMap(id, deltaTime))
+                    activeMaps[i] &= ~(UINT64_C(1) << (id % 64));
             }
+        }
+    }
 
-            // Check if CC has been set by the MIDI device
-            if (values[cc] < 0)
-                continue;
+    // returns false once the map has nothing else to do until its CC is received again
+    bool stepMap(const int id, const float deltaTime)
+    {
+        const int cc = ccs[id];
+        if (cc < 0)
+            return false;
+
+        // Get Module
+        Module* const module = paramHandles[id].module;
+        if (!module)
+            return false;
+
+        // Get ParamQuantity from ParamHandle
+        const int paramId = paramHandles[id].paramId;
+        ParamQuantity* const paramQuantity = module->paramQuantities[paramId];
+        if (!paramQuantity)
+            return false;
+        if (!paramQuantity->isBounded())
+            return false;
+
+        // Set filter from param value if filter is uninitialized
+        if (!filterInitialized[id])
+        {
+            valueFilters[id].out = paramQuantity->getScaledValue();
+            filterInitialized[id] = true;
+            return true;
+        }
+
+        // Check if CC has been set by the MIDI device
+        if (values[cc] < 0)
+            return false;
 
-            const float value = values[cc] / 127.f;
+        const float value = values[cc] / 127.f;
 
-            // Detect behavior from MIDI buttons.
-            if (smooth && std::fabs(valueFilters[id].out - value) < 1.f)
+        // Detect behavior from MIDI buttons.
+        if (smooth && std::fabs(valueFilters[id].out - value) < 1.f)
+        {
+            // Smooth value with filter
+            if (d_isEqual(valueFilters[id].process(deltaTime, value), value))
             {
-                // Smooth value with filter
-                if (d_isEqual(valueFilters[id].process(args.sampleTime * divider.getDivision(), value), value))
-                {
-                    values[cc] = -1;
-                    continue;
-                }
+                values[cc] = -1;
+                return false;
             }
-            else
+        }
+        else
+        {
+            // Jump value
+            if (d_isEqual(valueFilters[id].out, value))
             {
-                // Jump value
-                if (d_isEqual(valueFilters[id].out, value))
-                {
-                    values[cc] = -1;
-                    continue;
-                }
-
-                valueFilters[id].out = value;
+                values[cc] = -1;
+                return false;
             }
 
-            paramQuantity->setScaledValue(valueFilters[id].out);
+            valueFilters[id].out = value;
         }
+
+        paramQuantity->setScaledValue(valueFilters[id].out);
+        return true;
     }
 
     void processTerminalOutput(const ProcessArgs&) override
@@ -280,6 +301,8 @@ struct HostMIDIMap : TerminalModule {
             valueFilters[id].reset();
             refreshParamHandleText(id);
         }
+
+        ++mapsRevision;
     }
 
     void setChannel(uint8_t channel)
@@ -306,6 +329,7 @@ struct HostMIDIMap : TerminalModule {
         valueFilters[id].reset();
         refreshParamHandleText(id);
         updateMapLen();
+        ++mapsRevision;
     }
 
     void enableLearn(const int id)
@@ -318,6 +342,7 @@ struct HostMIDIMap : TerminalModule {
         learningId = id;
         learnedCc = false;
         learnedParam = false;
+        ++mapsRevision;
     }
 
     void learnParam(const int id, const int64_t moduleId, const int paramId)
@@ -326,6 +351,7 @@ struct HostMIDIMap : TerminalModule {
         learnedParam = true;
         maybeCommitLearn();
         updateMapLen();
+        ++mapsRevision;
     }
 
     /*
@@ -382,6 +408,26 @@ struct HostMIDIMap : TerminalModule {
         }
     }
 
+    // this is called during RT!!
+    void updateCcMaps()
+    {
+        lastMapsRevision = mapsRevision;
+        std::memset(ccMaps, 0, sizeof(ccMaps));
+
+        for (int id = 0; id < MAX_MIDI_CONTROL; ++id)
+        {
+            const int cc = ccs[id];
+            if (cc < 0 || cc >= MAX_MIDI_CONTROL)
+                continue;
+
+            const uint64_t bit = UINT64_C(1) << (id % 64);
+            ccMaps[cc][id / 64] |= bit;
+
+            // step every map once, so that new ones read the current param value
+            activeMaps[id / 64] |= bit;
+        }
+    }
+
     void updateMapLen()
     {
         // Find last nonempty map
@@ -456,6 +502,7 @@ struct HostMIDIMap : TerminalModule {
         }
 
         updateMapLen();
+        ++mapsRevision;
 
         if (json_t* const smoothJ = json_object_get(rootJ, "smooth"))
             smooth = json_boolean_value(smoothJ);
@@ -78,13 +78,23 @@ struct HostMIDI : TerminalModule {
         // Cardinal specific
         CardinalPluginContext* const pcontext;
         midi::Message converterMsg;
-        const MidiEvent* midiEvents;
-        uint32_t midiEventsLeft;
+        HostMidiEvents midiEvents;
         uint32_t midiEventFrame;
         uint32_t lastProcessCounter;
         bool wasPlaying;
         uint8_t channel;
 
+        /** Outputs only as many note channels as there are sounding voices, instead of all `channels`.
+        Grows at once with the voices, shrinks only once the voices above have been released for kReleaseTailTime.
+        */
+        bool adaptivePolyphony;
+        static constexpr const float kReleaseTailTime = 2.f;
+        int activeChannels;
+        bool voicesChanged;
+        int64_t nextVoiceShrinkFrame;
+        /** Frame at which each released voice stops counting as active, INT64_MAX while gated. */
+        int64_t voiceEndFrames[16];
+
         // stuff from Rack
         /** Number of semitones to bend up/down by pitch wheel */
         float pwRange;
@@ -138,12 +148,12 @@ struct HostMIDI : TerminalModule {
 
         void reset()
         {
-            midiEvents = nullptr;
-            midiEventsLeft = 0;
+            midiEvents.clear();
             midiEventFrame = 0;
             lastProcessCounter = 0;
             wasPlaying = false;
             channel = 0;
+            adaptivePolyphony = false;
             smooth = false;
             channels = 1;
             polyMode = ROTATE_MODE;
@@ -163,10 +173,40 @@ struct HostMIDI : TerminalModule {
                 mods[c] = 0;
                 pwFilters[c].reset();
                 modFilters[c].reset();
+                voiceEndFrames[c] = 0;
             }
             pedal = false;
             rotateIndex = -1;
             heldNotes.clear();
+            activeChannels = 1;
+            voicesChanged = true;
+            nextVoiceShrinkFrame = 0;
+        }
+
+        /** Recounts the active voices, called when gates change or a release tail runs out. */
+        void updateActiveChannels(const ProcessArgs& args)
+        {
+            const int64_t frame = args.frame;
+            int count = 1;
+
+            voicesChanged = false;
+            nextVoiceShrinkFrame = INT64_MAX;
+
+            for (int c = 0; c < channels; c++) {
+                if (gates[c]) {
+                    voiceEndFrames[c] = INT64_MAX;
+                }
+                else {
+                    if (voiceEndFrames[c] == INT64_MAX)
+                        voiceEndFrames[c] = frame + static_cast<int64_t>(kReleaseTailTime * args.sampleRate);
+                    if (voiceEndFrames[c] <= frame)
+                        continue;
+                    nextVoiceShrinkFrame = std::min(nextVoiceShrinkFrame, voiceEndFrames[c]);
+                }
+                count = c + 1;
+            }
+
+            activeChannels = count;
         }
 
         bool process(const ProcessArgs& args, std::vector<rack::engine::Output>& outputs, const bool isBypassed)
@@ -179,8 +219,7 @@ struct HostMIDI : TerminalModule {
             {
                 lastProcessCounter = processCounter;
 
-                midiEvents = pcontext->midiEvents;
-                midiEventsLeft = pcontext->midiEventCount;
+                midiEvents.startBlock(pcontext, channel);
 
                 if (isBypassed)
                 {
@@ -213,15 +252,14 @@ struct HostMIDI : TerminalModule {
                 return false;
             }
 
-            while (midiEventsLeft != 0)
+            while (const MidiEvent* const nextEvent = midiEvents.peek())
             {
-                const MidiEvent& midiEvent(*midiEvents);
+                const MidiEvent& midiEvent(*nextEvent);
 
                 if (midiEvent.frame > midiEventFrame)
                     break;
 
-                ++midiEvents;
-                --midiEventsLeft;
+                midiEvents.pop();
 
                 const uint8_t* data;
 
@@ -235,12 +273,6 @@ struct HostMIDI : TerminalModule {
                     data = midiEvent.data;
                 }
 
-                if (channel != 0 && data[0] < 0xF0)
-                {
-                    if ((data[0] & 0x0F) != (channel - 1))
-                        continue;
-                }
-
                 converterMsg.frame = midiEventFrame;
                 std::memcpy(converterMsg.bytes.data(), data, midiEvent.size);
 
@@ -249,6 +281,9 @@ struct HostMIDI : TerminalModule {
 
             ++midiEventFrame;
 
+            if (voicesChanged || args.frame >= nextVoiceShrinkFrame)
+                updateActiveChannels(args);
+
             // Rack stuff
             // Set pitch and mod wheel
             const int wheelChannels = (polyMode == MPE_MODE) ? 16 : 1;
@@ -275,13 +310,14 @@ struct HostMIDI : TerminalModule {
             }
 
             // Set note outputs
-            outputs[PITCH_OUTPUT].setChannels(channels);
-            outputs[GATE_OUTPUT].setChannels(channels);
-            outputs[VELOCITY_OUTPUT].setChannels(channels);
-            outputs[AFTERTOUCH_OUTPUT].setChannels(channels);
-            outputs[RETRIGGER_OUTPUT].setChannels(channels);
-
-            for (int c = 0; c < channels; c++) {
+            const int noteChannels = adaptivePolyphony ? activeChannels : channels;
+            outputs[PITCH_OUTPUT].setChannels(noteChannels);
+            outputs[GATE_OUTPUT].setChannels(noteChannels);
+            outputs[VELOCITY_OUTPUT].setChannels(noteChannels);
+            outputs[AFTERTOUCH_OUTPUT].setChannels(noteChannels);
+            outputs[RETRIGGER_OUTPUT].setChannels(noteChannels);
+
+            for (int c = 0; c < noteChannels; c++) {
                 float pw = pwValues[(polyMode == MPE_MODE) ? c : 0];
                 float pitch = (notes[c] - 60.f + pw * pwRange) / 12.f;
                 outputs[PITCH_OUTPUT].setVoltage(pitch, c);
@@ -414,14 +450,20 @@ struct HostMIDI : TerminalModule {
                 } // fallthrough
 
                 case ROTATE_MODE: {
+                    // Cardinal specific, rotate within the active voices and only add one when all are taken
+                    const int rotateChannels = adaptivePolyphony ? activeChannels : channels;
                     // Find next available channel
-                    for (int i = 0; i < channels; i++) {
+                    for (int i = 0; i < rotateChannels; i++) {
                         rotateIndex++;
-                        if (rotateIndex >= channels)
+                        if (rotateIndex >= rotateChannels)
                             rotateIndex = 0;
                         if (!gates[rotateIndex])
                             return rotateIndex;
                     }
+                    if (rotateChannels < channels) {
+                        rotateIndex = activeChannels++;
+                        return rotateIndex;
+                    }
                     // No notes are available. Advance rotateIndex once more.
                     rotateIndex++;
                     if (rotateIndex >= channels)
@@ -463,6 +505,7 @@ struct HostMIDI : TerminalModule {
             // Set note
             notes[*channel] = note;
             gates[*channel] = true;
+            voicesChanged = true;
             retriggerPulses[*channel].trigger(1e-3);
         }
 
@@ -480,6 +523,7 @@ struct HostMIDI : TerminalModule {
                     gates[c] = false;
                 }
             }
+            voicesChanged = true;
             // Set last note if monophonic
             if (channels == 1) {
                 if (note == notes[0] && !heldNotes.empty()) {
@@ -501,6 +545,7 @@ struct HostMIDI : TerminalModule {
             if (!pedal)
                 return;
             pedal = false;
+            voicesChanged = true;
             // Set last note if monophonic
             if (channels == 1) {
                 if (!heldNotes.empty()) {
@@ -706,6 +751,7 @@ struct HostMIDI : TerminalModule {
         json_object_set_new(rootJ, "smooth", json_boolean(midiInput.smooth));
         json_object_set_new(rootJ, "channels", json_integer(midiInput.channels));
         json_object_set_new(rootJ, "polyMode", json_integer(midiInput.polyMode));
+        json_object_set_new(rootJ, "adaptivePolyphony", json_boolean(midiInput.adaptivePolyphony));
 
         // Saving/restoring pitch and mod doesn't make much sense for MPE.
         if (midiInput.polyMode != MidiInput::MPE_MODE)
@@ -737,6 +783,9 @@ struct HostMIDI : TerminalModule {
         if (json_t* const polyModeJ = json_object_get(rootJ, "polyMode"))
             midiInput.polyMode = (MidiInput::PolyMode) json_integer_value(polyModeJ);
 
+        if (json_t* const adaptivePolyphonyJ = json_object_get(rootJ, "adaptivePolyphony"))
+            midiInput.adaptivePolyphony = json_boolean_value(adaptivePolyphonyJ);
+
         if (json_t* const lastPitchJ = json_object_get(rootJ, "lastPitch"))
             midiInput.pws[0] = json_integer_value(lastPitchJ);
 
@@ -860,6 +909,8 @@ struct HostMIDIWidget : ModuleWidgetWith9HP {
             "MPE",
         }, &module->midiInput.polyMode));
 
+        menu->addChild(createBoolPtrMenuItem("Adaptive polyphony", "", &module->midiInput.adaptivePolyphony));
+
         menu->addChild(new MenuSeparator);
         menu->addChild(createMenuLabel("MIDI Output"));
 
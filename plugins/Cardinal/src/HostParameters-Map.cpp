@@ -63,8 +63,9 @@ struct HostParametersMap : TerminalModule {
     uint8_t learningId = UINT8_MAX;
 
     CardinalPluginContext* const pcontext;
-    bool parametersChanged[kModuleParameters] = {};
-    float parameterValues[kModuleParameters];
+    // bit per host parameter changed since the mappings were last applied
+    uint32_t parametersChanged = 0;
+    HostParameterValues parameterValues;
     bool bypassed = false;
     bool firstRun = true;
     uint32_t lastProcessCounter = 0;
@@ -84,7 +85,7 @@ struct HostParametersMap : TerminalModule {
             pcontext->engine->addParamHandle(&mappings[id].paramHandle);
         }
 
-        std::memcpy(parameterValues, pcontext->parameters, sizeof(parameterValues));
+        parameterValues.reset(pcontext);
     }
 
     ~HostParametersMap()
@@ -119,8 +120,8 @@ struct HostParametersMap : TerminalModule {
         }
 
         firstRun = true;
-        std::memcpy(parameterValues, pcontext->parameters, sizeof(parameterValues));
-        std::memset(parametersChanged, 0, sizeof(parametersChanged));
+        parameterValues.reset(pcontext);
+        parametersChanged = 0;
     }
 
     void processTerminalInput(const ProcessArgs& args) override
@@ -131,21 +132,28 @@ struct HostParametersMap : TerminalModule {
             return;
 
         lastProcessCounter = processCounter;
+        parametersChanged |= parameterValues.startBlock(pcontext);
 
         if (isBypassed())
             return;
 
-        for (uint32_t i = 0; i < kModuleParameters; ++i)
+        // mappings of changed parameters go on until they reach the new value, the rest are left alone
+        if (parametersChanged != 0 && !firstRun)
         {
-            if (d_isEqual(pcontext->parameters[i], parameterValues[i]))
-                continue;
+            for (uint id = 0; id < numMappedParmeters; ++id)
+            {
+                const uint8_t hostParamId = mappings[id].hostParamId;
 
-            parameterValues[i] = pcontext->parameters[i];
-            parametersChanged[i] = true;
+                if (hostParamId < kModuleParameters && (parametersChanged & (1u << hostParamId)) != 0)
+                    valueReached[id] = false;
+            }
         }
 
         for (uint id = 0; id < numMappedParmeters; ++id)
         {
+            if (valueReached[id] && filterInitialized[id])
+                continue;
+
             ParamHandle& paramHandle(mappings[id].paramHandle);
 
             if (paramHandle.module == nullptr)
@@ -172,15 +180,9 @@ struct HostParametersMap : TerminalModule {
                 continue;
             }
 
-            // Check if parameter was changed by the host
-            if (parametersChanged[hostParamId] && !firstRun)
-                valueReached[id] = false;
-            else if (valueReached[id])
-                continue;
-
             // Apply value, smooth as needed.
-            const float value = 0.1f * (mappings[id].inverted ? 10.f - parameterValues[hostParamId]
-                                                              : parameterValues[hostParamId]);
+            const float value = 0.1f * (mappings[id].inverted ? 10.f - parameterValues.values[hostParamId]
+                                                              : parameterValues.values[hostParamId]);
 
             if (mappings[id].smooth && std::fabs(valueFilters[id].out - value) < 1.f)
             {
@@ -207,7 +209,7 @@ struct HostParametersMap : TerminalModule {
         }
 
         firstRun = false;
-        std::memset(parametersChanged, 0, sizeof(parametersChanged));
+        parametersChanged = 0;
     }
 
     void processTerminalOutput(const ProcessArgs&) override
@@ -20,7 +20,7 @@
 
 // -----------------------------------------------------------------------------------------------------------
 
-struct HostParameters : TerminalModule {
+struct HostParameters : TerminalModule, ModuleSampleRateCoefficients {
     enum ParamIds {
         NUM_PARAMS
     };
@@ -36,6 +36,7 @@ struct HostParameters : TerminalModule {
 
     CardinalPluginContext* const pcontext;
     rack::dsp::SlewLimiter parameters[kModuleParameters];
+    HostParameterValues parameterValues;
     bool parametersConnected[kModuleParameters] = {};
     bool bypassed = false;
     bool smooth = true;
@@ -48,6 +49,8 @@ struct HostParameters : TerminalModule {
             throw rack::Exception("Plugin context is null.");
 
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
+
+        parameterValues.reset(pcontext);
     }
 
     void processTerminalInput(const ProcessArgs& args) override
@@ -58,6 +61,7 @@ struct HostParameters : TerminalModule {
         {
             bypassed = isBypassed();
             lastProcessCounter = processCounter;
+            parameterValues.startBlock(pcontext);
 
             for (uint32_t i=0; i<kModuleParameters; ++i)
             {
@@ -77,17 +81,17 @@ struct HostParameters : TerminalModule {
         for (uint32_t i=0; i<kModuleParameters; ++i)
         {
             if (parametersConnected[i])
-                outputs[i].setVoltage(smooth ? parameters[i].process(args.sampleTime, pcontext->parameters[i])
-                                             : pcontext->parameters[i]);
+                outputs[i].setVoltage(smooth ? parameters[i].process(args.sampleTime, parameterValues.values[i])
+                                             : parameterValues.values[i]);
         }
     }
 
     void processTerminalOutput(const ProcessArgs&) override
     {}
 
-    void onSampleRateChange(const SampleRateChangeEvent& e) override
+    void updateSampleRateCoefficients(const float sampleRate, float) override
     {
-        const double fall = 1.0 / (double(pcontext->bufferSize) / e.sampleRate);
+        const double fall = 1.0 / (double(pcontext->bufferSize) / sampleRate);
 
         for (uint32_t i=0; i<kModuleParameters; ++i)
         {
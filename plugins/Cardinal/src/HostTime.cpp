@@ -20,7 +20,7 @@
 
 // --------------------------------------------------------------------------------------------------------------------
 
-struct HostTime : TerminalModule {
+struct HostTime : TerminalModule, ModuleFreeRunning {
     enum ParamIds {
         NUM_PARAMS
     };
@@ -40,8 +40,32 @@ struct HostTime : TerminalModule {
 
     const CardinalPluginContext* const pcontext;
 
-    rack::dsp::PulseGenerator pulseReset, pulseBar, pulseBeat, pulseClock;
-    float sampleTime = 0.0f;
+    // Edges of the current block, scheduled from the host position once it starts.
+    // Frames in between only count down the pulses and follow the tick position.
+    enum TimeEventFlags {
+        kTimeEventReset    = 1 << 0,
+        kTimeEventBar      = 1 << 1,
+        kTimeEventBeat     = 1 << 2,
+        kTimeEventNextBeat = 1 << 3,
+        kTimeEventClock    = 1 << 4,
+    };
+
+    struct TimeEvent {
+        uint32_t frame;
+        uint32_t flags;
+    };
+
+    static constexpr const uint32_t kMaxTimeEvents = 64;
+    TimeEvent events[kMaxTimeEvents];
+    uint32_t eventCount = 0;
+    uint32_t eventIndex = 0;
+    uint32_t frame = 0;
+    uint32_t beatWraps = 0;
+    double blockTick = 0.0;
+
+    // remaining frames of the reset, bar, beat and clock pulses, each lasting 1ms
+    uint32_t pulseFrames[4] = {};
+    uint32_t pulseLength = 1;
     uint32_t lastProcessCounter = 0;
     // cached time values
     struct {
@@ -62,14 +86,112 @@ struct HostTime : TerminalModule {
         config(NUM_PARAMS, NUM_INPUTS, kHostTimeCount, kHostTimeCount);
     }
 
+    // a rolling transport keeps clocking whatever is connected, even through silent parts of the song
+    bool isFreeRunning() override
+    {
+        if (! pcontext->playing)
+            return false;
+
+        for (int i=0; i<kHostTimeCount; ++i)
+        {
+            if (outputs[i].isConnected())
+                return true;
+        }
+
+        return false;
+    }
+
+    void addEvent(const uint32_t eventFrame, const uint32_t flags)
+    {
+        // kept in frame order, with edges on the same frame merged
+        uint32_t i = eventCount;
+        while (i != 0 && events[i - 1].frame > eventFrame)
+            --i;
+
+        if (i != 0 && events[i - 1].frame == eventFrame)
+        {
+            events[i - 1].flags |= flags;
+            return;
+        }
+
+        if (eventCount == kMaxTimeEvents)
+            return;
+
+        std::memmove(events + i + 1, events + i, sizeof(TimeEvent) * (eventCount - i));
+        events[i].frame = eventFrame;
+        events[i].flags = flags;
+        ++eventCount;
+    }
+
+    // frames at which a position starting at @a start and moving by @a step per frame passes each multiple of @a period,
+    // seen at the end of the frame like the per-frame counting that came before
+    void addPeriodEvents(const double start, const double step, const double period, const double margin,
+                         const uint32_t frames, const uint32_t flags)
+    {
+        if (period <= 0.0)
+            return;
+
+        int64_t lastFrame = -1;
+
+        for (uint32_t n = 1; n <= kMaxTimeEvents; ++n)
+        {
+            int64_t eventFrame = static_cast<int64_t>(std::ceil((n * period - margin - start) / step)) - 1;
+
+            // a single edge per frame
+            if (eventFrame <= lastFrame)
+                eventFrame = lastFrame + 1;
+            if (eventFrame >= frames)
+                break;
+
+            addEvent(eventFrame, flags);
+            lastFrame = eventFrame;
+        }
+    }
+
+    void scheduleBlock(const bool playingWithBBT)
+    {
+        eventCount = eventIndex = frame = beatWraps = 0;
+        blockTick = timeInfo.tick;
+
+        if (! playingWithBBT)
+            return;
+
+        uint32_t flags = 0;
+
+        if (timeInfo.reset)
+        {
+            timeInfo.reset = false;
+            flags |= kTimeEventReset;
+        }
+
+        if (d_isZero(timeInfo.tick))
+            flags |= kTimeEventBeat;
+
+        if (d_isZero(timeInfo.tickClock))
+            flags |= kTimeEventClock;
+
+        if (flags != 0)
+            addEvent(0, flags);
+
+        const double ticksPerFrame = pcontext->ticksPerFrame;
+        if (ticksPerFrame <= 0.0)
+            return;
+
+        const uint32_t frames = pcontext->bufferSize;
+
+        // give a little help to keep tick active,
+        // as otherwise we might miss it if located at the very end of the audio block
+        addPeriodEvents(timeInfo.tick, ticksPerFrame, pcontext->ticksPerBeat, 0.0001, frames, kTimeEventNextBeat);
+        addPeriodEvents(timeInfo.tickClock, ticksPerFrame, pcontext->ticksPerClock, 0.0, frames, kTimeEventClock);
+    }
+
     void processTerminalInput(const ProcessArgs& args) override
     {
         const uint32_t processCounter = pcontext->processCounter;
+        const bool playing = pcontext->playing;
+        const bool playingWithBBT = playing && pcontext->bbtValid;
 
-        // local variables for faster access
-        double tick, tickClock;
-
-        // Update time position if running a new audio block
+        // Update time position and schedule its edges if running a new audio block
         if (lastProcessCounter != processCounter)
         {
             lastProcessCounter = processCounter;
@@ -77,71 +199,66 @@ struct HostTime : TerminalModule {
             timeInfo.bar = pcontext->bar;
             timeInfo.beat = pcontext->beat;
             timeInfo.seconds = pcontext->frame / pcontext->sampleRate;
-            tick = pcontext->tick;
-            tickClock = pcontext->tickClock;
-        }
-        else
-        {
-            tick = timeInfo.tick;
-            tickClock = timeInfo.tickClock;
+            timeInfo.tick = pcontext->tick;
+            timeInfo.tickClock = pcontext->tickClock;
+            scheduleBlock(playingWithBBT);
+            pulseLength = std::max(1.0f, std::ceil(1e-3f / args.sampleTime));
         }
 
-        const bool playing = pcontext->playing;
-        const bool playingWithBBT = playing && pcontext->bbtValid;
-
-        if (playingWithBBT)
+        for (; eventIndex < eventCount && events[eventIndex].frame <= frame; ++eventIndex)
         {
-            if (d_isZero(tick))
-            {
-                pulseBeat.trigger();
-                if (timeInfo.beat == 1)
-                    pulseBar.trigger();
-            }
-
-            if (d_isZero(tickClock))
-                pulseClock.trigger();
+            uint32_t flags = events[eventIndex].flags;
 
-            if (timeInfo.reset)
+            if (flags & kTimeEventNextBeat)
             {
-                timeInfo.reset = false;
-                pulseReset.trigger();
-            }
-
-            tick += pcontext->ticksPerFrame;
-
-            // give a little help to keep tick active,
-            // as otherwise we might miss it if located at the very end of the audio block
-            if (tick + 0.0001 >= pcontext->ticksPerBeat)
-            {
-                tick -= pcontext->ticksPerBeat;
-                pulseBeat.trigger();
+                ++beatWraps;
+                flags |= kTimeEventBeat;
 
                 if (++timeInfo.beat > pcontext->beatsPerBar)
                 {
                     timeInfo.beat = 1;
                     ++timeInfo.bar;
-                    pulseBar.trigger();
+                    flags |= kTimeEventBar;
                 }
             }
-
-            if ((tickClock += pcontext->ticksPerFrame) >= pcontext->ticksPerClock)
+            else if ((flags & kTimeEventBeat) && timeInfo.beat == 1)
             {
-                tickClock -= pcontext->ticksPerClock;
-                pulseClock.trigger();
+                flags |= kTimeEventBar;
             }
+
+            if (flags & kTimeEventReset)
+                pulseFrames[0] = std::max(pulseFrames[0], pulseLength);
+            if (flags & kTimeEventBar)
+                pulseFrames[1] = std::max(pulseFrames[1], pulseLength);
+            if (flags & kTimeEventBeat)
+                pulseFrames[2] = std::max(pulseFrames[2], pulseLength);
+            if (flags & kTimeEventClock)
+                pulseFrames[3] = std::max(pulseFrames[3], pulseLength);
         }
 
-        // store back the local values
+        ++frame;
+
+        // tick position at the end of this frame
+        const double tick = playingWithBBT
+                          ? blockTick + frame * pcontext->ticksPerFrame - beatWraps * pcontext->ticksPerBeat
+                          : timeInfo.tick;
         timeInfo.tick = tick;
-        timeInfo.tickClock = tickClock;
 
         if (isBypassed())
             return;
 
-        const bool hasReset = pulseReset.process(args.sampleTime);
-        const bool hasBar = pulseBar.process(args.sampleTime);
-        const bool hasBeat = pulseBeat.process(args.sampleTime);
-        const bool hasClock = pulseClock.process(args.sampleTime);
+        bool pulses[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            pulses[i] = pulseFrames[i] != 0;
+            if (pulses[i])
+                --pulseFrames[i];
+        }
+
+        const bool hasReset = pulses[0];
+        const bool hasBar = pulses[1];
+        const bool hasBeat = pulses[2];
+        const bool hasClock = pulses[3];
         const float beatPhase = playingWithBBT && pcontext->ticksPerBeat > 0.0
                               ? tick / pcontext->ticksPerBeat
                               : 0.0f;
@@ -149,6 +266,7 @@ struct HostTime : TerminalModule {
                               ? ((float) (timeInfo.beat - 1) + beatPhase) / pcontext->beatsPerBar
                               : 0.0f;
 
+       #ifndef HEADLESS
         lights[kHostTimeRolling].setBrightness(playing ? 1.0f : 0.0f);
         lights[kHostTimeReset].setBrightnessSmooth(hasReset ? 1.0f : 0.0f, args.sampleTime * 0.5f);
         lights[kHostTimeBar].setBrightnessSmooth(hasBar ? 1.0f : 0.0f, args.sampleTime * 0.5f);
@@ -156,6 +274,7 @@ struct HostTime : TerminalModule {
         lights[kHostTimeClock].setBrightnessSmooth(hasClock ? 1.0f : 0.0f, args.sampleTime * 2.0f);
         lights[kHostTimeBarPhase].setBrightness(barPhase);
         lights[kHostTimeBeatPhase].setBrightness(beatPhase);
+       #endif
 
         outputs[kHostTimeRolling].setVoltage(playing ? 10.0f : 0.0f);
         outputs[kHostTimeReset].setVoltage(hasReset ? 10.0f : 0.0f);
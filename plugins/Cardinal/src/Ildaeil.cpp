@@ -42,10 +42,21 @@
 #include "CarlaNativePlugin.h"
 #include "CarlaBackendUtils.hpp"
 #include "CarlaEngine.hpp"
+#include "CarlaProjectState.hpp"
 #include "water/streams/MemoryOutputStream.h"
 #include "water/xml/XmlDocument.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
+
+#ifndef HEADLESS
+# include <sys/stat.h>
+#endif
 
 #ifndef CARDINAL_SYSDEPS
 // private method that takes ownership, we can use it to avoid superfulous allocations
@@ -66,6 +77,7 @@ enum SpecialPath {
 std::string getSpecialPath(const SpecialPath type);
 #endif
 std::string homeDir();
+std::string cacheDir();
 }
 
 #define BUFFER_SIZE 128
@@ -139,6 +151,203 @@ static const char* getPathForJSFX()
     return path.c_str();
 }
 
+// --------------------------------------------------------------------------------------------------------------------
+// plugin scan cache, shared by all instances and kept in the user folder across sessions
+
+#ifndef HEADLESS
+// bump when changing the filtering of scanned plugins, so old caches are discarded
+static constexpr const int kPluginScanCacheVersion = 1;
+
+struct PluginScanCacheEntry {
+    struct Plugin {
+        std::string name, label;
+    };
+    // plugin search path and last modification time of every bundle or file found in it
+    std::string path;
+    std::map<std::string, int64_t> bundles;
+    std::vector<Plugin> plugins;
+};
+
+// indexed by plugin type key, guarded by sPluginInfoLoadMutex
+static std::map<std::string, PluginScanCacheEntry> sPluginScanCache;
+static bool sPluginScanCacheLoaded = false;
+
+static const char* getPluginScanCacheKey(const PluginType type)
+{
+    switch (type)
+    {
+    case PLUGIN_LV2:
+        return "lv2";
+    case PLUGIN_JSFX:
+        return "jsfx";
+    default:
+        return nullptr;
+    }
+}
+
+static std::string getPluginScanPath(const PluginType type)
+{
+    if (type == PLUGIN_JSFX)
+        return getPathForJSFX();
+
+    DISTRHO_SAFE_ASSERT_RETURN(type == PLUGIN_LV2, std::string());
+
+    if (const char* const path = std::getenv("LV2_PATH"))
+        return path;
+
+    // same as the lilv defaults
+   #if defined(CARLA_OS_MAC)
+    return homeDir() + "/.lv2:" + homeDir() + "/Library/Audio/Plug-Ins/LV2:/usr/local/lib/lv2:/usr/lib/lv2:/Library/Audio/Plug-Ins/LV2";
+   #elif defined(CARLA_OS_WIN)
+    return getSpecialPath(kSpecialPathAppData) + "\\LV2;" + getSpecialPath(kSpecialPathCommonProgramFiles) + "\\LV2";
+   #else
+    return homeDir() + "/.lv2:/usr/lib/lv2:/usr/local/lib/lv2";
+   #endif
+}
+
+// only stats files, much cheaper than letting carla scan them
+static std::map<std::string, int64_t> getPluginBundleTimes(const PluginType type, const std::string& path)
+{
+   #ifdef CARLA_OS_WIN
+    const char split = ';';
+   #else
+    const char split = ':';
+   #endif
+    // lv2 bundles are directories, jsfx effects can be anywhere inside the effects folder
+    const int depth = type == PLUGIN_LV2 ? 0 : -1;
+
+    std::map<std::string, int64_t> bundles;
+    size_t start = 0;
+
+    while (start <= path.size())
+    {
+        size_t end = path.find(split, start);
+        if (end == std::string::npos)
+            end = path.size();
+
+        const std::string dir = path.substr(start, end - start);
+        start = end + 1;
+
+        if (dir.empty() || ! system::isDirectory(dir))
+            continue;
+
+        for (const std::string& entry : system::getEntries(dir, depth))
+        {
+            struct stat st;
+            if (stat(entry.c_str(), &st) == 0)
+                bundles[entry] = static_cast<int64_t>(st.st_mtime);
+        }
+    }
+
+    return bundles;
+}
+
+static void loadPluginScanCache()
+{
+    if (sPluginScanCacheLoaded)
+        return;
+    sPluginScanCacheLoaded = true;
+
+    const std::string dir = cacheDir();
+    if (dir.empty())
+        return;
+
+    const std::string filename = system::join(dir, "Ildaeil-plugins.json");
+
+    if (! system::isFile(filename))
+        return;
+
+    json_error_t error;
+    json_t* const rootJ = json_load_file(filename.c_str(), 0, &error);
+    DISTRHO_SAFE_ASSERT_RETURN(rootJ != nullptr,);
+
+    json_t* const versionJ = json_object_get(rootJ, "version");
+    json_t* const carlaJ = json_object_get(rootJ, "carla");
+    json_t* const typesJ = json_object_get(rootJ, "types");
+
+    if (json_integer_value(versionJ) == kPluginScanCacheVersion
+        && json_is_string(carlaJ) && std::strcmp(json_string_value(carlaJ), CARLA_VERSION_STRING) == 0
+        && json_is_object(typesJ))
+    {
+        const char* key;
+        json_t* typeJ;
+        json_object_foreach(typesJ, key, typeJ)
+        {
+            PluginScanCacheEntry& entry(sPluginScanCache[key]);
+
+            if (const char* const path = json_string_value(json_object_get(typeJ, "path")))
+                entry.path = path;
+
+            const char* bundle;
+            json_t* timeJ;
+            json_object_foreach(json_object_get(typeJ, "bundles"), bundle, timeJ)
+                entry.bundles[bundle] = json_integer_value(timeJ);
+
+            size_t i;
+            json_t* pluginJ;
+            json_array_foreach(json_object_get(typeJ, "plugins"), i, pluginJ)
+            {
+                const char* const name = json_string_value(json_array_get(pluginJ, 0));
+                const char* const label = json_string_value(json_array_get(pluginJ, 1));
+                DISTRHO_SAFE_ASSERT_CONTINUE(name != nullptr && label != nullptr);
+                entry.plugins.push_back({name, label});
+            }
+        }
+    }
+
+    json_decref(rootJ);
+}
+
+static void savePluginScanCache()
+{
+    const std::string dir = cacheDir();
+    if (dir.empty())
+        return;
+
+    json_t* const rootJ = json_object();
+    json_object_set_new(rootJ, "version", json_integer(kPluginScanCacheVersion));
+    json_object_set_new(rootJ, "carla", json_string(CARLA_VERSION_STRING));
+
+    json_t* const typesJ = json_object();
+
+    for (const auto& it : sPluginScanCache)
+    {
+        const PluginScanCacheEntry& entry(it.second);
+
+        json_t* const typeJ = json_object();
+        json_object_set_new(typeJ, "path", json_string(entry.path.c_str()));
+
+        json_t* const bundlesJ = json_object();
+        for (const auto& bundle : entry.bundles)
+            json_object_set_new(bundlesJ, bundle.first.c_str(), json_integer(bundle.second));
+        json_object_set_new(typeJ, "bundles", bundlesJ);
+
+        json_t* const pluginsJ = json_array();
+        for (const PluginScanCacheEntry::Plugin& plugin : entry.plugins)
+        {
+            json_t* const pluginJ = json_array();
+            json_array_append_new(pluginJ, json_string(plugin.name.c_str()));
+            json_array_append_new(pluginJ, json_string(plugin.label.c_str()));
+            json_array_append_new(pluginsJ, pluginJ);
+        }
+        json_object_set_new(typeJ, "plugins", pluginsJ);
+
+        json_object_set_new(typesJ, it.first.c_str(), typeJ);
+    }
+
+    json_object_set_new(rootJ, "types", typesJ);
+
+    // write to a temporary file first, other processes might be reading the cache
+    const std::string filename = system::join(dir, "Ildaeil-plugins.json");
+    const std::string tmpFilename = filename + ".tmp";
+
+    if (json_dump_file(rootJ, tmpFilename.c_str(), JSON_INDENT(2)) == 0)
+        system::rename(tmpFilename, filename);
+
+    json_decref(rootJ);
+}
+#endif
+
 /*
 #ifndef HEADLESS
 struct JuceInitializer {
@@ -148,8 +357,10 @@ struct JuceInitializer {
 #endif
 */
 
-struct IldaeilModule : Module {
+struct IldaeilModule : Module, ModuleLatency {
     enum ParamIds {
+        PIPELINED,
+        BRIDGED,
         NUM_PARAMS
     };
     enum InputIds {
@@ -200,10 +411,41 @@ struct IldaeilModule : Module {
     float meterOutL = 0.0f;
     float meterOutR = 0.0f;
 
+    // pipelined mode, a worker thread runs the hosted plugin on one chunk while the engine fills the next
+    float pipelineDataIn1[BUFFER_SIZE];
+    float pipelineDataIn2[BUFFER_SIZE];
+    float pipelineDataOut1[BUFFER_SIZE];
+    float pipelineDataOut2[BUFFER_SIZE];
+    NativeMidiEvent pipelineMidiIn[CardinalExpanderFromCVToCarlaMIDI::MAX_MIDI_EVENTS];
+    NativeMidiEvent pipelineMidiOut[CardinalExpanderFromCarlaMIDIToCV::MAX_MIDI_EVENTS];
+    uint pipelineMidiInCount = 0;
+    uint pipelineMidiOutCount = 0;
+    // set by the engine when handing over a chunk, cleared by the worker once processed
+    std::atomic<bool> pipelineJobPending{false};
+    // whether the hosted plugin is running on the worker, midi output then goes into pipelineMidiOut
+    std::atomic<bool> pipelineActive{false};
+    bool pipelineQuit = false;
+    std::mutex pipelineMutex;
+    std::condition_variable pipelineCondition;
+    std::thread pipelineThread;
+
+    // restoring a project instantiates its plugins, which can take long, so it runs in the background
+    // while the rest of the patch loads and plays, nothing but the audio thread uses the carla host meanwhile
+    std::atomic<bool> projectLoading{false};
+    // set once a background project restore is done, taken by the widget
+    std::atomic<bool> projectLoadFinished{false};
+    std::mutex projectLoadMutex;
+    std::condition_variable projectLoadCondition;
+    std::thread projectLoadThread;
+    // project saved to the patch storage in the background, see CarlaProjectState
+    CarlaProjectState projectSaveState;
+
     IldaeilModule()
         : pcontext(static_cast<CardinalPluginContext*>(APP))
     {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
+        configParam<SwitchQuantity>(PIPELINED, 0.f, 1.f, 0.f, "Pipelined processing")->randomizeEnabled = false;
+        configParam<SwitchQuantity>(BRIDGED, 0.f, 1.f, 0.f, "Run in bridge mode")->randomizeEnabled = false;
         for (uint i=0; i<2; ++i)
         {
             const char name[] = { 'A','u','d','i','o',' ','#',static_cast<char>('0'+i+1),'\0' };
@@ -212,6 +454,8 @@ struct IldaeilModule : Module {
         }
         std::memset(audioDataOut1, 0, sizeof(audioDataOut1));
         std::memset(audioDataOut2, 0, sizeof(audioDataOut2));
+        std::memset(pipelineDataOut1, 0, sizeof(pipelineDataOut1));
+        std::memset(pipelineDataOut2, 0, sizeof(pipelineDataOut2));
 
         fCarlaPluginDescriptor = carla_get_native_rack_plugin();
         DISTRHO_SAFE_ASSERT_RETURN(fCarlaPluginDescriptor != nullptr,);
@@ -304,10 +548,32 @@ struct IldaeilModule : Module {
                                            0, 0, nullptr, 0.0f);
 
         fCarlaPluginDescriptor->activate(fCarlaPluginHandle);
+
+       #ifndef __EMSCRIPTEN__
+        pipelineThread = std::thread([this] {
+            system::setThreadName("Ildaeil pipeline");
+            runPipeline();
+        });
+       #endif
     }
 
     ~IldaeilModule() override
     {
+        if (projectLoadThread.joinable())
+            projectLoadThread.join();
+
+        projectSaveState.wait();
+
+        if (pipelineThread.joinable())
+        {
+            {
+                const std::lock_guard<std::mutex> lock(pipelineMutex);
+                pipelineQuit = true;
+            }
+            pipelineCondition.notify_one();
+            pipelineThread.join();
+        }
+
         if (fCarlaPluginHandle != nullptr)
             fCarlaPluginDescriptor->deactivate(fCarlaPluginHandle);
 
@@ -354,11 +620,100 @@ struct IldaeilModule : Module {
         return 0;
     }
 
+    // audio is processed in chunks of BUFFER_SIZE frames, delaying it by as much, plus one chunk when pipelined
+    int getLatency() override
+    {
+        return isPipelined() ? BUFFER_SIZE * 2 : BUFFER_SIZE;
+    }
+
+    // run the hosted plugin in a separate process, so that crashes and cpu spikes do not take us down with it
+    bool wantsBridges() const
+    {
+       #ifdef CARLA_OS_WASM
+        return false;
+       #else
+        return canUseBridges && params[BRIDGED].getValue() > 0.5f;
+       #endif
+    }
+
+    bool isPipelined() const
+    {
+        return pipelineThread.joinable() && params[PIPELINED].getValue() > 0.5f;
+    }
+
+    void runPipeline()
+    {
+        std::unique_lock<std::mutex> lock(pipelineMutex);
+
+        for (;;)
+        {
+            pipelineCondition.wait(lock, [this] { return pipelineJobPending.load() || pipelineQuit; });
+
+            if (pipelineQuit)
+                return;
+
+            lock.unlock();
+
+            float* ins[2] = { pipelineDataIn1, pipelineDataIn2 };
+            float* outs[2] = { pipelineDataOut1, pipelineDataOut2 };
+            fCarlaPluginDescriptor->process(fCarlaPluginHandle, ins, outs, BUFFER_SIZE,
+                                            pipelineMidiIn, pipelineMidiInCount);
+
+            lock.lock();
+            pipelineJobPending.store(false, std::memory_order_release);
+        }
+    }
+
+    // the worker is expected to finish well within one chunk, so waiting for it is a short spin
+    void waitForPipeline()
+    {
+        while (pipelineJobPending.load(std::memory_order_acquire))
+            std::this_thread::yield();
+    }
+
+    bool isLoadingProject() const noexcept
+    {
+        return projectLoading.load(std::memory_order_acquire);
+    }
+
+    void waitForProjectLoad()
+    {
+        std::unique_lock<std::mutex> lock(projectLoadMutex);
+        projectLoadCondition.wait(lock, [this] { return ! projectLoading.load(); });
+    }
+
+    void loadProject(const char* const projectState)
+    {
+        CarlaEngine* const engine = carla_get_engine_from_handle(fCarlaHostHandle);
+
+        water::XmlDocument xml(projectState);
+
+        const MutexLocker cml(sPluginInfoLoadMutex);
+        engine->loadProjectInternal(xml, true);
+    }
+
+    void onSave(const SaveEvent&) override
+    {
+        if (fCarlaHostHandle == nullptr)
+            return;
+
+        // saving in the middle of a restore would store a partial project
+        waitForProjectLoad();
+
+        projectSaveState.startSaving(carla_get_engine_from_handle(fCarlaHostHandle), createPatchStorageDirectory());
+    }
+
     json_t* dataToJson() override
     {
         if (fCarlaHostHandle == nullptr)
             return nullptr;
 
+        if (json_t* const fileJ = projectSaveState.finishSaving())
+            return fileJ;
+
+        // saving in the middle of a restore would store a partial project
+        waitForProjectLoad();
+
         CarlaEngine* const engine = carla_get_engine_from_handle(fCarlaHostHandle);
 
         water::MemoryOutputStream projectState;
@@ -377,19 +732,35 @@ struct IldaeilModule : Module {
         if (fCarlaHostHandle == nullptr)
             return;
 
-        const char* const projectState = json_string_value(rootJ);
-        DISTRHO_SAFE_ASSERT_RETURN(projectState != nullptr,);
+        std::string projectState;
+        DISTRHO_SAFE_ASSERT_RETURN(CarlaProjectState::read(rootJ, getPatchStorageDirectory(), projectState),);
 
-        CarlaEngine* const engine = carla_get_engine_from_handle(fCarlaHostHandle);
+        // a previous restore must be done before starting another one
+        if (projectLoadThread.joinable())
+            projectLoadThread.join();
 
-        water::XmlDocument xml(projectState);
+        // params are restored before data, keep the plugin in its own process if it was saved that way
+        carla_set_engine_option(fCarlaHostHandle, ENGINE_OPTION_PREFER_PLUGIN_BRIDGES, wantsBridges(), nullptr);
 
-        {
-            const MutexLocker cml(sPluginInfoLoadMutex);
-            engine->loadProjectInternal(xml, true);
-        }
+       #if !defined(HEADLESS) && !defined(__EMSCRIPTEN__)
+        projectLoading.store(true, std::memory_order_release);
+
+        projectLoadThread = std::thread([this, state = std::move(projectState)] {
+            system::setThreadName("Ildaeil project load");
+            loadProject(state.c_str());
 
+            {
+                const std::lock_guard<std::mutex> lock(projectLoadMutex);
+                projectLoadFinished.store(true, std::memory_order_release);
+                projectLoading.store(false, std::memory_order_release);
+            }
+            projectLoadCondition.notify_all();
+        });
+       #else
+        // offline renders need the plugin ready as soon as the patch is
+        loadProject(projectState.c_str());
         projectLoadedFromDSP(fUI);
+       #endif
     }
 
     void process(const ProcessArgs& args) override
@@ -406,6 +777,9 @@ struct IldaeilModule : Module {
 
         if (audioDataFill == BUFFER_SIZE)
         {
+            // the previous chunk must be done before touching any state shared with the worker
+            waitForPipeline();
+
             const uint32_t processCounter = pcontext->processCounter;
 
             // Update time position if running a new audio block
@@ -459,16 +833,17 @@ struct IldaeilModule : Module {
                 }
             }
 
+            const bool pipelined = isPipelined();
+
             NativeMidiEvent* midiEvents;
             uint midiEventCount;
 
-            if (CardinalExpanderFromCVToCarlaMIDI* const midiInExpander = leftExpander.module != nullptr && leftExpander.module->model == modelExpanderInputMIDI
-                                                                        ? static_cast<CardinalExpanderFromCVToCarlaMIDI*>(leftExpander.module)
-                                                                        : nullptr)
+            if (leftExpander.module != nullptr && leftExpander.module->model == modelExpanderInputMIDI)
             {
-                midiEvents = midiInExpander->midiEvents;
-                midiEventCount = midiInExpander->midiEventCount;
-                midiInExpander->midiEventCount = midiInExpander->frame = 0;
+                // handed over by the flip requested on the previous frame, untouched by the expander until the next one
+                CardinalExpanderMIDIBlock* const midiBlock = static_cast<CardinalExpanderMIDIBlock*>(leftExpander.module->rightExpander.consumerMessage);
+                midiEvents = midiBlock->midiEvents;
+                midiEventCount = midiBlock->midiEventCount;
             }
             else
             {
@@ -479,11 +854,9 @@ struct IldaeilModule : Module {
             if ((midiOutExpander = rightExpander.module != nullptr && rightExpander.module->model == modelExpanderOutputMIDI
                                  ? static_cast<CardinalExpanderFromCarlaMIDIToCV*>(rightExpander.module)
                                  : nullptr))
-                midiOutExpander->midiEventCount = 0;
+                static_cast<CardinalExpanderMIDIBlock*>(midiOutExpander->leftExpander.producerMessage)->midiEventCount = 0;
 
             audioDataFill = 0;
-            float* ins[2] = { audioDataIn1, audioDataIn2 };
-            float* outs[2] = { audioDataOut1, audioDataOut2 };
 
             if (resetMeterIn)
                 meterInL = meterInR = 0.0f;
@@ -491,7 +864,41 @@ struct IldaeilModule : Module {
             meterInL = std::max(meterInL, d_findMaxNormalizedFloat128(audioDataIn1));
             meterInR = std::max(meterInR, d_findMaxNormalizedFloat128(audioDataIn2));
 
-            fCarlaPluginDescriptor->process(fCarlaPluginHandle, ins, outs, BUFFER_SIZE, midiEvents, midiEventCount);
+            if (pipelined)
+            {
+                // play back the chunk processed by the worker, and hand it the one just filled
+                std::memcpy(audioDataOut1, pipelineDataOut1, sizeof(audioDataOut1));
+                std::memcpy(audioDataOut2, pipelineDataOut2, sizeof(audioDataOut2));
+                std::memcpy(pipelineDataIn1, audioDataIn1, sizeof(pipelineDataIn1));
+                std::memcpy(pipelineDataIn2, audioDataIn2, sizeof(pipelineDataIn2));
+
+                if (midiOutExpander != nullptr && pipelineActive)
+                {
+                    CardinalExpanderMIDIBlock* const midiBlock = static_cast<CardinalExpanderMIDIBlock*>(midiOutExpander->leftExpander.producerMessage);
+                    std::memcpy(midiBlock->midiEvents, pipelineMidiOut, sizeof(NativeMidiEvent) * pipelineMidiOutCount);
+                    midiBlock->midiEventCount = pipelineMidiOutCount;
+                }
+
+                if (midiEventCount != 0)
+                    std::memcpy(pipelineMidiIn, midiEvents, sizeof(NativeMidiEvent) * midiEventCount);
+                pipelineMidiInCount = midiEventCount;
+                pipelineMidiOutCount = 0;
+                pipelineActive = true;
+
+                {
+                    const std::lock_guard<std::mutex> lock(pipelineMutex);
+                    pipelineJobPending = true;
+                }
+                pipelineCondition.notify_one();
+            }
+            else
+            {
+                pipelineActive = false;
+
+                float* ins[2] = { audioDataIn1, audioDataIn2 };
+                float* outs[2] = { audioDataOut1, audioDataOut2 };
+                fCarlaPluginDescriptor->process(fCarlaPluginHandle, ins, outs, BUFFER_SIZE, midiEvents, midiEventCount);
+            }
 
             if (resetMeterOut)
                 meterOutL = meterOutR = 0.0f;
@@ -500,11 +907,20 @@ struct IldaeilModule : Module {
             meterOutR = std::max(meterOutR, d_findMaxNormalizedFloat128(audioDataOut2));
 
             resetMeterIn = resetMeterOut = false;
+
+            // play back the new midi output from the next frame on
+            if (midiOutExpander != nullptr)
+                midiOutExpander->leftExpander.requestMessageFlip();
         }
+
+        // take over the midi input one frame before processing, the flip happens in between frames
+        if (audioDataFill + 1 == BUFFER_SIZE && leftExpander.module != nullptr && leftExpander.module->model == modelExpanderInputMIDI)
+            leftExpander.module->rightExpander.requestMessageFlip();
     }
 
     void onReset() override
     {
+        waitForPipeline();
         resetMeterIn = resetMeterOut = true;
         midiOutExpander = nullptr;
     }
@@ -514,6 +930,7 @@ struct IldaeilModule : Module {
         if (fCarlaPluginHandle == nullptr)
             return;
 
+        waitForPipeline();
         resetMeterIn = resetMeterOut = true;
         midiOutExpander = nullptr;
 
@@ -552,12 +969,26 @@ static const NativeTimeInfo* host_get_time_info(const NativeHostHandle handle)
 
 static bool host_write_midi_event(const NativeHostHandle handle, const NativeMidiEvent* const event)
 {
-    if (CardinalExpanderFromCarlaMIDIToCV* const expander = static_cast<IldaeilModule*>(handle)->midiOutExpander)
+    IldaeilModule* const module = static_cast<IldaeilModule*>(handle);
+
+    // on the worker thread, kept until the engine hands the next chunk over
+    if (module->pipelineActive)
+    {
+        if (module->pipelineMidiOutCount == CardinalExpanderFromCarlaMIDIToCV::MAX_MIDI_EVENTS)
+            return false;
+
+        carla_copyStruct(module->pipelineMidiOut[module->pipelineMidiOutCount++], *event);
+        return true;
+    }
+
+    if (CardinalExpanderFromCarlaMIDIToCV* const expander = module->midiOutExpander)
     {
-        if (expander->midiEventCount == CardinalExpanderFromCarlaMIDIToCV::MAX_MIDI_EVENTS)
+        CardinalExpanderMIDIBlock* const midiBlock = static_cast<CardinalExpanderMIDIBlock*>(expander->leftExpander.producerMessage);
+
+        if (midiBlock->midiEventCount == CardinalExpanderMIDIBlock::MAX_MIDI_EVENTS)
             return false;
 
-        NativeMidiEvent& expanderEvent(expander->midiEvents[expander->midiEventCount++]);
+        NativeMidiEvent& expanderEvent(midiBlock->midiEvents[midiBlock->midiEventCount++]);
         carla_copyStruct(expanderEvent, *event);
         return true;
     }
@@ -614,7 +1045,7 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
             char* name;
             char* printformat;
             uint32_t rindex;
-            bool boolean, bvalue, log, readonly;
+            bool boolean, bvalue, log, readonly, output, visible;
             float min, max, power;
             Parameter()
                 : name(nullptr),
@@ -624,6 +1055,8 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
                   bvalue(false),
                   log(false),
                   readonly(false),
+                  output(false),
+                  visible(false),
                   min(0.0f),
                   max(1.0f) {}
             ~Parameter()
@@ -633,18 +1066,24 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
             }
         }* parameters;
         float* values;
+        // position in parameters of each plugin parameter, or UINT32_MAX for disabled ones
+        uint32_t rcount;
+        uint32_t* indexes;
 
         PluginGenericUI()
             : title(nullptr),
               parameterCount(0),
               parameters(nullptr),
-              values(nullptr) {}
+              values(nullptr),
+              rcount(0),
+              indexes(nullptr) {}
 
         ~PluginGenericUI()
         {
             std::free(title);
             delete[] parameters;
             delete[] values;
+            delete[] indexes;
         }
     };
 
@@ -675,12 +1114,19 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
         bool needsReinit = true;
         uint pluginCount = 0;
         uint pluginIndex = 0;
+        // scan cache key and state of the plugin files, stored into cache once scanning finishes
+        const char* cacheKey = nullptr;
+        std::string cachePath;
+        std::map<std::string, int64_t> cacheBundles;
 
         void init()
         {
             needsReinit = true;
             pluginCount = 0;
             pluginIndex = 0;
+            cacheKey = nullptr;
+            cachePath.clear();
+            cacheBundles.clear();
         }
     } fRunnerData;
 
@@ -708,6 +1154,7 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
     String fPopupError, fPluginFilename;
 
     bool idleCallbackActive = false;
+    bool fWasLoadingProject = false;
     IldaeilModule* const module;
 
     IldaeilWidget(IldaeilModule* const m)
@@ -726,8 +1173,16 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
                 return;
             }
 
-            if (checkIfPluginIsLoaded())
-                fIdleState = kIdleInitPluginAlreadyLoaded;
+            // otherwise checked once the project is restored, see checkProjectLoad()
+            if (! m->isLoadingProject())
+            {
+                m->projectLoadFinished.store(false);
+
+                if (checkIfPluginIsLoaded())
+                    fIdleState = kIdleInitPluginAlreadyLoaded;
+            }
+
+            fPluginWillRunInBridgeMode = m->wantsBridges();
 
             m->fUI = this;
         }
@@ -745,7 +1200,7 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
             if (idleCallbackActive)
                 module->pcontext->removeIdleCallback(this);
 
-            if (fPluginRunning)
+            if (fPluginRunning && ! module->isLoadingProject())
                 carla_show_custom_ui(module->fCarlaHostHandle, 0, false);
 
             carla_set_engine_option(module->fCarlaHostHandle, ENGINE_OPTION_FRONTEND_WIN_ID, 0, "0");
@@ -788,6 +1243,42 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
         }
     }
 
+    // returns true while the module restores its project in the background
+    bool checkProjectLoad()
+    {
+        if (module->isLoadingProject())
+        {
+            if (! fWasLoadingProject)
+            {
+                fWasLoadingProject = true;
+                setDirty(true);
+            }
+            return true;
+        }
+
+        if (module->projectLoadFinished.exchange(false))
+        {
+            // a widget created during the restore has not checked for a plugin yet
+            if (fIdleState == kIdleInit)
+            {
+                if (checkIfPluginIsLoaded())
+                    fIdleState = kIdleInitPluginAlreadyLoaded;
+            }
+            else
+            {
+                projectLoadedFromDSP();
+            }
+        }
+
+        if (fWasLoadingProject)
+        {
+            fWasLoadingProject = false;
+            setDirty(true);
+        }
+
+        return false;
+    }
+
     void projectLoadedFromDSP()
     {
         if (checkIfPluginIsLoaded())
@@ -798,17 +1289,14 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
     {
         if (PluginGenericUI* const ui = fPluginGenericUI)
         {
-            for (uint32_t i=0; i < ui->parameterCount; ++i)
-            {
-                if (ui->parameters[i].rindex != index)
-                    continue;
+            const uint32_t i = index < ui->rcount ? ui->indexes[index] : UINT32_MAX;
 
+            if (i < ui->parameterCount)
+            {
                 ui->values[i] = value;
 
                 if (ui->parameters[i].boolean)
                     ui->parameters[i].bvalue = value > ui->parameters[i].min;
-
-                break;
             }
         }
 
@@ -889,6 +1377,8 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
 
         ui->parameters = new PluginGenericUI::Parameter[ui->parameterCount];
         ui->values = new float[ui->parameterCount];
+        ui->rcount = pcount;
+        ui->indexes = new uint32_t[pcount];
 
         // now safely fill in details
         for (uint32_t i=0, j=0; i < pcount; ++i)
@@ -896,7 +1386,12 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
             const ParameterData* const pdata = carla_get_parameter_data(handle, 0, i);
 
             if ((pdata->hints & PARAMETER_IS_ENABLED) == 0x0)
+            {
+                ui->indexes[i] = UINT32_MAX;
                 continue;
+            }
+
+            ui->indexes[i] = j;
 
             const CarlaParameterInfo* const pinfo = carla_get_parameter_info(handle, 0, i);
             const ::ParameterRanges* const pranges = carla_get_parameter_ranges(handle, 0, i);
@@ -917,6 +1412,7 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
             param.boolean = pdata->hints & PARAMETER_IS_BOOLEAN;
             param.log = pdata->hints & PARAMETER_IS_LOGARITHMIC;
             param.readonly = pdata->type != PARAMETER_INPUT || (pdata->hints & PARAMETER_IS_READ_ONLY);
+            param.output = pdata->type == PARAMETER_OUTPUT;
             param.min = pranges->min;
             param.max = pranges->max;
 
@@ -933,6 +1429,34 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
         fPluginGenericUI = ui;
     }
 
+    // output parameters have no change callback, only the ones drawn last time are polled for changes
+    bool updatePluginGenericUIOutputs(const CarlaHostHandle handle)
+    {
+        PluginGenericUI* const ui = fPluginGenericUI;
+        DISTRHO_SAFE_ASSERT_RETURN(ui != nullptr, false);
+
+        bool changed = false;
+
+        for (uint32_t i=0; i < ui->parameterCount; ++i)
+        {
+            if (! (ui->parameters[i].output && ui->parameters[i].visible))
+                continue;
+
+            const float value = carla_get_current_parameter_value(handle, 0, ui->parameters[i].rindex);
+
+            if (d_isEqual(ui->values[i], value))
+                continue;
+
+            ui->values[i] = value;
+            changed = true;
+
+            if (ui->parameters[i].boolean)
+                ui->parameters[i].bvalue = value > ui->parameters[i].min;
+        }
+
+        return changed;
+    }
+
     void updatePluginGenericUI(const CarlaHostHandle handle)
     {
         PluginGenericUI* const ui = fPluginGenericUI;
@@ -956,6 +1480,7 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
         }
 
         carla_set_engine_option(handle, ENGINE_OPTION_PREFER_PLUGIN_BRIDGES, fPluginWillRunInBridgeMode, nullptr);
+        module->params[IldaeilModule::BRIDGED].setValue(fPluginWillRunInBridgeMode ? 1.0f : 0.0f);
 
         const MutexLocker cml(sPluginInfoLoadMutex);
 
@@ -986,6 +1511,7 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
         }
 
         carla_set_engine_option(handle, ENGINE_OPTION_PREFER_PLUGIN_BRIDGES, fPluginWillRunInBridgeMode, nullptr);
+        module->params[IldaeilModule::BRIDGED].setValue(fPluginWillRunInBridgeMode ? 1.0f : 0.0f);
 
         const MutexLocker cml(sPluginInfoLoadMutex);
 
@@ -1049,9 +1575,10 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
             if (pcontext->window != nullptr)
                 carla_set_engine_option(handle, ENGINE_OPTION_FRONTEND_UI_SCALE, pcontext->window->pixelRatio*1000, nullptr);
 
+            // drives the embedded plugin UI, ahead of callbacks only giving idle time to plugin windows
             if (! idleCallbackActive)
             {
-                idleCallbackActive = pcontext->addIdleCallback(this);
+                idleCallbackActive = pcontext->addIdleCallback(this, 0.0, kIdlePriorityHigh, this);
             }
         }
     }
@@ -1085,10 +1612,14 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
         carla_juce_idle();
         */
 
+        if (checkProjectLoad())
+            return;
+
+        // input parameters are kept current through changeParameterFromDSP
         if (fDrawingState == kDrawingPluginGenericUI && fPluginGenericUI != nullptr && fPluginHasOutputParameters)
         {
-            updatePluginGenericUI(handle);
-            setDirty(true);
+            if (updatePluginGenericUIOutputs(handle))
+                setDirty(true);
         }
 
         switch (fIdleState)
@@ -1132,11 +1663,16 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
         case kIdleShowCustomUI:
             fIdleState = kIdleGiveIdleToUI;
             carla_show_custom_ui(handle, 0, true);
+            // the plugin window is separate from the rack, keep full rate while this widget is off screen
+            if (idleCallbackActive)
+                module->pcontext->addIdleCallback(this, 0.0, kIdlePriorityHigh, nullptr);
             break;
 
         case kIdleHidePluginUI:
             fIdleState = kIdleNothing;
             carla_show_custom_ui(handle, 0, false);
+            if (idleCallbackActive)
+                module->pcontext->addIdleCallback(this, 0.0, kIdlePriorityHigh, this);
             break;
 
         case kIdleGiveIdleToUI:
@@ -1217,6 +1753,9 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
 
     bool run() override
     {
+        // the plugin list changes while scanning
+        setDirty(true);
+
         if (fRunnerData.needsReinit)
         {
             fRunnerData.needsReinit = false;
@@ -1237,6 +1776,49 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
 
             fPluginCount = 0;
             delete[] fPlugins;
+            fPlugins = nullptr;
+
+            if ((fRunnerData.cacheKey = getPluginScanCacheKey(fPluginType)) != nullptr)
+            {
+                fRunnerData.cachePath = getPluginScanPath(fPluginType);
+                fRunnerData.cacheBundles = getPluginBundleTimes(fPluginType, fRunnerData.cachePath);
+
+                const MutexLocker cml(sPluginInfoLoadMutex);
+
+                loadPluginScanCache();
+
+                const auto it = sPluginScanCache.find(fRunnerData.cacheKey);
+
+                if (it != sPluginScanCache.end()
+                    && it->second.path == fRunnerData.cachePath
+                    && it->second.bundles == fRunnerData.cacheBundles)
+                {
+                    const std::vector<PluginScanCacheEntry::Plugin>& plugins(it->second.plugins);
+                    d_stdout("Using %u cached plugins", static_cast<uint>(plugins.size()));
+
+                    if (! plugins.empty())
+                    {
+                        fPlugins = new PluginInfoCache[plugins.size()];
+
+                        for (size_t i = 0; i < plugins.size(); ++i)
+                        {
+                            fPlugins[i].name = strdup(plugins[i].name.c_str());
+                            fPlugins[i].label = strdup(plugins[i].label.c_str());
+                        }
+
+                        fPluginCount = plugins.size();
+                    }
+
+                    if (fDrawingState == kDrawingLoading)
+                    {
+                        fDrawingState = kDrawingPluginList;
+                        fPluginSearchFirstShow = true;
+                    }
+
+                    fPluginScanningFinished = true;
+                    return false;
+                }
+            }
 
             {
                 const MutexLocker cml(sPluginInfoLoadMutex);
@@ -1260,7 +1842,7 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
             }
             else
             {
-                fPlugins = nullptr;
+                storePluginScanCache();
                 fPluginScanningFinished = true;
                 return false;
             }
@@ -1312,12 +1894,37 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
             return true;
 
         // stop here
+        storePluginScanCache();
         fPluginScanningFinished = true;
         return false;
     }
 
+    void storePluginScanCache()
+    {
+        if (fRunnerData.cacheKey == nullptr)
+            return;
+
+        const MutexLocker cml(sPluginInfoLoadMutex);
+
+        PluginScanCacheEntry& entry(sPluginScanCache[fRunnerData.cacheKey]);
+        entry.path = fRunnerData.cachePath;
+        entry.bundles = fRunnerData.cacheBundles;
+        entry.plugins.clear();
+
+        for (uint i=0; i<fPluginCount; ++i)
+            entry.plugins.push_back({fPlugins[i].name, fPlugins[i].label});
+
+        savePluginScanCache();
+    }
+
     void drawImGui() override
     {
+        if (module != nullptr && module->isLoadingProject())
+        {
+            drawLoading();
+            return;
+        }
+
         switch (fDrawingState)
         {
         case kDrawingLoading:
@@ -1478,6 +2085,7 @@ struct IldaeilWidget : ImGuiWidget, IdleCallback, Runner {
                     ImGui::SliderFloat(param.name, &ui->values[i], param.min, param.max, param.printformat,
                                        ImGuiSliderFlags_NoInput | (param.log ? ImGuiSliderFlags_Logarithmic : 0x0));
                     ImGui::EndDisabled();
+                    param.visible = ImGui::IsItemVisible();
                     continue;
                 }
 
@@ -1884,6 +2492,21 @@ struct IldaeilModuleWidget : ModuleWidgetWithSideScrews<26> {
         ModuleWidgetWithSideScrews<26>::draw(args);
     }
 
+    void appendContextMenu(ui::Menu* const menu) override
+    {
+        IldaeilModule* const module = static_cast<IldaeilModule*>(this->module);
+
+        if (module == nullptr || module->fCarlaHostHandle == nullptr)
+            return;
+
+        menu->addChild(new ui::MenuSeparator);
+
+        menu->addChild(createCheckMenuItem("Pipelined processing (adds latency)", "",
+            [=]() {return module->params[IldaeilModule::PIPELINED].getValue() > 0.5f;},
+            [=]() {module->params[IldaeilModule::PIPELINED].setValue(1.0f - module->params[IldaeilModule::PIPELINED].getValue());}
+        ));
+    }
+
     void step() override
     {
         hasLeftSideExpander = module != nullptr
@@ -63,6 +63,7 @@ bool ImGuiTextEditor::setFile(const std::string& file)
 
     pData->file = file;
     pData->editor.SetText(std::string((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>()));
+    setDirty(true);
     return true;
 }
 
@@ -70,6 +71,7 @@ void ImGuiTextEditor::setFileWithKnownText(const std::string& file, const std::s
 {
     pData->file = file;
     pData->editor.SetText(text);
+    setDirty(true);
 }
 
 std::string ImGuiTextEditor::getFile() const
@@ -79,6 +81,7 @@ std::string ImGuiTextEditor::getFile() const
 
 void ImGuiTextEditor::setLanguageDefinition(const std::string& lang)
 {
+    setDirty(true);
     pData->editor.SetColorizerEnable(true);
 
     if (lang == "AngelScript")
@@ -106,6 +109,7 @@ void ImGuiTextEditor::setText(const std::string& text)
 {
     pData->file.clear();
     pData->editor.SetText(text);
+    setDirty(true);
 }
 
 std::string ImGuiTextEditor::getText() const
@@ -117,6 +121,7 @@ void ImGuiTextEditor::setTextLines(const std::vector<std::string>& lines)
 {
     pData->file.clear();
     pData->editor.SetTextLines(lines);
+    setDirty(true);
 }
 
 std::vector<std::string> ImGuiTextEditor::getTextLines() const
@@ -142,6 +147,7 @@ bool ImGuiTextEditor::hasSelection() const
 void ImGuiTextEditor::selectAll()
 {
     pData->editor.SelectAll();
+    setDirty(true);
 }
 
 void ImGuiTextEditor::copy()
@@ -152,11 +158,13 @@ void ImGuiTextEditor::copy()
 void ImGuiTextEditor::cut()
 {
     pData->editor.Cut();
+    setDirty(true);
 }
 
 void ImGuiTextEditor::paste()
 {
     pData->editor.Paste();
+    setDirty(true);
 }
 
 bool ImGuiTextEditor::canUndo() const
@@ -172,11 +180,13 @@ bool ImGuiTextEditor::canRedo() const
 void ImGuiTextEditor::undo()
 {
     pData->editor.Undo();
+    setDirty(true);
 }
 
 void ImGuiTextEditor::redo()
 {
     pData->editor.Redo();
+    setDirty(true);
 }
 
 // --------------------------------------------------------------------------------------------------------------------
@@ -241,5 +251,9 @@ void ImGuiTextEditor::step()
                                                     : TextEditor::GetLightPalette());
     }
 
+    // colorization happens in slices while rendering
+    if (pData->editor.IsColorizing())
+        setDirty(true);
+
     ImGuiWidget::step();
 }
@@ -17,6 +17,7 @@
 
 #include "ImGuiWidget.hpp"
 #include "DearImGui/imgui.h"
+#include "DearImGui/imgui_internal.h"
 #include "DistrhoUtils.hpp"
 
 #ifndef DGL_NO_SHARED_RESOURCES
@@ -29,6 +30,9 @@
 # include "DearImGui/imgui_impl_opengl2.h"
 #endif
 
+// time to keep rendering after the last input event, so ImGui can settle hover and layout changes
+static constexpr const double kRenderTimeAfterInput = 0.5;
+
 static const char* GetClipboardTextFn(void*)
 {
     return glfwGetClipboardString(nullptr);
@@ -39,6 +43,102 @@ static void SetClipboardTextFn(void*, const char* const text)
     glfwSetClipboardString(nullptr, text);
 }
 
+static void buildFontAtlas(ImFontAtlas* const atlas, const bool useMonospacedFont, const float scaleFactor)
+{
+    if (useMonospacedFont)
+    {
+        const std::string fontPath = asset::system("res/fonts/ShareTechMono-Regular.ttf");
+        ImFontConfig fc;
+        fc.OversampleH = 1;
+        fc.OversampleV = 1;
+        fc.PixelSnapH = true;
+        atlas->AddFontFromFileTTF(fontPath.c_str(), 13.0f * scaleFactor, &fc);
+        atlas->Build();
+    }
+    else
+    {
+#ifndef DGL_NO_SHARED_RESOURCES
+        using namespace dpf_resources;
+        ImFontConfig fc;
+        fc.FontDataOwnedByAtlas = false;
+        fc.OversampleH = 1;
+        fc.OversampleV = 1;
+        fc.PixelSnapH = true;
+        atlas->AddFontFromMemoryTTF((void*)dejavusans_ttf, dejavusans_ttf_size, 13.0f * scaleFactor, &fc);
+
+        // extra fonts we can try loading for unicode support
+        static const char* extraFontPathsToTry[] = {
+           #if defined(ARCH_WIN)
+            // TODO
+            // "Meiryo.ttc",
+           #elif defined(ARCH_MAC)
+            // TODO
+           #elif defined(ARCH_LIN)
+            "/usr/share/fonts/opentype/noto/NotoSerifCJK-Regular.ttc",
+           #endif
+        };
+
+        fc.FontDataOwnedByAtlas = true;
+        fc.MergeMode = true;
+
+        for (size_t i=0; i<ARRAY_SIZE(extraFontPathsToTry); ++i)
+        {
+            if (rack::system::exists(extraFontPathsToTry[i]))
+                atlas->AddFontFromFileTTF(extraFontPathsToTry[i], 13.0f * scaleFactor, &fc,
+                                          atlas->GetGlyphRangesJapanese());
+        }
+
+        atlas->Build();
+#endif
+    }
+}
+
+// Font atlases are shared by all widgets with the same font and scale factor, so glyphs are only rasterized once.
+// Like the ImGui current context, these are only used from the UI thread.
+struct SharedFontAtlas {
+    ImFontAtlas* atlas;
+    bool useMonospacedFont;
+    float scaleFactor;
+    uint refCount;
+};
+
+static std::vector<SharedFontAtlas> sharedFontAtlases;
+
+static ImFontAtlas* acquireSharedFontAtlas(const bool useMonospacedFont, const float scaleFactor)
+{
+    for (SharedFontAtlas& shared : sharedFontAtlases)
+    {
+        if (shared.useMonospacedFont == useMonospacedFont && d_isEqual(shared.scaleFactor, scaleFactor))
+        {
+            ++shared.refCount;
+            return shared.atlas;
+        }
+    }
+
+    ImFontAtlas* const atlas = IM_NEW(ImFontAtlas)();
+    buildFontAtlas(atlas, useMonospacedFont, scaleFactor);
+    sharedFontAtlases.push_back({ atlas, useMonospacedFont, scaleFactor, 1 });
+    return atlas;
+}
+
+static void releaseSharedFontAtlas(ImFontAtlas* const atlas)
+{
+    for (auto it = sharedFontAtlases.begin(); it != sharedFontAtlases.end(); ++it)
+    {
+        if (it->atlas != atlas)
+            continue;
+
+        if (--it->refCount == 0)
+        {
+            IM_DELETE(atlas);
+            sharedFontAtlases.erase(it);
+        }
+        return;
+    }
+
+    DISTRHO_SAFE_ASSERT(false);
+}
+
 static void setupIO()
 {
     ImGuiIO& io(ImGui::GetIO());
@@ -75,6 +175,8 @@ static void setupIO()
 
 struct ImGuiWidget::PrivateData {
     ImGuiContext* context = nullptr;
+    ImFontAtlas* fontAtlas = nullptr;
+    ImTextureID fontTexture = 0;
     bool created = false;
     bool darkMode = true;
     bool fontGenerated = false;
@@ -82,6 +184,9 @@ struct ImGuiWidget::PrivateData {
     float originalScaleFactor = 0.0f;
     float scaleFactor = 0.0f;
     double lastFrameTime = 0.0;
+    double lastInputTime = 0.0;
+    bool wantsInput = false;
+    Vec lastSize;
 
     PrivateData()
     {
@@ -105,6 +210,7 @@ struct ImGuiWidget::PrivateData {
         }
 
         ImGui::DestroyContext(context);
+        releaseFontAtlas();
     }
 
     void generateFontIfNeeded()
@@ -115,55 +221,27 @@ struct ImGuiWidget::PrivateData {
         DISTRHO_SAFE_ASSERT_RETURN(scaleFactor != 0.0f,);
 
         fontGenerated = true;
+        fontAtlas = acquireSharedFontAtlas(useMonospacedFont, scaleFactor);
 
-        ImGuiIO& io(ImGui::GetIO());
-
-        if (useMonospacedFont)
+        // replace the context own atlas with the shared one
+        if (context->FontAtlasOwnedByContext)
         {
-            const std::string fontPath = asset::system("res/fonts/ShareTechMono-Regular.ttf");
-            ImFontConfig fc;
-            fc.OversampleH = 1;
-            fc.OversampleV = 1;
-            fc.PixelSnapH = true;
-            io.Fonts->AddFontFromFileTTF(fontPath.c_str(), 13.0f * scaleFactor, &fc);
-            io.Fonts->Build();
+            IM_DELETE(context->IO.Fonts);
+            context->FontAtlasOwnedByContext = false;
         }
-        else
-        {
-#ifndef DGL_NO_SHARED_RESOURCES
-            using namespace dpf_resources;
-            ImFontConfig fc;
-            fc.FontDataOwnedByAtlas = false;
-            fc.OversampleH = 1;
-            fc.OversampleV = 1;
-            fc.PixelSnapH = true;
-            io.Fonts->AddFontFromMemoryTTF((void*)dejavusans_ttf, dejavusans_ttf_size, 13.0f * scaleFactor, &fc);
-
-            // extra fonts we can try loading for unicode support
-            static const char* extraFontPathsToTry[] = {
-               #if defined(ARCH_WIN)
-                // TODO
-                // "Meiryo.ttc",
-               #elif defined(ARCH_MAC)
-                // TODO
-               #elif defined(ARCH_LIN)
-                "/usr/share/fonts/opentype/noto/NotoSerifCJK-Regular.ttc",
-               #endif
-            };
-
-            fc.FontDataOwnedByAtlas = true;
-            fc.MergeMode = true;
-
-            for (size_t i=0; i<ARRAY_SIZE(extraFontPathsToTry); ++i)
-            {
-                if (rack::system::exists(extraFontPathsToTry[i]))
-                    io.Fonts->AddFontFromFileTTF(extraFontPathsToTry[i], 13.0f * scaleFactor, &fc,
-                                                 io.Fonts->GetGlyphRangesJapanese());
-            }
 
-            io.Fonts->Build();
-#endif
-        }
+        context->IO.Fonts = fontAtlas;
+    }
+
+    void releaseFontAtlas()
+    {
+        fontTexture = 0;
+
+        if (fontAtlas == nullptr)
+            return;
+
+        releaseSharedFontAtlas(fontAtlas);
+        fontAtlas = nullptr;
     }
 
     void resetEverything(const bool doInit)
@@ -184,6 +262,7 @@ struct ImGuiWidget::PrivateData {
         scaleFactor = 0.0f;
         lastFrameTime = 0.0;
         ImGui::DestroyContext(context);
+        releaseFontAtlas();
 
         context = ImGui::CreateContext();
         ImGui::SetCurrentContext(context);
@@ -268,6 +347,7 @@ void ImGuiWidget::onContextCreate(const ContextCreateEvent& e)
     ImGui_ImplOpenGL2_Init();
 #endif
     imData->created = true;
+    setDirty(true);
 }
 
 void ImGuiWidget::onContextDestroy(const ContextDestroyEvent& e)
@@ -281,6 +361,7 @@ void ImGuiWidget::onContextDestroy(const ContextDestroyEvent& e)
         ImGui_ImplOpenGL2_Shutdown();
 #endif
         imData->created = false;
+        imData->fontTexture = 0;
     }
 
     OpenGlWidgetWithBrowserPreview::onContextDestroy(e);
@@ -301,6 +382,7 @@ void ImGuiWidget::setUseMonospaceFont(const bool useMonoFont)
 void ImGuiWidget::onHover(const HoverEvent& e)
 {
     ImGui::SetCurrentContext(imData->context);
+    imData->lastInputTime = system::getTime();
 
     ImGuiIO& io(ImGui::GetIO());
     io.MousePos.x = e.pos.x + e.mouseDelta.x;
@@ -316,6 +398,7 @@ void ImGuiWidget::onHover(const HoverEvent& e)
 void ImGuiWidget::onDragHover(const DragHoverEvent& e)
 {
     ImGui::SetCurrentContext(imData->context);
+    imData->lastInputTime = system::getTime();
 
     ImGuiIO& io(ImGui::GetIO());
     io.MousePos.x = e.pos.x + e.mouseDelta.x;
@@ -331,6 +414,7 @@ void ImGuiWidget::onDragHover(const DragHoverEvent& e)
 void ImGuiWidget::onDragEnd(const DragEndEvent& e)
 {
     ImGui::SetCurrentContext(imData->context);
+    imData->lastInputTime = system::getTime();
 
     ImGuiIO& io(ImGui::GetIO());
     io.MouseDown[0] = io.MouseDown[1] = io.MouseDown[2] = false;
@@ -339,6 +423,7 @@ void ImGuiWidget::onDragEnd(const DragEndEvent& e)
 void ImGuiWidget::onHoverScroll(const HoverScrollEvent& e)
 {
     ImGui::SetCurrentContext(imData->context);
+    imData->lastInputTime = system::getTime();
 
     float deltaX = e.scrollDelta.x;
     float deltaY = e.scrollDelta.y;
@@ -360,6 +445,7 @@ void ImGuiWidget::onHoverScroll(const HoverScrollEvent& e)
 void ImGuiWidget::onButton(const ButtonEvent& e)
 {
     ImGui::SetCurrentContext(imData->context);
+    imData->lastInputTime = system::getTime();
 
     ImGuiIO& io(ImGui::GetIO());
 
@@ -395,6 +481,7 @@ void ImGuiWidget::onSelectKey(const SelectKeyEvent& e)
         return;
 
     ImGui::SetCurrentContext(imData->context);
+    imData->lastInputTime = system::getTime();
 
     ImGuiIO& io(ImGui::GetIO());
 
@@ -422,6 +509,7 @@ void ImGuiWidget::onSelectKey(const SelectKeyEvent& e)
 void ImGuiWidget::onSelectText(const SelectTextEvent& e)
 {
     ImGui::SetCurrentContext(imData->context);
+    imData->lastInputTime = system::getTime();
 
     ImGuiIO& io(ImGui::GetIO());
     io.AddInputCharacter(e.codepoint);
@@ -436,14 +524,25 @@ void ImGuiWidget::step()
     {
         imData->darkMode = settings::darkMode;
         imData->resetEverything(true);
+        setDirty(true);
+    }
+
+    // only render on input, resize or when subclasses mark the widget as dirty, otherwise reuse the last frame
+    if (imData->wantsInput
+        || system::getTime() - imData->lastInputTime < kRenderTimeAfterInput
+        || d_isNotEqual(imData->scaleFactor, getCurrentScaleFactor())
+        || !imData->lastSize.equals(box.size))
+    {
+        setDirty(true);
     }
 
-    OpenGlWidgetWithBrowserPreview::step();
+    // skip OpenGlWidget::step, which renders every frame
+    FramebufferWidget::step();
 }
 
 void ImGuiWidget::drawFramebuffer()
 {
-    const float scaleFactor = APP->window->pixelRatio * std::max(1.0f, APP->scene->rack->getAbsoluteZoom());
+    const float scaleFactor = getCurrentScaleFactor();
 
     if (d_isNotEqual(imData->scaleFactor, scaleFactor))
         imData->resetEverything(true);
@@ -451,6 +550,11 @@ void ImGuiWidget::drawFramebuffer()
     drawFramebufferCommon(getFramebufferSize(), scaleFactor);
 }
 
+float ImGuiWidget::getCurrentScaleFactor() const
+{
+    return APP->window->pixelRatio * std::max(1.0f, APP->scene->rack->getAbsoluteZoom());
+}
+
 void ImGuiWidget::drawFramebufferForBrowserPreview()
 {
     imData->resetEverything(true);
@@ -511,16 +615,26 @@ void ImGuiWidget::drawFramebufferCommon(const Vec& fbSize, const float scaleFact
     io.DeltaTime = time - imData->lastFrameTime;
     imData->lastFrameTime = time;
 
+    // the backend replaces the texture of the shared font atlas with its own when created, and clears it when destroyed
+    if (imData->fontTexture != 0)
+        io.Fonts->SetTexID(imData->fontTexture);
+
 #if defined(DGL_USE_OPENGL3)
     ImGui_ImplOpenGL3_NewFrame();
 #else
     ImGui_ImplOpenGL2_NewFrame();
 #endif
 
+    imData->fontTexture = io.Fonts->TexID;
+
     ImGui::NewFrame();
     drawImGui();
     ImGui::Render();
 
+    // keep rendering while something is being dragged or edited
+    imData->wantsInput = io.WantTextInput || ImGui::IsAnyItemActive();
+    imData->lastSize = box.size;
+
     if (ImDrawData* const data = ImGui::GetDrawData())
     {
 #if defined(DGL_USE_OPENGL3)
@@ -55,4 +55,5 @@ private:
     void drawFramebuffer() override;
     void drawFramebufferForBrowserPreview() override;
     void drawFramebufferCommon(const Vec& fbSize, float scaleFactor);
+    float getCurrentScaleFactor() const;
 };
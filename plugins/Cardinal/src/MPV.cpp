@@ -18,7 +18,10 @@
 #include "plugincontext.hpp"
 #ifndef HEADLESS
 # include "EmbedWidget.hpp"
+# include "Widgets.hpp"
 # include "extra/ExternalWindow.hpp"
+# include <dlfcn.h>
+# include <GL/glx.h>
 #endif
 
 // --------------------------------------------------------------------------------------------------------------------
@@ -57,10 +60,248 @@ struct CardinalEmbedModule : Module {
 // --------------------------------------------------------------------------------------------------------------------
 
 #ifndef HEADLESS
+// libmpv is loaded at runtime, so it is not a build dependency, only the parts of its API used here are declared.
+// When it is available, mpv renders into the widget framebuffer through its render API, decoding in hardware
+// where it can share frames with OpenGL, and the video is composited like any other widget.
+// Otherwise the mpv program is started inside an embedded child window, as before.
+
+struct LibMPV {
+    struct Handle;
+    struct RenderContext;
+
+    enum RenderParamType {
+        kRenderParamInvalid = 0,
+        kRenderParamApiType = 1,
+        kRenderParamOpenGlInitParams = 2,
+        kRenderParamOpenGlFbo = 3,
+        kRenderParamFlipY = 4,
+        kRenderParamX11Display = 8,
+    };
+
+    struct RenderParam {
+        RenderParamType type;
+        void* data;
+    };
+
+    struct OpenGlInitParams {
+        void* (*get_proc_address)(void* ctx, const char* name);
+        void* get_proc_address_ctx;
+        // only read by libmpv 1.x
+        const char* extra_exts;
+    };
+
+    struct OpenGlFbo {
+        int fbo;
+        int w;
+        int h;
+        int internal_format;
+    };
+
+    Handle* (*create)();
+    int (*initialize)(Handle*);
+    void (*terminate_destroy)(Handle*);
+    int (*set_option_string)(Handle*, const char*, const char*);
+    int (*command)(Handle*, const char**);
+    int (*render_context_create)(RenderContext**, Handle*, RenderParam*);
+    void (*render_context_set_update_callback)(RenderContext*, void (*)(void*), void*);
+    uint64_t (*render_context_update)(RenderContext*);
+    int (*render_context_render)(RenderContext*, RenderParam*);
+    void (*render_context_free)(RenderContext*);
+
+    static const LibMPV* get()
+    {
+        static const LibMPV libmpv;
+        return libmpv.create != nullptr ? &libmpv : nullptr;
+    }
+
+private:
+    LibMPV()
+    {
+        void* lib = dlopen("libmpv.so.2", RTLD_NOW|RTLD_LOCAL);
+        if (lib == nullptr)
+            lib = dlopen("libmpv.so.1", RTLD_NOW|RTLD_LOCAL);
+        if (lib == nullptr)
+            return;
+
+        if (! loadSymbols(lib))
+        {
+            d_stderr2("libmpv found but misses its render API, using the mpv program instead");
+            create = nullptr;
+        }
+    }
+
+    template <typename T>
+    static bool loadSymbol(void* const lib, T& func, const char* const name)
+    {
+        func = reinterpret_cast<T>(dlsym(lib, name));
+        return func != nullptr;
+    }
+
+    bool loadSymbols(void* const lib)
+    {
+        return loadSymbol(lib, create, "mpv_create")
+            && loadSymbol(lib, initialize, "mpv_initialize")
+            && loadSymbol(lib, terminate_destroy, "mpv_terminate_destroy")
+            && loadSymbol(lib, set_option_string, "mpv_set_option_string")
+            && loadSymbol(lib, command, "mpv_command")
+            && loadSymbol(lib, render_context_create, "mpv_render_context_create")
+            && loadSymbol(lib, render_context_set_update_callback, "mpv_render_context_set_update_callback")
+            && loadSymbol(lib, render_context_update, "mpv_render_context_update")
+            && loadSymbol(lib, render_context_render, "mpv_render_context_render")
+            && loadSymbol(lib, render_context_free, "mpv_render_context_free");
+    }
+};
+
+struct MPVRenderWidget : OpenGlWidgetWithBrowserPreview {
+    const LibMPV* const libmpv;
+    LibMPV::Handle* handle = nullptr;
+    LibMPV::RenderContext* renderContext = nullptr;
+    // bumped from mpv threads whenever a new frame is ready
+    std::atomic<uint32_t> frameGeneration{0};
+    std::string pendingFile;
+
+    MPVRenderWidget(const LibMPV* const l)
+        : libmpv(l)
+    {
+        animationMode = kAnimationOnData;
+        dataGeneration = &frameGeneration;
+    }
+
+    ~MPVRenderWidget() override
+    {
+        destroy();
+    }
+
+    void loadFile(const char* const path)
+    {
+        pendingFile = path;
+        setDirty(true);
+    }
+
+    void onContextDestroy(const ContextDestroyEvent& e) override
+    {
+        // render context GL resources go with the context
+        destroy();
+        OpenGlWidgetWithBrowserPreview::onContextDestroy(e);
+    }
+
+    void drawFramebuffer() override
+    {
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        if (! pendingFile.empty())
+        {
+            if (renderContext == nullptr)
+                create();
+
+            if (handle != nullptr)
+            {
+                const char* args[] = { "loadfile", pendingFile.c_str(), nullptr };
+                libmpv->command(handle, args);
+            }
+
+            pendingFile.clear();
+        }
+
+        if (renderContext == nullptr)
+            return;
+
+        libmpv->render_context_update(renderContext);
+
+        GLint fbo = 0;
+        GLint viewport[4] = {};
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+
+        // nanovg shows framebuffers flipped, like the default one
+        LibMPV::OpenGlFbo target = { fbo, viewport[2], viewport[3], 0 };
+        int flipY = 1;
+        LibMPV::RenderParam params[] = {
+            { LibMPV::kRenderParamOpenGlFbo, &target },
+            { LibMPV::kRenderParamFlipY, &flipY },
+            { LibMPV::kRenderParamInvalid, nullptr },
+        };
+        libmpv->render_context_render(renderContext, params);
+    }
+
+    void drawFramebufferForBrowserPreview() override
+    {
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+
+private:
+    static void* getProcAddress(void*, const char* const name)
+    {
+        return reinterpret_cast<void*>(glXGetProcAddressARB(reinterpret_cast<const GLubyte*>(name)));
+    }
+
+    static void updateCallback(void* const ptr)
+    {
+        static_cast<MPVRenderWidget*>(ptr)->frameGeneration.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // called with the GL context current, before the first video is loaded
+    void create()
+    {
+        handle = libmpv->create();
+        DISTRHO_SAFE_ASSERT_RETURN(handle != nullptr,);
+
+        libmpv->set_option_string(handle, "vo", "libmpv");
+        libmpv->set_option_string(handle, "aid", "no");
+        libmpv->set_option_string(handle, "hwdec", "auto-safe");
+
+        if (libmpv->initialize(handle) < 0)
+        {
+            d_stderr2("Failed to initialize libmpv");
+            destroy();
+            return;
+        }
+
+        // lets mpv share hardware decoded frames with OpenGL through VAAPI or VDPAU
+        Display* const display = glXGetCurrentDisplay();
+        const char* const apiType = "opengl";
+        LibMPV::OpenGlInitParams glParams = { getProcAddress, nullptr, nullptr };
+        LibMPV::RenderParam params[] = {
+            { LibMPV::kRenderParamApiType, const_cast<char*>(apiType) },
+            { LibMPV::kRenderParamOpenGlInitParams, &glParams },
+            { display != nullptr ? LibMPV::kRenderParamX11Display : LibMPV::kRenderParamInvalid, display },
+            { LibMPV::kRenderParamInvalid, nullptr },
+        };
+
+        if (libmpv->render_context_create(&renderContext, handle, params) < 0)
+        {
+            d_stderr2("Failed to create libmpv render context");
+            renderContext = nullptr;
+            destroy();
+            return;
+        }
+
+        libmpv->render_context_set_update_callback(renderContext, updateCallback, this);
+    }
+
+    void destroy()
+    {
+        if (renderContext != nullptr)
+        {
+            libmpv->render_context_free(renderContext);
+            renderContext = nullptr;
+        }
+
+        if (handle != nullptr)
+        {
+            libmpv->terminate_destroy(handle);
+            handle = nullptr;
+        }
+    }
+};
+
 struct CardinalEmbedWidget : ModuleWidget, ExternalWindow {
     CardinalEmbedModule* const module;
     CardinalPluginContext* const pcontext;
     EmbedWidget* embedWidget = nullptr;
+    MPVRenderWidget* renderWidget = nullptr;
     bool isEmbed = false;
     bool videoIsLoaded = false;
 
@@ -75,8 +316,17 @@ struct CardinalEmbedWidget : ModuleWidget, ExternalWindow {
 
         if (m != nullptr)
         {
-            embedWidget = new EmbedWidget(box.size);
-            addChild(embedWidget);
+            if (const LibMPV* const libmpv = LibMPV::get())
+            {
+                renderWidget = new MPVRenderWidget(libmpv);
+                renderWidget->box.size = box.size;
+                addChild(renderWidget);
+            }
+            else
+            {
+                embedWidget = new EmbedWidget(box.size);
+                addChild(embedWidget);
+            }
         }
     }
 
@@ -87,7 +337,7 @@ struct CardinalEmbedWidget : ModuleWidget, ExternalWindow {
 
     void onAdd(const AddEvent&) override
     {
-        if (isEmbed)
+        if (isEmbed || renderWidget != nullptr)
             return;
 
         ContextCreateEvent ce;
@@ -107,7 +357,7 @@ struct CardinalEmbedWidget : ModuleWidget, ExternalWindow {
     {
         ModuleWidget::onContextCreate(e);
 
-        if (module == nullptr)
+        if (module == nullptr || renderWidget != nullptr)
             return;
 
         DISTRHO_SAFE_ASSERT_RETURN(module != nullptr,);
@@ -124,7 +374,7 @@ struct CardinalEmbedWidget : ModuleWidget, ExternalWindow {
     {
         ModuleWidget::onContextDestroy(e);
 
-        if (module == nullptr)
+        if (module == nullptr || renderWidget != nullptr)
             return;
 
         DISTRHO_SAFE_ASSERT_RETURN(module != nullptr,);
@@ -173,7 +423,12 @@ struct CardinalEmbedWidget : ModuleWidget, ExternalWindow {
                     if (path == nullptr)
                         return;
 
-                    if (self != nullptr)
+                    if (self != nullptr && self->renderWidget != nullptr)
+                    {
+                        self->videoIsLoaded = true;
+                        self->renderWidget->loadFile(path);
+                    }
+                    else if (self != nullptr)
                     {
                         char winIdStr[64];
                         std::snprintf(winIdStr, sizeof(winIdStr), "--wid=%lu",
@@ -0,0 +1,157 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include "plugin.hpp"
+
+// Min/max envelope of a scope capture ring, for drawing long timebases as one min/max pair per pixel column.
+// The audio thread keeps the extremes of every block of kBlockSize samples as it writes them,
+// so a column spanning many blocks only scans raw samples at its edges.
+struct ScopeEnvelope {
+    static const constexpr int kBlockSize = 64;
+
+    int size = 0;
+    int numBlocks = 0;
+    float* blockMin = nullptr;
+    float* blockMax = nullptr;
+
+    ~ScopeEnvelope()
+    {
+        delete[] blockMin;
+        delete[] blockMax;
+    }
+
+    // size of the ring this envelope follows, the last block may be shorter than the others
+    void realloc(const int newSize)
+    {
+        delete[] blockMin;
+        delete[] blockMax;
+
+        size = newSize;
+        numBlocks = (newSize + kBlockSize - 1) / kBlockSize;
+        blockMin = new float[numBlocks];
+        blockMax = new float[numBlocks];
+        std::memset(blockMin, 0, sizeof(float) * numBlocks);
+        std::memset(blockMax, 0, sizeof(float) * numBlocks);
+    }
+
+    // audio thread, called along with every write to the ring
+    inline void write(const int index, const float value)
+    {
+        const int block = index / kBlockSize;
+
+        if (index % kBlockSize == 0)
+        {
+            blockMin[block] = blockMax[block] = value;
+        }
+        else
+        {
+            blockMin[block] = std::min(blockMin[block], value);
+            blockMax[block] = std::max(blockMax[block], value);
+        }
+    }
+
+    // extremes of count samples of the ring starting at start, which may be negative or past the end.
+    // the block at writeIndex is still being refilled, its samples are always read from the ring
+    void getRange(const float* const data, const int start, const int count, const int writeIndex,
+                  float& min, float& max) const
+    {
+        min = INFINITY;
+        max = -INFINITY;
+
+        if (count <= 0 || size == 0)
+            return;
+
+        const int writeBlock = writeIndex / kBlockSize;
+        const int first = ((start % size) + size) % size;
+        const int firstCount = std::min(count, size - first);
+
+        accumulateSegment(data, first, first + firstCount, writeBlock, min, max);
+
+        // wrapped around the ring
+        for (int remaining = count - firstCount; remaining > 0; remaining -= size)
+            accumulateSegment(data, 0, std::min(remaining, size), writeBlock, min, max);
+    }
+
+    // one min/max pair per column, over count samples of the ring starting at start
+    void decimate(const float* const data, const int start, const int count, const int writeIndex,
+                  const int columns, float* const mins, float* const maxs) const
+    {
+        for (int i = 0; i < columns; ++i)
+        {
+            const int begin = static_cast<int>(static_cast<int64_t>(count) * i / columns);
+            const int end = static_cast<int>(static_cast<int64_t>(count) * (i + 1) / columns);
+            getRange(data, start + begin, std::max(1, end - begin), writeIndex, mins[i], maxs[i]);
+        }
+    }
+
+private:
+    // [start, end) without wrapping, whole blocks read from the envelope and partial ones from the ring
+    void accumulateSegment(const float* const data, int start, const int end, const int writeBlock,
+                           float& min, float& max) const
+    {
+        while (start < end)
+        {
+            const int block = start / kBlockSize;
+            const int blockEnd = std::min((block + 1) * kBlockSize, size);
+
+            if (start == block * kBlockSize && blockEnd <= end && block != writeBlock)
+            {
+                int last = end == size ? numBlocks : end / kBlockSize;
+                if (writeBlock > block && writeBlock < last)
+                    last = writeBlock;
+
+                accumulate(blockMin + block, blockMax + block, last - block, min, max);
+                start = std::min(last * kBlockSize, size);
+            }
+            else
+            {
+                const int rawEnd = std::min(blockEnd, end);
+                accumulate(data + start, data + start, rawEnd - start, min, max);
+                start = rawEnd;
+            }
+        }
+    }
+
+    static void accumulate(const float* const mins, const float* const maxs, const int count,
+                           float& min, float& max)
+    {
+        int i = 0;
+
+        if (count >= 4)
+        {
+            simd::float_4 vmin = simd::float_4::load(mins);
+            simd::float_4 vmax = simd::float_4::load(maxs);
+
+            for (i = 4; i + 4 <= count; i += 4)
+            {
+                vmin = simd::fmin(vmin, simd::float_4::load(mins + i));
+                vmax = simd::fmax(vmax, simd::float_4::load(maxs + i));
+            }
+
+            min = std::min(min, std::min(std::min(vmin[0], vmin[1]), std::min(vmin[2], vmin[3])));
+            max = std::max(max, std::max(std::max(vmax[0], vmax[1]), std::max(vmax[2], vmax[3])));
+        }
+
+        for (; i < count; ++i)
+        {
+            min = std::min(min, mins[i]);
+            max = std::max(max, maxs[i]);
+        }
+    }
+};
@@ -144,18 +144,16 @@ struct TextEditorModule : Module {
         }
     }
 
-    bool loadFileFromMenuAction(const char* const filepath)
+    // called from a background thread, see TextEditorModuleWidget::loadFile
+    static bool readTextFile(const std::string& filepath, std::string& text)
     {
         std::ifstream f(filepath);
 
-        if (f.good())
-        {
-            file = filepath;
-            text = std::string((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
-            return true;
-        }
+        if (! f.good())
+            return false;
 
-        return false;
+        text = std::string((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        return true;
     }
 };
 
@@ -219,35 +217,18 @@ struct TextEditorLangSelectMenuItem : MenuItem {
 
 // --------------------------------------------------------------------------------------------------------------------
 
+struct TextEditorModuleWidget;
+
 struct TextEditorLoadFileItem : MenuItem {
-    TextEditorModule* const module;
-    ImGuiTextEditor* const widget;
+    TextEditorModuleWidget* const moduleWidget;
 
-    TextEditorLoadFileItem(TextEditorModule* const textEditorModule, ImGuiTextEditor* const textEditorWidget)
-        : module(textEditorModule),
-          widget(textEditorWidget)
+    TextEditorLoadFileItem(TextEditorModuleWidget* const textEditorModuleWidget)
+        : moduleWidget(textEditorModuleWidget)
     {
         text = "Load text file...";
     }
 
-    void onAction(const event::Action&) override
-    {
-        TextEditorModule* const module = this->module;;
-        WeakPtr<ImGuiTextEditor> widget = this->widget;
-
-        async_dialog_filebrowser(false, nullptr, nullptr, text.c_str(), [module, widget](char* path)
-        {
-            if (path)
-            {
-                if (module->loadFileFromMenuAction(path))
-                {
-                    if (widget)
-                        widget->setFileWithKnownText(module->file, module->text);
-                }
-                free(path);
-            }
-        });
-    }
+    void onAction(const event::Action&) override;
 };
 
 // --------------------------------------------------------------------------------------------------------------------
@@ -338,6 +319,14 @@ struct TextEditorModuleWidget : ModuleWidget {
     Widget* panelBorder;
     ModuleResizeHandle* rightHandle;
 
+    // large files are read in the background, the editor gets the text on the next frame after that
+    struct LoadedFile {
+        std::string path;
+        std::string text;
+        bool ok = false;
+    };
+    background::Result<LoadedFile> fileLoad;
+
     TextEditorModuleWidget(TextEditorModule* const module)
     {
         setModule(module);
@@ -366,8 +355,26 @@ struct TextEditorModuleWidget : ModuleWidget {
         }
     }
 
+    void loadFile(const std::string& path)
+    {
+        fileLoad.prepare([path]() {
+            LoadedFile loaded;
+            loaded.path = path;
+            loaded.ok = TextEditorModule::readTextFile(path, loaded.text);
+            return loaded;
+        });
+    }
+
     void step() override
     {
+        LoadedFile loaded;
+        if (textEditorModule && fileLoad.poll(loaded) && loaded.ok)
+        {
+            textEditorModule->file = loaded.path;
+            textEditorModule->text = std::move(loaded.text);
+            textEditorWidget->setFileWithKnownText(textEditorModule->file, textEditorModule->text);
+        }
+
         if (textEditorModule)
         {
             box.size.x = textEditorModule->width * RACK_GRID_WIDTH;
@@ -393,7 +400,7 @@ struct TextEditorModuleWidget : ModuleWidget {
     void appendContextMenu(Menu* const menu) override
     {
         menu->addChild(new MenuSeparator);
-        menu->addChild(new TextEditorLoadFileItem(textEditorModule, textEditorWidget));
+        menu->addChild(new TextEditorLoadFileItem(this));
         menu->addChild(new TextEditorLangSelectMenuItem(textEditorModule, textEditorWidget));
 
         menu->addChild(new ui::MenuSeparator);
@@ -415,6 +422,21 @@ struct TextEditorModuleWidget : ModuleWidget {
 
     DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TextEditorModuleWidget)
 };
+
+void TextEditorLoadFileItem::onAction(const event::Action&)
+{
+    WeakPtr<TextEditorModuleWidget> moduleWidget = this->moduleWidget;
+
+    async_dialog_filebrowser(false, nullptr, nullptr, text.c_str(), [moduleWidget](char* path)
+    {
+        if (path)
+        {
+            if (moduleWidget)
+                moduleWidget->loadFile(path);
+            free(path);
+        }
+    });
+}
 #else
 struct TextEditorModuleWidget : ModuleWidget {
     TextEditorModuleWidget(TextEditorModule* const module) {
@@ -360,10 +360,57 @@ struct NanoMeter : Widget {
 };
 
 struct OpenGlWidgetWithBrowserPreview : OpenGlWidget {
+    enum AnimationMode {
+        // render every frame
+        kAnimationContinuous,
+        // render when dataGeneration changes, or while isAnimating()
+        kAnimationOnData,
+        // render only when marked dirty
+        kAnimationStatic
+    };
+
     NVGLUframebuffer* fb = nullptr;
+    AnimationMode animationMode = kAnimationContinuous;
+    // bumped by the module whenever it has something new to show, may be changed from any thread
+    const std::atomic<uint32_t>* dataGeneration = nullptr;
+    uint32_t lastDataGeneration = 0;
+    // frames stepped since the widget was last drawn, widgets outside the view are not drawn
+    uint32_t framesSinceDraw = 0;
+
+    void step() override
+    {
+        // keep the previous frame while off screen, changes are picked up once drawn again
+        if (++framesSinceDraw <= 2)
+        {
+            switch (animationMode)
+            {
+            case kAnimationContinuous:
+                setDirty(true);
+                break;
+            case kAnimationOnData:
+                if (dataGeneration != nullptr && dataGeneration->load(std::memory_order_relaxed) != lastDataGeneration)
+                {
+                    lastDataGeneration = dataGeneration->load(std::memory_order_relaxed);
+                    setDirty(true);
+                }
+                else if (isAnimating())
+                {
+                    setDirty(true);
+                }
+                break;
+            case kAnimationStatic:
+                break;
+            }
+        }
+
+        // skip OpenGlWidget::step, which renders every frame
+        FramebufferWidget::step();
+    }
 
     void draw(const DrawArgs& args) override
     {
+        framesSinceDraw = 0;
+
         if (args.fb == nullptr)
             return OpenGlWidget::draw(args);
 
@@ -409,6 +456,12 @@ struct OpenGlWidgetWithBrowserPreview : OpenGlWidget {
         fb = nullptr;
     }
 
+    // for kAnimationOnData, whether rendering should go on without new data, like for a transition
+    virtual bool isAnimating()
+    {
+        return false;
+    }
+
     virtual void drawFramebufferForBrowserPreview() = 0;
 };
 #endif
@@ -69,8 +69,20 @@ struct glBarsRendererWidget : OpenGlWidgetWithBrowserPreview {
     glBarsRendererWidget(glBarsModule* const module)
         : glBars(module)
     {
-        if (glBars != nullptr && APP->window->pixelRatio < 2.0f)
+        if (glBars == nullptr)
+            return;
+
+        if (APP->window->pixelRatio < 2.0f)
             oversample = 2.0f;
+
+        // bars only move after new audio, until they reach its heights
+        animationMode = kAnimationOnData;
+        dataGeneration = &glBars->state.generation;
+    }
+
+    bool isAnimating() override
+    {
+        return glBars != nullptr && glBars->state.IsAnimating();
     }
 
     void draw(const DrawArgs&) override
@@ -123,7 +135,7 @@ struct glBarsRendererWidget : OpenGlWidgetWithBrowserPreview {
 
     void step() override
     {
-        OpenGlWidget::step();
+        OpenGlWidgetWithBrowserPreview::step();
 
         if (glBars != nullptr)
             oversample = APP->window->pixelRatio < 2.0f ? 2.0f : 1.0f;
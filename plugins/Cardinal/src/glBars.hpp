@@ -22,52 +22,115 @@
 
 #include "plugin.hpp"
 
+// Bars are drawn from vertex arrays in a single call, with their layout and colors built once.
+// Only the bar heights change, so each frame scales the height of a unit bar layout in place.
+// This stays within fixed-function OpenGL, which is all glBars gets on the desktop.
+
+static constexpr const int kNumBars = 16 * 16;
+static constexpr const int kNumBarVertices = 3 * 6; // left, right and top faces
+static constexpr const int kNumVertices = kNumBars * kNumBarVertices;
+
+static inline
+void add_vertex(GLfloat*& vertex, GLfloat x, GLfloat y, GLfloat z)
+{
+    *vertex++ = x;
+    *vertex++ = y;
+    *vertex++ = z;
+}
+
 static inline
-void draw_rectangle(GLfloat x1, GLfloat y1, GLfloat z1, GLfloat x2, GLfloat y2, GLfloat z2)
+void add_rectangle(GLfloat*& vertex, GLfloat x1, GLfloat y1, GLfloat z1, GLfloat x2, GLfloat y2, GLfloat z2)
 {
     if (y1 == y2)
     {
-        glVertex3f(x1, y1, z1);
-        glVertex3f(x2, y1, z1);
-        glVertex3f(x2, y2, z2);
+        add_vertex(vertex, x1, y1, z1);
+        add_vertex(vertex, x2, y1, z1);
+        add_vertex(vertex, x2, y2, z2);
 
-        glVertex3f(x2, y2, z2);
-        glVertex3f(x1, y2, z2);
-        glVertex3f(x1, y1, z1);
+        add_vertex(vertex, x2, y2, z2);
+        add_vertex(vertex, x1, y2, z2);
+        add_vertex(vertex, x1, y1, z1);
     }
     else
     {
-        glVertex3f(x1, y1, z1);
-        glVertex3f(x2, y1, z2);
-        glVertex3f(x2, y2, z2);
+        add_vertex(vertex, x1, y1, z1);
+        add_vertex(vertex, x2, y1, z2);
+        add_vertex(vertex, x2, y2, z2);
 
-        glVertex3f(x2, y2, z2);
-        glVertex3f(x1, y2, z1);
-        glVertex3f(x1, y1, z1);
+        add_vertex(vertex, x2, y2, z2);
+        add_vertex(vertex, x1, y2, z1);
+        add_vertex(vertex, x1, y1, z1);
     }
 }
 
 static inline
-void draw_bar(GLfloat x_offset, GLfloat z_offset, GLfloat height, GLfloat red, GLfloat green, GLfloat blue)
+void add_face_color(GLfloat*& color, GLfloat red, GLfloat green, GLfloat blue)
+{
+    for (int i = 0; i < 6; ++i)
+        add_vertex(color, red, green, blue);
+}
+
+static inline
+void add_bar(GLfloat*& vertex, GLfloat*& color,
+             GLfloat x_offset, GLfloat z_offset, GLfloat red, GLfloat green, GLfloat blue)
 {
     static constexpr const GLfloat width = 0.1;
 
+    // unit height, scaled by the bar height when rendering
+
     // left
-    glColor3f(0.25 * red, 0.25 * green, 0.25 * blue);
-    draw_rectangle(x_offset, 0.0, z_offset , x_offset, height, z_offset + 0.1);
+    add_face_color(color, 0.25 * red, 0.25 * green, 0.25 * blue);
+    add_rectangle(vertex, x_offset, 0.0, z_offset , x_offset, 1.0, z_offset + 0.1);
 
     // right
-    glColor3f(0.5 * red, 0.5 * green, 0.5 * blue);
-    draw_rectangle(x_offset, 0.0, z_offset + 0.1, x_offset + width, height, z_offset + 0.1);
+    add_face_color(color, 0.5 * red, 0.5 * green, 0.5 * blue);
+    add_rectangle(vertex, x_offset, 0.0, z_offset + 0.1, x_offset + width, 1.0, z_offset + 0.1);
 
     // top
-    glColor3f(red, green, blue);
-    draw_rectangle(x_offset, height, z_offset, x_offset + width, height, z_offset + 0.1);
+    add_face_color(color, red, green, blue);
+    add_rectangle(vertex, x_offset, 1.0, z_offset, x_offset + width, 1.0, z_offset + 0.1);
 }
 
+struct glBarsGeometry {
+    GLfloat vertices[kNumVertices * 3];
+    GLfloat colors[kNumVertices * 3];
+
+    glBarsGeometry()
+    {
+        GLfloat* vertex = vertices;
+        GLfloat* color = colors;
+
+        // back to front, there is no depth test
+        for (int y = 16; --y >= 0;)
+        {
+            const GLfloat z_offset = -1.6 + ((15 - y) * 0.2);
+
+            const GLfloat b_base = y * (1.0 / 15);
+            const GLfloat r_base = 1.0 - b_base;
+
+            for (int x = 16; --x >= 0;)
+            {
+                const GLfloat x_offset = -1.6 + ((float)x * 0.2);
+
+                add_bar(vertex, color, x_offset, z_offset,
+                        r_base - (float(x) * (r_base / 15.0)), (float)x * (1.0 / 15), b_base);
+            }
+        }
+    }
+
+    static const glBarsGeometry& get()
+    {
+        static const glBarsGeometry geometry;
+        return geometry;
+    }
+};
+
 struct glBarsState {
     GLfloat heights[16][16], cHeights[16][16], scale;
     GLfloat hSpeed;
+    GLfloat vertices[kNumVertices * 3];
+    // bumped on every audio update, so the renderer knows there is something new to show
+    std::atomic<uint32_t> generation{0};
 
     glBarsState()
     {
@@ -89,9 +152,26 @@ struct glBarsState {
         std::memset(cHeights, 0, sizeof(cHeights));
     }
 
+    // whether bars are still moving towards their latest heights
+    bool IsAnimating() const
+    {
+        for (int y = 0; y < 16; ++y)
+        {
+            for (int x = 0; x < 16; ++x)
+            {
+                if (::fabs(cHeights[y][x]-heights[y][x])>hSpeed)
+                    return true;
+            }
+        }
+
+        return false;
+    }
+
     void Render()
     {
-        GLfloat x_offset, z_offset, r_base, b_base;
+        const glBarsGeometry& geometry(glBarsGeometry::get());
+        const GLfloat* unitVertex = geometry.vertices;
+        GLfloat* vertex = vertices;
 
         glPushMatrix();
         glTranslatef(0.0,0.25,-4.0);
@@ -99,18 +179,11 @@ struct glBarsState {
         glRotatef(45,0.0,1.0,0.0);
 
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        glBegin(GL_TRIANGLES);
 
         for (int y = 16; --y >= 0;)
         {
-            z_offset = -1.6 + ((15 - y) * 0.2);
-
-            b_base = y * (1.0 / 15);
-            r_base = 1.0 - b_base;
-
             for (int x = 16; --x >= 0;)
             {
-                x_offset = -1.6 + ((float)x * 0.2);
                 if (::fabs(cHeights[y][x]-heights[y][x])>hSpeed)
                 {
                   if (cHeights[y][x]<heights[y][x])
@@ -119,13 +192,25 @@ struct glBarsState {
                       cHeights[y][x] -= hSpeed;
                 }
 
-                draw_bar(x_offset, z_offset,
-                         cHeights[y][x], r_base - (float(x) * (r_base / 15.0)),
-                         (float)x * (1.0 / 15), b_base /*, 16*y+x*/);
+                const GLfloat height = cHeights[y][x];
+
+                for (int i = 0; i < kNumBarVertices; ++i, unitVertex += 3, vertex += 3)
+                {
+                    vertex[0] = unitVertex[0];
+                    vertex[1] = unitVertex[1] * height;
+                    vertex[2] = unitVertex[2];
+                }
             }
         }
 
-        glEnd();
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glVertexPointer(3, GL_FLOAT, 0, vertices);
+        glColorPointer(3, GL_FLOAT, 0, geometry.colors);
+        glDrawArrays(GL_TRIANGLES, 0, kNumVertices);
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+
         glPopMatrix();
     }
 
@@ -134,11 +219,15 @@ struct glBarsState {
         const int xscale[] = {0, 1, 2, 3, 5, 7, 10, 14, 20, 28, 40, 54, 74, 101, 137, 187, 255};
 
         GLfloat val;
+        bool changed = false;
 
         for (int y = 15; y > 0; y--)
         {
             for (int i = 0; i < 16; i++)
+            {
+                changed = changed || heights[y][i] != heights[y - 1][i];
                 heights[y][i] = heights[y - 1][i];
+            }
         }
 
         for (int i = 0; i < 16; i++)
@@ -161,8 +250,13 @@ struct glBarsState {
                 val = (logf(y) * scale);
             else
                 val = 0;
+            changed = changed || heights[0][i] != val;
             heights[0][i] = val;
         }
+
+        // silence keeps the same heights, nothing to redraw
+        if (changed)
+            generation.fetch_add(1, std::memory_order_relaxed);
     }
 };
 
@@ -18,6 +18,10 @@
 #pragma once
 
 #include "rack.hpp"
+#include "engine/BlockModule.hpp"
+#include "engine/ModuleFreeRunning.hpp"
+#include "engine/ModuleLatency.hpp"
+#include "engine/ModuleSampleRateCoefficients.hpp"
 #include "engine/TerminalModule.hpp"
 
 #ifdef NDEBUG
@@ -50,6 +50,12 @@ enum CardinalVariant {
 class Plugin;
 class UI;
 
+enum CardinalIdlePriority {
+    kIdlePriorityLow = -1,
+    kIdlePriorityNormal = 0,
+    kIdlePriorityHigh = 1,
+};
+
 struct MidiEvent {
     static const uint32_t kDataSize = 4;
     uint32_t frame;
@@ -59,9 +65,11 @@ struct MidiEvent {
 };
 
 struct CardinalPluginContext : rack::Context {
-    uint32_t bufferSize, processCounter;
+    uint32_t bufferSize, processCounter, oversampling;
     double sampleRate;
     float parameters[kModuleParameters];
+    // bit per parameter changed by the host since the previous engine block, set when the block starts
+    uint32_t parametersChangedMask;
     CardinalVariant variant;
     bool bypassed, playing, reset, bbtValid;
     int32_t bar, beat, beatsPerBar, beatType;
@@ -71,8 +79,16 @@ struct CardinalPluginContext : rack::Context {
     uintptr_t nativeWindowId;
     const float* const* dataIns;
     float** dataOuts;
+    uint32_t dataInsUsed, dataOutsWritten;
     const MidiEvent* midiEvents;
     uint32_t midiEventCount;
+    // host MIDI events of the block per channel filter, [0] for all channels and [1-16] for a single one.
+    // system messages are part of every channel. null when the block had too many events to bucket.
+    const MidiEvent* const* midiChannelEvents[17];
+    uint32_t midiChannelEventCount[17];
+    // MIDI output of the current block, sent to the host at the end of run() when the plugin provides storage
+    MidiEvent* midiOutEvents;
+    uint32_t midiOutEventCount, midiOutEventCapacity, midiOutFrameOffset;
     Plugin* const plugin;
 #ifndef HEADLESS
     DGL_NAMESPACE::NanoTopLevelWidget* tlw;
@@ -82,10 +98,139 @@ struct CardinalPluginContext : rack::Context {
     void writeMidiMessage(const rack::midi::Message& message, uint8_t channel);
 #ifndef HEADLESS
     bool addIdleCallback(IdleCallback* cb) const;
+    bool addIdleCallback(IdleCallback* cb, double rate, int priority, rack::widget::Widget* widget) const;
     void removeIdleCallback(IdleCallback* cb) const;
 #endif
 };
 
+// -----------------------------------------------------------------------------------------------------------
+// Host audio channels used by terminal modules, as bitmasks in the context.
+// The plugin only copies the host inputs that were ever read, and does not clear the outputs before a block.
+// The first module to write an output within a block claims it, and must then write it directly on every frame.
+
+static inline void markHostInputsUsed(CardinalPluginContext* const pcontext, const uint32_t first, const uint32_t count)
+{
+    pcontext->dataInsUsed |= ((1u << count) - 1) << first;
+}
+
+static inline bool claimHostOutput(CardinalPluginContext* const pcontext, const uint32_t index)
+{
+    const uint32_t bit = 1u << index;
+
+    if (pcontext->dataOutsWritten & bit)
+        return false;
+
+    pcontext->dataOutsWritten |= bit;
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------
+// Host MIDI events of the current block for a module channel filter, with 0 meaning all channels.
+// The plugin buckets events per channel once per block, so modules listening to one channel never see the others.
+// Blocks with more events than the buckets hold have no buckets, their events are filtered from the full list here.
+
+struct HostMidiEvents {
+    const MidiEvent* const* bucket = nullptr;
+    const MidiEvent* events = nullptr;
+    uint32_t left = 0;
+    uint8_t channel = 0;
+
+    void startBlock(const CardinalPluginContext* const pcontext, const uint8_t newChannel)
+    {
+        channel = newChannel <= 16 ? newChannel : 0;
+        bucket = pcontext->midiChannelEvents[channel];
+
+        if (bucket != nullptr)
+        {
+            events = nullptr;
+            left = pcontext->midiChannelEventCount[channel];
+        }
+        else
+        {
+            events = pcontext->midiEvents;
+            left = pcontext->midiEventCount;
+        }
+    }
+
+    void clear()
+    {
+        bucket = nullptr;
+        events = nullptr;
+        left = 0;
+    }
+
+    // next event of the block for the channel filter, without taking it, or null if there are no more
+    const MidiEvent* peek()
+    {
+        if (bucket != nullptr)
+            return left != 0 ? *bucket : nullptr;
+
+        for (; left != 0; ++events, --left)
+        {
+            if (events->size == 0)
+                continue;
+            if (channel == 0)
+                return events;
+
+            // system messages go to every channel
+            const uint8_t status = events->size > MidiEvent::kDataSize ? events->dataExt[0] : events->data[0];
+            if (status >= 0xF0 || (status & 0x0F) + 1 == channel)
+                return events;
+        }
+
+        return nullptr;
+    }
+
+    void pop()
+    {
+        if (bucket != nullptr)
+            ++bucket;
+        else
+            ++events;
+        --left;
+    }
+};
+
+// -----------------------------------------------------------------------------------------------------------
+// Host parameter values as seen by a terminal module, updated once per engine block.
+// DPF gives parameter changes no frame offset, so frame accurate delivery is not possible:
+// every change made before a block applies from its first frame.
+
+struct HostParameterValues {
+    float values[kModuleParameters];
+    uint32_t processCounter = 0;
+
+    void reset(const CardinalPluginContext* const pcontext)
+    {
+        std::memcpy(values, pcontext->parameters, sizeof(values));
+        processCounter = pcontext->processCounter;
+    }
+
+    // returns the mask of parameters changed since the previous block
+    uint32_t startBlock(const CardinalPluginContext* const pcontext)
+    {
+        // only parameters the host changed are looked at, unless blocks were missed since the last one
+        uint32_t checkMask = pcontext->parametersChangedMask;
+        if (pcontext->processCounter != processCounter + 1)
+            checkMask = (1u << kModuleParameters) - 1;
+        processCounter = pcontext->processCounter;
+
+        uint32_t changedMask = 0;
+        for (uint32_t mask = checkMask; mask != 0; mask &= mask - 1)
+        {
+            const uint32_t i = __builtin_ctz(mask);
+
+            if (d_isEqual(values[i], pcontext->parameters[i]))
+                continue;
+
+            values[i] = pcontext->parameters[i];
+            changedMask |= 1u << i;
+        }
+
+        return changedMask;
+    }
+};
+
 #ifndef HEADLESS
 void handleHostParameterDrag(const CardinalPluginContext* pcontext, uint index, bool started);
 #endif
@@ -40,7 +40,13 @@
 
 #pragma once
 
-#include "fftreal/FFTReal.h"
+#include "../ScopeEnvelope.hpp"
+
+#include <pffft.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
 
 // int gFFTAverage = 1;
 // int gSamplerate;
@@ -48,7 +54,8 @@
 // // gScope
 
 struct ScopeData {
-    int mIndex = 0;
+    // write position of the capture ring, written by the audio thread only
+    std::atomic<int> mIndex{0};
     int mSampleRate = 0;
     float mScroll = 0;
     float mTimeScale = 0.01f;
@@ -60,9 +67,6 @@ struct ScopeData {
     int mFFTZoom = 0;
     int mPot = 0;
     bool darkMode = true;
-    float fft1[65536 * 2];
-    float fft2[65536 * 2];
-    float ffta[65536 * 2];
     unsigned int colors[4] = {
         0xffc0c0c0,
         0xffa0a0ff,
@@ -76,6 +80,8 @@ struct ScopeData {
         int mScaleSlider = 0;
         float mOffset = 0;
         float* mData = nullptr;
+        // min/max summary of mData for the time display, written along with it
+        ScopeEnvelope mEnvelope;
 
         ~Channel()
         {
@@ -86,26 +92,42 @@ struct ScopeData {
         {
             mData = new float[sampleRate * 10];
             memset(mData, 0, sizeof(float) * sampleRate * 10);
+            mEnvelope.realloc(sampleRate * 10);
         }
     } mCh[4];
 
     struct {
-        int average;
-        ffft::FFTReal<float>* obj16;
-        ffft::FFTReal<float>* obj32;
-        ffft::FFTReal<float>* obj64;
-        ffft::FFTReal<float>* obj128;
-        ffft::FFTReal<float>* obj256;
-        ffft::FFTReal<float>* obj512;
-        ffft::FFTReal<float>* obj1024;
-        ffft::FFTReal<float>* obj2048;
-        ffft::FFTReal<float>* obj4096;
-        ffft::FFTReal<float>* obj8192;
-        ffft::FFTReal<float>* obj16384;
-        ffft::FFTReal<float>* obj32768;
-        ffft::FFTReal<float>* obj65536;
+        int average = 1;
     } fft;
 
+    // averaged magnitudes of the enabled channels, for the fft size and averaging they were computed with
+    struct Spectrum {
+        int pot = 0;
+        int average = 0;
+        std::vector<float> mags[4];
+    };
+    // computed in the background from a copy of the captured samples, the frequency display draws the last one done
+    rack::background::Result<Spectrum> spectrumResult;
+    Spectrum spectrum;
+
+    // twiddle tables depend only on the size, so all scopes share one setup per power of two
+    static PFFFT_Setup* getSharedFFTSetup(const int size)
+    {
+        static std::mutex mutex;
+        static PFFFT_Setup* setups[32] = {};
+
+        int bit = 0;
+        while ((1 << bit) < size)
+            ++bit;
+
+        const std::lock_guard<std::mutex> lock(mutex);
+
+        if (setups[bit] == nullptr)
+            setups[bit] = pffft_new_setup(size, PFFFT_REAL);
+
+        return setups[bit];
+    }
+
     void realloc(const int sampleRate)
     {
         mIndex = 0;
@@ -115,16 +137,25 @@ struct ScopeData {
             mCh[i].realloc(sampleRate);
     }
 
+    // the only work done on the audio thread, triggering and analysis happen while drawing
     inline void probe(float data1, float data2, float data3, float data4)
     {
         // since probe has several channels, need to deal with index here
         if (mMode == 0)
         {
-            mCh[0].mData[mIndex] = data1;
-            mCh[1].mData[mIndex] = data2;
-            mCh[2].mData[mIndex] = data3;
-            mCh[3].mData[mIndex] = data4;
-            mIndex = (mIndex + 1) % (mSampleRate * 10);
+            int index = mIndex.load(std::memory_order_relaxed);
+            mCh[0].mData[index] = data1;
+            mCh[1].mData[index] = data2;
+            mCh[2].mData[index] = data3;
+            mCh[3].mData[index] = data4;
+            mCh[0].mEnvelope.write(index, data1);
+            mCh[1].mEnvelope.write(index, data2);
+            mCh[2].mEnvelope.write(index, data3);
+            mCh[3].mEnvelope.write(index, data4);
+            if (++index == mSampleRate * 10)
+                index = 0;
+            // publish the samples to the UI thread together with the new position
+            mIndex.store(index, std::memory_order_release);
         }
     }
 };
@@ -40,6 +40,8 @@
 
 #include "sassy.hpp"
 
+#include <array>
+
 #define POW_2_3_4TH 1.6817928305074290860622509524664297900800685247135690216264521719
 
 static double catmullrom(double t, double p0, double p1, double p2, double p3)
@@ -272,41 +274,39 @@ static void scope_time(ScopeData* gScope, const float uiScale, int index)
         {
             if (gScope->mCh[j].mEnabled)
             {
-                float* graphdata = gScope->mCh[j].mData;
-                ImVec2 vert[grid_size];
+                // one min/max pair per pixel, so peaks between pixels are not lost at long timebases
+                float mins[grid_size];
+                float maxs[grid_size];
+                gScope->mCh[j].mEnvelope.decimate(gScope->mCh[j].mData, index - ofs, samples, index,
+                                                  grid_size, mins, maxs);
+
+                ImVec2 upper[grid_size];
+                ImVec2 lower[grid_size];
                 for (int i = 0; i < grid_size; i++)
                 {
-                    float v0 = -graphdata[(index - ofs + i * samples / grid_size + cycle) % cycle];
-                    float v1 = -graphdata[(index - ofs + (i + 1) * samples / grid_size + cycle) % cycle];
+                    float v0 = -maxs[i];
+                    float v1 = -mins[i];
                     v0 = v0 * gScope->mCh[j].mScale - gScope->mCh[j].mOffset;
                     v1 = v1 * gScope->mCh[j].mScale - gScope->mCh[j].mOffset;
-                    vert[i].x = p.x + i * uiScale;
-                    vert[i].y = p.y + (grid_size / 2 + v0 * grid_quarter_size) * uiScale;
+                    upper[i] = ImVec2(p.x + i * uiScale, p.y + (grid_size / 2 + v0 * grid_quarter_size) * uiScale);
+                    lower[i] = ImVec2(p.x + i * uiScale, p.y + (grid_size / 2 + v1 * grid_quarter_size) * uiScale);
                 }
-                float v0 = p.y + (grid_size / 2 + (-gScope->mCh[j].mOffset) * grid_quarter_size) * uiScale;
                 dl->Flags = 0;
                 for (int i = 0; i < grid_size-1; i++)
                 {
                     ImVec2 quad[4];
-                    quad[0] = ImVec2(vert[i].x, v0);
-                    quad[1] = ImVec2(vert[i].x, vert[i].y);
-                    quad[2] = ImVec2(vert[i + 1].x, vert[i + 1].y);
-                    quad[3] = ImVec2(vert[i + 1].x, v0);
+                    quad[0] = lower[i];
+                    quad[1] = upper[i];
+                    quad[2] = upper[i + 1];
+                    quad[3] = lower[i + 1];
                     dl->AddConvexPolyFilled(quad, 4, (gScope->colors[j] & 0xffffff) | 0x3f000000 );
 
                 }
 
-                if (gScope->mTimeScale < 0.1)
-                {
-                    dl->Flags = ImDrawListFlags_AntiAliasedLines;
-                    dl->AddPolyline(vert, grid_size, gScope->colors[j], false, 2 * uiScale);
-                }
-                else
-                {
-                    dl->Flags = ImDrawListFlags_AntiAliasedLines;
-                    dl->AddPolyline(vert, grid_size, gScope->colors[j], false, 1);
-
-                }
+                const float thickness = gScope->mTimeScale < 0.1 ? 2 * uiScale : 1;
+                dl->Flags = ImDrawListFlags_AntiAliasedLines;
+                dl->AddPolyline(upper, grid_size, gScope->colors[j], false, thickness);
+                dl->AddPolyline(lower, grid_size, gScope->colors[j], false, thickness);
             }
         }
     }
@@ -371,6 +371,61 @@ static void vertline(const float uiScale, const float x, const float w)
     ImGui::GetWindowDrawList()->AddLine(ImVec2(p.x + x * uiScale, p.y), ImVec2(p.x + x * uiScale, p.y + (grid_size) * uiScale), 0xff000000, w);
 }
 
+// fft of size pot * 2 with the samples in the real parts, averaged over `average` windows each starting one sample earlier.
+// windows[j] holds pot + average - 1 samples of channel j, oldest first, or nothing for disabled channels
+static ScopeData::Spectrum scope_compute_spectrum(const int pot, const int average, const std::vector<float>* const windows)
+{
+    ScopeData::Spectrum spectrum;
+    spectrum.pot = pot;
+    spectrum.average = average;
+
+    PFFFT_Setup* const setup = ScopeData::getSharedFFTSetup(pot * 2);
+    if (setup == nullptr)
+        return spectrum;
+
+    float* const fft1 = static_cast<float*>(pffft_aligned_malloc(sizeof(float) * pot * 2));
+    float* const fft2 = static_cast<float*>(pffft_aligned_malloc(sizeof(float) * pot * 2));
+    float* const work = static_cast<float*>(pffft_aligned_malloc(sizeof(float) * pot * 2));
+
+    for (int j = 0; j < 4; j++)
+    {
+        if (windows[j].empty())
+            continue;
+
+        // the display interpolates up to two bins past the last one
+        std::vector<float>& ffta(spectrum.mags[j]);
+        ffta.assign(pot / 4 + 3, 0.0f);
+
+        for (int k = 0; k < average; k++)
+        {
+            const float* const graphdata = windows[j].data() + average - 1 - k;
+
+            for (int i = 0; i < pot; i++)
+            {
+                fft1[i * 2] = graphdata[i];
+                fft1[i * 2 + 1] = 0;
+            }
+
+            pffft_transform_ordered(setup, fft1, fft2, work, PFFFT_FORWARD);
+
+            // pffft interleaves real and imaginary parts, with the nyquist bin in place of the first imaginary one.
+            // the display was made from the real parts of the previous fft layout, read here as such
+            for (int i = 0; i < pot / 4; i++)
+            {
+                const float re0 = i != 0 ? fft2[i * 4] : fft2[0];
+                const float re1 = fft2[i * 4 + 2];
+                ffta[i] += (1.0f / average) * sqrt(re0 * re0 + re1 * re1);
+            }
+        }
+    }
+
+    pffft_aligned_free(fft1);
+    pffft_aligned_free(fft2);
+    pffft_aligned_free(work);
+
+    return spectrum;
+}
+
 static void scope_freq(ScopeData* gScope, const float uiScale, int index)
 {
     ImVec2 p = ImGui::GetItemRectMin();
@@ -398,27 +453,39 @@ static void scope_freq(ScopeData* gScope, const float uiScale, int index)
 
     gScope->mPot = pot;
 
-    ffft::FFTReal<float>* fft = NULL;
-    switch (pot)
-    {
-    case 16: fft = gScope->fft.obj16; break;
-    case 32: fft = gScope->fft.obj32; break;
-    case 64: fft = gScope->fft.obj64; break;
-    case 128: fft = gScope->fft.obj128; break;
-    case 256: fft = gScope->fft.obj256; break;
-    case 512: fft = gScope->fft.obj512; break;
-    case 1024: fft = gScope->fft.obj1024; break;
-    case 2048: fft = gScope->fft.obj2048; break;
-    case 4096: fft = gScope->fft.obj4096; break;
-    case 8192: fft = gScope->fft.obj8192; break;
-    case 16384: fft = gScope->fft.obj16384; break;
-    case 32768: fft = gScope->fft.obj32768; break;
-    case 65536: fft = gScope->fft.obj65536; break;
-    }
-    if (!fft) return;
-
     int average = gScope->fft.average;
     int ofs = scope_sync(gScope, index);
+
+    // the ffts run in the background on copies of the samples they need, each frame asks for a newer spectrum
+    {
+        std::array<std::vector<float>, 4> windows;
+
+        for (int j = 0; j < 4; j++)
+        {
+            if (!gScope->mCh[j].mEnabled)
+                continue;
+
+            const float* const graphdata = gScope->mCh[j].mData;
+            const int start = index - ofs - (average - 1);
+            windows[j].resize(pot + average - 1);
+
+            for (int i = 0; i < pot + average - 1; i++)
+                windows[j][i] = graphdata[((start + i) % cycle + cycle) % cycle];
+        }
+
+        const std::shared_ptr<const std::array<std::vector<float>, 4>> shared(
+            std::make_shared<const std::array<std::vector<float>, 4>>(std::move(windows)));
+
+        gScope->spectrumResult.prepare([pot, average, shared]() {
+            return scope_compute_spectrum(pot, average, shared->data());
+        });
+        gScope->spectrumResult.poll(gScope->spectrum);
+    }
+
+    // nothing to draw until a spectrum of the current size is done
+    const ScopeData::Spectrum& spectrum(gScope->spectrum);
+    const bool spectrumReady = spectrum.pot == pot && spectrum.average == average;
+
     int size = grid_size - 1;
     float sizef = size;
     float freqbin = gSamplerate / (float)(pot / 2);
@@ -432,41 +499,26 @@ static void scope_freq(ScopeData* gScope, const float uiScale, int index)
         vertline(uiScale, sqrt(10000 / freqbin * i / (pot / 4)) / zoom * sizef, 1);
     }
 
+    for (int i = 0; i < size; i++)
+        freqbins[i] = powf(zoom * i / sizef, 2.0f) * pot / 4 * freqbin;
+
     for (int j = 0; j < 4; j++)
     {
-        if (gScope->mCh[j].mEnabled)
+        if (gScope->mCh[j].mEnabled && spectrumReady && !spectrum.mags[j].empty())
         {
-
-
-            memset(gScope->ffta, 0, sizeof(float) * 65536 * 2);
-            for (int k = 0; k < average; k++)
-            {
-                float* graphdata = gScope->mCh[j].mData;
-
-                for (int i = 0; i < pot; i++)
-                {
-                    gScope->fft1[i * 2] = graphdata[(index - ofs + i + cycle - k) % cycle];
-                    gScope->fft1[i * 2 + 1] = 0;
-                }
-
-                fft->do_fft(gScope->fft2, gScope->fft1);
-
-                for (int i = 0; i < pot / 4; i++)
-                    gScope->ffta[i] += (1.0f / average) * sqrt(gScope->fft2[i * 2 + 0] * gScope->fft2[i * 2 + 0] + gScope->fft2[i * 2 + 1] * gScope->fft2[i * 2 + 1]);
-            }
+            const float* const ffta = spectrum.mags[j].data();
 
             ImVec2 vert[size];
 
             for (int i = 0; i < size; i++)
             {
                 float ppos = powf(zoom * i / sizef, 2.0f) * pot / 4;
-                freqbins[i] = ppos * freqbin;
-                
+
                 float f = ppos - (int)ppos;
-                float a = i ? gScope->ffta[(int)ppos - 1] : 0;
-                float b = gScope->ffta[(int)ppos];
-                float c = i < size ? gScope->ffta[(int)ppos + 1] : 0;
-                float d = i < (size-1) ? gScope->ffta[(int)ppos + 2] : 0;
+                float a = i ? ffta[(int)ppos - 1] : 0;
+                float b = ffta[(int)ppos];
+                float c = i < size ? ffta[(int)ppos + 1] : 0;
+                float d = i < (size-1) ? ffta[(int)ppos + 2] : 0;
 
                 float v0 = (float)catmullrom(f, a, b, c, d);
                 
@@ -597,7 +649,7 @@ static void detect_fundamentals(ScopeData* gScope)
 void do_show_scope_window(ScopeData* gScope, const float uiScale)
 {
     // Data is updated live, so let's take local copies of critical stuff.
-    int index = gScope->mIndex;
+    int index = gScope->mIndex.load(std::memory_order_acquire);
 
     ImGui::Begin("Scope", nullptr, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize);
 
@@ -19,6 +19,13 @@
 #include "plugin.hpp"
 
 #include "DistrhoUtils.hpp"
+#include "MemoryUsage.hpp"
+#include "StartupTrace.hpp"
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
 
 // Cardinal (built-in)
 #include "Cardinal/src/plugin.hpp"
@@ -742,6 +749,7 @@ void StoermelderSettings::readFromJson() {}
 // surgext
 #include "surgext/src/SurgeXT.h"
 void surgext_rack_initialize();
+void surgext_rack_initialize_lazy();
 void surgext_rack_update_theme();
 
 // unless_modules
@@ -875,13 +883,44 @@ std::string pluginPath(const std::string& dirname);
 
 namespace plugin {
 
+// Cardinal specific API, declared as needed in other files
+void updatePluginIndex();
+#ifdef CARDINAL_SHARED_PLUGINS
+void addDeferredModel(Plugin* plugin, const char* dirname, const char* slug);
+void destroyDeferredPlugins();
+#endif
+
+#ifndef NOPLUGINS
+// all plugin manifests merged at build time, keyed by plugin directory name
+extern "C" {
+extern const unsigned char cardinal_plugin_manifests[];
+extern const unsigned int cardinal_plugin_manifests_len;
+}
+
+// parsed once while initializing static plugins, manifests are taken out of it as plugins load
+static json_t* pluginManifestsJ = nullptr;
+static std::mutex pluginManifestsMutex;
+#endif
+
+// set while plugins initialize in parallel, loaded plugins are kept here and registered afterwards in order
+static thread_local Plugin** pendingPluginSlot = nullptr;
+
 struct StaticPluginLoader {
     Plugin* const plugin;
+    const char* const name;
+    const double traceTime;
+    const size_t memoryStart;
+    const bool deferred;
     FILE* file;
     json_t* rootJ;
 
-    StaticPluginLoader(Plugin* const p, const char* const name)
+    // deferred plugins get placeholder models from the manifest, their code is loaded on first use
+    StaticPluginLoader(Plugin* const p, const char* const name, const bool deferred = false)
         : plugin(p),
+          name(name),
+          traceTime(startuptrace::now()),
+          memoryStart(memusage::getResidentSize()),
+          deferred(deferred),
           file(nullptr),
           rootJ(nullptr)
     {
@@ -891,21 +930,39 @@ struct StaticPluginLoader {
 
         p->path = asset::pluginPath(name);
 
-        const std::string manifestFilename = asset::pluginManifest(name);
-
-        if ((file = std::fopen(manifestFilename.c_str(), "r")) == nullptr)
+#ifndef NOPLUGINS
+        if (pluginManifestsJ != nullptr)
         {
-            d_stderr2("Manifest file %s does not exist", manifestFilename.c_str());
-            return;
+            const std::lock_guard<std::mutex> lock(pluginManifestsMutex);
+
+            if ((rootJ = json_object_get(pluginManifestsJ, name)) != nullptr)
+            {
+                json_incref(rootJ);
+                json_object_del(pluginManifestsJ, name);
+            }
         }
 
-        json_error_t error;
-        if ((rootJ = json_loadf(file, 0, &error)) == nullptr)
+        if (rootJ == nullptr)
+#endif
         {
-            d_stderr2("JSON parsing error at %s %d:%d %s", manifestFilename.c_str(), error.line, error.column, error.text);
-            return;
+            const std::string manifestFilename = asset::pluginManifest(name);
+
+            if ((file = std::fopen(manifestFilename.c_str(), "r")) == nullptr)
+            {
+                d_stderr2("Manifest file %s does not exist", manifestFilename.c_str());
+                return;
+            }
+
+            json_error_t error;
+            if ((rootJ = json_loadf(file, 0, &error)) == nullptr)
+            {
+                d_stderr2("JSON parsing error at %s %d:%d %s", manifestFilename.c_str(), error.line, error.column, error.text);
+                return;
+            }
         }
 
+        startuptrace::record("manifest", name, traceTime);
+
         // force ABI, we use static plugins so this doesnt matter as long as it builds
         json_t* const version = json_string((APP_VERSION_MAJOR + ".0").c_str());
         json_object_set(rootJ, "version", version);
@@ -914,9 +971,10 @@ struct StaticPluginLoader {
         // Load manifest
         p->fromJson(rootJ);
 
-        // Reject plugin if slug already exists
-        if (Plugin* const existingPlugin = getPlugin(p->slug))
-            throw Exception("Plugin %s is already loaded, not attempting to load it again", p->slug.c_str());
+        // Reject plugin if slug already exists, checked on registration when initializing in parallel
+        if (pendingPluginSlot == nullptr)
+            if (Plugin* const existingPlugin = getPlugin(p->slug))
+                throw Exception("Plugin %s is already loaded, not attempting to load it again", p->slug.c_str());
     }
 
     ~StaticPluginLoader()
@@ -925,14 +983,28 @@ struct StaticPluginLoader {
         {
             // Load modules manifest
             json_t* const modulesJ = json_object_get(rootJ, "modules");
+#ifdef CARDINAL_SHARED_PLUGINS
+            if (deferred)
+                addDeferredModels(modulesJ);
+#endif
+#ifdef CARDINAL_PLUGIN_SUBSET
+            removeModulesWithoutModel(modulesJ);
+#endif
             plugin->modulesFromJson(modulesJ);
 
             json_decref(rootJ);
-            plugins.push_back(plugin);
+
+            if (pendingPluginSlot != nullptr)
+                *pendingPluginSlot = plugin;
+            else
+                plugins.push_back(plugin);
         }
 
         if (file != nullptr)
             std::fclose(file);
+
+        startuptrace::record("plugin", name, traceTime);
+        memusage::record(name, memoryStart);
     }
 
     bool ok() const noexcept
@@ -940,6 +1012,35 @@ struct StaticPluginLoader {
         return rootJ != nullptr;
     }
 
+#ifdef CARDINAL_SHARED_PLUGINS
+    void addDeferredModels(json_t* const modules) const
+    {
+        size_t i;
+        json_t* v;
+        json_array_foreach(modules, i, v)
+        {
+            if (const char* const slug = json_string_value(json_object_get(v, "slug")))
+                addDeferredModel(plugin, name, slug);
+        }
+    }
+#endif
+
+#ifdef CARDINAL_PLUGIN_SUBSET
+    // models outside of the build subset are not added, their manifest entries go away with them
+    void removeModulesWithoutModel(json_t* const modules) const noexcept
+    {
+        for (size_t i = 0; i < json_array_size(modules);)
+        {
+            const char* const slug = json_string_value(json_object_get(json_array_get(modules, i), "slug"));
+
+            if (slug != nullptr && plugin->getModel(slug) == nullptr)
+                json_array_remove(modules, i);
+            else
+                ++i;
+        }
+    }
+#endif
+
     void removeModule(const char* const slugToRemove) const noexcept
     {
         json_t* const modules = json_object_get(rootJ, "modules");
@@ -994,6 +1095,8 @@ static void initStatic__Cardinal()
        #ifndef STATIC_BUILD
         p->addModel(modelAudioFile);
         p->addModel(modelIldaeil);
+        // loaded projects are reported to the widget from the module side
+        setModuleWidgetNeededOnEngineLoad(modelIldaeil);
        #else
         spl.removeModule("AudioFile");
         spl.removeModule("Ildaeil");
@@ -1031,6 +1134,11 @@ static void initStatic__Cardinal()
             modelHostParametersMap,
             modelHostTime,
         };
+
+        // constructors only configure the module itself, the mapping modules register param handles with the engine
+        for (const Model* const model : { modelHostAudio2, modelHostAudio8, modelHostCV, modelHostMIDI,
+                                          modelHostMIDICC, modelHostMIDIGate, modelHostParameters, modelHostTime })
+            setModuleParallelSafe(model);
     }
 }
 
@@ -1835,7 +1943,7 @@ static void initStatic__DrumKit()
     const StaticPluginLoader spl(p, "DrumKit");
     if (spl.ok())
     {
-        setupSamples();
+        setLazyPluginInit(p, setupSamples);
         p->addModel(modelBD9);
         p->addModel(modelSnare);
         p->addModel(modelClosedHH);
@@ -2912,6 +3020,7 @@ static void initStatic__surgext()
         */
 
         surgext_rack_initialize();
+        setLazyPluginInit(p, surgext_rack_initialize_lazy);
     }
 }
 
@@ -3046,83 +3155,200 @@ static void initStatic__ZZC()
 }
 #endif // NOPLUGINS
 
+#ifndef NOPLUGINS
+// plugins initialized in parallel, each group runs in order on a single thread as they share global state
+static void (*const staticPluginInitGroups[][2])() = {
+    { initStatic__21kHz },
+    { initStatic__8Mode },
+    { initStatic__AaronStatic },
+    { initStatic__alefsbits },
+    { initStatic__Algoritmarte },
+    { initStatic__AmalgamatedHarmonics },
+    { initStatic__AnimatedCircuits },
+    { initStatic__ArableInstruments },
+    { initStatic__Aria },
+    { initStatic__AS },
+    { initStatic__AudibleInstruments },
+    { initStatic__Autinn },
+    { initStatic__Axioma },
+    // both set up BaconStyle
+    { initStatic__Bacon, initStatic__surgext },
+    { initStatic__Befaco },
+    { initStatic__Bidoo },
+    { initStatic__BogaudioModules },
+    { initStatic__CatroModulo },
+    { initStatic__cf },
+    { initStatic__ChowDSP },
+    { initStatic__dBiz },
+    { initStatic__DrumKit },
+    { initStatic__ESeries },
+    { initStatic__ExpertSleepersEncoders },
+    { initStatic__Extratone },
+    { initStatic__FehlerFabrik },
+    { initStatic__forsitan },
+    { initStatic__GlueTheGiant },
+    { initStatic__GoodSheperd },
+    { initStatic__GrandeModular },
+    { initStatic__H4N4 },
+    { initStatic__HamptonHarmonics },
+    { initStatic__HetrickCV },
+    { initStatic__ImpromptuModular },
+    { initStatic__ihtsyn },
+    { initStatic__JW },
+    { initStatic__kocmoc },
+    { initStatic__LifeFormModular },
+    { initStatic__LilacLoop },
+    { initStatic__LittleUtils },
+    { initStatic__Lomas },
+    { initStatic__Lyrae },
+    { initStatic__Meander },
+    { initStatic__MindMeld },
+    { initStatic__ML },
+    { initStatic__MockbaModular },
+    { initStatic__Mog },
+    { initStatic__mscHack },
+    { initStatic__MSM },
+    { initStatic__myth_modules },
+    { initStatic__nonlinearcircuits },
+    { initStatic__Orbits },
+    { initStatic__ParableInstruments },
+    { initStatic__PathSet },
+    { initStatic__PinkTrombone },
+    { initStatic__Prism },
+    { initStatic__rackwindows },
+    { initStatic__RebelTech },
+    { initStatic__repelzen },
+    { initStatic__Sapphire },
+    { initStatic__sonusmodular },
+    { initStatic__stocaudio },
+    { initStatic__stoermelder_p1 },
+    { initStatic__unless_modules },
+    { initStatic__ValleyAudio },
+    { initStatic__Voxglitch },
+    { initStatic__WhatTheRack },
+    { initStatic__ZetaCarinaeModules },
+    { initStatic__ZZC },
+};
+
+#ifdef CARDINAL_PLUGIN_MODULE
+// entry point of a plugin family built as a separately loadable module, see SHARED_PLUGINS.
+// the plugin is kept by the host instead of being registered, only its placeholder is part of the plugin list
+extern "C" __attribute__((visibility("default")))
+Plugin* cardinalPluginModuleInit()
+{
+    Plugin* plugin = nullptr;
+    pendingPluginSlot = &plugin;
+
+    try {
+        for (const auto& group : staticPluginInitGroups)
+            for (size_t j = 0; j < 2 && group[j] != nullptr; ++j)
+                group[j]();
+    } catch (...) {
+        pendingPluginSlot = nullptr;
+        delete plugin;
+        throw;
+    }
+
+    pendingPluginSlot = nullptr;
+    return plugin;
+}
+#else
+static void initStaticPluginsInParallel()
+{
+    constexpr const size_t numGroups = sizeof(staticPluginInitGroups) / sizeof(staticPluginInitGroups[0]);
+
+    std::vector<Plugin*> loadedPlugins(numGroups * 2, nullptr);
+    std::vector<std::exception_ptr> exceptions(numGroups);
+    std::atomic<size_t> nextIndex{0};
+    Context* const context = contextGet();
+
+    auto runGroups = [&]() {
+        for (size_t i = nextIndex++; i < numGroups; i = nextIndex++)
+        {
+            try {
+                for (size_t j = 0; j < 2 && staticPluginInitGroups[i][j] != nullptr; ++j)
+                {
+                    pendingPluginSlot = &loadedPlugins[i * 2 + j];
+                    staticPluginInitGroups[i][j]();
+                }
+            } catch (...) {
+                exceptions[i] = std::current_exception();
+            }
+            pendingPluginSlot = nullptr;
+        }
+    };
+
+   #if defined(__EMSCRIPTEN__) || defined(CARDINAL_LOW_MEMORY)
+    const int threadCount = 1;
+   #else
+    const int threadCount = math::clamp<int>(std::thread::hardware_concurrency(), 1, 16);
+   #endif
+    std::vector<std::thread> threads;
+    for (int i = 1; i < threadCount; ++i)
+    {
+        threads.emplace_back([&] {
+            contextSet(context);
+            runGroups();
+        });
+    }
+    runGroups();
+    for (std::thread& thread : threads)
+        thread.join();
+
+    // registration, in the same order as serial initialization
+    for (size_t i = 0; i < numGroups; ++i)
+    {
+        if (exceptions[i])
+            std::rethrow_exception(exceptions[i]);
+
+        for (size_t j = 0; j < 2; ++j)
+        {
+            Plugin* const p = loadedPlugins[i * 2 + j];
+            if (p == nullptr)
+                continue;
+            if (Plugin* const existingPlugin = getPlugin(p->slug))
+                throw Exception("Plugin %s is already loaded, not attempting to load it again", p->slug.c_str());
+            plugins.push_back(p);
+        }
+    }
+}
+#endif // CARDINAL_PLUGIN_MODULE
+#endif // NOPLUGINS
+
+#ifndef CARDINAL_PLUGIN_MODULE
 void initStaticPlugins()
 {
+    const double startTime = system::getTime();
+
+#ifndef NOPLUGINS
+    {
+        const startuptrace::Scope trace("manifest", "built-in manifests");
+
+        json_error_t error;
+        pluginManifestsJ = json_loadb(reinterpret_cast<const char*>(cardinal_plugin_manifests),
+                                      cardinal_plugin_manifests_len, 0, &error);
+        if (pluginManifestsJ == nullptr)
+            d_stderr2("JSON parsing error in built-in plugin manifests %d:%d %s", error.line, error.column, error.text);
+    }
+#endif
+
+    // others may depend on these, always first and serially
     initStatic__Cardinal();
     initStatic__Fundamental();
     // initStatic__ZamAudio();
 #ifndef NOPLUGINS
-    initStatic__21kHz();
-    initStatic__8Mode();
-    initStatic__AaronStatic();
-    initStatic__alefsbits();
-    initStatic__Algoritmarte();
-    initStatic__AmalgamatedHarmonics();
-    initStatic__AnimatedCircuits();
-    initStatic__ArableInstruments();
-    initStatic__Aria();
-    initStatic__AS();
-    initStatic__AudibleInstruments();
-    initStatic__Autinn();
-    initStatic__Axioma();
-    initStatic__Bacon();
-    initStatic__Befaco();
-    initStatic__Bidoo();
-    initStatic__BogaudioModules();
-    initStatic__CatroModulo();
-    initStatic__cf();
-    initStatic__ChowDSP();
-    initStatic__dBiz();
-    initStatic__DrumKit();
-    initStatic__ESeries();
-    initStatic__ExpertSleepersEncoders();
-    initStatic__Extratone();
-    initStatic__FehlerFabrik();
-    initStatic__forsitan();
-    initStatic__GlueTheGiant();
-    initStatic__GoodSheperd();
-    initStatic__GrandeModular();
-    initStatic__H4N4();
-    initStatic__HamptonHarmonics();
-    initStatic__HetrickCV();
-    initStatic__ImpromptuModular();
-    initStatic__ihtsyn();
-    initStatic__JW();
-    initStatic__kocmoc();
-    initStatic__LifeFormModular();
-    initStatic__LilacLoop();
-    initStatic__LittleUtils();
-    initStatic__Lomas();
-    initStatic__Lyrae();
-    initStatic__Meander();
-    initStatic__MindMeld();
-    initStatic__ML();
-    initStatic__MockbaModular();
-    initStatic__Mog();
-    initStatic__mscHack();
-    initStatic__MSM();
-    initStatic__myth_modules();
-    initStatic__nonlinearcircuits();
-    initStatic__Orbits();
-    initStatic__ParableInstruments();
-    initStatic__PathSet();
-    initStatic__PinkTrombone();
-    initStatic__Prism();
-    initStatic__rackwindows();
-    initStatic__RebelTech();
-    initStatic__repelzen();
-    initStatic__Sapphire();
-    initStatic__sonusmodular();
-    initStatic__stocaudio();
-    initStatic__stoermelder_p1();
-    initStatic__surgext();
-    initStatic__unless_modules();
-    initStatic__ValleyAudio();
-    initStatic__Voxglitch();
-    initStatic__WhatTheRack();
-    initStatic__ZetaCarinaeModules();
-    initStatic__ZZC();
+    {
+        const startuptrace::Scope trace("startup", "parallel plugin init");
+        initStaticPluginsInParallel();
+    }
+
+    json_decref(pluginManifestsJ);
+    pluginManifestsJ = nullptr;
 #endif // NOPLUGINS
+
+    updatePluginIndex();
+
+    INFO("Initialized %d static plugins in %.1f ms", static_cast<int>(plugins.size()), (system::getTime() - startTime) * 1000.0);
 }
 
 void destroyStaticPlugins()
@@ -3130,12 +3356,18 @@ void destroyStaticPlugins()
     for (Plugin* p : plugins)
         delete p;
     plugins.clear();
+    updatePluginIndex();
+#ifdef CARDINAL_SHARED_PLUGINS
+    destroyDeferredPlugins();
+#endif
 }
 
 void updateStaticPluginsDarkMode()
 {
 #ifndef NOPLUGINS
     const bool darkMode = settings::darkMode;
+    // plugins left out of a subset build must not be referenced, or the linker pulls them in regardless
+#if !defined(CARDINAL_PLUGIN_SUBSET) || defined(CARDINAL_PLUGIN_SUBSET_BogaudioModules)
     // bogaudio
     {
         Skins& skins(Skins::skins());
@@ -3146,20 +3378,26 @@ void updateStaticPluginsDarkMode()
             listener->defaultSkinChanged(skins._default);
         }
     }
+#endif
+#if !defined(CARDINAL_PLUGIN_SUBSET) || defined(CARDINAL_PLUGIN_SUBSET_Meander)
     // meander
     {
         panelTheme = darkMode ? 1 : 0;
     }
+#endif
     // glue the giant
     {
         gtg_default_theme = darkMode ? 1 : 0;
     }
+#if !defined(CARDINAL_PLUGIN_SUBSET) || defined(CARDINAL_PLUGIN_SUBSET_surgext)
     // surgext
     {
         surgext_rack_update_theme();
     }
 #endif
+#endif
 }
+#endif // CARDINAL_PLUGIN_MODULE
 
 }
 }
@@ -21,10 +21,19 @@
 using namespace baconpaul::rackplugs;
 using namespace sst::surgext_rack::style;
 
+static bool xtStyleInitialized = false;
+
 void surgext_rack_initialize()
 {
     BaconStyle::get()->activeStyle = rack::settings::darkMode ? BaconStyle::DARK : BaconStyle::LIGHT;
+}
+
+// only needed by surgext modules, deferred until the first one is created
+void surgext_rack_initialize_lazy()
+{
     XTStyle::initialize();
+    XTStyle::setGlobalStyle(rack::settings::darkMode ? XTStyle::Style::DARK : XTStyle::Style::LIGHT);
+    xtStyleInitialized = true;
 }
 
 void surgext_rack_update_theme()
@@ -32,6 +41,10 @@ void surgext_rack_update_theme()
     BaconStyle::get()->activeStyle = rack::settings::darkMode ? BaconStyle::DARK : BaconStyle::LIGHT;
     BaconStyle::get()->notifyStyleListeners();
 
+    // initialized later with the current theme
+    if (! xtStyleInitialized)
+        return;
+
     XTStyle::setGlobalStyle(rack::settings::darkMode ? XTStyle::Style::DARK : XTStyle::Style::LIGHT);
     XTStyle::notifyStyleListeners();
 }
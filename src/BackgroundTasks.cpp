@@ -0,0 +1,105 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include <helpers.hpp>
+
+#include "ThreadScheduling.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <vector>
+
+namespace rack {
+namespace background {
+
+#if defined(__EMSCRIPTEN__) && !defined(CARDINAL_WASM_THREADS)
+// no threads to run them on, tasks run right away
+void run(const std::function<void()>& task)
+{
+    task();
+}
+#else
+// started on first use, leaves a core for the UI thread and at least one for audio
+struct Pool {
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::thread> threads;
+    bool stopping = false;
+
+    Pool()
+    {
+        const int count = std::max(1, std::min(4, threadsched::getCpuCount() - 2));
+
+        for (int i = 0; i < count; ++i)
+            threads.emplace_back([this]() { runTasks(); });
+    }
+
+    // tasks still queued at exit are dropped
+    ~Pool()
+    {
+        {
+            const std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            tasks.clear();
+        }
+        condition.notify_all();
+
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    void runTasks()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        for (;;)
+        {
+            condition.wait(lock, [this]() { return stopping || ! tasks.empty(); });
+
+            if (stopping)
+                return;
+
+            const std::function<void()> task = std::move(tasks.front());
+            tasks.pop_front();
+            lock.unlock();
+
+            try {
+                task();
+            } DISTRHO_SAFE_EXCEPTION("background task");
+
+            lock.lock();
+        }
+    }
+};
+
+void run(const std::function<void()>& task)
+{
+    static Pool pool;
+
+    {
+        const std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.tasks.push_back(task);
+    }
+    pool.condition.notify_one();
+}
+#endif
+
+}
+}
@@ -0,0 +1,102 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include <string.hpp>
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+// The module browser is built with its fuzzyScore calls renamed to browserFuzzyScore (see Makefile).
+// Every keystroke scores the search text of each model, which rarely changes, against the query.
+// Search texts are indexed by the set of bytes they contain, so that models without all query characters
+// are rejected without scanning, and models that did not match a query are rejected at once while the
+// query is only being extended by typing.
+// Whatever is not rejected is scored by the regular fuzzyScore, results are the same as Rack's.
+
+namespace rack {
+namespace string {
+
+struct SearchEntry {
+    uint64_t chars;
+    uint32_t missGeneration;
+};
+
+// bounded in case the browser ever scores texts that keep changing
+static constexpr const size_t kMaxSearchEntries = 8192;
+
+static std::mutex searchMutex;
+static std::unordered_map<std::string, SearchEntry> searchEntries;
+static std::string searchQuery;
+static uint64_t searchQueryChars = 0;
+static uint32_t searchGeneration = 1;
+static bool searchQueryExtended = false;
+
+static inline uint64_t getSearchChars(const std::string& s)
+{
+    // byte values folded into 64 bits, sharing a bit only makes rejection less likely, never wrong
+    uint64_t chars = 0;
+    for (const unsigned char c : s)
+        chars |= UINT64_C(1) << (c % 64);
+    return chars;
+}
+
+float browserFuzzyScore(const std::string& s, const std::string& query)
+{
+    if (query.empty() || s.empty())
+        return fuzzyScore(s, query);
+
+    const std::lock_guard<std::mutex> lock(searchMutex);
+
+    if (query != searchQuery)
+    {
+        // a query starting with the previous one cannot match what the previous one did not
+        searchQueryExtended = !searchQuery.empty() && query.compare(0, searchQuery.size(), searchQuery) == 0;
+        searchQuery = query;
+        searchQueryChars = getSearchChars(query);
+        ++searchGeneration;
+    }
+
+    if (searchEntries.size() >= kMaxSearchEntries)
+        searchEntries.clear();
+
+    auto it = searchEntries.find(s);
+    if (it == searchEntries.end())
+        it = searchEntries.emplace(s, SearchEntry{ getSearchChars(s), 0 }).first;
+
+    SearchEntry& entry(it->second);
+
+    if (entry.missGeneration == searchGeneration)
+        return 0.f;
+
+    if ((searchQueryExtended && entry.missGeneration == searchGeneration - 1)
+        || (entry.chars & searchQueryChars) != searchQueryChars)
+    {
+        entry.missGeneration = searchGeneration;
+        return 0.f;
+    }
+
+    const float score = fuzzyScore(s, query);
+
+    if (score <= 0.f)
+        entry.missGeneration = searchGeneration;
+
+    return score;
+}
+
+}
+}
@@ -0,0 +1,1078 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include <asset.hpp>
+#include <helpers.hpp>
+#include <history.hpp>
+#include <patch.hpp>
+#include <random.hpp>
+#include <settings.hpp>
+#include <system.hpp>
+
+#include <app/Browser.hpp>
+#include <app/Scene.hpp>
+#include <engine/Cable.hpp>
+#include <engine/Engine.hpp>
+#include <ui/common.hpp>
+#include <widget/event.hpp>
+#include <window/Window.hpp>
+
+#include "CardinalCommon.hpp"
+#include "ModuleMemory.hpp"
+#include "PluginContext.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <random>
+#include <vector>
+
+#ifdef ARCH_LIN
+# include <linux/perf_event.h>
+# include <sys/ioctl.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif
+
+extern const std::string CARDINAL_VERSION;
+
+namespace rack {
+namespace asset {
+std::string patchesPath();
+void destroy();
+}
+namespace engine {
+void Engine_setAboutToClose(Engine*);
+void Engine_setMaxBufferSize(Engine*, int frames);
+}
+namespace plugin {
+void initStaticPlugins();
+void destroyStaticPlugins();
+}
+}
+
+START_NAMESPACE_DISTRHO
+
+bool isUsingNativeAudio() noexcept { return false; }
+bool supportsAudioInput() { return false; }
+bool supportsBufferSizeChanges() { return false; }
+bool supportsMIDI() { return false; }
+bool isAudioInputEnabled() { return false; }
+bool isMIDIEnabled() { return false; }
+uint getBufferSize() { return 0; }
+bool requestAudioInput() { return false; }
+bool requestBufferSizeChange(uint) { return false; }
+bool requestMIDI() { return false; }
+const char* getPluginFormatName() noexcept { return "Benchmark"; }
+
+uint32_t Plugin::getBufferSize() const noexcept { return 512; }
+double Plugin::getSampleRate() const noexcept { return 48000; }
+bool Plugin::writeMidiEvent(const MidiEvent&) noexcept { return false; }
+
+END_NAMESPACE_DISTRHO
+
+USE_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// Synthetic module, a cheap oscillator mixing its inputs, optionally talking to its neighbours as an expander
+
+struct BenchmarkExpanderMessage {
+    float voltages[rack::PORT_MAX_CHANNELS];
+};
+
+struct BenchmarkModule : rack::engine::Module {
+    enum ParamIds {
+        NUM_PARAMS = 4
+    };
+    enum InputIds {
+        NUM_INPUTS = 4
+    };
+    enum OutputIds {
+        NUM_OUTPUTS = 4
+    };
+    enum LightIds {
+        NUM_LIGHTS
+    };
+
+    int channels = 1;
+    float phases[rack::PORT_MAX_CHANNELS] = {};
+    BenchmarkExpanderMessage expanderMessages[2] = {};
+
+    BenchmarkModule()
+    {
+        config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
+
+        for (int i = 0; i < NUM_PARAMS; ++i)
+            configParam(i, 0.f, 1.f, 0.5f);
+    }
+
+    void enableExpanderMessages()
+    {
+        leftExpander.producerMessage = &expanderMessages[0];
+        leftExpander.consumerMessage = &expanderMessages[1];
+    }
+
+    void process(const ProcessArgs& args) override
+    {
+        const BenchmarkExpanderMessage* const fromLeft = leftExpander.module != nullptr
+                                                       ? static_cast<const BenchmarkExpanderMessage*>(leftExpander.consumerMessage)
+                                                       : nullptr;
+
+        float mix[rack::PORT_MAX_CHANNELS];
+
+        for (int c = 0; c < channels; ++c)
+        {
+            phases[c] += (110.f + 10.f * c) * args.sampleTime;
+            phases[c] -= std::floor(phases[c]);
+            mix[c] = 5.f * (2.f * phases[c] - 1.f);
+
+            if (fromLeft != nullptr)
+                mix[c] += fromLeft->voltages[c];
+        }
+
+        for (int i = 0; i < NUM_INPUTS; ++i)
+        {
+            const float gain = params[i].getValue();
+
+            for (int c = 0; c < channels; ++c)
+                mix[c] += gain * inputs[i].getPolyVoltage(c);
+        }
+
+        for (int i = 0; i < NUM_OUTPUTS; ++i)
+        {
+            outputs[i].setChannels(channels);
+
+            for (int c = 0; c < channels; ++c)
+                outputs[i].setVoltage(rack::math::clamp(mix[c] * (0.25f * (i + 1)), -10.f, 10.f), c);
+        }
+
+        if (Module* const right = rightExpander.module)
+        {
+            if (BenchmarkExpanderMessage* const toRight = static_cast<BenchmarkExpanderMessage*>(right->leftExpander.producerMessage))
+            {
+                std::memcpy(toRight->voltages, mix, sizeof(float) * channels);
+                right->leftExpander.requestMessageFlip();
+            }
+        }
+    }
+};
+
+struct BenchmarkModuleWidget : rack::app::ModuleWidget {
+    BenchmarkModuleWidget(BenchmarkModule* const module)
+    {
+        setModule(module);
+    }
+};
+
+static rack::plugin::Model* getBenchmarkModel()
+{
+    static rack::plugin::Model* const model = rack::createModel<BenchmarkModule, BenchmarkModuleWidget>("Benchmark");
+    return model;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Stimulus fed to every input of a model benchmarked in isolation
+
+struct StimulusModule : rack::engine::Module {
+    enum Stimulus {
+        kStimulusSilence,
+        kStimulusAudio,
+        kStimulusPolyCV,
+        kStimulusCount
+    };
+
+    Stimulus stimulus = kStimulusSilence;
+    float phases[rack::PORT_MAX_CHANNELS] = {};
+
+    StimulusModule()
+    {
+        config(0, 0, 1, 0);
+    }
+
+    void process(const ProcessArgs& args) override
+    {
+        switch (stimulus)
+        {
+        case kStimulusSilence:
+            outputs[0].setChannels(1);
+            outputs[0].setVoltage(0.f);
+            break;
+        case kStimulusAudio:
+            // 440 Hz sine at audio level
+            phases[0] += 440.f * args.sampleTime;
+            phases[0] -= std::floor(phases[0]);
+            outputs[0].setChannels(1);
+            outputs[0].setVoltage(5.f * std::sin(2.f * float(M_PI) * phases[0]));
+            break;
+        case kStimulusPolyCV:
+            // slow CV on every channel, each at its own rate
+            outputs[0].setChannels(rack::PORT_MAX_CHANNELS);
+            for (int c = 0; c < rack::PORT_MAX_CHANNELS; ++c)
+            {
+                phases[c] += (0.5f + 0.25f * c) * args.sampleTime;
+                phases[c] -= std::floor(phases[c]);
+                outputs[0].setVoltage(5.f * std::sin(2.f * float(M_PI) * phases[c]), c);
+            }
+            break;
+        case kStimulusCount:
+            break;
+        }
+    }
+};
+
+struct StimulusModuleWidget : rack::app::ModuleWidget {
+    StimulusModuleWidget(StimulusModule* const module)
+    {
+        setModule(module);
+    }
+};
+
+static rack::plugin::Model* getStimulusModel()
+{
+    static rack::plugin::Model* const model = rack::createModel<StimulusModule, StimulusModuleWidget>("Stimulus");
+    return model;
+}
+
+static const char* const kStimulusNames[StimulusModule::kStimulusCount] = {
+    "silence",
+    "audio",
+    "poly-cv",
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// CPU counters of the calling thread, where the OS lets us read them
+
+struct CpuCounters {
+    enum Counter {
+        kCounterCycles,
+        kCounterInstructions,
+        kCounterCacheReferences,
+        kCounterCacheMisses,
+        kCounterCount
+    };
+
+    int fds[kCounterCount];
+    uint64_t values[kCounterCount] = {};
+
+    CpuCounters()
+    {
+        for (int i = 0; i < kCounterCount; ++i)
+            fds[i] = -1;
+
+       #ifdef ARCH_LIN
+        static const uint64_t configs[kCounterCount] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_REFERENCES,
+            PERF_COUNT_HW_CACHE_MISSES,
+        };
+
+        for (int i = 0; i < kCounterCount; ++i)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = configs[i];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+       #endif
+    }
+
+    ~CpuCounters()
+    {
+       #ifdef ARCH_LIN
+        for (int i = 0; i < kCounterCount; ++i)
+        {
+            if (fds[i] >= 0)
+                ::close(fds[i]);
+        }
+       #endif
+    }
+
+    bool isAvailable(const int counter) const
+    {
+        return fds[counter] >= 0;
+    }
+
+    void start()
+    {
+       #ifdef ARCH_LIN
+        for (int i = 0; i < kCounterCount; ++i)
+        {
+            if (fds[i] < 0)
+                continue;
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+       #endif
+    }
+
+    void stop()
+    {
+       #ifdef ARCH_LIN
+        for (int i = 0; i < kCounterCount; ++i)
+        {
+            if (fds[i] < 0)
+                continue;
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fds[i], &values[i], sizeof(uint64_t)) != sizeof(uint64_t))
+                values[i] = 0;
+        }
+       #endif
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+struct BenchmarkOptions {
+    double seconds = 2.0;
+    double sampleRate = 48000.0;
+    uint32_t bufferSize = 512;
+    uint32_t threads = 1;
+    uint32_t seed = 1;
+    std::string csvPath;
+    std::string jsonPath;
+    std::string baselinePath;
+    double tolerance = 10.0;
+};
+
+struct SyntheticGraph {
+    uint32_t modules = 128;
+    uint32_t cables = 256;
+    uint32_t polyphony = 1;
+    uint32_t expanderChain = 0;
+    uint32_t feedbackCables = 0;
+
+    std::string getName() const
+    {
+        return rack::string::f("synthetic-m%u-c%u-p%u-e%u-f%u", modules, cables, polyphony, expanderChain, feedbackCables);
+    }
+};
+
+struct BenchmarkResult {
+    std::string name;
+    size_t modules = 0;
+    size_t cables = 0;
+    uint64_t frames = 0;
+    double nsPerFrame = 0.0;
+    double nsPerModule = 0.0;
+    double realtimeFactor = 0.0;
+    double countersPerFrame[CpuCounters::kCounterCount] = {};
+    bool counters[CpuCounters::kCounterCount] = {};
+    // only measured for models in isolation, where ns/module is the cost over the stimulus alone
+    double constructionUs = 0.0;
+    int64_t memoryBytes = 0;
+};
+
+static const char* const kCounterNames[CpuCounters::kCounterCount] = {
+    "cycles",
+    "instructions",
+    "cache-references",
+    "cache-misses",
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+static CardinalPluginContext* createContext(const BenchmarkOptions& options)
+{
+    CardinalPluginContext* const context = new CardinalPluginContext(nullptr);
+    rack::contextSet(context);
+
+    context->bufferSize = options.bufferSize;
+    context->sampleRate = options.sampleRate;
+
+    context->engine = new rack::engine::Engine;
+    context->engine->setSampleRate(options.sampleRate);
+    rack::engine::Engine_setMaxBufferSize(context->engine, options.bufferSize);
+
+    context->history = new rack::history::State;
+    context->patch = new rack::patch::Manager;
+
+    context->event = new rack::widget::EventState;
+    context->scene = new rack::app::Scene;
+    context->event->rootWidget = context->scene;
+
+    context->window = new rack::window::Window;
+
+    return context;
+}
+
+static void destroyContext(CardinalPluginContext* const context)
+{
+    context->patch->clear();
+    rack::engine::Engine_setAboutToClose(context->engine);
+    delete context;
+    rack::contextSet(nullptr);
+}
+
+static void buildSyntheticGraph(rack::engine::Engine* const engine, const SyntheticGraph& graph, const uint32_t seed)
+{
+    using namespace rack::engine;
+
+    std::mt19937 rng(seed);
+    std::vector<BenchmarkModule*> modules(graph.modules);
+
+    for (uint32_t i = 0; i < graph.modules; ++i)
+    {
+        BenchmarkModule* const module = static_cast<BenchmarkModule*>(getBenchmarkModel()->createModule());
+        module->id = i + 1;
+        module->channels = rack::math::clamp<int>(graph.polyphony, 1, rack::PORT_MAX_CHANNELS);
+
+        // chains of expanders, each module sending its mix to the one on its right
+        if (graph.expanderChain > 1)
+        {
+            module->enableExpanderMessages();
+
+            if (i % graph.expanderChain != 0)
+            {
+                module->leftExpander.moduleId = i;
+                modules[i - 1]->rightExpander.moduleId = i + 1;
+            }
+        }
+
+        modules[i] = module;
+        engine->addModule(module);
+    }
+
+    if (graph.modules < 2)
+        return;
+
+    // each input takes at most one cable, forward cables go from lower to higher module indexes
+    std::vector<bool> usedInputs(graph.modules * BenchmarkModule::NUM_INPUTS);
+    const uint32_t totalCables = std::min(graph.cables + graph.feedbackCables,
+                                          graph.modules * BenchmarkModule::NUM_INPUTS);
+
+    for (uint32_t c = 0; c < totalCables; ++c)
+    {
+        const bool feedback = c >= graph.cables;
+        uint32_t outputModule, inputModule, inputId;
+        int attempts = 0;
+
+        // give up on this cable if its side of the graph has no free inputs left
+        do {
+            const uint32_t a = std::uniform_int_distribution<uint32_t>(0, graph.modules - 2)(rng);
+            const uint32_t b = std::uniform_int_distribution<uint32_t>(a + 1, graph.modules - 1)(rng);
+            outputModule = feedback ? b : a;
+            inputModule = feedback ? a : b;
+            inputId = std::uniform_int_distribution<uint32_t>(0, BenchmarkModule::NUM_INPUTS - 1)(rng);
+        } while (usedInputs[inputModule * BenchmarkModule::NUM_INPUTS + inputId] && ++attempts < 1000);
+
+        if (usedInputs[inputModule * BenchmarkModule::NUM_INPUTS + inputId])
+            continue;
+
+        usedInputs[inputModule * BenchmarkModule::NUM_INPUTS + inputId] = true;
+
+        Cable* const cable = new Cable;
+        cable->outputModule = modules[outputModule];
+        cable->outputId = std::uniform_int_distribution<int>(0, BenchmarkModule::NUM_OUTPUTS - 1)(rng);
+        cable->inputModule = modules[inputModule];
+        cable->inputId = inputId;
+        engine->addCable(cable);
+    }
+}
+
+static BenchmarkResult runEngine(CardinalPluginContext* const context, const BenchmarkOptions& options, const std::string& name)
+{
+    rack::engine::Engine* const engine = context->engine;
+    BenchmarkResult result;
+    result.name = name;
+    result.modules = engine->getNumModules();
+    result.cables = engine->getCableIds().size();
+
+    const uint64_t totalFrames = static_cast<uint64_t>(options.seconds * options.sampleRate + 0.5);
+    const uint32_t bufferSize = options.bufferSize;
+
+    std::vector<float> outputData(DISTRHO_PLUGIN_NUM_OUTPUTS * bufferSize);
+    float* dataOuts[DISTRHO_PLUGIN_NUM_OUTPUTS] = {};
+
+    for (uint32_t i = 0; i < CARDINAL_NUM_AUDIO_OUTPUTS; ++i)
+        dataOuts[i] = outputData.data() + i * bufferSize;
+
+    context->dataIns = nullptr;
+    context->dataOuts = dataOuts;
+    context->playing = true;
+
+    const auto stepBlock = [&](const uint64_t frame) {
+        context->frame = frame;
+        context->reset = frame == 0;
+        std::memset(outputData.data(), 0, sizeof(float) * outputData.size());
+        ++context->processCounter;
+        engine->stepBlock(bufferSize);
+    };
+
+    // warm up caches, worker threads and module state before measuring
+    const uint64_t warmupFrames = std::max<uint64_t>(bufferSize, totalFrames / 10);
+    uint64_t frame = 0;
+
+    for (; frame < warmupFrames; frame += bufferSize)
+        stepBlock(frame);
+
+    CpuCounters counters;
+    counters.start();
+    const auto start = std::chrono::steady_clock::now();
+
+    for (uint64_t measured = 0; measured < totalFrames; measured += bufferSize, frame += bufferSize)
+        stepBlock(frame);
+
+    const auto end = std::chrono::steady_clock::now();
+    counters.stop();
+
+    result.frames = (totalFrames + bufferSize - 1) / bufferSize * bufferSize;
+
+    const double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    result.nsPerFrame = ns / result.frames;
+    result.nsPerModule = result.modules != 0 ? result.nsPerFrame / result.modules : 0.0;
+    result.realtimeFactor = ns > 0.0 ? (result.frames / options.sampleRate) / (ns * 1e-9) : 0.0;
+
+    for (int i = 0; i < CpuCounters::kCounterCount; ++i)
+    {
+        result.counters[i] = counters.isAvailable(i);
+        result.countersPerFrame[i] = static_cast<double>(counters.values[i]) / result.frames;
+    }
+
+    return result;
+}
+
+static bool runSynthetic(const BenchmarkOptions& options, const SyntheticGraph& graph, BenchmarkResult& result)
+{
+    CardinalPluginContext* const context = createContext(options);
+    buildSyntheticGraph(context->engine, graph, options.seed);
+    result = runEngine(context, options, graph.getName());
+    destroyContext(context);
+    return true;
+}
+
+static bool runPatch(const BenchmarkOptions& options, const std::string& patchPath, BenchmarkResult& result)
+{
+    CardinalPluginContext* const context = createContext(options);
+
+    char uidBuf[32];
+    std::snprintf(uidBuf, sizeof(uidBuf), "CardinalBenchmark.%08x", rack::random::u32());
+    context->patch->autosavePath = rack::system::join(rack::system::getTempDirectory(), uidBuf);
+    rack::system::createDirectories(context->patch->autosavePath);
+
+    bool ok = false;
+
+    try {
+        context->patch->load(patchPath);
+        result = runEngine(context, options, rack::system::getStem(patchPath));
+        ok = true;
+    } catch (rack::Exception& e) {
+        d_stderr2("Failed to load patch \"%s\": %s", patchPath.c_str(), e.what());
+    }
+
+    const std::string autosavePath = context->patch->autosavePath;
+    destroyContext(context);
+    rack::system::removeRecursively(autosavePath);
+
+    return ok;
+}
+
+static StimulusModule* addStimulus(rack::engine::Engine* const engine, const StimulusModule::Stimulus stimulus)
+{
+    StimulusModule* const module = static_cast<StimulusModule*>(getStimulusModel()->createModule());
+    module->id = 1;
+    module->stimulus = stimulus;
+    engine->addModule(module);
+    return module;
+}
+
+static bool runStimulus(const BenchmarkOptions& options, const StimulusModule::Stimulus stimulus, BenchmarkResult& result)
+{
+    CardinalPluginContext* const context = createContext(options);
+    addStimulus(context->engine, stimulus);
+    result = runEngine(context, options, rack::string::f("stimulus/%s", kStimulusNames[stimulus]));
+    destroyContext(context);
+    return true;
+}
+
+// a single module of a model, with the stimulus connected to all of its inputs
+static bool runModel(const BenchmarkOptions& options,
+                     rack::plugin::Model* const model,
+                     const StimulusModule::Stimulus stimulus,
+                     const double stimulusNsPerFrame,
+                     BenchmarkResult& result)
+{
+    using namespace rack::engine;
+
+    CardinalPluginContext* const context = createContext(options);
+    Engine* const engine = context->engine;
+
+    StimulusModule* const stimulusModule = addStimulus(engine, stimulus);
+
+    Module* module = nullptr;
+    const auto start = std::chrono::steady_clock::now();
+    modulemem::beginConstruction(model);
+    try {
+        module = model->createModule();
+    } catch (rack::Exception& e) {
+        d_stderr2("Failed to create module %s: %s", model->getFullName().c_str(), e.what());
+    }
+    modulemem::endConstruction(module);
+    const auto end = std::chrono::steady_clock::now();
+
+    if (module == nullptr)
+    {
+        destroyContext(context);
+        return false;
+    }
+
+    module->id = 2;
+    engine->addModule(module);
+
+    for (int i = 0, count = module->inputs.size(); i < count; ++i)
+    {
+        Cable* const cable = new Cable;
+        cable->outputModule = stimulusModule;
+        cable->outputId = 0;
+        cable->inputModule = module;
+        cable->inputId = i;
+        engine->addCable(cable);
+    }
+
+    result = runEngine(context, options, rack::string::f("%s/%s/%s", model->plugin->slug.c_str(),
+                                                         model->slug.c_str(), kStimulusNames[stimulus]));
+    result.nsPerModule = std::max(0.0, result.nsPerFrame - stimulusNsPerFrame);
+    result.constructionUs = std::chrono::duration<double, std::micro>(end - start).count();
+    result.memoryBytes = modulemem::getModuleBytes(module);
+
+    destroyContext(context);
+    return true;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// CSV results, used as the baseline of later runs
+
+static void writeResults(const std::string& path, const std::vector<BenchmarkResult>& results)
+{
+    std::ofstream file(path);
+    DISTRHO_SAFE_ASSERT_RETURN(file.good(),);
+
+    file << "name,modules,cables,frames,ns_per_frame,ns_per_module,realtime_factor";
+    for (int i = 0; i < CpuCounters::kCounterCount; ++i)
+        file << "," << kCounterNames[i] << "_per_frame";
+    file << ",construction_us,memory_bytes\n";
+
+    for (const BenchmarkResult& result : results)
+    {
+        file << result.name << "," << result.modules << "," << result.cables << "," << result.frames << ","
+             << result.nsPerFrame << "," << result.nsPerModule << "," << result.realtimeFactor;
+        for (int i = 0; i < CpuCounters::kCounterCount; ++i)
+            file << "," << (result.counters[i] ? result.countersPerFrame[i] : 0.0);
+        file << "," << result.constructionUs << "," << result.memoryBytes << "\n";
+    }
+}
+
+static void writeResultsJson(const std::string& path, const std::vector<BenchmarkResult>& results)
+{
+    json_t* const rootJ = json_array();
+
+    for (const BenchmarkResult& result : results)
+    {
+        json_t* const resultJ = json_object();
+        json_object_set_new(resultJ, "name", json_string(result.name.c_str()));
+        json_object_set_new(resultJ, "modules", json_integer(result.modules));
+        json_object_set_new(resultJ, "cables", json_integer(result.cables));
+        json_object_set_new(resultJ, "frames", json_integer(result.frames));
+        json_object_set_new(resultJ, "nsPerFrame", json_real(result.nsPerFrame));
+        json_object_set_new(resultJ, "nsPerModule", json_real(result.nsPerModule));
+        json_object_set_new(resultJ, "realtimeFactor", json_real(result.realtimeFactor));
+        for (int i = 0; i < CpuCounters::kCounterCount; ++i)
+        {
+            if (result.counters[i])
+                json_object_set_new(resultJ, kCounterNames[i], json_real(result.countersPerFrame[i]));
+        }
+        json_object_set_new(resultJ, "constructionUs", json_real(result.constructionUs));
+        json_object_set_new(resultJ, "memoryBytes", json_integer(result.memoryBytes));
+        json_array_append_new(rootJ, resultJ);
+    }
+
+    if (json_dump_file(rootJ, path.c_str(), JSON_INDENT(2)) != 0)
+        d_stderr2("Failed to write results to \"%s\"", path.c_str());
+
+    json_decref(rootJ);
+}
+
+static std::map<std::string, double> readBaseline(const std::string& path)
+{
+    std::map<std::string, double> baseline;
+    std::ifstream file(path);
+    std::string line;
+
+    // skip header
+    std::getline(file, line);
+
+    while (std::getline(file, line))
+    {
+        std::vector<std::string> fields;
+        size_t pos = 0;
+
+        for (size_t comma; (comma = line.find(',', pos)) != std::string::npos; pos = comma + 1)
+            fields.push_back(line.substr(pos, comma - pos));
+        fields.push_back(line.substr(pos));
+
+        if (fields.size() > 4)
+            baseline[fields[0]] = std::atof(fields[4].c_str());
+    }
+
+    return baseline;
+}
+
+static void printResult(const BenchmarkResult& result)
+{
+    std::printf("%-40s %6zu modules %6zu cables %10.1f ns/frame %8.2f ns/module %8.1fx realtime",
+                result.name.c_str(), result.modules, result.cables,
+                result.nsPerFrame, result.nsPerModule, result.realtimeFactor);
+
+    for (int i = 0; i < CpuCounters::kCounterCount; ++i)
+    {
+        if (result.counters[i])
+            std::printf(" %10.1f %s/frame", result.countersPerFrame[i], kCounterNames[i]);
+    }
+
+    if (result.constructionUs > 0.0)
+        std::printf(" %10.1f us construction", result.constructionUs);
+
+    if (result.memoryBytes > 0)
+        std::printf(" %10lld bytes", static_cast<long long>(result.memoryBytes));
+
+    std::printf("\n");
+}
+
+static void printUsage(const char* const name)
+{
+    std::fprintf(stderr,
+                 "Usage: %s [options] [patch.vcv...]\n"
+                 "Measures Cardinal engine performance on synthetic graphs, or on the given patches.\n"
+                 "Without a graph description or patches, a standard suite of synthetic graphs is run.\n"
+                 "\n"
+                 "Models in isolation:\n"
+                 "  --models                    benchmark every bundled model alone, fed with silence,\n"
+                 "                              audio and 16 channel CV, ns/module is its cost over the stimulus\n"
+                 "  --filter <text>             only models whose plugin/model slug contains this text\n"
+                 "\n"
+                 "Graph description:\n"
+                 "  --modules <count>           number of modules\n"
+                 "  --cables <count>            number of forward cables\n"
+                 "  --polyphony <channels>      channels of every output\n"
+                 "  --expanders <length>        group modules into expander chains of this length\n"
+                 "  --feedback <count>          number of cables going back to earlier modules\n"
+                 "\n"
+                 "Run options:\n"
+                 "  -s, --seconds <seconds>     audio time to measure per benchmark (default: 2)\n"
+                 "  -r, --sample-rate <rate>    sample rate in Hz (default: 48000)\n"
+                 "  -b, --buffer-size <frames>  engine block size (default: 512)\n"
+                 "  -t, --threads <count>       engine threads (default: 1)\n"
+                 "  --seed <value>              random seed for synthetic graphs (default: 1)\n"
+                 "  --csv <path>                write results as CSV\n"
+                 "  --json <path>               write results as JSON\n"
+                 "  --baseline <path>           compare against a previous CSV, failing on regressions\n"
+                 "  --tolerance <percent>       allowed ns/frame increase over the baseline (default: 10)\n"
+                 "\n"
+                 "Memory is only reported when built with MODULE_MEMORY=true.\n",
+                 name);
+}
+
+int main(const int argc, const char* argv[])
+{
+    using namespace rack;
+
+    BenchmarkOptions options;
+    SyntheticGraph graph;
+    bool customGraph = false;
+    bool benchmarkModels = false;
+    std::string modelFilter;
+    std::vector<std::string> patchPaths;
+
+    for (int i=1; i<argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--modules" && hasValue)
+        {
+            graph.modules = std::atoi(argv[++i]);
+            customGraph = true;
+        }
+        else if (arg == "--cables" && hasValue)
+        {
+            graph.cables = std::atoi(argv[++i]);
+            customGraph = true;
+        }
+        else if (arg == "--polyphony" && hasValue)
+        {
+            graph.polyphony = std::atoi(argv[++i]);
+            customGraph = true;
+        }
+        else if (arg == "--expanders" && hasValue)
+        {
+            graph.expanderChain = std::atoi(argv[++i]);
+            customGraph = true;
+        }
+        else if (arg == "--feedback" && hasValue)
+        {
+            graph.feedbackCables = std::atoi(argv[++i]);
+            customGraph = true;
+        }
+        else if (arg == "--models")
+            benchmarkModels = true;
+        else if (arg == "--filter" && hasValue)
+            modelFilter = argv[++i];
+        else if ((arg == "-s" || arg == "--seconds") && hasValue)
+            options.seconds = std::atof(argv[++i]);
+        else if ((arg == "-r" || arg == "--sample-rate") && hasValue)
+            options.sampleRate = std::atof(argv[++i]);
+        else if ((arg == "-b" || arg == "--buffer-size") && hasValue)
+            options.bufferSize = std::atoi(argv[++i]);
+        else if ((arg == "-t" || arg == "--threads") && hasValue)
+            options.threads = std::atoi(argv[++i]);
+        else if (arg == "--seed" && hasValue)
+            options.seed = std::atoi(argv[++i]);
+        else if (arg == "--csv" && hasValue)
+            options.csvPath = argv[++i];
+        else if (arg == "--json" && hasValue)
+            options.jsonPath = argv[++i];
+        else if (arg == "--baseline" && hasValue)
+            options.baselinePath = argv[++i];
+        else if (arg == "--tolerance" && hasValue)
+            options.tolerance = std::atof(argv[++i]);
+        else if (arg[0] != '-')
+            patchPaths.push_back(arg);
+        else
+        {
+            printUsage(argv[0]);
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+    }
+
+    if (options.seconds <= 0.0 || options.sampleRate <= 0.0 || options.bufferSize == 0 || options.threads == 0)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // --------------------------------------------------------------------------
+
+    settings::allowCursorLock = false;
+    settings::autoCheckUpdates = false;
+    settings::autosaveInterval = 0;
+    settings::devMode = true;
+    settings::headless = true;
+    settings::isPlugin = true;
+    settings::skipLoadOnLaunch = true;
+    settings::showTipsOnLaunch = false;
+    settings::sampleRate = options.sampleRate;
+    settings::threadCount = options.threads;
+
+    system::init();
+    logger::init();
+    random::init();
+    ui::init();
+
+   #ifdef CARDINAL_PLUGIN_SOURCE_DIR
+    // Make system dir point to source code location as fallback
+    asset::systemDir = CARDINAL_PLUGIN_SOURCE_DIR DISTRHO_OS_SEP_STR "Rack";
+    asset::bundlePath.clear();
+
+    // If source code dir does not exist use install target prefix as system dir
+    if (!system::exists(system::join(asset::systemDir, "res")))
+   #endif
+    {
+       #if defined(ARCH_MAC)
+        asset::systemDir = "/Library/Application Support/Cardinal";
+       #elif defined(ARCH_WIN)
+        const std::string commonprogfiles = getSpecialPath(kSpecialPathCommonProgramFiles);
+        if (! commonprogfiles.empty())
+            asset::systemDir = system::join(commonprogfiles, "Cardinal");
+       #else
+        asset::systemDir = CARDINAL_PLUGIN_PREFIX "/share/cardinal";
+       #endif
+
+        asset::bundlePath = system::join(asset::systemDir, "PluginManifests");
+    }
+
+    asset::userDir = asset::systemDir;
+
+    INFO("%s %s %s, compatible with Rack version %s", APP_NAME.c_str(), APP_EDITION.c_str(), CARDINAL_VERSION.c_str(), APP_VERSION.c_str());
+    INFO("%s", system::getOperatingSystemInfo().c_str());
+
+    // patches and models need the real plugins, synthetic graphs only use the benchmark module
+    const bool needsPlugins = benchmarkModels || ! patchPaths.empty();
+
+    if (needsPlugins)
+    {
+        INFO("Initializing plugins");
+        plugin::initStaticPlugins();
+
+        INFO("Initializing plugin browser DB");
+        app::browserInit();
+    }
+
+    // --------------------------------------------------------------------------
+
+    std::vector<SyntheticGraph> graphs;
+
+    if (customGraph)
+    {
+        graphs.push_back(graph);
+    }
+    else if (patchPaths.empty() && ! benchmarkModels)
+    {
+        // standard suite, scaling module count, polyphony, expanders and feedback separately
+        static const uint32_t suite[][5] = {
+            {   16,   32,  1,  0,   0 },
+            {  128,  256,  1,  0,   0 },
+            {  512, 1024,  1,  0,   0 },
+            {  128,  256, 16,  0,   0 },
+            {  128,  128,  1,  8,   0 },
+            {  128,  256,  1,  0,  32 },
+            { 1024, 2048,  4,  4,  64 },
+        };
+
+        for (const uint32_t* const s : suite)
+        {
+            SyntheticGraph g;
+            g.modules = s[0];
+            g.cables = s[1];
+            g.polyphony = s[2];
+            g.expanderChain = s[3];
+            g.feedbackCables = s[4];
+            graphs.push_back(g);
+        }
+    }
+
+    std::vector<BenchmarkResult> results;
+    bool failed = false;
+
+    for (const SyntheticGraph& g : graphs)
+    {
+        BenchmarkResult result;
+        if (runSynthetic(options, g, result))
+        {
+            printResult(result);
+            results.push_back(result);
+        }
+    }
+
+    for (const std::string& patchPath : patchPaths)
+    {
+        BenchmarkResult result;
+        if (runPatch(options, patchPath, result))
+        {
+            printResult(result);
+            results.push_back(result);
+        }
+        else
+        {
+            failed = true;
+        }
+    }
+
+    if (benchmarkModels)
+    {
+        std::vector<BenchmarkResult> modelResults;
+        double stimulusNsPerFrame[StimulusModule::kStimulusCount];
+
+        for (int s = 0; s < StimulusModule::kStimulusCount; ++s)
+        {
+            BenchmarkResult result;
+            runStimulus(options, static_cast<StimulusModule::Stimulus>(s), result);
+            stimulusNsPerFrame[s] = result.nsPerFrame;
+            printResult(result);
+            results.push_back(result);
+        }
+
+        for (plugin::Plugin* const p : plugin::plugins)
+        {
+            for (plugin::Model* const model : p->models)
+            {
+                const std::string slug = p->slug + "/" + model->slug;
+
+                if (! modelFilter.empty() && slug.find(modelFilter) == std::string::npos)
+                    continue;
+
+                for (int s = 0; s < StimulusModule::kStimulusCount; ++s)
+                {
+                    BenchmarkResult result;
+                    if (runModel(options, model, static_cast<StimulusModule::Stimulus>(s), stimulusNsPerFrame[s], result))
+                    {
+                        printResult(result);
+                        modelResults.push_back(result);
+                    }
+                    else
+                        failed = true;
+                }
+            }
+        }
+
+        // most expensive first in the written results
+        std::stable_sort(modelResults.begin(), modelResults.end(), [](const BenchmarkResult& a, const BenchmarkResult& b) {
+            return a.nsPerModule > b.nsPerModule;
+        });
+
+        results.insert(results.end(), modelResults.begin(), modelResults.end());
+    }
+
+    if (! options.csvPath.empty())
+        writeResults(options.csvPath, results);
+
+    if (! options.jsonPath.empty())
+        writeResultsJson(options.jsonPath, results);
+
+    if (! options.baselinePath.empty())
+    {
+        const std::map<std::string, double> baseline = readBaseline(options.baselinePath);
+
+        for (const BenchmarkResult& result : results)
+        {
+            const auto it = baseline.find(result.name);
+            if (it == baseline.end() || it->second <= 0.0)
+                continue;
+
+            const double change = 100.0 * (result.nsPerFrame / it->second - 1.0);
+
+            if (change > options.tolerance)
+            {
+                std::printf("REGRESSION %s: %.1f ns/frame, baseline %.1f ns/frame (%+.1f%%)\n",
+                            result.name.c_str(), result.nsPerFrame, it->second, change);
+                failed = true;
+            }
+        }
+    }
+
+    // --------------------------------------------------------------------------
+
+    asset::bundlePath.clear();
+    asset::systemDir.clear();
+    asset::userDir.clear();
+
+    if (needsPlugins)
+        plugin::destroyStaticPlugins();
+
+    asset::destroy();
+    settings::destroy();
+    logger::destroy();
+
+    return failed ? 1 : 0;
+}
@@ -28,20 +28,36 @@
 #include "CardinalCommon.hpp"
 
 #include "AsyncDialog.hpp"
+#include "MemoryUsage.hpp"
+#include "ModuleMemory.hpp"
 #include "PluginContext.hpp"
+#include "ResourcePack.hpp"
+#include "StartupTrace.hpp"
 #include "DistrhoPluginUtils.hpp"
 
 #include <asset.hpp>
 #include <context.hpp>
+#include <helpers.hpp>
 #include <history.hpp>
 #include <patch.hpp>
+#include <plugin.hpp>
 #include <settings.hpp>
 #include <string.hpp>
 #include <system.hpp>
 #include <app/Browser.hpp>
+#include <app/CableWidget.hpp>
+#include <app/ModuleWidget.hpp>
+#include <app/RackWidget.hpp>
 #include <app/Scene.hpp>
+#include <engine/Engine.hpp>
 #include <window/Window.hpp>
 
+#include <archive.h>
+#include <archive_entry.h>
+
+#include <algorithm>
+#include <thread>
+
 #ifdef NDEBUG
 # undef DEBUG
 #endif
@@ -81,6 +97,18 @@ namespace asset {
 std::string patchesPath();
 void destroy();
 }
+namespace engine {
+void Engine_preparePatch(Engine*, json_t* rootJ);
+void Engine_beginPreparePatch(Engine*, const std::function<json_t*()>& parse);
+json_t* Engine_finishPreparePatch(Engine*);
+void Engine_cancelPreparePatch(Engine*);
+void Engine_addLoadProfileStage(Engine*, const char* name, double time);
+json_t* Engine_getBlockStatsJson(Engine*);
+void Engine_resetBlockStats(Engine*);
+json_t* Engine_getLoadProfileJson(Engine*);
+void Engine_beginEdits(Engine*);
+void Engine_endEdits(Engine*);
+}
 namespace plugin {
 void initStaticPlugins();
 void destroyStaticPlugins();
@@ -110,12 +138,24 @@ void handleHostParameterDrag(const CardinalPluginContext* pcontext, uint index,
 
 // --------------------------------------------------------------------------------------------------------------------
 
+// idle budget of module callbacks per UI idle tick, the rest of the tick belongs to drawing
+static constexpr const double kIdleCallbackBudget = 0.004;
+
+// callbacks of hidden or off screen widgets run at a quarter of their rate, and at most this often
+static constexpr const double kIdleHiddenInterval = 0.1;
+
 bool CardinalPluginContext::addIdleCallback(IdleCallback* const cb) const
+{
+    return addIdleCallback(cb, 0.0, kIdlePriorityNormal, nullptr);
+}
+
+bool CardinalPluginContext::addIdleCallback(IdleCallback* const cb, const double rate, const int priority,
+                                            rack::widget::Widget* const widget) const
 {
     if (ui == nullptr)
         return false;
 
-    ui->addIdleCallback(cb);
+    static_cast<CardinalBaseUI*>(ui)->idleScheduler.add(cb, rate, priority, widget);
     return true;
 }
 
@@ -124,7 +164,118 @@ void CardinalPluginContext::removeIdleCallback(IdleCallback* const cb) const
     if (ui == nullptr)
         return;
 
-    ui->removeIdleCallback(cb);
+    static_cast<CardinalBaseUI*>(ui)->idleScheduler.remove(cb);
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+static bool isWidgetShown(rack::widget::Widget* const widget)
+{
+    rack::widget::Widget* root = widget;
+
+    for (;; root = root->parent)
+    {
+        if (! root->isVisible())
+            return false;
+        if (root->parent == nullptr)
+            break;
+    }
+
+    // not part of the scene yet, or anymore
+    if (dynamic_cast<rack::app::Scene*>(root) == nullptr)
+        return false;
+
+    const rack::math::Vec topLeft = widget->getRelativeOffset(rack::math::Vec(), root);
+    const rack::math::Vec bottomRight = widget->getRelativeOffset(widget->box.size, root);
+
+    return rack::math::Rect::fromMinMax(topLeft, bottomRight).intersects(root->box.zeroPos());
+}
+
+void CardinalIdleScheduler::add(IdleCallback* const cb, const double rate, const int priority,
+                                rack::widget::Widget* const widget)
+{
+    const double interval = rate > 0.0 ? 1.0 / rate : 0.0;
+
+    for (Entry& entry : entries)
+    {
+        if (entry.callback == cb)
+        {
+            entry.interval = interval;
+            entry.priority = priority;
+            entry.widget = widget;
+            return;
+        }
+    }
+
+    entries.push_back({ cb, interval, priority, widget, 0.0 });
+}
+
+void CardinalIdleScheduler::remove(IdleCallback* const cb)
+{
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (entries[i].callback != cb)
+            continue;
+
+        // callbacks may remove themselves or others while being dispatched, entries are compacted afterwards
+        if (dispatching)
+            entries[i].callback = nullptr;
+        else
+            entries.erase(entries.begin() + i);
+        return;
+    }
+}
+
+void CardinalIdleScheduler::idleCallback()
+{
+    const double startTime = rack::system::getTime();
+
+    due.clear();
+
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (entries[i].callback != nullptr && entries[i].nextTime <= startTime)
+            due.push_back(i);
+    }
+
+    if (due.empty())
+        return;
+
+    // higher priority first, then the ones left over by the budget of previous ticks
+    std::stable_sort(due.begin(), due.end(), [this](const size_t a, const size_t b) {
+        if (entries[a].priority != entries[b].priority)
+            return entries[a].priority > entries[b].priority;
+        return entries[a].nextTime < entries[b].nextTime;
+    });
+
+    dispatching = true;
+
+    for (const size_t index : due)
+    {
+        // callbacks may add others, entries is not to be referenced across the call
+        IdleCallback* const cb = entries[index].callback;
+        if (cb == nullptr)
+            continue;
+
+        double interval = entries[index].interval;
+
+        if (entries[index].widget != nullptr && ! isWidgetShown(entries[index].widget))
+            interval = std::max(interval * 4, kIdleHiddenInterval);
+
+        // allow some jitter from the host idle timer, as done for repainting
+        entries[index].nextTime = startTime + interval * 0.9;
+
+        cb->idleCallback();
+
+        if (rack::system::getTime() - startTime >= kIdleCallbackBudget)
+            break;
+    }
+
+    dispatching = false;
+
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [](const Entry& entry) {
+        return entry.callback == nullptr;
+    }), entries.end());
 }
 
 void CardinalPluginContext::writeMidiMessage(const rack::midi::Message& message, const uint8_t channel)
@@ -137,7 +288,7 @@ void CardinalPluginContext::writeMidiMessage(const rack::midi::Message& message,
     DISTRHO_SAFE_ASSERT_RETURN(message.frame >= 0,);
 
     MidiEvent event;
-    event.frame = message.frame;
+    event.frame = message.frame / oversampling + midiOutFrameOffset;
 
     switch (message.bytes[0] & 0xF0)
     {
@@ -191,7 +342,52 @@ void CardinalPluginContext::writeMidiMessage(const rack::midi::Message& message,
     if (channel != 0 && event.data[0] < 0xF0)
         event.data[0] |= channel & 0x0F;
 
-    plugin->writeMidiEvent(event);
+    if (midiOutEvents == nullptr)
+    {
+        plugin->writeMidiEvent(event);
+        return;
+    }
+
+    // continuous messages sent again on the same host frame replace the previous value,
+    // common with oversampling where several engine frames map to a single host frame
+    uint8_t matchSize;
+
+    switch (event.data[0] & 0xF0)
+    {
+    case 0xA0:
+    case 0xB0:
+        matchSize = 2;
+        break;
+    case 0xD0:
+    case 0xE0:
+        matchSize = 1;
+        break;
+    default:
+        matchSize = 0;
+        break;
+    }
+
+    for (uint32_t i = midiOutEventCount; matchSize != 0 && i-- != 0;)
+    {
+        MidiEvent& other(midiOutEvents[i]);
+
+        if (other.frame != event.frame)
+            break;
+
+        // never move a value across other kinds of messages
+        const uint8_t otherStatus = other.data[0] & 0xF0;
+        if (otherStatus < 0xA0 || otherStatus == 0xC0 || otherStatus == 0xF0)
+            break;
+
+        if (std::memcmp(other.data, event.data, matchSize) == 0)
+        {
+            std::memcpy(other.data, event.data, event.size);
+            return;
+        }
+    }
+
+    if (midiOutEventCount < midiOutEventCapacity)
+        midiOutEvents[midiOutEventCount++] = event;
 }
 
 // -----------------------------------------------------------------------------------------------------------
@@ -208,17 +404,81 @@ static int osc_fallback_handler(const char* const path, const char* const types,
     return 0;
 }
 
-static int osc_hello_handler(const char*, const char*, lo_arg**, int, const lo_message m, void* const self)
+// Messages can start with the id of the instance they are meant for, as in "/load" "ib".
+// Regular typespecs never start with an int, so the id is taken off before the usual checks.
+static int32_t takeOscInstanceId(const char*& types, lo_arg**& argv, int& argc)
+{
+    if (types == nullptr || types[0] != 'i' || argc < 1)
+        return 0;
+
+    const int32_t id = argv[0]->i;
+    ++types;
+    ++argv;
+    --argc;
+    return id;
+}
+
+// the first instance is used when no id is given, the caller must hold oscPluginsMutex
+static CardinalBasePlugin* getOscPlugin(Initializer* const initializer, const int32_t id)
+{
+    for (const std::pair<int32_t, CardinalBasePlugin*>& oscPlugin : initializer->oscPlugins)
+    {
+        if (id == 0 || oscPlugin.first == id)
+            return oscPlugin.second;
+    }
+
+    return nullptr;
+}
+
+static int osc_hello_handler(const char*, const char* types, lo_arg** argv, int argc, const lo_message m, void* const self)
 {
     d_stdout("osc_hello_handler()");
+    Initializer* const initializer = static_cast<Initializer*>(self);
     const lo_address source = lo_message_get_source(m);
-    lo_send_from(source, static_cast<Initializer*>(self)->oscServer, LO_TT_IMMEDIATE, "/resp", "ss", "hello", "ok");
+
+    // lights are streamed for a single instance
+    initializer->oscTelemetryInstance = takeOscInstanceId(types, argv, argc);
+
+    // stream lights back to whoever connected last
+    if (initializer->oscTelemetryAddress != nullptr)
+        lo_address_free(initializer->oscTelemetryAddress);
+    initializer->oscTelemetryAddress = lo_address_new_with_proto(LO_UDP,
+                                                                 lo_address_get_hostname(source),
+                                                                 lo_address_get_port(source));
+    initializer->oscTelemetryLights.clear();
+
+    lo_send_from(source, initializer->oscServer, LO_TT_IMMEDIATE, "/resp", "ss", "hello", "ok");
     return 0;
 }
 
+static bool loadRemotePatch(Initializer* const initializer, const int32_t instanceId, const std::vector<uint8_t>& data)
+{
+    bool ok = false;
+
+    const MutexLocker cml(initializer->oscPluginsMutex);
+
+    if (CardinalBasePlugin* const plugin = getOscPlugin(initializer, instanceId))
+    {
+        CardinalPluginContext* const context = plugin->context;
+
+        rack::contextSet(context);
+        try {
+            patchUtils::loadFromMemory(data.data(), data.size());
+            ok = true;
+        }
+        catch (rack::Exception& e) {
+            WARN("%s", e.what());
+        }
+        rack::contextSet(nullptr);
+    }
+
+    return ok;
+}
+
 static int osc_load_handler(const char*, const char* types, lo_arg** argv, int argc, const lo_message m, void* const self)
 {
     d_stdout("osc_load_handler()");
+    const int32_t instanceId = takeOscInstanceId(types, argv, argc);
     DISTRHO_SAFE_ASSERT_RETURN(argc == 1, 0);
     DISTRHO_SAFE_ASSERT_RETURN(types != nullptr && types[0] == 'b', 0);
 
@@ -228,55 +488,599 @@ static int osc_load_handler(const char*, const char* types, lo_arg** argv, int a
     const uint8_t* const blob = (uint8_t*)(&argv[0]->blob.data);
     DISTRHO_SAFE_ASSERT_RETURN(blob != nullptr, 0);
 
+    std::vector<uint8_t> data(size);
+    std::memcpy(data.data(), blob, size);
+
+    const bool ok = loadRemotePatch(static_cast<Initializer*>(self), instanceId, data);
+
+    const lo_address source = lo_message_get_source(m);
+    lo_send_from(source, static_cast<Initializer*>(self)->oscServer,
+                    LO_TT_IMMEDIATE, "/resp", "ss", "load", ok ? "ok" : "fail");
+    return 0;
+}
+
+static int osc_load_chunk_handler(const char*, const char* types, lo_arg** argv, int argc, const lo_message m, void* const self)
+{
+    const int32_t instanceId = takeOscInstanceId(types, argv, argc);
+    DISTRHO_SAFE_ASSERT_RETURN(argc == 4, 0);
+    DISTRHO_SAFE_ASSERT_RETURN(types != nullptr && std::strcmp(types, "hiib") == 0, 0);
+
+    Initializer* const initializer = static_cast<Initializer*>(self);
+    const int64_t hash = argv[0]->h;
+    const int32_t index = argv[1]->i;
+    const int32_t count = argv[2]->i;
+    DISTRHO_SAFE_ASSERT_RETURN(count > 0 && index >= 0 && index < count, 0);
+
+    const int32_t size = argv[3]->blob.size;
+    DISTRHO_SAFE_ASSERT_RETURN(size > 0, 0);
+
+    const uint8_t* const blob = (uint8_t*)(&argv[3]->blob.data);
+    DISTRHO_SAFE_ASSERT_RETURN(blob != nullptr, 0);
+
+    // chunks of a different archive start a new transfer
+    if (initializer->oscTransferHash != hash || initializer->oscTransferChunks.size() != static_cast<size_t>(count))
+    {
+        initializer->oscTransferHash = hash;
+        initializer->oscTransferChunks.clear();
+        initializer->oscTransferChunks.resize(count);
+        initializer->oscTransferReceived = 0;
+    }
+
+    std::vector<uint8_t>& chunk(initializer->oscTransferChunks[index]);
+    const bool isNewChunk = chunk.empty();
+
+    if (isNewChunk)
+    {
+        chunk.resize(size);
+        std::memcpy(chunk.data(), blob, size);
+        ++initializer->oscTransferReceived;
+    }
+
+    // acknowledge duplicates too, the previous ack may have been lost
+    const lo_address source = lo_message_get_source(m);
+    lo_send_from(source, initializer->oscServer, LO_TT_IMMEDIATE, "/resp/chunk", "hi", hash, index);
+
+    if (!isNewChunk || initializer->oscTransferReceived != static_cast<uint32_t>(count))
+        return 0;
+
+    d_stdout("osc_load_chunk_handler() - received all %i chunks", count);
+
+    std::vector<uint8_t> data;
+    for (const std::vector<uint8_t>& c : initializer->oscTransferChunks)
+        data.insert(data.end(), c.begin(), c.end());
+
+    initializer->oscTransferHash = 0;
+    initializer->oscTransferChunks.clear();
+    initializer->oscTransferReceived = 0;
+
+    const bool ok = patchUtils::hashRemoteData(data.data(), data.size()) == hash
+                 && loadRemotePatch(initializer, instanceId, data);
+
+    lo_send_from(source, initializer->oscServer, LO_TT_IMMEDIATE, "/resp", "ss", "load", ok ? "ok" : "fail");
+    return 0;
+}
+
+// Applies the changes sent by patchUtils::deployChangesToRemote, in the order they are meant to be applied.
+// Modules and cables loaded with the patch are owned by their widgets, so the rack is kept in sync too.
+// Expanders are not updated from module positions, their ids come with the module changes instead.
+static void applyPatchChanges(rack::engine::Engine* const engine, json_t* const rootJ)
+{
+    using namespace rack;
+
+    app::RackWidget* const rack = APP->scene != nullptr ? APP->scene->rack : nullptr;
+
+    size_t i;
+    json_t* itemJ;
+
+    json_array_foreach(json_object_get(rootJ, "removedCables"), i, itemJ)
+    {
+        const int64_t cableId = json_integer_value(itemJ);
+
+        if (app::CableWidget* const cw = rack != nullptr ? rack->getCable(cableId) : nullptr)
+        {
+            // deletes the cable as well
+            rack->removeCable(cw);
+            delete cw;
+        }
+        else if (engine::Cable* const cable = engine->getCable(cableId))
+        {
+            engine->removeCable(cable);
+            delete cable;
+        }
+    }
+
+    json_array_foreach(json_object_get(rootJ, "removedModules"), i, itemJ)
+    {
+        const int64_t moduleId = json_integer_value(itemJ);
+
+        if (app::ModuleWidget* const mw = rack != nullptr ? rack->getModule(moduleId) : nullptr)
+        {
+            // deletes the module as well
+            rack->removeModule(mw);
+            delete mw;
+        }
+        else if (engine::Module* const module = engine->getModule(moduleId))
+        {
+            engine->removeModule(module);
+            delete module;
+            modulemem::removeModule(module);
+        }
+    }
+
+    json_array_foreach(json_object_get(rootJ, "modules"), i, itemJ)
+    {
+        const int64_t moduleId = json_integer_value(json_object_get(itemJ, "id"));
+
+        if (engine::Module* const module = engine->getModule(moduleId))
+        {
+            engine->moduleFromJson(module, itemJ);
+            continue;
+        }
+
+        plugin::Model* model;
+        try {
+            model = plugin::modelFromJson(itemJ);
+        }
+        catch (Exception& e) {
+            WARN("Cannot load model: %s", e.what());
+            continue;
+        }
+
+        modulemem::beginConstruction(model);
+        engine::Module* const module = model->createModule();
+        modulemem::endConstruction(module);
+        DISTRHO_SAFE_ASSERT_CONTINUE(module != nullptr);
+
+        // Create the widget too if needed by the module, otherwise only once there is a rack view for it
+        CardinalPluginModelHelper* const helper = dynamic_cast<CardinalPluginModelHelper*>(model);
+        DISTRHO_SAFE_ASSERT_CONTINUE(helper != nullptr);
+
+        if (plugin::isModuleWidgetNeededOnEngineLoad(model))
+        {
+            app::ModuleWidget* const moduleWidget = helper->createModuleWidgetFromEngineLoad(module);
+            DISTRHO_SAFE_ASSERT_CONTINUE(moduleWidget != nullptr);
+        }
+
+        try {
+            const modulemem::Scope memoryScope(module);
+            module->fromJson(itemJ);
+        }
+        catch (Exception& e) {
+            WARN("Cannot load module: %s", e.what());
+            helper->removeCachedModuleWidget(module);
+            delete module;
+            modulemem::removeModule(module);
+            continue;
+        }
+
+        engine->addModule(module);
+
+        if (rack != nullptr)
+        {
+            // takes the widget created above from the cache, if there is one
+            app::ModuleWidget* const mw = model->createModuleWidget(module);
+            DISTRHO_SAFE_ASSERT_CONTINUE(mw != nullptr);
+
+            double x = 0.0, y = 0.0;
+            json_unpack(json_object_get(itemJ, "pos"), "[F, F]", &x, &y);
+            mw->box.pos = math::Vec(x, y).mult(app::RACK_GRID_SIZE).plus(app::RACK_OFFSET);
+            rack->addModule(mw);
+        }
+    }
+
+    json_array_foreach(json_object_get(rootJ, "params"), i, itemJ)
+    {
+        engine::Module* const module = engine->getModule(json_integer_value(json_array_get(itemJ, 0)));
+        DISTRHO_SAFE_ASSERT_CONTINUE(module != nullptr);
+
+        const int paramId = json_integer_value(json_array_get(itemJ, 1));
+        DISTRHO_SAFE_ASSERT_CONTINUE(paramId >= 0 && static_cast<size_t>(paramId) < module->params.size());
+
+        engine->setParamValue(module, paramId, json_number_value(json_array_get(itemJ, 2)));
+    }
+
+    json_array_foreach(json_object_get(rootJ, "cables"), i, itemJ)
+    {
+        engine::Cable* const cable = new engine::Cable;
+
+        try {
+            cable->fromJson(itemJ);
+            engine->addCable(cable);
+        }
+        catch (Exception& e) {
+            WARN("Cannot load cable: %s", e.what());
+            delete cable;
+            continue;
+        }
+
+        if (rack != nullptr)
+        {
+            app::CableWidget* const cw = new app::CableWidget;
+            cw->setCable(cable);
+            rack->addCable(cw);
+        }
+    }
+}
+
+static int osc_patch_handler(const char*, const char* types, lo_arg** argv, int argc, const lo_message m, void* const self)
+{
+    d_stdout("osc_patch_handler()");
+    const int32_t instanceId = takeOscInstanceId(types, argv, argc);
+    DISTRHO_SAFE_ASSERT_RETURN(argc == 1, 0);
+    DISTRHO_SAFE_ASSERT_RETURN(types != nullptr && types[0] == 's', 0);
+
     bool ok = false;
 
-    if (CardinalBasePlugin* const plugin = static_cast<Initializer*>(self)->oscPlugin)
+    Initializer* const initializer = static_cast<Initializer*>(self);
+    const MutexLocker cml(initializer->oscPluginsMutex);
+
+    if (CardinalBasePlugin* const plugin = getOscPlugin(initializer, instanceId))
     {
         CardinalPluginContext* const context = plugin->context;
-        std::vector<uint8_t> data(size);
-        std::memcpy(data.data(), blob, size);
 
-        rack::contextSet(context);
-        rack::system::removeRecursively(context->patch->autosavePath);
-        rack::system::createDirectories(context->patch->autosavePath);
-        try {
-            rack::system::unarchiveToDirectory(data, context->patch->autosavePath);
-            context->patch->loadAutosave();
+        if (json_t* const rootJ = json_loads(&argv[0]->s, 0, nullptr))
+        {
+            rack::contextSet(context);
+            applyPatchChanges(context->engine, rootJ);
+            rack::contextSet(nullptr);
+            json_decref(rootJ);
             ok = true;
         }
-        catch (rack::Exception& e) {
-            WARN("%s", e.what());
-        }
-        rack::contextSet(nullptr);
     }
 
     const lo_address source = lo_message_get_source(m);
     lo_send_from(source, static_cast<Initializer*>(self)->oscServer,
-                    LO_TT_IMMEDIATE, "/resp", "ss", "load", ok ? "ok" : "fail");
+                    LO_TT_IMMEDIATE, "/resp", "ss", "patch", ok ? "ok" : "fail");
+    return 0;
+}
+
+static int osc_param_handler(const char*, const char* types, lo_arg** argv, int argc, lo_message, void* const self)
+{
+    const int32_t instanceId = takeOscInstanceId(types, argv, argc);
+    DISTRHO_SAFE_ASSERT_RETURN(argc == 3, 0);
+    DISTRHO_SAFE_ASSERT_RETURN(types != nullptr && std::strcmp(types, "hif") == 0, 0);
+
+    Initializer* const initializer = static_cast<Initializer*>(self);
+    const MutexLocker cml(initializer->oscPluginsMutex);
+
+    if (CardinalBasePlugin* const plugin = getOscPlugin(initializer, instanceId))
+    {
+        rack::engine::Engine* const engine = plugin->context->engine;
+        rack::engine::Module* const module = engine->getModule(argv[0]->h);
+        DISTRHO_SAFE_ASSERT_RETURN(module != nullptr, 0);
+
+        const int paramId = argv[1]->i;
+        DISTRHO_SAFE_ASSERT_RETURN(paramId >= 0 && static_cast<size_t>(paramId) < module->params.size(), 0);
+
+        engine->setParamValue(module, paramId, argv[2]->f);
+    }
+
+    return 0;
+}
+
+// Sends lights that changed since last time, quantized to 8 bits.
+// Each module gets a "/lights" message with its id and [u16 light id, u8 brightness] triplets,
+// messages are bundled up to a size that fits a single datagram.
+static void sendLightsTelemetry(Initializer* const initializer)
+{
+    static constexpr const size_t kMaxBundleSize = REMOTE_CHUNK_SIZE;
+
+    const MutexLocker cml(initializer->oscPluginsMutex);
+
+    CardinalBasePlugin* const plugin = getOscPlugin(initializer, initializer->oscTelemetryInstance);
+    if (plugin == nullptr)
+        return;
+
+    rack::engine::Engine* const engine = plugin->context->engine;
+    std::map<int64_t, std::vector<uint8_t>> lights;
+    std::vector<uint8_t> changes;
+    lo_bundle bundle = nullptr;
+
+    for (const int64_t moduleId : engine->getModuleIds())
+    {
+        rack::engine::Module* const module = engine->getModule(moduleId);
+        DISTRHO_SAFE_ASSERT_CONTINUE(module != nullptr);
+
+        if (module->lights.empty())
+            continue;
+
+        std::vector<uint8_t>& values(lights[moduleId]);
+        values.resize(module->lights.size());
+
+        const auto it = initializer->oscTelemetryLights.find(moduleId);
+        const bool known = it != initializer->oscTelemetryLights.end() && it->second.size() == values.size();
+
+        changes.clear();
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            values[i] = static_cast<uint8_t>(rack::math::clamp(module->lights[i].getBrightness(), 0.f, 1.f) * 255.f + 0.5f);
+
+            if (known && it->second[i] == values[i])
+                continue;
+
+            changes.push_back(i & 0xff);
+            changes.push_back(i >> 8);
+            changes.push_back(values[i]);
+        }
+
+        if (changes.empty())
+            continue;
+
+        const lo_message msg = lo_message_new();
+        lo_message_add_int64(msg, moduleId);
+        if (const lo_blob blob = lo_blob_new(changes.size(), changes.data()))
+        {
+            lo_message_add_blob(msg, blob);
+            lo_blob_free(blob);
+        }
+
+        if (bundle != nullptr && lo_bundle_length(bundle) + lo_message_length(msg, "/lights") > kMaxBundleSize)
+        {
+            lo_send_bundle_from(initializer->oscTelemetryAddress, initializer->oscServer, bundle);
+            lo_bundle_free_recursive(bundle);
+            bundle = nullptr;
+        }
+
+        if (bundle == nullptr)
+            bundle = lo_bundle_new(LO_TT_IMMEDIATE);
+
+        lo_bundle_add_message(bundle, "/lights", msg);
+    }
+
+    if (bundle != nullptr)
+    {
+        lo_send_bundle_from(initializer->oscTelemetryAddress, initializer->oscServer, bundle);
+        lo_bundle_free_recursive(bundle);
+    }
+
+    initializer->oscTelemetryLights.swap(lights);
+}
+
+static int osc_screenshot_handler(const char*, const char* types, lo_arg** argv, int argc, const lo_message m, void* const self)
+{
+    d_stdout("osc_screenshot_handler()");
+    const int32_t instanceId = takeOscInstanceId(types, argv, argc);
+    DISTRHO_SAFE_ASSERT_RETURN(argc == 1, 0);
+    DISTRHO_SAFE_ASSERT_RETURN(types != nullptr && types[0] == 'b', 0);
+
+    const int32_t size = argv[0]->blob.size;
+    DISTRHO_SAFE_ASSERT_RETURN(size > 4, 0);
+
+    const uint8_t* const blob = (uint8_t*)(&argv[0]->blob.data);
+    DISTRHO_SAFE_ASSERT_RETURN(blob != nullptr, 0);
+
+    bool ok = false;
+
+    Initializer* const initializer = static_cast<Initializer*>(self);
+
+    {
+        const MutexLocker cml(initializer->oscPluginsMutex);
+
+        if (CardinalBasePlugin* const plugin = getOscPlugin(initializer, instanceId))
+            ok = plugin->updateStateValue("screenshot", String::asBase64(blob, size).buffer());
+    }
+
+    const lo_address source = lo_message_get_source(m);
+    lo_send_from(source, initializer->oscServer,
+                    LO_TT_IMMEDIATE, "/resp", "ss", "screenshot", ok ? "ok" : "fail");
+    return 0;
+}
+
+static int osc_instances_handler(const char*, const char*, lo_arg**, int, const lo_message m, void* const self)
+{
+    Initializer* const initializer = static_cast<Initializer*>(self);
+    const lo_message msg = lo_message_new();
+
+    {
+        const MutexLocker cml(initializer->oscPluginsMutex);
+
+        for (const std::pair<int32_t, CardinalBasePlugin*>& oscPlugin : initializer->oscPlugins)
+            lo_message_add_int32(msg, oscPlugin.first);
+    }
+
+    lo_send_message_from(lo_message_get_source(m), initializer->oscServer, "/resp/instances", msg);
+    lo_message_free(msg);
+    return 0;
+}
+
+// replies with instance id, module count, and average and peak engine load as a fraction of the block time
+static int osc_stats_handler(const char*, const char* types, lo_arg** argv, int argc, const lo_message m, void* const self)
+{
+    const int32_t instanceId = takeOscInstanceId(types, argv, argc);
+    Initializer* const initializer = static_cast<Initializer*>(self);
+    const lo_address source = lo_message_get_source(m);
+
+    const MutexLocker cml(initializer->oscPluginsMutex);
+
+    for (const std::pair<int32_t, CardinalBasePlugin*>& oscPlugin : initializer->oscPlugins)
+    {
+        if (instanceId != 0 && oscPlugin.first != instanceId)
+            continue;
+
+        rack::engine::Engine* const engine = oscPlugin.second->context->engine;
+
+        lo_send_from(source, initializer->oscServer, LO_TT_IMMEDIATE, "/resp/stats", "iiff",
+                     oscPlugin.first,
+                     static_cast<int32_t>(engine->getNumModules()),
+                     static_cast<float>(engine->getMeterAverage()),
+                     static_cast<float>(engine->getMeterMax()));
+    }
+
+    return 0;
+}
+
+// replies with instance id and the block timing histogram, xruns and worst blocks as JSON, optionally resetting them
+static int osc_blockstats_handler(const char* const path, const char* types, lo_arg** argv, int argc, const lo_message m, void* const self)
+{
+    const int32_t instanceId = takeOscInstanceId(types, argv, argc);
+    const bool reset = std::strcmp(path, "/blockstats/reset") == 0;
+    Initializer* const initializer = static_cast<Initializer*>(self);
+    const lo_address source = lo_message_get_source(m);
+
+    const MutexLocker cml(initializer->oscPluginsMutex);
+
+    for (const std::pair<int32_t, CardinalBasePlugin*>& oscPlugin : initializer->oscPlugins)
+    {
+        if (instanceId != 0 && oscPlugin.first != instanceId)
+            continue;
+
+        rack::engine::Engine* const engine = oscPlugin.second->context->engine;
+
+        json_t* const statsJ = rack::engine::Engine_getBlockStatsJson(engine);
+        char* const json = json_dumps(statsJ, JSON_COMPACT);
+        json_decref(statsJ);
+
+        if (reset)
+            rack::engine::Engine_resetBlockStats(engine);
+
+        lo_send_from(source, initializer->oscServer, LO_TT_IMMEDIATE, "/resp/blockstats", "is",
+                     oscPlugin.first, json != nullptr ? json : "{}");
+        std::free(json);
+    }
+
+    return 0;
+}
+
+// how often the file given by CARDINAL_METRICS_FILE is rewritten, in seconds
+static constexpr const double kMetricsFileInterval = 10.0;
+
+// Metrics of every instance in Prometheus text format, sampled from the stats the engine keeps anyway,
+// so serving them adds no work to the audio thread. Used for "/metrics" and the optional metrics file.
+static std::string getMetricsText(Initializer* const initializer)
+{
+    struct InstanceMetrics {
+        int32_t id;
+        size_t modules, cables;
+        double meterAverage, meterMax;
+        json_t* blockStatsJ;
+        json_t* loadProfileJ;
+    };
+    std::vector<InstanceMetrics> instances;
+
+    {
+        const MutexLocker cml(initializer->oscPluginsMutex);
+
+        for (const std::pair<int32_t, CardinalBasePlugin*>& oscPlugin : initializer->oscPlugins)
+        {
+            rack::engine::Engine* const engine = oscPlugin.second->context->engine;
+
+            instances.push_back({
+                oscPlugin.first,
+                engine->getNumModules(),
+                engine->getNumCables(),
+                engine->getMeterAverage(),
+                engine->getMeterMax(),
+                rack::engine::Engine_getBlockStatsJson(engine),
+                rack::engine::Engine_getLoadProfileJson(engine),
+            });
+        }
+    }
+
+    std::string text;
+
+    const auto addMetric = [&](const char* const name, const char* const type, const char* const help,
+                               const std::function<void(const InstanceMetrics&)>& addSamples) {
+        text += rack::string::f("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+        for (const InstanceMetrics& instance : instances)
+            addSamples(instance);
+    };
+    const auto addSample = [&](const char* const name, const InstanceMetrics& instance,
+                               const std::string& labels, const double value) {
+        text += rack::string::f("%s{instance=\"%d\"%s} %.9g\n", name, instance.id, labels.c_str(), value);
+    };
+    const auto getNumber = [](json_t* const objectJ, const char* const key) {
+        return json_number_value(json_object_get(objectJ, key));
+    };
+
+    addMetric("cardinal_engine_load", "gauge", "Engine load as a fraction of the block time, averaged",
+              [&](const InstanceMetrics& instance) {
+        addSample("cardinal_engine_load", instance, "", instance.meterAverage);
+    });
+    addMetric("cardinal_engine_load_max", "gauge", "Peak engine load as a fraction of the block time",
+              [&](const InstanceMetrics& instance) {
+        addSample("cardinal_engine_load_max", instance, "", instance.meterMax);
+    });
+    addMetric("cardinal_engine_cpu_load", "gauge", "CPU time of the engine and its worker threads per block time, in cores",
+              [&](const InstanceMetrics& instance) {
+        addSample("cardinal_engine_cpu_load", instance, "", getNumber(instance.blockStatsJ, "cpuLoad"));
+    });
+    addMetric("cardinal_engine_cpu_budget", "gauge", "CPU budget of the engine in cores, 0 if unlimited",
+              [&](const InstanceMetrics& instance) {
+        addSample("cardinal_engine_cpu_budget", instance, "", getNumber(instance.blockStatsJ, "cpuBudget"));
+    });
+    addMetric("cardinal_block_load", "summary", "Block processing time as a fraction of the block duration",
+              [&](const InstanceMetrics& instance) {
+        const char* key;
+        json_t* valueJ;
+        json_object_foreach(json_object_get(instance.blockStatsJ, "percentiles"), key, valueJ)
+            addSample("cardinal_block_load", instance,
+                      rack::string::f(",quantile=\"%g\"", std::atof(key) / 100.0), json_number_value(valueJ));
+        addSample("cardinal_block_load_count", instance, "", getNumber(instance.blockStatsJ, "blocks"));
+    });
+    addMetric("cardinal_xruns_total", "counter", "Blocks that overran their deadline or were skipped",
+              [&](const InstanceMetrics& instance) {
+        addSample("cardinal_xruns_total", instance, "", getNumber(instance.blockStatsJ, "xruns"));
+    });
+    addMetric("cardinal_shed_blocks_total", "counter", "Blocks processed with load shedding",
+              [&](const InstanceMetrics& instance) {
+        addSample("cardinal_shed_blocks_total", instance, "", getNumber(instance.blockStatsJ, "shed"));
+    });
+    addMetric("cardinal_modules", "gauge", "Modules in the patch", [&](const InstanceMetrics& instance) {
+        addSample("cardinal_modules", instance, "", instance.modules);
+    });
+    addMetric("cardinal_cables", "gauge", "Cables in the patch", [&](const InstanceMetrics& instance) {
+        addSample("cardinal_cables", instance, "", instance.cables);
+    });
+    addMetric("cardinal_patch_load_seconds", "gauge", "Duration of the last patch load, in total and by stage",
+              [&](const InstanceMetrics& instance) {
+        addSample("cardinal_patch_load_seconds", instance, ",stage=\"total\"", getNumber(instance.loadProfileJ, "total"));
+        const char* key;
+        json_t* valueJ;
+        json_object_foreach(json_object_get(instance.loadProfileJ, "stages"), key, valueJ)
+            addSample("cardinal_patch_load_seconds", instance,
+                      rack::string::f(",stage=\"%s\"", key), json_number_value(valueJ));
+    });
+
+    if (const size_t residentSize = memusage::getResidentSize())
+        text += rack::string::f("# HELP cardinal_resident_memory_bytes Resident memory of the process\n"
+                                "# TYPE cardinal_resident_memory_bytes gauge\n"
+                                "cardinal_resident_memory_bytes %zu\n", residentSize);
+
+    for (const InstanceMetrics& instance : instances)
+    {
+        json_decref(instance.blockStatsJ);
+        json_decref(instance.loadProfileJ);
+    }
+
+    return text;
+}
+
+// replies with the metrics of all instances, see getMetricsText
+static int osc_metrics_handler(const char*, const char*, lo_arg**, int, const lo_message m, void* const self)
+{
+    Initializer* const initializer = static_cast<Initializer*>(self);
+    const std::string text = getMetricsText(initializer);
+
+    lo_send_from(lo_message_get_source(m), initializer->oscServer, LO_TT_IMMEDIATE, "/resp/metrics", "s", text.c_str());
     return 0;
 }
 
-static int osc_screenshot_handler(const char*, const char* types, lo_arg** argv, int argc, const lo_message m, void* const self)
+// for the textfile collector of the Prometheus node exporter, replaced as a whole so it is never read half written
+static void writeMetricsFile(Initializer* const initializer)
 {
-    d_stdout("osc_screenshot_handler()");
-    DISTRHO_SAFE_ASSERT_RETURN(argc == 1, 0);
-    DISTRHO_SAFE_ASSERT_RETURN(types != nullptr && types[0] == 'b', 0);
-
-    const int32_t size = argv[0]->blob.size;
-    DISTRHO_SAFE_ASSERT_RETURN(size > 4, 0);
-
-    const uint8_t* const blob = (uint8_t*)(&argv[0]->blob.data);
-    DISTRHO_SAFE_ASSERT_RETURN(blob != nullptr, 0);
+    const std::string text = getMetricsText(initializer);
+    const std::string tmpPath = initializer->oscMetricsPath + ".tmp";
 
-    bool ok = false;
+    FILE* const f = std::fopen(tmpPath.c_str(), "w");
+    DISTRHO_SAFE_ASSERT_RETURN(f != nullptr,);
 
-    if (CardinalBasePlugin* const plugin = static_cast<Initializer*>(self)->oscPlugin)
-        ok = plugin->updateStateValue("screenshot", String::asBase64(blob, size).buffer());
+    const bool ok = std::fwrite(text.data(), 1, text.size(), f) == text.size();
+    std::fclose(f);
 
-    const lo_address source = lo_message_get_source(m);
-    lo_send_from(source, static_cast<Initializer*>(self)->oscServer,
-                    LO_TT_IMMEDIATE, "/resp", "ss", "screenshot", ok ? "ok" : "fail");
-    return 0;
+    if (ok)
+        rack::system::rename(tmpPath, initializer->oscMetricsPath);
+    else
+        rack::system::remove(tmpPath);
 }
 #endif
 
@@ -284,6 +1088,9 @@ Initializer::Initializer(const CardinalBasePlugin* const plugin, const CardinalB
 {
     using namespace rack;
 
+    const startuptrace::Scope traceInitializer("startup", "Initializer");
+    double traceTime = startuptrace::now();
+
 #ifdef DISTRHO_OS_WASM
     settings::allowCursorLock = true;
 #else
@@ -320,11 +1127,17 @@ Initializer::Initializer(const CardinalBasePlugin* const plugin, const CardinalB
         color::fromHexString("#ff5293"),
     };
 
+    startuptrace::record("startup", "settings", traceTime);
+    traceTime = startuptrace::now();
+
     system::init();
     logger::init();
     random::init();
     ui::init();
 
+    startuptrace::record("startup", "system, logger and ui", traceTime);
+    traceTime = startuptrace::now();
+
     if (asset::systemDir.empty())
     {
         if (const char* const bundlePath = (plugin != nullptr ? plugin->getBundlePath() :
@@ -401,11 +1214,32 @@ Initializer::Initializer(const CardinalBasePlugin* const plugin, const CardinalB
                     "Make sure Cardinal was downloaded and installed correctly.", asset::systemDir.c_str());
     }
 
+    startuptrace::record("startup", "asset paths", traceTime);
+
+    if (! asset::systemDir.empty())
+    {
+        const startuptrace::Scope trace("startup", "resource pack");
+
+        // self-extracting standalone packages keep the pack inside themselves, see deps/unzipfx
+        const char* const embedded = getenv("CARDINAL_RESOURCE_PACK");
+
+        if (embedded == nullptr || ! respack::openEmbedded(embedded, asset::systemDir))
+            respack::open(system::join(asset::systemDir, "resources.pack"));
+    }
+
     INFO("Initializing plugins");
-    plugin::initStaticPlugins();
+    {
+        const startuptrace::Scope trace("startup", "initStaticPlugins");
+        plugin::initStaticPlugins();
+    }
 
     INFO("Initializing plugin browser DB");
-    app::browserInit();
+    {
+        const startuptrace::Scope trace("startup", "browserInit");
+        app::browserInit();
+    }
+
+    memusage::report("plugin init");
 
 #ifdef CARDINAL_INIT_OSC_THREAD
     INFO("Initializing OSC Remote control");
@@ -413,10 +1247,33 @@ Initializer::Initializer(const CardinalBasePlugin* const plugin, const CardinalB
     DISTRHO_SAFE_ASSERT_RETURN(oscServer != nullptr,);
 
     lo_server_add_method(oscServer, "/hello", "", osc_hello_handler, this);
+    lo_server_add_method(oscServer, "/hello", "i", osc_hello_handler, this);
     lo_server_add_method(oscServer, "/load", "b", osc_load_handler, this);
+    lo_server_add_method(oscServer, "/load", "ib", osc_load_handler, this);
+    lo_server_add_method(oscServer, "/load/chunk", "hiib", osc_load_chunk_handler, this);
+    lo_server_add_method(oscServer, "/load/chunk", "ihiib", osc_load_chunk_handler, this);
+    lo_server_add_method(oscServer, "/patch", "s", osc_patch_handler, this);
+    lo_server_add_method(oscServer, "/patch", "is", osc_patch_handler, this);
+    lo_server_add_method(oscServer, "/param", "hif", osc_param_handler, this);
+    lo_server_add_method(oscServer, "/param", "ihif", osc_param_handler, this);
     lo_server_add_method(oscServer, "/screenshot", "b", osc_screenshot_handler, this);
+    lo_server_add_method(oscServer, "/screenshot", "ib", osc_screenshot_handler, this);
+    lo_server_add_method(oscServer, "/instances", "", osc_instances_handler, this);
+    lo_server_add_method(oscServer, "/stats", "", osc_stats_handler, this);
+    lo_server_add_method(oscServer, "/stats", "i", osc_stats_handler, this);
+    lo_server_add_method(oscServer, "/blockstats", "", osc_blockstats_handler, this);
+    lo_server_add_method(oscServer, "/blockstats", "i", osc_blockstats_handler, this);
+    lo_server_add_method(oscServer, "/blockstats/reset", "", osc_blockstats_handler, this);
+    lo_server_add_method(oscServer, "/blockstats/reset", "i", osc_blockstats_handler, this);
+    lo_server_add_method(oscServer, "/metrics", "", osc_metrics_handler, this);
     lo_server_add_method(oscServer, nullptr, nullptr, osc_fallback_handler, nullptr);
 
+    if (const char* const metricsPath = getenv("CARDINAL_METRICS_FILE"))
+    {
+        INFO("Writing metrics to %s every %d seconds", metricsPath, static_cast<int>(kMetricsFileInterval));
+        oscMetricsPath = metricsPath;
+    }
+
     startThread();
 #else
     INFO("OSC Remote control is not enabled in this build");
@@ -435,8 +1292,19 @@ Initializer::~Initializer()
         lo_server_free(oscServer);
         oscServer = nullptr;
     }
+
+    if (oscTelemetryAddress != nullptr)
+    {
+        lo_address_free(oscTelemetryAddress);
+        oscTelemetryAddress = nullptr;
+    }
 #endif
 
+   #ifdef CARDINAL_STARTUP_TRACE
+    // in case no window was ever created
+    startuptrace::write(asset::user("startup-trace.json").c_str());
+   #endif
+
     INFO("Clearing asset paths");
     asset::bundlePath.clear();
     asset::systemDir.clear();
@@ -448,6 +1316,9 @@ Initializer::~Initializer()
     INFO("Destroying colourized assets");
     asset::destroy();
 
+    INFO("Closing resource pack");
+    respack::close();
+
     INFO("Destroying settings");
     settings::destroy();
 
@@ -456,14 +1327,66 @@ Initializer::~Initializer()
 }
 
 #ifdef CARDINAL_INIT_OSC_THREAD
+int32_t Initializer::addOscPlugin(CardinalBasePlugin* const plugin)
+{
+    const MutexLocker cml(oscPluginsMutex);
+
+    const int32_t id = oscNextPluginId++;
+    oscPlugins.push_back(std::make_pair(id, plugin));
+    INFO("OSC Remote control instance %d added", id);
+    return id;
+}
+
+void Initializer::removeOscPlugin(CardinalBasePlugin* const plugin)
+{
+    const MutexLocker cml(oscPluginsMutex);
+
+    for (auto it = oscPlugins.begin(); it != oscPlugins.end(); ++it)
+    {
+        if (it->second != plugin)
+            continue;
+
+        INFO("OSC Remote control instance %d removed", it->first);
+        oscPlugins.erase(it);
+        break;
+    }
+}
+
 void Initializer::run()
 {
     INFO("OSC Thread Listening for remote commands");
 
     while (! shouldThreadExit())
     {
-        d_msleep(200);
-        while (lo_server_recv_noblock(oscServer, 0) != 0) {}
+        // block until a message arrives, waking up only for the next lights telemetry (streamed at 20Hz)
+        // or, when there is none, every now and then to check if the thread should exit
+        int timeout = 500;
+        if (oscTelemetryAddress != nullptr)
+        {
+            const double remaining = oscTelemetryTime + 0.05 - rack::system::getTime();
+            timeout = remaining > 0.0 ? static_cast<int>(remaining * 1000.0) + 1 : 0;
+        }
+        if (! oscMetricsPath.empty())
+        {
+            const double remaining = oscMetricsTime + kMetricsFileInterval - rack::system::getTime();
+            timeout = std::min(timeout, remaining > 0.0 ? static_cast<int>(remaining * 1000.0) + 1 : 0);
+        }
+
+        if (lo_server_recv_noblock(oscServer, timeout) != 0)
+            while (lo_server_recv_noblock(oscServer, 0) != 0) {}
+
+        const double time = rack::system::getTime();
+        if (oscTelemetryAddress != nullptr && time - oscTelemetryTime >= 0.05)
+        {
+            oscTelemetryTime = time;
+            sendLightsTelemetry(this);
+        }
+
+        if (! oscMetricsPath.empty() && time - oscMetricsTime >= kMetricsFileInterval)
+        {
+            oscMetricsTime = time;
+            writeMetricsFile(this);
+        }
     }
 
     INFO("OSC Thread Closed");
@@ -533,6 +1456,33 @@ std::string homeDir()
     return {};
 }
 
+// directory for files that can be regenerated at any time, created if needed, empty if there is none
+std::string cacheDir()
+{
+    std::string dir;
+# if defined(DISTRHO_OS_WASM)
+    return dir;
+# elif defined(ARCH_WIN)
+    dir = getSpecialPath(kSpecialPathAppData);
+    if (! dir.empty())
+        dir = system::join(dir, "Cardinal", "cache");
+# elif defined(ARCH_MAC)
+    dir = homeDir();
+    if (! dir.empty())
+        dir = system::join(dir, "Library", "Caches", "Cardinal");
+# else
+    if (const char* const xdgCacheHome = getenv("XDG_CACHE_HOME"))
+        dir = xdgCacheHome;
+    if (! dir.empty())
+        dir = system::join(dir, "Cardinal");
+    else if (! (dir = homeDir()).empty())
+        dir = system::join(dir, ".cache", "Cardinal");
+# endif
+    if (! dir.empty() && ! system::isDirectory(dir))
+        system::createDirectories(dir);
+    return dir;
+}
+
 } // namespace rack
 
 // --------------------------------------------------------------------------------------------------------------------
@@ -592,6 +1542,20 @@ void loadPathDialog(const std::string& path, const bool asTemplate)
 #endif
 }
 
+void cloneSelectionAction(const bool cloneCables)
+{
+    engine::Engine_beginEdits(APP->engine);
+    APP->scene->rack->cloneSelectionAction(cloneCables);
+    engine::Engine_endEdits(APP->engine);
+}
+
+void deleteSelectionAction()
+{
+    engine::Engine_beginEdits(APP->engine);
+    APP->scene->rack->deleteSelectionAction();
+    engine::Engine_endEdits(APP->engine);
+}
+
 void loadSelectionDialog()
 {
     app::RackWidget* const w = APP->scene->rack;
@@ -647,7 +1611,7 @@ void saveDialog(const std::string& path)
     APP->history->setSaved();
 
     try {
-        APP->patch->save(path);
+        savePatch(path);
     }
     catch (Exception& e) {
         asyncDialog::create(string::f("Could not save patch: %s", e.what()).c_str());
@@ -656,6 +1620,19 @@ void saveDialog(const std::string& path)
 #endif
 }
 
+void setPatchBank(const std::string& directory)
+{
+#ifndef HEADLESS
+    CardinalPluginContext* const pcontext = static_cast<CardinalPluginContext*>(APP);
+    DISTRHO_SAFE_ASSERT_RETURN(pcontext != nullptr,);
+
+    CardinalBaseUI* const ui = static_cast<CardinalBaseUI*>(pcontext->ui);
+    DISTRHO_SAFE_ASSERT_RETURN(ui != nullptr,);
+
+    ui->setState("bank", directory.c_str());
+#endif
+}
+
 #ifndef HEADLESS
 static void saveAsDialog(const bool uncompressed)
 {
@@ -706,6 +1683,535 @@ void openBrowser(const std::string& url)
 #endif
 }
 
+// Binary copy of patch.json, stored next to it as patch.bin for large patches.
+// Starts with a magic and the hash of the patch.json it was made with, so a stale copy is never used.
+// JSON values follow as a type byte and little-endian payload: integers and reals take 8 bytes,
+// strings a 32-bit length and their bytes, arrays and objects a 32-bit count and their items or key/value pairs.
+
+static constexpr const char kBinaryPatchMagic[4] = { 'C', 'B', 'P', '1' };
+static constexpr const size_t kBinaryPatchMinJsonSize = 256 * 1024;
+
+enum BinaryPatchType : uint8_t {
+    kBinaryPatchNull,
+    kBinaryPatchTrue,
+    kBinaryPatchFalse,
+    kBinaryPatchInteger,
+    kBinaryPatchReal,
+    kBinaryPatchString,
+    kBinaryPatchArray,
+    kBinaryPatchObject,
+};
+
+static uint64_t hashPatchJson(const char* const data, const size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+template <typename T>
+static void writeBinaryPatchValue(std::vector<uint8_t>& out, const T value)
+{
+    uint8_t bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+static void writeBinaryPatchString(std::vector<uint8_t>& out, const char* const str, const size_t len)
+{
+    writeBinaryPatchValue<uint32_t>(out, len);
+    out.insert(out.end(), str, str + len);
+}
+
+static void writeBinaryPatch(std::vector<uint8_t>& out, json_t* const valueJ)
+{
+    switch (json_typeof(valueJ))
+    {
+    case JSON_NULL:
+        out.push_back(kBinaryPatchNull);
+        break;
+    case JSON_TRUE:
+        out.push_back(kBinaryPatchTrue);
+        break;
+    case JSON_FALSE:
+        out.push_back(kBinaryPatchFalse);
+        break;
+    case JSON_INTEGER:
+        out.push_back(kBinaryPatchInteger);
+        writeBinaryPatchValue<int64_t>(out, json_integer_value(valueJ));
+        break;
+    case JSON_REAL:
+        out.push_back(kBinaryPatchReal);
+        writeBinaryPatchValue<double>(out, json_real_value(valueJ));
+        break;
+    case JSON_STRING:
+        out.push_back(kBinaryPatchString);
+        writeBinaryPatchString(out, json_string_value(valueJ), json_string_length(valueJ));
+        break;
+    case JSON_ARRAY:
+    {
+        out.push_back(kBinaryPatchArray);
+        writeBinaryPatchValue<uint32_t>(out, json_array_size(valueJ));
+        size_t i;
+        json_t* itemJ;
+        json_array_foreach(valueJ, i, itemJ)
+            writeBinaryPatch(out, itemJ);
+        break;
+    }
+    case JSON_OBJECT:
+    {
+        out.push_back(kBinaryPatchObject);
+        writeBinaryPatchValue<uint32_t>(out, json_object_size(valueJ));
+        const char* key;
+        json_t* itemJ;
+        json_object_foreach(valueJ, key, itemJ)
+        {
+            writeBinaryPatchString(out, key, std::strlen(key));
+            writeBinaryPatch(out, itemJ);
+        }
+        break;
+    }
+    }
+}
+
+struct BinaryPatchReader {
+    const uint8_t* data;
+    size_t size;
+    size_t pos = 0;
+
+    template <typename T>
+    bool read(T& value)
+    {
+        if (size - pos < sizeof(T))
+            return false;
+        std::memcpy(&value, data + pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+
+    bool readString(const char*& str, uint32_t& len)
+    {
+        if (! read(len) || size - pos < len)
+            return false;
+        str = reinterpret_cast<const char*>(data + pos);
+        pos += len;
+        return true;
+    }
+
+    // returns null on malformed data
+    json_t* readValue(const int depth = 0)
+    {
+        uint8_t type;
+        if (depth > 1000 || ! read(type))
+            return nullptr;
+
+        switch (type)
+        {
+        case kBinaryPatchNull:
+            return json_null();
+        case kBinaryPatchTrue:
+            return json_true();
+        case kBinaryPatchFalse:
+            return json_false();
+        case kBinaryPatchInteger: {
+            int64_t value;
+            return read(value) ? json_integer(value) : nullptr;
+        }
+        case kBinaryPatchReal: {
+            double value;
+            return read(value) ? json_real(value) : nullptr;
+        }
+        case kBinaryPatchString: {
+            const char* str;
+            uint32_t len;
+            return readString(str, len) ? json_stringn_nocheck(str, len) : nullptr;
+        }
+        case kBinaryPatchArray: {
+            uint32_t count;
+            if (! read(count))
+                return nullptr;
+            json_t* const arrayJ = json_array();
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                json_t* const itemJ = readValue(depth + 1);
+                if (itemJ == nullptr)
+                {
+                    json_decref(arrayJ);
+                    return nullptr;
+                }
+                json_array_append_new(arrayJ, itemJ);
+            }
+            return arrayJ;
+        }
+        case kBinaryPatchObject: {
+            uint32_t count;
+            if (! read(count))
+                return nullptr;
+            json_t* const objectJ = json_object();
+            std::string key;
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                const char* str;
+                uint32_t len;
+                json_t* itemJ;
+                if (! readString(str, len) || (itemJ = readValue(depth + 1)) == nullptr)
+                {
+                    json_decref(objectJ);
+                    return nullptr;
+                }
+                key.assign(str, len);
+                json_object_set_new_nocheck(objectJ, key.c_str(), itemJ);
+            }
+            return objectJ;
+        }
+        }
+
+        return nullptr;
+    }
+};
+
+// Decodes patch.bin if it matches the given patch.json contents, returns null otherwise
+static json_t* loadBinaryPatch(const std::vector<uint8_t>& binary, const std::vector<char>& patchJson)
+{
+    BinaryPatchReader reader = { binary.data(), binary.size() };
+
+    char magic[4];
+    uint64_t hash;
+    if (! reader.read(magic) || std::memcmp(magic, kBinaryPatchMagic, sizeof(magic)) != 0)
+        return nullptr;
+    if (! reader.read(hash) || hash != hashPatchJson(patchJson.data(), patchJson.size()))
+        return nullptr;
+
+    json_t* const rootJ = reader.readValue();
+    if (rootJ != nullptr && reader.pos != binary.size())
+    {
+        json_decref(rootJ);
+        return nullptr;
+    }
+    return rootJ;
+}
+
+static bool writeFileAtomically(const std::string& path, const void* const data, const size_t size)
+{
+    const std::string tmpPath = path + ".tmp";
+    FILE* const f = std::fopen(tmpPath.c_str(), "wb");
+    DISTRHO_SAFE_ASSERT_RETURN(f != nullptr, false);
+
+    const bool ok = std::fwrite(data, size, 1, f) == 1 || size == 0;
+    std::fclose(f);
+
+    if (! ok)
+    {
+        system::remove(tmpPath);
+        return false;
+    }
+
+    system::remove(path);
+    system::rename(tmpPath, path);
+    return true;
+}
+
+static la_ssize_t archiveWriteVectorCallback(archive*, void* const clientData, const void* const buffer, const size_t length)
+{
+    std::vector<uint8_t>* const data = static_cast<std::vector<uint8_t>*>(clientData);
+    const uint8_t* const bytes = static_cast<const uint8_t*>(buffer);
+    data->insert(data->end(), bytes, bytes + length);
+    return length;
+}
+
+std::vector<uint8_t> archiveDirectory(const std::string& dirPath, const int compressionLevel)
+{
+    if (compressionLevel < 0 || compressionLevel > 19)
+        throw Exception("Invalid compression level %d", compressionLevel);
+
+    std::vector<uint8_t> data;
+
+    archive* const a = archive_write_new();
+    DISTRHO_SAFE_ASSERT_RETURN(a != nullptr, data);
+    DEFER({archive_write_free(a);});
+
+    // avoids libarchive padding the output to 10k blocks
+    archive_write_set_bytes_per_block(a, 0);
+    archive_write_set_format_ustar(a);
+    archive_write_add_filter_zstd(a);
+
+    if (archive_write_set_filter_option(a, nullptr, "compression-level", std::to_string(compressionLevel).c_str()) < ARCHIVE_WARN)
+        throw Exception("Could not set compression level: %s", archive_error_string(a));
+
+    // leave a core to the audio thread, older libarchive without threads support just ignores this
+    const unsigned int cores = std::thread::hardware_concurrency();
+    const unsigned int threads = cores > 1 ? cores - 1 : 1;
+    archive_write_set_filter_option(a, "zstd", "threads", std::to_string(threads).c_str());
+
+    if (archive_write_open(a, &data, nullptr, archiveWriteVectorCallback, nullptr) != ARCHIVE_OK)
+        throw Exception("Could not open archive: %s", archive_error_string(a));
+
+    std::vector<std::string> entries = system::getEntries(dirPath, -1);
+    std::sort(entries.begin(), entries.end());
+
+    // patch files first, so that loading can parse them while module data files are still being extracted
+    const std::string patchJsonPath = system::join(dirPath, "patch.json");
+    const std::string patchBinaryPath = system::join(dirPath, "patch.bin");
+    std::stable_partition(entries.begin(), entries.end(), [&](const std::string& entryPath) {
+        return entryPath == patchJsonPath || entryPath == patchBinaryPath;
+    });
+
+    archive_entry* const entry = archive_entry_new();
+    DEFER({archive_entry_free(entry);});
+
+    std::vector<uint8_t> buffer(1 << 16);
+
+    for (const std::string& entryPath : entries)
+    {
+        const bool isDirectory = system::isDirectory(entryPath);
+        if (! isDirectory && ! system::isFile(entryPath))
+            continue;
+
+        // same layout as archives made by Rack, relative to the archived directory
+        const std::string relativePath = "./" + entryPath.substr(dirPath.size() + 1);
+
+        archive_entry_clear(entry);
+        archive_entry_set_pathname(entry, relativePath.c_str());
+        archive_entry_set_filetype(entry, isDirectory ? AE_IFDIR : AE_IFREG);
+        archive_entry_set_perm(entry, isDirectory ? 0755 : 0644);
+        archive_entry_set_size(entry, isDirectory ? 0 : system::getFileSize(entryPath));
+
+        if (archive_write_header(a, entry) < ARCHIVE_WARN)
+            throw Exception("Could not write archive entry %s: %s", relativePath.c_str(), archive_error_string(a));
+
+        if (isDirectory)
+            continue;
+
+        FILE* const f = std::fopen(entryPath.c_str(), "rb");
+        if (f == nullptr)
+            throw Exception("Could not open %s", entryPath.c_str());
+        DEFER({std::fclose(f);});
+
+        size_t size;
+        while ((size = std::fread(buffer.data(), 1, buffer.size(), f)) != 0)
+            archive_write_data(a, buffer.data(), size);
+    }
+
+    if (archive_write_close(a) != ARCHIVE_OK)
+        throw Exception("Could not close archive: %s", archive_error_string(a));
+
+    return data;
+}
+
+void savePatch(const std::string& path)
+{
+    INFO("Saving patch %s", path.c_str());
+
+    APP->engine->prepareSave();
+    saveAutosave();
+    APP->patch->cleanAutosave();
+
+    const double startTime = system::getTime();
+    const std::vector<uint8_t> data(archiveDirectory(APP->patch->autosavePath, CARDINAL_FILE_COMPRESSION_LEVEL));
+
+    if (! writeFileAtomically(path, data.data(), data.size()))
+        throw Exception("Could not write patch file %s", path.c_str());
+
+    INFO("Archived patch in %f seconds", system::getTime() - startTime);
+}
+
+void saveAutosave(json_t** const rootJOut)
+{
+    json_t* const rootJ = APP->patch->toJson();
+    DISTRHO_SAFE_ASSERT_RETURN(rootJ != nullptr,);
+    DEFER({
+        if (rootJOut != nullptr)
+            *rootJOut = rootJ;
+        else
+            json_decref(rootJ);
+    });
+
+    const std::string& autosavePath(APP->patch->autosavePath);
+    system::createDirectories(autosavePath);
+
+    char* const json = json_dumps(rootJ, JSON_INDENT(2));
+    DISTRHO_SAFE_ASSERT_RETURN(json != nullptr,);
+    DEFER({std::free(json);});
+
+    const size_t jsonSize = std::strlen(json);
+    writeFileAtomically(system::join(autosavePath, "patch.json"), json, jsonSize);
+
+    const std::string binaryPath = system::join(autosavePath, "patch.bin");
+
+    if (jsonSize < kBinaryPatchMinJsonSize)
+    {
+        system::remove(binaryPath);
+        return;
+    }
+
+    std::vector<uint8_t> binary(kBinaryPatchMagic, kBinaryPatchMagic + sizeof(kBinaryPatchMagic));
+    binary.reserve(jsonSize / 2);
+    writeBinaryPatchValue<uint64_t>(binary, hashPatchJson(json, jsonSize));
+    writeBinaryPatch(binary, rootJ);
+    writeFileAtomically(binaryPath, binary.data(), binary.size());
+}
+
+// Parses patch.json, or decodes its binary copy if still matching
+static json_t* parsePatch(const std::vector<char>& patchJson, const std::vector<uint8_t>& patchBinary)
+{
+    json_t* rootJ = nullptr;
+
+    if (! patchBinary.empty())
+    {
+        rootJ = loadBinaryPatch(patchBinary, patchJson);
+        if (rootJ == nullptr)
+            WARN("Ignoring outdated or invalid binary patch");
+    }
+
+    json_error_t error;
+    if (rootJ == nullptr)
+        rootJ = json_loadb(patchJson.data(), patchJson.size(), 0, &error);
+    if (rootJ == nullptr)
+        throw Exception("Failed to load patch. JSON parsing error at %s %d:%d %s",
+                        error.source, error.line, error.column, error.text);
+
+    return rootJ;
+}
+
+void loadFromMemory(const uint8_t* const data, const size_t size, const std::function<void()>& aboutToSwap)
+{
+    const std::string& autosavePath(APP->patch->autosavePath);
+    system::removeRecursively(autosavePath);
+    system::createDirectories(autosavePath);
+
+    static constexpr const char zstdMagic[] = "\x28\xb5\x2f\xfd";
+
+    std::vector<char> patchJson;
+    std::vector<uint8_t> patchBinary;
+    const double stageTime = system::getTime();
+
+    // the patch is parsed and its modules created on another thread,
+    // meanwhile the module data files following patch.json in archives made by Cardinal are extracted
+    bool preparing = false;
+    const auto beginPreparing = [&]() {
+        preparing = true;
+        engine::Engine_beginPreparePatch(APP->engine, [&patchJson, &patchBinary]() {
+            return parsePatch(patchJson, patchBinary);
+        });
+    };
+    // does nothing once the preparation is finished
+    DEFER({
+        if (preparing)
+            engine::Engine_cancelPreparePatch(APP->engine);
+    });
+
+    if (size < 4 || std::memcmp(data, zstdMagic, 4) != 0)
+    {
+        patchJson.assign(data, data + size);
+    }
+    else
+    {
+        archive* const a = archive_read_new();
+        DISTRHO_SAFE_ASSERT_RETURN(a != nullptr,);
+        DEFER({archive_read_free(a);});
+
+        archive_read_support_filter_zstd(a);
+        archive_read_support_format_tar(a);
+
+        if (archive_read_open_memory(a, data, size) != ARCHIVE_OK)
+            throw Exception("Could not open patch archive: %s", archive_error_string(a));
+
+        archive_entry* entry;
+        while (archive_read_next_header(a, &entry) == ARCHIVE_OK)
+        {
+            std::string path = archive_entry_pathname(entry);
+            if (string::startsWith(path, "./"))
+                path.erase(0, 2);
+
+            if (path.empty() || path[0] == '/' || path.find("..") != std::string::npos)
+                throw Exception("Invalid path in patch archive: %s", path.c_str());
+
+            // patch.json and its binary copy are read straight into memory, only module data files go to disk
+            const bool isPatchJson = path == "patch.json";
+            const bool isPatchBinary = path == "patch.bin";
+
+            if (preparing && (isPatchJson || isPatchBinary))
+                throw Exception("Duplicate patch file in patch archive: %s", path.c_str());
+
+            if (! preparing && ! isPatchJson && ! isPatchBinary && ! patchJson.empty())
+                beginPreparing();
+
+            if (archive_entry_filetype(entry) == AE_IFDIR)
+            {
+                system::createDirectories(system::join(autosavePath, path));
+                continue;
+            }
+
+            if (archive_entry_filetype(entry) != AE_IFREG)
+                continue;
+
+            FILE* f = nullptr;
+
+            if (! isPatchJson && ! isPatchBinary)
+            {
+                const std::string filePath = system::join(autosavePath, path);
+                system::createDirectories(system::getDirectory(filePath));
+                f = std::fopen(filePath.c_str(), "wb");
+                if (f == nullptr)
+                    throw Exception("Could not create patch data file %s", filePath.c_str());
+            }
+
+            const void* buf;
+            size_t bufSize;
+            la_int64_t offset;
+            int ret;
+            while ((ret = archive_read_data_block(a, &buf, &bufSize, &offset)) == ARCHIVE_OK)
+            {
+                if (isPatchJson)
+                    patchJson.insert(patchJson.end(), static_cast<const char*>(buf), static_cast<const char*>(buf) + bufSize);
+                else if (isPatchBinary)
+                    patchBinary.insert(patchBinary.end(), static_cast<const uint8_t*>(buf), static_cast<const uint8_t*>(buf) + bufSize);
+                else
+                    std::fwrite(buf, bufSize, 1, f);
+            }
+
+            if (f != nullptr)
+                std::fclose(f);
+
+            if (ret != ARCHIVE_EOF)
+                throw Exception("Could not read patch archive: %s", archive_error_string(a));
+        }
+
+        engine::Engine_addLoadProfileStage(APP->engine, "archive", system::getTime() - stageTime);
+    }
+
+    if (! preparing)
+        beginPreparing();
+
+    // the new modules are created while the current patch keeps running, the engine picks them up in fromJson
+    json_t* const rootJ = engine::Engine_finishPreparePatch(APP->engine);
+    DISTRHO_SAFE_ASSERT_RETURN(rootJ != nullptr,);
+    DEFER({json_decref(rootJ);});
+
+    if (aboutToSwap)
+        aboutToSwap();
+
+    APP->patch->fromJson(rootJ);
+}
+
+void loadFromClone(json_t* const rootJ, const std::function<void()>& aboutToSwap)
+{
+    const std::string& autosavePath(APP->patch->autosavePath);
+    system::removeRecursively(autosavePath);
+    system::createDirectories(autosavePath);
+
+    engine::Engine_preparePatch(APP->engine, rootJ);
+
+    if (aboutToSwap)
+        aboutToSwap();
+
+    APP->patch->fromJson(rootJ);
+}
+
 }
 
 // --------------------------------------------------------------------------------------------------------------------
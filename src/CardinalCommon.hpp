@@ -19,13 +19,30 @@
 
 #include "DistrhoUtils.hpp"
 
+#include <functional>
 #include <string>
+#include <utility>
+#include <vector>
+
+// zstd levels for compressing patches, host state is saved often so it is kept fast
+#ifndef CARDINAL_STATE_COMPRESSION_LEVEL
+# define CARDINAL_STATE_COMPRESSION_LEVEL 1
+#endif
+#ifndef CARDINAL_FILE_COMPRESSION_LEVEL
+# define CARDINAL_FILE_COMPRESSION_LEVEL 3
+#endif
 
 #ifdef HAVE_LIBLO
 // # define REMOTE_HOST "localhost"
 # define REMOTE_HOST "192.168.51.1"
 # define REMOTE_HOST_PORT "2228"
+// patches are deployed in acknowledged chunks, small enough to never need IP fragmentation on common links
+# define REMOTE_CHUNK_SIZE 1200
+# ifndef REMOTE_COMPRESSION_LEVEL
+#  define REMOTE_COMPRESSION_LEVEL 1
+# endif
 # include "extra/Thread.hpp"
+# include <map>
 #endif
 
 #ifdef DISTRHO_OS_WASM
@@ -38,16 +55,33 @@
 
 extern const std::string CARDINAL_VERSION;
 
+// from jansson, to avoid including it here
+struct json_t;
+
 // -----------------------------------------------------------------------------------------------------------
 
 namespace rack {
 
+namespace plugin {
+struct Model;
+}
+
+namespace settings {
+// module meters drawn from the sampled module profiles of the engine, cheap enough to leave on, unlike cpuMeter
+extern bool sampledCpuMeter;
+// activity of output cables drawn over the module outputs, collected by the engine only while enabled
+extern bool cableActivity;
+// modules and cables drawn in low detail when zoomed far out
+extern bool lowDetailZoom;
+}
+
 namespace ui {
 struct Menu;
 }
 
 namespace window {
 void generateScreenshot();
+void generateModuleThumbnails();
 }
 
 bool isStandalone();
@@ -83,15 +117,63 @@ void saveDialog(const std::string& path);
 void saveAsDialog();
 void saveAsDialogUncompressed();
 void appendSelectionContextMenu(rack::ui::Menu* menu);
+
+// Makes the .vcv files of a directory the patch bank, switched by MIDI program change and host programs.
+// An empty directory clears the bank.
+void setPatchBank(const std::string& directory);
+
+// Rack's selection operations, with all their engine changes made under a single engine lock.
+void cloneSelectionAction(bool cloneCables);
+void deleteSelectionAction();
 void openBrowser(const std::string& url);
 
+// Archives a directory as zstd compressed tar, like rack::system::archiveDirectory(),
+// compressing with multiple threads and without changing the working directory.
+std::vector<uint8_t> archiveDirectory(const std::string& dirPath, int compressionLevel);
+
+// Saves the current patch to a .vcv file, like PatchManager::save() but through the functions below.
+void savePatch(const std::string& path);
+
+// Saves patch.json into the autosave directory like PatchManager::saveAutosave().
+// Large patches also get a binary copy as patch.bin, which loadFromMemory() decodes instead of parsing the JSON.
+// The saved patch is given to the caller through rootJOut if not null, it must be released with json_decref.
+void saveAutosave(json_t** rootJOut = nullptr);
+
+// Loads a patch from plain JSON or a zstd compressed archive in memory.
+// patch.json is parsed without touching the disk, only module data files are written to the autosave directory.
+// The new modules are created before stopping the current patch, aboutToSwap is called right before the swap.
+void loadFromMemory(const uint8_t* data, size_t size, const std::function<void()>& aboutToSwap = nullptr);
+
+// Loads a patch already parsed in memory, as copied from another instance of the same process.
+// Same as loadFromMemory() otherwise, the patch must not need any module data files.
+void loadFromClone(json_t* rootJ, const std::function<void()>& aboutToSwap = nullptr);
+
+// Searches the factory presets of all modules, matching every word of the query against preset and module names.
+// Results come from the preset index built in the background, as pairs of model and preset path.
+std::vector<std::pair<rack::plugin::Model*, std::string>> searchPresets(const std::string& query);
+
 bool connectToRemote();
 bool isRemoteConnected();
 bool isRemoteAutoDeployed();
 void setRemoteAutoDeploy(bool autoDeploy);
 void deployToRemote();
+void deployChangesToRemote();
 void sendScreenshotToRemote(const char* screenshot);
 
+#ifdef HAVE_LIBLO
+// FNV-1a hash identifying a deployed archive, also used to verify its chunks were reassembled correctly
+static inline int64_t hashRemoteData(const uint8_t* const data, const size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return static_cast<int64_t>(hash);
+}
+#endif
+
 } // namespace patchUtils
 
 // -----------------------------------------------------------------------------------------------------------
@@ -112,7 +194,27 @@ struct Initializer
 {
 #ifdef CARDINAL_INIT_OSC_THREAD
     lo_server oscServer = nullptr;
-    CardinalBasePlugin* oscPlugin = nullptr;
+
+    // instances that can be controlled remotely, messages starting with an instance id go to that instance,
+    // others go to the first one. the lock is held while handling a message, so instances can go away safely
+    Mutex oscPluginsMutex;
+    std::vector<std::pair<int32_t, CardinalBasePlugin*>> oscPlugins;
+    int32_t oscNextPluginId = 1;
+
+    // chunked patch transfer in progress, kept until complete so a resent transfer only needs its missing chunks
+    int64_t oscTransferHash = 0;
+    std::vector<std::vector<uint8_t>> oscTransferChunks;
+    uint32_t oscTransferReceived = 0;
+
+    // where lights are streamed back to, and their last sent quantized values per module
+    lo_address oscTelemetryAddress = nullptr;
+    int32_t oscTelemetryInstance = 0;
+    double oscTelemetryTime = 0.0;
+    std::map<int64_t, std::vector<uint8_t>> oscTelemetryLights;
+
+    // metrics file rewritten periodically, set with CARDINAL_METRICS_FILE
+    std::string oscMetricsPath;
+    double oscMetricsTime = 0.0;
 #endif
     std::string templatePath;
     std::string factoryTemplatePath;
@@ -120,6 +222,8 @@ struct Initializer
     Initializer(const CardinalBasePlugin* plugin, const CardinalBaseUI* ui);
     ~Initializer();
 #ifdef CARDINAL_INIT_OSC_THREAD
+    int32_t addOscPlugin(CardinalBasePlugin* plugin);
+    void removeOscPlugin(CardinalBasePlugin* plugin);
     void run() override;
 #endif
 };
@@ -26,6 +26,7 @@
  */
 
 #include "CardinalCommon.hpp"
+#include "PluginContext.hpp"
 
 #include <regex>
 
@@ -43,6 +44,12 @@
 #undef ModuleWidget
 
 namespace rack {
+namespace engine {
+int Engine_freezeModules(Engine*, const std::vector<Module*>& modules, int64_t frames);
+int Engine_unfreezeModules(Engine*, const std::vector<Module*>& modules);
+bool Engine_isModuleFrozen(Engine*, Module* module);
+}
+
 namespace app {
 
 static void CardinalModuleWidget__saveSelectionDialog(RackWidget* const w)
@@ -73,6 +80,29 @@ static void CardinalModuleWidget__saveSelectionDialog(RackWidget* const w)
     });
 }
 
+static std::vector<engine::Module*> CardinalModuleWidget__getSelectedModules(RackWidget* const w)
+{
+    std::vector<engine::Module*> modules;
+    for (ModuleWidget* const mw : w->getSelected())
+    {
+        if (mw->module != nullptr)
+            modules.push_back(mw->module);
+    }
+    return modules;
+}
+
+// renders the selection for a number of bars at the host tempo, or at 120 BPM in 4/4 without one
+static void CardinalModuleWidget__freezeSelection(RackWidget* const w, const int bars)
+{
+    CardinalPluginContext* const pcontext = static_cast<CardinalPluginContext*>(APP);
+    const double beatsPerMinute = pcontext->bbtValid && pcontext->beatsPerMinute > 0.0 ? pcontext->beatsPerMinute : 120.0;
+    const int beatsPerBar = pcontext->bbtValid && pcontext->beatsPerBar > 0 ? pcontext->beatsPerBar : 4;
+    const double seconds = bars * beatsPerBar * 60.0 / beatsPerMinute;
+
+    engine::Engine_freezeModules(APP->engine, CardinalModuleWidget__getSelectedModules(w),
+                                 static_cast<int64_t>(seconds * APP->engine->getSampleRate() + 0.5));
+}
+
 }
 }
 
@@ -145,19 +175,42 @@ void appendSelectionContextMenu(ui::Menu* const menu)
         w->bypassSelectionAction(!bypassed);
     }, n == 0, true));
 
+    // Freeze, renders what the selection sends to other modules and plays it back instead of processing it
+    bool frozen = false;
+    for (engine::Module* const module : CardinalModuleWidget__getSelectedModules(w))
+    {
+        if (engine::Engine_isModuleFrozen(APP->engine, module))
+        {
+            frozen = true;
+            break;
+        }
+    }
+    menu->addChild(createSubmenuItem("Freeze", frozen ? CHECKMARK_STRING : "", [w](ui::Menu* const menu) {
+        for (const int bars : { 4, 8, 16, 32 })
+        {
+            menu->addChild(createMenuItem(string::f("%d bars", bars), "", [w, bars]() {
+                CardinalModuleWidget__freezeSelection(w, bars);
+            }));
+        }
+    }, n == 0));
+
+    menu->addChild(createMenuItem("Unfreeze", "", [w]() {
+        engine::Engine_unfreezeModules(APP->engine, CardinalModuleWidget__getSelectedModules(w));
+    }, ! frozen, true));
+
     // Duplicate
-    menu->addChild(createMenuItem("Duplicate", RACK_MOD_CTRL_NAME "+D", [w]() {
-        w->cloneSelectionAction(false);
+    menu->addChild(createMenuItem("Duplicate", RACK_MOD_CTRL_NAME "+D", []() {
+        cloneSelectionAction(false);
     }, n == 0));
 
     // Duplicate with cables
-    menu->addChild(createMenuItem("└ with cables", RACK_MOD_SHIFT_NAME "+" RACK_MOD_CTRL_NAME "+D", [w]() {
-        w->cloneSelectionAction(true);
+    menu->addChild(createMenuItem("└ with cables", RACK_MOD_SHIFT_NAME "+" RACK_MOD_CTRL_NAME "+D", []() {
+        cloneSelectionAction(true);
     }, n == 0));
 
     // Delete
-    menu->addChild(createMenuItem("Delete", "Backspace/Delete", [w]() {
-        w->deleteSelectionAction();
+    menu->addChild(createMenuItem("Delete", "Backspace/Delete", []() {
+        deleteSelectionAction();
     }, n == 0, true));
 }
 
@@ -15,6 +15,7 @@
  * For a full copy of the GNU General Public License see the LICENSE file.
  */
 
+#include <history.hpp>
 #include <library.hpp>
 #include <midi.hpp>
 #include <patch.hpp>
@@ -24,7 +25,9 @@
 #include <system.hpp>
 
 #include <app/Scene.hpp>
+#include <dsp/fir.hpp>
 #include <engine/Engine.hpp>
+#include <engine/ModuleClone.hpp>
 #include <ui/common.hpp>
 #include <window/Window.hpp>
 
@@ -37,10 +40,18 @@
 # include "extra/Thread.hpp"
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include "CardinalCommon.hpp"
 #include "DistrhoPluginUtils.hpp"
+#include "DistrhoStandaloneUtils.hpp"
+#include "MemoryUsage.hpp"
 #include "PluginContext.hpp"
 #include "extra/Base64.hpp"
 
@@ -50,7 +61,36 @@
 # include "extra/SharedResourcePointer.hpp"
 #endif
 
-static const constexpr uint kCardinalStateBaseCount = 3; // patch, screenshot, comment
+static const constexpr uint kCardinalStateBaseCount = 4; // patch, screenshot, comment, bank
+
+// patch bank, one program per MIDI program number and up to this much patch data read ahead into memory
+static const constexpr uint kCardinalProgramCount = 128;
+static const constexpr size_t kPatchBankMemoryBudget = 256 * 1024 * 1024;
+
+#if DISTRHO_PLUGIN_WANT_PROGRAMS
+static const constexpr uint kCardinalHostProgramCount = kCardinalProgramCount;
+#else
+static const constexpr uint kCardinalHostProgramCount = 0;
+#endif
+
+// oversampling, the engine runs at up to 4 times the host sample rate
+static const constexpr uint kMaxOversampling = 4;
+static const constexpr uint kOversamplingQuality = 16;
+static const constexpr uint kMaxOversampledMidiEvents = 512;
+
+// true bypass, the engine keeps running for a short tail before being suspended, and fades back in on resume
+static const constexpr double kBypassTailSeconds = 0.1;
+static const constexpr double kBypassFadeInSeconds = 0.01;
+
+// sleep when idle, anything below -100 dBFS counts as silence
+static const constexpr float kIdleSilenceThreshold = 0.00001f;
+
+// MIDI output buffered during a single block
+static const constexpr uint kMaxMidiOutputEvents = 512;
+
+// fixed engine block size, host audio is queued by up to this many frames
+static const constexpr uint kMaxBlockQuantum = 256;
+static const constexpr uint kMaxBlockQuantumMidiData = 4096;
 
 #ifndef HEADLESS
 # include "extra/ScopedValueSetter.hpp"
@@ -61,16 +101,61 @@ static const constexpr uint kCardinalStateCount = kCardinalStateBaseCount + 2; /
 static const constexpr uint kCardinalStateCount = kCardinalStateBaseCount;
 #endif
 
+// read-only engine load parameters, after all others so existing parameter indexes stay the same
+enum EngineParameterList {
+    kEngineParameterAverageLoad,
+    kEngineParameterPeakLoad,
+    kEngineParameterXruns,
+    kEngineParameterCount
+};
+
+static const constexpr uint kEngineParameterOffset = kModuleParameters + kWindowParameterCount + 1;
+static const constexpr float kEngineParameterMaxXruns = 1000000.f;
+
 extern const std::string CARDINAL_VERSION;
 
 namespace rack {
 namespace engine {
 void Engine_setAboutToClose(Engine*);
+int Engine_getOversampling(Engine*);
+int Engine_getBlockQuantum(Engine*);
+int Engine_getLatency(Engine*);
+uint64_t Engine_getXrunCount(Engine*);
+bool Engine_isBlockSkipped(Engine*);
+void Engine_addDroppedMidiEvents(Engine*, int count);
+void Engine_setTransportFrame(Engine*, int64_t frame);
+void Engine_setMaxBufferSize(Engine*, int frames);
+void Engine_beginEdits(Engine*);
+void Engine_endEdits(Engine*);
+void Engine_applyAudioThreadScheduling(Engine*, double blockDuration);
+float Engine_getIdleSleepTime(Engine*);
+bool Engine_isIdleSleepAllowed(Engine*);
 }
 }
 
 START_NAMESPACE_DISTRHO
 
+// highest absolute sample value, null buffers count as silent
+static inline
+float getBuffersPeak(const float* const* const buffers, const int count, const uint32_t frames)
+{
+    float peak = 0.0f;
+
+    if (buffers == nullptr)
+        return peak;
+
+    for (int i=0; i<count; ++i)
+    {
+        if (buffers[i] == nullptr)
+            continue;
+
+        for (uint32_t f=0; f<frames; ++f)
+            peak = std::max(peak, std::abs(buffers[i][f]));
+    }
+
+    return peak;
+}
+
 template<typename T>
 static inline
 bool d_isDiffHigherThanLimit(const T& v1, const T& v2, const T& limit)
@@ -139,6 +224,258 @@ struct ScopedContext {
     }
 };
 
+// -----------------------------------------------------------------------------------------------------------
+
+// Last "patch" state given to the host by each instance, along with the patch it was made from.
+// Hosts duplicating a track hand that same state to a new instance, which then copies the patch in memory
+// instead of decoding, unarchiving and parsing it again.
+struct PatchStateClone {
+    const void* owner;
+    String state;
+    json_t* rootJ;
+    std::vector<std::pair<int64_t, std::shared_ptr<const void>>> moduleStates;
+
+    ~PatchStateClone()
+    {
+        json_decref(rootJ);
+    }
+};
+
+struct PatchStateClones {
+    std::mutex mutex;
+    std::list<std::shared_ptr<const PatchStateClone>> clones;
+
+    static PatchStateClones& get()
+    {
+        static PatchStateClones clones;
+        return clones;
+    }
+
+    void set(const void* const owner, std::shared_ptr<const PatchStateClone> clone)
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        clones.remove_if([owner](const std::shared_ptr<const PatchStateClone>& c) { return c->owner == owner; });
+        if (clone != nullptr)
+            clones.push_back(std::move(clone));
+    }
+
+    std::shared_ptr<const PatchStateClone> find(const void* const owner, const char* const state, const size_t length)
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        for (const std::shared_ptr<const PatchStateClone>& c : clones)
+        {
+            if (c->owner != owner && c->state.length() == length && std::memcmp(c->state.buffer(), state, length) == 0)
+                return c;
+        }
+        return nullptr;
+    }
+
+    // the saved patch may be copied by several new instances at once
+    json_t* copyPatch(const PatchStateClone& clone)
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        return json_deep_copy(clone.rootJ);
+    }
+};
+
+// -----------------------------------------------------------------------------------------------------------
+
+// Patches of a directory assigned to the plugin programs in name order, switched by MIDI program change or by the host.
+// A thread of its own reads the files ahead into memory, up to kPatchBankMemoryBudget for the whole bank,
+// and has the data of the requested program ready for the switch. While a UI is open the switch is taken from its idle,
+// otherwise the bank thread hands it to `load`, which returns false to leave it pending.
+// The new patch is then unpacked and its modules created while the current one keeps playing, as with any other patch load.
+class PatchBank
+{
+public:
+    typedef std::function<bool(const uint8_t* data, size_t size)> LoadFunction;
+
+    explicit PatchBank(const LoadFunction& load)
+        : fLoad(load) {}
+
+    ~PatchBank()
+    {
+        stop();
+    }
+
+    const std::string& getDirectory() const noexcept
+    {
+        return fDirectory;
+    }
+
+    void setDirectory(const std::string& directory)
+    {
+        stop();
+
+        const std::lock_guard<std::mutex> lock(fMutex);
+
+        fDirectory = directory;
+        fEntries.clear();
+        fStop = false;
+
+        if (directory.empty() || ! rack::system::isDirectory(directory))
+            return;
+
+        std::vector<std::string> paths;
+
+        for (const std::string& path : rack::system::getEntries(directory))
+        {
+            if (rack::system::getExtension(path) == ".vcv")
+                paths.push_back(path);
+        }
+
+        std::sort(paths.begin(), paths.end());
+
+        if (paths.size() > kCardinalProgramCount)
+            paths.resize(kCardinalProgramCount);
+
+        fEntries.resize(paths.size());
+        for (size_t i = 0; i < paths.size(); ++i)
+            fEntries[i].path = paths[i];
+
+        fThread = std::thread([this]() { run(); });
+    }
+
+    // from the audio thread or the host, only the latest request is switched to
+    void requestProgram(const uint32_t index)
+    {
+        if (! fThread.joinable())
+            return;
+
+        fRequestedProgram = static_cast<int>(index);
+        fCondition.notify_one();
+    }
+
+    // from the UI idle, the data of the switch still to be done, if any
+    std::shared_ptr<const std::vector<uint8_t>> takePendingProgram()
+    {
+        const std::lock_guard<std::mutex> lock(fMutex);
+        std::shared_ptr<const std::vector<uint8_t>> data;
+        data.swap(fPendingData);
+        return data;
+    }
+
+    void stop()
+    {
+        {
+            const std::lock_guard<std::mutex> lock(fMutex);
+            fStop = true;
+        }
+        fCondition.notify_all();
+
+        if (fThread.joinable())
+            fThread.join();
+    }
+
+private:
+    struct Entry {
+        std::string path;
+        std::shared_ptr<const std::vector<uint8_t>> data;
+    };
+
+    const LoadFunction fLoad;
+    std::string fDirectory;
+    std::vector<Entry> fEntries;
+    std::shared_ptr<const std::vector<uint8_t>> fPendingData;
+    std::atomic<int> fRequestedProgram{-1};
+    std::mutex fMutex;
+    std::condition_variable fCondition;
+    bool fStop = false;
+    std::thread fThread;
+
+    // the read ahead data of a program, otherwise read right away
+    std::shared_ptr<const std::vector<uint8_t>> readProgram(std::unique_lock<std::mutex>& lock, const uint32_t index)
+    {
+        if (index >= fEntries.size())
+            return nullptr;
+
+        std::shared_ptr<const std::vector<uint8_t>> data = fEntries[index].data;
+
+        if (data == nullptr)
+        {
+            const std::string path = fEntries[index].path;
+            lock.unlock();
+
+            try {
+                data = std::make_shared<const std::vector<uint8_t>>(rack::system::readFile(path));
+            } DISTRHO_SAFE_EXCEPTION("PatchBank readFile");
+
+            lock.lock();
+        }
+
+        if (data == nullptr || data->size() < 4)
+            return nullptr;
+
+        return data;
+    }
+
+    void run()
+    {
+        size_t next = 0;
+        size_t used = 0;
+
+        std::unique_lock<std::mutex> lock(fMutex);
+
+        while (! fStop)
+        {
+            // switches first, reading ahead continues afterwards
+            const int program = fRequestedProgram.exchange(-1);
+
+            if (program >= 0)
+            {
+                if (std::shared_ptr<const std::vector<uint8_t>> data = readProgram(lock, program))
+                    fPendingData = data;
+                continue;
+            }
+
+            // no UI takes the switch, do it here
+            if (fPendingData != nullptr)
+            {
+                std::shared_ptr<const std::vector<uint8_t>> data;
+                data.swap(fPendingData);
+                lock.unlock();
+
+                const bool loaded = fLoad(data->data(), data->size());
+
+                lock.lock();
+
+                // a newer request may have come meanwhile
+                if (! loaded && fPendingData == nullptr && fRequestedProgram == -1)
+                {
+                    fPendingData = data;
+                    fCondition.wait_for(lock, std::chrono::milliseconds(50));
+                }
+                continue;
+            }
+
+            if (next < fEntries.size())
+            {
+                const std::string path = fEntries[next].path;
+                lock.unlock();
+
+                std::shared_ptr<const std::vector<uint8_t>> data;
+                try {
+                    data = std::make_shared<const std::vector<uint8_t>>(rack::system::readFile(path));
+                } DISTRHO_SAFE_EXCEPTION("PatchBank read ahead");
+
+                lock.lock();
+
+                if (data != nullptr && used + data->size() <= kPatchBankMemoryBudget)
+                {
+                    used += data->size();
+                    fEntries[next].data = data;
+                }
+
+                ++next;
+                continue;
+            }
+
+            // notifications from the audio thread are sent without the lock, do not rely on them alone
+            fCondition.wait_for(lock, std::chrono::milliseconds(50));
+        }
+    }
+};
+
 
 // -----------------------------------------------------------------------------------------------------------
 
@@ -157,9 +494,53 @@ class CardinalPlugin : public CardinalBasePlugin
     float** fAudioBufferCopy;
    #endif
 
+    // oversampling, enabled per patch
+    uint32_t fOversampling;
+   #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+    float** fOversampledInputs;
+    rack::dsp::PolyphaseUpsampler<kMaxOversampling, kOversamplingQuality> fUpsamplers[DISTRHO_PLUGIN_NUM_INPUTS];
+   #endif
+    float** fOversampledOutputs;
+    rack::dsp::PolyphaseDecimator<kMaxOversampling, kOversamplingQuality> fDecimators[DISTRHO_PLUGIN_NUM_OUTPUTS];
+    MidiEvent fOversampledMidiEvents[kMaxOversampledMidiEvents];
+
+    // MIDI events of blocks skipped while the patch was edited, replayed at the start of the next stepped block
+    MidiEvent fSkippedMidiEvents[kMaxOversampledMidiEvents];
+    uint32_t fSkippedMidiEventCount;
+    uint8_t fSkippedMidiData[kMaxBlockQuantumMidiData];
+    uint32_t fSkippedMidiDataUsed;
+    MidiEvent fReplayMidiEvents[kMaxOversampledMidiEvents];
+
+    // MIDI events of each block per channel filter, see CardinalPluginContext::midiChannelEvents
+    const MidiEvent* fMidiChannelEvents[17][kMaxOversampledMidiEvents];
+
+    // MIDI output written by modules, sent to the host once per run
+    MidiEvent fMidiOutEvents[kMaxMidiOutputEvents];
+
+    // fixed engine block size, enabled per patch
+    uint32_t fBlockQuantum;
+    uint32_t fBlockQuantumFrame;
+   #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+    float** fBlockQuantumInputs;
+   #endif
+    float** fBlockQuantumOutputs;
+    MidiEvent fBlockQuantumMidiEvents[kMaxOversampledMidiEvents];
+    uint32_t fBlockQuantumMidiEventCount;
+    uint8_t fBlockQuantumMidiData[kMaxBlockQuantumMidiData];
+    uint32_t fBlockQuantumMidiDataUsed;
+    bool fBlockQuantumReset;
+
+    // latency reported to the host, from the fixed block size and modules buffering audio
+    uint32_t fLatency;
+
     std::string fAutosavePath;
     uint64_t fNextExpectedFrame;
 
+    // last serialized "patch" state, reused while the patch fingerprint stays the same
+    mutable String fCachedPatchState;
+    mutable uint64_t fCachedPatchFingerprint;
+    mutable bool fCachedPatchStateValid;
+
     struct {
         String comment;
         String screenshot;
@@ -168,18 +549,42 @@ class CardinalPlugin : public CardinalBasePlugin
        #endif
     } fState;
 
+    // parameters changed since the previous engine block, kept while the engine is not stepped
+    uint32_t fParameterChangedMask;
+
     // bypass handling
     bool fWasBypassed;
+    bool fEngineSuspended;
+    uint32_t fBypassTailFrames;
+    uint32_t fBypassFadeInFrames;
     MidiEvent bypassMidiEvents[16];
 
+    // sleep when idle, the engine is not stepped after the patch went silent for its idle time
+    bool fIdleSleeping;
+    bool fIdleWasPlaying;
+    uint32_t fIdleSilentFrames;
+
+    // patch loading, output fades out before the engine swaps patches and back in once done
+    std::atomic<bool> fSwapFadeOutRequested;
+    std::atomic<bool> fSwapFadedOut;
+    bool fSwapFadingOut;
+    uint32_t fSwapFadeOutFrames;
+
+    // patch loads from the host state and from the bank thread do not overlap
+    std::mutex fPatchLoadMutex;
+    PatchBank fBank;
+
    #ifndef HEADLESS
     // real values, not VCV interpreted ones
     float fWindowParameters[kWindowParameterCount];
    #endif
 
+    // engine load in percent and xrun count, refreshed once per run
+    float fEngineParameters[kEngineParameterCount];
+
 public:
     CardinalPlugin()
-        : CardinalBasePlugin(kModuleParameters + kWindowParameterCount + 1, 0, kCardinalStateCount),
+        : CardinalBasePlugin(kEngineParameterOffset + kEngineParameterCount, kCardinalHostProgramCount, kCardinalStateCount),
          #ifdef DISTRHO_OS_WASM
           fInitializer(new Initializer(this, static_cast<const CardinalBaseUI*>(nullptr))),
          #else
@@ -188,9 +593,42 @@ public:
          #if DISTRHO_PLUGIN_NUM_INPUTS != 0
           fAudioBufferCopy(nullptr),
          #endif
+          fOversampling(1),
+         #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+          fOversampledInputs(nullptr),
+         #endif
+          fOversampledOutputs(nullptr),
+          fSkippedMidiEventCount(0),
+          fSkippedMidiDataUsed(0),
+          fBlockQuantum(0),
+          fBlockQuantumFrame(0),
+         #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+          fBlockQuantumInputs(nullptr),
+         #endif
+          fBlockQuantumOutputs(nullptr),
+          fBlockQuantumMidiEventCount(0),
+          fBlockQuantumMidiDataUsed(0),
+          fBlockQuantumReset(false),
+          fLatency(0),
           fNextExpectedFrame(0),
-          fWasBypassed(false)
+          fCachedPatchFingerprint(0),
+          fCachedPatchStateValid(false),
+          fParameterChangedMask(0),
+          fWasBypassed(false),
+          fEngineSuspended(false),
+          fBypassTailFrames(0),
+          fBypassFadeInFrames(0),
+          fIdleSleeping(false),
+          fIdleWasPlaying(false),
+          fIdleSilentFrames(0),
+          fSwapFadeOutRequested(false),
+          fSwapFadedOut(false),
+          fSwapFadingOut(false),
+          fSwapFadeOutFrames(0),
+          fBank([this](const uint8_t* const data, const size_t size) { return loadBankPatchWithoutUI(data, size); })
     {
+        std::memset(fEngineParameters, 0, sizeof(fEngineParameters));
+
        #ifndef HEADLESS
         fWindowParameters[kWindowParameterShowTooltips] = 1.0f;
         fWindowParameters[kWindowParameterCableOpacity] = 50.0f;
@@ -237,6 +675,9 @@ public:
             bypassMidiEvents[i].data[1] = 0x7B;
         }
 
+        context->midiOutEvents = fMidiOutEvents;
+        context->midiOutEventCapacity = kMaxMidiOutputEvents;
+
         const float sampleRate = getSampleRate();
         rack::settings::sampleRate = sampleRate;
 
@@ -274,16 +715,23 @@ public:
         }
 
        #ifdef CARDINAL_INIT_OSC_THREAD
-        fInitializer->oscPlugin = this;
+        fInitializer->addOscPlugin(this);
        #endif
+
+        memusage::report("instance creation");
     }
 
     ~CardinalPlugin() override
     {
        #ifdef CARDINAL_INIT_OSC_THREAD
-        fInitializer->oscPlugin = nullptr;
+        fInitializer->removeOscPlugin(this);
        #endif
 
+        PatchStateClones::get().set(this, nullptr);
+
+        // bank switches need the context
+        fBank.stop();
+
         {
             const ScopedContext sc(this);
             context->patch->clear();
@@ -430,6 +878,36 @@ protected:
             return;
         }
 
+        if (index >= kEngineParameterOffset)
+        {
+            parameter.hints = kParameterIsOutput;
+            parameter.ranges.def = 0.0f;
+            parameter.ranges.min = 0.0f;
+
+            switch (index - kEngineParameterOffset)
+            {
+            case kEngineParameterAverageLoad:
+                parameter.name = "Engine load";
+                parameter.symbol = "engineLoad";
+                parameter.unit = "%";
+                parameter.ranges.max = 100.0f;
+                break;
+            case kEngineParameterPeakLoad:
+                parameter.name = "Engine peak load";
+                parameter.symbol = "enginePeakLoad";
+                parameter.unit = "%";
+                parameter.ranges.max = 100.0f;
+                break;
+            case kEngineParameterXruns:
+                parameter.name = "Engine xruns";
+                parameter.symbol = "engineXruns";
+                parameter.hints |= kParameterIsInteger;
+                parameter.ranges.max = kEngineParameterMaxXruns;
+                break;
+            }
+            return;
+        }
+
        #ifndef HEADLESS
         switch (index - kModuleParameters - 1)
         {
@@ -624,11 +1102,16 @@ protected:
             state.label = "Comment";
             break;
         case 3:
+            state.hints = kStateIsOnlyForDSP;
+            state.key = "bank";
+            state.label = "Patch bank";
+            break;
+        case 4:
             state.hints = kStateIsOnlyForUI;
             state.key = "moduleInfos";
             state.label = "moduleInfos";
             break;
-        case 4:
+        case 5:
             state.hints = kStateIsOnlyForUI;
             state.key = "windowSize";
             state.label = "Window size";
@@ -649,6 +1132,10 @@ protected:
         if (index == kModuleParameters)
             return context->bypassed ? 1.0f : 0.0f;
 
+        // engine load
+        if (index >= kEngineParameterOffset)
+            return fEngineParameters[index - kEngineParameterOffset];
+
        #ifndef HEADLESS
         // window related parameters
         index -= kModuleParameters + 1;
@@ -665,6 +1152,9 @@ protected:
         // host mapped parameters
         if (index < kModuleParameters)
         {
+            if (d_isNotEqual(context->parameters[index], value))
+                fParameterChangedMask |= 1u << index;
+
             context->parameters[index] = value;
             return;
         }
@@ -742,6 +1232,8 @@ protected:
             return fState.comment;
         if (std::strcmp(key, "screenshot") == 0)
             return fState.screenshot;
+        if (std::strcmp(key, "bank") == 0)
+            return String(fBank.getDirectory().c_str());
 
         if (std::strcmp(key, "patch") != 0)
             return String();
@@ -753,17 +1245,178 @@ protected:
         {
             const ScopedContext sc(this);
 
+            const uint64_t fingerprint = getPatchFingerprint();
+
+            if (fCachedPatchStateValid && fCachedPatchFingerprint == fingerprint)
+                return fCachedPatchState;
+
+            json_t* rootJ = nullptr;
+
             context->engine->prepareSave();
-            context->patch->saveAutosave();
+            patchUtils::saveAutosave(&rootJ);
             context->patch->cleanAutosave();
             // context->history->setSaved();
 
             try {
-                data = rack::system::archiveDirectory(fAutosavePath, 1);
+                data = patchUtils::archiveDirectory(fAutosavePath, CARDINAL_STATE_COMPRESSION_LEVEL);
             } DISTRHO_SAFE_EXCEPTION_RETURN("getState archiveDirectory", String());
+
+            fCachedPatchState = String::asBase64(data.data(), data.size());
+            fCachedPatchFingerprint = fingerprint;
+            fCachedPatchStateValid = true;
+
+            setPatchStateClone(rootJ);
+        }
+
+        return fCachedPatchState;
+    }
+
+    // Keeps the patch just saved for instances created with the same state, see PatchStateClones.
+    // Patches with module data files are left out, those files keep changing with the patch.
+    void setPatchStateClone(json_t* const rootJ) const
+    {
+        const std::string modulesPath = rack::system::join(fAutosavePath, "modules");
+
+        if (rootJ == nullptr || (rack::system::isDirectory(modulesPath) && ! rack::system::getEntries(modulesPath).empty()))
+        {
+            json_decref(rootJ);
+            PatchStateClones::get().set(this, nullptr);
+            return;
+        }
+
+        const std::shared_ptr<PatchStateClone> clone(new PatchStateClone);
+        clone->owner = this;
+        clone->state = fCachedPatchState;
+        clone->rootJ = rootJ;
+
+        for (const int64_t moduleId : context->engine->getModuleIds())
+        {
+            rack::engine::Module* const module = context->engine->getModule(moduleId);
+            rack::engine::ModuleClone* const moduleClone = dynamic_cast<rack::engine::ModuleClone*>(module);
+            if (moduleClone == nullptr)
+                continue;
+
+            std::shared_ptr<const void> moduleState;
+            try {
+                moduleState = moduleClone->saveClone();
+            } DISTRHO_SAFE_EXCEPTION("saveClone");
+
+            if (moduleState != nullptr)
+                clone->moduleStates.emplace_back(moduleId, std::move(moduleState));
+        }
+
+        PatchStateClones::get().set(this, clone);
+    }
+
+    // Loads the patch of another instance that gave the host this same state, without going through the state.
+    bool loadPatchStateClone(const char* const value, const std::function<void()>& aboutToSwap)
+    {
+        const std::shared_ptr<const PatchStateClone> clone(PatchStateClones::get().find(this, value, std::strlen(value)));
+        if (clone == nullptr)
+            return false;
+
+        json_t* const rootJ = PatchStateClones::get().copyPatch(*clone);
+        DISTRHO_SAFE_ASSERT_RETURN(rootJ != nullptr, false);
+
+        // modules loading their state from the clone skip dataFromJson(), all others go through the JSON copy
+        if (json_t* const modulesJ = json_object_get(rootJ, "modules"))
+        {
+            size_t moduleIndex;
+            json_t* moduleJ;
+            json_array_foreach(modulesJ, moduleIndex, moduleJ)
+            {
+                const int64_t moduleId = json_integer_value(json_object_get(moduleJ, "id"));
+
+                for (const auto& moduleState : clone->moduleStates)
+                {
+                    if (moduleState.first != moduleId)
+                        continue;
+                    json_object_del(moduleJ, "data");
+                    break;
+                }
+            }
+        }
+
+        try {
+            patchUtils::loadFromClone(rootJ, aboutToSwap);
+        } catch (...) {
+            json_decref(rootJ);
+            throw;
+        }
+
+        json_decref(rootJ);
+
+        // all module states at once, the audio thread is only held off for a single block
+        rack::engine::Engine_beginEdits(context->engine);
+        for (const auto& moduleState : clone->moduleStates)
+        {
+            rack::engine::Module* const module = context->engine->getModule(moduleState.first);
+            rack::engine::ModuleClone* const moduleClone = dynamic_cast<rack::engine::ModuleClone*>(module);
+            if (moduleClone == nullptr)
+                continue;
+
+            try {
+                moduleClone->loadClone(moduleState.second);
+            } DISTRHO_SAFE_EXCEPTION("loadClone");
+        }
+        rack::engine::Engine_endEdits(context->engine);
+
+        return true;
+    }
+
+    // Hash of everything that can change the saved patch: history position, cables, params and module data.
+    // Much cheaper than saving, archiving and encoding the patch, but still needs a valid context.
+    uint64_t getPatchFingerprint() const
+    {
+        uint64_t hash = 14695981039346656037ULL;
+
+        const auto mix = [&hash](const void* const ptr, const size_t size) {
+            const uint8_t* const bytes = static_cast<const uint8_t*>(ptr);
+            for (size_t i = 0; i < size; ++i)
+            {
+                hash ^= bytes[i];
+                hash *= 1099511628211ULL;
+            }
+        };
+
+        const rack::history::State* const history = context->history;
+        const int actionIndex = history->actionIndex;
+        const size_t numActions = history->actions.size();
+        const void* const lastAction = actionIndex > 0 ? history->actions[actionIndex - 1] : nullptr;
+        mix(&actionIndex, sizeof(actionIndex));
+        mix(&numActions, sizeof(numActions));
+        mix(&lastAction, sizeof(lastAction));
+
+        rack::engine::Engine* const engine = context->engine;
+
+        for (const int64_t cableId : engine->getCableIds())
+            mix(&cableId, sizeof(cableId));
+
+        for (const int64_t moduleId : engine->getModuleIds())
+        {
+            rack::engine::Module* const module = engine->getModule(moduleId);
+            DISTRHO_SAFE_ASSERT_CONTINUE(module != nullptr);
+
+            mix(&moduleId, sizeof(moduleId));
+
+            for (rack::engine::Param& param : module->params)
+            {
+                const float value = param.getValue();
+                mix(&value, sizeof(value));
+            }
+
+            if (json_t* const dataJ = module->dataToJson())
+            {
+                if (char* const json = json_dumps(dataJ, JSON_COMPACT | JSON_SORT_KEYS))
+                {
+                    mix(json, std::strlen(json));
+                    std::free(json);
+                }
+                json_decref(dataJ);
+            }
         }
 
-        return String::asBase64(data.data(), data.size());
+        return hash;
     }
 
     void setState(const char* const key, const char* const value) override
@@ -825,58 +1478,151 @@ protected:
             return;
         }
 
+        if (std::strcmp(key, "bank") == 0)
+        {
+            fBank.setDirectory(value);
+            return;
+        }
+
         if (std::strcmp(key, "patch") != 0)
             return;
         if (fAutosavePath.empty())
             return;
 
-        const std::vector<uint8_t> data(d_getChunkFromBase64String(value));
+        const std::lock_guard<std::mutex> lock(fPatchLoadMutex);
+        const ScopedContext sc(this);
 
-        DISTRHO_SAFE_ASSERT_RETURN(data.size() >= 4,);
+        fCachedPatchStateValid = false;
 
-        rack::system::removeRecursively(fAutosavePath);
-        rack::system::createDirectories(fAutosavePath);
+        const auto fadeOut = [this]() { fadeOutForSwap(); };
+        bool cloned = false;
 
-        static constexpr const char zstdMagic[] = "\x28\xb5\x2f\xfd";
+        try {
+            cloned = loadPatchStateClone(value, fadeOut);
+        } DISTRHO_SAFE_EXCEPTION("setState loadPatchStateClone");
 
-        if (std::memcmp(data.data(), zstdMagic, sizeof(zstdMagic)) != 0)
+        if (! cloned)
         {
-            FILE* const f = std::fopen(rack::system::join(fAutosavePath, "patch.json").c_str(), "w");
-            DISTRHO_SAFE_ASSERT_RETURN(f != nullptr,);
+            const std::vector<uint8_t> data(d_getChunkFromBase64String(value));
 
-            std::fwrite(data.data(), data.size(), 1, f);
-            std::fclose(f);
-        }
-        else
-        {
-            try {
-                rack::system::unarchiveToDirectory(data, fAutosavePath);
-            } DISTRHO_SAFE_EXCEPTION_RETURN("setState unarchiveToDirectory",);
-        }
+            DISTRHO_SAFE_ASSERT(data.size() >= 4);
 
-        const ScopedContext sc(this);
+            if (data.size() >= 4)
+            {
+                try {
+                    patchUtils::loadFromMemory(data.data(), data.size(), fadeOut);
+                } DISTRHO_SAFE_EXCEPTION("setState loadFromMemory");
+            }
+        }
 
-        try {
-            context->patch->loadAutosave();
-        } DISTRHO_SAFE_EXCEPTION_RETURN("setState loadAutosave",);
+        fSwapFadedOut = false;
+        fSwapFadeOutRequested = false;
 
         // context->history->setSaved();
     }
 
    /* --------------------------------------------------------------------------------------------------------
-    * Process */
+    * Programs */
 
-    void activate() override
+   #if DISTRHO_PLUGIN_WANT_PROGRAMS
+    void initProgramName(const uint32_t index, String& programName) override
     {
-        context->bufferSize = getBufferSize();
-
-       #if DISTRHO_PLUGIN_NUM_INPUTS != 0
-        fAudioBufferCopy = new float*[DISTRHO_PLUGIN_NUM_INPUTS];
-        for (int i=0; i<DISTRHO_PLUGIN_NUM_INPUTS; ++i)
-            fAudioBufferCopy[i] = new float[context->bufferSize];
-       #endif
-
-        fNextExpectedFrame = 0;
+        programName = String("Bank patch ") + String(index + 1);
+    }
+
+    void loadProgram(const uint32_t index) override
+    {
+        fBank.requestProgram(index);
+    }
+   #endif
+
+   #if !defined(HEADLESS) && DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
+    void uiIdle() override
+    {
+        if (const std::shared_ptr<const std::vector<uint8_t>> data = fBank.takePendingProgram())
+            loadBankPatch(data->data(), data->size());
+    }
+   #endif
+
+    // from the bank thread, bank switches go through the UI idle while there is one
+    bool loadBankPatchWithoutUI(const uint8_t* const data, const size_t size)
+    {
+       #if !defined(HEADLESS) && DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
+        if (context->ui != nullptr)
+            return false;
+       #endif
+
+        loadBankPatch(data, size);
+        return true;
+    }
+
+    // new modules are created while the current patch keeps playing, fade out only for the swap itself
+    void fadeOutForSwap()
+    {
+        fSwapFadeOutRequested = true;
+        for (int i = 0; i < 50 && ! fSwapFadedOut; ++i)
+            d_msleep(1);
+    }
+
+    // from the UI idle, or from the bank thread while there is no UI
+    void loadBankPatch(const uint8_t* const data, const size_t size)
+    {
+        if (fAutosavePath.empty())
+            return;
+
+        const std::lock_guard<std::mutex> lock(fPatchLoadMutex);
+        const ScopedContext sc(this);
+
+        fCachedPatchStateValid = false;
+
+        try {
+            patchUtils::loadFromMemory(data, size, [this]() { fadeOutForSwap(); });
+        } DISTRHO_SAFE_EXCEPTION("loadBankPatch loadFromMemory");
+
+        fSwapFadedOut = false;
+        fSwapFadeOutRequested = false;
+    }
+
+   /* --------------------------------------------------------------------------------------------------------
+    * Process */
+
+    void activate() override
+    {
+        const uint32_t bufferSize = getBufferSize();
+        // engine blocks can be larger than the host buffer when using a fixed block size
+        const uint32_t engineBufferSize = std::max(bufferSize, kMaxBlockQuantum) * kMaxOversampling;
+        context->bufferSize = (fBlockQuantum != 0 ? fBlockQuantum : bufferSize) * fOversampling;
+        rack::engine::Engine_setMaxBufferSize(context->engine, bufferSize);
+
+       #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+        fAudioBufferCopy = new float*[DISTRHO_PLUGIN_NUM_INPUTS];
+        fOversampledInputs = new float*[DISTRHO_PLUGIN_NUM_INPUTS];
+        fBlockQuantumInputs = new float*[DISTRHO_PLUGIN_NUM_INPUTS];
+        for (int i=0; i<DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+        {
+            // zeroed, inputs only get copied once a module reads them
+            fAudioBufferCopy[i] = new float[bufferSize]();
+            fOversampledInputs[i] = new float[engineBufferSize];
+            fBlockQuantumInputs[i] = new float[kMaxBlockQuantum]();
+        }
+       #endif
+
+        fOversampledOutputs = new float*[DISTRHO_PLUGIN_NUM_OUTPUTS];
+        fBlockQuantumOutputs = new float*[DISTRHO_PLUGIN_NUM_OUTPUTS];
+        for (int i=0; i<DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+        {
+            fOversampledOutputs[i] = new float[engineBufferSize];
+            fBlockQuantumOutputs[i] = new float[kMaxBlockQuantum]();
+        }
+
+        fBlockQuantumFrame = 0;
+        fBlockQuantumMidiEventCount = 0;
+        fBlockQuantumMidiDataUsed = 0;
+        fBlockQuantumReset = false;
+        fSkippedMidiEventCount = 0;
+        fSkippedMidiDataUsed = 0;
+        context->midiOutEventCount = 0;
+        fNextExpectedFrame = 0;
     }
 
     void deactivate() override
@@ -889,7 +1635,39 @@ protected:
             delete[] fAudioBufferCopy;
             fAudioBufferCopy = nullptr;
         }
+
+        if (fOversampledInputs != nullptr)
+        {
+            for (int i=0; i<DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+                delete[] fOversampledInputs[i];
+            delete[] fOversampledInputs;
+            fOversampledInputs = nullptr;
+        }
+
+        if (fBlockQuantumInputs != nullptr)
+        {
+            for (int i=0; i<DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+                delete[] fBlockQuantumInputs[i];
+            delete[] fBlockQuantumInputs;
+            fBlockQuantumInputs = nullptr;
+        }
        #endif
+
+        if (fOversampledOutputs != nullptr)
+        {
+            for (int i=0; i<DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+                delete[] fOversampledOutputs[i];
+            delete[] fOversampledOutputs;
+            fOversampledOutputs = nullptr;
+        }
+
+        if (fBlockQuantumOutputs != nullptr)
+        {
+            for (int i=0; i<DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+                delete[] fBlockQuantumOutputs[i];
+            delete[] fBlockQuantumOutputs;
+            fBlockQuantumOutputs = nullptr;
+        }
     }
 
     void run(const float** const inputs, float** const outputs, const uint32_t frames,
@@ -897,7 +1675,67 @@ protected:
     {
         rack::contextSet(context);
 
-        const bool bypassed = context->bypassed;
+        // program changes switch the bank patch, the bank thread gets the switch ready
+        for (uint32_t i = 0; i < midiEventCount; ++i)
+        {
+            const MidiEvent& midiEvent(midiEvents[i]);
+
+            if (midiEvent.size == 2 && (midiEvent.data[0] & 0xF0) == 0xC0)
+                fBank.requestProgram(midiEvent.data[1]);
+        }
+
+        // only the native standalone owns its audio thread, hosts and JACK schedule theirs
+        if (isUsingNativeAudio())
+            rack::engine::Engine_applyAudioThreadScheduling(context->engine, frames / getSampleRate());
+
+        // engine meters are averaged over a second, this only picks up their latest values
+        {
+            rack::engine::Engine* const engine = context->engine;
+            fEngineParameters[kEngineParameterAverageLoad] = std::min(100.0, engine->getMeterAverage() * 100.0);
+            fEngineParameters[kEngineParameterPeakLoad] = std::min(100.0, engine->getMeterMax() * 100.0);
+            fEngineParameters[kEngineParameterXruns] = std::min(kEngineParameterMaxXruns,
+                                                                static_cast<float>(rack::engine::Engine_getXrunCount(engine)));
+        }
+
+        const uint32_t oversampling = rack::engine::Engine_getOversampling(context->engine);
+        const uint32_t quantum = rack::engine::Engine_getBlockQuantum(context->engine);
+
+        if (fBlockQuantum != quantum)
+        {
+            fBlockQuantum = quantum;
+            fBlockQuantumFrame = 0;
+            fBlockQuantumMidiEventCount = 0;
+            fBlockQuantumMidiDataUsed = 0;
+            context->bufferSize = (quantum != 0 ? quantum : getBufferSize()) * oversampling;
+
+            // the first queued block is silent
+            for (int i=0; i<DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+                std::memset(fBlockQuantumOutputs[i], 0, sizeof(float)*kMaxBlockQuantum);
+        }
+
+        if (fOversampling != oversampling)
+        {
+            fOversampling = oversampling;
+            context->bufferSize = (quantum != 0 ? quantum : getBufferSize()) * oversampling;
+            context->oversampling = oversampling;
+
+           #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+            for (int i=0; i<DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+                fUpsamplers[i].setFactor(oversampling);
+           #endif
+            for (int i=0; i<DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+                fDecimators[i].setFactor(oversampling);
+        }
+
+        // engine latency is counted in engine frames, rounded up to host frames
+        const uint32_t engineLatency = rack::engine::Engine_getLatency(context->engine);
+        const uint32_t latency = quantum + (engineLatency + oversampling - 1) / oversampling;
+
+        if (fLatency != latency)
+        {
+            fLatency = latency;
+            setLatency(latency);
+        }
 
         {
             const TimePosition& timePos(getTimePosition());
@@ -912,6 +1750,9 @@ protected:
             context->bbtValid = timePos.bbt.valid;
             context->frame = timePos.frame;
 
+            // frozen modules play back their loops in sync with the transport
+            rack::engine::Engine_setTransportFrame(context->engine, timePos.playing ? static_cast<int64_t>(timePos.frame) : -1);
+
             if (timePos.bbt.valid)
             {
                 const double samplesPerTick = 60.0 * getSampleRate()
@@ -926,7 +1767,7 @@ protected:
                 context->tick = timePos.bbt.tick;
                 context->ticksPerBeat = timePos.bbt.ticksPerBeat;
                 context->ticksPerClock = timePos.bbt.ticksPerBeat / timePos.bbt.beatType;
-                context->ticksPerFrame = 1.0 / samplesPerTick;
+                context->ticksPerFrame = 1.0 / samplesPerTick / oversampling;
                 context->tickClock = std::fmod(timePos.bbt.tick, context->ticksPerClock);
             }
 
@@ -934,8 +1775,211 @@ protected:
             fNextExpectedFrame = timePos.playing ? timePos.frame + frames : 0;
         }
 
+        if (quantum == 0)
+        {
+            context->midiOutFrameOffset = 0;
+            processEngineBlock(inputs, outputs, frames, midiEvents, midiEventCount);
+            flushMidiOutput(frames);
+            return;
+        }
+
+        // fixed engine block size, host audio goes through a queue of one block
+        const uint64_t hostFrame = context->frame;
+        fBlockQuantumReset = fBlockQuantumReset || context->reset;
+
+        uint32_t midiEventIndex = 0;
+
+        for (uint32_t offset = 0; offset < frames;)
+        {
+            const uint32_t count = std::min(frames - offset, quantum - fBlockQuantumFrame);
+
+            // queue inputs before writing outputs, as hosts can use the same buffers for both
+           #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+            for (int i=0; i<DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+            {
+                float* const dataIn = fBlockQuantumInputs[i] + fBlockQuantumFrame;
+
+                // can be null on main variant
+                if (inputs == nullptr || inputs[i] == nullptr)
+                    std::memset(dataIn, 0, sizeof(float)*count);
+                else
+                    std::memcpy(dataIn, inputs[i] + offset, sizeof(float)*count);
+            }
+           #endif
+
+            for (; midiEventIndex < midiEventCount && midiEvents[midiEventIndex].frame < offset + count; ++midiEventIndex)
+            {
+                const MidiEvent& midiEvent(midiEvents[midiEventIndex]);
+
+                if (fBlockQuantumMidiEventCount == kMaxOversampledMidiEvents)
+                    continue;
+
+                MidiEvent& queuedEvent(fBlockQuantumMidiEvents[fBlockQuantumMidiEventCount]);
+                queuedEvent = midiEvent;
+                queuedEvent.frame = fBlockQuantumFrame + midiEvent.frame - offset;
+
+                // host sysex data is only valid during this run, keep a copy
+                if (midiEvent.size > MidiEvent::kDataSize)
+                {
+                    if (fBlockQuantumMidiDataUsed + midiEvent.size > kMaxBlockQuantumMidiData)
+                        continue;
+
+                    uint8_t* const data = fBlockQuantumMidiData + fBlockQuantumMidiDataUsed;
+                    std::memcpy(data, midiEvent.dataExt, midiEvent.size);
+                    queuedEvent.dataExt = data;
+                    fBlockQuantumMidiDataUsed += midiEvent.size;
+                }
+
+                ++fBlockQuantumMidiEventCount;
+            }
+
+            for (int i=0; i<DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+            {
+               #if CARDINAL_VARIANT_MAIN
+                // can be null on main variant
+                if (outputs[i] == nullptr)
+                    continue;
+               #endif
+                std::memcpy(outputs[i] + offset, fBlockQuantumOutputs[i] + fBlockQuantumFrame, sizeof(float)*count);
+            }
+
+            fBlockQuantumFrame += count;
+            offset += count;
+
+            if (fBlockQuantumFrame != quantum)
+                continue;
+
+            // the queued block started this many host frames ago
+            if (context->playing)
+                context->frame = hostFrame + offset > quantum ? hostFrame + offset - quantum : 0;
+
+            context->reset = fBlockQuantumReset;
+            fBlockQuantumReset = false;
+
+            // the block output is heard from this offset on, possibly continuing into the next run
+            context->midiOutFrameOffset = offset;
+
+           #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+            processEngineBlock(const_cast<const float**>(fBlockQuantumInputs), fBlockQuantumOutputs, quantum,
+                               fBlockQuantumMidiEvents, fBlockQuantumMidiEventCount);
+           #else
+            processEngineBlock(nullptr, fBlockQuantumOutputs, quantum,
+                               fBlockQuantumMidiEvents, fBlockQuantumMidiEventCount);
+           #endif
+
+            fBlockQuantumFrame = 0;
+            fBlockQuantumMidiEventCount = 0;
+            fBlockQuantumMidiDataUsed = 0;
+        }
+
+        flushMidiOutput(frames);
+    }
+
+    void sampleRateChanged(const double newSampleRate) override
+    {
+        rack::contextSet(context);
+        rack::settings::sampleRate = newSampleRate;
+        context->sampleRate = newSampleRate;
+        context->engine->setSampleRate(newSampleRate);
+    }
+
+    // -------------------------------------------------------------------------------------------------------
+
+private:
+   /**
+      Step the engine for a single block of host frames, using the current oversampling.
+      @a frames is never larger than the host buffer size, or the fixed block size if one is set.
+    */
+    void processEngineBlock(const float** const inputs, float** const outputs, const uint32_t frames,
+                            const MidiEvent* const midiEvents, const uint32_t midiEventCount)
+    {
+        const bool bypassed = context->bypassed;
+        const uint32_t oversampling = fOversampling;
+
+        if (bypassed)
+        {
+            // let modules handle the all-notes-off events and release, then stop stepping the engine
+            if (! fWasBypassed)
+            {
+                fBypassTailFrames = getSampleRate() * kBypassTailSeconds;
+            }
+            else if (fEngineSuspended)
+            {
+                for (int i=0; i<DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+                {
+                   #if CARDINAL_VARIANT_MAIN
+                    // can be null on main variant
+                    if (outputs[i] == nullptr)
+                        continue;
+                   #endif
+                    std::memset(outputs[i], 0, sizeof(float)*frames);
+                }
+
+                return;
+            }
+        }
+        else if (fEngineSuspended)
+        {
+            // engine state was kept as-is, fade in to hide the jump from where it stopped
+            fEngineSuspended = false;
+            fBypassFadeInFrames = getSampleRate() * kBypassFadeInSeconds;
+        }
+
+       #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+        const float inputPeak = getBuffersPeak(inputs, DISTRHO_PLUGIN_NUM_INPUTS, frames);
+       #else
+        const float inputPeak = 0.0f;
+       #endif
+
+        // asleep on silence, the engine stays as it was until anything comes in
+        if (fIdleSleeping)
+        {
+            if (! bypassed && ! isIdleWakeup(inputPeak, midiEventCount))
+            {
+                for (int i=0; i<DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+                {
+                   #if CARDINAL_VARIANT_MAIN
+                    // can be null on main variant
+                    if (outputs[i] == nullptr)
+                        continue;
+                   #endif
+                    std::memset(outputs[i], 0, sizeof(float)*frames);
+                }
+
+                return;
+            }
+
+            fIdleSleeping = false;
+            fIdleSilentFrames = 0;
+        }
+
+        // oversampled buffers, upsample host inputs into them
+        if (oversampling != 1)
+        {
+           #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+            for (int i=0; i<DISTRHO_PLUGIN_NUM_INPUTS; ++i)
+            {
+                float* const dataIn = fOversampledInputs[i];
+
+                // can be null on main variant
+                if (inputs == nullptr || inputs[i] == nullptr)
+                {
+                    std::memset(dataIn, 0, sizeof(float)*frames*oversampling);
+                    continue;
+                }
+
+                for (uint32_t f=0; f<frames; ++f)
+                    fUpsamplers[i].process(inputs[i][f], dataIn + f * oversampling);
+            }
+            context->dataIns = fOversampledInputs;
+           #else
+            context->dataIns = nullptr;
+           #endif
+
+            context->dataOuts = fOversampledOutputs;
+        }
         // separate buffers, use them
-        if (inputs != outputs && (inputs == nullptr || inputs[0] != outputs[0]))
+        else if (inputs != outputs && (inputs == nullptr || inputs[0] != outputs[0]))
         {
             context->dataIns = inputs;
             context->dataOuts = outputs;
@@ -946,6 +1990,9 @@ protected:
            #if DISTRHO_PLUGIN_NUM_INPUTS != 0
             for (int i=0; i<DISTRHO_PLUGIN_NUM_INPUTS; ++i)
             {
+                // skip inputs that no module ever read
+                if ((context->dataInsUsed & (1u << i)) == 0)
+                    continue;
                #if CARDINAL_VARIANT_MAIN
                 // can be null on main variant
                 if (inputs[i] != nullptr)
@@ -959,14 +2006,6 @@ protected:
             context->dataOuts = outputs;
         }
 
-        for (int i=0; i<DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
-        {
-           #if CARDINAL_VARIANT_MAIN
-            // can be null on main variant
-            if (outputs[i] != nullptr)
-           #endif
-                std::memset(outputs[i], 0, sizeof(float)*frames);
-        }
 
         if (bypassed)
         {
@@ -987,23 +2026,343 @@ protected:
             context->midiEventCount = midiEventCount;
         }
 
+        // kept in host frames, in case the engine skips this block
+        const MidiEvent* const hostMidiEvents = context->midiEvents;
+        const uint32_t hostMidiEventCount = context->midiEventCount;
+        uint32_t steppedHostMidiEventCount = hostMidiEventCount;
+
+        // events of skipped blocks go first, they are already late
+        if (fSkippedMidiEventCount != 0)
+        {
+            const uint32_t replayedMidiEventCount = fSkippedMidiEventCount;
+
+            // whatever does not fit after them is kept for the next block, see below
+            steppedHostMidiEventCount = std::min(hostMidiEventCount,
+                                                 kMaxOversampledMidiEvents - replayedMidiEventCount);
+
+            std::memcpy(fReplayMidiEvents, fSkippedMidiEvents, sizeof(MidiEvent)*replayedMidiEventCount);
+            if (steppedHostMidiEventCount != 0)
+                std::memcpy(fReplayMidiEvents + replayedMidiEventCount, hostMidiEvents,
+                            sizeof(MidiEvent)*steppedHostMidiEventCount);
+
+            context->midiEvents = fReplayMidiEvents;
+            context->midiEventCount = replayedMidiEventCount + steppedHostMidiEventCount;
+        }
+
+        // MIDI event frames are counted in engine frames
+        if (oversampling != 1 && context->midiEventCount != 0)
+        {
+            const uint32_t midiEventCount = std::min(context->midiEventCount, kMaxOversampledMidiEvents);
+
+            for (uint32_t i=0; i<midiEventCount; ++i)
+            {
+                fOversampledMidiEvents[i] = context->midiEvents[i];
+                fOversampledMidiEvents[i].frame *= oversampling;
+            }
+
+            context->midiEvents = fOversampledMidiEvents;
+            context->midiEventCount = midiEventCount;
+        }
+
+        updateMidiChannelEvents();
+
+        context->parametersChangedMask = fParameterChangedMask;
+
+        // outputs are claimed by the first module writing them, instead of being cleared beforehand
+        context->dataOutsWritten = 0;
+
         ++context->processCounter;
-        context->engine->stepBlock(frames);
+        context->engine->stepBlock(frames * oversampling);
+
+        // the patch was being edited, keep this block's events for the next one instead of losing them.
+        // otherwise the replayed events are done, only the ones that did not fit after them are kept.
+        if (rack::engine::Engine_isBlockSkipped(context->engine))
+        {
+            keepSkippedMidiEvents(hostMidiEvents, hostMidiEventCount);
+        }
+        else
+        {
+            fSkippedMidiEventCount = 0;
+            fSkippedMidiDataUsed = 0;
+            keepSkippedMidiEvents(hostMidiEvents + steppedHostMidiEventCount,
+                                  hostMidiEventCount - steppedHostMidiEventCount);
+        }
+
+        // silence the outputs no module wrote during this block
+        for (int i=0; i<DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+        {
+            if (context->dataOutsWritten & (1u << i))
+                continue;
+
+            if (oversampling != 1)
+            {
+                std::memset(fOversampledOutputs[i], 0, sizeof(float)*frames*oversampling);
+                continue;
+            }
+
+           #if CARDINAL_VARIANT_MAIN
+            // can be null on main variant
+            if (outputs[i] != nullptr)
+           #endif
+                std::memset(outputs[i], 0, sizeof(float)*frames);
+        }
+
+        // changes of skipped blocks are reported again with the next one
+        if (! rack::engine::Engine_isBlockSkipped(context->engine))
+            fParameterChangedMask = 0;
+        context->parametersChangedMask = 0;
+
+        // downsample engine output back to host rate
+        if (oversampling != 1)
+        {
+            for (int i=0; i<DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+            {
+               #if CARDINAL_VARIANT_MAIN
+                // can be null on main variant
+                if (outputs[i] == nullptr)
+                    continue;
+               #endif
+
+                const float* const dataOut = fOversampledOutputs[i];
+
+                for (uint32_t f=0; f<frames; ++f)
+                    outputs[i][f] = fDecimators[i].process(dataOut + f * oversampling);
+            }
+        }
+
+        if (fSwapFadeOutRequested)
+        {
+            const uint32_t fadeFrames = getSampleRate() * kBypassFadeInSeconds;
+
+            if (! fSwapFadingOut)
+            {
+                fSwapFadingOut = true;
+                fSwapFadeOutFrames = fadeFrames;
+                fBypassFadeInFrames = 0;
+            }
+
+            for (int i=0; i<DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+            {
+               #if CARDINAL_VARIANT_MAIN
+                // can be null on main variant
+                if (outputs[i] == nullptr)
+                    continue;
+               #endif
+
+                for (uint32_t f=0; f<frames; ++f)
+                    outputs[i][f] *= f < fSwapFadeOutFrames ? static_cast<float>(fSwapFadeOutFrames - f) / fadeFrames : 0.0f;
+            }
+
+            fSwapFadeOutFrames -= std::min(frames, fSwapFadeOutFrames);
+
+            if (fSwapFadeOutFrames == 0)
+                fSwapFadedOut = true;
+        }
+        else if (fSwapFadingOut)
+        {
+            // new patch is in place
+            fSwapFadingOut = false;
+            fBypassFadeInFrames = getSampleRate() * kBypassFadeInSeconds;
+        }
+
+        if (fBypassFadeInFrames != 0)
+        {
+            const uint32_t fadeFrames = getSampleRate() * kBypassFadeInSeconds;
+            const uint32_t framesToFade = std::min(frames, fBypassFadeInFrames);
+
+            for (int i=0; i<DISTRHO_PLUGIN_NUM_OUTPUTS; ++i)
+            {
+               #if CARDINAL_VARIANT_MAIN
+                // can be null on main variant
+                if (outputs[i] == nullptr)
+                    continue;
+               #endif
+
+                for (uint32_t f=0; f<framesToFade; ++f)
+                    outputs[i][f] *= 1.0f - static_cast<float>(fBypassFadeInFrames - f) / fadeFrames;
+            }
+
+            fBypassFadeInFrames -= framesToFade;
+        }
+
+        if (bypassed)
+        {
+            if (fBypassTailFrames > frames)
+                fBypassTailFrames -= frames;
+            else
+                fEngineSuspended = true;
+        }
+
+        updateIdleSleep(inputPeak, outputs, frames, midiEventCount);
 
         fWasBypassed = bypassed;
     }
 
-    void sampleRateChanged(const double newSampleRate) override
+    // anything that may make a sleeping patch produce sound again
+    bool isIdleWakeup(const float inputPeak, const uint32_t midiEventCount)
     {
-        rack::contextSet(context);
-        rack::settings::sampleRate = newSampleRate;
-        context->sampleRate = newSampleRate;
-        context->engine->setSampleRate(newSampleRate);
+        if (inputPeak >= kIdleSilenceThreshold || midiEventCount != 0 || fParameterChangedMask != 0)
+            return true;
+
+        if (context->playing != fIdleWasPlaying)
+            return true;
+
+        // patch edits and free running modules
+        return ! rack::engine::Engine_isIdleSleepAllowed(context->engine);
     }
 
-    // -------------------------------------------------------------------------------------------------------
+    // counts silent blocks of host inputs and outputs, and falls asleep once the idle time of the patch is reached
+    void updateIdleSleep(const float inputPeak, float** const outputs, const uint32_t frames, const uint32_t midiEventCount)
+    {
+        const float idleSleepTime = rack::engine::Engine_getIdleSleepTime(context->engine);
+
+        if (idleSleepTime <= 0.0f || context->bypassed || fSwapFadingOut
+            || inputPeak >= kIdleSilenceThreshold || midiEventCount != 0
+            || getBuffersPeak(outputs, DISTRHO_PLUGIN_NUM_OUTPUTS, frames) >= kIdleSilenceThreshold)
+        {
+            fIdleSilentFrames = 0;
+            return;
+        }
+
+        fIdleSilentFrames += frames;
+
+        if (fIdleSilentFrames < idleSleepTime * getSampleRate())
+            return;
+
+        if (! rack::engine::Engine_isIdleSleepAllowed(context->engine))
+            return;
+
+        fIdleSleeping = true;
+        fIdleWasPlaying = context->playing;
+    }
+
+    // sends the MIDI output of this run to the host in frame order, keeping events meant for later runs
+    void flushMidiOutput(const uint32_t frames)
+    {
+        MidiEvent* const events = fMidiOutEvents;
+        const uint32_t count = context->midiOutEventCount;
+
+        // each module writes its events in order, so the buffer is mostly sorted already
+        for (uint32_t i=1; i<count; ++i)
+        {
+            if (events[i].frame >= events[i-1].frame)
+                continue;
+
+            const MidiEvent event(events[i]);
+            uint32_t j = i;
+
+            for (; j != 0 && events[j-1].frame > event.frame; --j)
+                events[j] = events[j-1];
+
+            events[j] = event;
+        }
+
+        uint32_t kept = 0;
+
+        for (uint32_t i=0; i<count; ++i)
+        {
+            if (events[i].frame < frames)
+            {
+                writeMidiEvent(events[i]);
+                continue;
+            }
+
+            events[kept] = events[i];
+            events[kept++].frame -= frames;
+        }
+
+        context->midiOutEventCount = kept;
+    }
+
+    // sorts the block MIDI events into one list per channel filter, shared by all MIDI modules
+    // appends events to the ones replayed at the start of the next stepped block, counting those without room
+    void keepSkippedMidiEvents(const MidiEvent* const midiEvents, const uint32_t midiEventCount)
+    {
+        uint32_t droppedMidiEventCount = 0;
+
+        for (uint32_t i=0; i<midiEventCount; ++i)
+        {
+            const MidiEvent& midiEvent(midiEvents[i]);
+
+            if (fSkippedMidiEventCount == kMaxOversampledMidiEvents)
+            {
+                droppedMidiEventCount += midiEventCount - i;
+                break;
+            }
+
+            MidiEvent& skippedEvent(fSkippedMidiEvents[fSkippedMidiEventCount]);
+            skippedEvent = midiEvent;
+            skippedEvent.frame = 0;
+
+            // host sysex data is only valid during this run, keep a copy
+            if (midiEvent.size > MidiEvent::kDataSize)
+            {
+                if (fSkippedMidiDataUsed + midiEvent.size > kMaxBlockQuantumMidiData)
+                {
+                    ++droppedMidiEventCount;
+                    continue;
+                }
+
+                uint8_t* const data = fSkippedMidiData + fSkippedMidiDataUsed;
+                std::memcpy(data, midiEvent.dataExt, midiEvent.size);
+                skippedEvent.dataExt = data;
+                fSkippedMidiDataUsed += midiEvent.size;
+            }
+
+            ++fSkippedMidiEventCount;
+        }
+
+        if (droppedMidiEventCount != 0)
+            rack::engine::Engine_addDroppedMidiEvents(context->engine, droppedMidiEventCount);
+    }
+
+    void updateMidiChannelEvents()
+    {
+        uint32_t counts[17] = {};
+        const uint32_t midiEventCount = context->midiEventCount;
+
+        // too many for the buckets, modules then filter the full list themselves
+        if (midiEventCount > kMaxOversampledMidiEvents)
+        {
+            for (int c=0; c<=16; ++c)
+            {
+                context->midiChannelEvents[c] = nullptr;
+                context->midiChannelEventCount[c] = 0;
+            }
+            return;
+        }
+
+        for (uint32_t i=0; i<midiEventCount; ++i)
+        {
+            const MidiEvent& midiEvent(context->midiEvents[i]);
+
+            if (midiEvent.size == 0)
+                continue;
+
+            const uint8_t status = midiEvent.size > MidiEvent::kDataSize ? midiEvent.dataExt[0] : midiEvent.data[0];
+
+            fMidiChannelEvents[0][counts[0]++] = &midiEvent;
+
+            // system messages go to every channel
+            if (status >= 0xF0)
+            {
+                for (int c=1; c<=16; ++c)
+                    fMidiChannelEvents[c][counts[c]++] = &midiEvent;
+            }
+            else
+            {
+                const int c = (status & 0x0F) + 1;
+                fMidiChannelEvents[c][counts[c]++] = &midiEvent;
+            }
+        }
+
+        for (int c=0; c<=16; ++c)
+        {
+            context->midiChannelEvents[c] = fMidiChannelEvents[c];
+            context->midiChannelEventCount[c] = counts[c];
+        }
+    }
 
-private:
    /**
       Set our plugin class as non-copyable and add a leak detector just in case.
     */
@@ -107,6 +107,8 @@ CardinalRemoteUI::~CardinalRemoteUI()
 
 void CardinalRemoteUI::onNanoDisplay()
 {
+    flushInput();
+
     CardinalPluginContext* const context = static_cast<CardinalPluginContext*>(rack::contextGet());
     const ScopedContext sc(context);
     context->window->step();
@@ -275,21 +277,50 @@ bool CardinalRemoteUI::onMouse(const MouseEvent& ev)
     }
    #endif
 
+    flushInput();
+
     CardinalPluginContext* context = static_cast<CardinalPluginContext*>(rack::contextGet());
     const ScopedContext sc(context, mods);
     return context->event->handleButton(lastMousePos, button, action, mods);
 }
 
+// dispatches motion or scroll merged since the last frame, see CoalescedInput
+void CardinalRemoteUI::flushInput()
+{
+    CardinalPluginContext* const context = static_cast<CardinalPluginContext*>(rack::contextGet());
+
+    switch (coalescedInput.take())
+    {
+    case CoalescedInput::kTypeNone:
+        break;
+    case CoalescedInput::kTypeMotion:
+    {
+        const ScopedContext sc(context);
+        context->event->handleHover(coalescedInput.pos, coalescedInput.pos.minus(coalescedInput.lastMotionPos));
+        coalescedInput.lastMotionPos = coalescedInput.pos;
+        break;
+    }
+    case CoalescedInput::kTypeScroll:
+    {
+        const ScopedContext sc(context, coalescedInput.mods);
+        context->event->handleScroll(coalescedInput.pos, coalescedInput.scrollDelta);
+        break;
+    }
+    }
+}
+
 bool CardinalRemoteUI::onMotion(const MotionEvent& ev)
 {
     const rack::math::Vec mousePos = rack::math::Vec(ev.pos.getX(), ev.pos.getY()).div(getScaleFactor()).round();
-    const rack::math::Vec mouseDelta = mousePos.minus(lastMousePos);
+    const int mods = glfwMods(ev.mod);
 
     lastMousePos = mousePos;
 
-    CardinalPluginContext* context = static_cast<CardinalPluginContext*>(rack::contextGet());
-    const ScopedContext sc(context);
-    return context->event->handleHover(mousePos, mouseDelta);
+    if (coalescedInput.needsFlush(CoalescedInput::kTypeMotion, mods))
+        flushInput();
+
+    coalescedInput.addMotion(mousePos, mods);
+    return true;
 }
 
 bool CardinalRemoteUI::onScroll(const ScrollEvent& ev)
@@ -301,9 +332,11 @@ bool CardinalRemoteUI::onScroll(const ScrollEvent& ev)
 
     const int mods = glfwMods(ev.mod);
 
-    CardinalPluginContext* context = static_cast<CardinalPluginContext*>(rack::contextGet());
-    const ScopedContext sc(context, mods);
-    return context->event->handleScroll(lastMousePos, scrollDelta);
+    if (coalescedInput.needsFlush(CoalescedInput::kTypeScroll, mods))
+        flushInput();
+
+    coalescedInput.addScroll(lastMousePos, scrollDelta, mods);
+    return true;
 }
 
 bool CardinalRemoteUI::onCharacterInput(const CharacterInputEvent& ev)
@@ -311,6 +344,8 @@ bool CardinalRemoteUI::onCharacterInput(const CharacterInputEvent& ev)
     if (ev.character < ' ' || ev.character >= kKeyDelete)
         return false;
 
+    flushInput();
+
     const int mods = glfwMods(ev.mod);
 
     CardinalPluginContext* context = static_cast<CardinalPluginContext*>(rack::contextGet());
@@ -320,6 +355,8 @@ bool CardinalRemoteUI::onCharacterInput(const CharacterInputEvent& ev)
 
 bool CardinalRemoteUI::onKeyboard(const KeyboardEvent& ev)
 {
+    flushInput();
+
     const int action = ev.press ? GLFW_PRESS : GLFW_RELEASE;
     const int mods = glfwMods(ev.mod);
 
@@ -18,6 +18,7 @@
 #pragma once
 
 #include "NanoVG.hpp"
+#include "InputCoalescing.hpp"
 #include "PluginContext.hpp"
 #include "WindowParameters.hpp"
 
@@ -43,6 +44,7 @@ class CardinalRemoteUI : public NanoTopLevelWidget,
                          public WindowParametersCallback
 {
     rack::math::Vec lastMousePos;
+    CoalescedInput coalescedInput;
     WindowParameters windowParameters;
     int rateLimitStep = 0;
 
@@ -74,6 +76,7 @@ public:
     
 protected:
     void onNanoDisplay() override;
+    void flushInput();
     void idleCallback() override;
     void WindowParametersChanged(const WindowParameterList param, float value) override;
     bool onMouse(const MouseEvent& ev) override;
@@ -0,0 +1 @@
+../override/common.cpp
\ No newline at end of file
@@ -0,0 +1,517 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include <asset.hpp>
+#include <history.hpp>
+#include <patch.hpp>
+#include <random.hpp>
+#include <settings.hpp>
+#include <system.hpp>
+
+#include <app/Browser.hpp>
+#include <app/Scene.hpp>
+#include <dsp/fir.hpp>
+#include <engine/Engine.hpp>
+#include <ui/common.hpp>
+#include <widget/event.hpp>
+#include <window/Window.hpp>
+
+#include "CardinalCommon.hpp"
+#include "PluginContext.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+extern const std::string CARDINAL_VERSION;
+
+namespace rack {
+namespace asset {
+std::string patchesPath();
+void destroy();
+}
+namespace engine {
+void Engine_setAboutToClose(Engine*);
+int Engine_getOversampling(Engine*);
+void Engine_setMaxBufferSize(Engine*, int frames);
+}
+namespace plugin {
+void initStaticPlugins();
+void destroyStaticPlugins();
+}
+}
+
+START_NAMESPACE_DISTRHO
+
+bool isUsingNativeAudio() noexcept { return false; }
+bool supportsAudioInput() { return false; }
+bool supportsBufferSizeChanges() { return false; }
+bool supportsMIDI() { return false; }
+bool isAudioInputEnabled() { return false; }
+bool isMIDIEnabled() { return false; }
+uint getBufferSize() { return 0; }
+bool requestAudioInput() { return false; }
+bool requestBufferSizeChange(uint) { return false; }
+bool requestMIDI() { return false; }
+const char* getPluginFormatName() noexcept { return "Render"; }
+
+uint32_t Plugin::getBufferSize() const noexcept { return 512; }
+double Plugin::getSampleRate() const noexcept { return 48000; }
+bool Plugin::writeMidiEvent(const MidiEvent&) noexcept { return false; }
+
+END_NAMESPACE_DISTRHO
+
+USE_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+
+static constexpr const uint kMaxOversampling = 4;
+static constexpr const uint kOversamplingQuality = 16;
+
+struct RenderOptions {
+    double duration = 10.0;
+    double sampleRate = 48000.0;
+    uint32_t bufferSize = 512;
+    uint32_t channels = 2;
+    uint32_t jobs = 1;
+    std::string output;
+};
+
+struct RenderJob {
+    std::string patchPath;
+    std::string outputPath;
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// 32-bit float WAV file, sizes are written on close
+
+struct WavFile {
+    std::FILE* file = nullptr;
+    uint32_t channels = 0;
+    uint64_t frames = 0;
+
+    ~WavFile()
+    {
+        close();
+    }
+
+    bool open(const std::string& path, const uint32_t numChannels, const uint32_t sampleRate)
+    {
+        file = std::fopen(path.c_str(), "wb");
+        DISTRHO_SAFE_ASSERT_RETURN(file != nullptr, false);
+
+        channels = numChannels;
+        frames = 0;
+
+        const uint16_t format = 3; // IEEE float
+        const uint16_t numChannels16 = numChannels;
+        const uint32_t byteRate = sampleRate * numChannels * sizeof(float);
+        const uint16_t blockAlign = numChannels * sizeof(float);
+        const uint16_t bitsPerSample = 32;
+        const uint32_t fmtSize = 16;
+        const uint32_t unknownSize = 0;
+
+        std::fwrite("RIFF", 1, 4, file);
+        writeValue(unknownSize);
+        std::fwrite("WAVEfmt ", 1, 8, file);
+        writeValue(fmtSize);
+        writeValue(format);
+        writeValue(numChannels16);
+        writeValue(sampleRate);
+        writeValue(byteRate);
+        writeValue(blockAlign);
+        writeValue(bitsPerSample);
+        std::fwrite("data", 1, 4, file);
+        writeValue(unknownSize);
+
+        return std::ferror(file) == 0;
+    }
+
+    void write(const float* const interleaved, const uint32_t numFrames)
+    {
+        std::fwrite(interleaved, sizeof(float) * channels, numFrames, file);
+        frames += numFrames;
+    }
+
+    bool close()
+    {
+        if (file == nullptr)
+            return false;
+
+        const uint32_t dataSize = frames * channels * sizeof(float);
+        const uint32_t riffSize = dataSize + 36;
+
+        std::fseek(file, 4, SEEK_SET);
+        writeValue(riffSize);
+        std::fseek(file, 40, SEEK_SET);
+        writeValue(dataSize);
+
+        const bool ok = std::ferror(file) == 0;
+        std::fclose(file);
+        file = nullptr;
+        return ok;
+    }
+
+    template <typename T>
+    void writeValue(const T value)
+    {
+        // WAV is little-endian, same as all supported platforms
+        std::fwrite(&value, sizeof(T), 1, file);
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+static std::string createAutosavePath()
+{
+    // several render jobs can look for a free path at the same time
+    static std::mutex mutex;
+    const std::lock_guard<std::mutex> lock(mutex);
+
+    std::string autosavePath;
+
+    try {
+        char uidBuf[24];
+        const std::string tmp = rack::system::getTempDirectory();
+
+        for (int i=1;; ++i)
+        {
+            std::snprintf(uidBuf, sizeof(uidBuf), "Cardinal.%04d", i);
+            const std::string trypath = rack::system::join(tmp, uidBuf);
+
+            if (! rack::system::exists(trypath))
+            {
+                if (rack::system::createDirectories(trypath))
+                    autosavePath = trypath;
+                break;
+            }
+        }
+    } DISTRHO_SAFE_EXCEPTION("create unique temporary path");
+
+    return autosavePath;
+}
+
+static bool renderPatch(const RenderOptions& options, const RenderJob& job)
+{
+    const std::string autosavePath = createAutosavePath();
+
+    CardinalPluginContext* const context = new CardinalPluginContext(nullptr);
+    rack::contextSet(context);
+
+    context->bufferSize = options.bufferSize;
+    context->sampleRate = options.sampleRate;
+
+    context->engine = new rack::engine::Engine;
+    context->engine->setSampleRate(options.sampleRate);
+
+    context->history = new rack::history::State;
+    context->patch = new rack::patch::Manager;
+    context->patch->autosavePath = autosavePath;
+
+    context->event = new rack::widget::EventState;
+    context->scene = new rack::app::Scene;
+    context->event->rootWidget = context->scene;
+
+    context->window = new rack::window::Window;
+
+    bool ok = false;
+
+    try {
+        context->patch->load(job.patchPath);
+        ok = true;
+    } catch (rack::Exception& e) {
+        d_stderr2("Failed to load patch \"%s\": %s", job.patchPath.c_str(), e.what());
+    }
+
+    WavFile wav;
+
+    if (ok && ! wav.open(job.outputPath, options.channels, options.sampleRate))
+    {
+        d_stderr2("Failed to create output file \"%s\"", job.outputPath.c_str());
+        ok = false;
+    }
+
+    if (ok)
+    {
+        // the engine runs faster than the output rate if the patch is oversampled
+        const uint32_t oversampling = rack::engine::Engine_getOversampling(context->engine);
+        const uint32_t engineBufferSize = options.bufferSize * oversampling;
+        rack::engine::Engine_setMaxBufferSize(context->engine, options.bufferSize);
+
+        std::vector<float> outputData(DISTRHO_PLUGIN_NUM_OUTPUTS * engineBufferSize);
+        std::vector<float> interleaved(options.channels * options.bufferSize);
+        float* dataOuts[DISTRHO_PLUGIN_NUM_OUTPUTS] = {};
+        rack::dsp::PolyphaseDecimator<kMaxOversampling, kOversamplingQuality> decimators[CARDINAL_NUM_AUDIO_OUTPUTS];
+
+        for (uint32_t i=0; i<CARDINAL_NUM_AUDIO_OUTPUTS; ++i)
+        {
+            dataOuts[i] = outputData.data() + i * engineBufferSize;
+            decimators[i].setFactor(oversampling);
+        }
+
+        context->bufferSize = engineBufferSize;
+        context->oversampling = oversampling;
+        context->dataIns = nullptr;
+        context->dataOuts = dataOuts;
+        context->playing = true;
+
+        const uint64_t totalFrames = static_cast<uint64_t>(options.duration * options.sampleRate + 0.5);
+
+        for (uint64_t frame = 0; frame < totalFrames;)
+        {
+            const uint32_t frames = std::min<uint64_t>(options.bufferSize, totalFrames - frame);
+
+            context->frame = frame;
+            context->reset = frame == 0;
+            std::memset(outputData.data(), 0, sizeof(float) * outputData.size());
+
+            ++context->processCounter;
+            context->engine->stepBlock(frames * oversampling);
+
+            for (uint32_t c=0; c<options.channels; ++c)
+            {
+                const float* const dataOut = dataOuts[c];
+
+                for (uint32_t f=0; f<frames; ++f)
+                {
+                    interleaved[f * options.channels + c] = oversampling != 1
+                                                          ? decimators[c].process(dataOut + f * oversampling)
+                                                          : dataOut[f];
+                }
+            }
+
+            wav.write(interleaved.data(), frames);
+            frame += frames;
+        }
+
+        ok = wav.close();
+    }
+
+    context->patch->clear();
+    rack::engine::Engine_setAboutToClose(context->engine);
+    delete context;
+    rack::contextSet(nullptr);
+
+    if (! autosavePath.empty())
+        rack::system::removeRecursively(autosavePath);
+
+    return ok;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+static void printUsage(const char* const name)
+{
+    std::fprintf(stderr,
+                 "Usage: %s [options] patch.vcv [more-patches.vcv...]\n"
+                 "Renders Cardinal patches into 32-bit float WAV files, faster than real time.\n"
+                 "\n"
+                 "  -o, --output <path>         output file, or output directory for several patches\n"
+                 "  -d, --duration <seconds>    length of the render (default: 10)\n"
+                 "  -r, --sample-rate <rate>    sample rate in Hz (default: 48000)\n"
+                 "  -b, --buffer-size <frames>  engine block size (default: 512)\n"
+                 "  -c, --channels <count>      number of host audio outputs to write, 1 to %d (default: 2)\n"
+                 "  -j, --jobs <count>          patches rendered at once, 0 for one per CPU core (default: 1)\n",
+                 name, CARDINAL_NUM_AUDIO_OUTPUTS);
+}
+
+static std::string getOutputPath(const RenderOptions& options, const std::string& patchPath, const bool batch)
+{
+    const std::string filename = rack::system::getStem(patchPath) + ".wav";
+
+    if (options.output.empty())
+        return rack::system::join(rack::system::getDirectory(patchPath), filename);
+
+    if (batch || rack::system::isDirectory(options.output))
+        return rack::system::join(options.output, filename);
+
+    return options.output;
+}
+
+int main(const int argc, const char* argv[])
+{
+    using namespace rack;
+
+    RenderOptions options;
+    std::vector<std::string> patchPaths;
+
+    for (int i=1; i<argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if ((arg == "-o" || arg == "--output") && hasValue)
+            options.output = argv[++i];
+        else if ((arg == "-d" || arg == "--duration") && hasValue)
+            options.duration = std::atof(argv[++i]);
+        else if ((arg == "-r" || arg == "--sample-rate") && hasValue)
+            options.sampleRate = std::atof(argv[++i]);
+        else if ((arg == "-b" || arg == "--buffer-size") && hasValue)
+            options.bufferSize = std::atoi(argv[++i]);
+        else if ((arg == "-c" || arg == "--channels") && hasValue)
+            options.channels = std::atoi(argv[++i]);
+        else if ((arg == "-j" || arg == "--jobs") && hasValue)
+            options.jobs = std::atoi(argv[++i]);
+        else if (arg[0] != '-')
+            patchPaths.push_back(arg);
+        else
+        {
+            printUsage(argv[0]);
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+    }
+
+    if (patchPaths.empty() || options.duration <= 0.0 || options.sampleRate <= 0.0 || options.bufferSize == 0 ||
+        options.channels == 0 || options.channels > CARDINAL_NUM_AUDIO_OUTPUTS)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (options.jobs == 0)
+        options.jobs = std::max(1u, std::thread::hardware_concurrency());
+
+    const bool batch = patchPaths.size() > 1;
+
+    if (batch && ! options.output.empty() && ! system::isDirectory(options.output))
+        system::createDirectories(options.output);
+
+    std::vector<RenderJob> jobs(patchPaths.size());
+
+    for (size_t i=0; i<patchPaths.size(); ++i)
+    {
+        jobs[i].patchPath = patchPaths[i];
+        jobs[i].outputPath = getOutputPath(options, patchPaths[i], batch);
+    }
+
+    // --------------------------------------------------------------------------
+
+    settings::allowCursorLock = false;
+    settings::autoCheckUpdates = false;
+    settings::autosaveInterval = 0;
+    settings::devMode = true;
+    settings::headless = true;
+    settings::isPlugin = true;
+    settings::skipLoadOnLaunch = true;
+    settings::showTipsOnLaunch = false;
+    settings::sampleRate = options.sampleRate;
+
+    system::init();
+    logger::init();
+    random::init();
+    ui::init();
+
+   #ifdef CARDINAL_PLUGIN_SOURCE_DIR
+    // Make system dir point to source code location as fallback
+    asset::systemDir = CARDINAL_PLUGIN_SOURCE_DIR DISTRHO_OS_SEP_STR "Rack";
+    asset::bundlePath.clear();
+
+    // If source code dir does not exist use install target prefix as system dir
+    if (!system::exists(system::join(asset::systemDir, "res")))
+   #endif
+    {
+       #if defined(ARCH_MAC)
+        asset::systemDir = "/Library/Application Support/Cardinal";
+       #elif defined(ARCH_WIN)
+        const std::string commonprogfiles = getSpecialPath(kSpecialPathCommonProgramFiles);
+        if (! commonprogfiles.empty())
+            asset::systemDir = system::join(commonprogfiles, "Cardinal");
+       #else
+        asset::systemDir = CARDINAL_PLUGIN_PREFIX "/share/cardinal";
+       #endif
+
+        asset::bundlePath = system::join(asset::systemDir, "PluginManifests");
+    }
+
+    asset::userDir = asset::systemDir;
+
+    // Log environment
+    INFO("%s %s %s, compatible with Rack version %s", APP_NAME.c_str(), APP_EDITION.c_str(), CARDINAL_VERSION.c_str(), APP_VERSION.c_str());
+    INFO("%s", system::getOperatingSystemInfo().c_str());
+    INFO("System directory: %s", asset::systemDir.c_str());
+
+    // Report to user if something is wrong with the installation
+    if (asset::systemDir.empty())
+    {
+        d_stderr2("Failed to locate Cardinal plugin bundle.\n"
+                  "Install Cardinal with its bundle folder intact and try again.");
+    }
+    else if (! system::exists(asset::systemDir))
+    {
+        d_stderr2("System directory \"%s\" does not exist.\n"
+                  "Make sure Cardinal was downloaded and installed correctly.", asset::systemDir.c_str());
+    }
+
+    INFO("Initializing plugins");
+    plugin::initStaticPlugins();
+
+    INFO("Initializing plugin browser DB");
+    app::browserInit();
+
+    // --------------------------------------------------------------------------
+
+    // each render job uses its own context and engine, so patches can be rendered in parallel
+    std::atomic<size_t> nextJob(0);
+    std::atomic<int> failedJobs(0);
+
+    const std::function<void()> worker = [&]() {
+        for (size_t i = nextJob++; i < jobs.size(); i = nextJob++)
+        {
+            INFO("Rendering %s into %s", jobs[i].patchPath.c_str(), jobs[i].outputPath.c_str());
+
+            if (! renderPatch(options, jobs[i]))
+                ++failedJobs;
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for (uint32_t i=1; i<std::min<size_t>(options.jobs, jobs.size()); ++i)
+        threads.emplace_back(worker);
+
+    worker();
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    // --------------------------------------------------------------------------
+
+    INFO("Clearing asset paths");
+    asset::bundlePath.clear();
+    asset::systemDir.clear();
+    asset::userDir.clear();
+
+    INFO("Destroying plugins");
+    plugin::destroyStaticPlugins();
+
+    INFO("Destroying colourized assets");
+    asset::destroy();
+
+    INFO("Destroying settings");
+    settings::destroy();
+
+    INFO("Destroying logger");
+    logger::destroy();
+
+    // --------------------------------------------------------------------------
+
+    return failedJobs == 0 ? 0 : 1;
+}
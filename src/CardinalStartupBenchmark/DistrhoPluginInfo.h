@@ -0,0 +1 @@
+../Cardinal/DistrhoPluginInfo.h
\ No newline at end of file
@@ -0,0 +1 @@
+../custom/RemoteNanoVG.cpp
\ No newline at end of file
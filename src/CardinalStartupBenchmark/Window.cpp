@@ -0,0 +1 @@
+../override/Window.cpp
\ No newline at end of file
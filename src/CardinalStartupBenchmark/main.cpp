@@ -0,0 +1,545 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include <asset.hpp>
+#include <history.hpp>
+#include <patch.hpp>
+#include <random.hpp>
+#include <settings.hpp>
+#include <string.hpp>
+#include <system.hpp>
+
+#include <app/Scene.hpp>
+#include <engine/Engine.hpp>
+#include <widget/event.hpp>
+#include <window/Window.hpp>
+
+#include "CardinalCommon.hpp"
+#include "PluginContext.hpp"
+#include "extra/ScopedValueSetter.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <vector>
+
+#ifndef ARCH_WIN
+# include <spawn.h>
+# include <sys/wait.h>
+# include <unistd.h>
+extern char** environ;
+#endif
+
+// steady clock of the parent process when it spawned this one, the clock is shared by all processes
+#define CARDINAL_SPAWN_TIME_ENV "CARDINAL_STARTUP_BENCHMARK_SPAWN_TIME"
+
+namespace rack {
+namespace engine {
+void Engine_setAboutToClose(Engine*);
+}
+}
+
+START_NAMESPACE_DISTRHO
+
+bool isUsingNativeAudio() noexcept { return false; }
+bool supportsAudioInput() { return false; }
+bool supportsBufferSizeChanges() { return false; }
+bool supportsMIDI() { return false; }
+bool isAudioInputEnabled() { return false; }
+bool isMIDIEnabled() { return false; }
+uint getBufferSize() { return 0; }
+bool requestAudioInput() { return false; }
+bool requestBufferSizeChange(uint) { return false; }
+bool requestMIDI() { return false; }
+const char* getPluginFormatName() noexcept { return "StartupBenchmark"; }
+
+uint32_t Plugin::getBufferSize() const noexcept { return 512; }
+double Plugin::getSampleRate() const noexcept { return 48000; }
+bool Plugin::writeMidiEvent(const MidiEvent&) noexcept { return false; }
+
+#ifndef HEADLESS
+FileBrowserHandle fileBrowserCreate(bool, ulong, double, const FileBrowserOptions&) { return nullptr; }
+
+void UI::editParameter(uint, bool) {}
+void UI::setParameterValue(uint, float) {}
+void UI::setState(const char*, const char*) {}
+bool UI::openFileBrowser(const FileBrowserOptions&) { return false; }
+#endif
+
+END_NAMESPACE_DISTRHO
+
+USE_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+
+struct StartupOptions {
+    uint32_t instances = 4;
+    uint32_t runs = 3;
+    bool inProcess = false;
+    bool child = false;
+    std::string csvPath;
+    std::string jsonPath;
+};
+
+// stages are "process" (exec to main), "init" (first instance Initializer, plugins included),
+// "instance" (first or additional instance context, as created by the plugin constructor) and
+// "restore" (a session patch loaded like setState("patch") does)
+struct StartupResult {
+    uint32_t run = 0;
+    std::string stage;
+    std::string name;
+    uint32_t instance = 0;
+    double ms = 0.0;
+};
+
+static int64_t getSteadyTimeNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// taken first thing in main, static initializers of all plugins have run by then
+static int64_t mainTimeNs = 0;
+
+// --------------------------------------------------------------------------------------------------------------------
+// An instance, set up like the plugin constructor does
+
+struct StartupInstance {
+    CardinalPluginContext* context = nullptr;
+    std::string autosavePath;
+
+    void create(const Initializer& initializer)
+    {
+        char uidBuf[40];
+        std::snprintf(uidBuf, sizeof(uidBuf), "CardinalStartupBenchmark.%08x", rack::random::u32());
+        autosavePath = rack::system::join(rack::system::getTempDirectory(), uidBuf);
+        rack::system::createDirectories(autosavePath);
+
+        context = new CardinalPluginContext(nullptr);
+        rack::contextSet(context);
+
+        const float sampleRate = 48000;
+        rack::settings::sampleRate = sampleRate;
+
+        context->bufferSize = 512;
+        context->sampleRate = sampleRate;
+
+        context->engine = new rack::engine::Engine;
+        context->engine->setSampleRate(sampleRate);
+
+        context->history = new rack::history::State;
+        context->patch = new rack::patch::Manager;
+        context->patch->autosavePath = autosavePath;
+        context->patch->templatePath = initializer.templatePath;
+        context->patch->factoryTemplatePath = initializer.factoryTemplatePath;
+
+        context->event = new rack::widget::EventState;
+        context->scene = new rack::app::Scene;
+        context->event->rootWidget = context->scene;
+
+        context->window = new rack::window::Window;
+
+        context->patch->loadTemplate();
+        context->scene->rackScroll->reset();
+        // swap to factory template after first load
+        context->patch->templatePath = context->patch->factoryTemplatePath;
+    }
+
+    void destroy()
+    {
+        rack::contextSet(context);
+        context->patch->clear();
+
+        {
+            // do a little dance to prevent context scene deletion from saving to temp dir
+            const ScopedValueSetter<bool> svs(rack::settings::headless, true);
+            rack::engine::Engine_setAboutToClose(context->engine);
+            delete context;
+        }
+
+        rack::contextSet(nullptr);
+        rack::system::removeRecursively(autosavePath);
+        context = nullptr;
+    }
+};
+
+static double elapsedMs(const std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// one cold start of this process, as a DAW opening a project with the given number of instances does
+static bool runStartup(const StartupOptions& options, const std::vector<std::string>& corpus, std::vector<StartupResult>& results)
+{
+    const auto addResult = [&](const char* const stage, const std::string& name, const uint32_t instance, const double ms) {
+        StartupResult result;
+        result.stage = stage;
+        result.name = name;
+        result.instance = instance;
+        result.ms = ms;
+        results.push_back(result);
+    };
+
+    if (const char* const spawnTime = std::getenv(CARDINAL_SPAWN_TIME_ENV))
+        addResult("process", "start", 0, (mainTimeNs - std::atoll(spawnTime)) / 1e6);
+
+    auto start = std::chrono::steady_clock::now();
+    Initializer* const initializer = new Initializer(nullptr, nullptr);
+    addResult("init", "Initializer", 0, elapsedMs(start));
+
+    // session patches are read upfront, hosts hand them over already in memory
+    std::vector<std::vector<uint8_t>> sessions;
+    sessions.reserve(corpus.size());
+
+    for (const std::string& path : corpus)
+    {
+        try {
+            sessions.push_back(rack::system::readFile(path));
+        } catch (rack::Exception&) {
+            sessions.emplace_back();
+        }
+    }
+
+    std::vector<StartupInstance> instances(options.instances);
+    bool ok = true;
+
+    for (uint32_t i = 0; i < options.instances; ++i)
+    {
+        StartupInstance& instance(instances[i]);
+
+        start = std::chrono::steady_clock::now();
+        instance.create(*initializer);
+        addResult("instance", i == 0 ? "first" : "additional", i, elapsedMs(start));
+
+        for (size_t s = 0; s < corpus.size(); ++s)
+        {
+            const std::vector<uint8_t>& data(sessions[s]);
+
+            if (data.size() < 4)
+            {
+                d_stderr2("Failed to read session \"%s\"", corpus[s].c_str());
+                ok = false;
+                continue;
+            }
+
+            try {
+                start = std::chrono::steady_clock::now();
+                patchUtils::loadFromMemory(data.data(), data.size());
+                addResult("restore", rack::system::getStem(corpus[s]), i, elapsedMs(start));
+            } catch (rack::Exception& e) {
+                d_stderr2("Failed to restore session \"%s\": %s", corpus[s].c_str(), e.what());
+                ok = false;
+            }
+        }
+    }
+
+    for (StartupInstance& instance : instances)
+        instance.destroy();
+
+    delete initializer;
+    return ok;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Each run is a fresh process, spawned with the same arguments and reporting back through a pipe
+
+static constexpr const char kChildResultPrefix[] = "startup-result,";
+
+static void printChildResult(const StartupResult& result)
+{
+    std::printf("%s%s,%s,%u,%.6f\n", kChildResultPrefix,
+                result.stage.c_str(), result.name.c_str(), result.instance, result.ms);
+}
+
+#ifndef ARCH_WIN
+static bool parseChildResult(const std::string& line, const uint32_t run, StartupResult& result)
+{
+    if (line.compare(0, sizeof(kChildResultPrefix) - 1, kChildResultPrefix) != 0)
+        return false;
+
+    std::vector<std::string> fields;
+    size_t pos = sizeof(kChildResultPrefix) - 1;
+
+    for (size_t comma; (comma = line.find(',', pos)) != std::string::npos; pos = comma + 1)
+        fields.push_back(line.substr(pos, comma - pos));
+    fields.push_back(line.substr(pos));
+
+    if (fields.size() != 4)
+        return false;
+
+    result.run = run;
+    result.stage = fields[0];
+    result.name = fields[1];
+    result.instance = std::atoi(fields[2].c_str());
+    result.ms = std::atof(fields[3].c_str());
+    return true;
+}
+
+static bool spawnRun(const int argc, const char* argv[], const uint32_t run, std::vector<StartupResult>& results)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+        return false;
+
+    std::vector<char*> args;
+    for (int i = 0; i < argc; ++i)
+        args.push_back(const_cast<char*>(argv[i]));
+    args.push_back(const_cast<char*>("--child"));
+    args.push_back(nullptr);
+
+    std::vector<std::string> envStrings;
+    for (char** env = environ; *env != nullptr; ++env)
+    {
+        if (std::strncmp(*env, CARDINAL_SPAWN_TIME_ENV "=", sizeof(CARDINAL_SPAWN_TIME_ENV)) != 0)
+            envStrings.push_back(*env);
+    }
+    envStrings.push_back("");
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+
+    // taken last so that nothing but the spawn itself is in the measured time
+    envStrings.back() = rack::string::f(CARDINAL_SPAWN_TIME_ENV "=%lld", static_cast<long long>(getSteadyTimeNs()));
+
+    std::vector<char*> envs;
+    for (std::string& env : envStrings)
+        envs.push_back(&env[0]);
+    envs.push_back(nullptr);
+
+    pid_t pid;
+    const int err = posix_spawnp(&pid, argv[0], &actions, nullptr, args.data(), envs.data());
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+
+    if (err != 0)
+    {
+        close(fds[0]);
+        d_stderr2("Failed to spawn \"%s\": %s", argv[0], std::strerror(err));
+        return false;
+    }
+
+    std::string output;
+    char buf[4096];
+    for (ssize_t r; (r = read(fds[0], buf, sizeof(buf))) > 0;)
+        output.append(buf, r);
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    size_t pos = 0;
+    for (size_t end; (end = output.find('\n', pos)) != std::string::npos; pos = end + 1)
+    {
+        StartupResult result;
+        if (parseChildResult(output.substr(pos, end - pos), run, result))
+            results.push_back(result);
+    }
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+#endif
+
+// --------------------------------------------------------------------------------------------------------------------
+
+static void writeResults(const std::string& path, const std::vector<StartupResult>& results)
+{
+    std::ofstream file(path);
+    DISTRHO_SAFE_ASSERT_RETURN(file.good(),);
+
+    file << "run,stage,name,instance,ms\n";
+
+    for (const StartupResult& result : results)
+        file << result.run << "," << result.stage << "," << result.name << "," << result.instance << "," << result.ms << "\n";
+}
+
+static void writeResultsJson(const std::string& path, const std::vector<StartupResult>& results)
+{
+    json_t* const rootJ = json_array();
+
+    for (const StartupResult& result : results)
+    {
+        json_t* const resultJ = json_object();
+        json_object_set_new(resultJ, "run", json_integer(result.run));
+        json_object_set_new(resultJ, "stage", json_string(result.stage.c_str()));
+        json_object_set_new(resultJ, "name", json_string(result.name.c_str()));
+        json_object_set_new(resultJ, "instance", json_integer(result.instance));
+        json_object_set_new(resultJ, "ms", json_real(result.ms));
+        json_array_append_new(rootJ, resultJ);
+    }
+
+    if (json_dump_file(rootJ, path.c_str(), JSON_INDENT(2)) != 0)
+        d_stderr2("Failed to write results to \"%s\"", path.c_str());
+
+    json_decref(rootJ);
+}
+
+// min, median and max of every stage and name over all runs and instances
+static void printSummary(const std::vector<StartupResult>& results)
+{
+    std::vector<std::pair<std::string, std::vector<double>>> groups;
+    std::map<std::string, size_t> groupIndexes;
+
+    for (const StartupResult& result : results)
+    {
+        const std::string key = result.stage + "/" + result.name;
+        const auto it = groupIndexes.find(key);
+
+        if (it == groupIndexes.end())
+        {
+            groupIndexes[key] = groups.size();
+            groups.emplace_back(key, std::vector<double>{ result.ms });
+        }
+        else
+        {
+            groups[it->second].second.push_back(result.ms);
+        }
+    }
+
+    for (auto& group : groups)
+    {
+        std::vector<double>& values(group.second);
+        std::sort(values.begin(), values.end());
+
+        std::printf("%-48s %4zu samples %10.2f min %10.2f median %10.2f max ms\n",
+                    group.first.c_str(), values.size(), values.front(), values[values.size() / 2], values.back());
+    }
+}
+
+static void printUsage(const char* const name)
+{
+    std::fprintf(stderr,
+                 "Usage: %s [options] [session.vcv or directory...]\n"
+                 "Measures Cardinal cold start and patch restore, as a host opening a project does.\n"
+                 "Every run is a new process that initializes Cardinal, creates the instances and has each of them\n"
+                 "restore every session of the corpus in turn. Times are in milliseconds.\n"
+                 "\n"
+                 "Options:\n"
+                 "  -i, --instances <count>     instances per run (default: 4)\n"
+                 "  -n, --runs <count>          processes to start (default: 3)\n"
+                 "  --in-process                a single run in this process, process start is not measured\n"
+                 "  --csv <path>                write results as CSV\n"
+                 "  --json <path>               write results as JSON\n",
+                 name);
+}
+
+int main(const int argc, const char* argv[])
+{
+    mainTimeNs = getSteadyTimeNs();
+
+    StartupOptions options;
+    std::vector<std::string> sessionPaths;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if ((arg == "-i" || arg == "--instances") && hasValue)
+            options.instances = std::atoi(argv[++i]);
+        else if ((arg == "-n" || arg == "--runs") && hasValue)
+            options.runs = std::atoi(argv[++i]);
+        else if (arg == "--in-process")
+            options.inProcess = true;
+        else if (arg == "--child")
+            options.child = true;
+        else if (arg == "--csv" && hasValue)
+            options.csvPath = argv[++i];
+        else if (arg == "--json" && hasValue)
+            options.jsonPath = argv[++i];
+        else if (arg.size() != 0 && arg[0] != '-')
+            sessionPaths.push_back(arg);
+        else
+        {
+            printUsage(argv[0]);
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+    }
+
+    if (options.instances == 0 || options.runs == 0)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+   #ifdef ARCH_WIN
+    // no spawning on Windows, a single run in this process
+    options.inProcess = true;
+   #endif
+
+    // directories in the corpus stand for the sessions inside them
+    std::vector<std::string> corpus;
+
+    for (const std::string& path : sessionPaths)
+    {
+        if (rack::system::isDirectory(path))
+        {
+            std::vector<std::string> entries = rack::system::getEntries(path);
+            std::sort(entries.begin(), entries.end());
+
+            for (const std::string& entry : entries)
+            {
+                if (rack::system::getExtension(entry) == ".vcv")
+                    corpus.push_back(entry);
+            }
+        }
+        else
+        {
+            corpus.push_back(path);
+        }
+    }
+
+    std::vector<StartupResult> results;
+    bool ok = true;
+
+    if (options.child || options.inProcess)
+    {
+        ok = runStartup(options, corpus, results);
+
+        if (options.child)
+        {
+            for (const StartupResult& result : results)
+                printChildResult(result);
+
+            return ok ? 0 : 1;
+        }
+    }
+   #ifndef ARCH_WIN
+    else
+    {
+        for (uint32_t run = 0; run < options.runs; ++run)
+        {
+            if (! spawnRun(argc, argv, run, results))
+                ok = false;
+        }
+    }
+   #endif
+
+    printSummary(results);
+
+    if (! options.csvPath.empty())
+        writeResults(options.csvPath, results);
+
+    if (! options.jsonPath.empty())
+        writeResultsJson(options.jsonPath, results);
+
+    return ok ? 0 : 1;
+}
@@ -51,5 +51,6 @@
 #define DISTRHO_PLUGIN_WANT_FULL_STATE    1
 #define DISTRHO_PLUGIN_WANT_STATE         1
 #define DISTRHO_PLUGIN_WANT_TIMEPOS       1
+#define DISTRHO_PLUGIN_WANT_LATENCY       1
 
 #endif // DISTRHO_PLUGIN_INFO_H_INCLUDED
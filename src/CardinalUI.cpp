@@ -16,10 +16,13 @@
  */
 
 #include <app/MenuBar.hpp>
+#include <app/ModuleWidget.hpp>
+#include <app/RackWidget.hpp>
 #include <app/Scene.hpp>
 #include <asset.hpp>
 #include <context.hpp>
 #include <engine/Engine.hpp>
+#include <engine/UiSnapshot.hpp>
 #include <helpers.hpp>
 #include <patch.hpp>
 #include <settings.hpp>
@@ -49,7 +52,9 @@
 #include "Application.hpp"
 #include "AsyncDialog.hpp"
 #include "CardinalCommon.hpp"
+#include "InputCoalescing.hpp"
 #include "PluginContext.hpp"
+#include "StartupTrace.hpp"
 #include "WindowParameters.hpp"
 
 #ifndef DISTRHO_OS_WASM
@@ -66,6 +71,7 @@ namespace app {
 }
 namespace engine {
 void Engine_setAboutToClose(Engine*);
+const UiSnapshot* Engine_getUiSnapshot(Engine*);
 }
 namespace window {
     void WindowSetPluginUI(Window* window, DISTRHO_NAMESPACE::UI* ui);
@@ -184,8 +190,11 @@ struct WasmRemotePatchLoadingDialog : rack::widget::OpaqueWidget
     static const constexpr float margin = 10;
 
     rack::ui::MenuOverlay* overlay;
+    rack::ui::Label* label;
+    const char* const title;
 
     WasmRemotePatchLoadingDialog(const bool isFromPatchStorage)
+        : title(isFromPatchStorage ? "Loading patch from PatchStorage..." : "Loading remote patch...")
     {
         using rack::ui::Label;
         using rack::ui::MenuOverlay;
@@ -202,13 +211,11 @@ struct WasmRemotePatchLoadingDialog : rack::widget::OpaqueWidget
         layout->wrap = false;
         addChild(layout);
 
-        Label* const label = new Label;
+        label = new Label;
         label->box.size.x = box.size.x - 2*margin;
         label->box.size.y = box.size.y - 2*margin;
         label->fontSize = 16;
-        label->text = isFromPatchStorage
-                    ? "Loading patch from PatchStorage...\n"
-                    : "Loading remote patch...\n";
+        label->text = rack::string::f("%s\n", title);
         layout->addChild(label);
 
         overlay = new MenuOverlay;
@@ -217,6 +224,11 @@ struct WasmRemotePatchLoadingDialog : rack::widget::OpaqueWidget
         APP->scene->addChild(overlay);
     }
 
+    void setProgress(const int percent)
+    {
+        label->text = rack::string::f("%s %d%%\n", title, percent);
+    }
+
     void step() override
     {
         OpaqueWidget::step();
@@ -279,10 +291,151 @@ static void downloadRemotePatchSucceeded(const char* const filename)
     context->patch->path = "";
     context->history->setSaved();
 }
+
+// Remote patches are kept in IndexedDB by URL, so that reloading the page loads them at once.
+// The download still happens afterwards, but only to refresh the cached copy for the next time.
+static constexpr const char* const kRemotePatchCacheName = "CardinalRemotePatches";
+
+struct RemotePatchDownload {
+    std::string url;
+    std::string filename;
+    bool loadedFromCache;
+};
+
+static void remotePatchCacheStored(void* const arg)
+{
+    std::free(arg);
+}
+
+static void remotePatchDownloadLoaded(unsigned, void* const arg, const char* const filename)
+{
+    RemotePatchDownload* const download = static_cast<RemotePatchDownload*>(arg);
+
+    if (! download->loadedFromCache)
+        downloadRemotePatchSucceeded(filename);
+
+    if (FILE* const f = std::fopen(filename, "rb"))
+    {
+        std::fseek(f, 0, SEEK_END);
+        const long size = std::ftell(f);
+        std::fseek(f, 0, SEEK_SET);
+
+        if (size > 0)
+        {
+            void* const data = std::malloc(size);
+            if (data != nullptr && std::fread(data, size, 1, f) == 1)
+                emscripten_idb_async_store(kRemotePatchCacheName, download->url.c_str(), data, size,
+                                           data, remotePatchCacheStored, remotePatchCacheStored);
+            else
+                std::free(data);
+        }
+
+        std::fclose(f);
+    }
+
+    delete download;
+}
+
+static void remotePatchDownloadFailed(unsigned, void* const arg, const int status)
+{
+    RemotePatchDownload* const download = static_cast<RemotePatchDownload*>(arg);
+    d_stdout("remotePatchDownloadFailed %s %d", download->url.c_str(), status);
+
+    if (! download->loadedFromCache)
+        downloadRemotePatchFailed(download->filename.c_str());
+
+    delete download;
+}
+
+static void remotePatchDownloadProgress(unsigned, void* const arg, const int percent)
+{
+    RemotePatchDownload* const download = static_cast<RemotePatchDownload*>(arg);
+    CardinalBaseUI* const ui = static_cast<CardinalBaseUI*>(APP->ui);
+
+    if (! download->loadedFromCache && ui->psDialog != nullptr)
+        ui->psDialog->setProgress(percent);
+}
+
+static void remotePatchDownloadStart(RemotePatchDownload* const download)
+{
+    emscripten_async_wget2(download->url.c_str(), download->filename.c_str(), "GET", "", download,
+                           remotePatchDownloadLoaded, remotePatchDownloadFailed, remotePatchDownloadProgress);
+}
+
+static void remotePatchCacheLoaded(void* const arg, void* const data, const int size)
+{
+    RemotePatchDownload* const download = static_cast<RemotePatchDownload*>(arg);
+
+    if (FILE* const f = std::fopen(download->filename.c_str(), "wb"))
+    {
+        const bool ok = std::fwrite(data, size, 1, f) == 1;
+        std::fclose(f);
+
+        if (ok)
+        {
+            download->loadedFromCache = true;
+            downloadRemotePatchSucceeded(download->filename.c_str());
+        }
+    }
+
+    remotePatchDownloadStart(download);
+}
+
+static void remotePatchCacheMissing(void* const arg)
+{
+    remotePatchDownloadStart(static_cast<RemotePatchDownload*>(arg));
+}
+
+static void downloadRemotePatch(const std::string& url, const std::string& filename)
+{
+    RemotePatchDownload* const download = new RemotePatchDownload{ url, filename, false };
+    emscripten_idb_async_load(kRemotePatchCacheName, url.c_str(), download,
+                              remotePatchCacheLoaded, remotePatchCacheMissing);
+}
 #endif
 
 // -----------------------------------------------------------------------------------------------------------
 
+// repaint intervals while the user interacts with the editor, and after some time without user input
+static constexpr const double kInteractiveFrameInterval = 1.0 / 60.0;
+static constexpr const double kIdleFrameInterval = 1.0 / 15.0;
+static constexpr const double kIdleSecondsBeforeThrottling = 2.0;
+
+// repaint interval without user input while no module light changes, so displays still update slowly
+static constexpr const double kStaticFrameInterval = 1.0 / 4.0;
+
+// a hash of all module light values, quantized to the precision of an 8-bit color channel
+static uint32_t hashModuleLights(rack::engine::Engine* const engine, rack::app::RackWidget* const rack)
+{
+    uint32_t hash = 2166136261u;
+
+    // lights as of the last engine block, without reading them while the audio thread writes them
+    if (const rack::engine::UiSnapshot* const snapshot = rack::engine::Engine_getUiSnapshot(engine))
+    {
+        for (const float brightness : snapshot->lights)
+        {
+            const float value = rack::math::clamp(brightness, 0.f, 1.f);
+            hash = (hash ^ static_cast<uint32_t>(value * 255.f + 0.5f)) * 16777619u;
+        }
+
+        return hash;
+    }
+
+    for (rack::app::ModuleWidget* const mw : rack->getModules())
+    {
+        if (mw->module == nullptr)
+            continue;
+
+        for (rack::engine::Light& light : mw->module->lights)
+        {
+            const float value = rack::math::clamp(light.getBrightness(), 0.f, 1.f);
+            hash = (hash ^ static_cast<uint32_t>(value * 255.f + 0.5f)) * 16777619u;
+        }
+    }
+
+    return hash;
+}
+
 class CardinalUI : public CardinalBaseUI,
                    public WindowParametersCallback
 {
@@ -296,8 +449,12 @@ class CardinalUI : public CardinalBaseUI,
   #endif
 
     rack::math::Vec lastMousePos;
+    CoalescedInput coalescedInput;
     WindowParameters windowParameters;
-    int rateLimitStep = 0;
+    double lastInputTime = 0.0;
+    double lastRepaintTime = 0.0;
+    double lastDrawDuration = 0.0;
+    uint32_t lastLightsHash = 0;
    #ifdef DISTRHO_OS_WASM
     int8_t counterForFirstIdlePoint = 0;
    #endif
@@ -321,6 +478,7 @@ class CardinalUI : public CardinalBaseUI,
             rack::contextSet(context);
             rack::window::WindowSetMods(context->window, mods);
             WindowParametersRestore(context->window);
+            ui->lastInputTime = rack::system::getTime();
         }
 
         ~ScopedContext()
@@ -342,6 +500,8 @@ public:
         #endif
           lastMousePos()
     {
+        const double traceTime = startuptrace::now();
+
         rack::contextSet(context);
 
        #if ! DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
@@ -385,7 +545,10 @@ public:
 
         context->window = new rack::window::Window;
 
-        context->patch->loadTemplate();
+        {
+            const startuptrace::Scope trace("ui", "loadTemplate");
+            context->patch->loadTemplate();
+        }
         context->scene->rackScroll->reset();
         // swap to factory template after first load
         context->patch->templatePath = context->patch->factoryTemplatePath;
@@ -468,6 +631,11 @@ public:
 
         context->window->step();
 
+        startuptrace::record("ui", "CardinalUI", traceTime);
+       #ifdef CARDINAL_STARTUP_TRACE
+        startuptrace::write(rack::asset::user("startup-trace.json").c_str());
+       #endif
+
         rack::contextSet(nullptr);
 
         WindowParametersSetCallback(context->window, this);
@@ -512,8 +680,12 @@ public:
 
     void onNanoDisplay() override
     {
+        flushInput();
+
         const ScopedContext sc(this);
+        const double startTime = rack::system::getTime();
         context->window->step();
+        lastDrawDuration = rack::system::getTime() - startTime;
     }
 
     void uiIdle() override
@@ -592,8 +764,7 @@ public:
                 std::free(rack::patchStorageSlug);
                 rack::patchStorageSlug = nullptr;
 
-                emscripten_async_wget(url.c_str(), context->patch->templatePath.c_str(),
-                                      downloadRemotePatchSucceeded, downloadRemotePatchFailed);
+                downloadRemotePatch(url, context->patch->templatePath);
             }
             else if (rack::patchRemoteURL != nullptr)
             {
@@ -602,12 +773,16 @@ public:
                 std::free(rack::patchRemoteURL);
                 rack::patchRemoteURL = nullptr;
 
-                emscripten_async_wget(url.c_str(), context->patch->templatePath.c_str(),
-                                      downloadRemotePatchSucceeded, downloadRemotePatchFailed);
+                downloadRemotePatch(url, context->patch->templatePath);
             }
         }
        #endif
 
+       #if DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
+        // patch bank switches, also while hidden
+        static_cast<CardinalBasePlugin*>(context->plugin)->uiIdle();
+       #endif
+
         if (filebrowserhandle != nullptr && fileBrowserIdle(filebrowserhandle))
         {
             {
@@ -622,10 +797,34 @@ public:
             filebrowserhandle = nullptr;
         }
 
-        if (windowParameters.rateLimit != 0 && ++rateLimitStep % (windowParameters.rateLimit * 2))
+        // nothing to draw while the editor is hidden or minimized
+        if (! getWindow().isVisible())
             return;
 
-        rateLimitStep = 0;
+        const double time = rack::system::getTime();
+
+        // without user input only lights, meters and displays change, which is fine to draw at a lower rate
+        double interval = kInteractiveFrameInterval;
+        uint32_t lightsHash = lastLightsHash;
+
+        if (time - lastInputTime >= kIdleSecondsBeforeThrottling)
+        {
+            lightsHash = hashModuleLights(context->engine, context->scene->rack);
+            interval = lightsHash != lastLightsHash ? kIdleFrameInterval : kStaticFrameInterval;
+        }
+
+        if (const int rateLimit = windowParameters.rateLimit)
+            interval *= rateLimit * 2;
+
+        // keep drawing below half of the time available, so other editors and audio get their share
+        interval = std::max(interval, lastDrawDuration * 2);
+
+        // allow some jitter from the host idle timer, so 60Hz idle calls are not halved to 30fps
+        if (time - lastRepaintTime < interval * 0.9)
+            return;
+
+        lastRepaintTime = time;
+        lastLightsHash = lightsHash;
         repaint();
     }
 
@@ -683,7 +882,7 @@ public:
             break;
         case kWindowParameterUpdateRateLimit:
             windowParameters.rateLimit = static_cast<int>(value + 0.5f);
-            rateLimitStep = 0;
+            lastRepaintTime = 0.0;
             break;
         case kWindowParameterBrowserSort:
             windowParameters.browserSort = static_cast<int>(value + 0.5f);
@@ -761,7 +960,7 @@ protected:
             break;
         case kWindowParameterUpdateRateLimit:
             windowParameters.rateLimit = static_cast<int>(value + 0.5f);
-            rateLimitStep = 0;
+            lastRepaintTime = 0.0;
             break;
         case kWindowParameterBrowserSort:
             windowParameters.browserSort = static_cast<int>(value + 0.5f);
@@ -886,10 +1085,35 @@ protected:
         }
        #endif
 
+        flushInput();
+
         const ScopedContext sc(this, mods);
         return context->event->handleButton(lastMousePos, button, action, mods);
     }
 
+    // dispatches motion or scroll merged since the last frame, see CoalescedInput
+    void flushInput()
+    {
+        switch (coalescedInput.take())
+        {
+        case CoalescedInput::kTypeNone:
+            break;
+        case CoalescedInput::kTypeMotion:
+        {
+            const ScopedContext sc(this, coalescedInput.mods);
+            context->event->handleHover(coalescedInput.pos, coalescedInput.pos.minus(coalescedInput.lastMotionPos));
+            coalescedInput.lastMotionPos = coalescedInput.pos;
+            break;
+        }
+        case CoalescedInput::kTypeScroll:
+        {
+            const ScopedContext sc(this, coalescedInput.mods);
+            context->event->handleScroll(coalescedInput.pos, coalescedInput.scrollDelta);
+            break;
+        }
+        }
+    }
+
     bool onMotion(const MotionEvent& ev) override
     {
        #ifdef DPF_RUNTIME_TESTING
@@ -897,12 +1121,16 @@ protected:
        #endif
 
         const rack::math::Vec mousePos = rack::math::Vec(ev.pos.getX(), ev.pos.getY()).div(getScaleFactor()).round();
-        const rack::math::Vec mouseDelta = mousePos.minus(lastMousePos);
+        const int mods = glfwMods(ev.mod);
 
         lastMousePos = mousePos;
+        lastInputTime = rack::system::getTime();
+
+        if (coalescedInput.needsFlush(CoalescedInput::kTypeMotion, mods))
+            flushInput();
 
-        const ScopedContext sc(this, glfwMods(ev.mod));
-        return context->event->handleHover(mousePos, mouseDelta);
+        coalescedInput.addMotion(mousePos, mods);
+        return true;
     }
 
     bool onScroll(const ScrollEvent& ev) override
@@ -917,8 +1145,13 @@ protected:
 #endif
 
         const int mods = glfwMods(ev.mod);
-        const ScopedContext sc(this, mods);
-        return context->event->handleScroll(lastMousePos, scrollDelta);
+        lastInputTime = rack::system::getTime();
+
+        if (coalescedInput.needsFlush(CoalescedInput::kTypeScroll, mods))
+            flushInput();
+
+        coalescedInput.addScroll(lastMousePos, scrollDelta, mods);
+        return true;
     }
 
     bool onCharacterInput(const CharacterInputEvent& ev) override
@@ -930,6 +1163,8 @@ protected:
         if (ev.character < ' ' || ev.character >= kKeyDelete)
             return false;
 
+        flushInput();
+
         const int mods = glfwMods(ev.mod);
         const ScopedContext sc(this, mods);
         return context->event->handleText(lastMousePos, ev.character);
@@ -1016,6 +1251,8 @@ protected:
             break;
         }
 
+        flushInput();
+
         const ScopedContext sc(this, mods);
         return context->event->handleKey(lastMousePos, key, ev.keycode, action, mods);
     }
@@ -1042,6 +1279,8 @@ protected:
 
         if (!focus)
         {
+            flushInput();
+
             const ScopedContext sc(this, 0);
             context->event->handleLeave();
         }
@@ -1082,7 +1321,7 @@ protected:
                 }
                 else
                 {
-                    context->patch->save(sfilename);
+                    patchUtils::savePatch(sfilename);
                 }
             }
             catch (rack::Exception& e) {
@@ -0,0 +1 @@
+../CardinalCommon.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../custom/glfw.cpp
\ No newline at end of file
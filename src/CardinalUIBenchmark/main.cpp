@@ -0,0 +1,667 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include "Application.hpp"
+#include "NanoVG.hpp"
+#include "OpenGL.hpp"
+#include "Window.hpp"
+
+#include <asset.hpp>
+#include <history.hpp>
+#include <patch.hpp>
+#include <random.hpp>
+#include <settings.hpp>
+#include <system.hpp>
+
+#include <app/Browser.hpp>
+#include <app/Knob.hpp>
+#include <app/ModuleWidget.hpp>
+#include <app/RackScrollWidget.hpp>
+#include <app/RackWidget.hpp>
+#include <app/Scene.hpp>
+#include <engine/Engine.hpp>
+#include <ui/common.hpp>
+#include <widget/event.hpp>
+#include <window/Window.hpp>
+
+#include "CardinalCommon.hpp"
+#include "PluginContext.hpp"
+#include "extra/ScopedValueSetter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+extern const std::string CARDINAL_VERSION;
+
+namespace rack {
+namespace asset {
+std::string patchesPath();
+void destroy();
+}
+namespace engine {
+void Engine_setAboutToClose(Engine*);
+}
+namespace plugin {
+void initStaticPlugins();
+void destroyStaticPlugins();
+}
+namespace window {
+void WindowSetPluginRemote(Window* window, NanoTopLevelWidget* tlw);
+void WindowGetLastFrameDurations(Window* window, double& stepDuration, double& drawDuration);
+}
+}
+
+START_NAMESPACE_DISTRHO
+
+bool isUsingNativeAudio() noexcept { return false; }
+bool supportsAudioInput() { return false; }
+bool supportsBufferSizeChanges() { return false; }
+bool supportsMIDI() { return false; }
+bool isAudioInputEnabled() { return false; }
+bool isMIDIEnabled() { return false; }
+uint getBufferSize() { return 0; }
+bool requestAudioInput() { return false; }
+bool requestBufferSizeChange(uint) { return false; }
+bool requestMIDI() { return false; }
+const char* getPluginFormatName() noexcept { return "UIBenchmark"; }
+
+FileBrowserHandle fileBrowserCreate(bool, ulong, double, const FileBrowserOptions&) { return nullptr; }
+
+uint32_t Plugin::getBufferSize() const noexcept { return 512; }
+double Plugin::getSampleRate() const noexcept { return 48000; }
+bool Plugin::writeMidiEvent(const MidiEvent&) noexcept { return false; }
+
+void UI::editParameter(uint, bool) {}
+void UI::setParameterValue(uint, float) {}
+void UI::setState(const char*, const char*) {}
+bool UI::openFileBrowser(const FileBrowserOptions&) { return false; }
+
+END_NAMESPACE_DISTRHO
+
+USE_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+
+struct UIBenchmarkOptions {
+    uint32_t frames = 240;
+    uint32_t warmupFrames = 60;
+    uint width = DISTRHO_UI_DEFAULT_WIDTH;
+    uint height = DISTRHO_UI_DEFAULT_HEIGHT;
+    std::string csvPath;
+};
+
+enum Phase {
+    kPhaseIdle,
+    kPhasePan,
+    kPhaseZoom,
+    kPhaseDrag,
+    kPhaseCount
+};
+
+static const char* const kPhaseNames[kPhaseCount] = {
+    "idle",
+    "pan",
+    "zoom",
+    "drag",
+};
+
+// all in seconds
+struct FrameTimes {
+    double step = 0.0;
+    double draw = 0.0;
+    double flush = 0.0;
+    double gpu = 0.0;
+    double total = 0.0;
+};
+
+enum Metric {
+    kMetricStep,
+    kMetricDraw,
+    kMetricFlush,
+    kMetricGpu,
+    kMetricTotal,
+    kMetricCount
+};
+
+static const char* const kMetricNames[kMetricCount] = {
+    "step",
+    "draw",
+    "flush",
+    "gpu",
+    "total",
+};
+
+static constexpr const int kPercentileCount = 4;
+static const double kPercentiles[kPercentileCount] = { 0.5, 0.9, 0.99, 1.0 };
+static const char* const kPercentileNames[kPercentileCount] = { "p50", "p90", "p99", "max" };
+
+struct UIBenchmarkResult {
+    std::string name;
+    const char* phase = nullptr;
+    size_t modules = 0;
+    uint32_t frames = 0;
+    // milliseconds, per metric and percentile
+    double values[kMetricCount][kPercentileCount] = {};
+};
+
+static double percentile(std::vector<double>& values, const double fraction)
+{
+    if (values.empty())
+        return 0.0;
+
+    std::sort(values.begin(), values.end());
+
+    const size_t index = static_cast<size_t>(fraction * (values.size() - 1) + 0.5);
+    return values[std::min(index, values.size() - 1)];
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Top-level widget driving the Rack window, frames are rendered on request instead of from the event loop
+
+class UIBenchmarkWidget : public NanoTopLevelWidget
+{
+public:
+    explicit UIBenchmarkWidget(Window& window)
+        : NanoTopLevelWidget(window)
+    {
+        CardinalPluginContext* const context = static_cast<CardinalPluginContext*>(rack::contextGet());
+        context->nativeWindowId = window.getNativeWindowHandle();
+        context->tlw = this;
+
+        rack::window::WindowSetPluginRemote(context->window, this);
+    }
+
+    ~UIBenchmarkWidget() override
+    {
+        CardinalPluginContext* const context = static_cast<CardinalPluginContext*>(rack::contextGet());
+        context->nativeWindowId = 0;
+
+        rack::window::WindowSetPluginRemote(context->window, nullptr);
+    }
+
+    // GPU time is what glFinish waits for after the NanoVG flush, the window is never shown nor swapped
+    FrameTimes renderFrame()
+    {
+        CardinalPluginContext* const context = static_cast<CardinalPluginContext*>(rack::contextGet());
+        const Window::ScopedGraphicsContext sgc(getWindow());
+
+        FrameTimes times;
+        const double start = rack::system::getTime();
+
+        beginFrame(getWidth(), getHeight());
+        context->window->step();
+
+        const double flushStart = rack::system::getTime();
+        endFrame();
+
+        const double gpuStart = rack::system::getTime();
+        glFinish();
+
+        const double end = rack::system::getTime();
+
+        rack::window::WindowGetLastFrameDurations(context->window, times.step, times.draw);
+        times.flush = gpuStart - flushStart;
+        times.gpu = end - gpuStart;
+        times.total = end - start;
+        return times;
+    }
+
+protected:
+    void onNanoDisplay() override
+    {
+        rack::contextGet()->window->step();
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// Scripted interaction, applied before each frame
+
+struct UIScript {
+    Phase phase = kPhaseIdle;
+    uint32_t frames = 0;
+    float initialZoom = 1.f;
+    rack::math::Vec dragPos;
+    bool dragging = false;
+
+    void begin(CardinalPluginContext* const context, UIBenchmarkWidget* const widget)
+    {
+        context->scene->rackScroll->reset();
+        widget->renderFrame();
+
+        initialZoom = context->scene->rackScroll->getZoom();
+        dragging = false;
+
+        if (phase != kPhaseDrag)
+            return;
+
+        // first knob fully inside the rack view, positions are only valid after a frame with the new scroll
+        const rack::math::Rect view = context->scene->rackScroll->box;
+
+        for (rack::app::ModuleWidget* const moduleWidget : context->scene->rack->getModules())
+        {
+            for (rack::app::ParamWidget* const paramWidget : moduleWidget->getParams())
+            {
+                if (dynamic_cast<rack::app::Knob*>(paramWidget) == nullptr || ! paramWidget->isVisible())
+                    continue;
+
+                const rack::math::Vec pos = paramWidget->getAbsoluteOffset(paramWidget->box.size.div(2)).round();
+
+                if (! view.contains(pos))
+                    continue;
+
+                dragPos = pos;
+                dragging = true;
+                context->event->handleHover(dragPos, rack::math::Vec());
+                context->event->handleButton(dragPos, GLFW_MOUSE_BUTTON_LEFT, GLFW_PRESS, 0);
+                return;
+            }
+        }
+
+        d_stderr("No knob in view, drag phase only renders");
+    }
+
+    void apply(CardinalPluginContext* const context, const uint32_t frame)
+    {
+        rack::app::RackScrollWidget* const rackScroll = context->scene->rackScroll;
+
+        // half of the frames going one way, the other half coming back
+        const float direction = frame < frames / 2 ? 1.f : -1.f;
+
+        switch (phase)
+        {
+        case kPhaseIdle:
+        case kPhaseCount:
+            break;
+        case kPhasePan:
+            rackScroll->offset = rackScroll->offset.plus(rack::math::Vec(8.f, 4.f).mult(direction));
+            break;
+        case kPhaseZoom:
+            rackScroll->setZoom(initialZoom * std::pow(2.f, std::sin(2.f * M_PI * frame / frames)));
+            break;
+        case kPhaseDrag:
+            if (dragging)
+            {
+                const rack::math::Vec delta(0.f, -2.f * direction);
+                dragPos = dragPos.plus(delta);
+                context->event->handleHover(dragPos, delta);
+            }
+            break;
+        }
+    }
+
+    void end(CardinalPluginContext* const context)
+    {
+        if (dragging)
+        {
+            context->event->handleButton(dragPos, GLFW_MOUSE_BUTTON_LEFT, GLFW_RELEASE, 0);
+            dragging = false;
+        }
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+static void stepEngine(CardinalPluginContext* const context, std::vector<float>& outputData)
+{
+    std::memset(outputData.data(), 0, sizeof(float) * outputData.size());
+    context->reset = context->frame == 0;
+    ++context->processCounter;
+    context->engine->stepBlock(context->bufferSize);
+    context->frame += context->bufferSize;
+}
+
+static bool runPatch(const UIBenchmarkOptions& options,
+                     Application& app,
+                     UIBenchmarkWidget* const widget,
+                     const std::string& patchPath,
+                     std::vector<UIBenchmarkResult>& results)
+{
+    CardinalPluginContext* const context = static_cast<CardinalPluginContext*>(rack::contextGet());
+
+    try {
+        context->patch->load(patchPath);
+    } catch (rack::Exception& e) {
+        d_stderr2("Failed to load patch \"%s\": %s", patchPath.c_str(), e.what());
+        return false;
+    }
+
+    std::vector<float> outputData(DISTRHO_PLUGIN_NUM_OUTPUTS * context->bufferSize);
+    float* dataOuts[DISTRHO_PLUGIN_NUM_OUTPUTS] = {};
+
+    for (uint32_t i = 0; i < CARDINAL_NUM_AUDIO_OUTPUTS; ++i)
+        dataOuts[i] = outputData.data() + i * context->bufferSize;
+
+    context->dataIns = nullptr;
+    context->dataOuts = dataOuts;
+    context->playing = true;
+    context->frame = 0;
+
+    // let framebuffers, fonts and images settle before measuring
+    context->scene->rackScroll->reset();
+    for (uint32_t i = 0; i < options.warmupFrames; ++i)
+    {
+        stepEngine(context, outputData);
+        widget->renderFrame();
+        app.idle();
+    }
+
+    const std::string name = rack::system::getStem(patchPath);
+
+    for (int p = 0; p < kPhaseCount; ++p)
+    {
+        UIScript script;
+        script.phase = static_cast<Phase>(p);
+        script.frames = options.frames;
+        script.begin(context, widget);
+
+        std::vector<double> values[kMetricCount];
+        for (std::vector<double>& v : values)
+            v.reserve(options.frames);
+
+        for (uint32_t frame = 0; frame < options.frames; ++frame)
+        {
+            // engine and event loop are kept out of the measured frame
+            stepEngine(context, outputData);
+            app.idle();
+
+            script.apply(context, frame);
+            const FrameTimes times = widget->renderFrame();
+
+            values[kMetricStep].push_back(times.step);
+            values[kMetricDraw].push_back(times.draw);
+            values[kMetricFlush].push_back(times.flush);
+            values[kMetricGpu].push_back(times.gpu);
+            values[kMetricTotal].push_back(times.total);
+        }
+
+        script.end(context);
+
+        UIBenchmarkResult result;
+        result.name = name;
+        result.phase = kPhaseNames[p];
+        result.modules = context->engine->getNumModules();
+        result.frames = options.frames;
+
+        for (int m = 0; m < kMetricCount; ++m)
+            for (int i = 0; i < kPercentileCount; ++i)
+                result.values[m][i] = percentile(values[m], kPercentiles[i]) * 1000.0;
+
+        results.push_back(result);
+    }
+
+    context->dataOuts = nullptr;
+    context->playing = false;
+    return true;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+static void printResult(const UIBenchmarkResult& result)
+{
+    std::printf("%-32s %-5s %5zu modules", result.name.c_str(), result.phase, result.modules);
+
+    for (int m = 0; m < kMetricCount; ++m)
+        std::printf("  %s %6.2f/%6.2f/%6.2f/%6.2f", kMetricNames[m],
+                    result.values[m][0], result.values[m][1], result.values[m][2], result.values[m][3]);
+
+    std::printf(" ms\n");
+}
+
+static void writeResults(const std::string& path, const std::vector<UIBenchmarkResult>& results)
+{
+    std::ofstream file(path);
+    DISTRHO_SAFE_ASSERT_RETURN(file.good(),);
+
+    file << "name,phase,modules,frames";
+    for (int m = 0; m < kMetricCount; ++m)
+        for (int i = 0; i < kPercentileCount; ++i)
+            file << "," << kMetricNames[m] << "_" << kPercentileNames[i] << "_ms";
+    file << "\n";
+
+    for (const UIBenchmarkResult& result : results)
+    {
+        file << result.name << "," << result.phase << "," << result.modules << "," << result.frames;
+        for (int m = 0; m < kMetricCount; ++m)
+            for (int i = 0; i < kPercentileCount; ++i)
+                file << "," << result.values[m][i];
+        file << "\n";
+    }
+}
+
+static void printUsage(const char* const name)
+{
+    std::fprintf(stderr,
+                 "Usage: %s [options] <patch.vcv or directory>...\n"
+                 "Measures Cardinal UI frame times on a corpus of patches, rendered without showing a window.\n"
+                 "Each patch is idle, panned, zoomed and has a knob dragged, timings are p50/p90/p99/max in ms.\n"
+                 "step and draw are the scene step and draw, flush is the NanoVG flush and gpu the wait for it.\n"
+                 "\n"
+                 "Options:\n"
+                 "  -f, --frames <count>        measured frames per phase (default: 240)\n"
+                 "  --warmup <count>            frames rendered after loading each patch (default: 60)\n"
+                 "  --width <pixels>            window width (default: %d)\n"
+                 "  --height <pixels>           window height (default: %d)\n"
+                 "  --csv <path>                write results as CSV\n",
+                 name, DISTRHO_UI_DEFAULT_WIDTH, DISTRHO_UI_DEFAULT_HEIGHT);
+}
+
+int main(const int argc, const char* argv[])
+{
+    using namespace rack;
+
+    UIBenchmarkOptions options;
+    std::vector<std::string> patchPaths;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if ((arg == "-f" || arg == "--frames") && hasValue)
+            options.frames = std::atoi(argv[++i]);
+        else if (arg == "--warmup" && hasValue)
+            options.warmupFrames = std::atoi(argv[++i]);
+        else if (arg == "--width" && hasValue)
+            options.width = std::atoi(argv[++i]);
+        else if (arg == "--height" && hasValue)
+            options.height = std::atoi(argv[++i]);
+        else if (arg == "--csv" && hasValue)
+            options.csvPath = argv[++i];
+        else if (arg.size() != 0 && arg[0] != '-')
+            patchPaths.push_back(arg);
+        else
+        {
+            printUsage(argv[0]);
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+    }
+
+    if (patchPaths.empty() || options.frames == 0 || options.width == 0 || options.height == 0)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // --------------------------------------------------------------------------
+
+    settings::allowCursorLock = false;
+    settings::autoCheckUpdates = false;
+    settings::autosaveInterval = 0;
+    settings::devMode = true;
+    settings::isPlugin = true;
+    settings::skipLoadOnLaunch = true;
+    settings::showTipsOnLaunch = false;
+    settings::windowPos = math::Vec(0, 0);
+
+    system::init();
+    logger::init();
+    random::init();
+    ui::init();
+
+   #ifdef CARDINAL_PLUGIN_SOURCE_DIR
+    // Make system dir point to source code location as fallback
+    asset::systemDir = CARDINAL_PLUGIN_SOURCE_DIR DISTRHO_OS_SEP_STR "Rack";
+    asset::bundlePath.clear();
+
+    // If source code dir does not exist use install target prefix as system dir
+    if (!system::exists(system::join(asset::systemDir, "res")))
+   #endif
+    {
+       #if defined(ARCH_MAC)
+        asset::systemDir = "/Library/Application Support/Cardinal";
+       #elif defined(ARCH_WIN)
+        const std::string commonprogfiles = getSpecialPath(kSpecialPathCommonProgramFiles);
+        if (! commonprogfiles.empty())
+            asset::systemDir = system::join(commonprogfiles, "Cardinal");
+       #else
+        asset::systemDir = CARDINAL_PLUGIN_PREFIX "/share/cardinal";
+       #endif
+
+        asset::bundlePath = system::join(asset::systemDir, "PluginManifests");
+    }
+
+    asset::userDir = asset::systemDir;
+
+    INFO("%s %s %s, compatible with Rack version %s", APP_NAME.c_str(), APP_EDITION.c_str(), CARDINAL_VERSION.c_str(), APP_VERSION.c_str());
+    INFO("%s", system::getOperatingSystemInfo().c_str());
+
+    // directories in the corpus stand for the patches inside them
+    std::vector<std::string> corpus;
+
+    for (const std::string& path : patchPaths)
+    {
+        if (system::isDirectory(path))
+        {
+            std::vector<std::string> entries = system::getEntries(path);
+            std::sort(entries.begin(), entries.end());
+
+            for (const std::string& entry : entries)
+            {
+                if (system::getExtension(entry) == ".vcv")
+                    corpus.push_back(entry);
+            }
+        }
+        else
+        {
+            corpus.push_back(path);
+        }
+    }
+
+    INFO("Initializing plugins");
+    plugin::initStaticPlugins();
+
+    INFO("Initializing plugin browser DB");
+    app::browserInit();
+
+    // --------------------------------------------------------------------------
+
+    char uidBuf[32];
+    std::snprintf(uidBuf, sizeof(uidBuf), "CardinalUIBenchmark.%08x", random::u32());
+    const std::string autosavePath = system::join(system::getTempDirectory(), uidBuf);
+    system::createDirectories(autosavePath);
+
+    CardinalPluginContext* const context = new CardinalPluginContext(nullptr);
+    rack::contextSet(context);
+
+    context->bufferSize = 512;
+    context->sampleRate = 48000;
+    settings::sampleRate = context->sampleRate;
+
+    context->engine = new rack::engine::Engine;
+    context->engine->setSampleRate(context->sampleRate);
+
+    context->history = new rack::history::State;
+    context->patch = new rack::patch::Manager;
+    context->patch->autosavePath = autosavePath;
+
+    context->event = new rack::widget::EventState;
+    context->scene = new rack::app::Scene;
+    context->event->rootWidget = context->scene;
+
+    context->window = new rack::window::Window;
+
+    // --------------------------------------------------------------------------
+
+    std::vector<UIBenchmarkResult> results;
+    bool failed = false;
+
+    {
+        Application app;
+        Window window(app);
+        window.setIgnoringKeyRepeat(true);
+        window.setSize(options.width, options.height);
+
+        ScopedPointer<UIBenchmarkWidget> widget;
+
+        {
+            const Window::ScopedGraphicsContext sgc(window);
+            widget = new UIBenchmarkWidget(window);
+        }
+
+        for (const std::string& patchPath : corpus)
+        {
+            const size_t first = results.size();
+
+            if (runPatch(options, app, widget, patchPath, results))
+            {
+                for (size_t i = first; i < results.size(); ++i)
+                    printResult(results[i]);
+            }
+            else
+            {
+                failed = true;
+            }
+        }
+
+        context->patch->clear();
+
+        {
+            const Window::ScopedGraphicsContext sgc(window);
+            widget = nullptr;
+        }
+    }
+
+    if (! options.csvPath.empty())
+        writeResults(options.csvPath, results);
+
+    // --------------------------------------------------------------------------
+
+    {
+        // do a little dance to prevent context scene deletion from saving to temp dir
+        const ScopedValueSetter<bool> svs(rack::settings::headless, true);
+        Engine_setAboutToClose(context->engine);
+        delete context;
+    }
+
+    rack::system::removeRecursively(autosavePath);
+
+    asset::bundlePath.clear();
+    asset::systemDir.clear();
+    asset::userDir.clear();
+
+    plugin::destroyStaticPlugins();
+    asset::destroy();
+    settings::destroy();
+    logger::destroy();
+
+    return failed ? 1 : 0;
+}
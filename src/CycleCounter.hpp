@@ -0,0 +1,71 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+// CPU cycle counter for timing code on the audio thread, a single instruction on x86 and ARM64.
+// Falls back to the steady clock elsewhere. Ticks are converted to seconds with getSecondsPerTick(),
+// which measures the counter once per process on x86, so call it outside the audio thread first.
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <x86intrin.h>
+#endif
+
+namespace cyclecounter
+{
+
+static inline uint64_t now()
+{
+   #if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+   #elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+   #else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+   #endif
+}
+
+static inline double getSecondsPerTick()
+{
+   #if defined(__x86_64__) || defined(__i386__)
+    // invariant TSCs tick at a constant rate, measure it against the steady clock
+    static const double secondsPerTick = [] {
+        const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+        const uint64_t startTicks = now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        const uint64_t endTicks = now();
+        const double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        return endTicks > startTicks ? duration / (endTicks - startTicks) : 1e-9;
+    }();
+    return secondsPerTick;
+   #elif defined(__aarch64__)
+    uint64_t frequency;
+    __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+    return frequency != 0 ? 1.0 / frequency : 1e-9;
+   #else
+    return 1e-9;
+   #endif
+}
+
+}
@@ -0,0 +1,85 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include "DistrhoUtils.hpp"
+
+#include <math.hpp>
+
+START_NAMESPACE_DISTRHO
+
+// -----------------------------------------------------------------------------------------------------------
+
+// Pointer motion and scroll events pile up here until the next frame or the next event of another kind,
+// so mice and touchpads polled at 1000Hz walk the widget tree for hover and drag about once per frame.
+// A merged motion is dispatched with the distance from the last dispatched position, which is exactly
+// the sum of the merged deltas, so drags do not lose any movement.
+struct CoalescedInput {
+    enum Type {
+        kTypeNone,
+        kTypeMotion,
+        kTypeScroll,
+    };
+
+    Type pending = kTypeNone;
+    int mods = 0;
+    rack::math::Vec pos;
+    rack::math::Vec scrollDelta;
+    // where the last dispatched motion ended
+    rack::math::Vec lastMotionPos;
+
+    // whether the pending event must be dispatched before one of this type can be added
+    bool needsFlush(const Type type, const int newMods) const noexcept
+    {
+        if (pending == kTypeNone)
+            return false;
+        if (pending != type)
+            return true;
+        return type == kTypeScroll && mods != newMods;
+    }
+
+    void addMotion(const rack::math::Vec& newPos, const int newMods) noexcept
+    {
+        pending = kTypeMotion;
+        pos = newPos;
+        mods = newMods;
+    }
+
+    void addScroll(const rack::math::Vec& newPos, const rack::math::Vec& delta, const int newMods) noexcept
+    {
+        if (pending != kTypeScroll)
+            scrollDelta = rack::math::Vec();
+
+        pending = kTypeScroll;
+        pos = newPos;
+        scrollDelta = scrollDelta.plus(delta);
+        mods = newMods;
+    }
+
+    // takes the pending event, its position and delta are left in place for dispatching it
+    Type take() noexcept
+    {
+        const Type type = pending;
+        pending = kTypeNone;
+        return type;
+    }
+};
+
+// -----------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
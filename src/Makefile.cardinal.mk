@@ -298,6 +298,28 @@ ifeq ($(HEADLESS),true)
 BASE_FLAGS += -DHEADLESS
 endif
 
+ifeq ($(MODULE_MEMORY),true)
+BASE_FLAGS += -DCARDINAL_MODULE_MEMORY
+endif
+
+ifeq ($(STARTUP_TRACE),true)
+BASE_FLAGS += -DCARDINAL_STARTUP_TRACE
+endif
+
+ifeq ($(SHARED_PLUGINS),true)
+BASE_FLAGS += -DCARDINAL_SHARED_PLUGINS
+BUILD_C_FLAGS += -fvisibility=default
+BUILD_CXX_FLAGS += -fvisibility=default
+endif
+
+ifeq ($(MOD_BUILD),true)
+LOW_MEMORY ?= true
+endif
+
+ifeq ($(LOW_MEMORY),true)
+BASE_FLAGS += -DCARDINAL_LOW_MEMORY
+endif
+
 ifeq ($(MOD_BUILD),true)
 BASE_FLAGS += -DDISTRHO_PLUGIN_USES_MODGUI=1 -DDISTRHO_PLUGIN_MINIMUM_BUFFER_SIZE=0xffff
 endif
@@ -388,6 +410,10 @@ LINK_FLAGS += -sINITIAL_MEMORY=64Mb
 LINK_FLAGS += -sLZ4=1
 LINK_FLAGS += --shell-file=../emscripten/shell.html
 LINK_FLAGS += -O3
+ifeq ($(WASM_THREADS),true)
+# engine workers are created on startup, browsers only start threads once the main thread yields
+LINK_FLAGS += -sPTHREAD_POOL_SIZE=navigator.hardwareConcurrency
+endif
 else ifeq ($(HAIKU),true)
 LINK_FLAGS += -lpthread
 else
@@ -400,6 +426,11 @@ LINK_FLAGS += -ldl
 endif
 endif
 
+# plugin modules resolve Rack and Cardinal symbols from the executable loading them
+ifeq ($(SHARED_PLUGINS),true)
+LINK_FLAGS += -rdynamic
+endif
+
 ifeq ($(BSD),true)
 ifeq ($(DEBUG),true)
 LINK_FLAGS += -lexecinfo
@@ -0,0 +1,106 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include "MemoryUsage.hpp"
+
+#include <cstdio>
+
+#ifdef __linux__
+# include <unistd.h>
+#endif
+
+#ifdef CARDINAL_LOW_MEMORY
+# include <logger.hpp>
+
+# include <algorithm>
+# include <mutex>
+# include <string>
+# include <utility>
+# include <vector>
+
+# ifdef __GLIBC__
+#  include <malloc.h>
+# endif
+#endif
+
+namespace memusage
+{
+
+size_t getResidentSize()
+{
+   #ifdef __linux__
+    FILE* const f = std::fopen("/proc/self/statm", "r");
+    if (f == nullptr)
+        return 0;
+
+    unsigned long size = 0, resident = 0;
+    const bool ok = std::fscanf(f, "%lu %lu", &size, &resident) == 2;
+    std::fclose(f);
+
+    return ok ? resident * static_cast<size_t>(sysconf(_SC_PAGESIZE)) : 0;
+   #else
+    return 0;
+   #endif
+}
+
+#ifdef CARDINAL_LOW_MEMORY
+static std::mutex mutex;
+static std::vector<std::pair<std::string, size_t>> records;
+
+void record(const char* const name, const size_t startSize)
+{
+    const size_t size = getResidentSize();
+
+    const std::lock_guard<std::mutex> lock(mutex);
+    records.emplace_back(name, size > startSize ? size - startSize : 0);
+}
+
+void report(const char* const phase)
+{
+   #ifdef __GLIBC__
+    // give back what init code freed, parsed manifests and temporary strings are gone by now
+    malloc_trim(0);
+   #endif
+
+    INFO("Resident memory after %s: %.1f MiB", phase, getResidentSize() / 1048576.0);
+
+    const std::lock_guard<std::mutex> lock(mutex);
+
+    if (records.empty())
+        return;
+
+    std::sort(records.begin(), records.end(), [](const std::pair<std::string, size_t>& a,
+                                                 const std::pair<std::string, size_t>& b) {
+        return a.second > b.second;
+    });
+
+    size_t total = 0;
+    for (const std::pair<std::string, size_t>& record : records)
+        total += record.second;
+
+    INFO("Resident memory taken by %d plugins: %.1f MiB", static_cast<int>(records.size()), total / 1048576.0);
+
+    for (size_t i = 0; i < records.size() && i < 10; ++i)
+        INFO("Resident memory largest plugin #%d: %s %.1f KiB", static_cast<int>(i + 1),
+             records[i].first.c_str(), records[i].second / 1024.0);
+
+    records.clear();
+    records.shrink_to_fit();
+}
+#endif // CARDINAL_LOW_MEMORY
+
+}
@@ -0,0 +1,40 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+// Resident memory report, enabled by building with LOW_MEMORY=true (the default for MOD builds).
+// Plugins are then initialized serially so that the memory each one takes can be told apart,
+// which also keeps allocations in a single malloc arena instead of one per init thread.
+
+namespace memusage
+{
+
+// resident size of the process in bytes, 0 where it cannot be read (only Linux for now)
+size_t getResidentSize();
+
+#ifdef CARDINAL_LOW_MEMORY
+void record(const char* name, size_t startSize);
+void report(const char* phase);
+#else
+static inline void record(const char*, size_t) {}
+static inline void report(const char*) {}
+#endif
+
+}
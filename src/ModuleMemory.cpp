@@ -0,0 +1,399 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include "ModuleMemory.hpp"
+
+#ifdef CARDINAL_MODULE_MEMORY
+
+#include <engine/Module.hpp>
+#include <plugin/Model.hpp>
+#include <plugin/Plugin.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <map>
+#include <vector>
+
+#if defined(ARCH_LIN) && defined(__GLIBC__)
+# define CARDINAL_MODULE_MEMORY_HOOKS
+#endif
+
+namespace modulemem
+{
+
+// Fixed size tables filled without allocating, as they are used from within the allocator.
+// Each module instance gets a slot, which keeps its counts after the module is deleted.
+// Modules are found by address through `moduleEntries`, tracked allocations through `allocationEntries`.
+
+struct Slot {
+    std::atomic<const rack::engine::Module*> module;
+    std::atomic<const rack::plugin::Model*> model;
+    std::atomic<int64_t> bytes;
+};
+
+struct ModuleEntry {
+    std::atomic<const rack::engine::Module*> module;
+    std::atomic<uint32_t> slot;
+};
+
+struct AllocationEntry {
+    std::atomic<void*> ptr;
+    uint32_t slot;
+    size_t size;
+};
+
+static constexpr const uint32_t kSlotCount = 1 << 14;
+static constexpr const uint32_t kModuleEntryCount = 1 << 15;
+static constexpr const uint32_t kAllocationEntryCount = 1 << 21;
+static constexpr const uint32_t kMaxProbes = 64;
+
+// marks a removed entry, lookups go on past it
+static void* const kTombstone = reinterpret_cast<void*>(1);
+static const rack::engine::Module* const kModuleTombstone = reinterpret_cast<const rack::engine::Module*>(1);
+
+static Slot slots[kSlotCount];
+static std::atomic<uint32_t> nextSlot{1};
+static ModuleEntry moduleEntries[kModuleEntryCount];
+static AllocationEntry allocationEntries[kAllocationEntryCount];
+static std::atomic<int64_t> trackedAllocations{0};
+
+// slot 0 means not tagged
+static thread_local uint32_t currentSlot = 0;
+static thread_local const rack::engine::Module* currentModule = nullptr;
+static thread_local bool inHook = false;
+
+static inline uint32_t hashPointer(const void* const ptr, const uint32_t size)
+{
+    return static_cast<uint32_t>((reinterpret_cast<uintptr_t>(ptr) >> 4) * UINT64_C(0x9E3779B97F4A7C15) >> 40) % size;
+}
+
+static uint32_t findModuleSlot(const rack::engine::Module* const module)
+{
+    uint32_t index = hashPointer(module, kModuleEntryCount);
+
+    for (uint32_t i = 0; i < kMaxProbes; ++i, index = (index + 1) % kModuleEntryCount)
+    {
+        const rack::engine::Module* const entryModule = moduleEntries[index].module.load(std::memory_order_acquire);
+
+        if (entryModule == module)
+            return moduleEntries[index].slot.load(std::memory_order_acquire);
+        if (entryModule == nullptr)
+            return 0;
+    }
+
+    return 0;
+}
+
+static void bindModuleSlot(const rack::engine::Module* const module, const uint32_t slot)
+{
+    uint32_t index = hashPointer(module, kModuleEntryCount);
+
+    for (uint32_t i = 0; i < kMaxProbes; ++i, index = (index + 1) % kModuleEntryCount)
+    {
+        ModuleEntry& entry(moduleEntries[index]);
+        const rack::engine::Module* expected = entry.module.load(std::memory_order_acquire);
+
+        // a module at the address of a deleted one that was never removed takes its entry over
+        if (expected == module
+            || ((expected == nullptr || expected == kModuleTombstone)
+                && entry.module.compare_exchange_strong(expected, module)))
+        {
+            entry.slot.store(slot, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+static uint32_t newSlot(const rack::plugin::Model* const model, const rack::engine::Module* const module)
+{
+    const uint32_t slot = nextSlot++;
+    if (slot >= kSlotCount)
+        return 0;
+
+    slots[slot].model.store(model, std::memory_order_relaxed);
+    slots[slot].module.store(module, std::memory_order_release);
+    return slot;
+}
+
+static uint32_t getCurrentSlot()
+{
+    if (currentSlot != 0 || currentModule == nullptr)
+        return currentSlot;
+
+    // modules constructed without a tag, like those added from the browser, get a slot once they allocate
+    currentSlot = findModuleSlot(currentModule);
+    if (currentSlot == 0)
+    {
+        currentSlot = newSlot(currentModule->model, currentModule);
+        if (currentSlot != 0)
+            bindModuleSlot(currentModule, currentSlot);
+    }
+
+    return currentSlot;
+}
+
+static void onAllocate(void* const ptr, const size_t size, uint32_t slot)
+{
+    if (ptr == nullptr || inHook)
+        return;
+
+    inHook = true;
+
+    if (slot == 0)
+        slot = getCurrentSlot();
+
+    if (slot != 0)
+    {
+        uint32_t index = hashPointer(ptr, kAllocationEntryCount);
+
+        for (uint32_t i = 0; i < kMaxProbes; ++i, index = (index + 1) % kAllocationEntryCount)
+        {
+            AllocationEntry& entry(allocationEntries[index]);
+            void* expected = entry.ptr.load(std::memory_order_relaxed);
+
+            if (expected != nullptr && expected != kTombstone)
+                continue;
+
+            // claim the entry with the tombstone first, so lookups never see it half written
+            if (! entry.ptr.compare_exchange_strong(expected, kTombstone))
+                continue;
+
+            entry.slot = slot;
+            entry.size = size;
+            entry.ptr.store(ptr, std::memory_order_release);
+            slots[slot].bytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+            ++trackedAllocations;
+            break;
+        }
+    }
+
+    inHook = false;
+}
+
+// returns the slot the allocation belonged to, or 0 if not tracked
+static uint32_t onFree(void* const ptr)
+{
+    if (ptr == nullptr || trackedAllocations.load(std::memory_order_relaxed) == 0)
+        return 0;
+
+    uint32_t index = hashPointer(ptr, kAllocationEntryCount);
+
+    for (uint32_t i = 0; i < kMaxProbes; ++i, index = (index + 1) % kAllocationEntryCount)
+    {
+        AllocationEntry& entry(allocationEntries[index]);
+        void* expected = entry.ptr.load(std::memory_order_acquire);
+
+        if (expected == nullptr)
+            return 0;
+        if (expected != ptr)
+            continue;
+
+        const uint32_t slot = entry.slot;
+        const size_t size = entry.size;
+
+        if (! entry.ptr.compare_exchange_strong(expected, kTombstone))
+            return 0;
+
+        slots[slot].bytes.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
+        --trackedAllocations;
+        return slot;
+    }
+
+    return 0;
+}
+
+void beginConstruction(const rack::plugin::Model* const model)
+{
+    currentModule = nullptr;
+    currentSlot = newSlot(model, nullptr);
+}
+
+void endConstruction(const rack::engine::Module* const module)
+{
+    const uint32_t slot = currentSlot;
+    currentSlot = 0;
+    currentModule = nullptr;
+
+    if (slot == 0)
+        return;
+
+    // a constructor that threw leaves its model with whatever it did not free
+    if (module == nullptr)
+        return;
+
+    slots[slot].module.store(module, std::memory_order_release);
+    bindModuleSlot(module, slot);
+}
+
+void setModule(const rack::engine::Module* const module)
+{
+    currentModule = module;
+    currentSlot = 0;
+}
+
+void removeModule(const rack::engine::Module* const module)
+{
+    uint32_t index = hashPointer(module, kModuleEntryCount);
+
+    for (uint32_t i = 0; i < kMaxProbes; ++i, index = (index + 1) % kModuleEntryCount)
+    {
+        ModuleEntry& entry(moduleEntries[index]);
+        const rack::engine::Module* expected = entry.module.load(std::memory_order_acquire);
+
+        if (expected == nullptr)
+            return;
+        if (expected != module)
+            continue;
+
+        slots[entry.slot.load(std::memory_order_acquire)].module.store(nullptr, std::memory_order_release);
+        entry.module.compare_exchange_strong(expected, kModuleTombstone);
+        return;
+    }
+}
+
+int64_t getModuleBytes(const rack::engine::Module* const module)
+{
+    const uint32_t slot = findModuleSlot(module);
+    return slot != 0 ? slots[slot].bytes.load(std::memory_order_relaxed) : 0;
+}
+
+json_t* getModelsJson()
+{
+    struct ModelMemory {
+        int instances = 0;
+        int64_t bytes = 0;
+        int64_t leftBytes = 0;
+    };
+    std::map<const rack::plugin::Model*, ModelMemory> models;
+
+    const uint32_t slotCount = std::min(nextSlot.load(), kSlotCount);
+    for (uint32_t i = 1; i < slotCount; ++i)
+    {
+        const rack::plugin::Model* const model = slots[i].model.load(std::memory_order_acquire);
+        if (model == nullptr)
+            continue;
+
+        ModelMemory& modelMemory(models[model]);
+        const int64_t bytes = slots[i].bytes.load(std::memory_order_relaxed);
+
+        if (slots[i].module.load(std::memory_order_acquire) != nullptr)
+        {
+            ++modelMemory.instances;
+            modelMemory.bytes += bytes;
+        }
+        else
+        {
+            modelMemory.leftBytes += bytes;
+        }
+    }
+
+    std::vector<std::pair<const rack::plugin::Model*, ModelMemory>> sorted(models.begin(), models.end());
+    std::stable_sort(sorted.begin(), sorted.end(), [](const std::pair<const rack::plugin::Model*, ModelMemory>& a,
+                                                      const std::pair<const rack::plugin::Model*, ModelMemory>& b) {
+        return a.second.bytes + a.second.leftBytes > b.second.bytes + b.second.leftBytes;
+    });
+
+    json_t* const modelsJ = json_array();
+
+    for (const std::pair<const rack::plugin::Model*, ModelMemory>& model : sorted)
+    {
+        json_t* const modelJ = json_object();
+        json_object_set_new(modelJ, "plugin", json_string(model.first->plugin->slug.c_str()));
+        json_object_set_new(modelJ, "model", json_string(model.first->slug.c_str()));
+        json_object_set_new(modelJ, "instances", json_integer(model.second.instances));
+        json_object_set_new(modelJ, "bytes", json_integer(model.second.bytes));
+        json_object_set_new(modelJ, "leftBytes", json_integer(model.second.leftBytes));
+        json_array_append_new(modelsJ, modelJ);
+    }
+
+    return modelsJ;
+}
+
+}
+
+#ifdef CARDINAL_MODULE_MEMORY_HOOKS
+
+// Interposed allocator calls, forwarding to the glibc implementations.
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+
+__attribute__((visibility("default")))
+void* malloc(size_t size)
+{
+    void* const ptr = __libc_malloc(size);
+    modulemem::onAllocate(ptr, size, 0);
+    return ptr;
+}
+
+__attribute__((visibility("default")))
+void* calloc(size_t count, size_t size)
+{
+    void* const ptr = __libc_calloc(count, size);
+    modulemem::onAllocate(ptr, count * size, 0);
+    return ptr;
+}
+
+__attribute__((visibility("default")))
+void* realloc(void* ptr, size_t size)
+{
+    // a grown buffer stays with the module that allocated it
+    const uint32_t slot = modulemem::onFree(ptr);
+    void* const newPtr = __libc_realloc(ptr, size);
+    modulemem::onAllocate(newPtr, size, slot);
+    return newPtr;
+}
+
+__attribute__((visibility("default")))
+void* memalign(size_t alignment, size_t size)
+{
+    void* const ptr = __libc_memalign(alignment, size);
+    modulemem::onAllocate(ptr, size, 0);
+    return ptr;
+}
+
+__attribute__((visibility("default")))
+void* aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+__attribute__((visibility("default")))
+int posix_memalign(void** ptr, size_t alignment, size_t size)
+{
+    *ptr = memalign(alignment, size);
+    return *ptr != nullptr || size == 0 ? 0 : ENOMEM;
+}
+
+__attribute__((visibility("default")))
+void free(void* ptr)
+{
+    modulemem::onFree(ptr);
+    __libc_free(ptr);
+}
+
+}
+
+#endif // CARDINAL_MODULE_MEMORY_HOOKS
+
+#endif // CARDINAL_MODULE_MEMORY
@@ -0,0 +1,75 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include <jansson.h>
+
+namespace rack {
+namespace engine {
+struct Module;
+}
+namespace plugin {
+struct Model;
+}
+}
+
+// Heap accounting per module, enabled by building with MODULE_MEMORY=true.
+// Allocations are tagged with the module the calling thread works for, while constructing it, loading its state
+// or processing it, and are taken off the module again when freed, from any thread.
+// Only Linux with glibc can interpose the allocator, and only for the standalone, elsewhere nothing is recorded.
+
+namespace modulemem
+{
+
+#ifdef CARDINAL_MODULE_MEMORY
+// tags allocations of the calling thread with a module of @a model being constructed, until endConstruction()
+void beginConstruction(const rack::plugin::Model* model);
+// gives what was allocated since beginConstruction() to @a module, or drops it if construction failed
+void endConstruction(const rack::engine::Module* module);
+// tags allocations of the calling thread with @a module, or stops tagging if null
+void setModule(const rack::engine::Module* module);
+// forgets a deleted module, memory it did not free stays with its model
+void removeModule(const rack::engine::Module* module);
+// bytes allocated for @a module and not freed yet
+int64_t getModuleBytes(const rack::engine::Module* module);
+// instances, live bytes and bytes left behind by deleted instances of each model, largest first
+json_t* getModelsJson();
+#else
+static inline void beginConstruction(const rack::plugin::Model*) {}
+static inline void endConstruction(const rack::engine::Module*) {}
+static inline void setModule(const rack::engine::Module*) {}
+static inline void removeModule(const rack::engine::Module*) {}
+static inline int64_t getModuleBytes(const rack::engine::Module*) { return 0; }
+static inline json_t* getModelsJson() { return json_array(); }
+#endif
+
+struct Scope {
+    Scope(const rack::engine::Module* const module)
+    {
+        setModule(module);
+    }
+
+    ~Scope()
+    {
+        setModule(nullptr);
+    }
+};
+
+}
@@ -0,0 +1,193 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include "PerfTrace.hpp"
+
+#ifdef CARDINAL_PERF_TRACE
+
+#include <logger.hpp>
+
+#include "DistrhoUtils.hpp"
+#include "ThreadScheduling.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include <jansson.h>
+
+#if !defined(ARCH_WIN) && !defined(__EMSCRIPTEN__)
+# include <pthread.h>
+#endif
+
+namespace perftrace
+{
+
+struct Event {
+    const char* category;
+    const char* name;
+    double startTime;
+    double duration;
+};
+
+// about 30 seconds of the audio thread with sampled module spans
+static constexpr const uint32_t kEventsPerThread = 1 << 16;
+
+struct ThreadBuffer {
+    std::vector<Event> events;
+    // increased once the event at its position is complete
+    std::atomic<uint64_t> head{0};
+    char threadName[32];
+};
+
+std::atomic<bool> recording{false};
+
+static const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+// Buffers are allocated on the first recording and reused by the next ones, so that recording threads never allocate.
+// Each thread claims a buffer the first time it records during a session.
+static std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+static std::atomic<uint32_t> claimedBuffers{0};
+static std::atomic<uint32_t> session{0};
+
+static thread_local ThreadBuffer* currentBuffer = nullptr;
+static thread_local uint32_t currentSession = 0;
+
+double now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void record(const char* const category, const char* const name, const double startTime)
+{
+    const double endTime = now();
+
+    if (currentSession != session.load(std::memory_order_acquire))
+    {
+        currentSession = session.load(std::memory_order_acquire);
+
+        // threads beyond the buffers allocated for this session are not recorded
+        const uint32_t index = claimedBuffers++;
+        currentBuffer = index < buffers.size() ? buffers[index].get() : nullptr;
+
+        if (currentBuffer != nullptr)
+        {
+           #if defined(ARCH_WIN) || defined(__EMSCRIPTEN__)
+            std::snprintf(currentBuffer->threadName, sizeof(currentBuffer->threadName), "Thread %u", index + 1);
+           #else
+            if (pthread_getname_np(pthread_self(), currentBuffer->threadName, sizeof(currentBuffer->threadName)) != 0
+                || currentBuffer->threadName[0] == '\0')
+                std::snprintf(currentBuffer->threadName, sizeof(currentBuffer->threadName), "Thread %u", index + 1);
+           #endif
+        }
+    }
+
+    if (currentBuffer == nullptr)
+        return;
+
+    const uint64_t head = currentBuffer->head.load(std::memory_order_relaxed);
+    currentBuffer->events[head % kEventsPerThread] = { category, name, startTime, endTime - startTime };
+    currentBuffer->head.store(head + 1, std::memory_order_release);
+}
+
+void start()
+{
+    if (recording)
+        return;
+
+    // the UI, audio and screenshot threads besides one per core, as engine workers
+    const size_t bufferCount = threadsched::getCpuCount() + 4;
+
+    while (buffers.size() < bufferCount)
+    {
+        buffers.emplace_back(new ThreadBuffer);
+        buffers.back()->events.resize(kEventsPerThread);
+    }
+
+    for (const std::unique_ptr<ThreadBuffer>& buffer : buffers)
+        buffer->head = 0;
+
+    claimedBuffers = 0;
+    ++session;
+    recording.store(true, std::memory_order_release);
+
+    INFO("Started performance trace");
+}
+
+void stop(const char* const path)
+{
+    if (! recording)
+        return;
+
+    recording = false;
+
+    json_t* const eventsJ = json_array();
+    const uint32_t threadCount = std::min<uint32_t>(claimedBuffers, buffers.size());
+    size_t eventCount = 0;
+
+    for (uint32_t t = 0; t < threadCount; ++t)
+    {
+        const ThreadBuffer& buffer(*buffers[t]);
+
+        json_t* const nameJ = json_object();
+        json_object_set_new(nameJ, "name", json_string("thread_name"));
+        json_object_set_new(nameJ, "ph", json_string("M"));
+        json_object_set_new(nameJ, "pid", json_integer(1));
+        json_object_set_new(nameJ, "tid", json_integer(t + 1));
+        json_object_set_new(nameJ, "args", json_pack("{ss}", "name", buffer.threadName));
+        json_array_append_new(eventsJ, nameJ);
+
+        // a span still being recorded as recording stopped may be overwriting the oldest one, so it is skipped
+        const uint64_t head = buffer.head.load(std::memory_order_acquire);
+        const uint64_t first = head >= kEventsPerThread ? head - kEventsPerThread + 1 : 0;
+
+        for (uint64_t i = first; i < head; ++i)
+        {
+            const Event& event(buffer.events[i % kEventsPerThread]);
+
+            json_t* const eventJ = json_object();
+            json_object_set_new(eventJ, "name", json_string(event.name));
+            json_object_set_new(eventJ, "cat", json_string(event.category));
+            json_object_set_new(eventJ, "ph", json_string("X"));
+            json_object_set_new(eventJ, "ts", json_real(event.startTime * 1e6));
+            json_object_set_new(eventJ, "dur", json_real(event.duration * 1e6));
+            json_object_set_new(eventJ, "pid", json_integer(1));
+            json_object_set_new(eventJ, "tid", json_integer(t + 1));
+            json_array_append_new(eventsJ, eventJ);
+        }
+
+        eventCount += head - first;
+    }
+
+    json_t* const rootJ = json_object();
+    json_object_set_new(rootJ, "traceEvents", eventsJ);
+    json_object_set_new(rootJ, "displayTimeUnit", json_string("ms"));
+
+    if (json_dump_file(rootJ, path, JSON_COMPACT) != 0)
+        d_stderr2("Failed to write performance trace to %s", path);
+    else
+        INFO("Wrote performance trace of %d events over %u threads to %s",
+             static_cast<int>(eventCount), threadCount, path);
+
+    json_decref(rootJ);
+}
+
+}
+
+#endif // CARDINAL_PERF_TRACE
@@ -0,0 +1,65 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+// Performance timeline, enabled by building with PERF_TRACE=true and recorded on demand from the Engine menu.
+// Each thread records its spans into its own ring buffer without locking, keeping the last few seconds of activity.
+// The recording is written as a Chrome trace (viewable in chrome://tracing or Perfetto) when stopped.
+// Names and categories are kept by pointer, they must outlive the recording (string literals or model slugs).
+
+#ifdef CARDINAL_PERF_TRACE
+# include <atomic>
+#endif
+
+namespace perftrace
+{
+
+#ifdef CARDINAL_PERF_TRACE
+extern std::atomic<bool> recording;
+
+static inline bool isRecording() { return recording.load(std::memory_order_relaxed); }
+double now();
+void record(const char* category, const char* name, double startTime);
+void start();
+void stop(const char* path);
+#else
+static inline bool isRecording() { return false; }
+static inline double now() { return 0.0; }
+static inline void record(const char*, const char*, double) {}
+static inline void start() {}
+static inline void stop(const char*) {}
+#endif
+
+struct Scope {
+    const char* const category;
+    const char* const name;
+    const double startTime;
+
+    Scope(const char* const c, const char* const n, const bool enabled = true)
+        : category(c),
+          name(n),
+          startTime(enabled && isRecording() ? now() : -1.0) {}
+
+    ~Scope()
+    {
+        if (startTime >= 0.0)
+            record(category, name, startTime);
+    }
+};
+
+}
@@ -30,8 +30,16 @@
 
 #ifndef HEADLESS
 # include "DistrhoUI.hpp"
+
+namespace rack {
+namespace widget {
+struct Widget;
+}
+}
 #endif
 
+#include <vector>
+
 START_NAMESPACE_DISTRHO
 
 // -----------------------------------------------------------------------------------------------------------
@@ -48,10 +56,21 @@ enum CardinalVariant {
 
 // -----------------------------------------------------------------------------------------------------------
 
+// idle callbacks of the same priority take turns within the time budget of an idle tick
+enum CardinalIdlePriority {
+    kIdlePriorityLow = -1,
+    kIdlePriorityNormal = 0,
+    kIdlePriorityHigh = 1,
+};
+
+// -----------------------------------------------------------------------------------------------------------
+
 struct CardinalPluginContext : rack::Context {
-    uint32_t bufferSize, processCounter;
+    uint32_t bufferSize, processCounter, oversampling;
     double sampleRate;
     float parameters[kModuleParameters];
+    // bit per parameter changed by the host since the previous engine block, set when the block starts
+    uint32_t parametersChangedMask;
     CardinalVariant variant;
     bool bypassed, playing, reset, bbtValid;
     int32_t bar, beat, beatsPerBar, beatType;
@@ -61,8 +80,16 @@ struct CardinalPluginContext : rack::Context {
     uintptr_t nativeWindowId;
     const float* const* dataIns;
     float** dataOuts;
+    uint32_t dataInsUsed, dataOutsWritten;
     const MidiEvent* midiEvents;
     uint32_t midiEventCount;
+    // host MIDI events of the block per channel filter, [0] for all channels and [1-16] for a single one.
+    // system messages are part of every channel. null when the block had too many events to bucket.
+    const MidiEvent* const* midiChannelEvents[17];
+    uint32_t midiChannelEventCount[17];
+    // MIDI output of the current block, sent to the host at the end of run() when the plugin provides storage
+    MidiEvent* midiOutEvents;
+    uint32_t midiOutEventCount, midiOutEventCapacity, midiOutFrameOffset;
     Plugin* const plugin;
 #ifndef HEADLESS
     NanoTopLevelWidget* tlw;
@@ -72,7 +99,9 @@ struct CardinalPluginContext : rack::Context {
     CardinalPluginContext(Plugin* const p)
         : bufferSize(p != nullptr ? p->getBufferSize() : 0),
           processCounter(0),
+          oversampling(1),
           sampleRate(p != nullptr ? p->getSampleRate() : 0.0),
+          parametersChangedMask(0),
          #if CARDINAL_VARIANT_MAIN
           variant(kCardinalVariantMain),
          #elif CARDINAL_VARIANT_MINI
@@ -105,8 +134,14 @@ struct CardinalPluginContext : rack::Context {
           nativeWindowId(0),
           dataIns(nullptr),
           dataOuts(nullptr),
+          dataInsUsed(0),
+          dataOutsWritten(0),
           midiEvents(nullptr),
           midiEventCount(0),
+          midiOutEvents(nullptr),
+          midiOutEventCount(0),
+          midiOutEventCapacity(0),
+          midiOutFrameOffset(0),
           plugin(p)
 #ifndef HEADLESS
         , tlw(nullptr)
@@ -114,12 +149,18 @@ struct CardinalPluginContext : rack::Context {
 #endif
     {
         std::memset(parameters, 0, sizeof(parameters));
+        std::memset(midiChannelEvents, 0, sizeof(midiChannelEvents));
+        std::memset(midiChannelEventCount, 0, sizeof(midiChannelEventCount));
     }
 
     void writeMidiMessage(const rack::midi::Message& message, uint8_t channel);
 
 #ifndef HEADLESS
+    // called on every idle tick, with normal priority
     bool addIdleCallback(IdleCallback* cb) const;
+    // called up to rate times per second, 0 for every idle tick.
+    // when widget is not null, the callback is called less often while the widget is hidden or off screen
+    bool addIdleCallback(IdleCallback* cb, double rate, int priority, rack::widget::Widget* widget) const;
     void removeIdleCallback(IdleCallback* cb) const;
 #endif
 };
@@ -141,12 +182,42 @@ public:
           context(new CardinalPluginContext(this)) {}
     ~CardinalBasePlugin() override {}
 
+#ifndef HEADLESS
+    // called by the UI on every idle tick, for patch changes that must not happen while the UI is in use
+    virtual void uiIdle() {}
+#endif
+
 #ifndef HEADLESS
     friend class CardinalUI;
 #endif
 };
 
 #ifndef HEADLESS
+// Single UI idle callback running those registered through CardinalPluginContext::addIdleCallback.
+// Due callbacks run by priority and then by how long they have been due, until the idle tick uses up its time budget.
+// Those left over are due first on the next tick, so each one gets its turn even while the budget is exceeded.
+class CardinalIdleScheduler : public IdleCallback {
+public:
+    void add(IdleCallback* cb, double rate, int priority, rack::widget::Widget* widget);
+    void remove(IdleCallback* cb);
+
+protected:
+    void idleCallback() override;
+
+private:
+    struct Entry {
+        IdleCallback* callback;
+        double interval;
+        int priority;
+        rack::widget::Widget* widget;
+        double nextTime;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<size_t> due;
+    bool dispatching = false;
+};
+
 struct WasmRemotePatchLoadingDialog;
 
 class CardinalBaseUI : public UI {
@@ -163,6 +234,9 @@ public:
     std::function<void(char* path)> filebrowseraction;
     FileBrowserHandle filebrowserhandle;
 
+    // idle callbacks of modules, see CardinalPluginContext::addIdleCallback
+    CardinalIdleScheduler idleScheduler;
+
     CardinalBaseUI(const uint width, const uint height)
         : UI(width, height),
          #if DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
@@ -180,10 +254,14 @@ public:
     {
         context->tlw = this;
         context->ui = this;
+
+        addIdleCallback(&idleScheduler);
     }
 
     ~CardinalBaseUI() override
     {
+        removeIdleCallback(&idleScheduler);
+
         if (filebrowserhandle != nullptr)
             fileBrowserClose(filebrowserhandle);
 
@@ -0,0 +1,254 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include "RealTimeAudit.hpp"
+
+#ifdef CARDINAL_RT_AUDIT
+
+#include <engine/Module.hpp>
+#include <plugin/Model.hpp>
+#include <plugin/Plugin.hpp>
+#include <logger.hpp>
+
+#include "DistrhoUtils.hpp"
+
+#include <atomic>
+#include <cstdio>
+
+#if defined(ARCH_LIN) && defined(__GLIBC__)
+# define CARDINAL_RT_AUDIT_HOOKS
+# include <dlfcn.h>
+# include <pthread.h>
+#endif
+
+namespace rtaudit
+{
+
+enum Violation {
+    kViolationAlloc,
+    kViolationFree,
+    kViolationLock,
+    kViolationFile,
+    kViolationCount
+};
+
+static const char* const kViolationNames[kViolationCount] = {
+    "allocation",
+    "free",
+    "mutex lock",
+    "file open",
+};
+
+// Fixed size table of violation counts per model, filled without allocating from any audio thread.
+// Entries are keyed by model, the engine itself (outside of any module) uses the address of the table.
+struct Entry {
+    std::atomic<const void*> key;
+    std::atomic<uint32_t> counts[kViolationCount];
+};
+
+static constexpr const uint32_t kTableSize = 4096;
+static Entry table[kTableSize];
+static std::atomic<uint32_t> droppedViolations{0};
+
+static thread_local bool auditing = false;
+static thread_local bool recording = false;
+static thread_local const rack::plugin::Model* currentModel = nullptr;
+
+static void record(const Violation violation)
+{
+    if (!auditing || recording)
+        return;
+
+    recording = true;
+
+    const void* const key = currentModel != nullptr ? static_cast<const void*>(currentModel) : table;
+    uint32_t index = (reinterpret_cast<uintptr_t>(key) >> 4) % kTableSize;
+
+    for (uint32_t i = 0; i < kTableSize; ++i, index = (index + 1) % kTableSize)
+    {
+        const void* expected = nullptr;
+
+        if (table[index].key.compare_exchange_strong(expected, key) || expected == key)
+        {
+            table[index].counts[violation].fetch_add(1, std::memory_order_relaxed);
+            recording = false;
+            return;
+        }
+    }
+
+    ++droppedViolations;
+    recording = false;
+}
+
+void enter()
+{
+    currentModel = nullptr;
+    auditing = true;
+}
+
+void leave()
+{
+    auditing = false;
+    currentModel = nullptr;
+}
+
+void setModule(const rack::engine::Module* const module)
+{
+    currentModel = module != nullptr ? module->model : nullptr;
+}
+
+void writeReport(const char* const path)
+{
+    FILE* const f = std::fopen(path, "w");
+    DISTRHO_SAFE_ASSERT_RETURN(f != nullptr,);
+
+    std::fprintf(f, "# Real-time safety violations while stepping the engine\n");
+    std::fprintf(f, "# model");
+    for (int v = 0; v < kViolationCount; ++v)
+        std::fprintf(f, ", %s", kViolationNames[v]);
+    std::fprintf(f, "\n");
+
+    uint32_t offenders = 0;
+
+    for (uint32_t i = 0; i < kTableSize; ++i)
+    {
+        const Entry& entry(table[i]);
+        const void* const key = entry.key.load();
+
+        if (key == nullptr)
+            continue;
+
+        if (key != table)
+        {
+            const rack::plugin::Model* const model = static_cast<const rack::plugin::Model*>(key);
+            std::fprintf(f, "%s/%s", model->plugin->slug.c_str(), model->slug.c_str());
+        }
+        else
+        {
+            std::fprintf(f, "(engine)");
+        }
+
+        for (int v = 0; v < kViolationCount; ++v)
+            std::fprintf(f, ", %u", entry.counts[v].load(std::memory_order_relaxed));
+        std::fprintf(f, "\n");
+
+        ++offenders;
+    }
+
+    if (const uint32_t dropped = droppedViolations)
+        std::fprintf(f, "# %u violations were not recorded, the table is full\n", dropped);
+
+    std::fclose(f);
+
+    INFO("Real-time audit found %u offending models, report written to %s", offenders, path);
+}
+
+}
+
+#ifdef CARDINAL_RT_AUDIT_HOOKS
+
+// Interposed libc calls, forwarding to the real implementations.
+// Functions that glibc does not export under a private name are looked up once when loading,
+// so that no lookup can happen while auditing.
+
+typedef int (*PthreadMutexLockFunc)(pthread_mutex_t*);
+typedef FILE* (*FopenFunc)(const char*, const char*);
+
+static PthreadMutexLockFunc realPthreadMutexLock = nullptr;
+static FopenFunc realFopen = nullptr;
+static FopenFunc realFopen64 = nullptr;
+
+__attribute__((constructor))
+static void initRealFunctions()
+{
+    realPthreadMutexLock = reinterpret_cast<PthreadMutexLockFunc>(dlsym(RTLD_NEXT, "pthread_mutex_lock"));
+    realFopen = reinterpret_cast<FopenFunc>(dlsym(RTLD_NEXT, "fopen"));
+    realFopen64 = reinterpret_cast<FopenFunc>(dlsym(RTLD_NEXT, "fopen64"));
+}
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+
+__attribute__((visibility("default")))
+void* malloc(size_t size)
+{
+    rtaudit::record(rtaudit::kViolationAlloc);
+    return __libc_malloc(size);
+}
+
+__attribute__((visibility("default")))
+void* calloc(size_t count, size_t size)
+{
+    rtaudit::record(rtaudit::kViolationAlloc);
+    return __libc_calloc(count, size);
+}
+
+__attribute__((visibility("default")))
+void* realloc(void* ptr, size_t size)
+{
+    rtaudit::record(rtaudit::kViolationAlloc);
+    return __libc_realloc(ptr, size);
+}
+
+__attribute__((visibility("default")))
+void free(void* ptr)
+{
+    if (ptr != nullptr)
+        rtaudit::record(rtaudit::kViolationFree);
+    __libc_free(ptr);
+}
+
+__attribute__((visibility("default")))
+int pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+    // may be called before the constructor above
+    if (realPthreadMutexLock == nullptr)
+        initRealFunctions();
+
+    rtaudit::record(rtaudit::kViolationLock);
+    return realPthreadMutexLock(mutex);
+}
+
+__attribute__((visibility("default")))
+FILE* fopen(const char* path, const char* mode)
+{
+    if (realFopen == nullptr)
+        initRealFunctions();
+
+    rtaudit::record(rtaudit::kViolationFile);
+    return realFopen(path, mode);
+}
+
+__attribute__((visibility("default")))
+FILE* fopen64(const char* path, const char* mode)
+{
+    if (realFopen64 == nullptr)
+        initRealFunctions();
+
+    rtaudit::record(rtaudit::kViolationFile);
+    return realFopen64(path, mode);
+}
+
+}
+
+#endif // CARDINAL_RT_AUDIT_HOOKS
+
+#endif // CARDINAL_RT_AUDIT
@@ -0,0 +1,46 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+namespace rack {
+namespace engine {
+struct Module;
+}
+}
+
+// Real-time safety audit, enabled by building with RT_AUDIT=true.
+// While a thread steps the engine, memory allocations, mutex locks and file opens are recorded
+// against the module being processed, and written as a report when an engine is destroyed.
+// Only Linux with glibc can interpose these calls, elsewhere nothing is recorded.
+
+namespace rtaudit
+{
+
+#ifdef CARDINAL_RT_AUDIT
+void enter();
+void leave();
+void setModule(const rack::engine::Module* module);
+void writeReport(const char* path);
+#else
+static inline void enter() {}
+static inline void leave() {}
+static inline void setModule(const rack::engine::Module*) {}
+static inline void writeReport(const char*) {}
+#endif
+
+}
@@ -0,0 +1,313 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include "ResourcePack.hpp"
+
+#include <logger.hpp>
+#include <string.hpp>
+#include <system.hpp>
+
+#include "DistrhoUtils.hpp"
+
+#include <cstring>
+#include <initializer_list>
+#include <string_view>
+#include <unordered_map>
+
+#ifdef ARCH_WIN
+# include <windows.h>
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+// Pack layout, all values little-endian:
+//  header: char magic[4] = "CRPK", uint32 version, uint32 count, uint32 reserved
+//  count index records: uint64 offset, uint64 size, int64 mtime, uint32 nameLength, uint32 reserved,
+//                       followed by the name (relative to the pack location) padded to 8 bytes
+//  file contents, each padded to 8 bytes
+// A pack can also be embedded in another file, like the self-extracting standalone packages:
+//  the pack, followed by char magic[8] = "CRPKEMBD", uint64 offset of the pack within the file,
+//  either at the end of the file or right before a zip archive appended after it
+
+namespace respack
+{
+
+static constexpr const uint32_t kVersion = 1;
+
+struct Pack {
+    const uint8_t* mapped = nullptr;
+    size_t mappedSize = 0;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+   #ifdef ARCH_WIN
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+   #endif
+    std::string root;
+    std::unordered_map<std::string_view, Entry> entries;
+};
+
+static Pack pack;
+
+static inline uint32_t read32(const uint8_t* const p)
+{
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+static inline uint64_t read64(const uint8_t* const p)
+{
+    return uint64_t(read32(p)) | uint64_t(read32(p + 4)) << 32;
+}
+
+static bool map(const std::string& filename)
+{
+   #ifdef ARCH_WIN
+    pack.file = CreateFileW(rack::string::UTF8toUTF16(filename).c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (pack.file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(pack.file, &size) == 0 || size.QuadPart == 0)
+        return false;
+
+    pack.mapping = CreateFileMappingW(pack.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (pack.mapping == nullptr)
+        return false;
+
+    pack.mapped = static_cast<const uint8_t*>(MapViewOfFile(pack.mapping, FILE_MAP_READ, 0, 0, 0));
+    pack.mappedSize = size.QuadPart;
+    return pack.mapped != nullptr;
+   #else
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void* const data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+        return false;
+
+    pack.mapped = static_cast<const uint8_t*>(data);
+    pack.mappedSize = st.st_size;
+    return true;
+   #endif
+}
+
+static void unmap()
+{
+   #ifdef ARCH_WIN
+    if (pack.mapped != nullptr)
+        UnmapViewOfFile(pack.mapped);
+    if (pack.mapping != nullptr)
+        CloseHandle(pack.mapping);
+    if (pack.file != INVALID_HANDLE_VALUE)
+        CloseHandle(pack.file);
+    pack.mapping = nullptr;
+    pack.file = INVALID_HANDLE_VALUE;
+   #else
+    if (pack.mapped != nullptr)
+        munmap(const_cast<uint8_t*>(pack.mapped), pack.mappedSize);
+   #endif
+
+    pack.mapped = nullptr;
+    pack.mappedSize = 0;
+    pack.data = nullptr;
+    pack.size = 0;
+}
+
+static bool findEmbedded(const uint8_t* const data, const size_t size, size_t& offset)
+{
+    // the embedding trailer, checked before a zip archive first
+    size_t end = size;
+
+    // zip end of central directory record, within the last 64KiB in case of an archive comment
+    if (size >= 22)
+    {
+        const size_t first = size > 22 + 0xffff ? size - 22 - 0xffff : 0;
+
+        for (size_t pos = size - 22 + 1; pos-- > first;)
+        {
+            if (std::memcmp(data + pos, "PK\x05\x06", 4) != 0)
+                continue;
+
+            // central directory size and offset, relative to the start of the archive
+            const uint64_t directory = uint64_t(read32(data + pos + 12)) + read32(data + pos + 16);
+            if (directory <= pos)
+                end = pos - directory;
+            break;
+        }
+    }
+
+    for (const size_t trailer : { end, size })
+    {
+        if (trailer < 32 || std::memcmp(data + trailer - 16, "CRPKEMBD", 8) != 0)
+            continue;
+
+        offset = read64(data + trailer - 8);
+        if (offset < trailer - 16)
+            return true;
+    }
+
+    return false;
+}
+
+static bool load(const std::string& filename, const bool embedded)
+{
+    if (! rack::system::isFile(filename))
+        return false;
+
+    if (! map(filename))
+    {
+        d_stderr2("Failed to map resource pack %s", filename.c_str());
+        unmap();
+        return false;
+    }
+
+    size_t offset = 0;
+    if (embedded && ! findEmbedded(pack.mapped, pack.mappedSize, offset))
+    {
+        unmap();
+        return false;
+    }
+
+    pack.data = pack.mapped + offset;
+    pack.size = pack.mappedSize - offset;
+
+    const uint8_t* const data = pack.data;
+    const size_t size = pack.size;
+
+    if (size < 16 || std::memcmp(data, "CRPK", 4) != 0 || read32(data + 4) != kVersion)
+    {
+        d_stderr2("Resource pack %s is invalid or of another version", filename.c_str());
+        unmap();
+        return false;
+    }
+
+    const uint32_t count = read32(data + 8);
+    pack.entries.reserve(count);
+
+    size_t pos = 16;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (pos + 32 > size)
+            break;
+
+        const uint64_t offset = read64(data + pos);
+        const uint64_t length = read64(data + pos + 8);
+        const int64_t mtime = static_cast<int64_t>(read64(data + pos + 16));
+        const uint32_t nameLength = read32(data + pos + 24);
+        pos += 32;
+
+        if (pos + nameLength > size || offset > size || length > size - offset)
+            break;
+
+        const std::string_view name(reinterpret_cast<const char*>(data + pos), nameLength);
+        pack.entries.emplace(name, Entry{ data + offset, static_cast<size_t>(length), mtime });
+
+        pos += (nameLength + 7) & ~7u;
+    }
+
+    if (pack.entries.size() != count)
+    {
+        d_stderr2("Resource pack %s is truncated", filename.c_str());
+        close();
+        return false;
+    }
+
+    INFO("Mapped resource pack %s with %u files", filename.c_str(), count);
+    return true;
+}
+
+bool open(const std::string& filename)
+{
+    close();
+
+    if (! load(filename, false))
+        return false;
+
+    pack.root = rack::system::getDirectory(filename);
+    return true;
+}
+
+bool openEmbedded(const std::string& filename, const std::string& root)
+{
+    close();
+
+    if (! load(filename, true))
+        return false;
+
+    pack.root = root;
+    return true;
+}
+
+void close()
+{
+    pack.entries.clear();
+    pack.root.clear();
+    unmap();
+}
+
+const Entry* find(const char* const filename)
+{
+    if (pack.entries.empty() || filename == nullptr)
+        return nullptr;
+
+    const std::string& root(pack.root);
+    const size_t rootLength = root.size();
+
+    if (std::strncmp(filename, root.c_str(), rootLength) != 0 || (filename[rootLength] != '/' && filename[rootLength] != '\\'))
+        return nullptr;
+
+    const char* const relative = filename + rootLength + 1;
+    std::string_view name(relative);
+
+    // paths may come with backslashes or "./" segments, like the forced black and silver screws
+    std::string normalized;
+    if (name.find('\\') != std::string_view::npos || name.find("./") != std::string_view::npos)
+    {
+        normalized.reserve(name.size());
+        for (size_t i = 0; i < name.size(); ++i)
+        {
+            const char c = name[i] == '\\' ? '/' : name[i];
+            if (c == '.' && (i == 0 || normalized.empty() || normalized.back() == '/')
+                && i + 1 < name.size() && (name[i + 1] == '/' || name[i + 1] == '\\'))
+            {
+                ++i;
+                continue;
+            }
+            normalized += c;
+        }
+        name = normalized;
+    }
+
+    const auto it = pack.entries.find(name);
+    return it != pack.entries.end() ? &it->second : nullptr;
+}
+
+}
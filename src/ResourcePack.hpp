@@ -0,0 +1,47 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Panel, image and font resources packed into a single file by deps/respack.py, memory-mapped once.
+// Loaders look files up by their full path and only touch the filesystem for files not in the pack.
+// The pack is opened and closed by the Initializer, lookups are safe from any thread in between.
+
+namespace respack
+{
+
+struct Entry {
+    const uint8_t* data;
+    size_t size;
+    int64_t mtime;
+};
+
+bool open(const std::string& filename);
+
+// opens a pack embedded in another file by deps/respack.py, entry names are relative to root
+bool openEmbedded(const std::string& filename, const std::string& root);
+
+void close();
+
+// returns null if the file is not in the pack
+const Entry* find(const char* filename);
+
+}
@@ -0,0 +1,200 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include "ScriptRuntime.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace jsruntime
+{
+
+// contexts per runtime before another one is created, modules sharing a runtime wait on each other
+static constexpr const uint32_t kContextsPerRuntime = 16;
+
+// cached bytecode is dropped as a whole past this size, scripts are recompiled as they are loaded again
+static constexpr const size_t kMaxCacheSize = 32 * 1024 * 1024;
+
+struct Runtime {
+    JSRuntime* rt = nullptr;
+    std::mutex mutex;
+    uint32_t contexts = 0;
+};
+
+struct Pool {
+    std::mutex mutex;
+    std::vector<Runtime*> runtimes;
+};
+
+struct Cache {
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<const std::vector<uint8_t>>> scripts;
+    size_t size = 0;
+};
+
+static Pool pool;
+static Cache cache;
+
+static inline Runtime* getRuntime(JSContext* const ctx)
+{
+    return static_cast<Runtime*>(JS_GetRuntimeOpaque(JS_GetRuntime(ctx)));
+}
+
+JSContext* newContext()
+{
+    const std::lock_guard<std::mutex> lock(pool.mutex);
+
+    Runtime* runtime = nullptr;
+    for (Runtime* const r : pool.runtimes)
+    {
+        if (r->contexts < kContextsPerRuntime && (runtime == nullptr || r->contexts < runtime->contexts))
+            runtime = r;
+    }
+
+    if (runtime == nullptr)
+    {
+        JSRuntime* const rt = JS_NewRuntime();
+        if (rt == nullptr)
+            return nullptr;
+
+        // the stack limit is taken from the thread creating the runtime, meaningless once shared between threads
+        JS_SetMaxStackSize(rt, 0);
+
+        runtime = new Runtime;
+        runtime->rt = rt;
+        JS_SetRuntimeOpaque(rt, runtime);
+        pool.runtimes.push_back(runtime);
+    }
+
+    JSContext* ctx;
+    {
+        const std::lock_guard<std::mutex> rlock(runtime->mutex);
+        ctx = JS_NewContext(runtime->rt);
+    }
+
+    if (ctx != nullptr)
+        ++runtime->contexts;
+
+    if (runtime->contexts == 0)
+    {
+        pool.runtimes.erase(std::find(pool.runtimes.begin(), pool.runtimes.end(), runtime));
+        JS_FreeRuntime(runtime->rt);
+        delete runtime;
+    }
+
+    return ctx;
+}
+
+void freeContext(JSContext* const ctx)
+{
+    if (ctx == nullptr)
+        return;
+
+    const std::lock_guard<std::mutex> lock(pool.mutex);
+
+    Runtime* const runtime = getRuntime(ctx);
+    {
+        const std::lock_guard<std::mutex> rlock(runtime->mutex);
+        JS_FreeContext(ctx);
+    }
+
+    // runtimes go away with their last context, so an idle patch keeps no engine memory around
+    if (--runtime->contexts == 0)
+    {
+        pool.runtimes.erase(std::find(pool.runtimes.begin(), pool.runtimes.end(), runtime));
+        JS_FreeRuntime(runtime->rt);
+        delete runtime;
+    }
+}
+
+Lock::Lock(JSContext* const ctx)
+    : mutex(getRuntime(ctx)->mutex)
+{
+    mutex.lock();
+}
+
+Lock::~Lock()
+{
+    mutex.unlock();
+}
+
+JSValue eval(JSContext* const ctx, const char* const source, const size_t length, const char* const filename, const int flags)
+{
+    if (flags & JS_EVAL_FLAG_COMPILE_ONLY)
+        return JS_Eval(ctx, source, length, filename, flags);
+
+    // same source evaluated differently compiles differently, the flags are part of the key
+    std::string key(source, length);
+    key += '\0';
+    key += std::to_string(flags);
+
+    std::shared_ptr<const std::vector<uint8_t>> bytecode;
+    {
+        const std::lock_guard<std::mutex> lock(cache.mutex);
+        const auto it = cache.scripts.find(key);
+        if (it != cache.scripts.end())
+            bytecode = it->second;
+    }
+
+    if (bytecode != nullptr)
+    {
+        const JSValue function = JS_ReadObject(ctx, bytecode->data(), bytecode->size(), JS_READ_OBJ_BYTECODE);
+        if (! JS_IsException(function))
+            return JS_EvalFunction(ctx, function);
+
+        // unreadable from this runtime somehow, compile as usual
+        JS_FreeValue(ctx, JS_GetException(ctx));
+    }
+
+    const JSValue function = JS_Eval(ctx, source, length, filename, flags | JS_EVAL_FLAG_COMPILE_ONLY);
+    if (JS_IsException(function))
+        return function;
+
+    size_t size = 0;
+    if (uint8_t* const data = JS_WriteObject(ctx, &size, function, JS_WRITE_OBJ_BYTECODE))
+    {
+        const std::shared_ptr<const std::vector<uint8_t>> compiled(new std::vector<uint8_t>(data, data + size));
+        js_free(ctx, data);
+
+        const std::lock_guard<std::mutex> lock(cache.mutex);
+
+        if (cache.size + key.size() + size > kMaxCacheSize)
+        {
+            cache.scripts.clear();
+            cache.size = 0;
+        }
+
+        if (cache.scripts.emplace(key, compiled).second)
+            cache.size += key.size() + size;
+    }
+
+    // takes ownership of the function
+    return JS_EvalFunction(ctx, function);
+}
+
+void clearCache()
+{
+    const std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.scripts.clear();
+    cache.size = 0;
+}
+
+}
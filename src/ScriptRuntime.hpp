@@ -0,0 +1,52 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include <quickjs.h>
+
+#include <cstddef>
+#include <mutex>
+
+// QuickJS runtimes shared by all scripting modules of the process, instead of one runtime per module instance.
+// A runtime is single-threaded, so contexts taken from the pool are only used while holding a Lock on them.
+// Scripts are compiled once per process, later evaluations of the same source read the cached bytecode.
+
+namespace jsruntime
+{
+
+// new context on a pooled runtime, must be released with freeContext.
+// neither may be called while holding a Lock, they take the pool lock before the runtime one
+JSContext* newContext();
+void freeContext(JSContext* ctx);
+
+// serializes use of the runtime a context belongs to, other modules may be using it from another thread
+struct Lock {
+    explicit Lock(JSContext* ctx);
+    ~Lock();
+
+private:
+    std::mutex& mutex;
+};
+
+// same as JS_Eval, with the compiled bytecode cached by source and flags, needs a Lock on the context
+JSValue eval(JSContext* ctx, const char* source, size_t length, const char* filename, int flags);
+
+// drops all cached bytecode, contexts in use are not affected
+void clearCache();
+
+}
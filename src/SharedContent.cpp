@@ -0,0 +1,214 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include <helpers.hpp>
+#include <logger.hpp>
+#include <string.hpp>
+#include <system.hpp>
+
+#include <condition_variable>
+#include <mutex>
+
+#ifdef ARCH_WIN
+# include <windows.h>
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+namespace rack {
+namespace sharedcontent {
+
+// only weak references are kept, data is freed along with its last user
+struct Entry {
+    std::weak_ptr<const void> data;
+    bool loading = false;
+};
+
+static std::mutex mutex;
+static std::condition_variable loadedCondition;
+static std::unordered_map<std::string, Entry> entries;
+
+std::shared_ptr<const void> getData(const std::string& key, const std::function<std::shared_ptr<const void>()>& load)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    for (;;)
+    {
+        Entry& entry = entries[key];
+
+        if (const std::shared_ptr<const void> data = entry.data.lock())
+            return data;
+
+        if (! entry.loading)
+        {
+            entry.loading = true;
+            break;
+        }
+
+        loadedCondition.wait(lock);
+    }
+
+    lock.unlock();
+
+    std::shared_ptr<const void> data;
+
+    try {
+        data = load();
+    } catch (...) {
+        lock.lock();
+        entries.erase(key);
+        loadedCondition.notify_all();
+        throw;
+    }
+
+    lock.lock();
+
+    // drop whatever was freed meanwhile, the map only grows with the number of data sets in use
+    for (auto it = entries.begin(); it != entries.end();)
+    {
+        if (! it->second.loading && it->second.data.expired())
+            it = entries.erase(it);
+        else
+            ++it;
+    }
+
+    Entry& entry = entries[key];
+    entry.data = data;
+    entry.loading = false;
+    loadedCondition.notify_all();
+
+    return data;
+}
+
+std::string getFileKey(const std::string& path)
+{
+   #ifdef ARCH_WIN
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (GetFileAttributesExW(string::UTF8toUTF16(path).c_str(), GetFileExInfoStandard, &attributes) == 0)
+        return std::string();
+
+    const uint64_t size = uint64_t(attributes.nFileSizeHigh) << 32 | attributes.nFileSizeLow;
+    const uint64_t mtime = uint64_t(attributes.ftLastWriteTime.dwHighDateTime) << 32
+                         | attributes.ftLastWriteTime.dwLowDateTime;
+   #else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return std::string();
+
+    const uint64_t size = st.st_size;
+    const uint64_t mtime = st.st_mtime;
+   #endif
+
+    return string::f("%s:%llu:%llu", system::getCanonical(path).c_str(),
+                     static_cast<unsigned long long>(size), static_cast<unsigned long long>(mtime));
+}
+
+struct FileMapping : MappedFile {
+   #ifdef ARCH_WIN
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+   #endif
+
+    FileMapping()
+    {
+        data = nullptr;
+        size = 0;
+    }
+
+    ~FileMapping()
+    {
+       #ifdef ARCH_WIN
+        if (data != nullptr)
+            UnmapViewOfFile(data);
+        if (mapping != nullptr)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+       #else
+        if (data != nullptr)
+            munmap(const_cast<uint8_t*>(data), size);
+       #endif
+    }
+
+    bool map(const std::string& path)
+    {
+       #ifdef ARCH_WIN
+        file = CreateFileW(string::UTF8toUTF16(path).c_str(), GENERIC_READ, FILE_SHARE_READ,
+                           nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER fileSize;
+        if (GetFileSizeEx(file, &fileSize) == 0 || fileSize.QuadPart == 0)
+            return false;
+
+        mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr)
+            return false;
+
+        data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        size = fileSize.QuadPart;
+        return data != nullptr;
+       #else
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        void* const mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+
+        if (mapped == MAP_FAILED)
+            return false;
+
+        data = static_cast<const uint8_t*>(mapped);
+        size = st.st_size;
+        return true;
+       #endif
+    }
+};
+
+std::shared_ptr<const MappedFile> mapFile(const std::string& path)
+{
+    const std::string key = getFileKey(path);
+    if (key.empty())
+        return nullptr;
+
+    try {
+        return get<MappedFile>(key, [&path]() -> std::shared_ptr<const MappedFile> {
+            const std::shared_ptr<FileMapping> mapping(new FileMapping);
+            if (! mapping->map(path))
+                throw Exception("Could not map %s", path.c_str());
+            return mapping;
+        });
+    } catch (Exception& e) {
+        WARN("%s", e.what());
+        return nullptr;
+    }
+}
+
+}
+}
@@ -0,0 +1,146 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include "StartupTrace.hpp"
+
+#ifdef CARDINAL_STARTUP_TRACE
+
+#include <logger.hpp>
+
+#include "DistrhoUtils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <jansson.h>
+
+namespace startuptrace
+{
+
+struct Event {
+    std::string category;
+    std::string name;
+    double startTime;
+    double duration;
+    int thread;
+};
+
+// time zero is the first use of the trace, which happens as the first Initializer is created
+static const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+static std::mutex mutex;
+static std::vector<Event> events;
+static bool written = false;
+
+static std::atomic<int> nextThread{0};
+static thread_local int currentThread = -1;
+
+double now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void record(const char* const category, const char* const name, const double startTime)
+{
+    const double endTime = now();
+
+    if (currentThread < 0)
+        currentThread = nextThread++;
+
+    const std::lock_guard<std::mutex> lock(mutex);
+
+    // only the cold start is of interest, stop recording once the trace is out
+    if (written)
+        return;
+
+    events.push_back({ category, name, startTime, endTime - startTime, currentThread });
+}
+
+void write(const char* const path)
+{
+    const std::lock_guard<std::mutex> lock(mutex);
+
+    if (written)
+        return;
+
+    written = true;
+
+    json_t* const eventsJ = json_array();
+    std::map<std::string, std::pair<double, int>> categoryTimes;
+    double endTime = 0.0;
+
+    for (const Event& event : events)
+    {
+        json_t* const eventJ = json_object();
+        json_object_set_new(eventJ, "name", json_string(event.name.c_str()));
+        json_object_set_new(eventJ, "cat", json_string(event.category.c_str()));
+        json_object_set_new(eventJ, "ph", json_string("X"));
+        json_object_set_new(eventJ, "ts", json_real(event.startTime * 1e6));
+        json_object_set_new(eventJ, "dur", json_real(event.duration * 1e6));
+        json_object_set_new(eventJ, "pid", json_integer(1));
+        json_object_set_new(eventJ, "tid", json_integer(event.thread));
+        json_array_append_new(eventsJ, eventJ);
+
+        std::pair<double, int>& categoryTime(categoryTimes[event.category]);
+        categoryTime.first += event.duration;
+        ++categoryTime.second;
+
+        endTime = std::max(endTime, event.startTime + event.duration);
+    }
+
+    json_t* const rootJ = json_object();
+    json_object_set_new(rootJ, "traceEvents", eventsJ);
+    json_object_set_new(rootJ, "displayTimeUnit", json_string("ms"));
+
+    if (json_dump_file(rootJ, path, JSON_COMPACT) != 0)
+        d_stderr2("Failed to write startup trace to %s", path);
+
+    json_decref(rootJ);
+
+    INFO("Startup took %.1f ms, %d events traced to %s", endTime * 1000.0, static_cast<int>(events.size()), path);
+
+    for (const auto& categoryTime : categoryTimes)
+        INFO("Startup %s: %.1f ms over %d events", categoryTime.first.c_str(),
+             categoryTime.second.first * 1000.0, categoryTime.second.second);
+
+    // the slowest plugins are what usually need looking at
+    std::vector<const Event*> plugins;
+    for (const Event& event : events)
+        if (event.category == "plugin")
+            plugins.push_back(&event);
+
+    std::sort(plugins.begin(), plugins.end(), [](const Event* const a, const Event* const b) {
+        return a->duration > b->duration;
+    });
+
+    for (size_t i = 0; i < plugins.size() && i < 10; ++i)
+        INFO("Startup slowest plugin #%d: %s %.1f ms", static_cast<int>(i + 1),
+             plugins[i]->name.c_str(), plugins[i]->duration * 1000.0);
+
+    events.clear();
+    events.shrink_to_fit();
+}
+
+}
+
+#endif // CARDINAL_STARTUP_TRACE
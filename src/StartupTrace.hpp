@@ -0,0 +1,53 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+// Startup timeline, enabled by building with STARTUP_TRACE=true.
+// Timed scopes are recorded from any thread until the first window is up, then written as a Chrome trace
+// (viewable in chrome://tracing or Perfetto) and summarized in the log.
+
+namespace startuptrace
+{
+
+#ifdef CARDINAL_STARTUP_TRACE
+double now();
+void record(const char* category, const char* name, double startTime);
+void write(const char* path);
+#else
+static inline double now() { return 0.0; }
+static inline void record(const char*, const char*, double) {}
+static inline void write(const char*) {}
+#endif
+
+struct Scope {
+    const char* const category;
+    const char* const name;
+    const double startTime;
+
+    Scope(const char* const c, const char* const n)
+        : category(c),
+          name(n),
+          startTime(now()) {}
+
+    ~Scope()
+    {
+        record(category, name, startTime);
+    }
+};
+
+}
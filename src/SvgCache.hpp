@@ -0,0 +1,221 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+// Binary form of parsed nanosvg images, shared by the SVG cache in src/custom/dep.cpp and deps/svg2nsvg.cpp.
+// Structs are stored as-is with their pointers fixed on load, the header rejects data written by a different build.
+// nanosvg.h must be included before this file.
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static constexpr const uint32_t kSvgCacheMagic = 0x47565343; // "CSVG"
+static constexpr const uint32_t kSvgCacheVersion = 1;
+static const uint32_t kSvgCacheHeader[] = {
+    kSvgCacheMagic,
+    kSvgCacheVersion,
+    sizeof(NSVGimage),
+    sizeof(NSVGshape),
+    sizeof(NSVGpath),
+    sizeof(NSVGgradient),
+    sizeof(NSVGgradientStop),
+};
+
+// Precompiled SVGs are stored in the resource pack as "<file>.nsvg", next to the file they come from.
+// Layout is this header followed by the serialized image.
+struct SvgPrecompiledHeader {
+    uint32_t cache[sizeof(kSvgCacheHeader)/sizeof(kSvgCacheHeader[0])];
+    float dpi;
+    char units[8];
+};
+
+static inline void svgPrecompiledHeader(SvgPrecompiledHeader& header, const char* const units, const float dpi)
+{
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.cache, kSvgCacheHeader, sizeof(header.cache));
+    std::strncpy(header.units, units, sizeof(header.units) - 1);
+    header.dpi = dpi;
+}
+
+static inline void svgCacheWrite(std::vector<uint8_t>& data, const void* const ptr, const size_t size)
+{
+    const uint8_t* const bytes = static_cast<const uint8_t*>(ptr);
+    data.insert(data.end(), bytes, bytes + size);
+}
+
+static inline size_t svgCacheGradientSize(const NSVGgradient* const gradient)
+{
+    return sizeof(NSVGgradient) + sizeof(NSVGgradientStop) * (gradient->nstops - 1);
+}
+
+static inline bool svgCacheIsGradient(const NSVGpaint& paint)
+{
+    return paint.type == NSVG_PAINT_LINEAR_GRADIENT || paint.type == NSVG_PAINT_RADIAL_GRADIENT;
+}
+
+static inline void svgCacheSerialize(const NSVGimage* const image, std::vector<uint8_t>& data)
+{
+    svgCacheWrite(data, image, sizeof(NSVGimage));
+
+    for (const NSVGshape* shape = image->shapes; shape != nullptr; shape = shape->next)
+    {
+        const uint8_t hasShape = 1;
+        svgCacheWrite(data, &hasShape, 1);
+        svgCacheWrite(data, shape, sizeof(NSVGshape));
+
+        if (svgCacheIsGradient(shape->fill))
+            svgCacheWrite(data, shape->fill.gradient, svgCacheGradientSize(shape->fill.gradient));
+        if (svgCacheIsGradient(shape->stroke))
+            svgCacheWrite(data, shape->stroke.gradient, svgCacheGradientSize(shape->stroke.gradient));
+
+        for (const NSVGpath* path = shape->paths; path != nullptr; path = path->next)
+        {
+            const uint8_t hasPath = 1;
+            svgCacheWrite(data, &hasPath, 1);
+            svgCacheWrite(data, path, sizeof(NSVGpath));
+            svgCacheWrite(data, path->pts, sizeof(float) * 2 * path->npts);
+        }
+
+        const uint8_t endOfPaths = 0;
+        svgCacheWrite(data, &endOfPaths, 1);
+    }
+
+    const uint8_t endOfShapes = 0;
+    svgCacheWrite(data, &endOfShapes, 1);
+}
+
+struct SvgCacheReader {
+    const uint8_t* data;
+    size_t remaining;
+
+    bool read(void* const ptr, const size_t size)
+    {
+        if (size > remaining)
+            return false;
+        std::memcpy(ptr, data, size);
+        data += size;
+        remaining -= size;
+        return true;
+    }
+};
+
+static inline bool svgCacheDeserializeGradient(SvgCacheReader& reader, NSVGpaint& paint)
+{
+    NSVGgradient header;
+    if (! reader.read(&header, sizeof(NSVGgradient)) || header.nstops < 1)
+        return false;
+
+    const size_t size = svgCacheGradientSize(&header);
+    NSVGgradient* const gradient = static_cast<NSVGgradient*>(malloc(size));
+    std::memcpy(gradient, &header, sizeof(NSVGgradient));
+
+    if (! reader.read(reinterpret_cast<uint8_t*>(gradient) + sizeof(NSVGgradient), size - sizeof(NSVGgradient)))
+    {
+        std::free(gradient);
+        return false;
+    }
+
+    paint.gradient = gradient;
+    return true;
+}
+
+// everything is allocated the same way as nanosvg does, so the result can be given to nsvgDelete
+static inline NSVGimage* svgCacheDeserialize(const uint8_t* const data, const size_t size)
+{
+    SvgCacheReader reader = { data, size };
+
+    NSVGimage* const image = static_cast<NSVGimage*>(malloc(sizeof(NSVGimage)));
+    if (! reader.read(image, sizeof(NSVGimage)))
+    {
+        std::free(image);
+        return nullptr;
+    }
+    image->shapes = nullptr;
+
+    NSVGshape** nextShape = &image->shapes;
+
+    for (uint8_t hasShape;;)
+    {
+        if (! reader.read(&hasShape, 1))
+            goto fail;
+        if (hasShape == 0)
+            break;
+
+        NSVGshape* const shape = static_cast<NSVGshape*>(malloc(sizeof(NSVGshape)));
+        if (! reader.read(shape, sizeof(NSVGshape)))
+        {
+            std::free(shape);
+            goto fail;
+        }
+        shape->paths = nullptr;
+        shape->next = nullptr;
+
+        // link the shape only once its paint pointers are valid
+        const bool fillIsGradient = svgCacheIsGradient(shape->fill);
+        const bool strokeIsGradient = svgCacheIsGradient(shape->stroke);
+        const signed char strokeType = shape->stroke.type;
+        shape->stroke.type = NSVG_PAINT_NONE;
+
+        if (fillIsGradient && ! svgCacheDeserializeGradient(reader, shape->fill))
+        {
+            std::free(shape);
+            goto fail;
+        }
+
+        *nextShape = shape;
+        nextShape = &shape->next;
+
+        if (strokeIsGradient && ! svgCacheDeserializeGradient(reader, shape->stroke))
+            goto fail;
+
+        shape->stroke.type = strokeType;
+
+        NSVGpath** nextPath = &shape->paths;
+
+        for (uint8_t hasPath;;)
+        {
+            if (! reader.read(&hasPath, 1))
+                goto fail;
+            if (hasPath == 0)
+                break;
+
+            NSVGpath* const path = static_cast<NSVGpath*>(malloc(sizeof(NSVGpath)));
+            if (! reader.read(path, sizeof(NSVGpath)) || path->npts < 0)
+            {
+                std::free(path);
+                goto fail;
+            }
+
+            path->pts = static_cast<float*>(malloc(sizeof(float) * 2 * path->npts));
+            path->next = nullptr;
+            *nextPath = path;
+            nextPath = &path->next;
+
+            if (! reader.read(path->pts, sizeof(float) * 2 * path->npts))
+                goto fail;
+        }
+    }
+
+    return image;
+
+fail:
+    nsvgDelete(image);
+    return nullptr;
+}
@@ -0,0 +1,158 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include "ThreadScheduling.hpp"
+
+#include "DistrhoUtils.hpp"
+
+#include <algorithm>
+#include <thread>
+
+#if defined(ARCH_WIN)
+# include <windows.h>
+#elif defined(ARCH_MAC)
+# include <pthread.h>
+# include <mach/mach.h>
+# include <mach/mach_time.h>
+# include <mach/thread_policy.h>
+#elif defined(__linux__)
+# include <pthread.h>
+# include <sched.h>
+#endif
+
+namespace threadsched
+{
+
+int getCpuCount()
+{
+    const int count = static_cast<int>(std::thread::hardware_concurrency());
+    return count > 0 ? count : 1;
+}
+
+#if defined(ARCH_WIN)
+// avrt.dll is loaded on first use, so nothing changes for processes that never ask for real-time scheduling
+typedef HANDLE (WINAPI* AvSetMmThreadCharacteristicsWFunc)(LPCWSTR, LPDWORD);
+typedef BOOL (WINAPI* AvRevertMmThreadCharacteristicsFunc)(HANDLE);
+
+static thread_local HANDLE mmcssHandle = nullptr;
+#endif
+
+bool setCurrentThreadRealTime(const bool realTime, const double period)
+{
+   #if defined(ARCH_WIN)
+    static const HMODULE avrt = LoadLibraryA("avrt.dll");
+    if (avrt == nullptr)
+        return false;
+
+    static const AvSetMmThreadCharacteristicsWFunc setCharacteristics =
+        reinterpret_cast<AvSetMmThreadCharacteristicsWFunc>(GetProcAddress(avrt, "AvSetMmThreadCharacteristicsW"));
+    static const AvRevertMmThreadCharacteristicsFunc revertCharacteristics =
+        reinterpret_cast<AvRevertMmThreadCharacteristicsFunc>(GetProcAddress(avrt, "AvRevertMmThreadCharacteristics"));
+    DISTRHO_SAFE_ASSERT_RETURN(setCharacteristics != nullptr && revertCharacteristics != nullptr, false);
+
+    if (mmcssHandle != nullptr)
+    {
+        revertCharacteristics(mmcssHandle);
+        mmcssHandle = nullptr;
+    }
+
+    if (! realTime)
+        return true;
+
+    DWORD taskIndex = 0;
+    mmcssHandle = setCharacteristics(L"Pro Audio", &taskIndex);
+    return mmcssHandle != nullptr;
+   #elif defined(ARCH_MAC)
+    const thread_port_t thread = pthread_mach_thread_np(pthread_self());
+
+    if (! realTime || period <= 0.0)
+    {
+        thread_standard_policy_data_t policy = {};
+        return thread_policy_set(thread, THREAD_STANDARD_POLICY, reinterpret_cast<thread_policy_t>(&policy),
+                                 THREAD_STANDARD_POLICY_COUNT) == KERN_SUCCESS;
+    }
+
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    const double ticksPerSecond = 1e9 * timebase.denom / timebase.numer;
+
+    // the whole block may be used, but half of it is what is usually needed
+    thread_time_constraint_policy_data_t policy;
+    policy.period = static_cast<uint32_t>(period * ticksPerSecond);
+    policy.computation = static_cast<uint32_t>(period * 0.5 * ticksPerSecond);
+    policy.constraint = policy.period;
+    policy.preemptible = 1;
+
+    return thread_policy_set(thread, THREAD_TIME_CONSTRAINT_POLICY, reinterpret_cast<thread_policy_t>(&policy),
+                             THREAD_TIME_CONSTRAINT_POLICY_COUNT) == KERN_SUCCESS;
+   #elif defined(__linux__)
+    sched_param param = {};
+    int policy = SCHED_OTHER;
+
+    if (realTime)
+    {
+        // below what JACK uses for its own threads by default
+        policy = SCHED_FIFO;
+        param.sched_priority = std::min(70, sched_get_priority_max(SCHED_FIFO));
+    }
+
+    return pthread_setschedparam(pthread_self(), policy, &param) == 0;
+    // unused
+    (void)period;
+   #else
+    return false;
+    // unused
+    (void)realTime;
+    (void)period;
+   #endif
+}
+
+bool setCurrentThreadAffinity(const int cpu)
+{
+   #if defined(ARCH_WIN)
+    DWORD_PTR processMask = 0, systemMask = 0;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask) == 0)
+        return false;
+
+    const DWORD_PTR mask = cpu >= 0 && cpu < static_cast<int>(sizeof(DWORD_PTR) * 8)
+                         ? static_cast<DWORD_PTR>(1) << cpu
+                         : processMask;
+
+    return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+   #elif defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+
+    if (cpu >= 0)
+    {
+        CPU_SET(cpu, &cpus);
+    }
+    else
+    {
+        for (int i = 0, count = getCpuCount(); i < count; ++i)
+            CPU_SET(i, &cpus);
+    }
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+   #else
+    return false;
+    // unused
+    (void)cpu;
+   #endif
+}
+
+}
@@ -0,0 +1,35 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+// Scheduling of the calling thread, used for the audio thread of the native standalone and the engine workers.
+// Real-time scheduling is SCHED_FIFO on Linux, MMCSS "Pro Audio" on Windows and a Mach time-constraint on macOS.
+// Everything returns false where the system does not allow it, such as pinning threads on macOS.
+
+namespace threadsched
+{
+
+int getCpuCount();
+
+// @a period is the audio block duration in seconds, macOS needs it for the time-constraint policy
+bool setCurrentThreadRealTime(bool realTime, double period);
+
+// pins the calling thread to a single CPU, or lets it run on any CPU if @a cpu is negative
+bool setCurrentThreadAffinity(int cpu);
+
+}
@@ -32,6 +32,7 @@
 #include <window/Window.hpp>
 #include <asset.hpp>
 #include <widget/Widget.hpp>
+#include <app/ModuleWidget.hpp>
 #include <app/Scene.hpp>
 #include <context.hpp>
 #include <patch.hpp>
@@ -197,5 +198,14 @@ void generateScreenshot() {
 }
 
 
+void generateModuleThumbnails() {
+}
+
+
+app::ModuleWidget* createModuleThumbnail(plugin::Model*) {
+	return nullptr;
+}
+
+
 } // namespace window
 } // namespace rack
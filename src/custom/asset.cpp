@@ -25,6 +25,8 @@
 #endif
 
 #include <algorithm>
+#include <mutex>
+#include <unordered_map>
 
 #include "DistrhoUtils.hpp"
 
@@ -48,6 +50,34 @@ static inline std::string& trim(std::string& s)
     return s;
 }
 
+// resolved paths, widgets ask for the same few files over and over while constructing panels.
+// system paths are kept per screw mode, everything is dropped when the resource dirs change.
+struct PathCache {
+    std::mutex mutex;
+    std::string systemDir;
+    std::string bundlePath;
+    std::unordered_map<std::string, std::string> system[3];
+    std::unordered_map<const plugin::Plugin*, std::unordered_map<std::string, std::string>> plugins;
+
+    // must be called with the mutex locked
+    void validate()
+    {
+        if (systemDir == asset::systemDir && bundlePath == asset::bundlePath)
+            return;
+
+        systemDir = asset::systemDir;
+        bundlePath = asset::bundlePath;
+        for (std::unordered_map<std::string, std::string>& paths : system)
+            paths.clear();
+        plugins.clear();
+    }
+};
+
+static PathCache pathCache;
+
+// bound in case of callers building unique filenames
+static constexpr const size_t kMaxCachedPaths = 65536;
+
 // ignored, returns the same as `system`
 std::string user(std::string filename) {
     return system(filename);
@@ -56,18 +86,53 @@ std::string user(std::string filename) {
 // get system resource, trimming "res/" prefix if we are loaded as a plugin bundle
 std::string system(std::string filename) {
    #ifndef HEADLESS
-    /**/ if (forceBlackScrew && string::endsWith(filename, "/ScrewBlack.svg"))
-        filename = filename.substr(0, filename.size()-15) + "/./ScrewBlack.svg";
-    else if (forceSilverScrew && string::endsWith(filename, "/ScrewSilver.svg"))
-        filename = filename.substr(0, filename.size()-16) + "/./ScrewSilver.svg";
+    const int screwMode = forceBlackScrew ? 1 : forceSilverScrew ? 2 : 0;
+   #else
+    const int screwMode = 0;
+   #endif
+
+    const std::lock_guard<std::mutex> lock(pathCache.mutex);
+    pathCache.validate();
+
+    std::unordered_map<std::string, std::string>& paths(pathCache.system[screwMode]);
+
+    auto it = paths.find(filename);
+    if (it != paths.end())
+        return it->second;
+
+    if (paths.size() >= kMaxCachedPaths)
+        paths.clear();
+
+    std::string path = filename;
+   #ifndef HEADLESS
+    /**/ if (screwMode == 1 && string::endsWith(path, "/ScrewBlack.svg"))
+        path = path.substr(0, path.size()-15) + "/./ScrewBlack.svg";
+    else if (screwMode == 2 && string::endsWith(path, "/ScrewSilver.svg"))
+        path = path.substr(0, path.size()-16) + "/./ScrewSilver.svg";
    #endif
-    return system::join(systemDir, bundlePath.empty() ? filename : trim(filename));
+    path = system::join(systemDir, bundlePath.empty() ? path : trim(path));
+
+    return paths.emplace(std::move(filename), std::move(path)).first->second;
 }
 
 // get plugin resource path
 std::string plugin(plugin::Plugin* plugin, std::string filename) {
     DISTRHO_SAFE_ASSERT_RETURN(plugin != nullptr, {});
-    return system::join(plugin->path, filename);
+
+    const std::lock_guard<std::mutex> lock(pathCache.mutex);
+    pathCache.validate();
+
+    std::unordered_map<std::string, std::string>& paths(pathCache.plugins[plugin]);
+
+    auto it = paths.find(filename);
+    if (it != paths.end())
+        return it->second;
+
+    if (paths.size() >= kMaxCachedPaths)
+        paths.clear();
+
+    std::string path = system::join(plugin->path, filename);
+    return paths.emplace(std::move(filename), std::move(path)).first->second;
 }
 
 // path to demo patch files
@@ -97,5 +162,19 @@ std::string pluginPath(const std::string& dirname) {
     return system::join(systemDir, dirname);
 }
 
+// path to a plugin family built as a separately loadable module, see SHARED_PLUGINS
+std::string pluginModule(const std::string& dirname) {
+   #ifdef ARCH_MAC
+    const std::string filename = dirname + ".dylib";
+   #else
+    const std::string filename = dirname + ".so";
+   #endif
+    // no bundlePath set, assume local source build
+    if (bundlePath.empty())
+        return system::join(systemDir, "..", "..", "plugins", "PluginModules", filename);
+    // bundlePath is present, use resources from bundle
+    return system::join(systemDir, "PluginModules", filename);
+}
+
 }
 }
@@ -18,9 +18,16 @@
 #define STDIO_OVERRIDE Rackdep
 
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <list>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
 
 namespace rack {
 #ifndef HEADLESS
@@ -68,6 +75,8 @@ int rateLimit = 0;
 }
 
 #include "nanovg.h"
+#include "../ResourcePack.hpp"
+#include "../StartupTrace.hpp"
 
 // fix bogaudio build, another missing symbol
 #ifndef NDEBUG
@@ -93,6 +102,7 @@ NVGcolor nvgRGBblank(const unsigned char r, const unsigned char g, const unsigne
 #undef nsvgDelete
 #undef nsvgParseFromFile
 #include <nanosvg.h>
+#include "../SvgCache.hpp"
 
 #ifndef HEADLESS
 enum DarkMode {
@@ -1162,13 +1172,270 @@ NSVGimage* nsvgParseFromFileCardinal(const char* filename, const char* units, fl
 void nsvgDeleteCardinal(NSVGimage*);
 }
 
+namespace rack {
+std::string cacheDir();
+}
+
+// Parsed SVGs are kept in a binary cache file, so the XML is only parsed again when a file changes.
+// Only the index is read on startup, image data is read from the file when requested.
+struct SvgCacheEntry {
+    int64_t mtime;
+    int64_t size;
+    // location in the cache file, or the data itself for images parsed in this session
+    long offset;
+    uint32_t length;
+    std::vector<uint8_t> data;
+};
+
+static std::mutex svgCacheMutex;
+static std::unordered_map<std::string, SvgCacheEntry> svgCacheEntries;
+static std::string svgCachePath;
+static FILE* svgCacheFile = nullptr;
+static bool svgCacheLoaded = false;
+static bool svgCacheDirty = false;
+
+static void svgCacheLoad()
+{
+    svgCacheLoaded = true;
+
+    const std::string dir = rack::cacheDir();
+    if (dir.empty())
+        return;
+
+    svgCachePath = dir + "/svg.bin";
+
+    svgCacheFile = std::fopen(svgCachePath.c_str(), "rb");
+    if (svgCacheFile == nullptr)
+        return;
+
+    uint32_t header[sizeof(kSvgCacheHeader)/sizeof(kSvgCacheHeader[0])];
+    if (std::fread(header, sizeof(header), 1, svgCacheFile) != 1 || std::memcmp(header, kSvgCacheHeader, sizeof(header)) != 0)
+    {
+        std::fclose(svgCacheFile);
+        svgCacheFile = nullptr;
+        return;
+    }
+
+    // entries are: key length, key, file time, file size, data length, data
+    for (uint32_t keylen, datalen;;)
+    {
+        if (std::fread(&keylen, sizeof(keylen), 1, svgCacheFile) != 1 || keylen == 0 || keylen > 4096)
+            break;
+
+        std::string key(keylen, '\0');
+        SvgCacheEntry entry;
+
+        if (std::fread(&key[0], keylen, 1, svgCacheFile) != 1)
+            break;
+        if (std::fread(&entry.mtime, sizeof(entry.mtime), 1, svgCacheFile) != 1)
+            break;
+        if (std::fread(&entry.size, sizeof(entry.size), 1, svgCacheFile) != 1)
+            break;
+        if (std::fread(&datalen, sizeof(datalen), 1, svgCacheFile) != 1)
+            break;
+
+        entry.offset = std::ftell(svgCacheFile);
+        entry.length = datalen;
+
+        if (std::fseek(svgCacheFile, datalen, SEEK_CUR) != 0)
+            break;
+
+        svgCacheEntries[key] = std::move(entry);
+    }
+}
+
+static bool svgCacheReadEntry(const SvgCacheEntry& entry, std::vector<uint8_t>& data)
+{
+    if (! entry.data.empty())
+    {
+        data = entry.data;
+        return true;
+    }
+
+    if (svgCacheFile == nullptr || std::fseek(svgCacheFile, entry.offset, SEEK_SET) != 0)
+        return false;
+
+    data.resize(entry.length);
+    return entry.length == 0 || std::fread(data.data(), entry.length, 1, svgCacheFile) == 1;
+}
+
+static void svgCacheSave()
+{
+    const std::lock_guard<std::mutex> lock(svgCacheMutex);
+
+    if (svgCacheDirty)
+    {
+        const std::string tmpPath = svgCachePath + ".tmp";
+
+        if (FILE* const f = std::fopen(tmpPath.c_str(), "wb"))
+        {
+            bool ok = std::fwrite(kSvgCacheHeader, sizeof(kSvgCacheHeader), 1, f) == 1;
+            std::vector<uint8_t> data;
+
+            for (const auto& it : svgCacheEntries)
+            {
+                if (! ok)
+                    break;
+                if (! svgCacheReadEntry(it.second, data))
+                    continue;
+
+                const uint32_t keylen = it.first.size();
+                const uint32_t datalen = data.size();
+                ok = std::fwrite(&keylen, sizeof(keylen), 1, f) == 1
+                  && std::fwrite(it.first.data(), keylen, 1, f) == 1
+                  && std::fwrite(&it.second.mtime, sizeof(it.second.mtime), 1, f) == 1
+                  && std::fwrite(&it.second.size, sizeof(it.second.size), 1, f) == 1
+                  && std::fwrite(&datalen, sizeof(datalen), 1, f) == 1
+                  && (datalen == 0 || std::fwrite(data.data(), datalen, 1, f) == 1);
+            }
+
+            std::fclose(f);
+
+            if (svgCacheFile != nullptr)
+            {
+                std::fclose(svgCacheFile);
+                svgCacheFile = nullptr;
+            }
+
+            if (ok)
+            {
+                std::remove(svgCachePath.c_str());
+                ok = std::rename(tmpPath.c_str(), svgCachePath.c_str()) == 0;
+            }
+            if (! ok)
+                std::remove(tmpPath.c_str());
+        }
+    }
+
+    if (svgCacheFile != nullptr)
+    {
+        std::fclose(svgCacheFile);
+        svgCacheFile = nullptr;
+    }
+
+    svgCacheEntries.clear();
+    svgCachePath.clear();
+    svgCacheLoaded = svgCacheDirty = false;
+}
+
+// parses from the resource pack if the file is in it, nanosvg modifies the data so it must be copied
+static NSVGimage* nsvgParseFromFileOrPack(const char* const filename, const respack::Entry* const packed,
+                                          const char* const units, const float dpi)
+{
+    if (packed == nullptr)
+        return nsvgParseFromFile(filename, units, dpi);
+
+    char* const data = static_cast<char*>(std::malloc(packed->size + 1));
+    if (data == nullptr)
+        return nullptr;
+
+    std::memcpy(data, packed->data, packed->size);
+    data[packed->size] = '\0';
+
+    NSVGimage* const image = nsvgParse(data, units, dpi);
+    std::free(data);
+    return image;
+}
+
+// images precompiled at build time (see SVG_PRECOMPILE), only used if the file itself comes from the same pack
+static NSVGimage* nsvgLoadPrecompiled(const char* const filename, const char* const units, const float dpi)
+{
+    const std::string precompiledName = std::string(filename) + ".nsvg";
+    const respack::Entry* const precompiled = respack::find(precompiledName.c_str());
+
+    if (precompiled == nullptr || precompiled->size < sizeof(SvgPrecompiledHeader))
+        return nullptr;
+
+    SvgPrecompiledHeader header;
+    svgPrecompiledHeader(header, units, dpi);
+
+    if (std::memcmp(precompiled->data, &header, sizeof(header)) != 0)
+        return nullptr;
+
+    return svgCacheDeserialize(precompiled->data + sizeof(header), precompiled->size - sizeof(header));
+}
+
+static NSVGimage* nsvgParseFromFileCached(const char* const filename, const char* const units, const float dpi)
+{
+    // files in the resource pack are identified by what was recorded when packing, without a stat
+    const respack::Entry* const packed = respack::find(filename);
+
+    if (packed != nullptr)
+        if (NSVGimage* const image = nsvgLoadPrecompiled(filename, units, dpi))
+            return image;
+
+    struct stat st;
+    if (packed != nullptr)
+    {
+        st.st_mtime = static_cast<decltype(st.st_mtime)>(packed->mtime);
+        st.st_size = static_cast<decltype(st.st_size)>(packed->size);
+    }
+    else if (stat(filename, &st) != 0)
+    {
+        return nsvgParseFromFile(filename, units, dpi);
+    }
+
+    char dpistr[32];
+    std::snprintf(dpistr, sizeof(dpistr), "%g", dpi);
+
+    std::string key(filename);
+    key += '\n';
+    key += units;
+    key += '\n';
+    key += dpistr;
+
+    {
+        const std::lock_guard<std::mutex> lock(svgCacheMutex);
+
+        if (! svgCacheLoaded)
+            svgCacheLoad();
+
+        if (svgCachePath.empty())
+            return nsvgParseFromFileOrPack(filename, packed, units, dpi);
+
+        const auto it = svgCacheEntries.find(key);
+        if (it != svgCacheEntries.end() && it->second.mtime == st.st_mtime && it->second.size == st.st_size)
+        {
+            std::vector<uint8_t> data;
+            if (svgCacheReadEntry(it->second, data))
+                if (NSVGimage* const image = svgCacheDeserialize(data.data(), data.size()))
+                    return image;
+        }
+    }
+
+    NSVGimage* const image = nsvgParseFromFileOrPack(filename, packed, units, dpi);
+    if (image == nullptr)
+        return nullptr;
+
+    SvgCacheEntry entry;
+    entry.mtime = st.st_mtime;
+    entry.size = st.st_size;
+    entry.offset = 0;
+    svgCacheSerialize(image, entry.data);
+    entry.length = entry.data.size();
+
+    const std::lock_guard<std::mutex> lock(svgCacheMutex);
+    svgCacheEntries[key] = std::move(entry);
+    svgCacheDirty = true;
+    return image;
+}
+
 #ifndef HEADLESS
+// Alternative look of a single shape, swapped with the shape's own values when switching between dark and light mode
+struct NSVGshapeTheme {
+    NSVGpaint fill;
+    NSVGpaint stroke;
+    float opacity;
+};
+
 struct ExtendedNSVGimage {
     NSVGimage* const handle;
     NSVGimage* handleOrig;
     NSVGimage* handleMOD;
-    NSVGshape* shapesOrig;
-    NSVGshape* shapesMOD;
+    // one entry per shape of handle, in the same order
+    NSVGshapeTheme* shapeThemes;
+    uint32_t numShapeThemes;
+    bool shapeThemesSwapped;
 };
 
 static std::list<ExtendedNSVGimage> loadedDarkSVGs;
@@ -1186,52 +1453,79 @@ void nsvg__duplicatePaint(NSVGpaint& dst, NSVGpaint& src)
 }
 
 static inline
-NSVGshape* nsvg__duplicateShapes(NSVGshape* const orig)
+uint32_t nsvg__countShapes(NSVGshape* shape)
 {
-    NSVGshape* const dup = static_cast<NSVGshape*>(malloc(sizeof(NSVGshape)));
-    std::memcpy(dup, orig, sizeof(NSVGshape));
-    nsvg__duplicatePaint(dup->fill, orig->fill);
-    nsvg__duplicatePaint(dup->stroke, orig->stroke);
+    uint32_t count = 0;
+    for (; shape != nullptr; shape = shape->next)
+        ++count;
+    return count;
+}
 
-    for (NSVGshape* shape2 = dup;;)
-    {
-        if (shape2->next == nullptr)
-            break;
+// Copies a shape for inverting its paints, sharing everything besides the gradients
+static inline
+void nsvg__duplicateShapeForTheme(NSVGshape& dup, NSVGshape* const orig)
+{
+    std::memcpy(&dup, orig, sizeof(NSVGshape));
+    nsvg__duplicatePaint(dup.fill, orig->fill);
+    nsvg__duplicatePaint(dup.stroke, orig->stroke);
+}
 
-        NSVGshape* const shapedup = static_cast<NSVGshape*>(malloc(sizeof(NSVGshape)));
-        std::memcpy(shapedup, shape2->next, sizeof(NSVGshape));
-        nsvg__duplicatePaint(shapedup->fill, shape2->next->fill);
-        nsvg__duplicatePaint(shapedup->stroke, shape2->next->stroke);
-        shape2->next = shapedup;
-        shape2 = shapedup;
+static inline
+void nsvg__storeShapeTheme(NSVGshapeTheme& theme, const NSVGshape& shape)
+{
+    theme.fill = shape.fill;
+    theme.stroke = shape.stroke;
+    theme.opacity = shape.opacity;
+}
+
+static inline
+void swapShapeThemes(ExtendedNSVGimage& ext)
+{
+    uint32_t i = 0;
+    for (NSVGshape* shape = ext.handle->shapes; shape != nullptr && i < ext.numShapeThemes; shape = shape->next, ++i)
+    {
+        NSVGshapeTheme& theme(ext.shapeThemes[i]);
+        std::swap(shape->fill, theme.fill);
+        std::swap(shape->stroke, theme.stroke);
+        std::swap(shape->opacity, theme.opacity);
     }
 
-    return dup;
+    ext.shapeThemesSwapped = !ext.shapeThemesSwapped;
+}
+
+static inline
+void applyExtendedNSVGimage(ExtendedNSVGimage& ext, const bool useMOD)
+{
+    if (ext.shapeThemes != nullptr)
+    {
+        if (ext.shapeThemesSwapped != useMOD)
+            swapShapeThemes(ext);
+    }
+    else if (ext.handleMOD != nullptr)
+    {
+        std::memcpy(ext.handle, useMOD ? ext.handleMOD : ext.handleOrig, sizeof(NSVGimage));
+    }
 }
 
 static inline
 void deleteExtendedNSVGimage(ExtendedNSVGimage& ext)
 {
-    if (ext.shapesMOD != nullptr)
+    if (ext.shapeThemes != nullptr)
     {
+        // revert shapes back to original
+        if (ext.shapeThemesSwapped)
+            swapShapeThemes(ext);
+
         // delete duplicated resources
-        for (NSVGshape *next, *shape = ext.shapesMOD;;)
+        for (uint32_t i = 0; i < ext.numShapeThemes; ++i)
         {
-            next = shape->next;
-
-            nsvg__deletePaint(&shape->fill);
-            nsvg__deletePaint(&shape->stroke);
-            std::free(shape);
-
-            if (next == nullptr)
-                break;
-
-            shape = next;
+            nsvg__deletePaint(&ext.shapeThemes[i].fill);
+            nsvg__deletePaint(&ext.shapeThemes[i].stroke);
         }
 
-        // revert shapes back to original
-        ext.handle->shapes = ext.shapesOrig;
-        ext.shapesMOD = nullptr;
+        delete[] ext.shapeThemes;
+        ext.shapeThemes = nullptr;
+        ext.numShapeThemes = 0;
     }
 
     if (ext.handleMOD != nullptr)
@@ -1251,7 +1545,9 @@ void deleteExtendedNSVGimage(ExtendedNSVGimage& ext)
 
 NSVGimage* nsvgParseFromFileCardinal(const char* const filename, const char* const units, const float dpi)
 {
-    if (NSVGimage* const handle = nsvgParseFromFile(filename, units, dpi))
+    const startuptrace::Scope trace("svg", filename);
+
+    if (NSVGimage* const handle = nsvgParseFromFileCached(filename, units, dpi))
     {
        #ifndef HEADLESS
         const size_t filenamelen = std::strlen(filename);
@@ -1260,22 +1556,18 @@ NSVGimage* nsvgParseFromFileCardinal(const char* const filename, const char* con
         bool hasLightMode = false;
         NSVGimage* handleOrig;
         NSVGimage* handleMOD = nullptr;
-        NSVGshape* shapesOrig;
-        NSVGshape* shapesMOD;
+        NSVGshapeTheme* shapeThemes = nullptr;
+        uint32_t numShapeThemes = 0;
 
         if (filenamelen < 18)
-        {
-            shapesOrig = shapesMOD = nullptr;
             goto postparse;
-        }
 
         // Special case for light/dark screws
         if (std::strncmp(filename + (filenamelen-15), "/ScrewBlack.svg", 15) == 0 && filename[filenamelen-16] != '.')
         {
             const std::string silverfilename = std::string(filename).substr(0, filenamelen-9) + "Silver.svg";
             hasLightMode = true;
-            shapesOrig = shapesMOD = nullptr;
-            handleMOD = nsvgParseFromFile(silverfilename.c_str(), units, dpi);
+            handleMOD = nsvgParseFromFileCached(silverfilename.c_str(), units, dpi);
             goto postparse;
         }
 
@@ -1283,8 +1575,7 @@ NSVGimage* nsvgParseFromFileCardinal(const char* const filename, const char* con
         {
             const std::string blackfilename = std::string(filename).substr(0, filenamelen-10) + "Black.svg";
             hasDarkMode = true;
-            shapesOrig = shapesMOD = nullptr;
-            handleMOD = nsvgParseFromFile(blackfilename.c_str(), units, dpi);
+            handleMOD = nsvgParseFromFileCached(blackfilename.c_str(), units, dpi);
             goto postparse;
         }
 
@@ -1305,7 +1596,6 @@ NSVGimage* nsvgParseFromFileCardinal(const char* const filename, const char* con
             {
                 const std::string nightfilename = std::string(filename).substr(0, filenamelen-4) + "_Night.svg";
                 hasDarkMode = true;
-                shapesOrig = shapesMOD = nullptr;
                 handleMOD = nsvgParseFromFile(nightfilename.c_str(), units, dpi);
                 printf("special hack for glue: %s -> %s\n", filename, nightfilename.c_str());
                 goto postparse;
@@ -1330,12 +1620,17 @@ NSVGimage* nsvgParseFromFileCardinal(const char* const filename, const char* con
 
             hasDarkMode = true;
             handleMOD = nullptr;
-            shapesOrig = handle->shapes;
-            shapesMOD = nsvg__duplicateShapes(shapesOrig);
+            numShapeThemes = nsvg__countShapes(handle->shapes);
+            shapeThemes = new NSVGshapeTheme[numShapeThemes];
 
-            // shape paint inversion
-            for (NSVGshape* shape = shapesMOD; shape != nullptr; shape = shape->next, ++shapeCounter)
+            // shape paint inversion, into a copy of each shape
+            for (NSVGshape* orig = handle->shapes; orig != nullptr; orig = orig->next, ++shapeCounter)
             {
+                NSVGshape dup;
+                NSVGshape* const shape = &dup;
+                nsvg__duplicateShapeForTheme(dup, orig);
+                nsvg__storeShapeTheme(shapeThemes[shapeCounter], dup);
+
                 if (shapeNumberToIgnore == shapeCounter)
                     continue;
 
@@ -1353,6 +1648,8 @@ NSVGimage* nsvgParseFromFileCardinal(const char* const filename, const char* con
 
                 if (invertPaintForDarkMode(mode, shape, shape->fill, svgFileToInvert))
                     invertPaintForDarkMode(mode, shape, shape->stroke, svgFileToInvert);
+
+                nsvg__storeShapeTheme(shapeThemes[shapeCounter], dup);
             }
 
             goto postparse;
@@ -1373,14 +1670,21 @@ NSVGimage* nsvgParseFromFileCardinal(const char* const filename, const char* con
 
             hasLightMode = true;
             handleMOD = nullptr;
-            shapesOrig = handle->shapes;
-            shapesMOD = nsvg__duplicateShapes(shapesOrig);
+            numShapeThemes = nsvg__countShapes(handle->shapes);
+            shapeThemes = new NSVGshapeTheme[numShapeThemes];
 
-            // shape paint inversion
-            for (NSVGshape* shape = shapesMOD; shape != nullptr; shape = shape->next)
+            // shape paint inversion, into a copy of each shape
+            uint32_t shapeCounter = 0;
+            for (NSVGshape* orig = handle->shapes; orig != nullptr; orig = orig->next, ++shapeCounter)
             {
+                NSVGshape dup;
+                NSVGshape* const shape = &dup;
+                nsvg__duplicateShapeForTheme(dup, orig);
+
                 if (invertPaintForLightMode(mode, shape, shape->fill))
                     invertPaintForLightMode(mode, shape, shape->stroke);
+
+                nsvg__storeShapeTheme(shapeThemes[shapeCounter], dup);
             }
 
             goto postparse;
@@ -1404,30 +1708,20 @@ postparse:
 
         if (hasDarkMode)
         {
-            const ExtendedNSVGimage ext = { handle, handleOrig, handleMOD, shapesOrig, shapesMOD };
+            const ExtendedNSVGimage ext = { handle, handleOrig, handleMOD, shapeThemes, numShapeThemes, false };
             loadedDarkSVGs.push_back(ext);
 
             if (rack::settings::darkMode)
-            {
-                if (shapesMOD != nullptr)
-                    handle->shapes = shapesMOD;
-                else if (handleMOD != nullptr)
-                    std::memcpy(handle, handleMOD, sizeof(NSVGimage));
-            }
+                applyExtendedNSVGimage(loadedDarkSVGs.back(), true);
         }
 
         if (hasLightMode)
         {
-            const ExtendedNSVGimage ext = { handle, handleOrig, handleMOD, shapesOrig, shapesMOD };
+            const ExtendedNSVGimage ext = { handle, handleOrig, handleMOD, shapeThemes, numShapeThemes, false };
             loadedLightSVGs.push_back(ext);
 
             if (!rack::settings::darkMode)
-            {
-                if (shapesMOD != nullptr)
-                    handle->shapes = shapesMOD;
-                else if (handleMOD != nullptr)
-                    std::memcpy(handle, handleMOD, sizeof(NSVGimage));
-            }
+                applyExtendedNSVGimage(loadedLightSVGs.back(), true);
         }
        #endif // HEADLESS
 
@@ -1477,20 +1771,10 @@ void switchDarkMode(const bool darkMode)
     rack::settings::darkMode = darkMode;
 
     for (ExtendedNSVGimage& ext : loadedDarkSVGs)
-    {
-        if (ext.shapesMOD != nullptr)
-            ext.handle->shapes = darkMode ? ext.shapesMOD : ext.shapesOrig;
-        else if (ext.handleMOD != nullptr)
-            std::memcpy(ext.handle, darkMode ? ext.handleMOD : ext.handleOrig, sizeof(NSVGimage));
-    }
+        applyExtendedNSVGimage(ext, darkMode);
 
     for (ExtendedNSVGimage& ext : loadedLightSVGs)
-    {
-        if (ext.shapesMOD != nullptr)
-            ext.handle->shapes = !darkMode ? ext.shapesMOD : ext.shapesOrig;
-        else if (ext.handleMOD != nullptr)
-            std::memcpy(ext.handle, !darkMode ? ext.handleMOD : ext.handleOrig, sizeof(NSVGimage));
-    }
+        applyExtendedNSVGimage(ext, !darkMode);
    #endif
 }
 
@@ -1498,6 +1782,8 @@ namespace rack {
 namespace asset {
 
 void destroy() {
+    svgCacheSave();
+
    #ifndef HEADLESS
     for (auto it = loadedDarkSVGs.begin(), end = loadedDarkSVGs.end(); it != end; ++it)
     {
@@ -0,0 +1,80 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include <dsp/fft.hpp>
+
+#include <mutex>
+#include <vector>
+
+
+namespace rack {
+namespace dsp {
+
+
+/** Setups in use, by size and type.
+Patches use a handful of FFT sizes at most, a list is enough to look them up.
+*/
+struct PffftPlan {
+	PFFFT_Setup* setup;
+	int length;
+	pffft_transform_t transform;
+	int users;
+};
+
+static std::mutex pffftPlansMutex;
+static std::vector<PffftPlan> pffftPlans;
+
+
+PFFFT_Setup* acquirePffftSetup(int length, pffft_transform_t transform) {
+	std::lock_guard<std::mutex> lock(pffftPlansMutex);
+
+	for (PffftPlan& plan : pffftPlans) {
+		if (plan.length == length && plan.transform == transform) {
+			plan.users++;
+			return plan.setup;
+		}
+	}
+
+	PFFFT_Setup* setup = pffft_new_setup(length, transform);
+	// Invalid sizes are not cached, failing again next time
+	if (setup)
+		pffftPlans.push_back({setup, length, transform, 1});
+	return setup;
+}
+
+
+void releasePffftSetup(PFFFT_Setup* setup) {
+	if (!setup)
+		return;
+
+	std::lock_guard<std::mutex> lock(pffftPlansMutex);
+
+	for (size_t i = 0; i < pffftPlans.size(); i++) {
+		PffftPlan& plan = pffftPlans[i];
+		if (plan.setup != setup)
+			continue;
+		if (--plan.users == 0) {
+			pffft_destroy_setup(setup);
+			pffftPlans.erase(pffftPlans.begin() + i);
+		}
+		return;
+	}
+}
+
+
+} // namespace dsp
+} // namespace rack
@@ -5,6 +5,7 @@ cd $(dirname ${0})
 diff -U3 ../Rack/dep/oui-blendish/blendish.c blendish.c > diffs/blendish.c.diff
 diff -U3 ../Rack/src/common.cpp common.cpp > diffs/common.cpp.diff
 diff -U3 ../Rack/src/context.cpp context.cpp > diffs/context.cpp.diff
+diff -U3 ../Rack/src/history.cpp history.cpp > diffs/history.cpp.diff
 diff -U3 ../Rack/src/plugin.cpp plugin.cpp > diffs/plugin.cpp.diff
 diff -U3 ../Rack/src/app/MenuBar.cpp MenuBar.cpp > diffs/MenuBar.cpp.diff
 diff -U3 ../Rack/src/app/ModuleWidget.cpp ModuleWidget.cpp > diffs/ModuleWidget.cpp.diff
@@ -26,6 +26,7 @@
  */
 
 #include <algorithm>
+#include <climits>
 #include <set>
 #include <thread>
 #include <condition_variable>
@@ -34,22 +35,45 @@
 #include <tuple>
 #include <pmmintrin.h>
 #include <unordered_map>
+#include <unordered_set>
+#include <queue>
+#include <functional>
+#include <exception>
+#include <memory>
 
 #include <engine/Engine.hpp>
+#include <engine/BlockModule.hpp>
 #include <engine/TerminalModule.hpp>
+#include <engine/ModuleLatency.hpp>
+#include <engine/ModuleFreeRunning.hpp>
+#include <engine/ModuleSampleRateCoefficients.hpp>
+#include <engine/ModuleSnapshot.hpp>
+#include <engine/UiSnapshot.hpp>
+#include <asset.hpp>
 #include <settings.hpp>
 #include <system.hpp>
 #include <random.hpp>
 #include <patch.hpp>
 #include <plugin.hpp>
 #include <mutex.hpp>
+#include <context.hpp>
+#include <math.hpp>
+#include <string.hpp>
 #include <helpers.hpp>
+#include <simd/Vector.hpp>
+#include <simd/functions.hpp>
 
 #ifdef NDEBUG
 # undef DEBUG
 #endif
 
 #include "DistrhoUtils.hpp"
+#include "../extra/SharedResourcePointer.hpp"
+#include "../CycleCounter.hpp"
+#include "../ModuleMemory.hpp"
+#include "../PerfTrace.hpp"
+#include "../RealTimeAudit.hpp"
+#include "../ThreadScheduling.hpp"
 
 
 // known terminal modules
@@ -60,1201 +84,5038 @@ namespace rack {
 namespace engine {
 
 
-struct Engine::Internal {
-	std::vector<Module*> modules;
-	std::vector<TerminalModule*> terminalModules;
-	std::vector<Cable*> cables;
-	std::set<ParamHandle*> paramHandles;
-
-	// moduleId
-	std::map<int64_t, Module*> modulesCache;
-	// cableId
-	std::map<int64_t, Cable*> cablesCache;
-	// (moduleId, paramId)
-	std::map<std::tuple<int64_t, int>, ParamHandle*> paramHandlesCache;
+// Tells the real-time audit and memory accounting which module the calling thread works for
+static inline void Engine_setCurrentModule(const Module* const module) {
+	rtaudit::setModule(module);
+	modulemem::setModule(module);
+}
 
-	float sampleRate = 0.f;
-	float sampleTime = 0.f;
-	int64_t block = 0;
-	int64_t frame = 0;
-	int64_t blockFrame = 0;
-	double blockTime = 0.0;
-	int blockFrames = 0;
-	bool aboutToClose = false;
 
-#ifndef HEADLESS
-	// Meter
-	int meterCount = 0;
-	double meterTotal = 0.0;
-	double meterMax = 0.0;
-	double meterLastTime = -INFINITY;
-	double meterLastAverage = 0.0;
-	double meterLastMax = 0.0;
+/** Flushes denormals to zero on the calling thread while in scope, and restores the previous mode of the thread afterwards.
+Signals decaying in feedback loops and filters end up as denormals, which are very slow to process on most CPUs.
+The audio thread belongs to the host, which may or may not have set this mode already, so it is always set and restored.
+*/
+struct ScopedDenormalsFlush {
+#if defined(__EMSCRIPTEN__)
+	// WebAssembly has no control over denormals
+#elif defined(__aarch64__)
+	uint64_t fpcr;
+	ScopedDenormalsFlush() {
+		__asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+		// Set flush-to-zero (FZ), and round to nearest
+		const uint64_t flushFpcr = (fpcr | (UINT64_C(1) << 24)) & ~(UINT64_C(3) << 22);
+		__asm__ __volatile__("msr fpcr, %0" : : "r"(flushFpcr));
+	}
+	~ScopedDenormalsFlush() {
+		__asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+	}
+#elif defined(__arm__) && defined(__ARM_FP)
+	uint32_t fpscr;
+	ScopedDenormalsFlush() {
+		__asm__ __volatile__("vmrs %0, fpscr" : "=r"(fpscr));
+		// Set flush-to-zero (FZ), and round to nearest
+		const uint32_t flushFpscr = (fpscr | (1u << 24)) & ~(3u << 22);
+		__asm__ __volatile__("vmsr fpscr, %0" : : "r"(flushFpscr));
+	}
+	~ScopedDenormalsFlush() {
+		__asm__ __volatile__("vmsr fpscr, %0" : : "r"(fpscr));
+	}
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+	uint32_t csr;
+	ScopedDenormalsFlush() : csr(_mm_getcsr()) {
+		// Set flush-to-zero (FTZ) and denormals-are-zero (DAZ) mode, and round to nearest
+		// https://software.intel.com/en-us/node/682949
+		_mm_setcsr((csr | _MM_FLUSH_ZERO_ON | _MM_DENORMALS_ZERO_ON) & ~_MM_ROUND_MASK);
+	}
+	~ScopedDenormalsFlush() {
+		_mm_setcsr(csr);
+	}
 #endif
+};
 
-	// Parameter smoothing
-	Module* smoothModule = NULL;
-	int smoothParamId = 0;
-	float smoothValue = 0.f;
 
-	/** Mutex that guards the Engine state, such as settings, Modules, and Cables.
-	Writers lock when mutating the engine's state or stepping the block.
-	Readers lock when using the engine's state.
+// Cardinal specific engine API, declared as needed in other files
+void Engine_setSkipDormantModules(Engine* engine, bool skip);
+void Engine_setLoadShedding(Engine* engine, bool shedding);
+void Engine_setIdleSleepTime(Engine* engine, float seconds);
+void Engine_setOversampling(Engine* engine, int oversampling);
+void Engine_setBlockQuantum(Engine* engine, int quantum);
+void Engine_setMaxBufferSize(Engine* engine, int frames);
+void Engine_setWorkerPriority(Engine* engine, int priority);
+void Engine_setCpuBudget(Engine* engine, float cores);
+void Engine_setRealTimeScheduling(Engine* engine, bool realTime);
+void Engine_setAudioThreadCpu(Engine* engine, int cpu);
+void Engine_setAutoBufferSize(Engine* engine, bool autoBufferSize);
+void Engine_preparePatch(Engine* engine, json_t* rootJ);
+void Engine_beginPreparePatch(Engine* engine, const std::function<json_t*()>& parse);
+json_t* Engine_finishPreparePatch(Engine* engine);
+void Engine_cancelPreparePatch(Engine* engine);
+void Engine_beginEdits(Engine* engine);
+void Engine_endEdits(Engine* engine);
+void Engine_addLoadProfileStage(Engine* engine, const char* name, double time);
+json_t* Engine_getLoadProfileJson(Engine* engine);
+const UiSnapshot* Engine_getUiSnapshot(Engine* engine);
+
+
+/** Barrier based on a spin-lock.
+This is very fast for low numbers of threads, but not real-time safe if the number of threads exceeds the number of cores.
+*/
+struct SpinBarrier {
+	std::atomic<int> count{0};
+	std::atomic<uint8_t> step{0};
+	int total = 0;
+
+	/** Waits for all threads to arrive.
+	The last thread to arrive calls `f` before any other thread is released.
 	*/
-	SharedMutex mutex;
+	template <typename F>
+	void wait(F f) {
+		uint8_t s = step;
+		if (count.fetch_add(1, std::memory_order_acquire) + 1 >= total) {
+			// Reset count
+			count = 0;
+			f();
+			// Advance step, which releases all other threads
+			step.fetch_add(1, std::memory_order_release);
+			return;
+		}
+
+		// Spin until the last thread begins waiting
+		while (true) {
+			if (step.load(std::memory_order_relaxed) != s)
+				return;
+			_mm_pause();
+		}
+	}
+
+	void wait() {
+		wait([]{});
+	}
 };
 
 
-static void Engine_updateExpander_NoLock(Engine* that, Module* module, bool side) {
-	Module::Expander& expander = side ? module->rightExpander : module->leftExpander;
-	Module* oldExpanderModule = expander.module;
+/** Barrier that spin-locks until yield() is called, and then all threads switch to a mutex.
+yield() should be called if it is likely that all threads will block for a while and continuing to spin-lock is unnecessary.
+Saves CPU power after yield is called.
+*/
+struct HybridBarrier {
+	std::atomic<int> count{0};
+	std::atomic<uint8_t> step{0};
+	int total = 0;
 
-	if (expander.moduleId >= 0) {
-		if (!expander.module || expander.module->id != expander.moduleId) {
-			expander.module = that->getModule_NoLock(expander.moduleId);
-		}
+	std::mutex mutex;
+	std::condition_variable cv;
+
+	std::atomic<bool> yielded{false};
+
+	void yield() {
+		yielded = true;
 	}
-	else {
-		if (expander.module) {
-			expander.module = NULL;
+
+	void wait() {
+		uint8_t s = step;
+		if (count.fetch_add(1, std::memory_order_acquire) + 1 >= total) {
+			// Reset count
+			count = 0;
+			// If we're the last thread, reset yielded
+			bool wasYielded = yielded;
+			yielded = false;
+			// Advance step
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				step.fetch_add(1, std::memory_order_release);
+			}
+			if (wasYielded) {
+				// Wake up all other threads waiting on the condition variable
+				cv.notify_all();
+			}
+			return;
+		}
+
+		// Spin until the last thread begins waiting
+		while (!yielded.load(std::memory_order_relaxed)) {
+			if (step.load(std::memory_order_relaxed) != s)
+				return;
+			_mm_pause();
 		}
+
+		// Wait on mutex CV
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [&]{
+			return step != s;
+		});
 	}
+};
 
-	if (expander.module != oldExpanderModule) {
-		// Dispatch ExpanderChangeEvent
-		Module::ExpanderChangeEvent e;
-		e.side = side;
-		module->onExpanderChange(e);
+
+/** Shared lock that does not wait if the mutex is already locked by a writer.
+Given a deadline, spins until then instead, so that writers holding the mutex briefly do not make the lock fail.
+Check `locked` before accessing the guarded state.
+*/
+template <class TMutex>
+struct SharedTryLock {
+	TMutex& m;
+	const bool locked;
+
+	SharedTryLock(TMutex& m)
+		: m(m),
+		  locked(m.try_lock_shared()) {}
+
+	SharedTryLock(TMutex& m, double deadline)
+		: m(m),
+		  locked(tryLockUntil(m, deadline)) {}
+
+	~SharedTryLock() {
+		if (locked)
+			m.unlock_shared();
 	}
-}
+
+	static bool tryLockUntil(TMutex& m, double deadline) {
+		while (!m.try_lock_shared()) {
+			if (system::getTime() >= deadline)
+				return false;
+			for (int i = 0; i < 64; i++)
+				_mm_pause();
+		}
+		return true;
+	}
+};
 
 
-static void Cable_step(Cable* that) {
-	Output* output = &that->outputModule->outputs[that->outputId];
-	Input* input = &that->inputModule->inputs[that->inputId];
-	// Match number of polyphonic channels to output port
-	const int channels = output->channels;
-	// Copy all voltages from output to input
-	for (int c = 0; c < channels; c++) {
-		float v = output->voltages[c];
-		// Set 0V if infinite or NaN
-		if (!std::isfinite(v))
-			v = 0.f;
-		input->voltages[c] = v;
+/** Smooths any number of params towards their target values.
+Targets can be set from any thread, into a small table guarded by a spin-lock.
+The audio thread only tries to take the lock at the start of each block to receive the targets,
+and ramps all params every frame without locking, 4 at a time.
+*/
+struct ParamSmoother {
+	enum { kMaxParams = 128 };
+
+	// Targets, guarded by `locked`
+	std::atomic<bool> locked{false};
+	Param* targetParams[kMaxParams];
+	float targetValues[kMaxParams];
+	std::atomic<int> targetCount{0};
+	/** Incremented when smoothing of a param is cancelled, so that the audio thread stops ramping until it receives the targets again.
+	*/
+	std::atomic<uint32_t> cancelSerial{0};
+
+	// Ramps, only used by the audio thread
+	Param* params[kMaxParams];
+	float values[kMaxParams] = {};
+	float targets[kMaxParams] = {};
+	int count = 0;
+	uint32_t serial = 0;
+
+	bool tryLock() {
+		return !locked.exchange(true, std::memory_order_acquire);
 	}
-	// Set higher channel voltages to 0
-	for (int c = channels; c < input->channels; c++) {
-		input->voltages[c] = 0.f;
+
+	void lock() {
+		while (!tryLock())
+			_mm_pause();
 	}
-	input->channels = channels;
-}
 
+	void unlock() {
+		locked.store(false, std::memory_order_release);
+	}
 
-static void Port_step(Port* that, float deltaTime) {
-	// Set plug lights
-	if (that->channels == 0) {
-		that->plugLights[0].setBrightness(0.f);
-		that->plugLights[1].setBrightness(0.f);
-		that->plugLights[2].setBrightness(0.f);
+	int findTarget(Param* param) {
+		for (int i = 0, n = targetCount; i < n; i++) {
+			if (targetParams[i] == param)
+				return i;
+		}
+		return -1;
 	}
-	else if (that->channels == 1) {
-		float v = that->getVoltage() / 10.f;
-		that->plugLights[0].setSmoothBrightness(-v, deltaTime);
-		that->plugLights[1].setSmoothBrightness(v, deltaTime);
-		that->plugLights[2].setBrightness(0.f);
+
+	void removeTarget(int i) {
+		const int last = --targetCount;
+		targetParams[i] = targetParams[last];
+		targetValues[i] = targetValues[last];
 	}
-	else {
-		float v = that->getVoltageRMS() / 10.f;
-		that->plugLights[0].setBrightness(0.f);
-		that->plugLights[1].setBrightness(0.f);
-		that->plugLights[2].setSmoothBrightness(v, deltaTime);
+
+	/** Sets the value a param is smoothed towards.
+	Returns false if too many params are being smoothed already.
+	*/
+	bool setTarget(Param* param, float value) {
+		lock();
+		int i = findTarget(param);
+		if (i < 0) {
+			if (targetCount == kMaxParams) {
+				unlock();
+				return false;
+			}
+			i = targetCount++;
+			targetParams[i] = param;
+		}
+		targetValues[i] = value;
+		unlock();
+		return true;
 	}
-}
 
+	bool getTarget(Param* param, float& value) {
+		if (targetCount.load(std::memory_order_relaxed) == 0)
+			return false;
+		lock();
+		const int i = findTarget(param);
+		if (i >= 0)
+			value = targetValues[i];
+		unlock();
+		return i >= 0;
+	}
 
-static void TerminalModule__doProcess(TerminalModule* terminalModule, const Module::ProcessArgs& args, bool input) {
-	// Step module
-	if (input) {
-		terminalModule->processTerminalInput(args);
-		for (Output& output : terminalModule->outputs) {
-			for (Cable* cable : output.cables)
-				Cable_step(cable);
+	void cancel(Param* param) {
+		if (targetCount.load(std::memory_order_relaxed) == 0)
+			return;
+		lock();
+		const int i = findTarget(param);
+		if (i >= 0) {
+			removeTarget(i);
+			cancelSerial++;
 		}
-	} else {
-		terminalModule->processTerminalOutput(args);
+		unlock();
 	}
 
-	// Iterate ports to step plug lights
-	if (args.frame % 7 /* PORT_DIVIDER */ == 0) {
-		float portTime = args.sampleTime * 7 /* PORT_DIVIDER */;
-		for (Input& input : terminalModule->inputs) {
-			Port_step(&input, portTime);
+	/** Stops smoothing the params in the range [begin, end), such as all params of a module.
+	Must not be called while the audio thread is stepping.
+	*/
+	void cancelRange(Param* begin, Param* end) {
+		lock();
+		for (int i = targetCount - 1; i >= 0; i--) {
+			if (targetParams[i] >= begin && targetParams[i] < end)
+				removeTarget(i);
 		}
-		for (Output& output : terminalModule->outputs) {
-			Port_step(&output, portTime);
+		for (int i = count - 1; i >= 0; i--) {
+			if (params[i] >= begin && params[i] < end) {
+				count--;
+				params[i] = params[count];
+				values[i] = values[count];
+				targets[i] = targets[count];
+			}
 		}
+		unlock();
 	}
-}
-
 
-/** Steps a single frame
-*/
-static void Engine_stepFrame(Engine* that) {
-	Engine::Internal* internal = that->internal;
+	/** Receives the current targets, called by the audio thread at the start of each block.
+	If a writer holds the lock, the ramps of the previous block continue.
+	*/
+	void update() {
+		if (!tryLock())
+			return;
+		// Forget the targets reached during the previous block, unless they were changed meanwhile
+		for (int i = 0; i < count; i++) {
+			if (values[i] != targets[i])
+				continue;
+			const int t = findTarget(params[i]);
+			if (t >= 0 && targetValues[t] == targets[i])
+				removeTarget(t);
+		}
+		count = targetCount;
+		for (int i = 0; i < count; i++) {
+			params[i] = targetParams[i];
+			values[i] = params[i]->value;
+			targets[i] = targetValues[i];
+		}
+		serial = cancelSerial;
+		unlock();
+	}
 
-	// Param smoothing
-	Module* smoothModule = internal->smoothModule;
-	if (smoothModule) {
-		int smoothParamId = internal->smoothParamId;
-		float smoothValue = internal->smoothValue;
-		Param* smoothParam = &smoothModule->params[smoothParamId];
-		float value = smoothParam->value;
-		// Use decay rate of roughly 1 graphics frame
-		const float smoothLambda = 60.f;
-		float newValue = value + (smoothValue - value) * smoothLambda * internal->sampleTime;
-		if (value == newValue) {
-			// Snap to actual smooth value if the value doesn't change enough (due to the granularity of floats)
-			smoothParam->setValue(smoothValue);
-			internal->smoothModule = NULL;
-			internal->smoothParamId = 0;
+	/** Moves all params towards their targets by `lambda` of the remaining distance, called by the audio thread every frame.
+	*/
+	void step(float lambda) {
+		if (count == 0 || serial != cancelSerial.load(std::memory_order_relaxed))
+			return;
+		const simd::float_4 k = lambda;
+		for (int i = 0; i < count; i += 4) {
+			const simd::float_4 value = simd::float_4::load(&values[i]);
+			const simd::float_4 target = simd::float_4::load(&targets[i]);
+			simd::float_4 newValue = value + (target - value) * k;
+			// Snap to the target if the value doesn't change enough (due to the granularity of floats)
+			newValue = simd::ifelse(newValue == value, target, newValue);
+			newValue.store(&values[i]);
 		}
-		else {
-			smoothParam->setValue(newValue);
+		for (int i = 0; i < count; i++)
+			params[i]->setValue(values[i]);
+	}
+};
+
+
+/** Engine worker threads shared by every engine in the process, such as several plugin instances in the same host.
+There is one worker per core besides the audio thread, no matter how many engines exist.
+Engines borrow idle workers for a single block, up to their thread count setting and their share of the pool,
+so that many instances running together never oversubscribe the cores.
+The pool is shared among the engines currently stepping blocks, weighted by their worker priority,
+and each engine may borrow fewer workers to stay within its CPU budget, see Engine_updateCpuBudget().
+*/
+struct EngineWorkerPool {
+	/** Engines that stepped no block for this long, such as sleeping or bypassed instances, leave their share to the others.
+	*/
+	static constexpr const double kActiveTime = 0.5;
+
+	struct Worker {
+		EngineWorkerPool* pool;
+		std::thread thread;
+		/** Engine this worker is lent to, and its thread ID within it, guarded by the pool mutex.
+		*/
+		Engine* engine = NULL;
+		Context* context = NULL;
+		int id = 0;
+		/** Position of this worker in the pool, which decides its CPU when workers are pinned.
+		*/
+		int index = 0;
+		/** Scheduling this worker has applied to itself, only touched by the worker thread.
+		*/
+		int schedulingGeneration = 0;
+		bool realTime = false;
+		int cpu = -1;
+		/** Cleared by the engine at the end of a block, before releasing its workers from `engineBarrier`.
+		*/
+		std::atomic<bool> running{false};
+
+		void run();
+	};
+
+	/** Share of the pool of one engine, guarded by the pool mutex.
+	*/
+	struct Client {
+		int priority = 1;
+		double lastAcquireTime = -INFINITY;
+		/** Most workers the engine may borrow because of its CPU budget.
+		Not guarded by the mutex, only the engine uses it, from its audio thread or under its write lock.
+		*/
+		int budgetWorkers = INT_MAX;
+	};
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::vector<Worker*> workers;
+	std::vector<Worker*> idleWorkers;
+	bool quit = false;
+	std::vector<Client*> clients;
+	/** Scheduling of the workers, set by Engine_applyAudioThreadScheduling() and guarded by the mutex.
+	Each worker applies it to itself the next time it wakes up.
+	When pinned, workers take the CPUs after `firstCpu` in turn.
+	*/
+	int schedulingGeneration = 0;
+	bool realTime = false;
+	double realTimePeriod = 0.0;
+	int firstCpu = -1;
+
+	EngineWorkerPool() {
+#if !defined(__EMSCRIPTEN__) || defined(CARDINAL_WASM_THREADS)
+		const int workerCount = math::clamp((int) std::thread::hardware_concurrency() - 1, 0, 63);
+		workers.resize(workerCount);
+		for (int i = 0; i < workerCount; i++) {
+			Worker* const worker = new Worker;
+			worker->pool = this;
+			worker->index = i;
+			workers[i] = worker;
+			idleWorkers.push_back(worker);
+			worker->thread = std::thread([=] {
+				system::setThreadName(string::f("Worker %d", i + 1));
+				random::init();
+				const ScopedDenormalsFlush denormalsFlush;
+				worker->run();
+			});
 		}
+#endif
 	}
 
-	// Flip messages for each module
-	for (Module* module : internal->modules) {
-		if (module->leftExpander.messageFlipRequested) {
-			std::swap(module->leftExpander.producerMessage, module->leftExpander.consumerMessage);
-			module->leftExpander.messageFlipRequested = false;
+	~EngineWorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
 		}
-		if (module->rightExpander.messageFlipRequested) {
-			std::swap(module->rightExpander.producerMessage, module->rightExpander.consumerMessage);
-			module->rightExpander.messageFlipRequested = false;
+		cv.notify_all();
+		for (Worker* worker : workers) {
+			worker->thread.join();
+			delete worker;
 		}
 	}
 
-	// Build ProcessArgs
-	Module::ProcessArgs processArgs;
-	processArgs.sampleRate = internal->sampleRate;
-	processArgs.sampleTime = internal->sampleTime;
-	processArgs.frame = internal->frame;
+	void addClient(Client* client) {
+		std::lock_guard<std::mutex> lock(mutex);
+		clients.push_back(client);
+	}
 
-	// Process terminal inputs first
-	for (TerminalModule* terminalModule : internal->terminalModules) {
-		TerminalModule__doProcess(terminalModule, processArgs, true);
+	void removeClient(Client* client) {
+		std::lock_guard<std::mutex> lock(mutex);
+		clients.erase(std::remove(clients.begin(), clients.end(), client), clients.end());
 	}
 
-	// Step each module and cables
-	for (Module* module : internal->modules) {
-		module->doProcess(processArgs);
-		for (Output& output : module->outputs) {
-			for (Cable* cable : output.cables)
-				Cable_step(cable);
+	/** Lends up to `count` idle workers to an engine for one block, storing them in `borrowedWorkers`.
+	The engine gets no more than its share of the pool among the active engines, nor than its CPU budget allows.
+	`prepare` is called with the number of borrowed workers before any of them starts stepping the engine.
+	Called by the audio thread, so it gives up instead of waiting if the pool is busy.
+	*/
+	template <typename F>
+	void acquire(Engine* engine, Client* client, int count, std::vector<Worker*>& borrowedWorkers, F prepare) {
+		std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+		if (!lock.owns_lock()) {
+			prepare(0);
+			return;
+		}
+		const double now = system::getTime();
+		client->lastAcquireTime = now;
+		int activePriority = 0;
+		for (const Client* other : clients) {
+			if (now - other->lastAcquireTime < kActiveTime)
+				activePriority += other->priority;
+		}
+		if (activePriority > client->priority) {
+			const int share = ((int) workers.size() * client->priority + activePriority - 1) / activePriority;
+			count = std::min(count, share);
+		}
+		count = std::min(count, client->budgetWorkers);
+		while ((int) borrowedWorkers.size() < count && !idleWorkers.empty()) {
+			borrowedWorkers.push_back(idleWorkers.back());
+			idleWorkers.pop_back();
 		}
+		prepare(borrowedWorkers.size());
+		for (size_t i = 0; i < borrowedWorkers.size(); i++) {
+			Worker* const worker = borrowedWorkers[i];
+			worker->context = contextGet();
+			worker->id = i + 1;
+			worker->running = true;
+			worker->engine = engine;
+		}
+		lock.unlock();
+		if (!borrowedWorkers.empty())
+			cv.notify_all();
 	}
 
-	// Process terminal outputs last
-	for (TerminalModule* terminalModule : internal->terminalModules) {
-		TerminalModule__doProcess(terminalModule, processArgs, false);
+	/** Returns a worker to the pool once it left the engine, called by the worker itself.
+	*/
+	void release(Worker* worker) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			worker->engine = NULL;
+			worker->context = NULL;
+			idleWorkers.push_back(worker);
+		}
+		cv.notify_all();
 	}
 
-	++internal->frame;
-}
+	/** Waits until no worker is lent to `engine` anymore, before the engine is destroyed.
+	*/
+	void waitForEngine(Engine* engine) {
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [&] {
+			for (Worker* worker : workers) {
+				if (worker->engine == engine)
+					return false;
+			}
+			return true;
+		});
+	}
+};
 
 
-static void Port_setDisconnected(Port* that) {
-	that->channels = 0;
-	for (int c = 0; c < PORT_MAX_CHANNELS; c++) {
-		that->voltages[c] = 0.f;
+/** Hash of a (moduleId, paramId) pair for the ParamHandle cache.
+IDs are at most 53 bits, so the param ID is mixed into the bits above them.
+*/
+struct ParamHandleKeyHash {
+	size_t operator()(const std::tuple<int64_t, int>& key) const {
+		return std::hash<int64_t>()(std::get<0>(key) ^ ((int64_t) std::get<1>(key) << 53));
 	}
-}
-
+};
 
-static void Port_setConnected(Port* that) {
-	if (that->channels > 0)
-		return;
-	that->channels = 1;
-}
 
+/** Outputs of a frozen module, rendered offline by Engine_freezeModules() and played back instead of processing the module.
+The voltages of all recorded outputs are interleaved, `stride` voltages per frame, looping every `frames` frames.
+*/
+struct FrozenModule {
+	std::vector<int> outputIds;
+	std::vector<int> outputChannels;
+	int stride = 0;
+	int64_t frames = 0;
+	std::vector<float> voltages;
+};
 
-template<typename T>
-using IdentityDictionary = std::unordered_map<T, T>;
 
-template<typename T>
-inline bool dictContains(IdentityDictionary<T>& dict, T key) {
-	return dict.find(key) != dict.end();
-}
+/** Where the time went while loading a patch, per module, for spotting modules that are slow to load.
+*/
+struct LoadProfile {
+	struct ModuleTimes {
+		int64_t id = -1;
+		plugin::Model* model = NULL;
+		double createTime = 0.0;
+		double widgetTime = 0.0;
+		double fromJsonTime = 0.0;
+		double addTime = 0.0;
+	};
+
+	/** Steps before the engine is involved, like extracting the archive or parsing JSON, in order.
+	*/
+	std::vector<std::pair<std::string, double>> stages;
+	std::vector<ModuleTimes> modules;
+	double totalTime = 0.0;
+};
 
-template<typename T>
-inline void dictAdd(IdentityDictionary<T>& dict, T key) {
-	dict[key] = key;
-}
 
-static void Engine_storeTerminalModulesIDs(std::vector<TerminalModule*> terminalModules, IdentityDictionary<int64_t>& terminalModulesIDs) {
-	for (TerminalModule* terminalModule : terminalModules)
-		dictAdd(terminalModulesIDs, terminalModule->id);
-}
+/** Patch being parsed and its modules being constructed on a background thread, see Engine_beginPreparePatch().
+Everything but `thread` is only touched by that thread until it is joined.
+*/
+struct PreparingPatch {
+	std::thread thread;
+	std::function<json_t*()> parse;
+	bool timeParse = false;
+	json_t* rootJ = NULL;
+	std::exception_ptr error;
+	std::vector<size_t> moduleIndexes;
+	std::vector<plugin::Model*> models;
+	std::vector<Module*> modules;
+	std::vector<double> createTimes;
+	double parseTime = 0.0;
+	double createTime = 0.0;
+	/** ParamHandles that existed before, the ones added meanwhile belong to the new modules.
+	*/
+	std::set<ParamHandle*> paramHandles;
+};
 
-static void Engine_orderModule(Module* module, IdentityDictionary<Module*>& touchedModules, std::vector<Module*>& orderedModules, IdentityDictionary<int64_t>& terminalModulesIDs) {
-	if (!dictContains(touchedModules, module) && !dictContains(terminalModulesIDs, module->id)) { // Ignore feedback loops and terminal modules
-		dictAdd(touchedModules, module);
-		for (Output& output : module->outputs) {
-			for (Cable* cable : output.cables) {
-				Module* receiver = cable->inputModule; // The input to the cable is the receiving module
-				Engine_orderModule(receiver, touchedModules, orderedModules, terminalModulesIDs);
-			}
-		}
-		orderedModules.push_back(module);
-	}
-}
 
-static void Engine_assignOrderedModules(std::vector<Module*>& modules, std::vector<Module*>& orderedModules) {
-	std::reverse(orderedModules.begin(), orderedModules.end()); // These are stored bottom up
-	if (orderedModules.size() == modules.size()) {
-		for (unsigned int i = 0; i < orderedModules.size(); i++)
-			modules[i] = orderedModules[i];
-	}
-}
+/** Block processing time as a fraction of the block duration, since the last reset.
+Blocks taking longer than their duration are counted as xruns, as are blocks skipped while the engine was being modified.
+*/
+struct BlockStats {
+	/** Histogram bins are 2% of the block duration wide, the last one holds anything slower.
+	*/
+	static constexpr const int kBinsPerBlock = 50;
+	static constexpr const int kBinCount = 4 * kBinsPerBlock;
+	static constexpr const int kWorstBlockCount = 8;
+	static constexpr const int kWorstModuleCount = 3;
+
+	struct WorstBlock {
+		double load = 0.0;
+		double duration = 0.0;
+		double unixTime = 0.0;
+		int64_t frame = 0;
+		/** Slowest modules of the block, as timed on its first frame.
+		*/
+		int moduleCount = 0;
+		int64_t moduleIds[kWorstModuleCount];
+		plugin::Model* moduleModels[kWorstModuleCount];
+		double moduleTimes[kWorstModuleCount];
+	};
+
+	uint64_t counts[kBinCount] = {};
+	uint64_t blockCount = 0;
+	double maxLoad = 0.0;
+	/** Read by the meter without locking.
+	*/
+	std::atomic<uint64_t> xrunCount{0};
+	std::atomic<uint64_t> skippedCount{0};
+	/** MIDI events of skipped blocks that could not be kept for the next block, see Engine_addDroppedMidiEvents().
+	*/
+	std::atomic<uint64_t> droppedMidiCount{0};
+	/** Times the modules not reaching the host were skipped because of load, see Engine_updateLoadShedding().
+	*/
+	std::atomic<uint64_t> shedCount{0};
+	/** Slowest blocks first.
+	*/
+	WorstBlock worstBlocks[kWorstBlockCount];
+	int worstBlockCount = 0;
+};
 
-#if DEBUG_ORDERED_MODULES
-static void Engine_debugOrderedModules(std::vector<Module*>& modules) {
-	printf("\n--- Ordered modules ---\n");
-	for (unsigned int i = 0; i < modules.size(); i++)
-		printf("%d) %s - %ld\n", i, modules[i]->model->getFullName().c_str(), modules[i]->id);
-}
-#endif
 
-/** Order the modules so that they always read the most recent sample from their inputs
+/** Meter history of a module profile, only allocated while the sampled meters are shown, see Engine_setModuleMetersEnabled().
+`history` holds the average time per frame of each stretch of `kBlocksPerPoint` blocks, in seconds,
+so that it can be drawn like Rack's module meters.
 */
-static void Engine_orderModules(Engine* that) {
-	Engine::Internal* internal = that->internal;
+struct ModuleMeter {
+	static constexpr const int kHistoryLength = 64;
+	static constexpr const int kBlocksPerPoint = 32;
+
+	float history[kHistoryLength] = {};
+	std::atomic<int> historyIndex{0};
+	double pointTime = 0.0;
+	int pointBlocks = 0;
+};
 
-	IdentityDictionary<int64_t> terminalModulesIDs;
-	Engine_storeTerminalModulesIDs(internal->terminalModules, terminalModulesIDs);
 
-	IdentityDictionary<Module*> touchedModules;
-	std::vector<Module*> orderedModules; 
-	orderedModules.reserve(internal->modules.size());
+/** Sampled processing time of a module, from its first frame of each block.
+*/
+struct ModuleProfile {
+	/** Since the last reset.
+	*/
+	double totalTime = 0.0;
+	int64_t totalBlocks = 0;
+	std::unique_ptr<ModuleMeter> meter;
+};
+
+
+/** Activity of a cable since the cable stats were enabled or reset, see Engine_setCableStatsEnabled().
+The output voltages are sampled once per block, so brief changes in between samples are not seen.
+*/
+struct CableStats {
+	int64_t blocks = 0;
+	/** Blocks in which any channel differed from the block before.
+	*/
+	int64_t changedBlocks = 0;
+	int maxChannels = 0;
+	/** Channels that were ever non-zero or changed.
+	*/
+	uint32_t activeChannels = 0;
+	float lastVoltages[PORT_MAX_CHANNELS] = {};
+	double sums[PORT_MAX_CHANNELS] = {};
+	double squares[PORT_MAX_CHANNELS] = {};
+};
+
+
+struct Engine::Internal {
+	std::vector<Module*> modules;
+	std::vector<TerminalModule*> terminalModules;
+	std::vector<BlockModule*> blockModules;
+	std::vector<Cable*> cables;
+	std::set<ParamHandle*> paramHandles;
+	/** Modules with expander messages, collected every block so that message flips are only checked for them every frame.
+	*/
+	std::vector<Module*> expanderModules;
+
+	// moduleId
+	std::unordered_map<int64_t, Module*> modulesCache;
+	// cableId
+	std::unordered_map<int64_t, Cable*> cablesCache;
+	// (moduleId, paramId)
+	std::unordered_map<std::tuple<int64_t, int>, ParamHandle*, ParamHandleKeyHash> paramHandlesCache;
+
+	float sampleRate = 0.f;
+	float sampleTime = 0.f;
+	/** Sample rate given by setSampleRate(), the engine runs at `oversampling` times this rate.
+	*/
+	float hostSampleRate = 0.f;
+	int oversampling = 1;
+	/** Fixed number of host frames per engine block, or 0 to follow the host buffer size.
+	The plugin queues audio by this many frames and reports them as latency.
+	*/
+	int blockQuantum = 0;
+	/** Largest number of host frames the caller steps at once, see Engine_setMaxBufferSize().
+	Block modules are given buffers for `maxBlockFrames`, the largest engine block this allows with the current oversampling.
+	*/
+	int maxBufferSize = 512;
+	int maxBlockFrames = 512;
+	/** Audio thread scheduling of the native standalone, applied by Engine_applyAudioThreadScheduling().
+	`schedulingGeneration` is increased by the setters, the rest of the applied state is only touched by the audio thread.
+	*/
+	bool realTimeScheduling = false;
+	int audioThreadCpu = -1;
+	bool autoBufferSize = false;
+	std::atomic<int> schedulingGeneration{0};
+	int appliedSchedulingGeneration = 0;
+	double appliedBlockDuration = 0.0;
+	bool appliedRealTime = false;
+	int appliedCpu = -1;
+	int64_t block = 0;
+	int64_t frame = 0;
+	/** Whether modules record trace spans, only on the first frame of every 16th block while a trace is recorded.
+	*/
+	bool traceModules = false;
+	int64_t blockFrame = 0;
+	double blockTime = 0.0;
+	int blockFrames = 0;
+	/** Whether the last block was skipped because the engine was being modified.
+	*/
+	bool blockSkipped = false;
+	bool aboutToClose = false;
+
+	// Meter
+	int meterCount = 0;
+	double meterTotal = 0.0;
+	double meterMax = 0.0;
+	double meterLastTime = -INFINITY;
+	double meterLastAverage = 0.0;
+	double meterLastMax = 0.0;
+	double meterCpuTotal = 0.0;
+	double meterDurationTotal = 0.0;
+	double meterLastCpuLoad = 0.0;
+	/** Kept for spotting rare slow blocks, which the meter averages away within a second.
+	The audio thread only updates it if it gets the lock at once, readers copy it out.
+	*/
+	BlockStats blockStats;
+	std::mutex blockStatsMutex;
+	/** Time each module took on the first frame of the current block, by position in `modules`.
+	*/
+	std::vector<double> blockModuleTimes;
+	bool timeModules = false;
+	double secondsPerCycle = cyclecounter::getSecondsPerTick();
+	/** Sampled profile of each module, added and removed with the module.
+	`moduleProfilePointers` follows the order of `modules`, and is rebuilt by the audio thread along with `dormantModules`.
+	*/
+	std::unordered_map<Module*, ModuleProfile> moduleProfiles;
+	std::vector<ModuleProfile*> moduleProfilePointers;
+	/** Increased to reset the profile totals, which the audio thread then does itself.
+	*/
+	std::atomic<int> moduleProfileResetGeneration{0};
+	int appliedModuleProfileResetGeneration = 0;
+	/** Whether module profiles have a meter, changed under the writer lock.
+	*/
+	bool moduleMetersEnabled = false;
+	/** Activity of each cable while enabled, entries follow `cables` and are only added or removed under the writer lock.
+	*/
+	std::unordered_map<Cable*, CableStats> cableStats;
+	bool cableStatsEnabled = false;
+	std::atomic<int> cableStatsResetGeneration{0};
+	int appliedCableStatsResetGeneration = 0;
+	/** Triple buffered UI snapshots.
+	The audio thread fills `uiSnapshots[uiSnapshotBack]` and swaps it with the shared one, the UI swaps that one with `uiSnapshotFront` when it is newer.
+	`uiSnapshotShared` is the index of the shared one, with kUiSnapshotFresh set until the UI takes it.
+	*/
+	UiSnapshot uiSnapshots[3];
+	int uiSnapshotBack = 0;
+	int uiSnapshotFront = 1;
+	std::atomic<int> uiSnapshotShared{2};
+	/** When the UI last asked for a snapshot, they are only taken while it keeps asking.
+	*/
+	std::atomic<double> uiSnapshotReadTime{0.0};
+	/** Sizes the audio thread had no room for, the UI grows each snapshot it takes hold of to fit them.
+	*/
+	std::atomic<size_t> uiSnapshotModuleCount{0};
+	std::atomic<size_t> uiSnapshotCableCount{0};
+	std::atomic<size_t> uiSnapshotLightCount{0};
+	std::atomic<size_t> uiSnapshotParamCount{0};
+
+	// Parameter smoothing
+	ParamSmoother paramSmoother;
+
+	// Multi-threading, disabled while threadCount <= 1
+	/** Number of threads stepping the current block, the audio thread and the borrowed workers.
+	*/
+	int threadCount = 1;
+	DISTRHO_NAMESPACE::SharedResourcePointer<EngineWorkerPool> workerPool;
+	std::vector<EngineWorkerPool::Worker*> workers;
+	/** Share of this engine in the worker pool, weighted by its priority when shared with other engines.
+	*/
+	EngineWorkerPool::Client workerPoolClient;
+	/** CPU time the borrowed workers spent in this engine, in nanoseconds.
+	Workers add it as they leave the engine, so it is counted along with the block after theirs.
+	*/
+	std::atomic<int64_t> workerCpuTime{0};
+	/** Most CPU time this engine may take, in cores, or 0 for no limit. A per-patch setting.
+	*/
+	float cpuBudget = 0.f;
+	/** Recent CPU time per block duration of the audio thread and workers, in cores.
+	*/
+	double cpuLoad = 0.0;
+	/** Time since the budget last changed the number of workers, so that `cpuLoad` can follow before the next change.
+	*/
+	double cpuBudgetChangeTime = 0.0;
+	/** Whether the engine is over its CPU budget with no workers left to give up, which makes it shed if enabled.
+	*/
+	bool overCpuBudget = false;
+	HybridBarrier engineBarrier;
+	SpinBarrier workerBarrier;
+	std::atomic<int> workerModuleIndex{0};
+	/** Index into `modules` where each dependency level begins, plus a final entry for the end of `modules`.
+	Modules within the same level have no cables between them, so they can be processed concurrently.
+	*/
+	std::vector<int> levelStarts;
+	/** Dependency level of each module in `modules`.
+	Cables always connect modules of different levels, and the module with the lower level is processed first.
+	*/
+	std::unordered_map<Module*, int> moduleLevels;
+	/** Cables connected to the inputs of each module, the counterpart of `Output::cables`.
+	*/
+	std::unordered_map<Module*, std::vector<Cable*>> moduleInputCables;
+
+	/** Skip modules that cannot reach a terminal module through cables or expanders, a per-patch setting.
+	*/
+	bool skipDormantModules = false;
+	/** Skip the modules not reaching a terminal module only while blocks come close to their deadline, a per-patch setting.
+	Scopes, meters and other visual-only modules are then the first to go, see Engine_updateLoadShedding().
+	*/
+	bool loadShedding = false;
+	/** Whether the audio thread is currently shedding, and how long blocks have been light enough to stop.
+	*/
+	std::atomic<bool> shedding{false};
+	double sheddingQuietTime = 0.0;
+	/** Set when modules, cables or expanders change, so that dormant modules are found again before the next block.
+	*/
+	bool dormantModulesDirty = true;
+	/** Whether each module in `modules` is skipped, by position.
+	*/
+	std::vector<uint8_t> dormantModules;
+	/** Last module the user interacted with, which is woken up even if dormant.
+	Written by the UI thread, taken by the audio thread at the start of each block.
+	*/
+	std::atomic<Module*> touchedModule{NULL};
+	/** Modules woken up by user interaction, and the frame at which they can become dormant again.
+	A fixed table, the audio thread replaces the entry expiring first when it is full.
+	*/
+	struct WokenModule {
+		Module* module = NULL;
+		int64_t frame = 0;
+	};
+	static constexpr const int kWokenModuleCount = 8;
+	WokenModule wokenModules[kWokenModuleCount];
+	/** Scratch space of Engine_updateDormantModules(), sized when modules are added so that the audio thread does not allocate.
+	`dormantModuleIndexes` has a key for every module in `modules`, its values are only set by the walk.
+	*/
+	std::unordered_map<Module*, int> dormantModuleIndexes;
+	std::vector<uint8_t> reachableModules;
+	std::vector<Module*> reachableStack;
+
+	/** Frozen modules and their recorded outputs, see Engine_freezeModules().
+	`frozenModulePointers` follows the order of `modules`, and is rebuilt by the audio thread along with `dormantModules`.
+	*/
+	std::unordered_map<Module*, FrozenModule> frozenModules;
+	std::vector<FrozenModule*> frozenModulePointers;
+	/** Host transport position in engine frames, given by Engine_setTransportFrame(), or -1 while stopped.
+	Frozen modules play back from `freezeFrame`, which jumps to the transport position whenever it moves and runs on its own otherwise.
+	*/
+	std::atomic<int64_t> transportFrame{-1};
+	int64_t lastTransportFrame = -1;
+	int64_t freezeFrame = 0;
+
+	/** Flattened cable routing table, as structure-of-arrays.
+	Cables are grouped by the position of their output module in `modules`,
+	so the cables of `modules[i]` are in the range [moduleCableStarts[i], moduleCableStarts[i + 1]).
+	*/
+	std::vector<Output*> cableOutputs;
+	std::vector<Input*> cableInputs;
+	std::vector<int> moduleCableStarts;
+	/** Cable routes of the terminal modules, stepped by themselves instead of through the table above.
+	The cables of `terminalModules[i]` are in the range [terminalCableStarts[i], terminalCableStarts[i + 1]).
+	Rebuilt before the next block when cables or terminal modules change, so the audio loop never walks `Output::cables`.
+	*/
+	std::vector<Output*> terminalCableOutputs;
+	std::vector<Input*> terminalCableInputs;
+	std::vector<int> terminalCableStarts;
+	bool terminalCableRoutesDirty = true;
+
+	/** Set when modules or cables change, so that feedback cycles are found again before the next block.
+	*/
+	bool moduleCyclesDirty = true;
+	/** Strongly connected component of each module in `modules` that is part of a feedback cycle, by position, or -1 if it is in none.
+	Only these modules depend on the one-sample delay of feedback cables, everything else could be stepped a block at a time.
+	*/
+	std::vector<int> moduleCycles;
+	/** Whether each cable of the routing table closes a cycle, by route.
+	The receiving module of these cables is processed before the sending one, so it reads the sample of the previous frame.
+	*/
+	std::vector<uint8_t> cableDelays;
+	int moduleCycleCount = 0;
+	/** Longest delay in engine frames from the terminal module outputs to their inputs, through modules implementing ModuleLatency.
+	Updated together with the cycles, feedback cables are not followed.
+	*/
+	int latency = 0;
+	/** Modules implementing ModuleLatency and the latency they had when `latency` was computed.
+	Checked every block, so that modules may change their latency at runtime.
+	*/
+	std::vector<std::pair<ModuleLatency*, int>> moduleLatencies;
+	/** Modules implementing ModuleFreeRunning, collected along with `moduleLatencies`.
+	*/
+	std::vector<ModuleFreeRunning*> freeRunningModules;
+	/** Silence after which the plugin stops stepping the engine, in seconds, or 0 to never sleep. A per-patch setting.
+	*/
+	float idleSleepTime = 0.f;
+	/** Recent cycle decompositions, keyed by a hash of the routing table and checked against a copy of it.
+	Patches switched between a few topologies, by mute or cable switching modules, reuse them without running Tarjan again.
+	Cleared when a module is removed, since its address may be reused by another one.
+	The vectors of every entry are reserved along with the scratch space below, and only filled in place by the audio thread.
+	*/
+	struct ModuleCyclesEntry {
+		bool valid = false;
+		uint64_t hash = 0;
+		std::vector<Module*> modules;
+		std::vector<Input*> cableInputs;
+		std::vector<int> moduleCableStarts;
+		std::vector<Input*> terminalCableInputs;
+		std::vector<int> receivers;
+		std::vector<int> terminalReceivers;
+		std::vector<int> moduleCycles;
+		std::vector<uint8_t> cableDelays;
+		int moduleCycleCount = 0;
+	};
+	static constexpr const int kModuleCyclesCacheSize = 4;
+	ModuleCyclesEntry moduleCyclesCache[kModuleCyclesCacheSize];
+	int moduleCyclesCacheNext = 0;
+	/** Scratch space of Engine_updateModuleCycles(), reserved by Engine_reserveModuleCycles() under the writer lock so that the audio thread does not allocate.
+	`cycleInputModules` has a key for every input of the modules in `modules`, its values are only set by the cycle search.
+	*/
+	std::unordered_map<const Input*, int> cycleInputModules;
+	std::vector<int> cycleIndexes;
+	std::vector<int> cycleLowLinks;
+	std::vector<uint8_t> cycleOnStack;
+	std::vector<int> cycleStack;
+	std::vector<std::pair<int, int>> cycleCallStack;
+	std::vector<int> latencyArrivals;
+
+	/** Set by a saving thread so that the audio thread captures ModuleSnapshot states after its next block.
+	Cleared under `snapshotMutex` once done, which wakes up the saving thread.
+	*/
+	std::atomic<bool> snapshotRequested{false};
+	std::mutex snapshotMutex;
+	std::condition_variable snapshotCv;
+
+	/** Patch given to Engine_preparePatch(), and its modules created while the current patch keeps running, with their index in "modules".
+	Engine::fromJson() takes them when loading the same patch, so that the engine only stops for loading module data and swapping.
+	*/
+	json_t* preparedRootJ = NULL;
+	std::vector<std::pair<size_t, Module*>> preparedModules;
+	/** Patch still being prepared on a background thread, until Engine_finishPreparePatch().
+	*/
+	PreparingPatch* preparingPatch = NULL;
+	/** ParamHandles added by the constructors of the prepared modules, kept by clear().
+	*/
+	std::set<ParamHandle*> preparedParamHandles;
+
+	/** Profile of the last patch loaded, and the one being built for the next load.
+	Creation times of prepared modules are kept in the pending one until the patch is swapped in.
+	*/
+	LoadProfile loadProfile;
+	std::mutex loadProfileMutex;
+	LoadProfile pendingLoadProfile;
+	std::unordered_map<Module*, LoadProfile::ModuleTimes> pendingModuleTimes;
+
+	/** Mutex that guards the Engine state, such as settings, Modules, and Cables.
+	Writers lock when mutating the engine's state.
+	Readers lock when using the engine's state or stepping the block.
+	The audio thread only ever tries to lock it, and skips the block if a writer holds it.
+	*/
+	SharedMutex mutex;
+	/** Thread holding the writer lock across a batch of edits, and how many times it began one, see Engine_beginEdits().
+	*/
+	std::atomic<std::thread::id> editThread{std::thread::id()};
+	int editDepth = 0;
+};
+
+
+/** Returns whether the calling thread holds the writer lock for a batch of edits.
+*/
+static inline bool Engine_isEditing(Engine::Internal* internal) {
+	return internal->editThread.load(std::memory_order_relaxed) == std::this_thread::get_id();
+}
+
+
+/** Writer and reader locks of the engine mutex for API calls, skipped while the calling thread holds it for a batch of edits.
+*/
+struct EngineWriteLock {
+	SharedMutex* const mutex;
+
+	explicit EngineWriteLock(Engine::Internal* internal) : mutex(Engine_isEditing(internal) ? NULL : &internal->mutex) {
+		if (mutex)
+			mutex->lock();
+	}
+	~EngineWriteLock() {
+		if (mutex)
+			mutex->unlock();
+	}
+};
+
+
+struct EngineReadLock {
+	SharedMutex* const mutex;
+
+	explicit EngineReadLock(Engine::Internal* internal) : mutex(Engine_isEditing(internal) ? NULL : &internal->mutex) {
+		if (mutex)
+			mutex->lock_shared();
+	}
+	~EngineReadLock() {
+		if (mutex)
+			mutex->unlock_shared();
+	}
+};
+
+
+static void Engine_updateExpander_NoLock(Engine* that, Module* module, bool side) {
+	Module::Expander& expander = side ? module->rightExpander : module->leftExpander;
+	Module* oldExpanderModule = expander.module;
+
+	if (expander.moduleId >= 0) {
+		if (!expander.module || expander.module->id != expander.moduleId) {
+			expander.module = that->getModule_NoLock(expander.moduleId);
+		}
+	}
+	else {
+		if (expander.module) {
+			expander.module = NULL;
+		}
+	}
+
+	if (expander.module != oldExpanderModule) {
+		that->internal->dormantModulesDirty = true;
+		// Dispatch ExpanderChangeEvent
+		Module::ExpanderChangeEvent e;
+		e.side = side;
+		module->onExpanderChange(e);
+	}
+}
+
+
+static bool Module_hasExpanderMessages(Module* module) {
+	return module->leftExpander.producerMessage || module->leftExpander.consumerMessage
+		|| module->rightExpander.producerMessage || module->rightExpander.consumerMessage;
+}
+
+
+/** Counts one more frame for the constant and silent input hints if `holds`, otherwise starts over.
+*/
+static inline uint32_t Input_countHintFrames(uint32_t frames, bool holds) {
+	return holds ? frames + (frames != UINT32_MAX) : 0;
+}
+
+
+/** Returns whether the cables of `output` are to be stepped on this frame, control rate outputs only update them every few frames.
+*/
+static inline bool Output_isCableDue(const Output* output, int64_t frame) {
+	return (frame & output->controlRateMask) == 0;
+}
+
+
+static void Cable_step(Output* output, Input* input) {
+	// Match number of polyphonic channels to output port
+	const int channels = output->channels;
+
+	// Fast path for monophonic cables
+	if (channels == 1 && input->channels <= 1) {
+		const float v = output->voltages[0];
+		// Set 0V if infinite or NaN
+		const float w = std::isfinite(v) ? v : 0.f;
+		input->constantFrames = Input_countHintFrames(input->constantFrames, input->channels == 1 && w == input->voltages[0]);
+		input->silentFrames = Input_countHintFrames(input->silentFrames, w == 0.f);
+		input->voltages[0] = w;
+		input->channels = 1;
+		return;
+	}
+
+	// Copy all voltages from output to input, 4 channels at a time.
+	// Set 0V if infinite or NaN (all exponent bits set), and for channels higher than the output's channel count.
+	const simd::int32_4 exponentMask = 0x7f800000;
+	const simd::float_4 zero = simd::float_4::zero();
+	int changed = 0;
+	int nonzero = 0;
+	for (int c = 0; c < PORT_MAX_CHANNELS; c += 4) {
+		const simd::float_4 v = simd::float_4::load(&output->voltages[c]);
+		const simd::int32_4 finite = (simd::int32_4::cast(v) & exponentMask) != exponentMask;
+		const simd::int32_4 active = simd::int32_4(c, c + 1, c + 2, c + 3) < channels;
+		const simd::float_4 w = v & simd::float_4::cast(finite & active);
+		changed |= simd::movemask(w != simd::float_4::load(&input->voltages[c]));
+		nonzero |= simd::movemask(w != zero);
+		w.store(&input->voltages[c]);
+	}
+	input->constantFrames = Input_countHintFrames(input->constantFrames, changed == 0 && input->channels == channels);
+	input->silentFrames = Input_countHintFrames(input->silentFrames, nonzero == 0);
+	input->channels = channels;
+}
+
+
+#ifndef HEADLESS
+/** Steps the plug lights of terminal module ports, see Engine_stepTerminalPlugLights().
+*/
+static void Port_step(Port* that, float deltaTime) {
+	// Set plug lights
+	if (that->channels == 0) {
+		that->plugLights[0].setBrightness(0.f);
+		that->plugLights[1].setBrightness(0.f);
+		that->plugLights[2].setBrightness(0.f);
+	}
+	else if (that->channels == 1) {
+		float v = that->getVoltage() / 10.f;
+		that->plugLights[0].setSmoothBrightness(-v, deltaTime);
+		that->plugLights[1].setSmoothBrightness(v, deltaTime);
+		that->plugLights[2].setBrightness(0.f);
+	}
+	else {
+		float v = that->getVoltageRMS() / 10.f;
+		that->plugLights[0].setBrightness(0.f);
+		that->plugLights[1].setBrightness(0.f);
+		that->plugLights[2].setSmoothBrightness(v, deltaTime);
+	}
+}
+#endif
+
+
+static void TerminalModule__doProcess(Engine::Internal* internal, int terminalIndex, const Module::ProcessArgs& args, bool input) {
+	TerminalModule* const terminalModule = internal->terminalModules[terminalIndex];
+
+	// Step module
+	Engine_setCurrentModule(terminalModule);
+	if (input) {
+		terminalModule->processTerminalInput(args);
+		Output* const* const outputs = internal->terminalCableOutputs.data();
+		Input* const* const inputs = internal->terminalCableInputs.data();
+		const int end = internal->terminalCableStarts[terminalIndex + 1];
+		for (int c = internal->terminalCableStarts[terminalIndex]; c < end; c++) {
+			if (Output_isCableDue(outputs[c], args.frame))
+				Cable_step(outputs[c], inputs[c]);
+		}
+	} else {
+		terminalModule->processTerminalOutput(args);
+	}
+	Engine_setCurrentModule(NULL);
+
+	// Plug lights are stepped from the UI thread, see Engine_stepTerminalPlugLights()
+}
+
+
+/** Hints the CPU to start loading the memory touched when stepping `modules[moduleIndex]`.
+Modules and ports are allocated separately by plugins, so they are scattered in memory.
+Fetching the next module and the inputs its cables write to overlaps those cache misses with the current module's processing.
+*/
+static inline void Engine_prefetchModule(Engine::Internal* internal, int moduleIndex) {
+#if defined(__GNUC__) || defined(__clang__)
+	__builtin_prefetch(internal->modules[moduleIndex], 0, 3);
+	Input* const* const inputs = internal->cableInputs.data();
+	const int begin = internal->moduleCableStarts[moduleIndex];
+	const int end = std::min(internal->moduleCableStarts[moduleIndex + 1], begin + 4);
+	for (int c = begin; c < end; c++)
+		__builtin_prefetch(inputs[c], 1, 3);
+#else
+	(void) internal;
+	(void) moduleIndex;
+#endif
+}
+
+
+/** Steps all cables coming out of `modules[moduleIndex]`, using the flattened routing table.
+*/
+static void Engine_stepModuleCables(Engine::Internal* internal, int moduleIndex, int64_t frame) {
+	Output* const* const outputs = internal->cableOutputs.data();
+	Input* const* const inputs = internal->cableInputs.data();
+	const int end = internal->moduleCableStarts[moduleIndex + 1];
+	for (int c = internal->moduleCableStarts[moduleIndex]; c < end; c++) {
+		if (Output_isCableDue(outputs[c], frame))
+			Cable_step(outputs[c], inputs[c]);
+	}
+}
+
+
+/** Writes the recorded outputs of a frozen module for the given playback frame.
+*/
+static inline void FrozenModule_play(const FrozenModule* frozen, Module* module, int64_t frame) {
+	// Nothing outside the group listens to this one
+	if (frozen->stride == 0)
+		return;
+	const float* voltages = &frozen->voltages[(frame % frozen->frames) * frozen->stride];
+	const size_t outputCount = frozen->outputIds.size();
+	for (size_t i = 0; i < outputCount; i++) {
+		Output& output = module->outputs[frozen->outputIds[i]];
+		const int channels = frozen->outputChannels[i];
+		output.channels = channels;
+		std::memcpy(output.voltages, voltages, sizeof(float) * channels);
+		voltages += channels;
+	}
+}
+
+
+/** Processes `modules[moduleIndex]`, timing it with the cycle counter on the first frame of each block
+for the block stats and module profiles, and recording a trace span for it on the frames sampled by `traceModules`.
+*/
+static inline void Engine_processModule(Engine::Internal* internal, int moduleIndex, const Module::ProcessArgs& args) {
+	Module* const module = internal->modules[moduleIndex];
+	if (const FrozenModule* const frozen = internal->frozenModulePointers[moduleIndex]) {
+		FrozenModule_play(frozen, module, internal->freezeFrame);
+		return;
+	}
+	if (!internal->timeModules) {
+		module->doProcess(args);
+		return;
+	}
+	const perftrace::Scope trace(module->model->plugin->slug.c_str(), module->model->slug.c_str(), internal->traceModules);
+	const uint64_t startCycles = cyclecounter::now();
+	module->doProcess(args);
+	internal->blockModuleTimes[moduleIndex] = (cyclecounter::now() - startCycles) * internal->secondsPerCycle;
+}
+
+
+/** Steps the modules of each dependency level, one level at a time.
+All engine threads run this concurrently, sharing the modules of a level through `workerModuleIndex`.
+*/
+static void Engine_stepWorker(Engine* that, int threadId) {
+	Engine::Internal* internal = that->internal;
+
+	// Build ProcessArgs
+	Module::ProcessArgs processArgs;
+	processArgs.sampleRate = internal->sampleRate;
+	processArgs.sampleTime = internal->sampleTime;
+	processArgs.frame = internal->frame;
+
+	const int levelCount = (int) internal->levelStarts.size() - 1;
+	for (int l = 0; l < levelCount; l++) {
+		const int levelEnd = internal->levelStarts[l + 1];
+
+		// Step each module and cables of this level
+		while (true) {
+			const int i = internal->workerModuleIndex++;
+			if (i >= levelEnd)
+				break;
+
+			if (internal->dormantModules[i])
+				continue;
+
+			// Another thread likely takes the next module, but the inputs this one's cables write to are still fetched ahead
+			Engine_prefetchModule(internal, i);
+			Engine_setCurrentModule(internal->modules[i]);
+			Engine_processModule(internal, i, processArgs);
+			Engine_stepModuleCables(internal, i, processArgs.frame);
+		}
+		Engine_setCurrentModule(NULL);
+
+		// Wait for all threads to finish this level, then point the shared index to the start of the next one
+		internal->workerBarrier.wait([=]{
+			internal->workerModuleIndex = levelEnd;
+		});
+	}
+}
+
+
+void EngineWorkerPool::Worker::run() {
+	while (true) {
+		Engine* engine;
+		bool newRealTime = realTime;
+		double newPeriod = 0.0;
+		int newCpu = cpu;
+		bool schedulingChanged = false;
+		{
+			std::unique_lock<std::mutex> lock(pool->mutex);
+			pool->cv.wait(lock, [&] {
+				return this->engine != NULL || pool->quit;
+			});
+			if (pool->quit)
+				break;
+			engine = this->engine;
+			contextSet(context);
+			if (schedulingGeneration != pool->schedulingGeneration) {
+				schedulingGeneration = pool->schedulingGeneration;
+				schedulingChanged = true;
+				newRealTime = pool->realTime;
+				newPeriod = pool->realTimePeriod;
+				newCpu = pool->firstCpu >= 0 ? (pool->firstCpu + index) % threadsched::getCpuCount() : -1;
+			}
+		}
+
+		// Leave the scheduling alone unless it was asked for, the host may have set its own
+		if (schedulingChanged) {
+			if (newRealTime || realTime)
+				threadsched::setCurrentThreadRealTime(newRealTime, newPeriod);
+			if (newCpu != cpu)
+				threadsched::setCurrentThreadAffinity(newCpu);
+			realTime = newRealTime;
+			cpu = newCpu;
+		}
+
+		// Step frames with the engine until the end of its block, waiting on its barriers counts towards its CPU time
+		const double cpuStartTime = system::getThreadTime();
+		while (true) {
+			engine->internal->engineBarrier.wait();
+			if (!running)
+				break;
+			rtaudit::enter();
+			Engine_stepWorker(engine, id);
+			rtaudit::leave();
+		}
+		const double cpuTime = system::getThreadTime() - cpuStartTime;
+		engine->internal->workerCpuTime.fetch_add((int64_t) (cpuTime * 1e9), std::memory_order_relaxed);
+
+		pool->release(this);
+	}
+}
+
+
+/** Steps a single frame
+*/
+static void Engine_stepFrame(Engine* that) {
+	Engine::Internal* internal = that->internal;
+
+	// Param smoothing
+	// Use decay rate of roughly 1 graphics frame
+	const float smoothLambda = 60.f;
+	internal->paramSmoother.step(smoothLambda * internal->sampleTime);
+
+	// Flip messages for each module that has them
+	for (Module* module : internal->expanderModules) {
+		if (module->leftExpander.messageFlipRequested) {
+			std::swap(module->leftExpander.producerMessage, module->leftExpander.consumerMessage);
+			module->leftExpander.messageFlipRequested = false;
+		}
+		if (module->rightExpander.messageFlipRequested) {
+			std::swap(module->rightExpander.producerMessage, module->rightExpander.consumerMessage);
+			module->rightExpander.messageFlipRequested = false;
+		}
+	}
+
+	// Build ProcessArgs
+	Module::ProcessArgs processArgs;
+	processArgs.sampleRate = internal->sampleRate;
+	processArgs.sampleTime = internal->sampleTime;
+	processArgs.frame = internal->frame;
+
+	// Process terminal inputs first
+	const int terminalModuleCount = internal->terminalModules.size();
+	for (int i = 0; i < terminalModuleCount; i++) {
+		TerminalModule__doProcess(internal, i, processArgs, true);
+	}
+
+	// Step each module and cables
+	if (internal->threadCount > 1) {
+		// Workers are all waiting on engineBarrier, so it is safe to reset their shared index here
+		internal->workerModuleIndex = 0;
+		internal->engineBarrier.wait();
+		Engine_stepWorker(that, 0);
+	}
+	else {
+		const int moduleCount = internal->modules.size();
+		for (int i = 0; i < moduleCount; i++) {
+			if (i + 1 < moduleCount && !internal->dormantModules[i + 1])
+				Engine_prefetchModule(internal, i + 1);
+			if (internal->dormantModules[i])
+				continue;
+			Engine_setCurrentModule(internal->modules[i]);
+			Engine_processModule(internal, i, processArgs);
+			Engine_stepModuleCables(internal, i, processArgs.frame);
+		}
+		Engine_setCurrentModule(NULL);
+	}
+
+	// Process terminal outputs last
+	for (int i = 0; i < terminalModuleCount; i++) {
+		TerminalModule__doProcess(internal, i, processArgs, false);
+	}
+
+	++internal->frame;
+	++internal->freezeFrame;
+}
+
+
+static void Port_setDisconnected(Port* that) {
+	that->channels = 0;
+	for (int c = 0; c < PORT_MAX_CHANNELS; c++) {
+		that->voltages[c] = 0.f;
+	}
+	// Disconnected inputs stay at 0V
+	that->constantFrames = that->silentFrames = UINT32_MAX;
+}
+
+
+static void Port_setConnected(Port* that) {
+	if (that->channels > 0)
+		return;
+	that->channels = 1;
+	that->constantFrames = that->silentFrames = 0;
+}
+
+
+/** Returns the dependency level of a module, or -1 if it is not part of the processing order, like terminal modules.
+*/
+static int Engine_getModuleLevel(Engine::Internal* internal, Module* module) {
+	auto it = internal->moduleLevels.find(module);
+	if (it == internal->moduleLevels.end())
+		return -1;
+	return it->second;
+}
+
+
+/** Returns the position of a module in `modules`, only searching within its level.
+*/
+static int Engine_getModuleIndex(Engine::Internal* internal, Module* module, int level) {
+	const auto begin = internal->modules.begin();
+	const auto end = begin + internal->levelStarts[level + 1];
+	auto it = std::find(begin + internal->levelStarts[level], end, module);
+	DISTRHO_SAFE_ASSERT_RETURN(it != end, -1);
+	return it - begin;
+}
+
+
+/** Calls `f(neighbor, neighborLevel)` for every module in the processing order that is connected to `module` by a cable, except `skipCable`.
+*/
+template <typename F>
+static void Engine_forEachNeighbor(Engine::Internal* internal, Module* module, Cable* skipCable, F f) {
+	for (Output& output : module->outputs) {
+		for (Cable* cable : output.cables) {
+			if (cable == skipCable || cable->inputModule == module)
+				continue;
+			const int level = Engine_getModuleLevel(internal, cable->inputModule);
+			if (level >= 0)
+				f(cable->inputModule, level);
+		}
+	}
+	auto it = internal->moduleInputCables.find(module);
+	if (it == internal->moduleInputCables.end())
+		return;
+	for (Cable* cable : it->second) {
+		if (cable == skipCable || cable->outputModule == module)
+			continue;
+		const int level = Engine_getModuleLevel(internal, cable->outputModule);
+		if (level >= 0)
+			f(cable->outputModule, level);
+	}
+}
+
+
+/** Moves a module to the end of another level, keeping `modules`, `levelStarts` and the cable routing table in sync.
+Only the modules between its old and new position are shifted.
+*/
+static void Engine_setModuleLevel(Engine::Internal* internal, Module* module, int level) {
+	const int oldLevel = Engine_getModuleLevel(internal, module);
+	DISTRHO_SAFE_ASSERT_RETURN(oldLevel >= 0,);
+	if (level == oldLevel)
+		return;
+	const int i = Engine_getModuleIndex(internal, module, oldLevel);
+	DISTRHO_SAFE_ASSERT_RETURN(i >= 0,);
+	internal->moduleLevels[module] = level;
+
+	std::vector<int>& levelStarts = internal->levelStarts;
+	std::vector<int>& cableStarts = internal->moduleCableStarts;
+	// Add empty levels at the end, they are filled by the module
+	while ((int) levelStarts.size() < level + 2)
+		levelStarts.push_back(levelStarts.back());
+
+	const auto modulesBegin = internal->modules.begin();
+	const auto outputsBegin = internal->cableOutputs.begin();
+	const auto inputsBegin = internal->cableInputs.begin();
+	const int cableCount = cableStarts[i + 1] - cableStarts[i];
+
+	if (level > oldLevel) {
+		// Shift the following modules back by one, along with their cables
+		const int j = levelStarts[level + 1] - 1;
+		std::rotate(modulesBegin + i, modulesBegin + i + 1, modulesBegin + j + 1);
+		std::rotate(outputsBegin + cableStarts[i], outputsBegin + cableStarts[i + 1], outputsBegin + cableStarts[j + 1]);
+		std::rotate(inputsBegin + cableStarts[i], inputsBegin + cableStarts[i + 1], inputsBegin + cableStarts[j + 1]);
+		for (int k = i; k <= j; k++)
+			cableStarts[k] = cableStarts[k + 1] - cableCount;
+		for (int l = oldLevel + 1; l <= level; l++)
+			levelStarts[l]--;
+	}
+	else {
+		// Shift the preceding modules forward by one, along with their cables
+		const int j = levelStarts[level + 1];
+		std::rotate(modulesBegin + j, modulesBegin + i, modulesBegin + i + 1);
+		std::rotate(outputsBegin + cableStarts[j], outputsBegin + cableStarts[i], outputsBegin + cableStarts[i + 1]);
+		std::rotate(inputsBegin + cableStarts[j], inputsBegin + cableStarts[i], inputsBegin + cableStarts[i + 1]);
+		for (int k = i; k > j; k--)
+			cableStarts[k] = cableStarts[k - 1] + cableCount;
+		for (int l = level + 1; l <= oldLevel; l++)
+			levelStarts[l]++;
+	}
+
+	// Remove empty levels at the end
+	while (levelStarts.size() > 2 && levelStarts[levelStarts.size() - 2] == levelStarts.back())
+		levelStarts.pop_back();
+}
+
+
+/** Returns whether `target` is processed after `module` because of a chain of cables.
+Only modules with a level up to `targetLevel` can be part of such a chain, so the search stays close to both modules.
+*/
+static bool Engine_isModuleFollowedBy(Engine::Internal* internal, Module* module, Module* target, int targetLevel, Cable* skipCable) {
+	std::vector<Module*> stack;
+	std::unordered_set<Module*> visited;
+	stack.push_back(module);
+	visited.insert(module);
+	bool found = false;
+	while (!stack.empty() && !found) {
+		Module* m = stack.back();
+		stack.pop_back();
+		const int level = internal->moduleLevels[m];
+		Engine_forEachNeighbor(internal, m, skipCable, [&](Module* neighbor, int neighborLevel) {
+			if (neighborLevel <= level || neighborLevel > targetLevel)
+				return;
+			if (neighbor == target)
+				found = true;
+			else if (visited.insert(neighbor).second)
+				stack.push_back(neighbor);
+		});
+	}
+	return found;
+}
+
+
+/** Raises a module to at least `level`, and then every module following it that would otherwise not be processed after it.
+Modules are visited by their previous level, so each of them is moved at most once.
+The direction of each cable is decided by the previous levels, since raised modules can temporarily share a level with their neighbors.
+*/
+static void Engine_raiseModuleLevel(Engine::Internal* internal, Module* module, int level, Cable* skipCable) {
+	typedef std::pair<int, Module*> QueueEntry;
+	std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+	std::unordered_map<Module*, int> requiredLevels;
+	std::unordered_map<Module*, int> oldLevels;
+
+	requiredLevels[module] = level;
+	queue.push(QueueEntry(internal->moduleLevels[module], module));
+	while (!queue.empty()) {
+		const int oldLevel = queue.top().first;
+		Module* m = queue.top().second;
+		queue.pop();
+		const int requiredLevel = requiredLevels[m];
+		if (requiredLevel <= oldLevel || oldLevels.find(m) != oldLevels.end())
+			continue;
+		oldLevels[m] = oldLevel;
+		Engine_setModuleLevel(internal, m, requiredLevel);
+		Engine_forEachNeighbor(internal, m, skipCable, [&](Module* neighbor, int neighborLevel) {
+			// Skip modules processed before this one, and the ones that are already late enough
+			auto it = oldLevels.find(neighbor);
+			if (it != oldLevels.end() || neighborLevel <= oldLevel || neighborLevel > requiredLevel)
+				return;
+			int& neighborRequiredLevel = requiredLevels[neighbor];
+			if (neighborRequiredLevel > requiredLevel)
+				return;
+			neighborRequiredLevel = requiredLevel + 1;
+			queue.push(QueueEntry(neighborLevel, neighbor));
+		});
+	}
+}
+
+
+/** Lowers a module right after the latest module it depends on, and then the modules following it in turn.
+*/
+static void Engine_lowerModuleLevel(Engine::Internal* internal, Module* module) {
+	std::vector<Module*> stack;
+	stack.push_back(module);
+	while (!stack.empty()) {
+		Module* m = stack.back();
+		stack.pop_back();
+		const int oldLevel = internal->moduleLevels[m];
+		int level = 0;
+		Engine_forEachNeighbor(internal, m, NULL, [&](Module*, int neighborLevel) {
+			if (neighborLevel < oldLevel)
+				level = std::max(level, neighborLevel + 1);
+		});
+		if (level >= oldLevel)
+			continue;
+		Engine_setModuleLevel(internal, m, level);
+		Engine_forEachNeighbor(internal, m, NULL, [&](Module* neighbor, int neighborLevel) {
+			if (neighborLevel > oldLevel)
+				stack.push_back(neighbor);
+		});
+	}
+}
+
+
+/** Adds a cable to the routing table, at the end of the cables of its output module.
+Cables from terminal modules are not part of the table, they are stepped by the terminal module itself.
+*/
+static void Engine_addCableRoute(Engine::Internal* internal, Cable* cable) {
+	const int level = Engine_getModuleLevel(internal, cable->outputModule);
+	if (level < 0)
+		return;
+	const int i = Engine_getModuleIndex(internal, cable->outputModule, level);
+	DISTRHO_SAFE_ASSERT_RETURN(i >= 0,);
+	const int c = internal->moduleCableStarts[i + 1];
+	internal->cableOutputs.insert(internal->cableOutputs.begin() + c, &cable->outputModule->outputs[cable->outputId]);
+	internal->cableInputs.insert(internal->cableInputs.begin() + c, &cable->inputModule->inputs[cable->inputId]);
+	for (size_t k = i + 1; k < internal->moduleCableStarts.size(); k++)
+		internal->moduleCableStarts[k]++;
+}
+
+
+static void Engine_removeCableRoute(Engine::Internal* internal, Cable* cable) {
+	const int level = Engine_getModuleLevel(internal, cable->outputModule);
+	if (level < 0)
+		return;
+	const int i = Engine_getModuleIndex(internal, cable->outputModule, level);
+	DISTRHO_SAFE_ASSERT_RETURN(i >= 0,);
+	// Inputs only have a single cable, so they identify the route
+	Input* const input = &cable->inputModule->inputs[cable->inputId];
+	const auto begin = internal->cableInputs.begin();
+	const auto end = begin + internal->moduleCableStarts[i + 1];
+	auto it = std::find(begin + internal->moduleCableStarts[i], end, input);
+	DISTRHO_SAFE_ASSERT_RETURN(it != end,);
+	const int c = it - begin;
+	internal->cableInputs.erase(it);
+	internal->cableOutputs.erase(internal->cableOutputs.begin() + c);
+	for (size_t k = i + 1; k < internal->moduleCableStarts.size(); k++)
+		internal->moduleCableStarts[k]--;
+}
+
+template<typename T>
+using IdentityDictionary = std::unordered_map<T, T>;
+
+template<typename T>
+inline bool dictContains(IdentityDictionary<T>& dict, T key) {
+	return dict.find(key) != dict.end();
+}
+
+template<typename T>
+inline void dictAdd(IdentityDictionary<T>& dict, T key) {
+	dict[key] = key;
+}
+
+static void Engine_storeTerminalModulesIDs(std::vector<TerminalModule*> terminalModules, IdentityDictionary<int64_t>& terminalModulesIDs) {
+	for (TerminalModule* terminalModule : terminalModules)
+		dictAdd(terminalModulesIDs, terminalModule->id);
+}
+
+static void Engine_orderModule(Module* module, IdentityDictionary<Module*>& touchedModules, std::vector<Module*>& orderedModules, IdentityDictionary<int64_t>& terminalModulesIDs) {
+	if (!dictContains(touchedModules, module) && !dictContains(terminalModulesIDs, module->id)) { // Ignore feedback loops and terminal modules
+		dictAdd(touchedModules, module);
+		for (Output& output : module->outputs) {
+			for (Cable* cable : output.cables) {
+				Module* receiver = cable->inputModule; // The input to the cable is the receiving module
+				Engine_orderModule(receiver, touchedModules, orderedModules, terminalModulesIDs);
+			}
+		}
+		orderedModules.push_back(module);
+	}
+}
+
+static void Engine_assignOrderedModules(std::vector<Module*>& modules, std::vector<Module*>& orderedModules) {
+	std::reverse(orderedModules.begin(), orderedModules.end()); // These are stored bottom up
+	if (orderedModules.size() == modules.size()) {
+		for (unsigned int i = 0; i < orderedModules.size(); i++)
+			modules[i] = orderedModules[i];
+	}
+}
+
+/** Groups the ordered modules into dependency levels, so that modules in the same level can be processed in parallel.
+A module is placed after every module that sends it a cable earlier in the order, and also after every module it feeds back into,
+so that the receiving end of a feedback cable is never processed while its input is being written.
+Sorting by level keeps the relative order of every connected pair of modules, so serial processing behaves exactly the same.
+*/
+static void Engine_assignModuleLevels(Engine::Internal* internal) {
+	std::vector<Module*>& modules = internal->modules;
+	const int moduleCount = modules.size();
+
+	std::unordered_map<Module*, int> moduleIndexes;
+	moduleIndexes.reserve(moduleCount);
+	for (int i = 0; i < moduleCount; i++)
+		moduleIndexes[modules[i]] = i;
+
+	std::vector<int> levels(moduleCount, 0);
+	int levelCount = 1;
+
+	for (int i = 0; i < moduleCount; i++) {
+		Module* module = modules[i];
+
+		// Feedback cables, the receiver was already processed earlier in the order
+		for (Output& output : module->outputs) {
+			for (Cable* cable : output.cables) {
+				auto it = moduleIndexes.find(cable->inputModule);
+				if (it != moduleIndexes.end() && it->second < i)
+					levels[i] = std::max(levels[i], levels[it->second] + 1);
+			}
+		}
+
+		// Forward cables, the receiver comes later in the order
+		for (Output& output : module->outputs) {
+			for (Cable* cable : output.cables) {
+				auto it = moduleIndexes.find(cable->inputModule);
+				if (it != moduleIndexes.end() && it->second > i)
+					levels[it->second] = std::max(levels[it->second], levels[i] + 1);
+			}
+		}
+
+		levelCount = std::max(levelCount, levels[i] + 1);
+	}
+
+	// Stable counting sort by level
+	std::vector<int> counts(levelCount + 1, 0);
+	for (int i = 0; i < moduleCount; i++)
+		counts[levels[i] + 1]++;
+	for (int l = 0; l < levelCount; l++)
+		counts[l + 1] += counts[l];
+	internal->levelStarts = counts;
+
+	std::vector<Module*> sortedModules(moduleCount);
+	internal->moduleLevels.clear();
+	internal->moduleLevels.reserve(moduleCount);
+	for (int i = 0; i < moduleCount; i++) {
+		sortedModules[counts[levels[i]]++] = modules[i];
+		internal->moduleLevels[modules[i]] = levels[i];
+	}
+	modules.swap(sortedModules);
+}
+
+/** Compiles the cables of the ordered modules into the flattened routing table.
+*/
+static void Engine_buildCableRoutes(Engine::Internal* internal) {
+	const int moduleCount = internal->modules.size();
+
+	internal->cableOutputs.clear();
+	internal->cableInputs.clear();
+	internal->cableOutputs.reserve(internal->cables.size());
+	internal->cableInputs.reserve(internal->cables.size());
+	internal->moduleCableStarts.resize(moduleCount + 1);
+
+	for (int i = 0; i < moduleCount; i++) {
+		internal->moduleCableStarts[i] = internal->cableOutputs.size();
+		for (Output& output : internal->modules[i]->outputs) {
+			for (Cable* cable : output.cables) {
+				internal->cableOutputs.push_back(&output);
+				internal->cableInputs.push_back(&cable->inputModule->inputs[cable->inputId]);
+			}
+		}
+	}
+	internal->moduleCableStarts[moduleCount] = internal->cableOutputs.size();
+}
+
+/** Compiles the cables of the terminal modules into their own routing table, if they changed.
+*/
+static void Engine_updateTerminalCableRoutes(Engine::Internal* internal) {
+	if (!internal->terminalCableRoutesDirty)
+		return;
+	internal->terminalCableRoutesDirty = false;
+
+	const int terminalModuleCount = internal->terminalModules.size();
+
+	internal->terminalCableOutputs.clear();
+	internal->terminalCableInputs.clear();
+	internal->terminalCableStarts.resize(terminalModuleCount + 1);
+
+	for (int i = 0; i < terminalModuleCount; i++) {
+		internal->terminalCableStarts[i] = internal->terminalCableOutputs.size();
+		for (Output& output : internal->terminalModules[i]->outputs) {
+			for (Cable* cable : output.cables) {
+				internal->terminalCableOutputs.push_back(&output);
+				internal->terminalCableInputs.push_back(&cable->inputModule->inputs[cable->inputId]);
+			}
+		}
+	}
+	internal->terminalCableStarts[terminalModuleCount] = internal->terminalCableOutputs.size();
+}
+
+/** Orders all modules from scratch so that they always read the most recent sample from their inputs.
+Single cable changes repair the order locally instead, this is used after adding many cables at once.
+*/
+static void Engine_orderModules(Engine* that) {
+	Engine::Internal* internal = that->internal;
+
+	IdentityDictionary<int64_t> terminalModulesIDs;
+	Engine_storeTerminalModulesIDs(internal->terminalModules, terminalModulesIDs);
+
+	IdentityDictionary<Module*> touchedModules;
+	std::vector<Module*> orderedModules;
+	orderedModules.reserve(internal->modules.size());
 	for (Module* module : internal->modules)
 		Engine_orderModule(module, touchedModules, orderedModules, terminalModulesIDs);
 
-	Engine_assignOrderedModules(internal->modules, orderedModules);
+	Engine_assignOrderedModules(internal->modules, orderedModules);
+	Engine_assignModuleLevels(internal);
+	Engine_buildCableRoutes(internal);
+}
+
+
+#if DEBUG_ORDERED_MODULES
+static void Engine_debugOrderedModules(std::vector<Module*>& modules) {
+	printf("\n--- Ordered modules ---\n");
+	for (unsigned int i = 0; i < modules.size(); i++)
+		printf("%d) %s - %ld\n", i, modules[i]->model->getFullName().c_str(), modules[i]->id);
+}
+#endif
+
+
+static void Engine_updateBlockMode(BlockModule* blockModule) {
+	bool inputsConnected = false;
+	for (Input& input : blockModule->inputs) {
+		if (input.isConnected()) {
+			inputsConnected = true;
+			break;
+		}
+	}
+	bool outputsConnected = false;
+	for (Output& output : blockModule->outputs) {
+		if (output.isConnected()) {
+			outputsConnected = true;
+			break;
+		}
+	}
+
+	if (!inputsConnected)
+		blockModule->blockMode = BlockModule::kBlockModeSource;
+	else if (!outputsConnected)
+		blockModule->blockMode = BlockModule::kBlockModeSink;
+	else
+		blockModule->blockMode = BlockModule::kBlockModeFrame;
+}
+
+
+static void Cable_updateBlockModes(Cable* cable) {
+	if (BlockModule* const blockModule = dynamic_cast<BlockModule*>(cable->inputModule))
+		Engine_updateBlockMode(blockModule);
+	if (BlockModule* const blockModule = dynamic_cast<BlockModule*>(cable->outputModule))
+		Engine_updateBlockMode(blockModule);
+}
+
+
+/** Updates the ports, processing order and cable routes after a cable was added.
+Only the modules around the cable are visited, instead of rebuilding the state of the whole patch.
+*/
+static void Engine_connectCable(Engine* that, Cable* cable) {
+	Engine::Internal* internal = that->internal;
+	Port_setConnected(&cable->inputModule->inputs[cable->inputId]);
+	Port_setConnected(&cable->outputModule->outputs[cable->outputId]);
+	internal->moduleInputCables[cable->inputModule].push_back(cable);
+	// Process the input module after the output module so it reads the most recent sample, unless the cable closes a feedback loop
+	const int outputLevel = Engine_getModuleLevel(internal, cable->outputModule);
+	const int inputLevel = Engine_getModuleLevel(internal, cable->inputModule);
+	if (outputLevel >= 0 && inputLevel >= 0 && cable->outputModule != cable->inputModule && outputLevel >= inputLevel) {
+		if (outputLevel == inputLevel || !Engine_isModuleFollowedBy(internal, cable->inputModule, cable->outputModule, outputLevel, cable))
+			Engine_raiseModuleLevel(internal, cable->inputModule, outputLevel + 1, cable);
+	}
+	Engine_addCableRoute(internal, cable);
+	internal->terminalCableRoutesDirty = true;
+	internal->moduleCyclesDirty = true;
+	internal->dormantModulesDirty = true;
+	// Decide which modules can be processed a block at a time
+	Cable_updateBlockModes(cable);
+#if DEBUG_ORDERED_MODULES
+	Engine_debugOrderedModules(internal->modules);
+#endif
+}
+
+
+/** Updates the ports, processing order and cable routes after a cable was removed.
+*/
+static void Engine_disconnectCable(Engine* that, Cable* cable) {
+	Engine::Internal* internal = that->internal;
+	Port_setDisconnected(&cable->inputModule->inputs[cable->inputId]);
+	Output& output = cable->outputModule->outputs[cable->outputId];
+	if (output.cables.empty())
+		Port_setDisconnected(&output);
+	auto it = internal->moduleInputCables.find(cable->inputModule);
+	if (it != internal->moduleInputCables.end()) {
+		std::vector<Cable*>& inputCables = it->second;
+		inputCables.erase(std::remove(inputCables.begin(), inputCables.end(), cable), inputCables.end());
+		if (inputCables.empty())
+			internal->moduleInputCables.erase(it);
+	}
+	Engine_removeCableRoute(internal, cable);
+	internal->terminalCableRoutesDirty = true;
+	internal->moduleCyclesDirty = true;
+	internal->dormantModulesDirty = true;
+	// The later of both modules might not need to wait for the other anymore
+	const int outputLevel = Engine_getModuleLevel(internal, cable->outputModule);
+	const int inputLevel = Engine_getModuleLevel(internal, cable->inputModule);
+	if (outputLevel >= 0 && inputLevel >= 0 && cable->outputModule != cable->inputModule)
+		Engine_lowerModuleLevel(internal, outputLevel > inputLevel ? cable->outputModule : cable->inputModule);
+	Cable_updateBlockModes(cable);
+#if DEBUG_ORDERED_MODULES
+	Engine_debugOrderedModules(internal->modules);
+#endif
+}
+
+
+/** Finds the modules that cannot reach a terminal module, if enabled for the patch.
+Modules touched by the user are kept awake for a second, so that they can still show what they are doing.
+*/
+static void Engine_updateDormantModules(Engine::Internal* internal) {
+	Engine::Internal::WokenModule* const wokenModules = internal->wokenModules;
+	const int wokenModuleCount = Engine::Internal::kWokenModuleCount;
+	if (Module* touchedModule = internal->touchedModule.exchange(NULL)) {
+		if (internal->moduleLevels.find(touchedModule) != internal->moduleLevels.end()) {
+			// Reuse the entry of the module if it is already awake, or the one expiring first
+			int w = 0;
+			for (int i = 0; i < wokenModuleCount; i++) {
+				if (wokenModules[i].module == touchedModule) {
+					w = i;
+					break;
+				}
+				if (!wokenModules[i].module || (wokenModules[w].module && wokenModules[i].frame < wokenModules[w].frame))
+					w = i;
+			}
+			wokenModules[w].module = touchedModule;
+			wokenModules[w].frame = internal->frame + (int64_t) internal->sampleRate;
+			internal->dormantModulesDirty = true;
+		}
+	}
+	for (int i = 0; i < wokenModuleCount; i++) {
+		if (wokenModules[i].module && wokenModules[i].frame <= internal->frame) {
+			wokenModules[i].module = NULL;
+			internal->dormantModulesDirty = true;
+		}
+	}
+
+	if (!internal->dormantModulesDirty)
+		return;
+	internal->dormantModulesDirty = false;
+
+	const int moduleCount = internal->modules.size();
+	internal->moduleProfilePointers.resize(moduleCount);
+	for (int i = 0; i < moduleCount; i++) {
+		auto it = internal->moduleProfiles.find(internal->modules[i]);
+		internal->moduleProfilePointers[i] = it != internal->moduleProfiles.end() ? &it->second : NULL;
+	}
+	internal->frozenModulePointers.resize(moduleCount);
+	for (int i = 0; i < moduleCount; i++) {
+		auto it = internal->frozenModules.find(internal->modules[i]);
+		internal->frozenModulePointers[i] = it != internal->frozenModules.end() ? &it->second : NULL;
+	}
+	internal->dormantModules.assign(moduleCount, 0);
+	if (!internal->skipDormantModules && !internal->shedding)
+		return;
+
+	// Walk back from terminal modules, through cables and expanders
+	for (int i = 0; i < moduleCount; i++)
+		internal->dormantModuleIndexes.find(internal->modules[i])->second = i;
+	std::vector<uint8_t>& reachableModules = internal->reachableModules;
+	std::vector<Module*>& stack = internal->reachableStack;
+	reachableModules.assign(moduleCount, 0);
+	stack.clear();
+	// Terminal modules have no index, they start the walk and are never pushed again
+	const auto visit = [&](Module* module) {
+		if (!module)
+			return;
+		auto it = internal->dormantModuleIndexes.find(module);
+		if (it == internal->dormantModuleIndexes.end() || reachableModules[it->second])
+			return;
+		reachableModules[it->second] = 1;
+		stack.push_back(module);
+	};
+	for (TerminalModule* terminalModule : internal->terminalModules)
+		stack.push_back(terminalModule);
+	while (!stack.empty()) {
+		Module* module = stack.back();
+		stack.pop_back();
+		auto it = internal->moduleInputCables.find(module);
+		if (it != internal->moduleInputCables.end()) {
+			for (Cable* cable : it->second)
+				visit(cable->outputModule);
+		}
+		visit(module->leftExpander.module);
+		visit(module->rightExpander.module);
+	}
+
+	for (int i = 0; i < moduleCount; i++) {
+		if (reachableModules[i])
+			continue;
+		Module* module = internal->modules[i];
+		bool woken = false;
+		for (int w = 0; w < wokenModuleCount; w++)
+			woken = woken || wokenModules[w].module == module;
+		internal->dormantModules[i] = !woken;
+	}
+}
+
+
+/** Sizes the scratch space of Engine_updateDormantModules() for the current modules, called under the writer lock.
+*/
+static void Engine_reserveDormantModules(Engine::Internal* internal) {
+	const size_t moduleCount = internal->modules.size();
+	internal->dormantModules.reserve(moduleCount);
+	internal->moduleProfilePointers.reserve(moduleCount);
+	internal->frozenModulePointers.reserve(moduleCount);
+	internal->reachableModules.reserve(moduleCount);
+	internal->reachableStack.reserve(moduleCount + internal->terminalModules.size());
+}
+
+
+/** Finds the longest delay from the host inputs to the host outputs, given the receiver of each terminal module route and of each route.
+Modules are sorted by level, so following the routes that are not one-sample delays visits them in order.
+*/
+static void Engine_updateLatency(Engine::Internal* internal, const std::vector<int>& terminalReceivers, const std::vector<int>& receivers) {
+	const std::vector<Module*>& modules = internal->modules;
+	const int moduleCount = modules.size();
+
+	// Delay at which the host inputs reach each module, or -1 if they never do
+	std::vector<int>& arrivals = internal->latencyArrivals;
+	arrivals.assign(moduleCount, -1);
+	int latency = 0;
+
+	internal->moduleLatencies.clear();
+	internal->freeRunningModules.clear();
+	for (Module* module : modules) {
+		if (ModuleLatency* const moduleLatency = dynamic_cast<ModuleLatency*>(module))
+			internal->moduleLatencies.push_back(std::make_pair(moduleLatency, moduleLatency->getLatency()));
+		if (ModuleFreeRunning* const freeRunning = dynamic_cast<ModuleFreeRunning*>(module))
+			internal->freeRunningModules.push_back(freeRunning);
+	}
+
+	for (const int w : terminalReceivers) {
+		if (w >= 0)
+			arrivals[w] = 0;
+	}
+
+	for (int i = 0; i < moduleCount; i++) {
+		if (arrivals[i] < 0)
+			continue;
+		int delay = arrivals[i];
+		if (ModuleLatency* const moduleLatency = dynamic_cast<ModuleLatency*>(modules[i]))
+			delay += std::max(0, moduleLatency->getLatency());
+		for (int c = internal->moduleCableStarts[i]; c < internal->moduleCableStarts[i + 1]; c++) {
+			if (internal->cableDelays[c])
+				continue;
+			const int w = receivers[c];
+			if (w < 0)
+				latency = std::max(latency, delay);
+			else
+				arrivals[w] = std::max(arrivals[w], delay);
+		}
+	}
+
+	internal->latency = latency;
+}
+
+
+/** Hashes the module order and the routing table, which is all that the cycles and the latency of the patch depend on.
+*/
+static uint64_t Engine_hashModuleGraph(const Engine::Internal* internal) {
+	// FNV-1a over the pointers and route ranges
+	uint64_t hash = 0xcbf29ce484222325ull;
+	const auto mix = [&hash](uint64_t value) {
+		hash ^= value;
+		hash *= 0x100000001b3ull;
+	};
+	for (const Module* module : internal->modules)
+		mix(reinterpret_cast<uintptr_t>(module));
+	for (const Input* input : internal->cableInputs)
+		mix(reinterpret_cast<uintptr_t>(input));
+	for (const int cableStart : internal->moduleCableStarts)
+		mix(cableStart);
+	for (const Input* input : internal->terminalCableInputs)
+		mix(reinterpret_cast<uintptr_t>(input));
+	return hash;
+}
+
+
+/** Finds the feedback cycles of the patch as strongly connected components of the module graph, using Tarjan's algorithm,
+and marks the cables that close them as one-sample delays.
+Terminal modules are not part of the graph, their inputs are processed before every other module and their outputs after.
+*/
+static void Engine_updateModuleCycles(Engine::Internal* internal) {
+	// Cached modules are only valid while the patch is unchanged
+	if (!internal->moduleCyclesDirty) {
+		for (const std::pair<ModuleLatency*, int>& moduleLatency : internal->moduleLatencies) {
+			if (moduleLatency.first->getLatency() != moduleLatency.second) {
+				internal->moduleCyclesDirty = true;
+				break;
+			}
+		}
+	}
+
+	if (!internal->moduleCyclesDirty)
+		return;
+	internal->moduleCyclesDirty = false;
+
+	const std::vector<Module*>& modules = internal->modules;
+	const int moduleCount = modules.size();
+
+	// The decomposition only depends on the order of the modules and where their routes go
+	const uint64_t hash = Engine_hashModuleGraph(internal);
+	for (const Engine::Internal::ModuleCyclesEntry& entry : internal->moduleCyclesCache) {
+		if (!entry.valid || entry.hash != hash
+			|| entry.modules != modules
+			|| entry.cableInputs != internal->cableInputs
+			|| entry.moduleCableStarts != internal->moduleCableStarts
+			|| entry.terminalCableInputs != internal->terminalCableInputs)
+			continue;
+		internal->moduleCycles.assign(entry.moduleCycles.begin(), entry.moduleCycles.end());
+		internal->moduleCycleCount = entry.moduleCycleCount;
+		internal->cableDelays.assign(entry.cableDelays.begin(), entry.cableDelays.end());
+		// Module latencies may have changed since, only the routes are cached
+		Engine_updateLatency(internal, entry.terminalReceivers, entry.receivers);
+		return;
+	}
+
+	Engine::Internal::ModuleCyclesEntry& entry = internal->moduleCyclesCache[internal->moduleCyclesCacheNext];
+	internal->moduleCyclesCacheNext = (internal->moduleCyclesCacheNext + 1) % Engine::Internal::kModuleCyclesCacheSize;
+
+	// Receiver of each route, or -1 for terminal modules
+	std::unordered_map<const Input*, int>& inputModules = internal->cycleInputModules;
+	for (int i = 0; i < moduleCount; i++) {
+		for (const Input& input : modules[i]->inputs)
+			inputModules.find(&input)->second = i;
+	}
+	Input* const* const inputs = internal->cableInputs.data();
+	const int routeCount = internal->cableInputs.size();
+	std::vector<int>& receivers = entry.receivers;
+	receivers.assign(routeCount, -1);
+	internal->cableDelays.assign(routeCount, 0);
+	for (int i = 0; i < moduleCount; i++) {
+		for (int c = internal->moduleCableStarts[i]; c < internal->moduleCableStarts[i + 1]; c++) {
+			auto it = inputModules.find(inputs[c]);
+			if (it == inputModules.end())
+				continue;
+			receivers[c] = it->second;
+			// Modules are sorted by level, so a receiver at or before the sender was already processed this frame
+			internal->cableDelays[c] = it->second <= i;
+		}
+	}
+	std::vector<int>& terminalReceivers = entry.terminalReceivers;
+	terminalReceivers.clear();
+	for (const Input* input : internal->terminalCableInputs) {
+		auto it = inputModules.find(input);
+		terminalReceivers.push_back(it != inputModules.end() ? it->second : -1);
+	}
+
+	// Iterative Tarjan, so that long chains of modules cannot overflow the stack
+	std::vector<int>& indexes = internal->cycleIndexes;
+	std::vector<int>& lowLinks = internal->cycleLowLinks;
+	std::vector<uint8_t>& onStack = internal->cycleOnStack;
+	std::vector<int>& stack = internal->cycleStack;
+	std::vector<std::pair<int, int>>& callStack = internal->cycleCallStack;
+	indexes.assign(moduleCount, -1);
+	lowLinks.assign(moduleCount, 0);
+	onStack.assign(moduleCount, 0);
+	stack.clear();
+	callStack.clear();
+	int nextIndex = 0;
+
+	internal->moduleCycles.assign(moduleCount, -1);
+	internal->moduleCycleCount = 0;
+
+	for (int root = 0; root < moduleCount; root++) {
+		if (indexes[root] >= 0)
+			continue;
+		callStack.emplace_back(root, internal->moduleCableStarts[root]);
+		indexes[root] = lowLinks[root] = nextIndex++;
+		stack.push_back(root);
+		onStack[root] = 1;
+
+		while (!callStack.empty()) {
+			const int v = callStack.back().first;
+			int& c = callStack.back().second;
+
+			if (c < internal->moduleCableStarts[v + 1]) {
+				const int w = receivers[c++];
+				if (w < 0)
+					continue;
+				if (indexes[w] < 0) {
+					indexes[w] = lowLinks[w] = nextIndex++;
+					stack.push_back(w);
+					onStack[w] = 1;
+					callStack.emplace_back(w, internal->moduleCableStarts[w]);
+				}
+				else if (onStack[w]) {
+					lowLinks[v] = std::min(lowLinks[v], indexes[w]);
+				}
+				continue;
+			}
+
+			callStack.pop_back();
+			if (!callStack.empty()) {
+				const int parent = callStack.back().first;
+				lowLinks[parent] = std::min(lowLinks[parent], lowLinks[v]);
+			}
+			if (lowLinks[v] != indexes[v])
+				continue;
+
+			// v is the root of a component, a single module is only a cycle if it feeds back into itself
+			const auto routesBegin = receivers.begin() + internal->moduleCableStarts[v];
+			const auto routesEnd = receivers.begin() + internal->moduleCableStarts[v + 1];
+			const bool cyclic = stack.back() != v || std::find(routesBegin, routesEnd, v) != routesEnd;
+			const int cycle = cyclic ? internal->moduleCycleCount++ : -1;
+			int w;
+			do {
+				w = stack.back();
+				stack.pop_back();
+				onStack[w] = 0;
+				internal->moduleCycles[w] = cycle;
+			} while (w != v);
+		}
+	}
+
+#if DEBUG_ORDERED_MODULES
+	printf("\n--- Module cycles: %d ---\n", internal->moduleCycleCount);
+	for (int i = 0; i < moduleCount; i++) {
+		if (internal->moduleCycles[i] >= 0)
+			printf("%d) %s - %ld, cycle %d\n", i, modules[i]->model->getFullName().c_str(), modules[i]->id, internal->moduleCycles[i]);
+	}
+#endif
+
+	entry.valid = true;
+	entry.hash = hash;
+	entry.modules.assign(modules.begin(), modules.end());
+	entry.cableInputs.assign(internal->cableInputs.begin(), internal->cableInputs.end());
+	entry.moduleCableStarts.assign(internal->moduleCableStarts.begin(), internal->moduleCableStarts.end());
+	entry.terminalCableInputs.assign(internal->terminalCableInputs.begin(), internal->terminalCableInputs.end());
+	entry.moduleCycles.assign(internal->moduleCycles.begin(), internal->moduleCycles.end());
+	entry.moduleCycleCount = internal->moduleCycleCount;
+	entry.cableDelays.assign(internal->cableDelays.begin(), internal->cableDelays.end());
+
+	Engine_updateLatency(internal, terminalReceivers, receivers);
+}
+
+
+/** Sizes the scratch space and the cache entries of Engine_updateModuleCycles() for the current modules and cables, called under the writer lock.
+Every route comes from a cable, so the cable count bounds the routing table.
+*/
+static void Engine_reserveModuleCycles(Engine::Internal* internal) {
+	const size_t moduleCount = internal->modules.size();
+	const size_t cableCount = internal->cables.size();
+	internal->moduleCycles.reserve(moduleCount);
+	internal->cableDelays.reserve(cableCount);
+	internal->cycleIndexes.reserve(moduleCount);
+	internal->cycleLowLinks.reserve(moduleCount);
+	internal->cycleOnStack.reserve(moduleCount);
+	internal->cycleStack.reserve(moduleCount);
+	internal->cycleCallStack.reserve(moduleCount);
+	internal->latencyArrivals.reserve(moduleCount);
+	internal->moduleLatencies.reserve(moduleCount);
+	internal->freeRunningModules.reserve(moduleCount);
+	for (Engine::Internal::ModuleCyclesEntry& entry : internal->moduleCyclesCache) {
+		entry.modules.reserve(moduleCount);
+		entry.cableInputs.reserve(cableCount);
+		entry.moduleCableStarts.reserve(moduleCount + 1);
+		entry.terminalCableInputs.reserve(cableCount);
+		entry.receivers.reserve(cableCount);
+		entry.terminalReceivers.reserve(cableCount);
+		entry.moduleCycles.reserve(moduleCount);
+		entry.cableDelays.reserve(cableCount);
+	}
+}
+
+
+static void Engine_refreshParamHandleCache(Engine* that) {
+	// Clear cache
+	that->internal->paramHandlesCache.clear();
+	// Add active ParamHandles to cache
+	for (ParamHandle* paramHandle : that->internal->paramHandles) {
+		if (paramHandle->moduleId >= 0) {
+			that->internal->paramHandlesCache[std::make_tuple(paramHandle->moduleId, paramHandle->paramId)] = paramHandle;
+		}
+	}
+}
+
+
+/** Borrows workers from the shared pool for the current block, within this engine's share of the pool.
+*/
+static void Engine_acquireWorkers(Engine* that, int threadCount) {
+	Engine::Internal* internal = that->internal;
+
+	// Barriers must count the borrowed workers before they start waiting on them
+	internal->workerPool->acquire(that, &internal->workerPoolClient, threadCount - 1, internal->workers, [=](int borrowedCount) {
+		internal->threadCount = 1 + borrowedCount;
+		internal->engineBarrier.total = internal->threadCount;
+		internal->workerBarrier.total = internal->threadCount;
+	});
+}
+
+
+/** Gives the borrowed workers back to the shared pool at the end of a block.
+*/
+static void Engine_releaseWorkers(Engine* that) {
+	Engine::Internal* internal = that->internal;
+	if (internal->workers.empty())
+		return;
+
+	// Workers are all waiting on engineBarrier, let them leave the engine
+	for (EngineWorkerPool::Worker* worker : internal->workers) {
+		worker->running = false;
+	}
+	internal->engineBarrier.wait();
+	internal->workers.clear();
+	internal->threadCount = 1;
+}
+
+
+Engine::Engine() {
+	internal = new Internal;
+	internal->workerPool->addClient(&internal->workerPoolClient);
+}
+
+
+static void Engine_deletePreparingPatch(PreparingPatch* const preparing) {
+	if (preparing->thread.joinable())
+		preparing->thread.join();
+	for (Module* const module : preparing->modules) {
+		delete module;
+		modulemem::removeModule(module);
+	}
+	if (preparing->rootJ)
+		json_decref(preparing->rootJ);
+	delete preparing;
+}
+
+
+static void Engine_discardPreparedPatch(Engine* that) {
+	Engine::Internal* internal = that->internal;
+
+	if (internal->preparingPatch) {
+		Engine_deletePreparingPatch(internal->preparingPatch);
+		internal->preparingPatch = NULL;
+	}
+
+	// Module destructors remove their own ParamHandles
+	internal->preparedParamHandles.clear();
+
+	for (const std::pair<size_t, Module*>& preparedModule : internal->preparedModules) {
+		Module* const module = preparedModule.second;
+		if (CardinalPluginModelHelper* const helper = dynamic_cast<CardinalPluginModelHelper*>(module->model))
+			helper->removeCachedModuleWidget(module);
+		delete module;
+		modulemem::removeModule(module);
+	}
+	internal->preparedModules.clear();
+	internal->pendingModuleTimes.clear();
+
+	if (internal->preparedRootJ) {
+		json_decref(internal->preparedRootJ);
+		internal->preparedRootJ = NULL;
+	}
+}
+
+
+Engine::~Engine() {
+	// Make sure that no worker is still leaving this engine
+	internal->workerPool->removeClient(&internal->workerPoolClient);
+	internal->workerPool->waitForEngine(this);
+
+#ifdef CARDINAL_RT_AUDIT
+	rtaudit::writeReport(asset::user("rt-audit.txt").c_str());
+#endif
+
+	// Clear modules, cables, etc
+	Engine_discardPreparedPatch(this);
+	clear();
+
+	// Make sure there are no cables or modules in the rack on destruction.
+	// If this happens, a module must have failed to remove itself before the RackWidget was destroyed.
+	DISTRHO_SAFE_ASSERT(internal->cables.empty());
+	DISTRHO_SAFE_ASSERT(internal->modules.empty());
+	DISTRHO_SAFE_ASSERT(internal->terminalModules.empty());
+	DISTRHO_SAFE_ASSERT(internal->paramHandles.empty());
+
+	DISTRHO_SAFE_ASSERT(internal->modulesCache.empty());
+	DISTRHO_SAFE_ASSERT(internal->cablesCache.empty());
+	DISTRHO_SAFE_ASSERT(internal->paramHandlesCache.empty());
+
+	delete internal;
+}
+
+
+void Engine::clear() {
+	const EngineWriteLock lock(internal);
+	clear_NoLock();
+}
+
+
+void Engine::clear_NoLock() {
+	// Copy lists because we'll be removing while iterating
+	std::set<ParamHandle*> paramHandles = internal->paramHandles;
+	for (ParamHandle* paramHandle : paramHandles) {
+		// Owned by modules of the next patch
+		if (internal->preparedParamHandles.find(paramHandle) != internal->preparedParamHandles.end())
+			continue;
+		removeParamHandle_NoLock(paramHandle);
+		// Don't delete paramHandle because they're normally owned by Module subclasses
+	}
+	std::vector<Cable*> cables = internal->cables;
+	for (Cable* cable : cables) {
+		removeCable_NoLock(cable);
+		delete cable;
+	}
+	std::vector<Module*> modules = internal->modules;
+	for (Module* module : modules) {
+		removeModule_NoLock(module);
+		delete module;
+		modulemem::removeModule(module);
+	}
+	std::vector<TerminalModule*> terminalModules = internal->terminalModules;
+	for (TerminalModule* terminalModule : terminalModules) {
+		removeModule_NoLock(terminalModule);
+		delete terminalModule;
+		modulemem::removeModule(terminalModule);
+	}
+}
+
+
+static void Engine_captureSnapshots_NoLock(Engine::Internal* internal) {
+	for (Module* module : internal->modules) {
+		if (ModuleSnapshot* const moduleSnapshot = dynamic_cast<ModuleSnapshot*>(module)) {
+			Engine_setCurrentModule(module);
+			moduleSnapshot->captureSnapshot();
+		}
+	}
+	Engine_setCurrentModule(NULL);
+}
+
+
+/** Makes modules implementing ModuleSnapshot capture their state between two blocks, before they are serialized.
+While audio is running, the audio thread does it after its next block. Otherwise they are captured here under the write lock.
+*/
+static void Engine_captureSnapshots(Engine* that) {
+	Engine::Internal* internal = that->internal;
+
+	// The audio thread is held off during a batch of edits, capture right away instead
+	if (!Engine_isEditing(internal) && system::getTime() - internal->blockTime < 0.1) {
+		std::unique_lock<std::mutex> snapshotLock(internal->snapshotMutex);
+		internal->snapshotRequested = true;
+		if (internal->snapshotCv.wait_for(snapshotLock, std::chrono::milliseconds(200), [internal] {
+			return !internal->snapshotRequested.load();
+		}))
+			return;
+		// Audio stopped in the meantime
+		internal->snapshotRequested = false;
+	}
+
+	const EngineWriteLock lock(internal);
+	Engine_captureSnapshots_NoLock(internal);
+}
+
+
+static constexpr const int kUiSnapshotFresh = 4;
+
+
+static bool UiSnapshot_fits(const UiSnapshot& snapshot, size_t moduleCount, size_t cableCount, size_t lightCount, size_t paramCount) {
+	return snapshot.moduleIds.capacity() >= moduleCount && snapshot.modules.capacity() >= moduleCount
+		&& snapshot.lightStarts.capacity() > moduleCount && snapshot.paramStarts.capacity() > moduleCount
+		&& snapshot.cableIds.capacity() >= cableCount
+		&& snapshot.lights.capacity() >= lightCount && snapshot.params.capacity() >= paramCount;
+}
+
+
+static void UiSnapshot_addModule(UiSnapshot& snapshot, const Module* module) {
+	snapshot.moduleIds.push_back(module->id);
+	snapshot.modules.push_back(module);
+	for (const Light& light : module->lights)
+		snapshot.lights.push_back(light.value);
+	for (const Param& param : module->params)
+		snapshot.params.push_back(param.value);
+	snapshot.lightStarts.push_back(snapshot.lights.size());
+	snapshot.paramStarts.push_back(snapshot.params.size());
+}
+
+
+/** Publishes the light brightnesses and param values of this block for the UI, see UiSnapshot.
+Only fills snapshots that already have room for the patch, so it never allocates.
+*/
+static void Engine_publishUiSnapshot(Engine::Internal* internal) {
+	// Nobody is looking
+	if (internal->blockTime - internal->uiSnapshotReadTime.load(std::memory_order_relaxed) > 1.0)
+		return;
+
+	const size_t moduleCount = internal->modules.size() + internal->terminalModules.size();
+	const size_t cableCount = internal->cables.size();
+	size_t lightCount = 0;
+	size_t paramCount = 0;
+	for (const Module* module : internal->modules) {
+		lightCount += module->lights.size();
+		paramCount += module->params.size();
+	}
+	for (const Module* module : internal->terminalModules) {
+		lightCount += module->lights.size();
+		paramCount += module->params.size();
+	}
+
+	UiSnapshot& snapshot = internal->uiSnapshots[internal->uiSnapshotBack];
+	snapshot.moduleIds.clear();
+	snapshot.modules.clear();
+	snapshot.cableIds.clear();
+	snapshot.lightStarts.clear();
+	snapshot.paramStarts.clear();
+	snapshot.lights.clear();
+	snapshot.params.clear();
+
+	if (UiSnapshot_fits(snapshot, moduleCount, cableCount, lightCount, paramCount)) {
+		snapshot.lightStarts.push_back(0);
+		snapshot.paramStarts.push_back(0);
+		for (const Module* module : internal->modules)
+			UiSnapshot_addModule(snapshot, module);
+		for (const Module* module : internal->terminalModules)
+			UiSnapshot_addModule(snapshot, module);
+		for (const Cable* cable : internal->cables)
+			snapshot.cableIds.push_back(cable->id);
+		snapshot.block = internal->block;
+	}
+	else {
+		// Handed over empty, for the UI to grow
+		internal->uiSnapshotModuleCount = moduleCount;
+		internal->uiSnapshotCableCount = cableCount;
+		internal->uiSnapshotLightCount = lightCount;
+		internal->uiSnapshotParamCount = paramCount;
+		snapshot.block = -1;
+	}
+
+	const int shared = internal->uiSnapshotShared.exchange(internal->uiSnapshotBack | kUiSnapshotFresh, std::memory_order_acq_rel);
+	internal->uiSnapshotBack = shared & ~kUiSnapshotFresh;
+}
+
+
+/** Adds the module times of this block to the module profiles.
+*/
+static void Engine_updateModuleProfiles(Engine::Internal* internal) {
+	const int resetGeneration = internal->moduleProfileResetGeneration;
+	const bool reset = resetGeneration != internal->appliedModuleProfileResetGeneration;
+	internal->appliedModuleProfileResetGeneration = resetGeneration;
+
+	const int moduleCount = internal->modules.size();
+	for (int i = 0; i < moduleCount; i++) {
+		ModuleProfile* const profile = internal->moduleProfilePointers[i];
+		if (!profile)
+			continue;
+		if (reset) {
+			profile->totalTime = 0.0;
+			profile->totalBlocks = 0;
+		}
+		if (internal->dormantModules[i])
+			continue;
+
+		const double time = internal->blockModuleTimes[i];
+		profile->totalTime += time;
+		profile->totalBlocks++;
+
+		ModuleMeter* const meter = profile->meter.get();
+		if (!meter)
+			continue;
+		meter->pointTime += time;
+		if (++meter->pointBlocks >= ModuleMeter::kBlocksPerPoint) {
+			const int index = (meter->historyIndex + 1) % ModuleMeter::kHistoryLength;
+			meter->history[index] = meter->pointTime / meter->pointBlocks;
+			meter->historyIndex = index;
+			meter->pointTime = 0.0;
+			meter->pointBlocks = 0;
+		}
+	}
+}
+
+
+/** Samples the output voltages of every cable at the end of the block, while cable stats are enabled.
+*/
+static void Engine_updateCableStats(Engine::Internal* internal) {
+	if (!internal->cableStatsEnabled)
+		return;
+
+	const int resetGeneration = internal->cableStatsResetGeneration;
+	const bool reset = resetGeneration != internal->appliedCableStatsResetGeneration;
+	internal->appliedCableStatsResetGeneration = resetGeneration;
+
+	for (Cable* cable : internal->cables) {
+		auto it = internal->cableStats.find(cable);
+		if (it == internal->cableStats.end())
+			continue;
+		CableStats& stats = it->second;
+		if (reset)
+			stats = CableStats();
+
+		const Output& output = cable->outputModule->outputs[cable->outputId];
+		const int channels = output.channels;
+		bool changed = false;
+		for (int c = 0; c < channels; c++) {
+			const float v = std::isfinite(output.voltages[c]) ? output.voltages[c] : 0.f;
+			if (v != stats.lastVoltages[c]) {
+				changed = true;
+				stats.activeChannels |= 1u << c;
+			}
+			else if (v != 0.f) {
+				stats.activeChannels |= 1u << c;
+			}
+			stats.lastVoltages[c] = v;
+			stats.sums[c] += v;
+			stats.squares[c] += (double) v * v;
+		}
+		if (changed && stats.blocks != 0)
+			stats.changedBlocks++;
+		stats.maxChannels = std::max(stats.maxChannels, channels);
+		stats.blocks++;
+	}
+}
+
+
+/** Keeps the CPU time of the engine within its budget by borrowing fewer workers, one at a time, and more again once well below it.
+A heavy patch then slows down on its own instead of taking cores from the other instances of the process.
+With no workers left to give up, the modules not reaching the host are skipped if load shedding is enabled for the patch.
+*/
+static void Engine_updateCpuBudget(Engine::Internal* internal, double cpuLoad, double duration, int borrowedCount) {
+	static constexpr const double kAverageTime = 0.25;
+	static constexpr const double kChangeTime = 0.1;
+	static constexpr const double kRaiseLoad = 0.75;
+
+	internal->cpuLoad += (cpuLoad - internal->cpuLoad) * std::fmin(1.0, duration / kAverageTime);
+
+	EngineWorkerPool::Client& client = internal->workerPoolClient;
+	if (internal->cpuBudget <= 0.f)
+		return;
+
+	internal->cpuBudgetChangeTime += duration;
+	if (internal->cpuBudgetChangeTime < kChangeTime)
+		return;
+
+	if (internal->cpuLoad > internal->cpuBudget) {
+		internal->overCpuBudget = borrowedCount == 0;
+		if (borrowedCount == 0)
+			return;
+		client.budgetWorkers = borrowedCount - 1;
+		internal->cpuBudgetChangeTime = 0.0;
+	}
+	else if (internal->cpuLoad < internal->cpuBudget * kRaiseLoad) {
+		internal->overCpuBudget = false;
+		if (client.budgetWorkers == INT_MAX)
+			return;
+		client.budgetWorkers++;
+		if (client.budgetWorkers >= (int) internal->workerPool->workers.size())
+			client.budgetWorkers = INT_MAX;
+		internal->cpuBudgetChangeTime = 0.0;
+	}
+}
+
+
+/** Starts skipping the modules that do not reach the host once a block takes most of its duration, if enabled for the patch.
+They are only stepped again after blocks stayed well below their deadline for a while, so that the patch does not flip back and forth.
+*/
+static void Engine_updateLoadShedding(Engine::Internal* internal, double load, double duration) {
+	static constexpr const double kStartLoad = 0.85;
+	static constexpr const double kStopLoad = 0.5;
+	static constexpr const double kStopTime = 10.0;
+
+	if (!internal->loadShedding || internal->skipDormantModules)
+		return;
+
+	if (!internal->shedding) {
+		if (load < kStartLoad && !internal->overCpuBudget)
+			return;
+		internal->shedding = true;
+		internal->sheddingQuietTime = 0.0;
+		internal->dormantModulesDirty = true;
+		internal->blockStats.shedCount++;
+		return;
+	}
+
+	// The lighter blocks are expected to come from shedding itself, only stop after a long enough quiet time
+	if (load >= kStopLoad || internal->overCpuBudget) {
+		internal->sheddingQuietTime = 0.0;
+		return;
+	}
+	internal->sheddingQuietTime += duration;
+	if (internal->sheddingQuietTime < kStopTime)
+		return;
+	internal->shedding = false;
+	internal->dormantModulesDirty = true;
+}
+
+
+/** Adds a block to the block stats, keeping it among the worst blocks if it is slow enough.
+*/
+static void Engine_updateBlockStats(Engine::Internal* internal, double load, double duration) {
+	BlockStats& stats = internal->blockStats;
+	if (load > 1.0)
+		stats.xrunCount++;
+
+	// Readers only hold the lock for copying, leave this block out rather than waiting for them
+	std::unique_lock<std::mutex> lock(internal->blockStatsMutex, std::try_to_lock);
+	if (!lock.owns_lock())
+		return;
+
+	stats.counts[math::clamp((int) (load * BlockStats::kBinsPerBlock), 0, BlockStats::kBinCount - 1)]++;
+	stats.blockCount++;
+	stats.maxLoad = std::fmax(stats.maxLoad, load);
+
+	if (stats.worstBlockCount == BlockStats::kWorstBlockCount && load <= stats.worstBlocks[stats.worstBlockCount - 1].load)
+		return;
+
+	// Insert sorted, dropping the fastest of the worst blocks once full
+	int pos = std::min(stats.worstBlockCount, BlockStats::kWorstBlockCount - 1);
+	for (; pos > 0 && stats.worstBlocks[pos - 1].load < load; pos--)
+		stats.worstBlocks[pos] = stats.worstBlocks[pos - 1];
+	if (stats.worstBlockCount < BlockStats::kWorstBlockCount)
+		stats.worstBlockCount++;
+
+	BlockStats::WorstBlock& block = stats.worstBlocks[pos];
+	block.load = load;
+	block.duration = duration;
+	block.unixTime = system::getUnixTime();
+	block.frame = internal->blockFrame;
+	block.moduleCount = 0;
+
+	const int moduleCount = internal->blockModuleTimes.size();
+	for (int i = 0; i < moduleCount; i++) {
+		const double time = internal->blockModuleTimes[i];
+		if (time <= 0.0)
+			continue;
+		if (block.moduleCount == BlockStats::kWorstModuleCount && time <= block.moduleTimes[block.moduleCount - 1])
+			continue;
+		int m = std::min(block.moduleCount, BlockStats::kWorstModuleCount - 1);
+		for (; m > 0 && block.moduleTimes[m - 1] < time; m--) {
+			block.moduleIds[m] = block.moduleIds[m - 1];
+			block.moduleModels[m] = block.moduleModels[m - 1];
+			block.moduleTimes[m] = block.moduleTimes[m - 1];
+		}
+		if (block.moduleCount < BlockStats::kWorstModuleCount)
+			block.moduleCount++;
+		block.moduleIds[m] = internal->modules[i]->id;
+		block.moduleModels[m] = internal->modules[i]->model;
+		block.moduleTimes[m] = time;
+	}
+}
+
+
+void Engine::stepBlock(int frames) {
+	const perftrace::Scope trace("engine", "stepBlock");
+
+	// Start timer before locking
+	double startTime = system::getTime();
+	const double startCpuTime = system::getThreadTime();
+
+	// Only wait for writers for a small part of the block, most edits hold the lock for much less.
+	// If the engine is still being modified, skip this block and leave the outputs silent.
+	static constexpr const double kWriterWaitRatio = 0.25;
+	const double writerDeadline = startTime + kWriterWaitRatio * frames / internal->sampleRate;
+	const SharedTryLock<SharedMutex> lock(internal->mutex, writerDeadline);
+	if (!lock.locked) {
+		internal->blockStats.skippedCount++;
+		internal->blockSkipped = true;
+		internal->blockFrame = internal->frame;
+		internal->blockTime = system::getTime();
+		internal->blockFrames = frames;
+		internal->frame += frames;
+		internal->freezeFrame += frames;
+		internal->block++;
+		return;
+	}
+	internal->blockSkipped = false;
+
+	// Configure thread
+	const ScopedDenormalsFlush denormalsFlush;
+	random::init();
+
+	// Borrow worker threads from the shared pool for this block
+#if defined(__EMSCRIPTEN__) && !defined(CARDINAL_WASM_THREADS)
+	const int threadCount = 1;
+#else
+	const int threadCount = math::clamp(settings::threadCount, 1, 64);
+#endif
+	Engine_acquireWorkers(this, threadCount);
+
+	// Record anything not real-time safe from here on, if enabled
+	rtaudit::enter();
+
+	internal->blockFrame = internal->frame;
+	internal->blockTime = system::getTime();
+	internal->blockFrames = frames;
+
+	// Frozen modules follow the host transport whenever it moves, fixed block sizes step it more than once per host block
+	const int64_t transportFrame = internal->transportFrame.load(std::memory_order_relaxed);
+	if (transportFrame >= 0 && transportFrame != internal->lastTransportFrame)
+		internal->freezeFrame = transportFrame;
+	internal->lastTransportFrame = transportFrame;
+
+	// Update expander pointers, and collect the modules that can request message flips
+	internal->expanderModules.clear();
+	for (Module* module : internal->modules) {
+		Engine_updateExpander_NoLock(this, module, false);
+		Engine_updateExpander_NoLock(this, module, true);
+		if (Module_hasExpanderMessages(module))
+			internal->expanderModules.push_back(module);
+	}
+
+	// Skip modules that do not reach the host
+	Engine_updateDormantModules(internal);
+	internal->blockModuleTimes.assign(internal->modules.size(), 0.0);
+
+	// Route terminal module cables without walking their cable lists on each frame
+	Engine_updateTerminalCableRoutes(internal);
+
+	// Find the modules that depend on one-sample feedback delays
+	Engine_updateModuleCycles(internal);
+
+	// Receive new param smoothing targets
+	internal->paramSmoother.update();
+
+	// Build ProcessArgs for block modules
+	Module::ProcessArgs processArgs;
+	processArgs.sampleRate = internal->sampleRate;
+	processArgs.sampleTime = internal->sampleTime;
+	processArgs.frame = internal->frame;
+
+	// Render block sources before stepping frames, they play back their outputs frame by frame
+	for (BlockModule* blockModule : internal->blockModules) {
+		if (blockModule->blockMode == BlockModule::kBlockModeFrame)
+			continue;
+		if (internal->frozenModules.find(blockModule) != internal->frozenModules.end())
+			continue;
+		if (!blockModule->prepareBlock(frames))
+			continue;
+		if (blockModule->blockMode == BlockModule::kBlockModeSource && !blockModule->isBypassed()) {
+			Engine_setCurrentModule(blockModule);
+			blockModule->processBlock(processArgs, frames);
+		}
+	}
+	Engine_setCurrentModule(NULL);
+
+	// Step individual frames
+	internal->traceModules = perftrace::isRecording() && internal->block % 16 == 0;
+	internal->timeModules = true;
+	for (int i = 0; i < frames; i++) {
+		Engine_stepFrame(this);
+		internal->traceModules = false;
+		internal->timeModules = false;
+	}
+
+	// Render block sinks after stepping frames, they recorded their inputs frame by frame
+	for (BlockModule* blockModule : internal->blockModules) {
+		if (blockModule->blockMode == BlockModule::kBlockModeSink && !blockModule->isBypassed()
+			&& frames <= blockModule->getBlockCapacity()
+			&& internal->frozenModules.find(blockModule) == internal->frozenModules.end()) {
+			Engine_setCurrentModule(blockModule);
+			blockModule->processBlock(processArgs, frames);
+		}
+	}
+	Engine_setCurrentModule(NULL);
+
+	Engine_updateModuleProfiles(internal);
+	Engine_updateCableStats(internal);
+	Engine_publishUiSnapshot(internal);
+
+	// Capture module states for a pending save, at the block boundary
+	const bool snapshotCaptured = internal->snapshotRequested.load(std::memory_order_acquire);
+	if (snapshotCaptured)
+		Engine_captureSnapshots_NoLock(internal);
+
+	// Waking up and releasing workers is expected to lock
+	rtaudit::leave();
+
+	// Let workers sleep in the pool until the next block
+	yieldWorkers();
+	const int borrowedCount = internal->workers.size();
+	Engine_releaseWorkers(this);
+
+	if (snapshotCaptured) {
+		{
+			std::lock_guard<std::mutex> snapshotLock(internal->snapshotMutex);
+			internal->snapshotRequested = false;
+		}
+		internal->snapshotCv.notify_all();
+	}
+
+	internal->block++;
+
+	// Stop timer
+	double endTime = system::getTime();
+	double meter = (endTime - startTime) / (frames * internal->sampleTime);
+	internal->meterTotal += meter;
+	internal->meterMax = std::fmax(internal->meterMax, meter);
+	internal->meterCount++;
+
+	// CPU time of the audio thread and of the workers, of the previous block for the latter
+	const double cpuTime = system::getThreadTime() - startCpuTime
+		+ internal->workerCpuTime.exchange(0, std::memory_order_relaxed) * 1e-9;
+	internal->meterCpuTotal += cpuTime;
+	internal->meterDurationTotal += frames * internal->sampleTime;
+
+	// Update meter values
+	const double meterUpdateDuration = 1.0;
+	if (startTime - internal->meterLastTime >= meterUpdateDuration) {
+		internal->meterLastAverage = internal->meterTotal / internal->meterCount;
+		internal->meterLastMax = internal->meterMax;
+		internal->meterLastCpuLoad = internal->meterCpuTotal / internal->meterDurationTotal;
+		internal->meterLastTime = startTime;
+		internal->meterCount = 0;
+		internal->meterTotal = 0.0;
+		internal->meterMax = 0.0;
+		internal->meterCpuTotal = 0.0;
+		internal->meterDurationTotal = 0.0;
+	}
+
+	Engine_updateCpuBudget(internal, cpuTime / (frames * internal->sampleTime), frames * internal->sampleTime, borrowedCount);
+	Engine_updateLoadShedding(internal, meter, frames * internal->sampleTime);
+	Engine_updateBlockStats(internal, meter, frames * internal->sampleTime);
+}
+
+
+void Engine::setMasterModule(Module* module) {
+}
+
+
+void Engine::setMasterModule_NoLock(Module* module) {
+}
+
+
+Module* Engine::getMasterModule() {
+	return nullptr;
+}
+
+
+float Engine::getSampleRate() {
+	return internal->sampleRate;
+}
+
+
+/** Calls `f(i)` for every index below `count`, spread over a few threads taking indexes in turn.
+Threads are only started when there is enough work to pay for them, each one gets the context of the calling thread.
+*/
+template <typename F>
+static void Engine_runInParallel(const size_t count, const F& f) {
+	std::atomic<size_t> nextIndex{0};
+	Context* const context = contextGet();
+
+	auto run = [&]() {
+		for (size_t i = nextIndex++; i < count; i = nextIndex++)
+			f(i);
+	};
+
+#ifdef __EMSCRIPTEN__
+	const int threadCount = 1;
+#else
+	const int threadCount = math::clamp<int>(std::min<size_t>(std::thread::hardware_concurrency(), count / 8), 1, 16);
+#endif
+	std::vector<std::thread> threads;
+	for (int i = 1; i < threadCount; i++) {
+		threads.emplace_back([&] {
+			// Modules may access the context or generate random numbers
+			contextSet(context);
+			random::init();
+			run();
+		});
+	}
+	run();
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+
+/** Dispatches SampleRateChangeEvent to all modules.
+The handlers of some of them are slow, like plugin hosts restarting their plugins or modules rebuilding tables,
+so those of models set as parallel safe run on a few threads, the others run serially on the calling thread.
+Modules implementing ModuleSampleRateCoefficients are updated last, in a single pass.
+The writer lock keeps the audio thread out until every module is done.
+*/
+static void Engine_updateSampleRate(Engine* that) {
+	Engine::Internal* internal = that->internal;
+	const float sampleRate = internal->hostSampleRate * internal->oversampling;
+	if (sampleRate == internal->sampleRate)
+		return;
+	const EngineWriteLock lock(internal);
+
+	internal->sampleRate = sampleRate;
+	internal->sampleTime = 1.f / sampleRate;
+	// Dispatch SampleRateChangeEvent
+	Module::SampleRateChangeEvent e;
+	e.sampleRate = internal->sampleRate;
+	e.sampleTime = internal->sampleTime;
+	std::vector<Module*> modules(internal->modules);
+	modules.insert(modules.end(), internal->terminalModules.begin(), internal->terminalModules.end());
+
+	std::vector<Module*> parallelModules;
+	std::vector<ModuleSampleRateCoefficients*> coefficientModules;
+	for (Module* module : modules) {
+		if (ModuleSampleRateCoefficients* const coefficients = dynamic_cast<ModuleSampleRateCoefficients*>(module))
+			coefficientModules.push_back(coefficients);
+		else if (plugin::isModuleParallelSafe(module->model))
+			parallelModules.push_back(module);
+		else
+			module->onSampleRateChange(e);
+	}
+
+	Engine_runInParallel(parallelModules.size(), [&](const size_t i) {
+		parallelModules[i]->onSampleRateChange(e);
+	});
+
+	for (ModuleSampleRateCoefficients* coefficients : coefficientModules)
+		coefficients->updateSampleRateCoefficients(e.sampleRate, e.sampleTime);
+}
+
+
+void Engine::setSampleRate(float sampleRate) {
+	internal->hostSampleRate = sampleRate;
+	Engine_updateSampleRate(this);
+}
+
+
+void Engine::setSuggestedSampleRate(float suggestedSampleRate) {
+}
+
+
+float Engine::getSampleTime() {
+	return internal->sampleTime;
+}
+
+
+void Engine::yieldWorkers() {
+	internal->engineBarrier.yield();
+}
+
+
+int64_t Engine::getBlock() {
+	return internal->block;
+}
+
+
+int64_t Engine::getFrame() {
+	return internal->frame;
+}
+
+
+void Engine::setFrame(int64_t frame) {
+	internal->frame = frame;
+}
+
+
+int64_t Engine::getBlockFrame() {
+	return internal->blockFrame;
+}
+
+
+double Engine::getBlockTime() {
+	return internal->blockTime;
+}
+
+
+int Engine::getBlockFrames() {
+	return internal->blockFrames;
+}
+
+
+double Engine::getBlockDuration() {
+	return internal->blockFrames * internal->sampleTime;
+}
+
+
+double Engine::getMeterAverage() {
+	return internal->meterLastAverage;
+}
+
+
+double Engine::getMeterMax() {
+	return internal->meterLastMax;
+}
+
+
+size_t Engine::getNumModules() {
+	return internal->modules.size() + internal->terminalModules.size();
+}
+
+
+size_t Engine::getModuleIds(int64_t* moduleIds, size_t len) {
+	const EngineReadLock lock(internal);
+	size_t i = 0;
+	for (Module* m : internal->modules) {
+		if (i >= len)
+			break;
+		moduleIds[i++] = m->id;
+	}
+	for (TerminalModule* m : internal->terminalModules) {
+		if (i >= len)
+			break;
+		moduleIds[i++] = m->id;
+	}
+	return i;
+}
+
+
+std::vector<int64_t> Engine::getModuleIds() {
+	const EngineReadLock lock(internal);
+	std::vector<int64_t> moduleIds;
+	moduleIds.reserve(getNumModules());
+	for (Module* m : internal->modules) {
+		moduleIds.push_back(m->id);
+	}
+	for (TerminalModule* tm : internal->terminalModules) {
+		moduleIds.push_back(tm->id);
+	}
+	return moduleIds;
+}
+
+
+static TerminalModule* asTerminalModule(Module* const module) {
+	const plugin::Model* const model = module->model;
+	if (std::find(hostTerminalModels.begin(), hostTerminalModels.end(), model) != hostTerminalModels.end())
+		return static_cast<TerminalModule*>(module);
+	return nullptr;
+}
+
+
+/** Adds a module without cables to the processing order.
+Such a module does not depend on any other module, so it goes to the end of the first level.
+*/
+static void Engine_insertModuleToOrder(Engine::Internal* internal, Module* module) {
+	std::vector<int>& levelStarts = internal->levelStarts;
+	std::vector<int>& cableStarts = internal->moduleCableStarts;
+	if (levelStarts.size() < 2)
+		levelStarts = {0, 0};
+	if (cableStarts.empty())
+		cableStarts.push_back(0);
+	const int index = levelStarts[1];
+	const int cableStart = cableStarts[index];
+	internal->modules.insert(internal->modules.begin() + index, module);
+	cableStarts.insert(cableStarts.begin() + index, cableStart);
+	for (size_t l = 1; l < levelStarts.size(); l++)
+		levelStarts[l]++;
+	internal->moduleLevels[module] = 0;
+	internal->dormantModuleIndexes[module] = index;
+	for (const Input& input : module->inputs)
+		internal->cycleInputModules[&input] = index;
+	ModuleProfile& profile = internal->moduleProfiles[module];
+	if (internal->moduleMetersEnabled)
+		profile.meter.reset(new ModuleMeter);
+	internal->moduleCyclesDirty = true;
+	internal->dormantModulesDirty = true;
+}
+
+
+/** Removes a module from the processing order.
+All of its cables must have been removed already.
+*/
+static void Engine_eraseModuleFromOrder(Engine::Internal* internal, std::vector<Module*>::iterator it) {
+	const int index = it - internal->modules.begin();
+	internal->moduleLevels.erase(*it);
+	internal->dormantModuleIndexes.erase(*it);
+	for (const Input& input : (*it)->inputs)
+		internal->cycleInputModules.erase(&input);
+	internal->moduleProfiles.erase(*it);
+	internal->modules.erase(it);
+	for (int& levelStart : internal->levelStarts) {
+		if (levelStart > index)
+			levelStart--;
+	}
+	// Remove empty levels at the end
+	while (internal->levelStarts.size() > 2 && internal->levelStarts[internal->levelStarts.size() - 2] == internal->levelStarts.back())
+		internal->levelStarts.pop_back();
+	DISTRHO_SAFE_ASSERT(internal->moduleCableStarts[index] == internal->moduleCableStarts[index + 1]);
+	internal->moduleCableStarts.erase(internal->moduleCableStarts.begin() + index);
+	internal->moduleCyclesDirty = true;
+	internal->dormantModulesDirty = true;
+	for (Engine::Internal::ModuleCyclesEntry& entry : internal->moduleCyclesCache)
+		entry.valid = false;
+}
+
 
+static void Engine_addModule_NoLock(Engine* that, Module* module) {
+	Engine::Internal* internal = that->internal;
+	// Set ID if unset or collides with an existing ID
+	while (module->id < 0 || internal->modulesCache.find(module->id) != internal->modulesCache.end()) {
+		// Randomly generate ID
+		module->id = random::u64() % (1ull << 53);
+	}
+	// Add module
+	if (TerminalModule* const terminalModule = asTerminalModule(module)) {
+		internal->terminalModules.push_back(terminalModule);
+		internal->terminalCableRoutesDirty = true;
+	}
+	else
+		Engine_insertModuleToOrder(internal, module);
+	Engine_reserveDormantModules(internal);
+	Engine_reserveModuleCycles(internal);
+	if (BlockModule* const blockModule = dynamic_cast<BlockModule*>(module)) {
+		Engine_updateBlockMode(blockModule);
+		blockModule->reserveBlock(internal->maxBlockFrames);
+		internal->blockModules.push_back(blockModule);
+	}
+	internal->modulesCache[module->id] = module;
+	// Dispatch AddEvent
+	Module::AddEvent eAdd;
+	module->onAdd(eAdd);
+	// Dispatch SampleRateChangeEvent
+	Module::SampleRateChangeEvent eSrc;
+	eSrc.sampleRate = internal->sampleRate;
+	eSrc.sampleTime = internal->sampleTime;
+	module->onSampleRateChange(eSrc);
+	// Update ParamHandles' module pointers
+	for (ParamHandle* paramHandle : internal->paramHandles) {
+		if (paramHandle->moduleId == module->id)
+			paramHandle->module = module;
+	}
 #if DEBUG_ORDERED_MODULES
-	Engine_debugOrderedModules(internal->modules);
+	printf("New module: %s - %ld\n", module->model->getFullName().c_str(), module->id);
 #endif
 }
 
 
-static void Engine_updateConnected(Engine* that) {
-	// Find disconnected ports
-	std::set<Input*> disconnectedInputs;
-	std::set<Output*> disconnectedOutputs;
-	for (Module* module : that->internal->modules) {
-		for (Input& input : module->inputs) {
-			disconnectedInputs.insert(&input);
-		}
-		for (Output& output : module->outputs) {
-			disconnectedOutputs.insert(&output);
-		}
-	}
-	for (TerminalModule* terminalModule : that->internal->terminalModules) {
-		for (Input& input : terminalModule->inputs) {
-			disconnectedInputs.insert(&input);
-		}
-		for (Output& output : terminalModule->outputs) {
-			disconnectedOutputs.insert(&output);
+void Engine::addModule(Module* module) {
+	const EngineWriteLock lock(internal);
+	DISTRHO_SAFE_ASSERT_RETURN(module != nullptr,);
+	// Check that the module is not already added
+	auto it = std::find(internal->modules.begin(), internal->modules.end(), module);
+	DISTRHO_SAFE_ASSERT_RETURN(it == internal->modules.end(),);
+	auto tit = std::find(internal->terminalModules.begin(), internal->terminalModules.end(), module);
+	DISTRHO_SAFE_ASSERT_RETURN(tit == internal->terminalModules.end(),);
+	Engine_addModule_NoLock(this, module);
+}
+
+
+void Engine::removeModule(Module* module) {
+	const EngineWriteLock lock(internal);
+	removeModule_NoLock(module);
+}
+
+
+static void removeModule_NoLock_common(Engine::Internal* internal, Module* module) {
+	// Remove from widgets cache
+	CardinalPluginModelHelper* const helper = dynamic_cast<CardinalPluginModelHelper*>(module->model);
+	DISTRHO_SAFE_ASSERT_RETURN(helper != nullptr,);
+	helper->removeCachedModuleWidget(module);
+	// Dispatch RemoveEvent
+	Module::RemoveEvent eRemove;
+	module->onRemove(eRemove);
+	// Update ParamHandles' module pointers
+	for (ParamHandle* paramHandle : internal->paramHandles) {
+		if (paramHandle->moduleId == module->id)
+			paramHandle->module = NULL;
+	}
+	// If params are being smoothed on this module, stop smoothing them immediately
+	if (!module->params.empty())
+		internal->paramSmoother.cancelRange(&module->params.front(), &module->params.back() + 1);
+	// Check that all cables are disconnected
+	for (Cable* cable : internal->cables) {
+		DISTRHO_SAFE_ASSERT(cable->inputModule != module);
+		DISTRHO_SAFE_ASSERT(cable->outputModule != module);
+	}
+	// Update expanders of other modules
+	for (Module* m : internal->modules) {
+		if (m->leftExpander.module == module) {
+			m->leftExpander.moduleId = -1;
+			m->leftExpander.module = NULL;
+		}
+		if (m->rightExpander.module == module) {
+			m->rightExpander.moduleId = -1;
+			m->rightExpander.module = NULL;
+		}
+	}
+	// Reset expanders
+	module->leftExpander.moduleId = -1;
+	module->leftExpander.module = NULL;
+	module->rightExpander.moduleId = -1;
+	module->rightExpander.module = NULL;
+	// Forget about user interaction with this module
+	Module* touchedModule = module;
+	internal->touchedModule.compare_exchange_strong(touchedModule, NULL);
+	for (Engine::Internal::WokenModule& wokenModule : internal->wokenModules) {
+		if (wokenModule.module == module)
+			wokenModule.module = NULL;
+	}
+	internal->frozenModules.erase(module);
+	// Remove module
+	auto eit = std::find(internal->expanderModules.begin(), internal->expanderModules.end(), module);
+	if (eit != internal->expanderModules.end())
+		internal->expanderModules.erase(eit);
+	auto bit = std::find(internal->blockModules.begin(), internal->blockModules.end(), module);
+	if (bit != internal->blockModules.end())
+		internal->blockModules.erase(bit);
+	internal->modulesCache.erase(module->id);
+}
+
+
+void Engine::removeModule_NoLock(Module* module) {
+	DISTRHO_SAFE_ASSERT_RETURN(module,);
+	// Check that the module actually exists
+	if (TerminalModule* const terminalModule = asTerminalModule(module)) {
+		auto tit = std::find(internal->terminalModules.begin(), internal->terminalModules.end(), terminalModule);
+		DISTRHO_SAFE_ASSERT_RETURN(tit != internal->terminalModules.end(),);
+		removeModule_NoLock_common(internal, module);
+		internal->terminalModules.erase(tit);
+		internal->terminalCableRoutesDirty = true;
+	}
+	else {
+		auto it = std::find(internal->modules.begin(), internal->modules.end(), module);
+		DISTRHO_SAFE_ASSERT_RETURN(it != internal->modules.end(),);
+		removeModule_NoLock_common(internal, module);
+		Engine_eraseModuleFromOrder(internal, it);
+	}
+}
+
+
+bool Engine::hasModule(Module* module) {
+	const EngineReadLock lock(internal);
+	// TODO Performance could be improved by searching modulesCache, but more testing would be needed to make sure it's always valid.
+	auto it = std::find(internal->modules.begin(), internal->modules.end(), module);
+	auto tit = std::find(internal->terminalModules.begin(), internal->terminalModules.end(), module);
+	return it != internal->modules.end() && tit != internal->terminalModules.end();
+}
+
+
+Module* Engine::getModule(int64_t moduleId) {
+	const EngineReadLock lock(internal);
+	return getModule_NoLock(moduleId);
+}
+
+
+Module* Engine::getModule_NoLock(int64_t moduleId) {
+	auto it = internal->modulesCache.find(moduleId);
+	if (it == internal->modulesCache.end())
+		return NULL;
+	return it->second;
+}
+
+
+void Engine::resetModule(Module* module) {
+	const EngineWriteLock lock(internal);
+	DISTRHO_SAFE_ASSERT_RETURN(module,);
+
+	Module::ResetEvent eReset;
+	module->onReset(eReset);
+}
+
+
+void Engine::randomizeModule(Module* module) {
+	const EngineWriteLock lock(internal);
+	DISTRHO_SAFE_ASSERT_RETURN(module,);
+
+	Module::RandomizeEvent eRandomize;
+	module->onRandomize(eRandomize);
+}
+
+
+void Engine::bypassModule(Module* module, bool bypassed) {
+	DISTRHO_SAFE_ASSERT_RETURN(module,);
+	if (module->isBypassed() == bypassed)
+		return;
+
+	const EngineWriteLock lock(internal);
+
+	// Clear outputs and set to 1 channel
+	for (Output& output : module->outputs) {
+		// This zeros all voltages, but the channel is set to 1 if connected
+		output.setChannels(0);
+	}
+	// Set bypassed state
+	module->setBypassed(bypassed);
+	if (bypassed) {
+		// Dispatch BypassEvent
+		Module::BypassEvent eBypass;
+		module->onBypass(eBypass);
+	}
+	else {
+		// Dispatch UnBypassEvent
+		Module::UnBypassEvent eUnBypass;
+		module->onUnBypass(eUnBypass);
+	}
+}
+
+
+json_t* Engine::moduleToJson(Module* module) {
+	if (dynamic_cast<ModuleSnapshot*>(module) != NULL)
+		Engine_captureSnapshots(this);
+	const EngineReadLock lock(internal);
+	return module->toJson();
+}
+
+
+void Engine::moduleFromJson(Module* module, json_t* rootJ) {
+	const EngineWriteLock lock(internal);
+	const modulemem::Scope memoryScope(module);
+	module->fromJson(rootJ);
+}
+
+
+void Engine::prepareSaveModule(Module* module) {
+	const EngineReadLock lock(internal);
+	Module::SaveEvent e;
+	module->onSave(e);
+}
+
+
+void Engine::prepareSave() {
+	if (internal->aboutToClose)
+		return;
+	Engine_captureSnapshots(this);
+	const EngineReadLock lock(internal);
+	for (Module* module : internal->modules) {
+		Module::SaveEvent e;
+		module->onSave(e);
+	}
+	for (TerminalModule* terminalModule : internal->terminalModules) {
+		Module::SaveEvent e;
+		terminalModule->onSave(e);
+	}
+}
+
+
+size_t Engine::getNumCables() {
+	return internal->cables.size();
+}
+
+
+size_t Engine::getCableIds(int64_t* cableIds, size_t len) {
+	const EngineReadLock lock(internal);
+	size_t i = 0;
+	for (Cable* c : internal->cables) {
+		if (i >= len)
+			break;
+		cableIds[i] = c->id;
+		i++;
+	}
+	return i;
+}
+
+
+std::vector<int64_t> Engine::getCableIds() {
+	const EngineReadLock lock(internal);
+	std::vector<int64_t> cableIds;
+	cableIds.reserve(internal->cables.size());
+	for (Cable* c : internal->cables) {
+		cableIds.push_back(c->id);
+	}
+	return cableIds;
+}
+
+
+void Engine::addCable(Cable* cable) {
+	const EngineWriteLock lock(internal);
+	DISTRHO_SAFE_ASSERT_RETURN(cable,);
+	// Check cable properties
+	DISTRHO_SAFE_ASSERT_RETURN(cable->inputModule,);
+	DISTRHO_SAFE_ASSERT_RETURN(cable->outputModule,);
+	bool outputWasConnected = false;
+	for (Cable* cable2 : internal->cables) {
+		// Check that the cable is not already added
+		DISTRHO_SAFE_ASSERT_RETURN(cable2 != cable,);
+		// Check that the input is not already used by another cable
+		DISTRHO_SAFE_ASSERT_RETURN(!(cable2->inputModule == cable->inputModule && cable2->inputId == cable->inputId),);
+		// Get connected status of output, to decide whether we need to call a PortChangeEvent.
+		// It's best to not trust `cable->outputModule->outputs[cable->outputId]->isConnected()`
+		if (cable2->outputModule == cable->outputModule && cable2->outputId == cable->outputId)
+			outputWasConnected = true;
+	}
+	// Set ID if unset or collides with an existing ID
+	while (cable->id < 0 || internal->cablesCache.find(cable->id) != internal->cablesCache.end()) {
+		// Randomly generate ID
+		cable->id = random::u64() % (1ull << 53);
+	}
+	// Add the cable
+	internal->cables.push_back(cable);
+	internal->cablesCache[cable->id] = cable;
+	// Add the cable's zero-latency shortcut
+	cable->outputModule->outputs[cable->outputId].cables.push_back(cable);
+	Engine_connectCable(this, cable);
+	Engine_reserveModuleCycles(internal);
+	// Dispatch input port event
+	{
+		Module::PortChangeEvent e;
+		e.connecting = true;
+		e.type = Port::INPUT;
+		e.portId = cable->inputId;
+		cable->inputModule->onPortChange(e);
+	}
+	// Dispatch output port event if its state went from disconnected to connected.
+	if (!outputWasConnected) {
+		Module::PortChangeEvent e;
+		e.connecting = true;
+		e.type = Port::OUTPUT;
+		e.portId = cable->outputId;
+		cable->outputModule->onPortChange(e);
+	}
+}
+
+
+/** Adds many cables at once, ordering the modules a single time instead of after each cable.
+The cables must not be added already, and must not share inputs with each other or with existing cables.
+*/
+static void Engine_addCables_NoLock(Engine* that, const std::vector<Cable*>& cables) {
+	Engine::Internal* internal = that->internal;
+	std::vector<bool> outputsWereConnected;
+	outputsWereConnected.reserve(cables.size());
+	internal->cables.reserve(internal->cables.size() + cables.size());
+	internal->cablesCache.reserve(internal->cablesCache.size() + cables.size());
+	for (Cable* cable : cables) {
+		// Set ID if unset or collides with an existing ID
+		while (cable->id < 0 || internal->cablesCache.find(cable->id) != internal->cablesCache.end()) {
+			// Randomly generate ID
+			cable->id = random::u64() % (1ull << 53);
 		}
-	}
-	for (Cable* cable : that->internal->cables) {
-		// Connect input
 		Input& input = cable->inputModule->inputs[cable->inputId];
-		auto inputIt = disconnectedInputs.find(&input);
-		if (inputIt != disconnectedInputs.end())
-			disconnectedInputs.erase(inputIt);
-		Port_setConnected(&input);
-		// Connect output
 		Output& output = cable->outputModule->outputs[cable->outputId];
-		auto outputIt = disconnectedOutputs.find(&output);
-		if (outputIt != disconnectedOutputs.end())
-			disconnectedOutputs.erase(outputIt);
+		outputsWereConnected.push_back(!output.cables.empty());
+		// Add the cable
+		internal->cables.push_back(cable);
+		internal->cablesCache[cable->id] = cable;
+		// Add the cable's zero-latency shortcut
+		output.cables.push_back(cable);
+		internal->moduleInputCables[cable->inputModule].push_back(cable);
+		Port_setConnected(&input);
 		Port_setConnected(&output);
 	}
-	// Disconnect ports that have no cable
-	for (Input* input : disconnectedInputs) {
-		Port_setDisconnected(input);
+	Engine_orderModules(that);
+	Engine_reserveModuleCycles(internal);
+	internal->moduleCyclesDirty = true;
+	internal->dormantModulesDirty = true;
+	for (BlockModule* blockModule : internal->blockModules) {
+		Engine_updateBlockMode(blockModule);
 	}
-	for (Output* output : disconnectedOutputs) {
-		Port_setDisconnected(output);
-		DISTRHO_SAFE_ASSERT(output->cables.empty());
+#if DEBUG_ORDERED_MODULES
+	Engine_debugOrderedModules(internal->modules);
+#endif
+	// Dispatch port events once all cables are connected
+	for (size_t i = 0; i < cables.size(); i++) {
+		Cable* cable = cables[i];
+		{
+			Module::PortChangeEvent e;
+			e.connecting = true;
+			e.type = Port::INPUT;
+			e.portId = cable->inputId;
+			cable->inputModule->onPortChange(e);
+		}
+		if (!outputsWereConnected[i]) {
+			Module::PortChangeEvent e;
+			e.connecting = true;
+			e.type = Port::OUTPUT;
+			e.portId = cable->outputId;
+			cable->outputModule->onPortChange(e);
+		}
 	}
-	// Order the modules according to their connections
-	Engine_orderModules(that);
 }
 
 
-static void Engine_refreshParamHandleCache(Engine* that) {
-	// Clear cache
-	that->internal->paramHandlesCache.clear();
-	// Add active ParamHandles to cache
-	for (ParamHandle* paramHandle : that->internal->paramHandles) {
-		if (paramHandle->moduleId >= 0) {
-			that->internal->paramHandlesCache[std::make_tuple(paramHandle->moduleId, paramHandle->paramId)] = paramHandle;
-		}
+void Engine::removeCable(Cable* cable) {
+	const EngineWriteLock lock(internal);
+	removeCable_NoLock(cable);
+}
+
+
+void Engine::removeCable_NoLock(Cable* cable) {
+	DISTRHO_SAFE_ASSERT_RETURN(cable,);
+	// Check that the cable is already added
+	auto it = std::find(internal->cables.begin(), internal->cables.end(), cable);
+	DISTRHO_SAFE_ASSERT_RETURN(it != internal->cables.end(),);
+	// Remove the cable's zero-latency shortcut
+	cable->outputModule->outputs[cable->outputId].cables.remove(cable);
+	// Remove the cable
+	internal->cablesCache.erase(cable->id);
+	internal->cables.erase(it);
+	Engine_disconnectCable(this, cable);
+	bool outputIsConnected = false;
+	for (Cable* cable2 : internal->cables) {
+		// Get connected status of output, to decide whether we need to call a PortChangeEvent.
+		// It's best to not trust `cable->outputModule->outputs[cable->outputId]->isConnected()`
+		if (cable2->outputModule == cable->outputModule && cable2->outputId == cable->outputId)
+			outputIsConnected = true;
+	}
+	// Dispatch input port event
+	{
+		Module::PortChangeEvent e;
+		e.connecting = false;
+		e.type = Port::INPUT;
+		e.portId = cable->inputId;
+		cable->inputModule->onPortChange(e);
+	}
+	// Dispatch output port event if its state went from connected to disconnected.
+	if (!outputIsConnected) {
+		Module::PortChangeEvent e;
+		e.connecting = false;
+		e.type = Port::OUTPUT;
+		e.portId = cable->outputId;
+		cable->outputModule->onPortChange(e);
 	}
 }
 
 
-Engine::Engine() {
-	internal = new Internal;
+bool Engine::hasCable(Cable* cable) {
+	const EngineReadLock lock(internal);
+	// TODO Performance could be improved by searching cablesCache, but more testing would be needed to make sure it's always valid.
+	auto it = std::find(internal->cables.begin(), internal->cables.end(), cable);
+	return it != internal->cables.end();
 }
 
 
-Engine::~Engine() {
-	// Clear modules, cables, etc
-	clear();
+Cable* Engine::getCable(int64_t cableId) {
+	const EngineReadLock lock(internal);
+	auto it = internal->cablesCache.find(cableId);
+	if (it == internal->cablesCache.end())
+		return NULL;
+	return it->second;
+}
 
-	// Make sure there are no cables or modules in the rack on destruction.
-	// If this happens, a module must have failed to remove itself before the RackWidget was destroyed.
-	DISTRHO_SAFE_ASSERT(internal->cables.empty());
-	DISTRHO_SAFE_ASSERT(internal->modules.empty());
-	DISTRHO_SAFE_ASSERT(internal->terminalModules.empty());
-	DISTRHO_SAFE_ASSERT(internal->paramHandles.empty());
 
-	DISTRHO_SAFE_ASSERT(internal->modulesCache.empty());
-	DISTRHO_SAFE_ASSERT(internal->cablesCache.empty());
-	DISTRHO_SAFE_ASSERT(internal->paramHandlesCache.empty());
+void Engine::setParamValue(Module* module, int paramId, float value) {
+	// If param is being smoothed, cancel smoothing.
+	internal->paramSmoother.cancel(&module->params[paramId]);
+	module->params[paramId].value = value;
+	// Wake up the module if dormant
+	if (internal->skipDormantModules || internal->shedding)
+		internal->touchedModule = module;
+}
 
-	delete internal;
+
+float Engine::getParamValue(Module* module, int paramId) {
+	return module->params[paramId].value;
 }
 
 
-void Engine::clear() {
-	std::lock_guard<SharedMutex> lock(internal->mutex);
-	clear_NoLock();
+void Engine::setParamSmoothValue(Module* module, int paramId, float value) {
+	// Jump to the value if too many params are being smoothed
+	if (!internal->paramSmoother.setTarget(&module->params[paramId], value))
+		module->params[paramId].setValue(value);
+	// Wake up the module if dormant
+	if (internal->skipDormantModules || internal->shedding)
+		internal->touchedModule = module;
 }
 
 
-void Engine::clear_NoLock() {
-	// Copy lists because we'll be removing while iterating
-	std::set<ParamHandle*> paramHandles = internal->paramHandles;
-	for (ParamHandle* paramHandle : paramHandles) {
-		removeParamHandle_NoLock(paramHandle);
-		// Don't delete paramHandle because they're normally owned by Module subclasses
-	}
-	std::vector<Cable*> cables = internal->cables;
-	for (Cable* cable : cables) {
-		removeCable_NoLock(cable);
-		delete cable;
-	}
-	std::vector<Module*> modules = internal->modules;
-	for (Module* module : modules) {
-		removeModule_NoLock(module);
-		delete module;
-	}
-	std::vector<TerminalModule*> terminalModules = internal->terminalModules;
-	for (TerminalModule* terminalModule : terminalModules) {
-		removeModule_NoLock(terminalModule);
-		delete terminalModule;
-	}
+float Engine::getParamSmoothValue(Module* module, int paramId) {
+	float value;
+	if (internal->paramSmoother.getTarget(&module->params[paramId], value))
+		return value;
+	return module->params[paramId].value;
 }
 
 
-void Engine::stepBlock(int frames) {
-#ifndef HEADLESS
-	// Start timer before locking
-	double startTime = system::getTime();
-#endif
+void Engine::addParamHandle(ParamHandle* paramHandle) {
+	const EngineWriteLock lock(internal);
+	// New ParamHandles must be blank.
+	// This means we don't have to refresh the cache.
+	DISTRHO_SAFE_ASSERT_RETURN(paramHandle->moduleId < 0,);
 
-	SharedLock<SharedMutex> lock(internal->mutex);
-	// Configure thread
-	random::init();
+	// Check that the ParamHandle is not already added
+	auto it = internal->paramHandles.find(paramHandle);
+	DISTRHO_SAFE_ASSERT_RETURN(it == internal->paramHandles.end(),);
 
-	internal->blockFrame = internal->frame;
-	internal->blockTime = system::getTime();
-	internal->blockFrames = frames;
+	// Add it
+	internal->paramHandles.insert(paramHandle);
+	// No need to refresh the cache because the moduleId is not set.
+}
 
-	// Update expander pointers
-	for (Module* module : internal->modules) {
-		Engine_updateExpander_NoLock(this, module, false);
-		Engine_updateExpander_NoLock(this, module, true);
-	}
 
-	// Step individual frames
-	for (int i = 0; i < frames; i++) {
-		Engine_stepFrame(this);
-	}
+void Engine::removeParamHandle(ParamHandle* paramHandle) {
+	const EngineWriteLock lock(internal);
+	removeParamHandle_NoLock(paramHandle);
+}
 
-	internal->block++;
 
-#ifndef HEADLESS
-	// Stop timer
-	double endTime = system::getTime();
-	double meter = (endTime - startTime) / (frames * internal->sampleTime);
-	internal->meterTotal += meter;
-	internal->meterMax = std::fmax(internal->meterMax, meter);
-	internal->meterCount++;
+void Engine::removeParamHandle_NoLock(ParamHandle* paramHandle) {
+	// Check that the ParamHandle is already added
+	auto it = internal->paramHandles.find(paramHandle);
+	DISTRHO_SAFE_ASSERT_RETURN(it != internal->paramHandles.end(),);
 
-	// Update meter values
-	const double meterUpdateDuration = 1.0;
-	if (startTime - internal->meterLastTime >= meterUpdateDuration) {
-		internal->meterLastAverage = internal->meterTotal / internal->meterCount;
-		internal->meterLastMax = internal->meterMax;
-		internal->meterLastTime = startTime;
-		internal->meterCount = 0;
-		internal->meterTotal = 0.0;
-		internal->meterMax = 0.0;
+	// Remove it
+	paramHandle->module = NULL;
+	internal->paramHandles.erase(it);
+	Engine_refreshParamHandleCache(this);
+}
+
+
+ParamHandle* Engine::getParamHandle(int64_t moduleId, int paramId) {
+	const EngineReadLock lock(internal);
+	return getParamHandle_NoLock(moduleId, paramId);
+}
+
+
+ParamHandle* Engine::getParamHandle_NoLock(int64_t moduleId, int paramId) {
+	auto it = internal->paramHandlesCache.find(std::make_tuple(moduleId, paramId));
+	if (it == internal->paramHandlesCache.end())
+		return NULL;
+	return it->second;
+}
+
+
+ParamHandle* Engine::getParamHandle(Module* module, int paramId) {
+	return getParamHandle(module->id, paramId);
+}
+
+
+void Engine::updateParamHandle(ParamHandle* paramHandle, int64_t moduleId, int paramId, bool overwrite) {
+	const EngineWriteLock lock(internal);
+	updateParamHandle_NoLock(paramHandle, moduleId, paramId, overwrite);
+}
+
+
+void Engine::updateParamHandle_NoLock(ParamHandle* paramHandle, int64_t moduleId, int paramId, bool overwrite) {
+	// Check that it exists
+	auto it = internal->paramHandles.find(paramHandle);
+	DISTRHO_SAFE_ASSERT_RETURN(it != internal->paramHandles.end(),);
+
+	// Set IDs
+	paramHandle->moduleId = moduleId;
+	paramHandle->paramId = paramId;
+	paramHandle->module = NULL;
+	// At this point, the ParamHandle cache might be invalid.
+
+	if (paramHandle->moduleId >= 0) {
+		// Replace old ParamHandle, or reset the current ParamHandle
+		ParamHandle* oldParamHandle = getParamHandle_NoLock(moduleId, paramId);
+		if (oldParamHandle) {
+			if (overwrite) {
+				oldParamHandle->moduleId = -1;
+				oldParamHandle->paramId = 0;
+				oldParamHandle->module = NULL;
+			}
+			else {
+				paramHandle->moduleId = -1;
+				paramHandle->paramId = 0;
+				paramHandle->module = NULL;
+			}
+		}
 	}
-#endif
-}
 
+	// Set module pointer if the above block didn't reset it
+	if (paramHandle->moduleId >= 0) {
+		paramHandle->module = getModule_NoLock(paramHandle->moduleId);
+	}
 
-void Engine::setMasterModule(Module* module) {
+	Engine_refreshParamHandleCache(this);
 }
 
 
-void Engine::setMasterModule_NoLock(Module* module) {
-}
+json_t* Engine::toJson() {
+	const EngineReadLock lock(internal);
+	json_t* rootJ = json_object();
 
+	// modules
+	json_t* modulesJ = json_array();
+	for (Module* module : internal->modules) {
+		json_t* moduleJ = module->toJson();
+		json_array_append_new(modulesJ, moduleJ);
+	}
+	for (TerminalModule* terminalModule : internal->terminalModules) {
+		json_t* terminalModuleJ = terminalModule->toJson();
+		json_array_append_new(modulesJ, terminalModuleJ);
+	}
+	json_object_set_new(rootJ, "modules", modulesJ);
 
-Module* Engine::getMasterModule() {
-	return nullptr;
+	// cables
+	json_t* cablesJ = json_array();
+	for (Cable* cable : internal->cables) {
+		json_t* cableJ = cable->toJson();
+		json_array_append_new(cablesJ, cableJ);
+	}
+	json_object_set_new(rootJ, "cables", cablesJ);
+
+	// Cardinal specific
+	if (internal->skipDormantModules)
+		json_object_set_new(rootJ, "skipDormantModules", json_true());
+	if (internal->loadShedding)
+		json_object_set_new(rootJ, "loadShedding", json_true());
+	if (internal->idleSleepTime > 0.f)
+		json_object_set_new(rootJ, "idleSleep", json_real(internal->idleSleepTime));
+	if (internal->cpuBudget > 0.f)
+		json_object_set_new(rootJ, "cpuBudget", json_real(internal->cpuBudget));
+	if (internal->oversampling > 1)
+		json_object_set_new(rootJ, "oversampling", json_integer(internal->oversampling));
+	if (internal->blockQuantum != 0)
+		json_object_set_new(rootJ, "blockQuantum", json_integer(internal->blockQuantum));
+	if (internal->realTimeScheduling)
+		json_object_set_new(rootJ, "realTimeScheduling", json_true());
+	if (internal->audioThreadCpu >= 0)
+		json_object_set_new(rootJ, "audioThreadCpu", json_integer(internal->audioThreadCpu));
+	if (internal->autoBufferSize)
+		json_object_set_new(rootJ, "autoBufferSize", json_true());
+
+	return rootJ;
 }
 
 
-float Engine::getSampleRate() {
-	return internal->sampleRate;
+/** Creates modules for a patch load, running the constructors of models set as parallel safe in parallel.
+Many modules allocate buffers, generate tables or load samples when constructed, which dominates the load of a big patch.
+Constructors of other models may touch shared state, they run serially on the calling thread.
+Widgets and module state are loaded serially afterwards, by the calling thread.
+Modules whose constructor throws are left as NULL.
+*/
+static void Engine_createModules(const std::vector<plugin::Model*>& models, std::vector<Module*>& modules, std::vector<double>& createTimes) {
+	modules.assign(models.size(), NULL);
+	createTimes.assign(models.size(), 0.0);
+
+	auto create = [&](const size_t i) {
+		const double startTime = system::getTime();
+		modulemem::beginConstruction(models[i]);
+		try {
+			modules[i] = models[i]->createModule();
+		}
+		catch (Exception& e) {
+			WARN("Cannot create module: %s", e.what());
+		}
+		modulemem::endConstruction(modules[i]);
+		createTimes[i] = system::getTime() - startTime;
+	};
+
+	std::vector<size_t> parallelIndexes;
+	for (size_t i = 0; i < models.size(); i++) {
+		if (plugin::isModuleParallelSafe(models[i]))
+			parallelIndexes.push_back(i);
+		else
+			create(i);
+	}
+
+	Engine_runInParallel(parallelIndexes.size(), [&](const size_t i) {
+		create(parallelIndexes[i]);
+	});
 }
 
 
-void Engine::setSampleRate(float sampleRate) {
-	if (sampleRate == internal->sampleRate)
-		return;
-	std::lock_guard<SharedMutex> lock(internal->mutex);
+/** Parses a patch and constructs its modules, on the background thread of Engine_beginPreparePatch().
+*/
+static void Engine_runPreparingPatch(PreparingPatch* const preparing) {
+	try {
+		const double parseStartTime = system::getTime();
+		preparing->rootJ = preparing->parse();
+		preparing->parseTime = system::getTime() - parseStartTime;
+
+		const double startTime = system::getTime();
+		DEFER({preparing->createTime = system::getTime() - startTime;});
+
+		json_t* modulesJ = json_object_get(preparing->rootJ, "modules");
+		if (!modulesJ)
+			return;
+
+		size_t moduleIndex;
+		json_t* moduleJ;
+		json_array_foreach(modulesJ, moduleIndex, moduleJ) {
+			try {
+				preparing->models.push_back(plugin::modelFromJson(moduleJ));
+				preparing->moduleIndexes.push_back(moduleIndex);
+			}
+			catch (Exception& e) {
+				WARN("Cannot load model: %s", e.what());
+			}
+		}
 
-	internal->sampleRate = sampleRate;
-	internal->sampleTime = 1.f / sampleRate;
-	// Dispatch SampleRateChangeEvent
-	Module::SampleRateChangeEvent e;
-	e.sampleRate = internal->sampleRate;
-	e.sampleTime = internal->sampleTime;
-	for (Module* module : internal->modules) {
-		module->onSampleRateChange(e);
+		Engine_createModules(preparing->models, preparing->modules, preparing->createTimes);
 	}
-	for (TerminalModule* terminalModule : internal->terminalModules) {
-		terminalModule->onSampleRateChange(e);
+	catch (...) {
+		preparing->error = std::current_exception();
 	}
 }
 
 
-void Engine::setSuggestedSampleRate(float suggestedSampleRate) {
-}
+static void Engine_startPreparingPatch(Engine* const engine, const std::function<json_t*()>& parse, const bool background) {
+	Engine::Internal* internal = engine->internal;
+	Engine_discardPreparedPatch(engine);
 
+	PreparingPatch* const preparing = new PreparingPatch;
+	preparing->parse = parse;
+	preparing->timeParse = background;
+	{
+		const EngineReadLock lock(internal);
+		preparing->paramHandles = internal->paramHandles;
+	}
+	internal->preparingPatch = preparing;
 
-float Engine::getSampleTime() {
-	return internal->sampleTime;
+#if defined(__EMSCRIPTEN__) && !defined(CARDINAL_WASM_THREADS)
+	const bool threaded = false;
+#else
+	const bool threaded = background;
+#endif
+	if (!threaded) {
+		Engine_runPreparingPatch(preparing);
+		return;
+	}
+
+	Context* const context = contextGet();
+	preparing->thread = std::thread([preparing, context] {
+		// Modules may access the context or generate random numbers
+		contextSet(context);
+		random::init();
+		Engine_runPreparingPatch(preparing);
+	});
 }
 
 
-void Engine::yieldWorkers() {
+/** Starts loading a patch on a background thread, returning right away so the caller can keep working meanwhile,
+like extracting module data files from the patch archive.
+The thread first calls `parse`, which returns a new reference to the patch or throws, then constructs its modules.
+Must be followed by Engine_finishPreparePatch() or Engine_cancelPreparePatch() on the same thread.
+*/
+void Engine_beginPreparePatch(Engine* const engine, const std::function<json_t*()>& parse) {
+	Engine_startPreparingPatch(engine, parse, true);
 }
 
 
-int64_t Engine::getBlock() {
-	return internal->block;
-}
+/** Waits for Engine_beginPreparePatch(), then creates the module widgets needed while loading, same as Engine_preparePatch().
+Returns the parsed patch, to be given to Engine::fromJson() and released by the caller, or rethrows what parsing threw.
+*/
+json_t* Engine_finishPreparePatch(Engine* const engine) {
+	const perftrace::Scope trace("patch", "prepare");
+	Engine::Internal* internal = engine->internal;
+	PreparingPatch* const preparing = internal->preparingPatch;
+	DISTRHO_SAFE_ASSERT_RETURN(preparing != NULL, NULL);
+	internal->preparingPatch = NULL;
+
+	if (preparing->thread.joinable())
+		preparing->thread.join();
+
+	if (preparing->error) {
+		const std::exception_ptr error = preparing->error;
+		Engine_deletePreparingPatch(preparing);
+		std::rethrow_exception(error);
+	}
 
+	if (preparing->timeParse)
+		internal->pendingLoadProfile.stages.emplace_back("parse", preparing->parseTime);
+	const double createTime = preparing->createTime;
+	const double startTime = system::getTime();
+	DEFER({internal->pendingLoadProfile.stages.emplace_back("prepare", createTime + system::getTime() - startTime);});
+
+	json_t* const rootJ = preparing->rootJ;
+	const std::vector<size_t>& moduleIndexes = preparing->moduleIndexes;
+	const std::vector<plugin::Model*>& models = preparing->models;
+	const std::vector<double>& createTimes = preparing->createTimes;
+	const std::set<ParamHandle*>& paramHandles = preparing->paramHandles;
+	std::vector<Module*> createdModules;
+	createdModules.swap(preparing->modules);
+	preparing->rootJ = NULL;
+	DEFER({Engine_deletePreparingPatch(preparing);});
+
+	for (size_t i = 0; i < createdModules.size(); i++) {
+		Module* const module = createdModules[i];
+		DISTRHO_SAFE_ASSERT_CONTINUE(module != nullptr);
 
-int64_t Engine::getFrame() {
-	return internal->frame;
-}
+		CardinalPluginModelHelper* const helper = dynamic_cast<CardinalPluginModelHelper*>(models[i]);
+		DISTRHO_SAFE_ASSERT_CONTINUE(helper != nullptr);
+
+		// Widgets are only created here for the few modules that need them while loading, the rack view creates the others
+		const double widgetStartTime = system::getTime();
+		if (plugin::isModuleWidgetNeededOnEngineLoad(models[i]) && helper->createModuleWidgetFromEngineLoad(module) == nullptr) {
+			delete module;
+			modulemem::removeModule(module);
+			continue;
+		}
 
+		LoadProfile::ModuleTimes& times = internal->pendingModuleTimes[module];
+		times.model = models[i];
+		times.createTime = createTimes[i];
+		times.widgetTime = system::getTime() - widgetStartTime;
 
-void Engine::setFrame(int64_t frame) {
-	internal->frame = frame;
-}
+		internal->preparedModules.emplace_back(moduleIndexes[i], module);
+	}
 
+	// Whatever ParamHandles appeared meanwhile belong to the new modules
+	{
+		const EngineReadLock lock(internal);
+		for (ParamHandle* paramHandle : internal->paramHandles) {
+			if (paramHandles.find(paramHandle) == paramHandles.end())
+				internal->preparedParamHandles.insert(paramHandle);
+		}
+	}
 
-int64_t Engine::getBlockFrame() {
-	return internal->blockFrame;
+	json_incref(rootJ);
+	internal->preparedRootJ = rootJ;
+	return rootJ;
 }
 
 
-double Engine::getBlockTime() {
-	return internal->blockTime;
+/** Waits for Engine_beginPreparePatch() and throws away what it made, for loads failing meanwhile.
+*/
+void Engine_cancelPreparePatch(Engine* const engine) {
+	Engine::Internal* internal = engine->internal;
+	if (internal->preparingPatch) {
+		Engine_deletePreparingPatch(internal->preparingPatch);
+		internal->preparingPatch = NULL;
+	}
 }
 
 
-int Engine::getBlockFrames() {
-	return internal->blockFrames;
+/** Creates the modules of a patch and their widgets while the current patch keeps running.
+Module data is only loaded by Engine::fromJson(), once the modules of the current patch are gone,
+so that modules referring to others by ID never see the ones being replaced.
+*/
+void Engine_preparePatch(Engine* const engine, json_t* const rootJ) {
+	json_incref(rootJ);
+	Engine_startPreparingPatch(engine, [rootJ]() { return rootJ; }, false);
+	json_t* const preparedRootJ = Engine_finishPreparePatch(engine);
+	if (preparedRootJ)
+		json_decref(preparedRootJ);
 }
 
 
-double Engine::getBlockDuration() {
-	return internal->blockFrames * internal->sampleTime;
-}
+void Engine::fromJson(json_t* rootJ) {
+	const perftrace::Scope trace("patch", "fromJson");
+	// Don't write-lock the entire method because most of it doesn't need it.
+	const double startTime = system::getTime();
+
+	LoadProfile profile;
+	profile.stages.swap(internal->pendingLoadProfile.stages);
+	DEFER({
+		for (const std::pair<std::string, double>& stage : profile.stages)
+			profile.totalTime += stage.second;
+		profile.totalTime += system::getTime() - startTime;
+		std::lock_guard<std::mutex> lock(internal->loadProfileMutex);
+		internal->loadProfile = std::move(profile);
+	});
+
+	// Take the modules created by Engine_preparePatch() for this patch
+	std::unordered_map<Module*, LoadProfile::ModuleTimes> moduleTimes;
+	std::vector<std::pair<size_t, Module*>> preparedModules;
+	if (internal->preparedRootJ == rootJ) {
+		preparedModules.swap(internal->preparedModules);
+		moduleTimes.swap(internal->pendingModuleTimes);
+		json_decref(internal->preparedRootJ);
+		internal->preparedRootJ = NULL;
+	}
+	else {
+		Engine_discardPreparedPatch(this);
+	}
 
+	// Write-locks
+	clear();
+	internal->preparedParamHandles.clear();
+	Engine_setSkipDormantModules(this, json_boolean_value(json_object_get(rootJ, "skipDormantModules")));
+	Engine_setLoadShedding(this, json_boolean_value(json_object_get(rootJ, "loadShedding")));
+	Engine_setIdleSleepTime(this, json_number_value(json_object_get(rootJ, "idleSleep")));
+	Engine_setCpuBudget(this, json_number_value(json_object_get(rootJ, "cpuBudget")));
+	json_t* oversamplingJ = json_object_get(rootJ, "oversampling");
+	Engine_setOversampling(this, oversamplingJ ? json_integer_value(oversamplingJ) : 1);
+	Engine_setBlockQuantum(this, json_integer_value(json_object_get(rootJ, "blockQuantum")));
+	Engine_setRealTimeScheduling(this, json_boolean_value(json_object_get(rootJ, "realTimeScheduling")));
+	json_t* audioThreadCpuJ = json_object_get(rootJ, "audioThreadCpu");
+	Engine_setAudioThreadCpu(this, audioThreadCpuJ ? json_integer_value(audioThreadCpuJ) : -1);
+	Engine_setAutoBufferSize(this, json_boolean_value(json_object_get(rootJ, "autoBufferSize")));
+	// modules
+	json_t* modulesJ = json_object_get(rootJ, "modules");
+	if (!modulesJ)
+		return;
+	const bool prepared = !preparedModules.empty();
+	std::vector<size_t> moduleIndexes;
+	std::vector<Module*> createdModules;
+	size_t moduleIndex;
+	json_t* moduleJ;
+	if (prepared) {
+		for (const std::pair<size_t, Module*>& preparedModule : preparedModules) {
+			moduleIndexes.push_back(preparedModule.first);
+			createdModules.push_back(preparedModule.second);
+		}
+	}
+	else {
+		std::vector<plugin::Model*> models;
+		moduleIndexes.reserve(json_array_size(modulesJ));
+		models.reserve(json_array_size(modulesJ));
+		json_array_foreach(modulesJ, moduleIndex, moduleJ) {
+			// Get model
+			try {
+				models.push_back(plugin::modelFromJson(moduleJ));
+				moduleIndexes.push_back(moduleIndex);
+			}
+			catch (Exception& e) {
+				WARN("Cannot load model: %s", e.what());
+				// APP->patch->log(e.what());
+				continue;
+			}
+		}
 
-double Engine::getMeterAverage() {
-#ifndef HEADLESS
-	return internal->meterLastAverage;
-#else
-	return 0.0;
-#endif
-}
+		// Create modules
+		std::vector<double> createTimes;
+		Engine_createModules(models, createdModules, createTimes);
 
+		for (size_t i = 0; i < createdModules.size(); i++) {
+			if (!createdModules[i])
+				continue;
+			LoadProfile::ModuleTimes& times = moduleTimes[createdModules[i]];
+			times.model = models[i];
+			times.createTime = createTimes[i];
+		}
+	}
 
-double Engine::getMeterMax() {
-#ifndef HEADLESS
-	return internal->meterLastMax;
-#else
-	return 0.0;
-#endif
-}
+	std::vector<Module*> modules;
+	modules.reserve(createdModules.size());
+	for (size_t i = 0; i < createdModules.size(); i++) {
+		Module* const module = createdModules[i];
+		DISTRHO_SAFE_ASSERT_CONTINUE(module != nullptr);
+		moduleIndex = moduleIndexes[i];
+		moduleJ = json_array_get(modulesJ, moduleIndex);
 
+		// Create the widget too if needed by the module, prepared modules already have theirs
+		CardinalPluginModelHelper* const helper = dynamic_cast<CardinalPluginModelHelper*>(module->model);
+		DISTRHO_SAFE_ASSERT_CONTINUE(helper != nullptr);
 
-size_t Engine::getNumModules() {
-	return internal->modules.size() + internal->terminalModules.size();
-}
+		LoadProfile::ModuleTimes& times = moduleTimes[module];
 
+		if (!prepared && plugin::isModuleWidgetNeededOnEngineLoad(module->model)) {
+			const double widgetStartTime = system::getTime();
+			app::ModuleWidget* const moduleWidget = helper->createModuleWidgetFromEngineLoad(module);
+			times.widgetTime = system::getTime() - widgetStartTime;
+			DISTRHO_SAFE_ASSERT_CONTINUE(moduleWidget != nullptr);
+		}
 
-size_t Engine::getModuleIds(int64_t* moduleIds, size_t len) {
-	SharedLock<SharedMutex> lock(internal->mutex);
-	size_t i = 0;
-	for (Module* m : internal->modules) {
-		if (i >= len)
-			break;
-		moduleIds[i++] = m->id;
-	}
-	for (TerminalModule* m : internal->terminalModules) {
-		if (i >= len)
-			break;
-		moduleIds[i++] = m->id;
-	}
-	return i;
-}
+		try {
+			// This doesn't need a lock because the Module is not added to the Engine yet.
+			const double fromJsonStartTime = system::getTime();
+			{
+				const modulemem::Scope memoryScope(module);
+				module->fromJson(moduleJ);
+			}
+			times.fromJsonTime = system::getTime() - fromJsonStartTime;
 
+			// Before 1.0, the module ID was the index in the "modules" array
+			if (module->id < 0) {
+				module->id = moduleIndex;
+			}
 
-std::vector<int64_t> Engine::getModuleIds() {
-	SharedLock<SharedMutex> lock(internal->mutex);
-	std::vector<int64_t> moduleIds;
-	moduleIds.reserve(getNumModules());
-	for (Module* m : internal->modules) {
-		moduleIds.push_back(m->id);
+			modules.push_back(module);
+		}
+		catch (Exception& e) {
+			WARN("Cannot load module: %s", e.what());
+			// APP->patch->log(e.what());
+			helper->removeCachedModuleWidget(module);
+			delete module;
+			modulemem::removeModule(module);
+			continue;
+		}
 	}
-	for (TerminalModule* tm : internal->terminalModules) {
-		moduleIds.push_back(tm->id);
+
+	// Write-locks once for all modules
+	{
+		const EngineWriteLock lock(internal);
+		internal->modulesCache.reserve(internal->modulesCache.size() + modules.size());
+		for (Module* module : modules) {
+			const double addStartTime = system::getTime();
+			Engine_addModule_NoLock(this, module);
+
+			LoadProfile::ModuleTimes& times = moduleTimes[module];
+			times.id = module->id;
+			times.addTime = system::getTime() - addStartTime;
+			profile.modules.push_back(times);
+		}
 	}
-	return moduleIds;
-}
 
+	// cables
+	json_t* cablesJ = json_object_get(rootJ, "cables");
+	// Before 1.0, cables were called wires
+	if (!cablesJ)
+		cablesJ = json_object_get(rootJ, "wires");
+	if (!cablesJ)
+		return;
+	std::vector<Cable*> cables;
+	cables.reserve(json_array_size(cablesJ));
+	std::unordered_set<Input*> usedInputs;
+	size_t cableIndex;
+	json_t* cableJ;
+	json_array_foreach(cablesJ, cableIndex, cableJ) {
+		// cable
+		Cable* cable = new Cable;
 
-static TerminalModule* asTerminalModule(Module* const module) {
-	const plugin::Model* const model = module->model;
-	if (std::find(hostTerminalModels.begin(), hostTerminalModels.end(), model) != hostTerminalModels.end())
-		return static_cast<TerminalModule*>(module);
-	return nullptr;
-}
+		try {
+			// Looks up the cable modules, which read-locks
+			cable->fromJson(cableJ);
 
+			// Before 1.0, the cable ID was the index in the "cables" array
+			if (cable->id < 0) {
+				cable->id = cableIndex;
+			}
+		}
+		catch (Exception& e) {
+			WARN("Cannot load cable: %s", e.what());
+			delete cable;
+			// Don't log exceptions because missing modules create unnecessary complaining when cables try to connect to them.
+			continue;
+		}
 
-void Engine::addModule(Module* module) {
-	std::lock_guard<SharedMutex> lock(internal->mutex);
-	DISTRHO_SAFE_ASSERT_RETURN(module != nullptr,);
-	// Check that the module is not already added
-	auto it = std::find(internal->modules.begin(), internal->modules.end(), module);
-	DISTRHO_SAFE_ASSERT_RETURN(it == internal->modules.end(),);
-	auto tit = std::find(internal->terminalModules.begin(), internal->terminalModules.end(), module);
-	DISTRHO_SAFE_ASSERT_RETURN(tit == internal->terminalModules.end(),);
-	// Set ID if unset or collides with an existing ID
-	while (module->id < 0 || internal->modulesCache.find(module->id) != internal->modulesCache.end()) {
-		// Randomly generate ID
-		module->id = random::u64() % (1ull << 53);
-	}
-	// Add module
-	if (TerminalModule* const terminalModule = asTerminalModule(module))
-		internal->terminalModules.push_back(terminalModule);
-	else
-		internal->modules.push_back(module);
-	internal->modulesCache[module->id] = module;
-	// Dispatch AddEvent
-	Module::AddEvent eAdd;
-	module->onAdd(eAdd);
-	// Dispatch SampleRateChangeEvent
-	Module::SampleRateChangeEvent eSrc;
-	eSrc.sampleRate = internal->sampleRate;
-	eSrc.sampleTime = internal->sampleTime;
-	module->onSampleRateChange(eSrc);
-	// Update ParamHandles' module pointers
-	for (ParamHandle* paramHandle : internal->paramHandles) {
-		if (paramHandle->moduleId == module->id)
-			paramHandle->module = module;
+		// Check that the input is not already used by another cable
+		if (!usedInputs.insert(&cable->inputModule->inputs[cable->inputId]).second) {
+			WARN("Cannot load cable: input already connected");
+			delete cable;
+			continue;
+		}
+
+		cables.push_back(cable);
+	}
+
+	// Write-locks once for all cables
+	{
+		const EngineWriteLock lock(internal);
+		Engine_addCables_NoLock(this, cables);
 	}
-#if DEBUG_ORDERED_MODULES
-	printf("New module: %s - %ld\n", module->model->getFullName().c_str(), module->id);
-#endif
 }
 
 
-void Engine::removeModule(Module* module) {
-	std::lock_guard<SharedMutex> lock(internal->mutex);
-	removeModule_NoLock(module);
+void Engine::startFallbackThread() {
 }
 
 
-static void removeModule_NoLock_common(Engine::Internal* internal, Module* module) {
-	// Remove from widgets cache
-	CardinalPluginModelHelper* const helper = dynamic_cast<CardinalPluginModelHelper*>(module->model);
-	DISTRHO_SAFE_ASSERT_RETURN(helper != nullptr,);
-	helper->removeCachedModuleWidget(module);
-	// Dispatch RemoveEvent
-	Module::RemoveEvent eRemove;
-	module->onRemove(eRemove);
-	// Update ParamHandles' module pointers
-	for (ParamHandle* paramHandle : internal->paramHandles) {
-		if (paramHandle->moduleId == module->id)
-			paramHandle->module = NULL;
-	}
-	// If a param is being smoothed on this module, stop smoothing it immediately
-	if (module == internal->smoothModule) {
-		internal->smoothModule = NULL;
-	}
-	// Check that all cables are disconnected
-	for (Cable* cable : internal->cables) {
-		DISTRHO_SAFE_ASSERT(cable->inputModule != module);
-		DISTRHO_SAFE_ASSERT(cable->outputModule != module);
-	}
-	// Update expanders of other modules
-	for (Module* m : internal->modules) {
-		if (m->leftExpander.module == module) {
-			m->leftExpander.moduleId = -1;
-			m->leftExpander.module = NULL;
-		}
-		if (m->rightExpander.module == module) {
-			m->rightExpander.moduleId = -1;
-			m->rightExpander.module = NULL;
-		}
+/** Holds the engine writer lock across the module and cable changes made by the calling thread until the matching Engine_endEdits(),
+so that editing many of them, like deleting or duplicating a selection, only holds off the audio thread once.
+Engine API calls made meanwhile by the same thread skip locking, calls may nest.
+*/
+void Engine_beginEdits(Engine* const engine) {
+	Engine::Internal* const internal = engine->internal;
+	if (Engine_isEditing(internal)) {
+		internal->editDepth++;
+		return;
 	}
-	// Reset expanders
-	module->leftExpander.moduleId = -1;
-	module->leftExpander.module = NULL;
-	module->rightExpander.moduleId = -1;
-	module->rightExpander.module = NULL;
-	// Remove module
-	internal->modulesCache.erase(module->id);
+	internal->mutex.lock();
+	internal->editThread = std::this_thread::get_id();
+	internal->editDepth = 1;
 }
 
 
-void Engine::removeModule_NoLock(Module* module) {
-	DISTRHO_SAFE_ASSERT_RETURN(module,);
-	// Check that the module actually exists
-	if (TerminalModule* const terminalModule = asTerminalModule(module)) {
-		auto tit = std::find(internal->terminalModules.begin(), internal->terminalModules.end(), terminalModule);
-		DISTRHO_SAFE_ASSERT_RETURN(tit != internal->terminalModules.end(),);
-		removeModule_NoLock_common(internal, module);
-		internal->terminalModules.erase(tit);
+void Engine_endEdits(Engine* const engine) {
+	Engine::Internal* const internal = engine->internal;
+	DISTRHO_SAFE_ASSERT_RETURN(Engine_isEditing(internal),);
+	if (--internal->editDepth != 0)
+		return;
+	internal->editThread = std::thread::id();
+	internal->mutex.unlock();
+}
+
+
+/** Records a step of the next patch load that happens before Engine::fromJson().
+*/
+void Engine_addLoadProfileStage(Engine* const engine, const char* const name, const double time) {
+	engine->internal->pendingLoadProfile.stages.emplace_back(name, time);
+	if (perftrace::isRecording())
+		perftrace::record("patch", name, perftrace::now() - time);
+}
+
+
+/** Returns the block load histogram, percentiles and slowest blocks since the last reset as a new JSON object.
+*/
+json_t* Engine_getBlockStatsJson(Engine* const engine) {
+	Engine::Internal* const internal = engine->internal;
+	BlockStats& stats = internal->blockStats;
+
+	uint64_t counts[BlockStats::kBinCount];
+	uint64_t blockCount;
+	double maxLoad;
+	BlockStats::WorstBlock worstBlocks[BlockStats::kWorstBlockCount];
+	int worstBlockCount;
+	{
+		std::lock_guard<std::mutex> lock(internal->blockStatsMutex);
+		std::copy(stats.counts, stats.counts + BlockStats::kBinCount, counts);
+		blockCount = stats.blockCount;
+		maxLoad = stats.maxLoad;
+		worstBlockCount = stats.worstBlockCount;
+		std::copy(stats.worstBlocks, stats.worstBlocks + worstBlockCount, worstBlocks);
 	}
-	else {
-		auto it = std::find(internal->modules.begin(), internal->modules.end(), module);
-		DISTRHO_SAFE_ASSERT_RETURN(it != internal->modules.end(),);
-		removeModule_NoLock_common(internal, module);
-		internal->modules.erase(it);
+
+	json_t* rootJ = json_object();
+	json_object_set_new(rootJ, "blocks", json_integer(blockCount));
+	json_object_set_new(rootJ, "xruns", json_integer(stats.xrunCount + stats.skippedCount));
+	json_object_set_new(rootJ, "skipped", json_integer(stats.skippedCount));
+	json_object_set_new(rootJ, "droppedMidi", json_integer(stats.droppedMidiCount));
+	json_object_set_new(rootJ, "shed", json_integer(stats.shedCount));
+	json_object_set_new(rootJ, "max", json_real(maxLoad));
+	json_object_set_new(rootJ, "cpuLoad", json_real(internal->meterLastCpuLoad));
+	if (internal->cpuBudget > 0.f)
+		json_object_set_new(rootJ, "cpuBudget", json_real(internal->cpuBudget));
+	if (internal->workerPoolClient.budgetWorkers != INT_MAX)
+		json_object_set_new(rootJ, "budgetWorkers", json_integer(internal->workerPoolClient.budgetWorkers));
+
+	// Upper edge of the bin holding each percentile, as a fraction of the block duration
+	json_t* percentilesJ = json_object();
+	static const std::pair<const char*, double> percentiles[] = {{"50", 0.5}, {"90", 0.9}, {"99", 0.99}, {"99.9", 0.999}};
+	for (const std::pair<const char*, double>& percentile : percentiles) {
+		const double target = percentile.second * blockCount;
+		uint64_t count = 0;
+		int bin = 0;
+		for (; bin < BlockStats::kBinCount - 1; bin++) {
+			count += counts[bin];
+			if (count >= target)
+				break;
+		}
+		const double load = bin < BlockStats::kBinCount - 1 ? (bin + 1.0) / BlockStats::kBinsPerBlock : maxLoad;
+		json_object_set_new(percentilesJ, percentile.first, json_real(blockCount != 0 ? std::fmin(load, maxLoad) : 0.0));
+	}
+	json_object_set_new(rootJ, "percentiles", percentilesJ);
+
+	int binCount = BlockStats::kBinCount;
+	while (binCount > 0 && counts[binCount - 1] == 0)
+		binCount--;
+	json_t* histogramJ = json_array();
+	for (int i = 0; i < binCount; i++)
+		json_array_append_new(histogramJ, json_integer(counts[i]));
+	json_object_set_new(rootJ, "binWidth", json_real(1.0 / BlockStats::kBinsPerBlock));
+	json_object_set_new(rootJ, "histogram", histogramJ);
+
+	json_t* worstJ = json_array();
+	for (int i = 0; i < worstBlockCount; i++) {
+		const BlockStats::WorstBlock& block = worstBlocks[i];
+		json_t* blockJ = json_object();
+		json_object_set_new(blockJ, "load", json_real(block.load));
+		json_object_set_new(blockJ, "duration", json_real(block.duration));
+		json_object_set_new(blockJ, "time", json_real(block.unixTime));
+		json_object_set_new(blockJ, "frame", json_integer(block.frame));
+		json_t* modulesJ = json_array();
+		for (int m = 0; m < block.moduleCount; m++) {
+			json_t* moduleJ = json_object();
+			json_object_set_new(moduleJ, "id", json_integer(block.moduleIds[m]));
+			if (plugin::Model* const model = block.moduleModels[m]) {
+				json_object_set_new(moduleJ, "plugin", json_string(model->plugin->slug.c_str()));
+				json_object_set_new(moduleJ, "model", json_string(model->slug.c_str()));
+			}
+			json_object_set_new(moduleJ, "time", json_real(block.moduleTimes[m]));
+			json_array_append_new(modulesJ, moduleJ);
+		}
+		json_object_set_new(blockJ, "modules", modulesJ);
+		json_array_append_new(worstJ, blockJ);
 	}
+	json_object_set_new(rootJ, "worst", worstJ);
+
+	return rootJ;
 }
 
 
-bool Engine::hasModule(Module* module) {
-	SharedLock<SharedMutex> lock(internal->mutex);
-	// TODO Performance could be improved by searching modulesCache, but more testing would be needed to make sure it's always valid.
-	auto it = std::find(internal->modules.begin(), internal->modules.end(), module);
-	auto tit = std::find(internal->terminalModules.begin(), internal->terminalModules.end(), module);
-	return it != internal->modules.end() && tit != internal->terminalModules.end();
+void Engine_resetBlockStats(Engine* const engine) {
+	Engine::Internal* const internal = engine->internal;
+	BlockStats& stats = internal->blockStats;
+	std::lock_guard<std::mutex> lock(internal->blockStatsMutex);
+	std::fill(stats.counts, stats.counts + BlockStats::kBinCount, 0);
+	stats.blockCount = 0;
+	stats.maxLoad = 0.0;
+	stats.xrunCount = 0;
+	stats.skippedCount = 0;
+	stats.droppedMidiCount = 0;
+	stats.shedCount = 0;
+	stats.worstBlockCount = 0;
 }
 
 
-Module* Engine::getModule(int64_t moduleId) {
-	SharedLock<SharedMutex> lock(internal->mutex);
-	return getModule_NoLock(moduleId);
+bool Engine_getModuleMeter(Engine* const engine, Module* const module, std::vector<float>& values) {
+	const EngineReadLock lock(engine->internal);
+	auto it = engine->internal->moduleProfiles.find(module);
+	if (it == engine->internal->moduleProfiles.end() || !it->second.meter)
+		return false;
+	// Oldest first
+	const ModuleMeter& meter = *it->second.meter;
+	const int historyIndex = meter.historyIndex;
+	values.resize(ModuleMeter::kHistoryLength);
+	for (int i = 0; i < ModuleMeter::kHistoryLength; i++)
+		values[i] = meter.history[(historyIndex + 1 + i) % ModuleMeter::kHistoryLength];
+	return true;
 }
 
 
-Module* Engine::getModule_NoLock(int64_t moduleId) {
-	auto it = internal->modulesCache.find(moduleId);
-	if (it == internal->modulesCache.end())
-		return NULL;
-	return it->second;
+/** Allocates the meter history of every module while the sampled meters are shown, and frees it once hidden.
+Cheap to call on every UI frame, the engine is only locked when the state changes.
+*/
+void Engine_setModuleMetersEnabled(Engine* const engine, const bool enabled) {
+	Engine::Internal* const internal = engine->internal;
+	if (internal->moduleMetersEnabled == enabled)
+		return;
+
+	const EngineWriteLock lock(internal);
+	internal->moduleMetersEnabled = enabled;
+	for (auto& pair : internal->moduleProfiles)
+		pair.second.meter.reset(enabled ? new ModuleMeter : NULL);
 }
 
 
-void Engine::resetModule(Module* module) {
-	std::lock_guard<SharedMutex> lock(internal->mutex);
-	DISTRHO_SAFE_ASSERT_RETURN(module,);
+/** Starts or stops collecting cable stats, and follows the cables added or removed while enabled.
+Cheap to call on every UI frame, the engine is only locked for writing when something changed.
+*/
+void Engine_setCableStatsEnabled(Engine* const engine, const bool enabled) {
+	Engine::Internal* const internal = engine->internal;
+	if (!enabled && !internal->cableStatsEnabled)
+		return;
 
-	Module::ResetEvent eReset;
-	module->onReset(eReset);
+	if (enabled) {
+		const EngineReadLock lock(internal);
+		bool inSync = internal->cableStatsEnabled && internal->cableStats.size() == internal->cables.size();
+		for (size_t i = 0; inSync && i < internal->cables.size(); i++)
+			inSync = internal->cableStats.find(internal->cables[i]) != internal->cableStats.end();
+		if (inSync)
+			return;
+	}
+
+	const EngineWriteLock lock(internal);
+	internal->cableStatsEnabled = enabled;
+	if (!enabled) {
+		internal->cableStats.clear();
+		return;
+	}
+	std::unordered_map<Cable*, CableStats> cableStats;
+	for (Cable* cable : internal->cables) {
+		auto it = internal->cableStats.find(cable);
+		if (it != internal->cableStats.end())
+			cableStats.emplace(cable, it->second);
+		else
+			cableStats.emplace(cable, CableStats());
+	}
+	internal->cableStats.swap(cableStats);
 }
 
 
-void Engine::randomizeModule(Module* module) {
-	std::lock_guard<SharedMutex> lock(internal->mutex);
-	DISTRHO_SAFE_ASSERT_RETURN(module,);
+/** Latest UI snapshot, or NULL while there is none yet.
+Only for the UI thread, the snapshot stays valid until the next call. Never locks the engine.
+*/
+const UiSnapshot* Engine_getUiSnapshot(Engine* const engine) {
+	Engine::Internal* const internal = engine->internal;
+	internal->uiSnapshotReadTime = system::getTime();
 
-	Module::RandomizeEvent eRandomize;
-	module->onRandomize(eRandomize);
+	if (internal->uiSnapshotShared.load(std::memory_order_relaxed) & kUiSnapshotFresh) {
+		const int shared = internal->uiSnapshotShared.exchange(internal->uiSnapshotFront, std::memory_order_acq_rel);
+		internal->uiSnapshotFront = shared & ~kUiSnapshotFresh;
+	}
+
+	// Make room for what the audio thread needed, with some to spare for patches that keep growing
+	UiSnapshot& snapshot = internal->uiSnapshots[internal->uiSnapshotFront];
+	const auto grow = [](size_t count) {
+		return count + count / 2 + 16;
+	};
+	const size_t moduleCount = internal->uiSnapshotModuleCount;
+	const size_t cableCount = internal->uiSnapshotCableCount;
+	const size_t lightCount = internal->uiSnapshotLightCount;
+	const size_t paramCount = internal->uiSnapshotParamCount;
+	if (!UiSnapshot_fits(snapshot, moduleCount, cableCount, lightCount, paramCount)) {
+		snapshot.moduleIds.reserve(grow(moduleCount));
+		snapshot.modules.reserve(grow(moduleCount));
+		snapshot.lightStarts.reserve(grow(moduleCount) + 1);
+		snapshot.paramStarts.reserve(grow(moduleCount) + 1);
+		snapshot.cableIds.reserve(grow(cableCount));
+		snapshot.lights.reserve(grow(lightCount));
+		snapshot.params.reserve(grow(paramCount));
+	}
+
+	return snapshot.block >= 0 ? &snapshot : NULL;
 }
 
 
-void Engine::bypassModule(Module* module, bool bypassed) {
-	DISTRHO_SAFE_ASSERT_RETURN(module,);
-	if (module->isBypassed() == bypassed)
-		return;
+void Engine_resetCableStats(Engine* const engine) {
+	engine->internal->cableStatsResetGeneration++;
+}
 
-	std::lock_guard<SharedMutex> lock(internal->mutex);
 
-	// Clear outputs and set to 1 channel
-	for (Output& output : module->outputs) {
-		// This zeros all voltages, but the channel is set to 1 if connected
-		output.setChannels(0);
+/** Summary of the cables of an output for the cable overlay, from the stats of its first cable.
+`changeRate` is the fraction of blocks in which the voltages changed.
+*/
+bool Engine_getOutputActivity(Engine* const engine, Module* const module, const int outputId, int& channels, int& activeChannels, float& changeRate) {
+	Engine::Internal* const internal = engine->internal;
+	const EngineReadLock lock(internal);
+	for (Cable* cable : internal->cables) {
+		if (cable->outputModule != module || cable->outputId != outputId)
+			continue;
+		auto it = internal->cableStats.find(cable);
+		if (it == internal->cableStats.end() || it->second.blocks < 2)
+			return false;
+		const CableStats& stats = it->second;
+		channels = stats.maxChannels;
+		activeChannels = __builtin_popcount(stats.activeChannels);
+		changeRate = (float) stats.changedBlocks / (stats.blocks - 1);
+		return true;
 	}
-	// Set bypassed state
-	module->setBypassed(bypassed);
-	if (bypassed) {
-		// Dispatch BypassEvent
-		Module::BypassEvent eBypass;
-		module->onBypass(eBypass);
+	return false;
+}
+
+
+static json_t* Engine_getCableStatsJson_NoLock(Engine::Internal* internal) {
+	std::set<Module*> dormantModules;
+	for (size_t i = 0; i < internal->modules.size() && i < internal->dormantModules.size(); i++) {
+		if (internal->dormantModules[i])
+			dormantModules.insert(internal->modules[i]);
 	}
-	else {
-		// Dispatch UnBypassEvent
-		Module::UnBypassEvent eUnBypass;
-		module->onUnBypass(eUnBypass);
+
+	json_t* cablesJ = json_array();
+	for (Cable* cable : internal->cables) {
+		auto it = internal->cableStats.find(cable);
+		if (it == internal->cableStats.end() || it->second.blocks == 0)
+			continue;
+		const CableStats& stats = it->second;
+
+		// Largest standard deviation among the channels, in volts
+		double deviation = 0.0;
+		for (int c = 0; c < stats.maxChannels; c++) {
+			const double mean = stats.sums[c] / stats.blocks;
+			deviation = std::fmax(deviation, std::sqrt(std::fmax(stats.squares[c] / stats.blocks - mean * mean, 0.0)));
+		}
+
+		const Output& output = cable->outputModule->outputs[cable->outputId];
+		json_t* cableJ = json_object();
+		json_object_set_new(cableJ, "id", json_integer(cable->id));
+		json_object_set_new(cableJ, "outputModuleId", json_integer(cable->outputModule->id));
+		json_object_set_new(cableJ, "outputId", json_integer(cable->outputId));
+		json_object_set_new(cableJ, "inputModuleId", json_integer(cable->inputModule->id));
+		json_object_set_new(cableJ, "inputId", json_integer(cable->inputId));
+		if (plugin::Model* const model = cable->outputModule->model) {
+			json_object_set_new(cableJ, "plugin", json_string(model->plugin->slug.c_str()));
+			json_object_set_new(cableJ, "model", json_string(model->slug.c_str()));
+		}
+		json_object_set_new(cableJ, "blocks", json_integer(stats.blocks));
+		json_object_set_new(cableJ, "channels", json_integer(stats.maxChannels));
+		json_object_set_new(cableJ, "activeChannels", json_integer(__builtin_popcount(stats.activeChannels)));
+		json_object_set_new(cableJ, "changeRate", json_real(stats.blocks > 1 ? (double) stats.changedBlocks / (stats.blocks - 1) : 0.0));
+		json_object_set_new(cableJ, "deviation", json_real(deviation));
+		json_object_set_new(cableJ, "controlRate", json_integer(output.controlRateMask + 1));
+		json_object_set_new(cableJ, "dormant", json_boolean(dormantModules.find(cable->inputModule) != dormantModules.end()));
+		json_array_append_new(cablesJ, cableJ);
 	}
+	return cablesJ;
 }
 
 
-json_t* Engine::moduleToJson(Module* module) {
-	SharedLock<SharedMutex> lock(internal->mutex);
-	return module->toJson();
+/** Returns the cable stats as a new JSON array, empty unless enabled.
+*/
+json_t* Engine_getCableStatsJson(Engine* const engine) {
+	const EngineReadLock lock(engine->internal);
+	return Engine_getCableStatsJson_NoLock(engine->internal);
 }
 
 
-void Engine::moduleFromJson(Module* module, json_t* rootJ) {
-	std::lock_guard<SharedMutex> lock(internal->mutex);
-	module->fromJson(rootJ);
+#ifndef HEADLESS
+/** Steps the plug lights of terminal module ports from the voltages they hold right now, called by Scene::step().
+The audio thread does not touch them, so they cost nothing while the editor is closed.
+*/
+void Engine_stepTerminalPlugLights(Engine* const engine, const float deltaTime) {
+	Engine::Internal* const internal = engine->internal;
+	const EngineReadLock lock(internal);
+	// Long UI stalls would overshoot the smoothing
+	const float portTime = std::min(deltaTime, 1.f / 30.f);
+	for (TerminalModule* terminalModule : internal->terminalModules) {
+		for (Input& input : terminalModule->inputs) {
+			Port_step(&input, portTime);
+		}
+		for (Output& output : terminalModule->outputs) {
+			Port_step(&output, portTime);
+		}
+	}
 }
+#endif
 
 
-void Engine::prepareSaveModule(Module* module) {
-	SharedLock<SharedMutex> lock(internal->mutex);
-	Module::SaveEvent e;
-	module->onSave(e);
-}
+json_t* Engine_getModuleProfileJson(Engine* const engine) {
+	Engine::Internal* const internal = engine->internal;
+	const EngineReadLock lock(internal);
 
+	struct ModelLoad {
+		plugin::Model* model;
+		int instances;
+		double load;
+	};
+	std::vector<ModelLoad> models;
+	json_t* modulesJ = json_array();
 
-void Engine::prepareSave() {
-	if (internal->aboutToClose)
-		return;
-	SharedLock<SharedMutex> lock(internal->mutex);
 	for (Module* module : internal->modules) {
-		Module::SaveEvent e;
-		module->onSave(e);
+		auto it = internal->moduleProfiles.find(module);
+		if (it == internal->moduleProfiles.end())
+			continue;
+		const ModuleProfile& profile = it->second;
+		// Average time per frame as a fraction of the frame duration
+		const double load = profile.totalBlocks != 0 ? profile.totalTime / profile.totalBlocks * internal->sampleRate : 0.0;
+
+		json_t* moduleJ = json_object();
+		json_object_set_new(moduleJ, "id", json_integer(module->id));
+		if (module->model) {
+			json_object_set_new(moduleJ, "plugin", json_string(module->model->plugin->slug.c_str()));
+			json_object_set_new(moduleJ, "model", json_string(module->model->slug.c_str()));
+		}
+		json_object_set_new(moduleJ, "load", json_real(load));
+		json_object_set_new(moduleJ, "blocks", json_integer(profile.totalBlocks));
+		json_array_append_new(modulesJ, moduleJ);
+
+		auto modelIt = std::find_if(models.begin(), models.end(), [&](const ModelLoad& m) {return m.model == module->model;});
+		if (modelIt == models.end())
+			models.push_back({module->model, 1, load});
+		else {
+			modelIt->instances++;
+			modelIt->load += load;
+		}
 	}
-	for (TerminalModule* terminalModule : internal->terminalModules) {
-		Module::SaveEvent e;
-		terminalModule->onSave(e);
+
+	// Heaviest models first, all instances together
+	std::stable_sort(models.begin(), models.end(), [](const ModelLoad& a, const ModelLoad& b) {
+		return a.load > b.load;
+	});
+	json_t* modelsJ = json_array();
+	for (const ModelLoad& m : models) {
+		json_t* modelJ = json_object();
+		if (m.model) {
+			json_object_set_new(modelJ, "plugin", json_string(m.model->plugin->slug.c_str()));
+			json_object_set_new(modelJ, "model", json_string(m.model->slug.c_str()));
+		}
+		json_object_set_new(modelJ, "instances", json_integer(m.instances));
+		json_object_set_new(modelJ, "load", json_real(m.load));
+		json_array_append_new(modelsJ, modelJ);
 	}
+
+	json_t* rootJ = json_object();
+	json_object_set_new(rootJ, "models", modelsJ);
+	json_object_set_new(rootJ, "modules", modulesJ);
+	if (internal->cableStatsEnabled)
+		json_object_set_new(rootJ, "cables", Engine_getCableStatsJson_NoLock(internal));
+	return rootJ;
 }
 
 
-size_t Engine::getNumCables() {
-	return internal->cables.size();
+void Engine_resetModuleProfiles(Engine* const engine) {
+	engine->internal->moduleProfileResetGeneration++;
 }
 
 
-size_t Engine::getCableIds(int64_t* cableIds, size_t len) {
-	SharedLock<SharedMutex> lock(internal->mutex);
-	size_t i = 0;
-	for (Cable* c : internal->cables) {
-		if (i >= len)
-			break;
-		cableIds[i] = c->id;
-		i++;
-	}
-	return i;
+uint64_t Engine_getXrunCount(Engine* const engine) {
+	return engine->internal->blockStats.xrunCount + engine->internal->blockStats.skippedCount;
 }
 
 
-std::vector<int64_t> Engine::getCableIds() {
-	SharedLock<SharedMutex> lock(internal->mutex);
-	std::vector<int64_t> cableIds;
-	cableIds.reserve(internal->cables.size());
-	for (Cable* c : internal->cables) {
-		cableIds.push_back(c->id);
-	}
-	return cableIds;
+bool Engine_isBlockSkipped(Engine* const engine) {
+	return engine->internal->blockSkipped;
 }
 
 
-void Engine::addCable(Cable* cable) {
-	std::lock_guard<SharedMutex> lock(internal->mutex);
-	DISTRHO_SAFE_ASSERT_RETURN(cable,);
-	// Check cable properties
-	DISTRHO_SAFE_ASSERT_RETURN(cable->inputModule,);
-	DISTRHO_SAFE_ASSERT_RETURN(cable->outputModule,);
-	bool outputWasConnected = false;
-	for (Cable* cable2 : internal->cables) {
-		// Check that the cable is not already added
-		DISTRHO_SAFE_ASSERT_RETURN(cable2 != cable,);
-		// Check that the input is not already used by another cable
-		DISTRHO_SAFE_ASSERT_RETURN(!(cable2->inputModule == cable->inputModule && cable2->inputId == cable->inputId),);
-		// Get connected status of output, to decide whether we need to call a PortChangeEvent.
-		// It's best to not trust `cable->outputModule->outputs[cable->outputId]->isConnected()`
-		if (cable2->outputModule == cable->outputModule && cable2->outputId == cable->outputId)
-			outputWasConnected = true;
-	}
-	// Set ID if unset or collides with an existing ID
-	while (cable->id < 0 || internal->cablesCache.find(cable->id) != internal->cablesCache.end()) {
-		// Randomly generate ID
-		cable->id = random::u64() % (1ull << 53);
-	}
-	// Add the cable
-	internal->cables.push_back(cable);
-	internal->cablesCache[cable->id] = cable;
-	// Add the cable's zero-latency shortcut
-	cable->outputModule->outputs[cable->outputId].cables.push_back(cable);
-	Engine_updateConnected(this);
-	// Dispatch input port event
+/** Counts MIDI events of skipped blocks that the plugin had no room to replay, reported with the block stats.
+*/
+void Engine_addDroppedMidiEvents(Engine* const engine, const int count) {
+	engine->internal->blockStats.droppedMidiCount += count;
+}
+
+
+/** Returns the profile of the last patch load as a new JSON object, modules sorted from slowest to fastest.
+*/
+json_t* Engine_getLoadProfileJson(Engine* const engine) {
+	LoadProfile profile;
 	{
-		Module::PortChangeEvent e;
-		e.connecting = true;
-		e.type = Port::INPUT;
-		e.portId = cable->inputId;
-		cable->inputModule->onPortChange(e);
+		std::lock_guard<std::mutex> lock(engine->internal->loadProfileMutex);
+		profile = engine->internal->loadProfile;
 	}
-	// Dispatch output port event if its state went from disconnected to connected.
-	if (!outputWasConnected) {
-		Module::PortChangeEvent e;
-		e.connecting = true;
-		e.type = Port::OUTPUT;
-		e.portId = cable->outputId;
-		cable->outputModule->onPortChange(e);
+
+	json_t* rootJ = json_object();
+	json_object_set_new(rootJ, "total", json_real(profile.totalTime));
+
+	json_t* stagesJ = json_object();
+	for (const std::pair<std::string, double>& stage : profile.stages)
+		json_object_set_new(stagesJ, stage.first.c_str(), json_real(stage.second));
+	json_object_set_new(rootJ, "stages", stagesJ);
+
+	std::vector<LoadProfile::ModuleTimes>& modules(profile.modules);
+	auto getTotal = [](const LoadProfile::ModuleTimes& times) {
+		return times.createTime + times.widgetTime + times.fromJsonTime + times.addTime;
+	};
+	std::stable_sort(modules.begin(), modules.end(), [&](const LoadProfile::ModuleTimes& a, const LoadProfile::ModuleTimes& b) {
+		return getTotal(a) > getTotal(b);
+	});
+
+	json_t* modulesJ = json_array();
+	for (const LoadProfile::ModuleTimes& times : modules) {
+		json_t* moduleJ = json_object();
+		json_object_set_new(moduleJ, "id", json_integer(times.id));
+		if (times.model) {
+			json_object_set_new(moduleJ, "plugin", json_string(times.model->plugin->slug.c_str()));
+			json_object_set_new(moduleJ, "model", json_string(times.model->slug.c_str()));
+		}
+		json_object_set_new(moduleJ, "total", json_real(getTotal(times)));
+		json_object_set_new(moduleJ, "createModule", json_real(times.createTime));
+		json_object_set_new(moduleJ, "createModuleWidget", json_real(times.widgetTime));
+		json_object_set_new(moduleJ, "fromJson", json_real(times.fromJsonTime));
+		json_object_set_new(moduleJ, "addModule", json_real(times.addTime));
+#ifdef CARDINAL_MODULE_MEMORY
+		json_object_set_new(moduleJ, "memory", json_integer(modulemem::getModuleBytes(engine->getModule(times.id))));
+#endif
+		json_array_append_new(modulesJ, moduleJ);
 	}
+	json_object_set_new(rootJ, "modules", modulesJ);
+
+	return rootJ;
 }
 
 
-void Engine::removeCable(Cable* cable) {
-	std::lock_guard<SharedMutex> lock(internal->mutex);
-	removeCable_NoLock(cable);
+void Engine_setAboutToClose(Engine* const engine) {
+	engine->internal->aboutToClose = true;
 }
 
 
-void Engine::removeCable_NoLock(Cable* cable) {
-	DISTRHO_SAFE_ASSERT_RETURN(cable,);
-	// Check that the cable is already added
-	auto it = std::find(internal->cables.begin(), internal->cables.end(), cable);
-	DISTRHO_SAFE_ASSERT_RETURN(it != internal->cables.end(),);
-	// Remove the cable's zero-latency shortcut
-	cable->outputModule->outputs[cable->outputId].cables.remove(cable);
-	// Remove the cable
-	internal->cablesCache.erase(cable->id);
-	internal->cables.erase(it);
-	Engine_updateConnected(this);
-	bool outputIsConnected = false;
-	for (Cable* cable2 : internal->cables) {
-		// Get connected status of output, to decide whether we need to call a PortChangeEvent.
-		// It's best to not trust `cable->outputModule->outputs[cable->outputId]->isConnected()`
-		if (cable2->outputModule == cable->outputModule && cable2->outputId == cable->outputId)
-			outputIsConnected = true;
-	}
-	// Dispatch input port event
-	{
-		Module::PortChangeEvent e;
-		e.connecting = false;
-		e.type = Port::INPUT;
-		e.portId = cable->inputId;
-		cable->inputModule->onPortChange(e);
-	}
-	// Dispatch output port event if its state went from connected to disconnected.
-	if (!outputIsConnected) {
-		Module::PortChangeEvent e;
-		e.connecting = false;
-		e.type = Port::OUTPUT;
-		e.portId = cable->outputId;
-		cable->outputModule->onPortChange(e);
-	}
+bool Engine_isSkippingDormantModules(Engine* const engine) {
+	return engine->internal->skipDormantModules;
 }
 
 
-bool Engine::hasCable(Cable* cable) {
-	SharedLock<SharedMutex> lock(internal->mutex);
-	// TODO Performance could be improved by searching cablesCache, but more testing would be needed to make sure it's always valid.
-	auto it = std::find(internal->cables.begin(), internal->cables.end(), cable);
-	return it != internal->cables.end();
+void Engine_setSkipDormantModules(Engine* const engine, const bool skip) {
+	const EngineWriteLock lock(engine->internal);
+	engine->internal->skipDormantModules = skip;
+	engine->internal->dormantModulesDirty = true;
 }
 
 
-Cable* Engine::getCable(int64_t cableId) {
-	SharedLock<SharedMutex> lock(internal->mutex);
-	auto it = internal->cablesCache.find(cableId);
-	if (it == internal->cablesCache.end())
-		return NULL;
-	return it->second;
+bool Engine_isLoadShedding(Engine* const engine) {
+	return engine->internal->loadShedding;
 }
 
 
-void Engine::setParamValue(Module* module, int paramId, float value) {
-	// If param is being smoothed, cancel smoothing.
-	if (internal->smoothModule == module && internal->smoothParamId == paramId) {
-		internal->smoothModule = NULL;
-		internal->smoothParamId = 0;
-	}
-	module->params[paramId].value = value;
+void Engine_setLoadShedding(Engine* const engine, const bool shedding) {
+	const EngineWriteLock lock(engine->internal);
+	engine->internal->loadShedding = shedding;
+	engine->internal->shedding = false;
+	engine->internal->dormantModulesDirty = true;
 }
 
 
-float Engine::getParamValue(Module* module, int paramId) {
-	return module->params[paramId].value;
+float Engine_getIdleSleepTime(Engine* const engine) {
+	return engine->internal->idleSleepTime;
 }
 
 
-void Engine::setParamSmoothValue(Module* module, int paramId, float value) {
-	// If another param is being smoothed, jump value
-	if (internal->smoothModule && !(internal->smoothModule == module && internal->smoothParamId == paramId)) {
-		internal->smoothModule->params[internal->smoothParamId].value = internal->smoothValue;
+void Engine_setIdleSleepTime(Engine* const engine, const float seconds) {
+	engine->internal->idleSleepTime = std::isfinite(seconds) ? std::max(0.f, seconds) : 0.f;
+}
+
+
+/** Whether the plugin may stop stepping the engine now that the patch is silent, called on the audio thread between blocks.
+Not while the patch is being edited, or was since the last block, nor while a ModuleFreeRunning module wants to keep going.
+*/
+bool Engine_isIdleSleepAllowed(Engine* const engine) {
+	Engine::Internal* const internal = engine->internal;
+	const SharedTryLock<SharedMutex> lock(internal->mutex);
+	if (!lock.locked)
+		return false;
+	if (internal->moduleCyclesDirty || internal->dormantModulesDirty)
+		return false;
+	for (ModuleFreeRunning* const freeRunning : internal->freeRunningModules) {
+		if (freeRunning->isFreeRunning())
+			return false;
 	}
-	internal->smoothParamId = paramId;
-	internal->smoothValue = value;
-	// Set this last so the above values are valid as soon as it is set
-	internal->smoothModule = module;
+	return true;
 }
 
 
-float Engine::getParamSmoothValue(Module* module, int paramId) {
-	if (internal->smoothModule == module && internal->smoothParamId == paramId)
-		return internal->smoothValue;
-	return module->params[paramId].value;
+int Engine_getOversampling(Engine* const engine) {
+	return engine->internal->oversampling;
 }
 
 
-void Engine::addParamHandle(ParamHandle* paramHandle) {
-	std::lock_guard<SharedMutex> lock(internal->mutex);
-	// New ParamHandles must be blank.
-	// This means we don't have to refresh the cache.
-	DISTRHO_SAFE_ASSERT_RETURN(paramHandle->moduleId < 0,);
+/** Gives block modules buffers for the largest block allowed by the buffer size, block quantum and oversampling.
+*/
+static void Engine_updateMaxBlockFrames(Engine::Internal* internal) {
+	const int maxBlockFrames = std::max(internal->maxBufferSize, internal->blockQuantum) * internal->oversampling;
+	if (maxBlockFrames == internal->maxBlockFrames)
+		return;
+	const EngineWriteLock lock(internal);
+	internal->maxBlockFrames = maxBlockFrames;
+	for (BlockModule* blockModule : internal->blockModules)
+		blockModule->reserveBlock(maxBlockFrames);
+}
 
-	// Check that the ParamHandle is not already added
-	auto it = internal->paramHandles.find(paramHandle);
-	DISTRHO_SAFE_ASSERT_RETURN(it == internal->paramHandles.end(),);
 
-	// Add it
-	internal->paramHandles.insert(paramHandle);
-	// No need to refresh the cache because the moduleId is not set.
+void Engine_setOversampling(Engine* const engine, const int oversampling) {
+	// The plugin resamples its audio by 1, 2 or 4 times
+	engine->internal->oversampling = oversampling >= 4 ? 4 : oversampling >= 2 ? 2 : 1;
+	Engine_updateMaxBlockFrames(engine->internal);
+	Engine_updateSampleRate(engine);
 }
 
 
-void Engine::removeParamHandle(ParamHandle* paramHandle) {
-	std::lock_guard<SharedMutex> lock(internal->mutex);
-	removeParamHandle_NoLock(paramHandle);
+int Engine_getLatency(Engine* const engine) {
+	return engine->internal->latency;
 }
 
 
-void Engine::removeParamHandle_NoLock(ParamHandle* paramHandle) {
-	// Check that the ParamHandle is already added
-	auto it = internal->paramHandles.find(paramHandle);
-	DISTRHO_SAFE_ASSERT_RETURN(it != internal->paramHandles.end(),);
+int Engine_getBlockQuantum(Engine* const engine) {
+	return engine->internal->blockQuantum;
+}
 
-	// Remove it
-	paramHandle->module = NULL;
-	internal->paramHandles.erase(it);
-	Engine_refreshParamHandleCache(this);
+
+void Engine_setBlockQuantum(Engine* const engine, const int quantum) {
+	// The plugin queues up to 256 frames, any other value follows the host buffer size
+	engine->internal->blockQuantum = quantum == 64 || quantum == 128 || quantum == 256 ? quantum : 0;
+	Engine_updateMaxBlockFrames(engine->internal);
 }
 
 
-ParamHandle* Engine::getParamHandle(int64_t moduleId, int paramId) {
-	SharedLock<SharedMutex> lock(internal->mutex);
-	return getParamHandle_NoLock(moduleId, paramId);
+/** Sets the largest number of host frames given to a single stepBlock(), before oversampling. Defaults to 512.
+Called outside the audio thread, whenever the host buffer size changes.
+*/
+void Engine_setMaxBufferSize(Engine* const engine, const int frames) {
+	engine->internal->maxBufferSize = std::max(frames, 1);
+	Engine_updateMaxBlockFrames(engine->internal);
 }
 
 
-ParamHandle* Engine::getParamHandle_NoLock(int64_t moduleId, int paramId) {
-	auto it = internal->paramHandlesCache.find(std::make_tuple(moduleId, paramId));
-	if (it == internal->paramHandlesCache.end())
-		return NULL;
-	return it->second;
+void Engine_setWorkerPriority(Engine* const engine, const int priority) {
+	const EngineWriteLock lock(engine->internal);
+	const std::lock_guard<std::mutex> poolLock(engine->internal->workerPool->mutex);
+	engine->internal->workerPoolClient.priority = math::clamp(priority, 1, 100);
 }
 
 
-ParamHandle* Engine::getParamHandle(Module* module, int paramId) {
-	return getParamHandle(module->id, paramId);
+/** Average CPU time of the engine per block duration over the last meter update, in cores.
+Unlike getMeterAverage(), this includes the time of the borrowed workers, and not the time the audio thread was preempted.
+*/
+double Engine_getCpuLoad(Engine* const engine) {
+	return engine->internal->meterLastCpuLoad;
 }
 
 
-void Engine::updateParamHandle(ParamHandle* paramHandle, int64_t moduleId, int paramId, bool overwrite) {
-	std::lock_guard<SharedMutex> lock(internal->mutex);
-	updateParamHandle_NoLock(paramHandle, moduleId, paramId, overwrite);
+float Engine_getCpuBudget(Engine* const engine) {
+	return engine->internal->cpuBudget;
 }
 
 
-void Engine::updateParamHandle_NoLock(ParamHandle* paramHandle, int64_t moduleId, int paramId, bool overwrite) {
-	// Check that it exists
-	auto it = internal->paramHandles.find(paramHandle);
-	DISTRHO_SAFE_ASSERT_RETURN(it != internal->paramHandles.end(),);
+void Engine_setCpuBudget(Engine* const engine, const float cores) {
+	const EngineWriteLock lock(engine->internal);
+	Engine::Internal* const internal = engine->internal;
+	internal->cpuBudget = std::isfinite(cores) ? std::max(0.f, cores) : 0.f;
+	internal->cpuBudgetChangeTime = 0.0;
+	internal->overCpuBudget = false;
+	internal->workerPoolClient.budgetWorkers = INT_MAX;
+}
 
-	// Set IDs
-	paramHandle->moduleId = moduleId;
-	paramHandle->paramId = paramId;
-	paramHandle->module = NULL;
-	// At this point, the ParamHandle cache might be invalid.
 
-	if (paramHandle->moduleId >= 0) {
-		// Replace old ParamHandle, or reset the current ParamHandle
-		ParamHandle* oldParamHandle = getParamHandle_NoLock(moduleId, paramId);
-		if (oldParamHandle) {
-			if (overwrite) {
-				oldParamHandle->moduleId = -1;
-				oldParamHandle->paramId = 0;
-				oldParamHandle->module = NULL;
-			}
-			else {
-				paramHandle->moduleId = -1;
-				paramHandle->paramId = 0;
-				paramHandle->module = NULL;
-			}
-		}
-	}
+bool Engine_isRealTimeScheduling(Engine* const engine) {
+	return engine->internal->realTimeScheduling;
+}
 
-	// Set module pointer if the above block didn't reset it
-	if (paramHandle->moduleId >= 0) {
-		paramHandle->module = getModule_NoLock(paramHandle->moduleId);
-	}
 
-	Engine_refreshParamHandleCache(this);
+void Engine_setRealTimeScheduling(Engine* const engine, const bool realTime) {
+	engine->internal->realTimeScheduling = realTime;
+	engine->internal->schedulingGeneration++;
 }
 
 
-json_t* Engine::toJson() {
-	SharedLock<SharedMutex> lock(internal->mutex);
-	json_t* rootJ = json_object();
+int Engine_getAudioThreadCpu(Engine* const engine) {
+	return engine->internal->audioThreadCpu;
+}
 
-	// modules
-	json_t* modulesJ = json_array();
-	for (Module* module : internal->modules) {
-		json_t* moduleJ = module->toJson();
-		json_array_append_new(modulesJ, moduleJ);
-	}
-	for (TerminalModule* terminalModule : internal->terminalModules) {
-		json_t* terminalModuleJ = terminalModule->toJson();
-		json_array_append_new(modulesJ, terminalModuleJ);
-	}
-	json_object_set_new(rootJ, "modules", modulesJ);
 
-	// cables
-	json_t* cablesJ = json_array();
-	for (Cable* cable : internal->cables) {
-		json_t* cableJ = cable->toJson();
-		json_array_append_new(cablesJ, cableJ);
-	}
-	json_object_set_new(rootJ, "cables", cablesJ);
+void Engine_setAudioThreadCpu(Engine* const engine, const int cpu) {
+	engine->internal->audioThreadCpu = cpu >= 0 && cpu < threadsched::getCpuCount() ? cpu : -1;
+	engine->internal->schedulingGeneration++;
+}
 
-	return rootJ;
+
+bool Engine_isAutoBufferSize(Engine* const engine) {
+	return engine->internal->autoBufferSize;
 }
 
 
-void Engine::fromJson(json_t* rootJ) {
-	// Don't write-lock the entire method because most of it doesn't need it.
+void Engine_setAutoBufferSize(Engine* const engine, const bool autoBufferSize) {
+	// Buffer sizes are picked by the menu bar from the engine meter, see MenuBar.cpp
+	engine->internal->autoBufferSize = autoBufferSize;
+}
 
-	// Write-locks
-	clear();
-	// modules
-	json_t* modulesJ = json_object_get(rootJ, "modules");
-	if (!modulesJ)
+
+void Engine_applyAudioThreadScheduling(Engine* const engine, const double blockDuration) {
+	Engine::Internal* const internal = engine->internal;
+	const int generation = internal->schedulingGeneration;
+	const bool realTime = internal->realTimeScheduling;
+	const int cpu = internal->audioThreadCpu;
+
+	// The time-constraint period follows the buffer size, nothing else changes between blocks
+	if (generation == internal->appliedSchedulingGeneration
+		&& (!realTime || blockDuration == internal->appliedBlockDuration))
 		return;
-	size_t moduleIndex;
-	json_t* moduleJ;
-	json_array_foreach(modulesJ, moduleIndex, moduleJ) {
-		// Get model
-		plugin::Model* model;
-		try {
-			model = plugin::modelFromJson(moduleJ);
-		}
-		catch (Exception& e) {
-			WARN("Cannot load model: %s", e.what());
-			// APP->patch->log(e.what());
-			continue;
-		}
 
-		// Create module
-		Module* const module = model->createModule();
-		DISTRHO_SAFE_ASSERT_CONTINUE(module != nullptr);
+	// Called by the audio thread, so try again on the next block if the pool is busy
+	EngineWorkerPool* const pool = internal->workerPool;
+	{
+		std::unique_lock<std::mutex> lock(pool->mutex, std::try_to_lock);
+		if (!lock.owns_lock())
+			return;
+		pool->realTime = realTime;
+		pool->realTimePeriod = blockDuration;
+		pool->firstCpu = cpu >= 0 ? cpu + 1 : -1;
+		pool->schedulingGeneration++;
+	}
 
-		// Create the widget too, needed by a few modules
-		CardinalPluginModelHelper* const helper = dynamic_cast<CardinalPluginModelHelper*>(model);
-		DISTRHO_SAFE_ASSERT_CONTINUE(helper != nullptr);
+	internal->appliedSchedulingGeneration = generation;
+	internal->appliedBlockDuration = blockDuration;
 
-		app::ModuleWidget* const moduleWidget = helper->createModuleWidgetFromEngineLoad(module);
-		DISTRHO_SAFE_ASSERT_CONTINUE(moduleWidget != nullptr);
+	// Leave the scheduling alone unless it was asked for, JACK may have made the thread real-time already
+	if (realTime || internal->appliedRealTime) {
+		if (!threadsched::setCurrentThreadRealTime(realTime, blockDuration) && realTime)
+			WARN("Could not make the audio thread real-time, the system may not allow it");
+	}
+	if (cpu != internal->appliedCpu) {
+		if (!threadsched::setCurrentThreadAffinity(cpu) && cpu >= 0)
+			WARN("Could not pin the audio thread to CPU %d", cpu + 1);
+	}
+	internal->appliedRealTime = realTime;
+	internal->appliedCpu = cpu;
+}
 
-		try {
-			// This doesn't need a lock because the Module is not added to the Engine yet.
-			module->fromJson(moduleJ);
 
-			// Before 1.0, the module ID was the index in the "modules" array
-			if (module->id < 0) {
-				module->id = moduleIndex;
-			}
+/** Renders the outputs of `modules` that feed other modules for `frames` engine frames, then plays them back instead of processing these modules.
+The modules are stepped on their own in engine order while the engine waits, with the cables between them stepped as usual.
+Inputs coming from other modules hold the voltages they had when freezing started.
+Channel counts of the recorded outputs are fixed to the ones they have when freezing starts.
+Host modules, modules processed a block at a time and modules already frozen are left alone.
+Returns the number of modules frozen.
+*/
+int Engine_freezeModules(Engine* const engine, const std::vector<Module*>& modules, const int64_t frames) {
+	Engine::Internal* const internal = engine->internal;
+	// Loops of more than 64M voltages are refused, that is 11 minutes of a single mono output at 96 kHz
+	const int64_t maxVoltages = 64 * 1024 * 1024;
 
-			// Write-locks
-			addModule(module);
+	if (frames <= 0)
+		return 0;
+
+	const EngineWriteLock lock(internal);
+
+	// Terminal modules are not in `modules`, so they are never part of the group
+	const std::unordered_set<Module*> selected(modules.begin(), modules.end());
+	std::vector<Module*> group;
+	for (Module* module : internal->modules) {
+		if (selected.find(module) == selected.end())
+			continue;
+		if (internal->frozenModules.find(module) != internal->frozenModules.end())
+			continue;
+		if (BlockModule* const blockModule = dynamic_cast<BlockModule*>(module)) {
+			if (blockModule->blockMode != BlockModule::kBlockModeFrame)
+				continue;
 		}
-		catch (Exception& e) {
-			WARN("Cannot load module: %s", e.what());
-			// APP->patch->log(e.what());
-			helper->removeCachedModuleWidget(module);
-			delete module;
+		group.push_back(module);
+	}
+	const std::unordered_set<Module*> groupModules(group.begin(), group.end());
+
+	// Cables within the group are stepped while rendering, outputs feeding anything else are recorded
+	std::unordered_map<Module*, std::vector<Cable*>> groupCables;
+	std::unordered_map<Module*, std::set<int>> recordedOutputIds;
+	for (Cable* cable : internal->cables) {
+		if (groupModules.find(cable->outputModule) == groupModules.end())
 			continue;
+		if (groupModules.find(cable->inputModule) != groupModules.end())
+			groupCables[cable->outputModule].push_back(cable);
+		else
+			recordedOutputIds[cable->outputModule].insert(cable->outputId);
+	}
+
+	// Nothing else hears the group, freezing it would only silence it
+	if (recordedOutputIds.empty())
+		return 0;
+
+	int64_t stride = 0;
+	for (const auto& pair : recordedOutputIds) {
+		for (const int outputId : pair.second)
+			stride += pair.first->outputs[outputId].channels;
+	}
+	if (stride * frames > maxVoltages) {
+		WARN("Not freezing %d modules, %lld frames of %lld voltages is too long", (int) group.size(), (long long) frames, (long long) stride);
+		return 0;
+	}
+
+	struct GroupModule {
+		Module* module;
+		std::vector<std::pair<Output*, Input*>> cables;
+		FrozenModule frozen;
+	};
+	std::vector<GroupModule> groupSteps(group.size());
+	for (size_t i = 0; i < group.size(); i++) {
+		GroupModule& step = groupSteps[i];
+		step.module = group[i];
+		for (Cable* cable : groupCables[step.module])
+			step.cables.push_back(std::make_pair(&cable->outputModule->outputs[cable->outputId], &cable->inputModule->inputs[cable->inputId]));
+		for (const int outputId : recordedOutputIds[step.module]) {
+			const int channels = step.module->outputs[outputId].channels;
+			step.frozen.outputIds.push_back(outputId);
+			step.frozen.outputChannels.push_back(channels);
+			step.frozen.stride += channels;
 		}
+		step.frozen.frames = frames;
+		step.frozen.voltages.resize(step.frozen.stride * frames);
 	}
 
-	// cables
-	json_t* cablesJ = json_object_get(rootJ, "cables");
-	// Before 1.0, cables were called wires
-	if (!cablesJ)
-		cablesJ = json_object_get(rootJ, "wires");
-	if (!cablesJ)
-		return;
-	size_t cableIndex;
-	json_t* cableJ;
-	json_array_foreach(cablesJ, cableIndex, cableJ) {
-		// cable
-		Cable* cable = new Cable;
+	const double startTime = system::getTime();
 
-		try {
-			cable->fromJson(cableJ);
+	Module::ProcessArgs processArgs;
+	processArgs.sampleRate = internal->sampleRate;
+	processArgs.sampleTime = internal->sampleTime;
 
-			// Before 1.0, the cable ID was the index in the "cables" array
-			if (cable->id < 0) {
-				cable->id = cableIndex;
+	for (int64_t f = 0; f < frames; f++) {
+		processArgs.frame = internal->frame + f;
+		for (GroupModule& step : groupSteps) {
+			Module* const module = step.module;
+			if (module->leftExpander.messageFlipRequested) {
+				std::swap(module->leftExpander.producerMessage, module->leftExpander.consumerMessage);
+				module->leftExpander.messageFlipRequested = false;
+			}
+			if (module->rightExpander.messageFlipRequested) {
+				std::swap(module->rightExpander.producerMessage, module->rightExpander.consumerMessage);
+				module->rightExpander.messageFlipRequested = false;
 			}
 
-			// Write-locks
-			addCable(cable);
-		}
-		catch (Exception& e) {
-			WARN("Cannot load cable: %s", e.what());
-			delete cable;
-			// Don't log exceptions because missing modules create unnecessary complaining when cables try to connect to them.
-			continue;
+			Engine_setCurrentModule(module);
+			module->doProcess(processArgs);
+
+			for (const std::pair<Output*, Input*>& cable : step.cables)
+				Cable_step(cable.first, cable.second);
+
+			float* voltages = &step.frozen.voltages[f * step.frozen.stride];
+			for (size_t i = 0; i < step.frozen.outputIds.size(); i++) {
+				const int channels = step.frozen.outputChannels[i];
+				std::memcpy(voltages, module->outputs[step.frozen.outputIds[i]].voltages, sizeof(float) * channels);
+				voltages += channels;
+			}
 		}
 	}
+	Engine_setCurrentModule(NULL);
+
+	// Playback starts where the loop begins, lined up with the transport if the host is playing
+	const int64_t transportFrame = internal->transportFrame.load(std::memory_order_relaxed);
+	internal->freezeFrame = transportFrame >= 0 ? transportFrame : 0;
+	internal->lastTransportFrame = transportFrame;
+
+	for (GroupModule& step : groupSteps)
+		internal->frozenModules[step.module] = std::move(step.frozen);
+	internal->dormantModulesDirty = true;
+
+	INFO("Froze %d modules, rendered %lld frames in %f seconds", (int) group.size(), (long long) frames, system::getTime() - startTime);
+	return group.size();
 }
 
 
-void Engine::startFallbackThread() {
+/** Processes `modules` again, starting from the state they were left in by Engine_freezeModules().
+Returns the number of modules unfrozen.
+*/
+int Engine_unfreezeModules(Engine* const engine, const std::vector<Module*>& modules) {
+	Engine::Internal* const internal = engine->internal;
+	const EngineWriteLock lock(internal);
+
+	int count = 0;
+	for (Module* module : modules)
+		count += internal->frozenModules.erase(module);
+	if (count != 0)
+		internal->dormantModulesDirty = true;
+	return count;
 }
 
 
-void Engine_setAboutToClose(Engine* const engine) {
-	engine->internal->aboutToClose = true;
+bool Engine_isModuleFrozen(Engine* const engine, Module* const module) {
+	Engine::Internal* const internal = engine->internal;
+	const EngineReadLock lock(internal);
+	return internal->frozenModules.find(module) != internal->frozenModules.end();
+}
+
+
+/** Sets the host transport position in host frames at the start of the next block, or -1 while the transport is stopped.
+*/
+void Engine_setTransportFrame(Engine* const engine, const int64_t frame) {
+	Engine::Internal* const internal = engine->internal;
+	internal->transportFrame.store(frame >= 0 ? frame * internal->oversampling : -1, std::memory_order_relaxed);
 }
 
 
@@ -25,6 +25,7 @@
  * the License, or (at your option) any later version.
  */
 
+#include <algorithm>
 #include <thread>
 #include <utility>
 
@@ -52,6 +53,9 @@
 #include <library.hpp>
 
 #include "../CardinalCommon.hpp"
+#include "../ModuleMemory.hpp"
+#include "../PerfTrace.hpp"
+#include "../ThreadScheduling.hpp"
 #include "DistrhoStandaloneUtils.hpp"
 
 #ifdef HAVE_LIBLO
@@ -69,10 +73,48 @@ namespace plugin {
 void updateStaticPluginsDarkMode();
 }
 
+namespace engine {
+bool Engine_isSkippingDormantModules(Engine*);
+void Engine_setSkipDormantModules(Engine*, bool);
+bool Engine_isLoadShedding(Engine*);
+void Engine_setLoadShedding(Engine*, bool);
+float Engine_getIdleSleepTime(Engine*);
+void Engine_setIdleSleepTime(Engine*, float);
+float Engine_getCpuBudget(Engine*);
+void Engine_setCpuBudget(Engine*, float);
+int Engine_getOversampling(Engine*);
+void Engine_setOversampling(Engine*, int);
+int Engine_getBlockQuantum(Engine*);
+void Engine_setBlockQuantum(Engine*, int);
+json_t* Engine_getLoadProfileJson(Engine*);
+json_t* Engine_getBlockStatsJson(Engine*);
+void Engine_resetBlockStats(Engine*);
+uint64_t Engine_getXrunCount(Engine*);
+json_t* Engine_getModuleProfileJson(Engine*);
+json_t* Engine_getCableStatsJson(Engine*);
+void Engine_resetCableStats(Engine*);
+void Engine_resetModuleProfiles(Engine*);
+bool Engine_isRealTimeScheduling(Engine*);
+void Engine_setRealTimeScheduling(Engine*, bool);
+int Engine_getAudioThreadCpu(Engine*);
+void Engine_setAudioThreadCpu(Engine*, int);
+bool Engine_isAutoBufferSize(Engine*);
+void Engine_setAutoBufferSize(Engine*, bool);
+}
+
 namespace app {
 namespace menuBar {
 
 
+static const std::vector<uint32_t> bufferSizes = {
+	#ifdef DISTRHO_OS_WASM
+	256, 512, 1024, 2048, 4096, 8192, 16384
+	#else
+	128, 256, 512, 1024, 2048, 4096, 8192
+	#endif
+};
+
+
 struct MenuButton : ui::Button {
 	void step() override {
 		box.size.x = bndLabelWidth(APP->window->vg, -1, text.c_str()) + 1.0;
@@ -166,6 +208,20 @@ struct FileButton : MenuButton {
 			patchUtils::revertDialog();
 		}, APP->patch->path.empty()));
 
+#ifndef DISTRHO_OS_WASM
+		menu->addChild(createSubmenuItem("Patch bank", "", [=](ui::Menu* const menu) {
+			menu->addChild(createMenuItem("Use this patch folder", "", []() {
+				patchUtils::setPatchBank(system::getDirectory(APP->patch->path));
+			}, APP->patch->path.empty()));
+
+			menu->addChild(createMenuItem("Clear", "", []() {
+				patchUtils::setPatchBank("");
+			}));
+
+			menu->addChild(createMenuLabel("MIDI program N loads the Nth .vcv file by name"));
+		}));
+#endif
+
 #ifdef HAVE_LIBLO
 		menu->addChild(new ui::MenuSeparator);
 
@@ -508,6 +564,10 @@ struct KnobScrollSensitivitySlider : ui::Slider {
 };
 
 
+/** Marks framebuffers for re-rendering after a theme change, which Window::getFrameDurationRemaining() spreads across frames.
+Only the first framebuffer of each widget is marked, its children are drawn into it.
+The appearance sliders need none of this, as rack brightness, halo and cables are applied when drawing every frame.
+*/
 static void setAllFramebufferWidgetsDirty(widget::Widget* const widget)
 {
 	for (widget::Widget* child : widget->children)
@@ -540,6 +600,7 @@ struct ViewButton : MenuButton {
 		}));
 
 		menu->addChild(createBoolPtrMenuItem("Show tooltips", "", &settings::tooltips));
+		menu->addChild(createBoolPtrMenuItem("Simplify when zoomed out", "", &settings::lowDetailZoom));
 
 		ZoomSlider* zoomSlider = new ZoomSlider;
 		zoomSlider->box.size.x = 250.0;
@@ -626,6 +687,10 @@ struct ViewButton : MenuButton {
 				));
 			}
 		}));
+
+		menu->addChild(createMenuItem("Pre-render module browser previews", "", []() {
+			window::generateModuleThumbnails();
+		}));
 	}
 };
 
@@ -642,10 +707,325 @@ struct EngineButton : MenuButton {
 		menu->box.pos = getAbsoluteOffset(math::Vec(0, box.size.y));
 
 		std::string cpuMeterText = "F3";
-		if (settings::cpuMeter)
+		if (settings::sampledCpuMeter)
 			cpuMeterText += " " CHECKMARK_STRING;
 		menu->addChild(createMenuItem("Performance meters", cpuMeterText, [=]() {
-			settings::cpuMeter ^= true;
+			settings::sampledCpuMeter ^= true;
+		}));
+
+		// Times every frame of every module, which is precise but too slow to leave on
+		menu->addChild(createBoolPtrMenuItem("Exact performance meters", "", &settings::cpuMeter));
+
+		menu->addChild(createSubmenuItem("Module profile", "", [=](ui::Menu* menu) {
+			json_t* const profileJ = engine::Engine_getModuleProfileJson(APP->engine);
+			DEFER({json_decref(profileJ);});
+
+			// Heaviest models first, with all their instances together
+			size_t modelIndex;
+			json_t* modelJ;
+			json_array_foreach(json_object_get(profileJ, "models"), modelIndex, modelJ) {
+				if (modelIndex == 20)
+					break;
+				menu->addChild(createMenuLabel(string::f("%s/%s x%d: %.2f%%",
+					json_string_value(json_object_get(modelJ, "plugin")),
+					json_string_value(json_object_get(modelJ, "model")),
+					(int) json_integer_value(json_object_get(modelJ, "instances")),
+					json_real_value(json_object_get(modelJ, "load")) * 100)));
+			}
+
+			menu->addChild(new ui::MenuSeparator);
+			menu->addChild(createMenuItem("Copy as JSON", "", []() {
+				json_t* const profileJ = engine::Engine_getModuleProfileJson(APP->engine);
+				DEFER({json_decref(profileJ);});
+				char* const json = json_dumps(profileJ, JSON_INDENT(2));
+				DEFER({std::free(json);});
+				glfwSetClipboardString(APP->window->win, json);
+			}));
+			menu->addChild(createMenuItem("Reset", "", []() {
+				engine::Engine_resetModuleProfiles(APP->engine);
+			}));
+		}));
+
+		menu->addChild(createSubmenuItem("Cable activity", "", [=](ui::Menu* menu) {
+			menu->addChild(createBoolPtrMenuItem("Show over outputs", "", &settings::cableActivity));
+			if (!settings::cableActivity)
+				return;
+
+			json_t* const cablesJ = engine::Engine_getCableStatsJson(APP->engine);
+			DEFER({json_decref(cablesJ);});
+
+			// Cables with the most wasted channels first, then constant ones
+			std::vector<json_t*> wasteful;
+			size_t cableIndex;
+			json_t* cableJ;
+			json_array_foreach(cablesJ, cableIndex, cableJ) {
+				const int channels = json_integer_value(json_object_get(cableJ, "channels"));
+				const int activeChannels = json_integer_value(json_object_get(cableJ, "activeChannels"));
+				if (activeChannels < channels || json_real_value(json_object_get(cableJ, "changeRate")) == 0.0
+					|| json_is_true(json_object_get(cableJ, "dormant")))
+					wasteful.push_back(cableJ);
+			}
+			std::stable_sort(wasteful.begin(), wasteful.end(), [](json_t* a, json_t* b) {
+				const auto waste = [](json_t* j) {
+					return json_integer_value(json_object_get(j, "channels")) - json_integer_value(json_object_get(j, "activeChannels"));
+				};
+				return waste(a) > waste(b);
+			});
+
+			if (!wasteful.empty())
+				menu->addChild(new ui::MenuSeparator);
+			for (size_t i = 0; i < wasteful.size() && i < 20; i++) {
+				json_t* const j = wasteful[i];
+				menu->addChild(createMenuLabel(string::f("%s/%s out %d: %d/%d channels, %.0f%% changing%s",
+					json_string_value(json_object_get(j, "plugin")),
+					json_string_value(json_object_get(j, "model")),
+					(int) json_integer_value(json_object_get(j, "outputId")) + 1,
+					(int) json_integer_value(json_object_get(j, "activeChannels")),
+					(int) json_integer_value(json_object_get(j, "channels")),
+					json_real_value(json_object_get(j, "changeRate")) * 100,
+					json_is_true(json_object_get(j, "dormant")) ? ", not reaching the host" : "")));
+			}
+
+			menu->addChild(new ui::MenuSeparator);
+			menu->addChild(createMenuItem("Copy as JSON", "", []() {
+				json_t* const cablesJ = engine::Engine_getCableStatsJson(APP->engine);
+				DEFER({json_decref(cablesJ);});
+				char* const json = json_dumps(cablesJ, JSON_INDENT(2));
+				DEFER({std::free(json);});
+				glfwSetClipboardString(APP->window->win, json);
+			}));
+			menu->addChild(createMenuItem("Reset", "", []() {
+				engine::Engine_resetCableStats(APP->engine);
+			}));
+		}));
+
+#if !defined(DISTRHO_OS_WASM) || defined(CARDINAL_WASM_THREADS)
+		menu->addChild(createSubmenuItem("Threads", string::f("%d", settings::threadCount), [=](ui::Menu* menu) {
+			// BUG This assumes SMT is enabled.
+			const int cores = std::max(1, system::getLogicalCoreCount() / 2);
+
+			for (int i = 1; i <= 2 * cores; i++) {
+				std::string rightText;
+				if (i == cores)
+					rightText += "(most modules)";
+				else if (i == 1)
+					rightText += "(lowest CPU usage)";
+				menu->addChild(createCheckMenuItem(string::f("%d", i), rightText,
+					[=]() {return settings::threadCount == i;},
+					[=]() {settings::threadCount = i;}
+				));
+			}
+		}));
+#endif
+
+		menu->addChild(createCheckMenuItem("Skip modules not reaching the host", "",
+			[=]() {return engine::Engine_isSkippingDormantModules(APP->engine);},
+			[=]() {engine::Engine_setSkipDormantModules(APP->engine, !engine::Engine_isSkippingDormantModules(APP->engine));}
+		));
+
+		// Same as above, but only while blocks come close to their deadline
+		menu->addChild(createCheckMenuItem("Skip them when overloaded", "",
+			[=]() {return engine::Engine_isLoadShedding(APP->engine);},
+			[=]() {engine::Engine_setLoadShedding(APP->engine, !engine::Engine_isLoadShedding(APP->engine));}
+		));
+
+		// Stops stepping the engine after the host inputs and outputs were silent for a while, saved with the patch
+		static const std::vector<int> idleSleepTimes = {0, 10, 30, 60, 300};
+		const float idleSleepTime = engine::Engine_getIdleSleepTime(APP->engine);
+		menu->addChild(createSubmenuItem("Sleep when idle", idleSleepTime > 0.f ? string::f("%g s", idleSleepTime) : "Off", [=](ui::Menu* menu) {
+			for (int seconds : idleSleepTimes) {
+				menu->addChild(createCheckMenuItem(seconds != 0 ? string::f("After %d s of silence", seconds) : "Off", "",
+					[=]() {return engine::Engine_getIdleSleepTime(APP->engine) == seconds;},
+					[=]() {engine::Engine_setIdleSleepTime(APP->engine, seconds);}
+				));
+			}
+		}));
+
+#if !defined(DISTRHO_OS_WASM) || defined(CARDINAL_WASM_THREADS)
+		// Borrows fewer threads when the patch takes more CPU than this, saved with the patch
+		static const std::vector<float> cpuBudgets = {0.f, 0.5f, 1.f, 2.f, 4.f};
+		const float cpuBudget = engine::Engine_getCpuBudget(APP->engine);
+		menu->addChild(createSubmenuItem("CPU budget", cpuBudget > 0.f ? string::f("%g cores", cpuBudget) : "Off", [=](ui::Menu* menu) {
+			for (float cores : cpuBudgets) {
+				menu->addChild(createCheckMenuItem(cores != 0.f ? string::f("%g cores", cores) : "Off", "",
+					[=]() {return engine::Engine_getCpuBudget(APP->engine) == cores;},
+					[=]() {engine::Engine_setCpuBudget(APP->engine, cores);}
+				));
+			}
+		}));
+#endif
+
+		static const std::vector<int> oversamplingFactors = {1, 2, 4};
+		menu->addChild(createSubmenuItem("Oversampling", string::f("%dx", engine::Engine_getOversampling(APP->engine)), [=](ui::Menu* menu) {
+			for (int factor : oversamplingFactors) {
+				menu->addChild(createCheckMenuItem(string::f("%dx", factor), "",
+					[=]() {return engine::Engine_getOversampling(APP->engine) == factor;},
+					[=]() {engine::Engine_setOversampling(APP->engine, factor);}
+				));
+			}
+		}));
+
+		menu->addChild(createSubmenuItem("Block timing", "", [=](ui::Menu* menu) {
+			json_t* const statsJ = engine::Engine_getBlockStatsJson(APP->engine);
+			DEFER({json_decref(statsJ);});
+
+			menu->addChild(createMenuLabel(string::f("Blocks: %lld, xruns: %lld (%lld skipped)",
+				(long long) json_integer_value(json_object_get(statsJ, "blocks")),
+				(long long) json_integer_value(json_object_get(statsJ, "xruns")),
+				(long long) json_integer_value(json_object_get(statsJ, "skipped")))));
+			json_t* const budgetWorkersJ = json_object_get(statsJ, "budgetWorkers");
+			menu->addChild(createMenuLabel(string::f("CPU: %.2f cores%s",
+				json_real_value(json_object_get(statsJ, "cpuLoad")),
+				budgetWorkersJ ? string::f(", limited to %lld threads by its budget",
+					(long long) json_integer_value(budgetWorkersJ) + 1).c_str() : "")));
+			if (json_integer_value(json_object_get(statsJ, "shed")) != 0)
+				menu->addChild(createMenuLabel(string::f("Modules not reaching the host skipped %lld times when overloaded",
+					(long long) json_integer_value(json_object_get(statsJ, "shed")))));
+
+			json_t* const percentilesJ = json_object_get(statsJ, "percentiles");
+			menu->addChild(createMenuLabel(string::f("50%%: %.0f%%  90%%: %.0f%%  99%%: %.0f%%  99.9%%: %.0f%%  max: %.0f%%",
+				json_real_value(json_object_get(percentilesJ, "50")) * 100,
+				json_real_value(json_object_get(percentilesJ, "90")) * 100,
+				json_real_value(json_object_get(percentilesJ, "99")) * 100,
+				json_real_value(json_object_get(percentilesJ, "99.9")) * 100,
+				json_real_value(json_object_get(statsJ, "max")) * 100)));
+
+			// Worst blocks first, with the modules that took longest in them
+			json_t* const worstJ = json_object_get(statsJ, "worst");
+			if (json_array_size(worstJ) != 0)
+				menu->addChild(new ui::MenuSeparator);
+			const double now = system::getUnixTime();
+			size_t blockIndex;
+			json_t* blockJ;
+			json_array_foreach(worstJ, blockIndex, blockJ) {
+				std::string text = string::f("%.0f%% %.0f s ago",
+					json_real_value(json_object_get(blockJ, "load")) * 100,
+					now - json_real_value(json_object_get(blockJ, "time")));
+				size_t moduleIndex;
+				json_t* moduleJ;
+				json_array_foreach(json_object_get(blockJ, "modules"), moduleIndex, moduleJ) {
+					text += string::f("%s %s/%s %.2f ms", moduleIndex == 0 ? ":" : ",",
+						json_string_value(json_object_get(moduleJ, "plugin")),
+						json_string_value(json_object_get(moduleJ, "model")),
+						json_real_value(json_object_get(moduleJ, "time")) * 1000);
+				}
+				menu->addChild(createMenuLabel(text));
+			}
+
+			menu->addChild(new ui::MenuSeparator);
+			menu->addChild(createMenuItem("Copy as JSON", "", []() {
+				json_t* const statsJ = engine::Engine_getBlockStatsJson(APP->engine);
+				DEFER({json_decref(statsJ);});
+				char* const json = json_dumps(statsJ, JSON_INDENT(2));
+				DEFER({std::free(json);});
+				glfwSetClipboardString(APP->window->win, json);
+			}));
+			menu->addChild(createMenuItem("Reset", "", []() {
+				engine::Engine_resetBlockStats(APP->engine);
+			}));
+		}));
+
+		menu->addChild(createSubmenuItem("Patch load profile", "", [=](ui::Menu* menu) {
+			json_t* const profileJ = engine::Engine_getLoadProfileJson(APP->engine);
+			DEFER({json_decref(profileJ);});
+
+			menu->addChild(createMenuLabel(string::f("Total: %.1f ms", json_real_value(json_object_get(profileJ, "total")) * 1000)));
+
+			const char* stage;
+			json_t* stageJ;
+			json_object_foreach(json_object_get(profileJ, "stages"), stage, stageJ) {
+				menu->addChild(createMenuLabel(string::f("%s: %.1f ms", stage, json_real_value(stageJ) * 1000)));
+			}
+
+			// Slowest modules first
+			json_t* const modulesJ = json_object_get(profileJ, "modules");
+			if (json_array_size(modulesJ) != 0)
+				menu->addChild(new ui::MenuSeparator);
+			size_t moduleIndex;
+			json_t* moduleJ;
+			json_array_foreach(modulesJ, moduleIndex, moduleJ) {
+				if (moduleIndex == 20)
+					break;
+				const std::string name = string::f("%s/%s",
+					json_string_value(json_object_get(moduleJ, "plugin")),
+					json_string_value(json_object_get(moduleJ, "model")));
+#ifdef CARDINAL_MODULE_MEMORY
+				menu->addChild(createMenuLabel(string::f("%s: %.1f ms, %.1f MiB", name.c_str(),
+					json_real_value(json_object_get(moduleJ, "total")) * 1000,
+					json_integer_value(json_object_get(moduleJ, "memory")) / (1024.0 * 1024.0))));
+#else
+				menu->addChild(createMenuLabel(string::f("%s: %.1f ms", name.c_str(), json_real_value(json_object_get(moduleJ, "total")) * 1000)));
+#endif
+			}
+
+			menu->addChild(new ui::MenuSeparator);
+			menu->addChild(createMenuItem("Copy as JSON", "", []() {
+				json_t* const profileJ = engine::Engine_getLoadProfileJson(APP->engine);
+				DEFER({json_decref(profileJ);});
+				char* const json = json_dumps(profileJ, JSON_INDENT(2));
+				DEFER({std::free(json);});
+				glfwSetClipboardString(APP->window->win, json);
+			}));
+		}));
+
+#ifdef CARDINAL_MODULE_MEMORY
+		menu->addChild(createSubmenuItem("Module memory", "", [=](ui::Menu* menu) {
+			json_t* const modelsJ = modulemem::getModelsJson();
+			DEFER({json_decref(modelsJ);});
+
+			if (json_array_size(modelsJ) == 0)
+				menu->addChild(createMenuLabel("Nothing allocated yet"));
+
+			// Models using the most memory first, counting what deleted instances did not free
+			size_t modelIndex;
+			json_t* modelJ;
+			json_array_foreach(modelsJ, modelIndex, modelJ) {
+				if (modelIndex == 20)
+					break;
+				const int64_t leftBytes = json_integer_value(json_object_get(modelJ, "leftBytes"));
+				std::string text = string::f("%s/%s: %.1f MiB in %d",
+					json_string_value(json_object_get(modelJ, "plugin")),
+					json_string_value(json_object_get(modelJ, "model")),
+					json_integer_value(json_object_get(modelJ, "bytes")) / (1024.0 * 1024.0),
+					(int) json_integer_value(json_object_get(modelJ, "instances")));
+				if (leftBytes != 0)
+					text += string::f(", %.1f MiB left by deleted", leftBytes / (1024.0 * 1024.0));
+				menu->addChild(createMenuLabel(text));
+			}
+
+			menu->addChild(new ui::MenuSeparator);
+			menu->addChild(createMenuItem("Copy as JSON", "", []() {
+				json_t* const modelsJ = modulemem::getModelsJson();
+				DEFER({json_decref(modelsJ);});
+				char* const json = json_dumps(modelsJ, JSON_INDENT(2));
+				DEFER({std::free(json);});
+				glfwSetClipboardString(APP->window->win, json);
+			}));
+		}));
+#endif
+
+#ifdef CARDINAL_PERF_TRACE
+		if (perftrace::isRecording()) {
+			menu->addChild(createMenuItem("Stop performance trace", "Saves perf-trace.json", []() {
+				perftrace::stop(asset::user("perf-trace.json").c_str());
+			}));
+		}
+		else {
+			menu->addChild(createMenuItem("Start performance trace", "", []() {
+				perftrace::start();
+			}));
+		}
+#endif
+
+		static const std::vector<int> blockQuanta = {0, 64, 128, 256};
+		const int blockQuantum = engine::Engine_getBlockQuantum(APP->engine);
+		menu->addChild(createSubmenuItem("Fixed block size", blockQuantum != 0 ? string::f("%d", blockQuantum) : "Off", [=](ui::Menu* menu) {
+			for (int quantum : blockQuanta) {
+				menu->addChild(createCheckMenuItem(quantum != 0 ? string::f("%d frames", quantum) : "Off (follow host)", "",
+					[=]() {return engine::Engine_getBlockQuantum(APP->engine) == quantum;},
+					[=]() {engine::Engine_setBlockQuantum(APP->engine, quantum);}
+				));
+			}
 		}));
 
 		if (isUsingNativeAudio()) {
@@ -670,23 +1050,45 @@ struct EngineButton : MenuButton {
 			}
 
 			if (supportsBufferSizeChanges()) {
-				static const std::vector<uint32_t> bufferSizes = {
-					#ifdef DISTRHO_OS_WASM
-					256, 512, 1024, 2048, 4096, 8192, 16384
-					#else
-					128, 256, 512, 1024, 2048, 4096, 8192
-					#endif
-				};
 				const uint32_t currentBufferSize = getBufferSize();
-				menu->addChild(createSubmenuItem("Buffer Size", std::to_string(currentBufferSize), [=](ui::Menu* menu) {
+				const bool autoBufferSize = engine::Engine_isAutoBufferSize(APP->engine);
+				menu->addChild(createSubmenuItem("Buffer Size", autoBufferSize ? string::f("Auto (%u)", currentBufferSize) : std::to_string(currentBufferSize), [=](ui::Menu* menu) {
+					menu->addChild(createCheckMenuItem("Automatic", "",
+						[=]() {return engine::Engine_isAutoBufferSize(APP->engine);},
+						[=]() {engine::Engine_setAutoBufferSize(APP->engine, !engine::Engine_isAutoBufferSize(APP->engine));}
+					));
+					menu->addChild(new ui::MenuSeparator);
 					for (uint32_t bufferSize : bufferSizes) {
 						menu->addChild(createCheckMenuItem(std::to_string(bufferSize), "",
 							[=]() {return currentBufferSize == bufferSize;},
-							[=]() {requestBufferSizeChange(bufferSize);}
+							[=]() {
+								engine::Engine_setAutoBufferSize(APP->engine, false);
+								requestBufferSizeChange(bufferSize);
+							}
 						));
 					}
 				}));
 			}
+
+#ifndef DISTRHO_OS_WASM
+			menu->addChild(createBoolMenuItem("Real-time priority", "",
+				[=]() {return engine::Engine_isRealTimeScheduling(APP->engine);},
+				[=](bool realTime) {engine::Engine_setRealTimeScheduling(APP->engine, realTime);}
+			));
+
+# ifndef ARCH_MAC
+			// The audio thread takes the chosen CPU and the engine workers the ones after it
+			const int audioThreadCpu = engine::Engine_getAudioThreadCpu(APP->engine);
+			menu->addChild(createSubmenuItem("Pin audio thread", audioThreadCpu >= 0 ? string::f("CPU %d", audioThreadCpu + 1) : "Off", [=](ui::Menu* menu) {
+				for (int cpu = -1, count = threadsched::getCpuCount(); cpu < count; cpu++) {
+					menu->addChild(createCheckMenuItem(cpu >= 0 ? string::f("CPU %d", cpu + 1) : "Off", "",
+						[=]() {return engine::Engine_getAudioThreadCpu(APP->engine) == cpu;},
+						[=]() {engine::Engine_setAudioThreadCpu(APP->engine, cpu);}
+					));
+				}
+			}));
+# endif
+#endif
 		}
 	}
 };
@@ -756,13 +1158,63 @@ struct MeterLabel : ui::Label {
 		double meterAverage = APP->engine->getMeterAverage();
 		double meterMax = APP->engine->getMeterMax();
 		text = string::f("%.1f fps  %.1f%% avg  %.1f%% max", 1.0 / frameDurationAvg, meterAverage * 100, meterMax * 100);
+		const uint64_t xrunCount = engine::Engine_getXrunCount(APP->engine);
+		if (xrunCount != 0)
+			text += string::f("  %llu xruns", (unsigned long long) xrunCount);
 		Label::step();
 	}
 };
 
 
+/** Picks the smallest buffer size of the native standalone that keeps the engine meter clear of overloads.
+Steps up as soon as a block comes close to its deadline, and back down after a long stretch of low load,
+but never down to a size that overloaded before.
+*/
+struct AutoBufferSize {
+	double lastTime = 0.0;
+	double lowLoadTime = 0.0;
+	uint32_t overloadedBufferSize = 0;
+
+	void step() {
+		if (!engine::Engine_isAutoBufferSize(APP->engine) || !isUsingNativeAudio() || !supportsBufferSizeChanges())
+			return;
+
+		// The engine meter is updated once per second
+		const double time = system::getTime();
+		if (time - lastTime < 1.0)
+			return;
+		lastTime = time;
+
+		const uint32_t bufferSize = getBufferSize();
+		const auto it = std::find(bufferSizes.begin(), bufferSizes.end(), bufferSize);
+		if (it == bufferSizes.end())
+			return;
+
+		const double meterMax = APP->engine->getMeterMax();
+
+		if (meterMax > 0.85) {
+			overloadedBufferSize = std::max(overloadedBufferSize, bufferSize);
+			lowLoadTime = 0.0;
+			if (it + 1 != bufferSizes.end())
+				requestBufferSizeChange(*(it + 1));
+		}
+		else if (meterMax < 0.4 && it != bufferSizes.begin() && *(it - 1) > overloadedBufferSize) {
+			lowLoadTime += 1.0;
+			if (lowLoadTime >= 10.0) {
+				lowLoadTime = 0.0;
+				requestBufferSizeChange(*(it - 1));
+			}
+		}
+		else {
+			lowLoadTime = 0.0;
+		}
+	}
+};
+
+
 struct MenuBar : widget::OpaqueWidget {
 	MeterLabel* meterLabel;
+	AutoBufferSize autoBufferSize;
 
 	MenuBar(const bool isStandalone)
 		: widget::OpaqueWidget()
@@ -801,7 +1253,7 @@ struct MenuBar : widget::OpaqueWidget {
 
 		meterLabel = new MeterLabel;
 		meterLabel->box.pos.y = margin;
-		meterLabel->box.size.x = 300;
+		meterLabel->box.size.x = 380;
 		meterLabel->alignment = ui::Label::RIGHT_ALIGNMENT;
 		meterLabel->color.a = 0.5;
 		addChild(meterLabel);
@@ -816,6 +1268,7 @@ struct MenuBar : widget::OpaqueWidget {
 
 	void step() override {
 		meterLabel->box.pos.x = box.size.x - meterLabel->box.size.x - 5;
+		autoBufferSize.step();
 		Widget::step();
 	}
 };
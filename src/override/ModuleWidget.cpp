@@ -26,17 +26,25 @@
  */
 
 #include "../../CardinalCommon.hpp"
+#include "../ModuleMemory.hpp"
 
+#include <atomic>
+#include <mutex>
 #include <thread>
 #include <regex>
+#include <unordered_map>
+
+#include <sys/stat.h>
 
 #include <osdialog.h>
 
 #include <app/ModuleWidget.hpp>
 #include <app/Scene.hpp>
 #include <engine/Engine.hpp>
+#include <plugin.hpp>
 #include <plugin/Plugin.hpp>
 #include <app/SvgPanel.hpp>
+#include <engine/ModulePresetLoad.hpp>
 #include <ui/MenuSeparator.hpp>
 #include <system.hpp>
 #include <asset.hpp>
@@ -49,11 +57,61 @@
 
 
 namespace rack {
+
+namespace settings {
+bool sampledCpuMeter = false;
+bool cableActivity = false;
+bool lowDetailZoom = true;
+}
+
+namespace engine {
+bool Engine_getModuleMeter(Engine*, Module*, std::vector<float>& values);
+bool Engine_getOutputActivity(Engine*, Module*, int outputId, int& channels, int& activeChannels, float& changeRate);
+void Engine_beginEdits(Engine*);
+void Engine_endEdits(Engine*);
+}
+
 namespace app {
 
 
 static const char PRESET_FILTERS[] = "VCV Rack module preset (.vcvm):vcvm";
 
+/** Screen pixels per rack unit below which modules and cables are drawn in low detail, a 10 HP module is then under 70 pixels wide.
+*/
+static const constexpr float kLowDetailScale = 0.45f;
+
+
+// Cardinal specific API, declared as needed in other files
+bool ModuleWidget_isLowDetail(float scale) {
+	return settings::lowDetailZoom && scale < kLowDetailScale;
+}
+
+static bool isLowDetail(const widget::Widget::DrawArgs& args) {
+	float xform[6];
+	nvgCurrentTransform(args.vg, xform);
+	return ModuleWidget_isLowDetail(std::hypot(xform[0], xform[1]));
+}
+
+
+/** Preset being read and parsed on a background thread, applied from Scene::step() once finished.
+*/
+struct PresetLoad {
+	Context* context;
+	ModuleWidget* moduleWidget;
+	std::string filename;
+	std::thread thread;
+	std::atomic<bool> finished{false};
+	std::atomic<float> progress{0.f};
+	/** Set by the background thread, NULL on error. */
+	json_t* moduleJ = NULL;
+	std::string error;
+};
+
+/** Pending preset loads of all instances, each scene only finishes the ones of its own context.
+*/
+static std::mutex presetLoadsMutex;
+static std::vector<PresetLoad*> presetLoads;
+
 
 struct ModuleWidget::Internal {
 	/** The module position clicked on to start dragging in the rack.
@@ -66,6 +124,26 @@ struct ModuleWidget::Internal {
 	bool dragEnabled = true;
 
 	widget::Widget* panel = NULL;
+
+	/** CPU meter plot heights and label, only rebuilt when the module has a new meter value.
+	*/
+	int meterIndex = -1;
+	double meterUpdateTime = -INFINITY;
+	float meterWidth = 0.f;
+	std::vector<float> meterValues;
+	std::string meterText;
+	float meterTextWidth = 0.f;
+
+	/** Cable activity labels of the outputs and their centers, rebuilt at most 10 times per second.
+	*/
+	struct ActivityLabel {
+		math::Vec pos;
+		std::string text;
+	};
+	double activityUpdateTime = -INFINITY;
+	std::vector<ActivityLabel> activityLabels;
+
+	PresetLoad* presetLoad = NULL;
 };
 
 
@@ -74,7 +152,10 @@ ModuleWidget::ModuleWidget() {
 	box.size = math::Vec(0, RACK_GRID_HEIGHT);
 }
 
+static void cancelPresetLoad(ModuleWidget* mw);
+
 ModuleWidget::~ModuleWidget() {
+	cancelPresetLoad(this);
 	clearChildren();
 	setModule(NULL);
 	delete internal;
@@ -97,6 +178,7 @@ void ModuleWidget::setModule(engine::Module* module) {
 	if (this->module) {
 		APP->engine->removeModule(this->module);
 		delete this->module;
+		modulemem::removeModule(this->module);
 		this->module = NULL;
 	}
 	this->module = module;
@@ -232,6 +314,31 @@ std::vector<PortWidget*> ModuleWidget::getOutputs() {
 	return pws;
 }
 
+/** Panel from its framebuffer and lights as flat dots, knobs, ports, displays and text are too small to be seen.
+Lights nested in other widgets keep their color from step(), so only their boxes are needed here.
+*/
+static void drawLowDetail(ModuleWidget* mw, widget::Widget* panel, const widget::Widget::DrawArgs& args) {
+	if (panel) {
+		mw->drawChild(panel, args);
+	}
+	else {
+		nvgBeginPath(args.vg);
+		nvgRect(args.vg, 0.0, 0.0, VEC_ARGS(mw->box.size));
+		nvgFillColor(args.vg, nvgRGBf(0.5, 0.5, 0.5));
+		nvgFill(args.vg);
+	}
+
+	doIfTypeRecursive<LightWidget>(mw, [&](LightWidget* lw) {
+		if (!lw->isVisible() || lw->color.a < 0.05f)
+			return;
+		const math::Vec pos = lw->getRelativeOffset(math::Vec(), mw);
+		nvgBeginPath(args.vg);
+		nvgRect(args.vg, VEC_ARGS(pos), VEC_ARGS(lw->box.size));
+		nvgFillColor(args.vg, lw->color);
+		nvgFill(args.vg);
+	});
+}
+
 void ModuleWidget::draw(const DrawArgs& args) {
 	nvgScissor(args.vg, RECT_ARGS(args.clipBox));
 
@@ -239,14 +346,75 @@ void ModuleWidget::draw(const DrawArgs& args) {
 		nvgAlpha(args.vg, 0.33);
 	}
 
+	if (isLowDetail(args)) {
+		drawLowDetail(this, internal->panel, args);
+
+		if (APP->scene->rack->isSelected(this)) {
+			nvgBeginPath(args.vg);
+			nvgRect(args.vg, 0.0, 0.0, VEC_ARGS(box.size));
+			nvgFillColor(args.vg, nvgRGBAf(1, 0, 0, 0.25));
+			nvgFill(args.vg);
+		}
+
+		nvgResetScissor(args.vg);
+		return;
+	}
+
 	Widget::draw(args);
 
-	// Meter
-	if (module && settings::cpuMeter) {
-		float sampleRate = APP->engine->getSampleRate();
-		const float* meterBuffer = module->meterBuffer();
-		int meterLength = module->meterLength();
-		int meterIndex = module->meterIndex();
+	// Meter, from Rack's exact timing of every frame if enabled, otherwise from the engine's sampled module profile
+	if (module && (settings::cpuMeter || settings::sampledCpuMeter)) {
+		const bool sampled = !settings::cpuMeter;
+		int meterLength = sampled ? 0 : module->meterLength();
+		const int meterIndex = sampled ? -1 : module->meterIndex();
+
+		// Refresh the cached meter at most 10 times per second
+		const double time = system::getTime();
+		if (((sampled || meterIndex != internal->meterIndex) && time - internal->meterUpdateTime >= 0.1) || box.size.x != internal->meterWidth) {
+			const float sampleRate = APP->engine->getSampleRate();
+			float latestValue = 0.f;
+
+			internal->meterIndex = meterIndex;
+			internal->meterUpdateTime = time;
+			internal->meterWidth = box.size.x;
+			if (sampled) {
+				if (!engine::Engine_getModuleMeter(APP->engine, module, internal->meterValues))
+					internal->meterValues.clear();
+				if (!internal->meterValues.empty())
+					latestValue = internal->meterValues.back();
+				for (float& value : internal->meterValues)
+					value = math::clamp(value * sampleRate, 0.f, 1.f);
+			}
+			else {
+				const float* meterBuffer = module->meterBuffer();
+				internal->meterValues.resize(meterLength);
+				for (int i = 0; i < meterLength; i++) {
+					int index = math::eucMod(meterIndex + i + 1, meterLength);
+					internal->meterValues[i] = math::clamp(meterBuffer[index] * sampleRate, 0.f, 1.f);
+				}
+				latestValue = meterBuffer[meterIndex];
+			}
+
+			float percent = latestValue * sampleRate * 100.f;
+			// float microseconds = meterBuffer[meterIndex] * 1e6f;
+			internal->meterText = string::f("%.1f", percent);
+			// Only append "%" if wider than 2 HP
+			if (box.getWidth() > RACK_GRID_WIDTH * 2)
+				internal->meterText += "%";
+#ifdef CARDINAL_MODULE_MEMORY
+			// Heap memory of the module next to its CPU usage, where there is room for it
+			if (box.getWidth() > RACK_GRID_WIDTH * 4) {
+				const double bytes = modulemem::getModuleBytes(module);
+				if (bytes >= 1024.0 * 1024.0)
+					internal->meterText += string::f(" %.1fM", bytes / (1024.0 * 1024.0));
+				else
+					internal->meterText += string::f(" %.0fK", bytes / 1024.0);
+			}
+#endif
+			internal->meterTextWidth = bndLabelWidth(args.vg, -1, internal->meterText.c_str());
+		}
+		if (sampled)
+			meterLength = internal->meterValues.size();
 
 		// // Text background
 		// nvgBeginPath(args.vg);
@@ -259,10 +427,8 @@ void ModuleWidget::draw(const DrawArgs& args) {
 		nvgBeginPath(args.vg);
 		nvgMoveTo(args.vg, 0.0, plotHeight);
 		math::Vec p1;
-		for (int i = 0; i < meterLength; i++) {
-			int index = math::eucMod(meterIndex + i + 1, meterLength);
-			float meter = math::clamp(meterBuffer[index] * sampleRate, 0.f, 1.f);
-			meter = std::max(0.f, meter);
+		for (int i = 0; i < (int) internal->meterValues.size(); i++) {
+			const float meter = internal->meterValues[i];
 			math::Vec p;
 			p.x = (float) i / (meterLength - 1) * box.size.x;
 			p.y = (1.f - meter) * plotHeight;
@@ -290,16 +456,51 @@ void ModuleWidget::draw(const DrawArgs& args) {
 		bndMenuBackground(args.vg, 0.0, plotHeight, box.size.x, BND_WIDGET_HEIGHT, BND_CORNER_ALL);
 
 		// Text
-		float percent = meterBuffer[meterIndex] * sampleRate * 100.f;
-		// float microseconds = meterBuffer[meterIndex] * 1e6f;
-		std::string meterText = string::f("%.1f", percent);
-		// Only append "%" if wider than 2 HP
-		if (box.getWidth() > RACK_GRID_WIDTH * 2)
-			meterText += "%";
 		math::Vec pt;
-		pt.x = box.size.x - bndLabelWidth(args.vg, -1, meterText.c_str()) + 3;
+		pt.x = box.size.x - internal->meterTextWidth + 3;
 		pt.y = plotHeight + 0.5;
-		bndMenuLabel(args.vg, VEC_ARGS(pt), INFINITY, BND_WIDGET_HEIGHT, -1, meterText.c_str());
+		bndMenuLabel(args.vg, VEC_ARGS(pt), INFINITY, BND_WIDGET_HEIGHT, -1, internal->meterText.c_str());
+	}
+
+	// Cable activity over the outputs, only where polyphony or audio rate updates are wasted
+	if (module && settings::cableActivity) {
+		const double time = system::getTime();
+		if (time - internal->activityUpdateTime >= 0.1) {
+			internal->activityUpdateTime = time;
+			internal->activityLabels.clear();
+			for (PortWidget* pw : getOutputs()) {
+				int channels, activeChannels;
+				float changeRate;
+				if (!engine::Engine_getOutputActivity(APP->engine, module, pw->portId, channels, activeChannels, changeRate))
+					continue;
+				std::string text;
+				if (activeChannels < channels)
+					text = string::f("%d/%d", activeChannels, channels);
+				if (changeRate == 0.f)
+					text += text.empty() ? "const" : " const";
+				if (!text.empty())
+					internal->activityLabels.push_back({pw->getRelativeOffset(pw->box.size.div(2), this), text});
+			}
+		}
+		for (const Internal::ActivityLabel& label : internal->activityLabels) {
+			const float width = bndLabelWidth(args.vg, -1, label.text.c_str());
+			const math::Vec pt = label.pos.minus(math::Vec(width / 2, BND_WIDGET_HEIGHT / 2));
+			bndMenuBackground(args.vg, VEC_ARGS(pt), width, BND_WIDGET_HEIGHT, BND_CORNER_ALL);
+			bndMenuLabel(args.vg, VEC_ARGS(pt), width, BND_WIDGET_HEIGHT, -1, label.text.c_str());
+		}
+	}
+
+	// Preset loading progress
+	if (internal->presetLoad) {
+		const float progress = math::clamp(internal->presetLoad->progress.load(), 0.f, 1.f);
+		nvgBeginPath(args.vg);
+		nvgRect(args.vg, 0.0, box.size.y - 4, box.size.x, 4);
+		nvgFillColor(args.vg, nvgRGBAf(0, 0, 0, 0.5));
+		nvgFill(args.vg);
+		nvgBeginPath(args.vg);
+		nvgRect(args.vg, 0.0, box.size.y - 4, box.size.x * progress, 4);
+		nvgFillColor(args.vg, componentlibrary::SCHEME_ORANGE);
+		nvgFill(args.vg);
 	}
 
 	// Selection
@@ -317,6 +518,10 @@ void ModuleWidget::draw(const DrawArgs& args) {
 }
 
 void ModuleWidget::drawLayer(const DrawArgs& args, int layer) {
+	// No shadow nor light halos, lights are part of the low detail layer 0
+	if (isLowDetail(args))
+		return;
+
 	if (layer == -1) {
 		nvgBeginPath(args.vg);
 		float r = 20; // Blur radius
@@ -622,24 +827,131 @@ void ModuleWidget::load(std::string filename) {
 	fromJson(moduleJ);
 }
 
-void ModuleWidget::loadAction(std::string filename) {
-	// history::ModuleChange
-	history::ModuleChange* h = new history::ModuleChange;
-	h->name = "load module preset";
-	h->moduleId = module->id;
-	h->oldModuleJ = toJson();
+static void runPresetLoad(PresetLoad* load, engine::Module* module) {
+	DEFER({load->finished = true;});
 
-	try {
-		load(filename);
+	FILE* file = std::fopen(load->filename.c_str(), "r");
+	if (!file) {
+		load->error = string::f("Could not load patch file %s", load->filename.c_str());
+		return;
 	}
-	catch (Exception& e) {
-		delete h;
-		throw;
+	DEFER({std::fclose(file);});
+
+	INFO("Loading preset %s", load->filename.c_str());
+
+	json_error_t error;
+	json_t* moduleJ = json_loadf(file, 0, &error);
+	if (!moduleJ) {
+		load->error = string::f("File is not a valid patch file. JSON parsing error at %s %d:%d %s", error.source, error.line, error.column, error.text);
+		return;
 	}
 
-	// TODO We can use `moduleJ` here instead to save a toJson() call.
-	h->newModuleJ = toJson();
-	APP->history->push(h);
+	engine::Module::jsonStripIds(moduleJ);
+
+	if (engine::ModulePresetLoad* const presetLoadModule = dynamic_cast<engine::ModulePresetLoad*>(module)) {
+		try {
+			presetLoadModule->preparePresetLoad(moduleJ, load->progress);
+		}
+		catch (Exception& e) {
+			load->error = e.what();
+			json_decref(moduleJ);
+			return;
+		}
+	}
+
+	load->progress = 1.f;
+	load->moduleJ = moduleJ;
+}
+
+static void releasePresetLoad(ModuleWidget* mw, PresetLoad* load) {
+	{
+		std::lock_guard<std::mutex> lock(presetLoadsMutex);
+		presetLoads.erase(std::remove(presetLoads.begin(), presetLoads.end(), load), presetLoads.end());
+	}
+	mw->internal->presetLoad = NULL;
+	load->thread.join();
+}
+
+static void cancelPresetLoad(ModuleWidget* mw) {
+	PresetLoad* const load = mw->internal->presetLoad;
+	if (!load)
+		return;
+	releasePresetLoad(mw, load);
+
+	if (load->moduleJ) {
+		if (engine::ModulePresetLoad* const presetLoadModule = dynamic_cast<engine::ModulePresetLoad*>(mw->module))
+			presetLoadModule->cancelPresetLoad();
+		json_decref(load->moduleJ);
+	}
+	delete load;
+}
+
+void ModuleWidget::loadAction(std::string filename) {
+	// Only the latest preset gets applied
+	cancelPresetLoad(this);
+
+	PresetLoad* const load = new PresetLoad;
+	load->context = APP;
+	load->moduleWidget = this;
+	load->filename = filename;
+	// Start the thread before others can see the load, so they can safely join it
+	engine::Module* const m = module;
+	load->thread = std::thread([load, m]() {
+		system::setThreadName("Preset loader");
+		runPresetLoad(load, m);
+	});
+	internal->presetLoad = load;
+
+	std::lock_guard<std::mutex> lock(presetLoadsMutex);
+	presetLoads.push_back(load);
+}
+
+/** Applies the presets finished loading in the background, at a point where the module widgets are not in use.
+Called by the scene every frame.
+*/
+void ModuleWidget_finishPresetLoads() {
+	std::vector<PresetLoad*> finishedLoads;
+	{
+		std::lock_guard<std::mutex> lock(presetLoadsMutex);
+		for (PresetLoad* load : presetLoads) {
+			if (load->context == APP && load->finished)
+				finishedLoads.push_back(load);
+		}
+	}
+
+	for (PresetLoad* load : finishedLoads) {
+		ModuleWidget* const mw = load->moduleWidget;
+		releasePresetLoad(mw, load);
+		DEFER({
+			json_decref(load->moduleJ);
+			delete load;
+		});
+
+		if (!load->moduleJ) {
+			async_dialog_message(load->error.c_str());
+			continue;
+		}
+
+		// history::ModuleChange
+		history::ModuleChange* h = new history::ModuleChange;
+		h->name = "load module preset";
+		h->moduleId = mw->module->id;
+		h->oldModuleJ = mw->toJson();
+
+		try {
+			mw->fromJson(load->moduleJ);
+		}
+		catch (Exception& e) {
+			delete h;
+			if (engine::ModulePresetLoad* const presetLoadModule = dynamic_cast<engine::ModulePresetLoad*>(mw->module))
+				presetLoadModule->cancelPresetLoad();
+			async_dialog_message(e.what());
+			continue;
+		}
+
+		h->newModuleJ = mw->toJson();
+		APP->history->push(h);
+	}
 }
 
 void ModuleWidget::loadTemplate() {
@@ -856,7 +1168,9 @@ void ModuleWidget::cloneAction(bool cloneCables) {
 
 	// Clone Module
 	INFO("Creating module %s", model->getFullName().c_str());
+	modulemem::beginConstruction(model);
 	engine::Module* clonedModule = model->createModule();
+	modulemem::endConstruction(clonedModule);
 
 	// Set ID here so we can copy module storage dir
 	clonedModule->id = random::u64() % (1ull << 53);
@@ -864,11 +1178,15 @@ void ModuleWidget::cloneAction(bool cloneCables) {
 
 	// This doesn't need a lock (via Engine::moduleFromJson()) because the Module is not added to the Engine yet.
 	try {
+		const modulemem::Scope memoryScope(clonedModule);
 		clonedModule->fromJson(moduleJ);
 	}
 	catch (Exception& e) {
 		WARN("%s", e.what());
 	}
+
+	// Add the module and its cables under a single engine lock
+	engine::Engine_beginEdits(APP->engine);
 	APP->engine->addModule(clonedModule);
 
 	// Clone ModuleWidget
@@ -920,6 +1238,8 @@ void ModuleWidget::cloneAction(bool cloneCables) {
 		}
 	}
 
+	engine::Engine_endEdits(APP->engine);
+
 	APP->history->push(h);
 }
 
@@ -938,6 +1258,9 @@ void ModuleWidget::bypassAction(bool bypassed) {
 }
 
 void ModuleWidget::removeAction() {
+	// Remove the cables and the module under a single engine lock
+	engine::Engine_beginEdits(APP->engine);
+
 	history::ComplexAction* h = new history::ComplexAction;
 	h->name = "delete module";
 
@@ -962,42 +1285,165 @@ void ModuleWidget::removeAction() {
 	delete this;
 
 	APP->scene->rack->updateExpanders();
+
+	engine::Engine_endEdits(APP->engine);
+}
+
+
+/** Factory presets of each model, keyed by preset directory, so that context menus do not scan and sort directories every time.
+Built in the background for all models on first use, a directory is scanned again once its modification time changes.
+*/
+struct PresetIndex {
+	struct Preset {
+		std::string name;
+		std::string path;
+	};
+
+	struct Entry {
+		plugin::Model* model = NULL;
+		time_t mtime = 0;
+		std::vector<Preset> presets;
+	};
+
+	std::mutex mutex;
+	std::unordered_map<std::string, Entry> entries;
+	std::atomic<bool> started{false};
+	std::atomic<bool> stopping{false};
+	std::thread thread;
+
+	~PresetIndex() {
+		stopping = true;
+		if (thread.joinable())
+			thread.join();
+	}
+};
+
+static PresetIndex presetIndex;
+
+
+static bool getPresetDirectoryTime(const std::string& presetDir, time_t& mtime) {
+	struct stat st;
+	if (stat(presetDir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+		return false;
+	mtime = st.st_mtime;
+	return true;
+}
+
+
+static std::vector<PresetIndex::Preset> scanPresetDirectory(const std::string& presetDir) {
+	std::vector<PresetIndex::Preset> presets;
+	std::vector<std::string> entries;
+	try {
+		entries = system::getEntries(presetDir);
+	}
+	catch (Exception& e) {
+		WARN("%s", e.what());
+		return presets;
+	}
+	std::sort(entries.begin(), entries.end());
+
+	// Remove "1_", "42_", "001_", etc at the beginning of preset filenames
+	static const std::regex r("^\\d+_");
+
+	for (const std::string& path : entries) {
+		if (system::getExtension(path) != ".vcvm")
+			continue;
+		std::string name = std::regex_replace(system::getStem(path), r, "");
+		if (name == "template")
+			continue;
+		presets.push_back({name, path});
+	}
+	return presets;
+}
+
+
+static void updatePresetIndex(plugin::Model* model, const std::string& presetDir, time_t mtime, std::vector<PresetIndex::Preset>* presets) {
+	std::vector<PresetIndex::Preset> scannedPresets = scanPresetDirectory(presetDir);
+	if (presets)
+		*presets = scannedPresets;
+
+	std::lock_guard<std::mutex> lock(presetIndex.mutex);
+	PresetIndex::Entry& entry = presetIndex.entries[presetDir];
+	entry.model = model;
+	entry.mtime = mtime;
+	entry.presets = std::move(scannedPresets);
+}
+
+
+static void startPresetIndex() {
+	if (presetIndex.started.exchange(true))
+		return;
+
+	// Directories are collected here so that the thread never touches models
+	std::vector<std::pair<plugin::Model*, std::string>> presetDirs;
+	for (plugin::Plugin* plugin : plugin::plugins) {
+		for (plugin::Model* model : plugin->models)
+			presetDirs.emplace_back(model, model->getFactoryPresetDirectory());
+	}
+
+	presetIndex.thread = std::thread([presetDirs]() {
+		for (const std::pair<plugin::Model*, std::string>& presetDir : presetDirs) {
+			if (presetIndex.stopping)
+				return;
+
+			time_t mtime;
+			if (!getPresetDirectoryTime(presetDir.second, mtime))
+				continue;
+
+			{
+				std::lock_guard<std::mutex> lock(presetIndex.mutex);
+				auto it = presetIndex.entries.find(presetDir.second);
+				if (it != presetIndex.entries.end() && it->second.mtime == mtime)
+					continue;
+			}
+
+			updatePresetIndex(presetDir.first, presetDir.second, mtime, NULL);
+		}
+	});
+}
+
+
+static std::vector<PresetIndex::Preset> getPresets(plugin::Model* model, const std::string& presetDir) {
+	startPresetIndex();
+
+	std::vector<PresetIndex::Preset> presets;
+	time_t mtime;
+	if (!getPresetDirectoryTime(presetDir, mtime))
+		return presets;
+
+	{
+		std::lock_guard<std::mutex> lock(presetIndex.mutex);
+		auto it = presetIndex.entries.find(presetDir);
+		if (it != presetIndex.entries.end() && it->second.mtime == mtime)
+			return it->second.presets;
+	}
+
+	// Not indexed yet or changed since
+	updatePresetIndex(model, presetDir, mtime, &presets);
+	return presets;
 }
 
 
 // Create ModulePresetPathItems for each patch in a directory.
 static void appendPresetItems(ui::Menu* menu, WeakPtr<ModuleWidget> moduleWidget, std::string presetDir) {
-	bool hasPresets = false;
-	if (system::isDirectory(presetDir)) {
-		// Note: This is not cached, so opening this menu each time might have a bit of latency.
-		std::vector<std::string> entries = system::getEntries(presetDir);
-		std::sort(entries.begin(), entries.end());
-		for (std::string path : entries) {
-			std::string name = system::getStem(path);
-			// Remove "1_", "42_", "001_", etc at the beginning of preset filenames
-			std::regex r("^\\d+_");
-			name = std::regex_replace(name, r, "");
-
-			if (false) {
+	const std::vector<PresetIndex::Preset> presets = getPresets(moduleWidget->model, presetDir);
+	if (presets.empty())
+		return;
+
+	menu->addChild(new ui::MenuSeparator);
+
+	for (const PresetIndex::Preset& preset : presets) {
+		const std::string path = preset.path;
+		menu->addChild(createMenuItem(preset.name, "", [=]() {
+			if (!moduleWidget)
+				return;
+			try {
+				moduleWidget->loadAction(path);
 			}
-			else if (system::getExtension(path) == ".vcvm" && name != "template") {
-				if (!hasPresets)
-					menu->addChild(new ui::MenuSeparator);
-
-				hasPresets = true;
-
-				menu->addChild(createMenuItem(name, "", [=]() {
-					if (!moduleWidget)
-						return;
-					try {
-						moduleWidget->loadAction(path);
-					}
-					catch (Exception& e) {
-						async_dialog_message(e.what());
-					}
-				}));
+			catch (Exception& e) {
+				async_dialog_message(e.what());
 			}
-		}
+		}));
 	}
 };
 
@@ -1159,3 +1605,44 @@ engine::Module* ModuleWidget::releaseModule() {
 
 } // namespace app
 } // namespace rack
+
+
+namespace patchUtils {
+
+
+std::vector<std::pair<rack::plugin::Model*, std::string>> searchPresets(const std::string& query) {
+	using namespace rack;
+	using namespace rack::app;
+
+	startPresetIndex();
+
+	// Every word must be found in the preset or module name
+	std::vector<std::string> words = string::split(string::lowercase(query), " ");
+	words.erase(std::remove(words.begin(), words.end(), ""), words.end());
+
+	std::vector<std::pair<plugin::Model*, std::string>> results;
+
+	std::lock_guard<std::mutex> lock(presetIndex.mutex);
+	for (const auto& it : presetIndex.entries) {
+		const PresetIndex::Entry& entry = it.second;
+		const std::string modelName = string::lowercase(entry.model->name);
+
+		for (const PresetIndex::Preset& preset : entry.presets) {
+			const std::string presetName = string::lowercase(preset.name);
+			bool matches = true;
+			for (const std::string& word : words) {
+				if (presetName.find(word) == std::string::npos && modelName.find(word) == std::string::npos) {
+					matches = false;
+					break;
+				}
+			}
+			if (matches)
+				results.emplace_back(entry.model, preset.path);
+		}
+	}
+
+	return results;
+}
+
+
+} // namespace patchUtils
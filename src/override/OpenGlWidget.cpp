@@ -34,7 +34,7 @@ namespace widget {
 
 
 void OpenGlWidget::step() {
-	// Render every frame
+	// Render every frame, Cardinal's own OpenGL widgets choose how often through their animation mode instead
 	dirty = true;
 	FramebufferWidget::step();
 }
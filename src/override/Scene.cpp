@@ -25,16 +25,26 @@
  * the License, or (at your option) any later version.
  */
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
 #include <thread>
+#include <vector>
 
 #include <osdialog.h>
 
 #include <app/Scene.hpp>
 #include <app/Browser.hpp>
+#include <app/CableWidget.hpp>
 #include <app/TipWindow.hpp>
 #include <app/MenuBar.hpp>
+#include <app/ModuleWidget.hpp>
+#include <app/OffscreenStepping.hpp>
+#include <app/RackWidget.hpp>
 #include <context.hpp>
 #include <engine/Engine.hpp>
+#include <engine/UiSnapshot.hpp>
 #include <system.hpp>
 #include <network.hpp>
 #include <history.hpp>
@@ -60,9 +70,71 @@
 
 
 namespace rack {
+
+#ifndef HEADLESS
+namespace engine {
+void Engine_stepTerminalPlugLights(Engine*, float deltaTime);
+void Engine_setModuleMetersEnabled(Engine*, bool enabled);
+void Engine_setCableStatsEnabled(Engine*, bool enabled);
+}
+#endif
+namespace engine {
+const UiSnapshot* Engine_getUiSnapshot(Engine*);
+}
+
 namespace app {
 
 
+// Cardinal specific API, declared as needed in other files
+void ModuleWidget_finishPresetLoads();
+bool ModuleWidget_isLowDetail(float scale);
+
+
+/** Cables as thin straight lines, one stroke per color, shown instead of the cable container at low zoom.
+*/
+struct LowDetailCables : widget::TransparentWidget {
+	struct Line {
+		NVGcolor color;
+		math::Vec from, to;
+	};
+	std::vector<Line> lines;
+
+	void draw(const DrawArgs& args) override {
+		lines.clear();
+		for (widget::Widget* const w : APP->scene->rack->getCableContainer()->children) {
+			CableWidget* const cw = dynamic_cast<CableWidget*>(w);
+			if (cw == nullptr || !(cw->inputPort || cw->outputPort))
+				continue;
+			lines.push_back({cw->color, cw->getOutputPos(), cw->getInputPos()});
+		}
+		if (lines.empty())
+			return;
+
+		std::sort(lines.begin(), lines.end(), [](const Line& a, const Line& b) {
+			return std::memcmp(&a.color, &b.color, sizeof(NVGcolor)) < 0;
+		});
+
+		float xform[6];
+		nvgCurrentTransform(args.vg, xform);
+		const float scale = std::hypot(xform[0], xform[1]);
+
+		nvgLineCap(args.vg, NVG_ROUND);
+		nvgStrokeWidth(args.vg, 1.5f / scale);
+
+		for (size_t i = 0; i < lines.size();) {
+			const NVGcolor color = lines[i].color;
+			nvgBeginPath(args.vg);
+			for (; i < lines.size() && std::memcmp(&lines[i].color, &color, sizeof(NVGcolor)) == 0; ++i) {
+				nvgMoveTo(args.vg, VEC_ARGS(lines[i].from));
+				nvgLineTo(args.vg, VEC_ARGS(lines[i].to));
+			}
+			nvgStrokeColor(args.vg, color::alpha(color, settings::cableOpacity));
+			nvgStroke(args.vg);
+		}
+	}
+};
+
+
 struct ResizeHandle : widget::OpaqueWidget {
 	math::Vec size;
 
@@ -131,6 +203,11 @@ struct Scene::Internal {
 
 	bool heldArrowKeys[4] = {};
 
+	// module widgets hidden while the scene steps, as they are out of view
+	std::vector<ModuleWidget*> offscreenModuleWidgets;
+
+	LowDetailCables* lowDetailCables = nullptr;
+
 #ifdef HAVE_LIBLO
 	double lastSceneChangeTime = 0.0;
 	int historyActionIndex = -1;
@@ -139,6 +216,148 @@ struct Scene::Internal {
 	bool oscConnected = false;
 	lo_server oscServer = nullptr;
 
+	// Patch state last deployed to the remote, so auto-deploy only sends what changed
+	struct RemoteModule {
+		std::vector<float> params;
+		// module JSON without params
+		std::string json;
+	};
+	bool remoteSynced = false;
+	std::map<int64_t, RemoteModule> remoteModules;
+	std::map<int64_t, std::string> remoteCables;
+
+	// Full patch archive being sent in chunks, each one is resent until acknowledged
+	enum ChunkState : uint8_t {
+		kChunkPending,
+		kChunkInFlight,
+		kChunkAcked,
+	};
+	struct RemoteTransfer {
+		int64_t hash = 0;
+		std::vector<uint8_t> data;
+		std::vector<ChunkState> chunks;
+		uint32_t numAcked = 0;
+		uint32_t numRetries = 0;
+		double lastSendTime = 0.0;
+	} remoteTransfer;
+
+	void sendRemoteChunks() {
+		static constexpr const uint32_t kMaxChunksInFlight = 32;
+
+		RemoteTransfer& transfer(remoteTransfer);
+		const uint32_t numChunks = transfer.chunks.size();
+
+		uint32_t numInFlight = 0;
+		for (const ChunkState state : transfer.chunks)
+			numInFlight += state == kChunkInFlight;
+
+		const lo_address addr = lo_address_new_with_proto(LO_UDP, REMOTE_HOST, REMOTE_HOST_PORT);
+		DISTRHO_SAFE_ASSERT_RETURN(addr != nullptr,);
+
+		for (uint32_t i = 0; i < numChunks && numInFlight < kMaxChunksInFlight; ++i) {
+			if (transfer.chunks[i] != kChunkPending)
+				continue;
+
+			const size_t offset = i * REMOTE_CHUNK_SIZE;
+			const size_t size = std::min<size_t>(REMOTE_CHUNK_SIZE, transfer.data.size() - offset);
+
+			if (const lo_blob blob = lo_blob_new(size, transfer.data.data() + offset)) {
+				// sent from our server so that acks come back to it
+				lo_send_from(addr, oscServer, LO_TT_IMMEDIATE, "/load/chunk", "hiib",
+				             transfer.hash, (int32_t)i, (int32_t)numChunks, blob);
+				lo_blob_free(blob);
+			}
+
+			transfer.chunks[i] = kChunkInFlight;
+			++numInFlight;
+		}
+
+		lo_address_free(addr);
+
+		transfer.lastSendTime = system::getTime();
+	}
+
+	// Streams param changes since the last deploy, one bundle per frame
+	void sendRemoteParamChanges() {
+		if (!remoteSynced || remoteTransfer.numAcked != remoteTransfer.chunks.size())
+			return;
+
+		// Param values of the last engine block, without locking the engine for every module
+		const engine::UiSnapshot* const snapshot = engine::Engine_getUiSnapshot(APP->engine);
+		if (snapshot == nullptr)
+			return;
+
+		const lo_address addr = lo_address_new_with_proto(LO_UDP, REMOTE_HOST, REMOTE_HOST_PORT);
+		DISTRHO_SAFE_ASSERT_RETURN(addr != nullptr,);
+
+		lo_bundle bundle = nullptr;
+
+		for (size_t m = 0; m < snapshot->moduleIds.size(); ++m) {
+			const auto it = remoteModules.find(snapshot->moduleIds[m]);
+			if (it == remoteModules.end())
+				continue;
+
+			size_t paramCount;
+			const float* const params = snapshot->getParams(m, paramCount);
+			if (paramCount != it->second.params.size())
+				continue;
+
+			for (size_t i = 0; i < paramCount; ++i) {
+				const float value = params[i];
+				if (d_isEqual(it->second.params[i], value))
+					continue;
+				it->second.params[i] = value;
+
+				const lo_message msg = lo_message_new();
+				lo_message_add_int64(msg, it->first);
+				lo_message_add_int32(msg, i);
+				lo_message_add_float(msg, value);
+
+				if (bundle != nullptr && lo_bundle_length(bundle) + lo_message_length(msg, "/param") > REMOTE_CHUNK_SIZE) {
+					lo_send_bundle_from(addr, oscServer, bundle);
+					lo_bundle_free_recursive(bundle);
+					bundle = nullptr;
+				}
+
+				if (bundle == nullptr)
+					bundle = lo_bundle_new(LO_TT_IMMEDIATE);
+
+				lo_bundle_add_message(bundle, "/param", msg);
+			}
+		}
+
+		if (bundle != nullptr) {
+			lo_send_bundle_from(addr, oscServer, bundle);
+			lo_bundle_free_recursive(bundle);
+		}
+
+		lo_address_free(addr);
+	}
+
+	void stepRemoteTransfer() {
+		RemoteTransfer& transfer(remoteTransfer);
+
+		if (transfer.chunks.empty() || transfer.numAcked == transfer.chunks.size())
+			return;
+		if (system::getTime() - transfer.lastSendTime < 0.5)
+			return;
+
+		if (++transfer.numRetries > 20) {
+			d_stderr("Remote did not acknowledge the patch, giving up");
+			transfer.chunks.clear();
+			transfer.data.clear();
+			remoteSynced = false;
+			return;
+		}
+
+		for (ChunkState& state : transfer.chunks) {
+			if (state == kChunkInFlight)
+				state = kChunkPending;
+		}
+
+		sendRemoteChunks();
+	}
+
 	static int osc_handler(const char* const path, const char* const types, lo_arg** argv, const int argc, lo_message, void* const self)
 	{
 		d_stdout("osc_handler(\"%s\", \"%s\", %p, %i)", path, types, argv, argc);
@@ -147,6 +366,42 @@ struct Scene::Internal {
 			d_stdout("osc_handler(\"%s\", ...) - got resp | '%s' '%s'", path, &argv[0]->s, &argv[1]->s);
 			if (std::strcmp(&argv[0]->s, "hello") == 0 && std::strcmp(&argv[1]->s, "ok") == 0)
 				static_cast<Internal*>(self)->oscConnected = true;
+			// Send the full patch next time if the remote could not load the last one
+			else if (std::strcmp(&argv[0]->s, "load") == 0 || std::strcmp(&argv[0]->s, "patch") == 0)
+				static_cast<Internal*>(self)->remoteSynced &= std::strcmp(&argv[1]->s, "ok") == 0;
+		}
+		else if (std::strcmp(path, "/lights") == 0 && argc == 2 && types[0] == 'h' && types[1] == 'b') {
+			// [u16 light id, u8 brightness] triplets of lights that changed on the remote
+			engine::Module* const module = APP->engine->getModule(argv[0]->h);
+			if (module == nullptr)
+				return 0;
+
+			const int32_t size = argv[1]->blob.size;
+			const uint8_t* const data = (uint8_t*)(&argv[1]->blob.data);
+
+			for (int32_t i = 0; i + 2 < size; i += 3) {
+				const uint16_t lightId = data[i] | (data[i + 1] << 8);
+				if (lightId < module->lights.size())
+					module->lights[lightId].setBrightness(data[i + 2] / 255.f);
+			}
+		}
+		else if (std::strcmp(path, "/resp/chunk") == 0 && argc == 2 && types[0] == 'h' && types[1] == 'i') {
+			Internal* const internal = static_cast<Internal*>(self);
+			RemoteTransfer& transfer(internal->remoteTransfer);
+			const int32_t index = argv[1]->i;
+
+			if (argv[0]->h != transfer.hash || index < 0 || static_cast<size_t>(index) >= transfer.chunks.size())
+				return 0;
+			if (transfer.chunks[index] == kChunkAcked)
+				return 0;
+
+			transfer.chunks[index] = kChunkAcked;
+			transfer.numRetries = 0;
+
+			if (++transfer.numAcked != transfer.chunks.size())
+				internal->sendRemoteChunks();
+			else
+				transfer.data.clear();
 		}
 		return 0;
 	}
@@ -166,6 +421,11 @@ Scene::Scene() {
 
 	rack = rackScroll->rackWidget;
 
+	// over all the rack containers, module widgets included
+	internal->lowDetailCables = new LowDetailCables;
+	internal->lowDetailCables->hide();
+	rack->addChild(internal->lowDetailCables);
+
 	menuBar = createMenuBar();
 	addChild(menuBar);
 
@@ -193,6 +453,14 @@ math::Vec Scene::getMousePos() {
 
 
 void Scene::step() {
+	ModuleWidget_finishPresetLoads();
+#ifndef HEADLESS
+	engine::Engine_stepTerminalPlugLights(APP->engine, APP->window->getLastFrameDuration());
+	// Exact meters come from Rack's own per module buffers, which do not need these
+	engine::Engine_setModuleMetersEnabled(APP->engine, settings::sampledCpuMeter && !settings::cpuMeter);
+	engine::Engine_setCableStatsEnabled(APP->engine, settings::cableActivity);
+#endif
+
 	if (APP->window->isFullScreen()) {
 		// Expand RackScrollWidget to cover entire screen if fullscreen
 		rackScroll->box.pos.y = 0;
@@ -242,20 +510,54 @@ void Scene::step() {
 	if (internal->oscServer != nullptr) {
 		while (lo_server_recv_noblock(internal->oscServer, 0) != 0) {}
 
+		internal->stepRemoteTransfer();
+		internal->sendRemoteParamChanges();
+
 		if (internal->oscAutoDeploy) {
 			const int actionIndex = APP->history->actionIndex;
 			const double time = system::getTime();
 			if (internal->historyActionIndex != actionIndex && time - internal->lastSceneChangeTime >= 5.0) {
 				internal->historyActionIndex = actionIndex;
 				internal->lastSceneChangeTime = time;
-				patchUtils::deployToRemote();
+				patchUtils::deployChangesToRemote();
 				window::generateScreenshot();
 			}
 		}
 	}
 #endif
 
+	// Skip stepping module widgets that are out of view, hiding them until the step is done
+	// All module widgets share the module container, so the view is mapped into its coordinates once
+	// instead of walking up the widget tree for every module.
+	std::vector<ModuleWidget*>& offscreen(internal->offscreenModuleWidgets);
+	widget::Widget* const moduleContainer = rack->getModuleContainer();
+	const float zoom = rack->getAbsoluteZoom();
+
+	// Cables drawn as plain lines in low detail, the same zoom at which module widgets simplify themselves.
+	// The hidden cable container is not stepped either, its plugs follow once the view zooms in again
+	const bool lowDetail = ModuleWidget_isLowDetail(zoom * APP->window->pixelRatio);
+	rack->getCableContainer()->setVisible(!lowDetail);
+	internal->lowDetailCables->setVisible(lowDetail);
+	internal->lowDetailCables->box = rack->box.zeroPos();
+	const math::Vec containerOffset = moduleContainer->getAbsoluteOffset(math::Vec());
+	const math::Rect viewBox(rackScroll->box.pos.minus(containerOffset).div(zoom), rackScroll->box.size.div(zoom));
+	for (widget::Widget* const w : moduleContainer->children) {
+		ModuleWidget* const mw = static_cast<ModuleWidget*>(w);
+		if (!mw->visible)
+			continue;
+		if (mw->box.intersects(viewBox))
+			continue;
+		if (dynamic_cast<OffscreenStepping*>(mw) != nullptr)
+			continue;
+		mw->visible = false;
+		offscreen.push_back(mw);
+	}
+
 	Widget::step();
+
+	for (ModuleWidget* const mw : offscreen)
+		mw->visible = true;
+	offscreen.clear();
 }
 
 
@@ -348,7 +650,7 @@ void Scene::onHoverKey(const HoverKeyEvent& e) {
 			e.consume(this);
 		}
 		if (e.key == GLFW_KEY_F3 && (e.mods & RACK_MOD_MASK) == 0) {
-			settings::cpuMeter ^= true;
+			settings::sampledCpuMeter ^= true;
 			e.consume(this);
 		}
 		if (e.key == GLFW_KEY_F7 && (e.mods & RACK_MOD_MASK) == 0) {
@@ -408,19 +710,19 @@ void Scene::onHoverKey(const HoverKeyEvent& e) {
 		}
 		if (e.keyName == "d" && (e.mods & RACK_MOD_MASK) == RACK_MOD_CTRL) {
 			if (rack->hasSelection()) {
-				rack->cloneSelectionAction(false);
+				patchUtils::cloneSelectionAction(false);
 				e.consume(this);
 			}
 		}
 		if (e.keyName == "d" && (e.mods & RACK_MOD_MASK) == (RACK_MOD_CTRL | GLFW_MOD_SHIFT)) {
 			if (rack->hasSelection()) {
-				rack->cloneSelectionAction(true);
+				patchUtils::cloneSelectionAction(true);
 				e.consume(this);
 			}
 		}
 		if ((e.key == GLFW_KEY_DELETE || e.key == GLFW_KEY_BACKSPACE) && (e.mods & RACK_MOD_MASK) == 0) {
 			if (rack->hasSelection()) {
-				rack->deleteSelectionAction();
+				patchUtils::deleteSelectionAction();
 				e.consume(this);
 			}
 		}
@@ -502,14 +804,19 @@ bool connectToRemote() {
 		const lo_server oscServer = lo_server_new_with_proto(nullptr, LO_UDP, nullptr);
 		DISTRHO_SAFE_ASSERT_RETURN(oscServer != nullptr, false);
 		lo_server_add_method(oscServer, "/resp", nullptr, rack::app::Scene::Internal::osc_handler, internal);
+		lo_server_add_method(oscServer, "/resp/chunk", "hi", rack::app::Scene::Internal::osc_handler, internal);
+		lo_server_add_method(oscServer, "/lights", "hb", rack::app::Scene::Internal::osc_handler, internal);
 		internal->oscServer = oscServer;
 	}
 
 	const lo_address addr = lo_address_new_with_proto(LO_UDP, REMOTE_HOST, REMOTE_HOST_PORT);
 	DISTRHO_SAFE_ASSERT_RETURN(addr != nullptr, false);
-	lo_send(addr, "/hello", "");
+	// sent from our server so that responses and telemetry come back to it
+	lo_send_from(addr, internal->oscServer, LO_TT_IMMEDIATE, "/hello", "");
 	lo_address_free(addr);
 
+	internal->remoteSynced = false;
+
 	return true;
 #else
 	return false;
@@ -542,22 +849,150 @@ void setRemoteAutoDeploy(bool autoDeploy) {
 }
 
 
+#ifdef HAVE_LIBLO
+static void collectRemoteState(std::map<int64_t, rack::app::Scene::Internal::RemoteModule>& modules,
+                               std::map<int64_t, std::string>& cables) {
+	rack::engine::Engine* const engine = APP->engine;
+
+	for (const int64_t moduleId : engine->getModuleIds()) {
+		rack::engine::Module* const module = engine->getModule(moduleId);
+		DISTRHO_SAFE_ASSERT_CONTINUE(module != nullptr);
+
+		rack::app::Scene::Internal::RemoteModule& remoteModule(modules[moduleId]);
+		remoteModule.params.resize(module->params.size());
+		for (size_t i = 0; i < module->params.size(); ++i)
+			remoteModule.params[i] = module->params[i].getValue();
+
+		json_t* const moduleJ = engine->moduleToJson(module);
+		json_object_del(moduleJ, "params");
+		char* const json = json_dumps(moduleJ, JSON_COMPACT | JSON_SORT_KEYS);
+		remoteModule.json = json;
+		std::free(json);
+		json_decref(moduleJ);
+	}
+
+	for (const int64_t cableId : engine->getCableIds()) {
+		rack::engine::Cable* const cable = engine->getCable(cableId);
+		DISTRHO_SAFE_ASSERT_CONTINUE(cable != nullptr);
+
+		json_t* const cableJ = cable->toJson();
+		char* const json = json_dumps(cableJ, JSON_COMPACT | JSON_SORT_KEYS);
+		cables[cableId] = json;
+		std::free(json);
+		json_decref(cableJ);
+	}
+}
+#endif
+
+
 void deployToRemote() {
 #ifdef HAVE_LIBLO
-	const lo_address addr = lo_address_new_with_proto(LO_UDP, REMOTE_HOST, REMOTE_HOST_PORT);
-	DISTRHO_SAFE_ASSERT_RETURN(addr != nullptr,);
+	rack::app::Scene::Internal* const internal = APP->scene->internal;
+	DISTRHO_SAFE_ASSERT_RETURN(internal->oscServer != nullptr,);
 
 	APP->engine->prepareSave();
-	APP->patch->saveAutosave();
+	patchUtils::saveAutosave();
 	APP->patch->cleanAutosave();
-	std::vector<uint8_t> data(rack::system::archiveDirectory(APP->patch->autosavePath, 1));
 
-	if (const lo_blob blob = lo_blob_new(data.size(), data.data())) {
-		lo_send(addr, "/load", "b", blob);
-		lo_blob_free(blob);
+	// A new transfer replaces any unfinished one, the remote drops chunks of a different archive
+	rack::app::Scene::Internal::RemoteTransfer& transfer(internal->remoteTransfer);
+	transfer.data = patchUtils::archiveDirectory(APP->patch->autosavePath, REMOTE_COMPRESSION_LEVEL);
+	transfer.hash = patchUtils::hashRemoteData(transfer.data.data(), transfer.data.size());
+	transfer.chunks.assign((transfer.data.size() + REMOTE_CHUNK_SIZE - 1) / REMOTE_CHUNK_SIZE,
+	                       rack::app::Scene::Internal::kChunkPending);
+	transfer.numAcked = 0;
+	transfer.numRetries = 0;
+	internal->sendRemoteChunks();
+
+	internal->remoteModules.clear();
+	internal->remoteCables.clear();
+	collectRemoteState(internal->remoteModules, internal->remoteCables);
+	internal->remoteSynced = true;
+#endif
+}
+
+
+void deployChangesToRemote() {
+#ifdef HAVE_LIBLO
+	rack::app::Scene::Internal* const internal = APP->scene->internal;
+
+	// Changes must not reach the remote before the full patch they apply to
+	if (!internal->remoteSynced || internal->remoteTransfer.numAcked != internal->remoteTransfer.chunks.size())
+		return deployToRemote();
+
+	APP->engine->prepareSave();
+
+	std::map<int64_t, rack::app::Scene::Internal::RemoteModule> modules;
+	std::map<int64_t, std::string> cables;
+	collectRemoteState(modules, cables);
+
+	// Changed cables are removed and added again, removals are applied first on the remote
+	json_t* const removedCablesJ = json_array();
+	for (const auto& remoteCable : internal->remoteCables) {
+		const auto it = cables.find(remoteCable.first);
+		if (it == cables.end() || it->second != remoteCable.second)
+			json_array_append_new(removedCablesJ, json_integer(remoteCable.first));
 	}
 
-	lo_address_free(addr);
+	json_t* const removedModulesJ = json_array();
+	for (const auto& remoteModule : internal->remoteModules) {
+		if (modules.find(remoteModule.first) == modules.end())
+			json_array_append_new(removedModulesJ, json_integer(remoteModule.first));
+	}
+
+	// New or otherwise changed modules are sent whole, modules with only param changes as [moduleId, paramId, value]
+	json_t* const modulesJ = json_array();
+	json_t* const paramsJ = json_array();
+	for (const auto& module : modules) {
+		const auto it = internal->remoteModules.find(module.first);
+
+		if (it == internal->remoteModules.end()
+			|| it->second.json != module.second.json
+			|| it->second.params.size() != module.second.params.size()) {
+			json_t* const moduleJ = APP->engine->moduleToJson(APP->engine->getModule(module.first));
+			// position on the rack, as merged into patches by RackWidget
+			if (rack::app::ModuleWidget* const mw = APP->scene->rack->getModule(module.first)) {
+				const rack::math::Vec pos = mw->box.pos.minus(rack::app::RACK_OFFSET).div(rack::app::RACK_GRID_SIZE).round();
+				json_object_set_new(moduleJ, "pos", json_pack("[i, i]", (int)pos.x, (int)pos.y));
+			}
+			json_array_append_new(modulesJ, moduleJ);
+			continue;
+		}
+
+		for (size_t i = 0; i < module.second.params.size(); ++i) {
+			if (d_isNotEqual(it->second.params[i], module.second.params[i]))
+				json_array_append_new(paramsJ, json_pack("[I, i, f]", (json_int_t)module.first, (int)i, module.second.params[i]));
+		}
+	}
+
+	json_t* const cablesJ = json_array();
+	for (const auto& cable : cables) {
+		const auto it = internal->remoteCables.find(cable.first);
+		if (it == internal->remoteCables.end() || it->second != cable.second)
+			json_array_append_new(cablesJ, json_loads(cable.second.c_str(), 0, nullptr));
+	}
+
+	internal->remoteModules.swap(modules);
+	internal->remoteCables.swap(cables);
+
+	json_t* const rootJ = json_object();
+	json_object_set_new(rootJ, "removedCables", removedCablesJ);
+	json_object_set_new(rootJ, "removedModules", removedModulesJ);
+	json_object_set_new(rootJ, "modules", modulesJ);
+	json_object_set_new(rootJ, "params", paramsJ);
+	json_object_set_new(rootJ, "cables", cablesJ);
+
+	if (json_array_size(removedCablesJ) != 0 || json_array_size(removedModulesJ) != 0 || json_array_size(modulesJ) != 0
+		|| json_array_size(paramsJ) != 0 || json_array_size(cablesJ) != 0) {
+		if (const lo_address addr = lo_address_new_with_proto(LO_UDP, REMOTE_HOST, REMOTE_HOST_PORT)) {
+			char* const json = json_dumps(rootJ, JSON_COMPACT);
+			lo_send(addr, "/patch", "s", json);
+			std::free(json);
+			lo_address_free(addr);
+		}
+	}
+
+	json_decref(rootJ);
 #endif
 }
 
@@ -25,17 +25,30 @@
  * the License, or (at your option) any later version.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <queue>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include <window/Window.hpp>
 #include <asset.hpp>
+#include <widget/FramebufferWidget.hpp>
 #include <widget/Widget.hpp>
+#include <app/ModuleWidget.hpp>
 #include <app/Scene.hpp>
+#include <plugin.hpp>
 #include <context.hpp>
 #include <patch.hpp>
 #include <settings.hpp>
+#include <string.hpp>
 #include <system.hpp>
 
 #ifdef NDEBUG
@@ -56,8 +69,12 @@
 #include "Application.hpp"
 #include "extra/String.hpp"
 #include "../CardinalCommon.hpp"
+#include "../PerfTrace.hpp"
 #include "../PluginContext.hpp"
+#include "../ResourcePack.hpp"
+#include "../StartupTrace.hpp"
 #include "../WindowParameters.hpp"
+#include "../extra/SharedResourcePointer.hpp"
 
 #ifndef DGL_NO_SHARED_RESOURCES
 # include "src/Resources.hpp"
@@ -73,12 +90,50 @@ namespace window {
 
 static const math::Vec WINDOW_SIZE_MIN = math::Vec(648, 538);
 
+// part of each frame that is given to re-rendering framebuffers
+static constexpr const double kFramebufferFrameRatio = 0.5;
+// framebuffers that may always re-render in a frame, regardless of time
+static constexpr const int kFramebufferMinRendersPerFrame = 2;
+
 
 struct FontWithOriginalContext : Font {
 	int ohandle = -1;
 	std::string ofilename;
+	// file contents, NanoVG only references them
+	std::shared_ptr<std::vector<uint8_t>> data;
+};
+
+
+/** Font files loaded by any window of this process.
+NanoVG keeps font data in memory for as long as the font exists, so every window and plugin instance references the same copy.
+Entries expire when the last font using them is deleted.
+*/
+struct SharedFontFiles {
+	std::mutex mutex;
+	std::map<std::string, std::weak_ptr<std::vector<uint8_t>>> files;
+
+	std::shared_ptr<std::vector<uint8_t>> load(const std::string& filename) {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::weak_ptr<std::vector<uint8_t>>& file = files[filename];
+		std::shared_ptr<std::vector<uint8_t>> data = file.lock();
+		if (!data) {
+			if (const respack::Entry* const packed = respack::find(filename.c_str()))
+				data = std::make_shared<std::vector<uint8_t>>(packed->data, packed->data + packed->size);
+			else
+				data = std::make_shared<std::vector<uint8_t>>(system::readFile(filename));
+			file = data;
+		}
+		return data;
+	}
 };
 
+
+static int Window__createFont(NVGcontext* const vg, FontWithOriginalContext* const font) {
+	if (font->data)
+		return nvgCreateFontMem(vg, font->ofilename.c_str(), font->data->data(), font->data->size(), 0);
+	return nvgCreateFont(vg, font->ofilename.c_str(), font->ofilename.c_str());
+}
+
 struct ImageWithOriginalContext : Image {
 	int ohandle = -1;
 	std::string ofilename;
@@ -95,7 +150,16 @@ void Font::loadFile(const std::string& filename, NVGcontext* vg) {
 	std::string name = system::getStem(filename);
 	size_t size;
 	// Transfer ownership of font data to font object
-	uint8_t* data = system::readFile(filename, &size);
+	uint8_t* data;
+	if (const respack::Entry* const packed = respack::find(filename.c_str())) {
+		size = packed->size;
+		data = static_cast<uint8_t*>(std::malloc(size));
+		if (data != nullptr)
+			std::memcpy(data, packed->data, size);
+	}
+	else {
+		data = system::readFile(filename, &size);
+	}
 	// Don't use nvgCreateFont because it doesn't properly handle UTF-8 filenames on Windows.
 	handle = nvgCreateFontMem(vg, name.c_str(), data, size, 1);
 	if (handle < 0) {
@@ -119,9 +183,16 @@ Image::~Image() {
 
 void Image::loadFile(const std::string& filename, NVGcontext* vg) {
 	this->vg = vg;
-	std::vector<uint8_t> data = system::readFile(filename);
 	// Don't use nvgCreateImage because it doesn't properly handle UTF-8 filenames on Windows.
-	handle = nvgCreateImageMem(vg, NVG_IMAGE_REPEATX | NVG_IMAGE_REPEATY, data.data(), data.size());
+	if (const respack::Entry* const packed = respack::find(filename.c_str())) {
+		// only decoded, never written to
+		handle = nvgCreateImageMem(vg, NVG_IMAGE_REPEATX | NVG_IMAGE_REPEATY,
+		                           const_cast<uint8_t*>(packed->data), packed->size);
+	}
+	else {
+		std::vector<uint8_t> data = system::readFile(filename);
+		handle = nvgCreateImageMem(vg, NVG_IMAGE_REPEATX | NVG_IMAGE_REPEATY, data.data(), data.size());
+	}
 	if (handle <= 0)
 		throw Exception("Failed to load image %s", filename.c_str());
 	INFO("Loaded image %s", filename.c_str());
@@ -142,6 +213,26 @@ enum ScreenshotStep {
 };
 
 
+/** A module widget rendered for the module browser, bottom-up RGBA as read by glReadPixels.
+*/
+struct ModuleThumbnail {
+	std::string key;
+	math::Vec boxSize;
+	int width;
+	int height;
+	std::vector<uint8_t> pixels;
+};
+
+
+/** Where a module is in the thumbnail atlas pages.
+*/
+struct ModuleThumbnailRect {
+	int page;
+	math::Rect rect;
+	math::Vec boxSize;
+};
+
+
 struct Window::Internal {
 	std::string lastWindowTitle;
 
@@ -167,16 +258,41 @@ struct Window::Internal {
 	int frameSwapInterval = 1;
 #ifndef DGL_USE_GLES
 	int generateScreenshotStep = kScreenshotStepNone;
+	// screenshots are encoded on this thread, the UI thread picks up the result when ready
+	std::thread screenshotThread;
+	std::atomic<bool> screenshotEncoded{false};
+	std::string screenshotData;
+	// downscaled pixels of the last screenshot, only touched by the encoding thread
+	std::vector<uint8_t> lastScreenshotPixels;
 #endif
+
+	// module browser thumbnails, rendered a few per frame and packed into atlas pages on another thread
+	std::string thumbnailDir;
+	float thumbnailZoom = 1.f;
+	std::vector<plugin::Model*> thumbnailModels;
+	size_t thumbnailModelIndex = 0;
+	std::vector<ModuleThumbnail> thumbnails;
+	bool renderingThumbnails = false;
+	std::thread thumbnailThread;
+	std::atomic<bool> thumbnailsWritten{false};
+	bool thumbnailIndexLoaded = false;
+	bool thumbnailIndexDarkMode = false;
+	std::unordered_map<std::string, ModuleThumbnailRect> thumbnailIndex;
+
 	double monitorRefreshRate = 60.0;
 	double frameTime = 0.0;
 	double lastFrameDuration = 0.0;
+	// CPU time spent in the scene step and draw of the last frame, as seen by the UI benchmark
+	double lastStepDuration = 0.0;
+	double lastDrawDuration = 0.0;
 
 	std::map<std::string, std::shared_ptr<FontWithOriginalContext>> fontCache;
+	DISTRHO_NAMESPACE::SharedResourcePointer<SharedFontFiles> sharedFontFiles;
 	std::map<std::string, std::shared_ptr<ImageWithOriginalContext>> imageCache;
 
 	bool fbDirtyOnSubpixelChange = true;
 	int fbCount = 0;
+	int fbRenderCount = 0;
 
 	Internal()
 #if DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
@@ -208,6 +324,7 @@ static int loadFallbackFont(NVGcontext* const vg)
 
 
 Window::Window() {
+	const startuptrace::Scope trace("ui", "Window");
 	internal = new Internal;
 
 	// Set up NanoVG
@@ -302,8 +419,7 @@ void WindowSetPluginRemote(Window* const window, NanoTopLevelWidget* const tlw)
 		{
 			font.second->vg = window->vg;
 			font.second->ohandle = font.second->handle;
-			font.second->handle = nvgCreateFont(window->vg,
-			                                    font.second->ofilename.c_str(), font.second->ofilename.c_str());
+			font.second->handle = Window__createFont(window->vg, font.second.get());
 		}
 		for (auto& image : window->internal->imageCache)
 		{
@@ -413,8 +529,7 @@ void WindowSetPluginUI(Window* const window, DISTRHO_NAMESPACE::UI* const ui)
 		{
 			font.second->vg = window->vg;
 			font.second->ohandle = font.second->handle;
-			font.second->handle = nvgCreateFont(window->vg,
-			                                    font.second->ofilename.c_str(), font.second->ofilename.c_str());
+			font.second->handle = Window__createFont(window->vg, font.second.get());
 		}
 		for (auto& image : window->internal->imageCache)
 		{
@@ -479,6 +594,13 @@ void WindowSetMods(Window* const window, const int mods)
 }
 
 Window::~Window() {
+#ifndef DGL_USE_GLES
+	if (internal->screenshotThread.joinable())
+		internal->screenshotThread.join();
+#endif
+	if (internal->thumbnailThread.joinable())
+		internal->thumbnailThread.join();
+
 	{
 #if DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
 		DGL_NAMESPACE::Window::ScopedGraphicsContext sgc(internal->hiddenWindow);
@@ -532,6 +654,11 @@ void WindowSetInternalSize(rack::window::Window* const window, math::Vec size) {
 	window->internal->size = size;
 }
 
+void WindowGetLastFrameDurations(rack::window::Window* const window, double& stepDuration, double& drawDuration) {
+	stepDuration = window->internal->lastStepDuration;
+	drawDuration = window->internal->lastDrawDuration;
+}
+
 
 void Window::run() {
 	internal->frame = 0;
@@ -539,19 +666,10 @@ void Window::run() {
 
 
 #ifndef DGL_USE_GLES
-static void Window__flipBitmap(uint8_t* pixels, const int width, const int height, const int depth) {
-	for (int y = 0; y < height / 2; y++) {
-		const int flipY = height - y - 1;
-		uint8_t tmp[width * depth];
-		std::memcpy(tmp, &pixels[y * width * depth], width * depth);
-		std::memmove(&pixels[y * width * depth], &pixels[flipY * width * depth], width * depth);
-		std::memcpy(&pixels[flipY * width * depth], tmp, width * depth);
-	}
-}
-
-
 #ifdef STBI_WRITE_NO_STDIO
-static void Window__downscaleBitmap(uint8_t* pixels, int& width, int& height) {
+/** Scales down a bottom-up bitmap as read by glReadPixels into a new top-down bitmap.
+*/
+static uint8_t* Window__flipAndDownscaleBitmap(const uint8_t* pixels, int& width, int& height, const int depth) {
 	int targetWidth = width;
 	int targetHeight = height;
 	double scale = 1.0;
@@ -566,29 +684,302 @@ static void Window__downscaleBitmap(uint8_t* pixels, int& width, int& height) {
 		targetHeight = 210;
 		targetWidth = width / scale;
 	}
-	DISTRHO_SAFE_ASSERT_INT_RETURN(targetWidth <= 340, targetWidth,);
-	DISTRHO_SAFE_ASSERT_INT_RETURN(targetHeight <= 210, targetHeight,);
+	DISTRHO_SAFE_ASSERT_INT_RETURN(targetWidth <= 340, targetWidth, nullptr);
+	DISTRHO_SAFE_ASSERT_INT_RETURN(targetHeight <= 210, targetHeight, nullptr);
+
+	uint8_t* const target = new uint8_t[targetWidth * targetHeight * depth];
 
 	// FIXME worst possible quality :/
 	for (int y = 0; y < targetHeight; ++y) {
-		const int ys = static_cast<int>(y * scale);
+		const uint8_t* const row = pixels + width * (height - 1 - static_cast<int>(y * scale)) * depth;
+		uint8_t* const targetRow = target + targetWidth * y * depth;
 		for (int x = 0; x < targetWidth; ++x) {
-			const int xs = static_cast<int>(x * scale);
-			std::memmove(pixels + (width * y + x) * 3, pixels + (width * ys + xs) * 3, 3);
+			std::memcpy(targetRow + x * depth, row + static_cast<int>(x * scale) * depth, depth);
 		}
 	}
 
 	width = targetWidth;
 	height = targetHeight;
+	return target;
 }
 
 static void Window__writeImagePNG(void* context, void* data, int size) {
 	USE_NAMESPACE_DISTRHO
-	UI* const ui = static_cast<UI*>(context);
-	ui->setState("screenshot", String::asBase64(data, size).buffer());
+	std::string* const output = static_cast<std::string*>(context);
+	output->assign(String::asBase64(data, size).buffer());
+}
+#else
+static void Window__flipBitmap(uint8_t* pixels, const int width, const int height, const int depth) {
+	std::vector<uint8_t> tmp(width * depth);
+	for (int y = 0; y < height / 2; y++) {
+		const int flipY = height - y - 1;
+		std::memcpy(tmp.data(), &pixels[y * width * depth], width * depth);
+		std::memcpy(&pixels[y * width * depth], &pixels[flipY * width * depth], width * depth);
+		std::memcpy(&pixels[flipY * width * depth], tmp.data(), width * depth);
+	}
 }
 #endif
+
+
+/** Converts the pixels read from the front buffer into a PNG, then takes ownership of `pixels` and deletes it.
+Only the bottom `height` rows are used, the rest is covered by the menu bar.
+Nothing is encoded if the downscaled image did not change since the last screenshot, leaving `screenshotData` empty.
+*/
+static void Window__encodeScreenshot(Window::Internal* const internal, uint8_t* const pixels, int width, int height, const int depth) {
+	const perftrace::Scope trace("ui", "encode screenshot");
+
+#ifdef STBI_WRITE_NO_STDIO
+	if (uint8_t* const scaled = Window__flipAndDownscaleBitmap(pixels, width, height, depth)) {
+		const size_t size = width * height * depth;
+		std::vector<uint8_t>& last(internal->lastScreenshotPixels);
+		if (last.size() != size || std::memcmp(last.data(), scaled, size) != 0) {
+			last.assign(scaled, scaled + size);
+			stbi_write_png_to_func(Window__writeImagePNG, &internal->screenshotData,
+			                       width, height, depth, scaled, width * depth);
+		}
+		delete[] scaled;
+	}
+#else
+	Window__flipBitmap(pixels, width, height, depth);
+	stbi_write_png("screenshot.png", width, height, depth, pixels, width * depth);
+#endif
+
+	delete[] pixels;
+	internal->screenshotEncoded.store(true, std::memory_order_release);
+}
+#endif
+
+
+static constexpr const int kThumbnailPageSize = 2048;
+
+
+static std::string Window__getThumbnailDirectory() {
+	return asset::user("thumbnails");
+}
+
+
+static void Window__appendPNG(void* const context, void* const data, const int size) {
+	std::vector<uint8_t>* const output = static_cast<std::vector<uint8_t>*>(context);
+	const uint8_t* const bytes = static_cast<const uint8_t*>(data);
+	output->insert(output->end(), bytes, bytes + size);
+}
+
+
+/** Packs the rendered module thumbnails into atlas pages, left to right in shelves of decreasing height,
+then writes the pages and their index next to each other.
+Runs outside the UI thread, as PNG encoding is slow.
+*/
+static void Window__writeModuleThumbnails(Window::Internal* const internal, const bool darkMode) {
+	const std::string indexFilename = system::join(internal->thumbnailDir, "atlas.json");
+
+	std::vector<ModuleThumbnail*> sorted;
+	for (ModuleThumbnail& thumbnail : internal->thumbnails) {
+		if (thumbnail.width <= kThumbnailPageSize && thumbnail.height <= kThumbnailPageSize)
+			sorted.push_back(&thumbnail);
+	}
+	std::sort(sorted.begin(), sorted.end(), [](const ModuleThumbnail* const a, const ModuleThumbnail* const b) {
+		return a->height > b->height;
+	});
+
+	std::vector<std::vector<uint8_t>> pages;
+	std::vector<int> pageHeights;
+	json_t* const modulesJ = json_object();
+	int x = 0;
+	int y = 0;
+	int shelfHeight = 0;
+
+	for (const ModuleThumbnail* const thumbnail : sorted) {
+		const int width = thumbnail->width;
+		const int height = thumbnail->height;
+
+		if (x + width > kThumbnailPageSize) {
+			x = 0;
+			y += shelfHeight + 1;
+			shelfHeight = 0;
+		}
+		if (pages.empty() || y + height > kThumbnailPageSize) {
+			pages.emplace_back(kThumbnailPageSize * kThumbnailPageSize * 4, 0);
+			pageHeights.push_back(0);
+			x = y = shelfHeight = 0;
+		}
+
+		// flip while copying, rows were read bottom-up
+		uint8_t* const page = pages.back().data();
+		for (int row = 0; row < height; ++row) {
+			std::memcpy(page + ((y + row) * kThumbnailPageSize + x) * 4,
+			            thumbnail->pixels.data() + (height - 1 - row) * width * 4,
+			            width * 4);
+		}
+
+		json_object_set_new(modulesJ, thumbnail->key.c_str(),
+		                    json_pack("[iiiiiff]", static_cast<int>(pages.size() - 1), x, y, width, height,
+		                              static_cast<double>(thumbnail->boxSize.x),
+		                              static_cast<double>(thumbnail->boxSize.y)));
+
+		x += width + 1;
+		shelfHeight = std::max(shelfHeight, height);
+		pageHeights.back() = std::max(pageHeights.back(), y + height);
+	}
+
+	internal->thumbnails.clear();
+	internal->thumbnails.shrink_to_fit();
+
+	try {
+		system::createDirectories(internal->thumbnailDir);
+		// an index must never point into pages of another generation
+		system::remove(indexFilename);
+
+		for (size_t i = 0; i < pages.size(); ++i) {
+			std::vector<uint8_t> png;
+			stbi_write_png_to_func(Window__appendPNG, &png, kThumbnailPageSize, pageHeights[i], 4,
+			                       pages[i].data(), kThumbnailPageSize * 4);
+			system::writeFile(system::join(internal->thumbnailDir, string::f("atlas-%d.png", static_cast<int>(i))), png);
+			pages[i] = std::vector<uint8_t>();
+		}
+
+		json_t* const rootJ = json_object();
+		json_object_set_new(rootJ, "version", json_string(CARDINAL_VERSION.c_str()));
+		json_object_set_new(rootJ, "darkMode", json_boolean(darkMode));
+		json_object_set_new(rootJ, "zoom", json_real(internal->thumbnailZoom));
+		json_object_set_new(rootJ, "modules", json_incref(modulesJ));
+		if (json_dump_file(rootJ, indexFilename.c_str(), 0) != 0)
+			WARN("Could not write module thumbnail index %s", indexFilename.c_str());
+		json_decref(rootJ);
+
+		INFO("Wrote %d module thumbnails in %d atlas pages to %s",
+		     static_cast<int>(sorted.size()), static_cast<int>(pages.size()), internal->thumbnailDir.c_str());
+	}
+	catch (Exception& e) {
+		WARN("Could not write module thumbnails: %s", e.what());
+	}
+
+	json_decref(modulesJ);
+	internal->thumbnailsWritten.store(true, std::memory_order_release);
+}
+
+
+/** Renders the next module thumbnails queued by screenshotModules, within a small time budget per frame.
+The NanoVG context is current, as when framebuffer widgets render while drawing the scene.
+*/
+static void Window__renderModuleThumbnails(Window* const window) {
+	Window::Internal* const internal = window->internal;
+	const double startTime = system::getTime();
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	// thumbnails are made from the actual module widgets
+	internal->renderingThumbnails = true;
+
+	while (internal->thumbnailModelIndex < internal->thumbnailModels.size() && system::getTime() - startTime < 0.008) {
+		plugin::Model* const model = internal->thumbnailModels[internal->thumbnailModelIndex++];
+
+		widget::FramebufferWidget* const fbw = new widget::FramebufferWidget;
+
+		struct ModuleWidgetContainer : widget::Widget {
+			void draw(const DrawArgs& args) override {
+				Widget::draw(args);
+				Widget::drawLayer(args, 1);
+			}
+		};
+		ModuleWidgetContainer* const mwc = new ModuleWidgetContainer;
+		fbw->addChild(mwc);
+
+		app::ModuleWidget* mw;
+		try {
+			mw = model->createModuleWidget(NULL);
+		}
+		catch (Exception& e) {
+			WARN("Could not create module widget %s %s: %s", model->plugin->slug.c_str(), model->slug.c_str(), e.what());
+			delete fbw;
+			continue;
+		}
+		if (mw == nullptr) {
+			delete fbw;
+			continue;
+		}
+		mwc->box.size = mw->box.size;
+		fbw->box.size = mw->box.size;
+		mwc->addChild(mw);
+
+		// Step to allow the ModuleWidget state to set its default appearance.
+		fbw->step();
+
+		// Draw to framebuffer
+		fbw->render(math::Vec(internal->thumbnailZoom, internal->thumbnailZoom));
+
+		if (NVGLUframebuffer* const fb = fbw->getFramebuffer()) {
+			ModuleThumbnail thumbnail;
+			thumbnail.key = model->plugin->slug + "/" + model->slug;
+			thumbnail.boxSize = mw->box.size;
+			nvgImageSize(window->vg, fbw->getImageHandle(), &thumbnail.width, &thumbnail.height);
+			thumbnail.pixels.resize(thumbnail.width * thumbnail.height * 4);
+
+			nvgluBindFramebuffer(fb);
+			glPixelStorei(GL_PACK_ALIGNMENT, 1);
+			glReadPixels(0, 0, thumbnail.width, thumbnail.height, GL_RGBA, GL_UNSIGNED_BYTE, thumbnail.pixels.data());
+			nvgluBindFramebuffer(NULL);
+
+			internal->thumbnails.push_back(std::move(thumbnail));
+		}
+
+		delete fbw;
+	}
+
+	internal->renderingThumbnails = false;
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	if (internal->thumbnailModelIndex < internal->thumbnailModels.size())
+		return;
+
+	internal->thumbnailModels.clear();
+	internal->thumbnailModelIndex = 0;
+
+#ifdef DISTRHO_OS_WASM
+	Window__writeModuleThumbnails(internal, settings::darkMode);
+#else
+	internal->thumbnailThread = std::thread(Window__writeModuleThumbnails, internal, settings::darkMode);
 #endif
+}
+
+
+static void Window__loadModuleThumbnailIndex(Window::Internal* const internal) {
+	internal->thumbnailIndexLoaded = true;
+	internal->thumbnailIndex.clear();
+
+	const std::string indexFilename = system::join(Window__getThumbnailDirectory(), "atlas.json");
+	if (!system::isFile(indexFilename))
+		return;
+
+	json_error_t error;
+	json_t* const rootJ = json_load_file(indexFilename.c_str(), 0, &error);
+	if (rootJ == nullptr) {
+		WARN("Could not parse module thumbnail index %s: %d:%d %s", indexFilename.c_str(), error.line, error.column, error.text);
+		return;
+	}
+
+	// thumbnails of another version are likely outdated
+	const char* const version = json_string_value(json_object_get(rootJ, "version"));
+	if (version != nullptr && CARDINAL_VERSION == version) {
+		internal->thumbnailIndexDarkMode = json_boolean_value(json_object_get(rootJ, "darkMode"));
+
+		const char* key;
+		json_t* rectJ;
+		json_object_foreach(json_object_get(rootJ, "modules"), key, rectJ) {
+			int page, x, y, width, height;
+			double boxWidth, boxHeight;
+			if (json_unpack(rectJ, "[iiiiiff]", &page, &x, &y, &width, &height, &boxWidth, &boxHeight) != 0)
+				continue;
+			internal->thumbnailIndex[key] = {
+				page,
+				math::Rect(x, y, width, height),
+				math::Vec(boxWidth, boxHeight),
+			};
+		}
+	}
+
+	json_decref(rootJ);
+}
 
 
 void Window::step() {
@@ -597,11 +988,14 @@ void Window::step() {
 	if (vg == nullptr)
 		return;
 
+	const perftrace::Scope trace("ui", "Window::step");
+
 	double frameTime = system::getTime();
 	double lastFrameTime = internal->frameTime;
 	internal->frameTime = frameTime;
 	internal->lastFrameDuration = frameTime - lastFrameTime;
 	internal->fbCount = 0;
+	internal->fbRenderCount = 0;
 	// DEBUG("%.2lf Hz", 1.0 / internal->lastFrameDuration);
 
 	// Make event handlers and step() have a clean NanoVG context
@@ -649,16 +1043,45 @@ void Window::step() {
 	int fbHeight = winHeight;// * newPixelRatio;
 	windowRatio = (float)fbWidth / winWidth;
 
+	if (internal->thumbnailsWritten.load(std::memory_order_acquire)) {
+		if (internal->thumbnailThread.joinable())
+			internal->thumbnailThread.join();
+		internal->thumbnailsWritten.store(false, std::memory_order_relaxed);
+
+		// drop cached atlas pages of the previous generation, previews still using them keep their reference
+		const std::string thumbnailDir = Window__getThumbnailDirectory();
+		for (auto it = internal->imageCache.begin(); it != internal->imageCache.end();) {
+			if (string::startsWith(it->first, thumbnailDir))
+				it = internal->imageCache.erase(it);
+			else
+				++it;
+		}
+		internal->thumbnailIndexLoaded = false;
+	}
+
+	if (!internal->thumbnailModels.empty()) {
+		const perftrace::Scope traceThumbnails("ui", "thumbnails");
+		Window__renderModuleThumbnails(this);
+	}
+
 	if (APP->scene) {
 		// DEBUG("%f %f %d %d", pixelRatio, windowRatio, fbWidth, winWidth);
 		// Resize scene
 		APP->scene->box.size = math::Vec(fbWidth, fbHeight).div(newPixelRatio);
 
 		// Step scene
-		APP->scene->step();
+		{
+			const perftrace::Scope traceStep("ui", "scene step");
+			const double stepStart = system::getTime();
+			APP->scene->step();
+			internal->lastStepDuration = system::getTime() - stepStart;
+		}
 
 		// Render scene
 		{
+			const perftrace::Scope traceDraw("ui", "scene draw");
+			const double drawStart = system::getTime();
+
 			// Update and render
 			nvgScale(vg, newPixelRatio, newPixelRatio);
 
@@ -675,51 +1098,62 @@ void Window::step() {
 			glClearColor(0.0, 0.0, 0.0, 1.0);
 #endif
 			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+			internal->lastDrawDuration = system::getTime() - drawStart;
 		}
 	}
 
 	++internal->frame;
 
 #ifndef DGL_USE_GLES
+	if (internal->screenshotEncoded.load(std::memory_order_acquire)) {
+		if (internal->screenshotThread.joinable())
+			internal->screenshotThread.join();
+		internal->screenshotEncoded.store(false, std::memory_order_relaxed);
+#ifdef STBI_WRITE_NO_STDIO
+		// unchanged screenshots are neither stored again nor sent to the remote
+		if (!internal->screenshotData.empty()) {
+			internal->ui->setState("screenshot", internal->screenshotData.c_str());
+			internal->screenshotData.clear();
+		}
+#endif
+	}
+
 	if (internal->generateScreenshotStep != kScreenshotStepNone) {
 		++internal->generateScreenshotStep;
 
-		int y = 0;
+		if (internal->generateScreenshotStep == kScreenshotStepSaving)
+		{
+			const perftrace::Scope traceScreenshot("ui", "screenshot");
+
+			int y = 0;
 #ifdef CARDINAL_TRANSPARENT_SCREENSHOTS
-		constexpr const int depth = 4;
+			constexpr const int depth = 4;
 #else
-		y = APP->scene->menuBar->box.size.y * newPixelRatio;
-		constexpr const int depth = 3;
+			y = APP->scene->menuBar->box.size.y * newPixelRatio;
+			constexpr const int depth = 3;
 #endif
 
-		// Allocate pixel color buffer
-		uint8_t* const pixels = new uint8_t[winHeight * winWidth * 4];
+			// Allocate pixel color buffer, owned by the encoder from here on
+			uint8_t* const pixels = new uint8_t[winHeight * winWidth * 4];
 
-		// glReadPixels defaults to GL_BACK, but the back-buffer is unstable, so use the front buffer (what the user sees)
-		glReadBuffer(GL_FRONT);
-		glReadPixels(0, 0, winWidth, winHeight, depth == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+			// glReadPixels defaults to GL_BACK, but the back-buffer is unstable, so use the front buffer (what the user sees)
+			glReadBuffer(GL_FRONT);
+			glPixelStorei(GL_PACK_ALIGNMENT, 1);
+			glReadPixels(0, 0, winWidth, winHeight, depth == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 
-		if (internal->generateScreenshotStep == kScreenshotStepSaving)
-		{
-			// Write pixels to PNG
-			const int stride = winWidth * depth;
-			uint8_t* const pixelsWithOffset = pixels + (stride * y);
-			Window__flipBitmap(pixels, winWidth, winHeight, depth);
-			winHeight -= y;
-#ifdef STBI_WRITE_NO_STDIO
-			Window__downscaleBitmap(pixelsWithOffset, winWidth, winHeight);
-			stbi_write_png_to_func(Window__writeImagePNG, internal->ui,
-			                       winWidth, winHeight, depth, pixelsWithOffset, stride);
+			// Write pixels to PNG, encoding is slow so do it outside the UI thread
+			if (internal->screenshotThread.joinable())
+				internal->screenshotThread.join();
+#ifdef DISTRHO_OS_WASM
+			Window__encodeScreenshot(internal, pixels, winWidth, winHeight - y, depth);
 #else
-			stbi_write_png("screenshot.png", winWidth, winHeight, depth, pixelsWithOffset, stride);
+			internal->screenshotThread = std::thread(Window__encodeScreenshot, internal, pixels, winWidth, winHeight - y, depth);
 #endif
 
 			internal->generateScreenshotStep = kScreenshotStepNone;
 			APP->scene->menuBar->show();
 			APP->scene->rack->children.front()->show();
 		}
-
-		delete[] pixels;
 	}
 #endif
 }
@@ -733,7 +1167,24 @@ void Window::screenshot(const std::string&) {
 }
 
 
-void Window::screenshotModules(const std::string&, float) {
+void Window::screenshotModules(const std::string& screenshotsDir, float zoom) {
+	if (internal->thumbnailThread.joinable())
+		internal->thumbnailThread.join();
+
+	internal->thumbnailDir = screenshotsDir;
+	internal->thumbnailZoom = zoom;
+	internal->thumbnailModels.clear();
+	internal->thumbnailModelIndex = 0;
+	internal->thumbnails.clear();
+
+	for (plugin::Plugin* p : plugin::plugins) {
+		for (plugin::Model* model : p->models) {
+			if (!model->hidden)
+				internal->thumbnailModels.push_back(model);
+		}
+	}
+
+	INFO("Rendering %d module thumbnails to %s", static_cast<int>(internal->thumbnailModels.size()), screenshotsDir.c_str());
 }
 
 
@@ -817,9 +1268,21 @@ double Window::getLastFrameDuration() {
 }
 
 
+/** Dirty framebuffers only re-render while this is positive, otherwise they keep drawing their previous (scaled) texture.
+Only part of the frame is given to them, so that zooming or switching theme on a big patch spreads the re-rendering
+across several frames while the UI stays responsive.
+A few framebuffers are always allowed per frame, so everything catches up even when the rest of the frame is slow.
+*/
 double Window::getFrameDurationRemaining() {
-	double frameDurationDesired = internal->frameSwapInterval / internal->monitorRefreshRate;
-	return frameDurationDesired - (system::getTime() - internal->frameTime);
+	const double frameDurationDesired = internal->frameSwapInterval / internal->monitorRefreshRate;
+	const double remaining = frameDurationDesired * kFramebufferFrameRatio - (system::getTime() - internal->frameTime);
+
+	if (remaining <= 0.0 && internal->fbRenderCount < kFramebufferMinRendersPerFrame) {
+		++internal->fbRenderCount;
+		return frameDurationDesired;
+	}
+
+	return remaining;
 }
 
 
@@ -828,12 +1291,18 @@ std::shared_ptr<Font> Window::loadFont(const std::string& filename) {
 	if (pair != internal->fontCache.end())
 		return pair->second;
 
-	// Load font
+	// Load font, sharing its data with other windows
+	const startuptrace::Scope trace("font", filename.c_str());
 	std::shared_ptr<FontWithOriginalContext> font;
 	try {
 		font = std::make_shared<FontWithOriginalContext>();
 		font->ofilename = filename;
-		font->loadFile(filename, vg);
+		font->vg = vg;
+		font->data = internal->sharedFontFiles->load(filename);
+		font->handle = Window__createFont(vg, font.get());
+		if (font->handle < 0)
+			throw Exception("Failed to load font %s", filename.c_str());
+		INFO("Loaded font %s", filename.c_str());
 	}
 	catch (Exception& e) {
 		WARN("%s", e.what());
@@ -850,6 +1319,7 @@ std::shared_ptr<Image> Window::loadImage(const std::string& filename) {
 		return pair->second;
 
 	// Load image
+	const startuptrace::Scope trace("image", filename.c_str());
 	std::shared_ptr<ImageWithOriginalContext> image;
 	try {
 		image = std::make_shared<ImageWithOriginalContext>();
@@ -882,6 +1352,76 @@ void generateScreenshot() {
 }
 
 
+void generateModuleThumbnails() {
+	Window* const window = APP->window;
+	window->screenshotModules(Window__getThumbnailDirectory(), window->pixelRatio * std::pow(2.f, settings::browserZoom));
+}
+
+
+/** Module browser preview drawn from the thumbnail atlas, instead of the actual module widget.
+*/
+struct ModuleThumbnailWidget : app::ModuleWidget {
+	std::shared_ptr<Image> image;
+	math::Rect rect;
+
+	void draw(const DrawArgs& args) override {
+		if (!image || image->handle < 0)
+			return;
+
+		int width, height;
+		nvgImageSize(args.vg, image->handle, &width, &height);
+
+		const float scaleX = box.size.x / rect.size.x;
+		const float scaleY = box.size.y / rect.size.y;
+		const NVGpaint paint = nvgImagePattern(args.vg,
+		                                       -rect.pos.x * scaleX, -rect.pos.y * scaleY,
+		                                       width * scaleX, height * scaleY,
+		                                       0.f, image->handle, 1.f);
+
+		nvgBeginPath(args.vg);
+		nvgRect(args.vg, 0, 0, box.size.x, box.size.y);
+		nvgFillPaint(args.vg, paint);
+		nvgFill(args.vg);
+	}
+
+	void drawLayer(const DrawArgs&, int) override {}
+};
+
+
+app::ModuleWidget* createModuleThumbnail(plugin::Model* const model) {
+	Window* const window = APP->window;
+	if (window == nullptr || window->vg == nullptr)
+		return nullptr;
+
+	Window::Internal* const internal = window->internal;
+	if (internal->renderingThumbnails)
+		return nullptr;
+
+	if (!internal->thumbnailIndexLoaded)
+		Window__loadModuleThumbnailIndex(internal);
+
+	if (internal->thumbnailIndex.empty() || internal->thumbnailIndexDarkMode != settings::darkMode)
+		return nullptr;
+
+	auto it = internal->thumbnailIndex.find(model->plugin->slug + "/" + model->slug);
+	if (it == internal->thumbnailIndex.end())
+		return nullptr;
+
+	const ModuleThumbnailRect& thumbnailRect(it->second);
+	std::shared_ptr<Image> image = window->loadImage(system::join(Window__getThumbnailDirectory(),
+	                                                              string::f("atlas-%d.png", thumbnailRect.page)));
+	if (!image)
+		return nullptr;
+
+	ModuleThumbnailWidget* const mw = new ModuleThumbnailWidget;
+	mw->image = image;
+	mw->rect = thumbnailRect.rect;
+	mw->box.size = thumbnailRect.boxSize;
+	mw->setModel(model);
+	return mw;
+}
+
+
 void init() {
 }
 
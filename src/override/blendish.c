@@ -25,6 +25,8 @@ THE SOFTWARE.
 
 #include <memory.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include <blendish.h>
 
 #ifdef _MSC_VER
@@ -250,6 +252,156 @@ void bndSetFont(int font) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Measurements of the labels drawn or laid out every frame, menus measure all of their items on each step.
+// Entries are keyed by context, font, size, font scale, wrap width and text, the least recently used is dropped first.
+// Labels are measured the way blendish draws them, left aligned with the default letter spacing and line height.
+#define BND_TEXT_CACHE_SIZE 1024
+#define BND_TEXT_CACHE_BUCKETS 2048
+#define BND_TEXT_CACHE_MAX_LENGTH 256
+// width of a measurement done with nvgTextBounds instead of nvgTextBoxBounds
+#define BND_TEXT_ADVANCE (-INFINITY)
+
+typedef struct {
+    NVGcontext *ctx;
+    int font;
+    float size;
+    float scale;
+    // wrap width of nvgTextBoxBounds, or BND_TEXT_ADVANCE
+    float width;
+    unsigned int hash;
+    char *text;
+    float advance;
+    float bounds[4];
+    // indices are offset by one, 0 ends a list
+    int bucketNext;
+    int lruPrev, lruNext;
+} BNDtextCacheEntry;
+
+static BNDtextCacheEntry bnd_text_cache[BND_TEXT_CACHE_SIZE];
+static int bnd_text_cache_buckets[BND_TEXT_CACHE_BUCKETS];
+static int bnd_text_cache_count = 0;
+// most and least recently used entries
+static int bnd_text_cache_head = 0;
+static int bnd_text_cache_tail = 0;
+
+static unsigned int bnd_hash_bytes(unsigned int hash, const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+// font scale of the current transform, quantized like nanovg does before rasterizing glyphs
+static float bnd_text_scale(NVGcontext *ctx) {
+    float t[6];
+    nvgCurrentTransform(ctx, t);
+    float sx = sqrtf(t[0]*t[0] + t[2]*t[2]);
+    float sy = sqrtf(t[1]*t[1] + t[3]*t[3]);
+    return roundf((sx + sy) * 0.5f * 100.0f) / 100.0f;
+}
+
+static void bnd_text_cache_unlink(int index) {
+    BNDtextCacheEntry *entry = &bnd_text_cache[index-1];
+    if (entry->lruPrev) bnd_text_cache[entry->lruPrev-1].lruNext = entry->lruNext;
+    else bnd_text_cache_head = entry->lruNext;
+    if (entry->lruNext) bnd_text_cache[entry->lruNext-1].lruPrev = entry->lruPrev;
+    else bnd_text_cache_tail = entry->lruPrev;
+}
+
+static void bnd_text_cache_push(int index) {
+    BNDtextCacheEntry *entry = &bnd_text_cache[index-1];
+    entry->lruPrev = 0;
+    entry->lruNext = bnd_text_cache_head;
+    if (bnd_text_cache_head) bnd_text_cache[bnd_text_cache_head-1].lruPrev = index;
+    else bnd_text_cache_tail = index;
+    bnd_text_cache_head = index;
+}
+
+// reuses the least recently used entry once the cache is full
+static int bnd_text_cache_take(void) {
+    if (bnd_text_cache_count < BND_TEXT_CACHE_SIZE)
+        return ++bnd_text_cache_count;
+
+    int index = bnd_text_cache_tail;
+    BNDtextCacheEntry *entry = &bnd_text_cache[index-1];
+    int *link = &bnd_text_cache_buckets[entry->hash % BND_TEXT_CACHE_BUCKETS];
+    while (*link != index)
+        link = &bnd_text_cache[*link-1].bucketNext;
+    *link = entry->bucketNext;
+
+    bnd_text_cache_unlink(index);
+    free(entry->text);
+    return index;
+}
+
+// same as nvgTextBounds (BND_TEXT_ADVANCE width) or nvgTextBoxBounds at (1, 1), font face and size must already be set
+static float bnd_text_bounds(NVGcontext *ctx, int font, float size, float width,
+    const char *text, float *bounds) {
+    size_t length = strlen(text);
+    float measured[4];
+    if (!bounds) bounds = measured;
+
+    if (length > BND_TEXT_CACHE_MAX_LENGTH) {
+        if (width == BND_TEXT_ADVANCE) return nvgTextBounds(ctx, 1, 1, text, NULL, bounds);
+        nvgTextBoxBounds(ctx, 1, 1, width, text, NULL, bounds);
+        return bounds[2];
+    }
+
+    float scale = bnd_text_scale(ctx);
+    unsigned int hash = bnd_hash_bytes(2166136261u, text, length);
+    hash = bnd_hash_bytes(hash, &ctx, sizeof(ctx));
+    hash = bnd_hash_bytes(hash, &font, sizeof(font));
+    hash = bnd_hash_bytes(hash, &size, sizeof(size));
+    hash = bnd_hash_bytes(hash, &scale, sizeof(scale));
+    hash = bnd_hash_bytes(hash, &width, sizeof(width));
+
+    int *bucket = &bnd_text_cache_buckets[hash % BND_TEXT_CACHE_BUCKETS];
+    for (int index = *bucket; index; index = bnd_text_cache[index-1].bucketNext) {
+        BNDtextCacheEntry *entry = &bnd_text_cache[index-1];
+        if (entry->hash != hash || entry->ctx != ctx || entry->font != font || entry->size != size
+            || entry->scale != scale || entry->width != width || strcmp(entry->text, text) != 0)
+            continue;
+        if (bnd_text_cache_head != index) {
+            bnd_text_cache_unlink(index);
+            bnd_text_cache_push(index);
+        }
+        memcpy(bounds, entry->bounds, sizeof(entry->bounds));
+        return entry->advance;
+    }
+
+    float advance;
+    if (width == BND_TEXT_ADVANCE) {
+        advance = nvgTextBounds(ctx, 1, 1, text, NULL, bounds);
+    } else {
+        nvgTextBoxBounds(ctx, 1, 1, width, text, NULL, bounds);
+        advance = bounds[2];
+    }
+
+    char *copy = (char *)malloc(length + 1);
+    if (!copy) return advance;
+    memcpy(copy, text, length + 1);
+
+    int index = bnd_text_cache_take();
+    BNDtextCacheEntry *entry = &bnd_text_cache[index-1];
+    entry->ctx = ctx;
+    entry->font = font;
+    entry->size = size;
+    entry->scale = scale;
+    entry->width = width;
+    entry->hash = hash;
+    entry->text = copy;
+    entry->advance = advance;
+    memcpy(entry->bounds, bounds, sizeof(entry->bounds));
+    // the bucket may have been the one of the evicted entry
+    bucket = &bnd_text_cache_buckets[hash % BND_TEXT_CACHE_BUCKETS];
+    entry->bucketNext = *bucket;
+    *bucket = index;
+    bnd_text_cache_push(index);
+    return advance;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 void bndLabel(NVGcontext *ctx,
     float x, float y, float w, float h, int iconid, const char *label) {
     bndIconLabelValue(ctx,x,y,w,h,iconid,
@@ -737,9 +889,7 @@ float bndLabelWidth(NVGcontext *ctx, int iconid, const char *label) {
     if (label && (bnd_font >= 0)) {
         nvgFontFaceId(ctx, bnd_font);
         nvgFontSize(ctx, BND_LABEL_FONT_SIZE);
-        float bounds[4];
-        nvgTextBoxBounds(ctx, 1, 1, INFINITY, label, NULL, bounds);
-        w += bounds[2];
+        w += bnd_text_bounds(ctx, bnd_font, BND_LABEL_FONT_SIZE, INFINITY, label, NULL);
     }
     return w;
 }
@@ -754,7 +904,7 @@ float bndLabelHeight(NVGcontext *ctx, int iconid, const char *label, float width
         nvgFontFaceId(ctx, bnd_font);
         nvgFontSize(ctx, BND_LABEL_FONT_SIZE);
         float bounds[4];
-        nvgTextBoxBounds(ctx, 1, 1, width, label, NULL, bounds);
+        bnd_text_bounds(ctx, bnd_font, BND_LABEL_FONT_SIZE, width, label, bounds);
         int bh = (int)(bounds[3] - bounds[1]) + BND_TEXT_PAD_DOWN;
         if (bh > h)
         	h = bh;
@@ -978,15 +1128,15 @@ void bndIconLabelValue(NVGcontext *ctx, float x, float y, float w, float h,
         nvgBeginPath(ctx);
         nvgFillColor(ctx, color);
         if (value) {
-            float label_width = nvgTextBounds(ctx, 1, 1, label, NULL, NULL);
-            float sep_width = nvgTextBounds(ctx, 1, 1,
-                BND_LABEL_SEPARATOR, NULL, NULL);
+            float label_width = bnd_text_bounds(ctx, bnd_font, fontsize, BND_TEXT_ADVANCE, label, NULL);
+            float sep_width = bnd_text_bounds(ctx, bnd_font, fontsize, BND_TEXT_ADVANCE,
+                BND_LABEL_SEPARATOR, NULL);
 
             nvgTextAlign(ctx, NVG_ALIGN_LEFT|NVG_ALIGN_BASELINE);
             x += pleft;
             if (align == BND_CENTER) {
                 float width = label_width + sep_width
-                    + nvgTextBounds(ctx, 1, 1, value, NULL, NULL);
+                    + bnd_text_bounds(ctx, bnd_font, fontsize, BND_TEXT_ADVANCE, value, NULL);
                 x += ((w-BND_PAD_RIGHT-pleft)-width)*0.5f;
             }
             y += BND_WIDGET_HEIGHT-BND_TEXT_PAD_DOWN;
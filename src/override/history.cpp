@@ -0,0 +1,497 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+/**
+ * This file is an edited version of VCVRack's history.cpp
+ * Copyright (C) 2016-2021 VCV.
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ */
+
+#include <history.hpp>
+#include <context.hpp>
+#include <engine/Engine.hpp>
+#include <engine/Cable.hpp>
+#include <app/Scene.hpp>
+#include <app/RackWidget.hpp>
+#include <app/ModuleWidget.hpp>
+#include <app/CableWidget.hpp>
+
+#include <mutex>
+#include <unordered_map>
+
+#include <zstd.h>
+
+#include "../CardinalCommon.hpp"
+#include "../ModuleMemory.hpp"
+
+
+namespace rack {
+namespace history {
+
+
+/** Module states kept by actions, stored as zstd compressed JSON once pushed into the history.
+Keyed by the address of the action member holding the state, which is NULL while compressed.
+*/
+static std::mutex payloadsMutex;
+static std::unordered_map<json_t* const*, std::vector<uint8_t>> payloads;
+
+static void compressPayload(json_t** const stateJ) {
+	if (!*stateJ)
+		return;
+
+	char* const str = json_dumps(*stateJ, JSON_COMPACT);
+	if (!str)
+		return;
+	DEFER({std::free(str);});
+
+	const size_t size = std::strlen(str);
+	std::vector<uint8_t> data(ZSTD_compressBound(size));
+	const size_t ret = ZSTD_compress(data.data(), data.size(), str, size, CARDINAL_STATE_COMPRESSION_LEVEL);
+	if (ZSTD_isError(ret)) {
+		// keep it uncompressed
+		WARN("Cannot compress undo history state: %s", ZSTD_getErrorName(ret));
+		return;
+	}
+	data.resize(ret);
+	data.shrink_to_fit();
+
+	{
+		std::lock_guard<std::mutex> lock(payloadsMutex);
+		payloads[stateJ] = std::move(data);
+	}
+
+	json_decref(*stateJ);
+	*stateJ = NULL;
+}
+
+/** Returns a new reference to the state, decompressing it if needed. */
+static json_t* loadPayload(json_t* const* const stateJ) {
+	if (*stateJ)
+		return json_incref(*stateJ);
+
+	std::lock_guard<std::mutex> lock(payloadsMutex);
+	auto it = payloads.find(stateJ);
+	if (it == payloads.end())
+		return NULL;
+
+	const std::vector<uint8_t>& data(it->second);
+	const unsigned long long size = ZSTD_getFrameContentSize(data.data(), data.size());
+	if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN)
+		return NULL;
+
+	std::vector<char> str(size);
+	if (ZSTD_isError(ZSTD_decompress(str.data(), str.size(), data.data(), data.size())))
+		return NULL;
+
+	json_error_t error;
+	json_t* const rootJ = json_loadb(str.data(), str.size(), 0, &error);
+	if (!rootJ)
+		WARN("Cannot load undo history state: %s", error.text);
+	return rootJ;
+}
+
+static void freePayload(json_t** const stateJ) {
+	json_decref(*stateJ);
+	*stateJ = NULL;
+
+	std::lock_guard<std::mutex> lock(payloadsMutex);
+	payloads.erase(stateJ);
+}
+
+static size_t getPayloadSize(json_t* const* const stateJ) {
+	if (*stateJ)
+		return json_dumpb(*stateJ, NULL, 0, JSON_COMPACT);
+
+	std::lock_guard<std::mutex> lock(payloadsMutex);
+	auto it = payloads.find(stateJ);
+	return it != payloads.end() ? it->second.size() : 0;
+}
+
+static void compressAction(Action* const action) {
+	if (ComplexAction* const complexAction = dynamic_cast<ComplexAction*>(action)) {
+		for (Action* const subAction : complexAction->actions)
+			compressAction(subAction);
+	}
+	// also ModuleRemove
+	else if (ModuleAdd* const moduleAdd = dynamic_cast<ModuleAdd*>(action)) {
+		compressPayload(&moduleAdd->moduleJ);
+	}
+	else if (ModuleChange* const moduleChange = dynamic_cast<ModuleChange*>(action)) {
+		compressPayload(&moduleChange->oldModuleJ);
+		compressPayload(&moduleChange->newModuleJ);
+	}
+}
+
+/** Approximate memory used by an action, the exact overhead of small actions does not matter. */
+static size_t getActionMemory(Action* const action) {
+	size_t size = 64 + action->name.size();
+
+	if (ComplexAction* const complexAction = dynamic_cast<ComplexAction*>(action)) {
+		for (Action* const subAction : complexAction->actions)
+			size += getActionMemory(subAction);
+	}
+	else if (ModuleAdd* const moduleAdd = dynamic_cast<ModuleAdd*>(action)) {
+		size += getPayloadSize(&moduleAdd->moduleJ);
+	}
+	else if (ModuleChange* const moduleChange = dynamic_cast<ModuleChange*>(action)) {
+		size += getPayloadSize(&moduleChange->oldModuleJ);
+		size += getPayloadSize(&moduleChange->newModuleJ);
+	}
+
+	return size;
+}
+
+
+ComplexAction::~ComplexAction() {
+	for (Action* action : actions) {
+		delete action;
+	}
+}
+
+
+void ComplexAction::undo() {
+	for (auto it = actions.rbegin(); it != actions.rend(); it++) {
+		Action* action = *it;
+		action->undo();
+	}
+}
+
+
+void ComplexAction::redo() {
+	for (Action* action : actions) {
+		action->redo();
+	}
+}
+
+
+void ComplexAction::push(Action* action) {
+	actions.push_back(action);
+}
+
+
+bool ComplexAction::isEmpty() {
+	return actions.empty();
+}
+
+
+ModuleAdd::~ModuleAdd() {
+	freePayload(&moduleJ);
+}
+
+
+void ModuleAdd::setModule(app::ModuleWidget* mw) {
+	model = mw->model;
+	assert(mw->module);
+	moduleId = mw->module->id;
+	pos = mw->box.pos;
+	// ModuleAdd doesn't *really* need the state to be serialized, although ModuleRemove certainly does.
+	// However, we need to give the module a chance to serialize its state before it is deleted.
+	moduleJ = mw->toJson();
+}
+
+
+void ModuleAdd::undo() {
+	app::ModuleWidget* mw = APP->scene->rack->getModule(moduleId);
+	if (!mw)
+		return;
+	APP->scene->rack->removeModule(mw);
+	delete mw;
+}
+
+
+void ModuleAdd::redo() {
+	modulemem::beginConstruction(model);
+	engine::Module* module = model->createModule();
+	modulemem::endConstruction(module);
+	module->id = moduleId;
+	if (json_t* const stateJ = loadPayload(&moduleJ)) {
+		try {
+			const modulemem::Scope memoryScope(module);
+			module->fromJson(stateJ);
+		}
+		catch (Exception& e) {
+			WARN("%s", e.what());
+		}
+		json_decref(stateJ);
+	}
+	APP->engine->addModule(module);
+
+	app::ModuleWidget* mw = model->createModuleWidget(module);
+	mw->setPosition(pos);
+	APP->scene->rack->addModule(mw);
+}
+
+
+void ModuleMove::undo() {
+	app::ModuleWidget* mw = APP->scene->rack->getModule(moduleId);
+	if (!mw)
+		return;
+	mw->setPosition(oldPos);
+	APP->scene->rack->updateExpanders();
+}
+
+
+void ModuleMove::redo() {
+	app::ModuleWidget* mw = APP->scene->rack->getModule(moduleId);
+	if (!mw)
+		return;
+	mw->setPosition(newPos);
+	APP->scene->rack->updateExpanders();
+}
+
+
+void ModuleBypass::undo() {
+	engine::Module* module = APP->engine->getModule(moduleId);
+	if (!module)
+		return;
+	APP->engine->bypassModule(module, !bypassed);
+}
+
+
+void ModuleBypass::redo() {
+	engine::Module* module = APP->engine->getModule(moduleId);
+	if (!module)
+		return;
+	APP->engine->bypassModule(module, bypassed);
+}
+
+
+ModuleChange::~ModuleChange() {
+	freePayload(&oldModuleJ);
+	freePayload(&newModuleJ);
+}
+
+
+void ModuleChange::undo() {
+	engine::Module* module = APP->engine->getModule(moduleId);
+	if (!module)
+		return;
+	if (json_t* const stateJ = loadPayload(&oldModuleJ)) {
+		APP->engine->moduleFromJson(module, stateJ);
+		json_decref(stateJ);
+	}
+}
+
+
+void ModuleChange::redo() {
+	engine::Module* module = APP->engine->getModule(moduleId);
+	if (!module)
+		return;
+	if (json_t* const stateJ = loadPayload(&newModuleJ)) {
+		APP->engine->moduleFromJson(module, stateJ);
+		json_decref(stateJ);
+	}
+}
+
+
+void ParamChange::undo() {
+	engine::Module* module = APP->engine->getModule(moduleId);
+	if (!module)
+		return;
+	APP->engine->setParamValue(module, paramId, oldValue);
+}
+
+
+void ParamChange::redo() {
+	engine::Module* module = APP->engine->getModule(moduleId);
+	if (!module)
+		return;
+	APP->engine->setParamValue(module, paramId, newValue);
+}
+
+
+void CableAdd::setCable(app::CableWidget* cw) {
+	assert(cw->cable);
+	assert(cw->cable->id >= 0);
+	cableId = cw->cable->id;
+	assert(cw->cable->inputModule);
+	inputModuleId = cw->cable->inputModule->id;
+	inputId = cw->cable->inputId;
+	assert(cw->cable->outputModule);
+	outputModuleId = cw->cable->outputModule->id;
+	outputId = cw->cable->outputId;
+	color = cw->color;
+}
+
+
+void CableAdd::undo() {
+	app::CableWidget* cw = APP->scene->rack->getCable(cableId);
+	if (!cw)
+		return;
+	APP->scene->rack->removeCable(cw);
+	delete cw;
+}
+
+
+void CableAdd::redo() {
+	engine::Cable* cable = new engine::Cable;
+	cable->id = cableId;
+	cable->inputModule = APP->engine->getModule(inputModuleId);
+	cable->inputId = inputId;
+	cable->outputModule = APP->engine->getModule(outputModuleId);
+	cable->outputId = outputId;
+	APP->engine->addCable(cable);
+
+	app::CableWidget* cw = new app::CableWidget;
+	cw->setCable(cable);
+	cw->color = color;
+	APP->scene->rack->addCable(cw);
+}
+
+
+void CableColorChange::setCable(app::CableWidget* cw) {
+	assert(cw->cable);
+	assert(cw->cable->id >= 0);
+	cableId = cw->cable->id;
+}
+
+
+void CableColorChange::undo() {
+	app::CableWidget* cw = APP->scene->rack->getCable(cableId);
+	if (!cw)
+		return;
+	cw->color = oldColor;
+}
+
+
+void CableColorChange::redo() {
+	app::CableWidget* cw = APP->scene->rack->getCable(cableId);
+	if (!cw)
+		return;
+	cw->color = newColor;
+}
+
+
+State::State() {
+	clear();
+}
+
+
+State::~State() {
+	clear();
+}
+
+
+void State::clear() {
+	for (Action* action : actions) {
+		delete action;
+	}
+	actions.clear();
+	actionIndex = 0;
+	savedIndex = -1;
+}
+
+
+void State::push(Action* action) {
+	assert(action);
+	// Delete all future actions (if we have undone some actions)
+	for (int i = actionIndex; i < (int) actions.size(); i++) {
+		delete actions[i];
+	}
+	actions.resize(actionIndex);
+	// Delete actions from beginning if limit is reached
+	static const int limit = 500;
+	int n = (int) actions.size() - limit + 1;
+	if (n > 0) {
+		for (int i = 0; i < n; i++) {
+			delete actions[i];
+		}
+		actions.erase(actions.begin(), actions.begin() + n);
+		actionIndex -= n;
+		savedIndex -= n;
+	}
+	// Push action
+	compressAction(action);
+	actions.push_back(action);
+	actionIndex++;
+	// Unset the savedIndex if we just permanently overwrote the saved state
+	if (actionIndex == savedIndex) {
+		savedIndex = -1;
+	}
+
+	// Delete the oldest actions while over the memory budget, always keeping the one just pushed
+	static const size_t memoryLimit = 64 * 1024 * 1024;
+	size_t memory = 0;
+	for (Action* a : actions) {
+		memory += getActionMemory(a);
+	}
+	while (memory > memoryLimit && actions.size() > 1) {
+		memory -= getActionMemory(actions.front());
+		delete actions.front();
+		actions.pop_front();
+		actionIndex--;
+		savedIndex--;
+	}
+}
+
+
+void State::undo() {
+	if (canUndo()) {
+		actionIndex--;
+		actions[actionIndex]->undo();
+	}
+}
+
+
+void State::redo() {
+	if (canRedo()) {
+		actions[actionIndex]->redo();
+		actionIndex++;
+	}
+}
+
+
+bool State::canUndo() {
+	return actionIndex > 0;
+}
+
+
+bool State::canRedo() {
+	return actionIndex < (int) actions.size();
+}
+
+
+std::string State::getUndoName() {
+	if (!canUndo())
+		return "";
+	return actions[actionIndex - 1]->name;
+}
+
+
+std::string State::getRedoName() {
+	if (!canRedo())
+		return "";
+	return actions[actionIndex]->name;
+}
+
+
+void State::setSaved() {
+	savedIndex = actionIndex;
+}
+
+
+bool State::isSaved() {
+	return actionIndex == savedIndex;
+}
+
+
+} // namespace history
+} // namespace rack
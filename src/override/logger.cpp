@@ -0,0 +1,363 @@
+/*
+ * DISTRHO Cardinal Plugin
+ * Copyright (C) 2021-2022 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+/**
+ * This file is an edited version of VCVRack's logger.cpp
+ * Copyright (C) 2016-2021 VCV.
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ */
+
+#include <common.hpp>
+#include <logger.hpp>
+#include <system.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+
+namespace rack {
+namespace logger {
+
+
+std::string logPath;
+
+static FILE* outputFile = NULL;
+static int64_t startTime = 0;
+
+static const char* const levelLabels[] = {
+	"debug",
+	"info",
+	"warn",
+	"fatal",
+};
+
+static const int levelColors[] = {
+	35,
+	34,
+	33,
+	31,
+};
+
+
+/** Messages are formatted by the thread logging them into a slot of a fixed ring, so that logging never locks nor allocates.
+A background thread writes them out, a full ring drops messages instead of waiting.
+The ring is a bounded queue with a sequence number per slot, producers claim slots with a CAS on the enqueue position.
+*/
+static const constexpr uint32_t kRingSize = 1024;
+static const constexpr size_t kMessageSize = 480;
+/** How often the writer thread empties the ring. */
+static const constexpr int kWriteIntervalMs = 20;
+/** Messages per second a single call site may log, the rest is counted and reported with its next message. */
+static const constexpr uint32_t kRateLimit = 20;
+static const constexpr uint32_t kCallSiteCount = 256;
+static const constexpr uint32_t kCallSiteProbes = 8;
+
+struct Record {
+	std::atomic<uint32_t> sequence;
+	int64_t time;
+	Level level;
+	const char* filename;
+	int line;
+	const char* func;
+	uint32_t suppressed;
+	char message[kMessageSize];
+};
+
+struct CallSite {
+	std::atomic<uintptr_t> key;
+	std::atomic<int64_t> window;
+	std::atomic<uint32_t> count;
+	std::atomic<uint32_t> suppressed;
+};
+
+static Record ring[kRingSize];
+static std::atomic<uint32_t> enqueuePos;
+static uint32_t dequeuePos = 0;
+static std::atomic<uint32_t> droppedCount;
+static CallSite callSites[kCallSiteCount];
+
+/** Serializes the consumer side of the ring and the writes to outputFile. */
+static std::mutex writeMutex;
+
+static std::atomic<bool> running;
+#if !defined(__EMSCRIPTEN__) || defined(CARDINAL_WASM_THREADS)
+static std::thread writerThread;
+static std::mutex writerMutex;
+static std::condition_variable writerCondition;
+static bool writerStopping = false;
+#endif
+
+
+static void writeLine(int64_t time, Level level, const char* filename, int line, const char* func, const char* message) {
+	const double duration = (time - startTime) / 1e9;
+	if (outputFile == stderr)
+		std::fprintf(outputFile, "\x1B[%dm", levelColors[level]);
+	std::fprintf(outputFile, "[%.03f %s %s:%d %s] ", duration, levelLabels[level], filename, line, func);
+	if (outputFile == stderr)
+		std::fprintf(outputFile, "\x1B[0m");
+	std::fprintf(outputFile, "%s\n", message);
+}
+
+/** Empties the ring, needs writeMutex. */
+static void writePending() {
+	bool written = false;
+
+	for (;;) {
+		Record& record = ring[dequeuePos % kRingSize];
+		if (record.sequence.load(std::memory_order_acquire) != dequeuePos + 1)
+			break;
+
+		if (record.suppressed != 0) {
+			char message[kMessageSize + 48];
+			std::snprintf(message, sizeof(message), "%s (%u similar messages suppressed)", record.message, record.suppressed);
+			writeLine(record.time, record.level, record.filename, record.line, record.func, message);
+		}
+		else {
+			writeLine(record.time, record.level, record.filename, record.line, record.func, record.message);
+		}
+
+		record.sequence.store(dequeuePos + kRingSize, std::memory_order_release);
+		++dequeuePos;
+		written = true;
+	}
+
+	if (const uint32_t dropped = droppedCount.exchange(0, std::memory_order_relaxed)) {
+		char message[64];
+		std::snprintf(message, sizeof(message), "%u log messages dropped, the log ring was full", dropped);
+		writeLine(system::getNanoseconds(), WARN_LEVEL, __FILE__, __LINE__, __FUNCTION__, message);
+		written = true;
+	}
+
+	if (written)
+		std::fflush(outputFile);
+}
+
+#if !defined(__EMSCRIPTEN__) || defined(CARDINAL_WASM_THREADS)
+static void runWriter() {
+	std::unique_lock<std::mutex> lock(writerMutex);
+
+	while (!writerStopping) {
+		writerCondition.wait_for(lock, std::chrono::milliseconds(kWriteIntervalMs));
+
+		const std::lock_guard<std::mutex> writeLock(writeMutex);
+		writePending();
+	}
+}
+#endif
+
+
+/** Slot of the rate limiter for a call site, NULL if the table is too crowded around it. */
+static CallSite* getCallSite(const char* filename, int line) {
+	const uintptr_t key = (reinterpret_cast<uintptr_t>(filename) ^ (static_cast<uintptr_t>(line) * 2654435761u)) | 1;
+	const uint32_t start = static_cast<uint32_t>(key ^ (key >> 16)) % kCallSiteCount;
+
+	for (uint32_t i = 0; i < kCallSiteProbes; i++) {
+		CallSite& site = callSites[(start + i) % kCallSiteCount];
+		uintptr_t current = site.key.load(std::memory_order_relaxed);
+		if (current == 0 && site.key.compare_exchange_strong(current, key, std::memory_order_relaxed))
+			return &site;
+		// current is the key stored meanwhile if the exchange failed
+		if (current == key)
+			return &site;
+	}
+
+	return NULL;
+}
+
+/** Whether a call site may log now, sets how many of its messages were suppressed since it last could. */
+static bool allowCallSite(CallSite* site, int64_t time, uint32_t& suppressed) {
+	const int64_t window = time / 1000000000;
+	int64_t lastWindow = site->window.load(std::memory_order_relaxed);
+	if (lastWindow != window && site->window.compare_exchange_strong(lastWindow, window, std::memory_order_relaxed))
+		site->count.store(0, std::memory_order_relaxed);
+
+	if (site->count.fetch_add(1, std::memory_order_relaxed) >= kRateLimit) {
+		site->suppressed.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	suppressed = site->suppressed.exchange(0, std::memory_order_relaxed);
+	return true;
+}
+
+/** Claims the next free slot of the ring and its position, NULL if it is full. */
+static Record* claimRecord(uint32_t& pos) {
+	pos = enqueuePos.load(std::memory_order_relaxed);
+
+	for (;;) {
+		Record& record = ring[pos % kRingSize];
+		const int32_t diff = static_cast<int32_t>(record.sequence.load(std::memory_order_acquire) - pos);
+
+		if (diff == 0) {
+			if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				return &record;
+		}
+		else if (diff < 0) {
+			return NULL;
+		}
+		else {
+			pos = enqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+
+void init() {
+	startTime = system::getNanoseconds();
+
+	for (uint32_t i = 0; i < kRingSize; i++)
+		ring[i].sequence.store(i, std::memory_order_relaxed);
+	enqueuePos.store(0, std::memory_order_relaxed);
+	dequeuePos = 0;
+	droppedCount.store(0, std::memory_order_relaxed);
+
+	// Don't open a file in development mode.
+	if (logPath.empty()) {
+		outputFile = stderr;
+	}
+	else {
+		assert(!outputFile);
+		outputFile = std::fopen(logPath.c_str(), "w");
+		if (!outputFile) {
+			std::fprintf(stderr, "Could not open log at %s\n", logPath.c_str());
+			return;
+		}
+	}
+
+#if !defined(__EMSCRIPTEN__) || defined(CARDINAL_WASM_THREADS)
+	writerStopping = false;
+	writerThread = std::thread(runWriter);
+#endif
+	running.store(true, std::memory_order_release);
+}
+
+void destroy() {
+	if (!running.exchange(false, std::memory_order_acq_rel))
+		return;
+
+#if !defined(__EMSCRIPTEN__) || defined(CARDINAL_WASM_THREADS)
+	{
+		const std::lock_guard<std::mutex> lock(writerMutex);
+		writerStopping = true;
+	}
+	writerCondition.notify_one();
+	writerThread.join();
+#endif
+
+	const std::lock_guard<std::mutex> lock(writeMutex);
+	writePending();
+
+	if (outputFile && outputFile != stderr) {
+		// Print end token so we know if the logger exited cleanly.
+		std::fprintf(outputFile, "END");
+		std::fclose(outputFile);
+	}
+	outputFile = NULL;
+}
+
+static void logVa(Level level, const char* filename, int line, const char* func, const char* format, va_list args) {
+	if (!running.load(std::memory_order_acquire))
+		return;
+
+	const int64_t time = system::getNanoseconds();
+
+	// Fatal messages come right before a crash or abort, they are never limited and written before returning
+	uint32_t suppressed = 0;
+	if (level != FATAL_LEVEL) {
+		if (CallSite* const site = getCallSite(filename, line)) {
+			if (!allowCallSite(site, time, suppressed))
+				return;
+		}
+	}
+
+	uint32_t pos;
+	Record* const record = claimRecord(pos);
+	if (record == NULL) {
+		droppedCount.fetch_add(1, std::memory_order_relaxed);
+		if (level != FATAL_LEVEL)
+			return;
+
+		char message[kMessageSize];
+		std::vsnprintf(message, sizeof(message), format, args);
+		const std::lock_guard<std::mutex> lock(writeMutex);
+		writePending();
+		writeLine(time, level, filename, line, func, message);
+		std::fflush(outputFile);
+		return;
+	}
+
+	record->time = time;
+	record->level = level;
+	record->filename = filename;
+	record->line = line;
+	record->func = func;
+	record->suppressed = suppressed;
+	std::vsnprintf(record->message, sizeof(record->message), format, args);
+	record->sequence.store(pos + 1, std::memory_order_release);
+
+	// Without a writer thread everything is written right away
+#if !defined(__EMSCRIPTEN__) || defined(CARDINAL_WASM_THREADS)
+	if (level == FATAL_LEVEL)
+#endif
+	{
+		const std::lock_guard<std::mutex> lock(writeMutex);
+		writePending();
+	}
+}
+
+void log(Level level, const char* filename, int line, const char* func, const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	logVa(level, filename, line, func, format, args);
+	va_end(args);
+}
+
+static bool fileEndsWith(FILE* file, std::string str) {
+	// Seek to last `len` characters
+	size_t len = str.size();
+	std::fseek(file, -long(len), SEEK_END);
+	char actual[len];
+	if (std::fread(actual, 1, len, file) != len)
+		return false;
+	return std::string(actual, len) == str;
+}
+
+bool wasTruncated() {
+	if (logPath.empty())
+		return false;
+
+	// Check existing log file for END token
+	FILE* file = std::fopen(logPath.c_str(), "r");
+	if (!file)
+		return false;
+	DEFER({std::fclose(file);});
+
+	return !fileEndsWith(file, "END");
+}
+
+
+} // namespace logger
+} // namespace rack
@@ -29,12 +29,16 @@
 #include <dsp/fft.hpp>
 #include <dsp/window.hpp>
 
+#include <map>
+#include <mutex>
+#include <vector>
+
 
 namespace rack {
 namespace dsp {
 
 
-void minBlepImpulse(int z, int o, float* output) {
+static void computeMinBlepImpulse(int z, int o, float* output) {
 	// Symmetric sinc array with `z` zero-crossings on each side
 	int n = 2 * z * o;
 	float* x = (float*) pffft_aligned_malloc(sizeof(float) * n);
@@ -107,5 +111,27 @@ void minBlepImpulse(int z, int o, float* output) {
 }
 
 
+/** Impulses already computed, by zero crossings and oversampling.
+Every MinBlepGenerator computes its impulse on construction, and most of them use the same few sizes,
+so each size is computed once per process and copied from then on.
+*/
+static std::mutex minBlepImpulsesMutex;
+static std::map<std::pair<int, int>, std::vector<float>> minBlepImpulses;
+
+
+void minBlepImpulse(int z, int o, float* output) {
+	const int n = 2 * z * o;
+	std::lock_guard<std::mutex> lock(minBlepImpulsesMutex);
+
+	std::vector<float>& impulse = minBlepImpulses[std::make_pair(z, o)];
+	if (impulse.empty()) {
+		impulse.resize(n);
+		computeMinBlepImpulse(z, o, impulse.data());
+	}
+
+	std::memcpy(output, impulse.data(), n * sizeof(float));
+}
+
+
 } // namespace dsp
 } // namespace rack
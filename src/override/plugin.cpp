@@ -27,11 +27,28 @@
 
 #include <algorithm>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <plugin.hpp>
 
+#ifdef CARDINAL_SHARED_PLUGINS
+# include <atomic>
+# include <dlfcn.h>
+# include <helpers.hpp>
+#endif
+
 
 namespace rack {
+
+#ifdef CARDINAL_SHARED_PLUGINS
+namespace asset {
+std::string pluginModule(const std::string& dirname);
+}
+#endif
+
 namespace plugin {
 
 
@@ -52,10 +69,35 @@ static const std::map<std::string, std::string> pluginSlugFallbacks = {
 };
 
 
+/** Hashed lookups of plugins and models, built once static plugins are initialized.
+Models are keyed by "pluginSlug/modelSlug", slugs cannot contain '/'.
+Fallback entries resolve the fallback tables ahead of time, in the same order getModelFallback tries them.
+*/
+static bool indexReady = false;
+static std::unordered_map<std::string, Plugin*> pluginIndex;
+static std::unordered_map<std::string, Model*> modelIndex;
+static std::unordered_map<std::string, Model*> modelFallbackIndex;
+
+
+static inline std::string modelIndexKey(const std::string& pluginSlug, const std::string& modelSlug) {
+	std::string key;
+	key.reserve(pluginSlug.size() + 1 + modelSlug.size());
+	key += pluginSlug;
+	key += '/';
+	key += modelSlug;
+	return key;
+}
+
+
 Plugin* getPlugin(const std::string& pluginSlug) {
 	if (pluginSlug.empty())
 		return NULL;
 
+	if (indexReady) {
+		auto it = pluginIndex.find(pluginSlug);
+		return it != pluginIndex.end() ? it->second : NULL;
+	}
+
 	auto it = std::find_if(plugins.begin(), plugins.end(), [=](Plugin* p) {
 		return p->slug == pluginSlug;
 	});
@@ -110,6 +152,11 @@ Model* getModel(const std::string& pluginSlug, const std::string& modelSlug) {
 	if (pluginSlug.empty() || modelSlug.empty())
 		return NULL;
 
+	if (indexReady) {
+		auto it = modelIndex.find(modelIndexKey(pluginSlug, modelSlug));
+		return it != modelIndex.end() ? it->second : NULL;
+	}
+
 	Plugin* p = getPlugin(pluginSlug);
 	if (!p)
 		return NULL;
@@ -122,6 +169,15 @@ Model* getModelFallback(const std::string& pluginSlug, const std::string& modelS
 	if (pluginSlug.empty() || modelSlug.empty())
 		return NULL;
 
+	if (indexReady) {
+		const std::string key = modelIndexKey(pluginSlug, modelSlug);
+		auto it = modelIndex.find(key);
+		if (it != modelIndex.end())
+			return it->second;
+		auto it2 = modelFallbackIndex.find(key);
+		return it2 != modelFallbackIndex.end() ? it2->second : NULL;
+	}
+
 	// Attempt exact plugin and model
 	Model* m = getModel(pluginSlug, modelSlug);
 	if (m)
@@ -147,6 +203,47 @@ Model* getModelFallback(const std::string& pluginSlug, const std::string& modelS
 }
 
 
+void updatePluginIndex() {
+	indexReady = false;
+	pluginIndex.clear();
+	modelIndex.clear();
+	modelFallbackIndex.clear();
+
+	if (plugins.empty())
+		return;
+
+	size_t numModels = 0;
+	for (Plugin* p : plugins)
+		numModels += p->models.size();
+
+	pluginIndex.reserve(plugins.size());
+	modelIndex.reserve(numModels);
+
+	for (Plugin* p : plugins) {
+		// first registered plugin and model wins, as with the linear lookups
+		pluginIndex.emplace(p->slug, p);
+		for (Model* m : p->models)
+			modelIndex.emplace(modelIndexKey(p->slug, m->slug), m);
+	}
+
+	// Fallback modules, then fallback plugins
+	for (const auto& fallback : moduleSlugFallbacks) {
+		auto it = modelIndex.find(modelIndexKey(std::get<0>(fallback.second), std::get<1>(fallback.second)));
+		if (it != modelIndex.end())
+			modelFallbackIndex.emplace(modelIndexKey(std::get<0>(fallback.first), std::get<1>(fallback.first)), it->second);
+	}
+	for (const auto& fallback : pluginSlugFallbacks) {
+		auto it = pluginIndex.find(fallback.second);
+		if (it == pluginIndex.end())
+			continue;
+		for (Model* m : it->second->models)
+			modelFallbackIndex.emplace(modelIndexKey(fallback.first, m->slug), m);
+	}
+
+	indexReady = true;
+}
+
+
 Model* modelFromJson(json_t* moduleJ) {
 	// Get slugs
 	json_t* pluginSlugJ = json_object_get(moduleJ, "plugin");
@@ -189,6 +286,276 @@ std::string normalizeSlug(const std::string& slug) {
 }
 
 
+/** Plugin setup deferred until the first module or module widget of the plugin is created.
+Registered while initializing static plugins, read-only afterwards.
+*/
+struct LazyPluginInit {
+	void (*init)();
+	std::once_flag once;
+};
+static std::map<const Plugin*, std::unique_ptr<LazyPluginInit>> lazyPluginInits;
+
+#ifdef CARDINAL_SHARED_PLUGINS
+/** Plugin modules register while being loaded, which can happen while modules of others are being created.
+Guards the otherwise read-only registrations.
+*/
+static std::mutex lateRegistrationMutex;
+#ifndef HEADLESS
+static Model* getLoadedDeferredModel(const Model* model);
+#endif
+#endif
+
+
+void setLazyPluginInit(const Plugin* plugin, void (*init)()) {
+	LazyPluginInit* const lazyInit = new LazyPluginInit;
+	lazyInit->init = init;
+#ifdef CARDINAL_SHARED_PLUGINS
+	const std::lock_guard<std::mutex> lock(lateRegistrationMutex);
+#endif
+	lazyPluginInits[plugin].reset(lazyInit);
+}
+
+
+void runLazyPluginInit(const Plugin* plugin) {
+	LazyPluginInit* lazyInit;
+	{
+#ifdef CARDINAL_SHARED_PLUGINS
+		const std::lock_guard<std::mutex> lock(lateRegistrationMutex);
+#endif
+		auto it = lazyPluginInits.find(plugin);
+		if (it == lazyPluginInits.end())
+			return;
+		lazyInit = it->second.get();
+	}
+	std::call_once(lazyInit->once, lazyInit->init);
+}
+
+
+#ifndef HEADLESS
+/** Models that get their module widget created right away when the engine loads a patch, instead of when the rack view is built.
+Registered while initializing static plugins, read-only afterwards.
+*/
+static std::unordered_set<const Model*> modelsNeedingWidgetOnEngineLoad;
+
+
+void setModuleWidgetNeededOnEngineLoad(const Model* model) {
+#ifdef CARDINAL_SHARED_PLUGINS
+	const std::lock_guard<std::mutex> lock(lateRegistrationMutex);
+#endif
+	modelsNeedingWidgetOnEngineLoad.insert(model);
+}
+
+
+bool isModuleWidgetNeededOnEngineLoad(const Model* model) {
+#ifdef CARDINAL_SHARED_PLUGINS
+	// placeholders answer for their loaded model, loaded when creating their module
+	if (Model* const loadedModel = getLoadedDeferredModel(model))
+		model = loadedModel;
+	const std::lock_guard<std::mutex> lock(lateRegistrationMutex);
+#endif
+	return modelsNeedingWidgetOnEngineLoad.find(model) != modelsNeedingWidgetOnEngineLoad.end();
+}
+#endif
+
+
+/** Models that may be constructed and get their sample rate changes on engine worker threads, in parallel with other modules.
+Registered while initializing static plugins, read-only afterwards.
+*/
+static std::unordered_set<const Model*> parallelSafeModels;
+
+
+void setModuleParallelSafe(const Model* model) {
+#ifdef CARDINAL_SHARED_PLUGINS
+	const std::lock_guard<std::mutex> lock(lateRegistrationMutex);
+#endif
+	parallelSafeModels.insert(model);
+}
+
+
+bool isModuleParallelSafe(const Model* model) {
+#ifdef CARDINAL_SHARED_PLUGINS
+	// placeholders are not, creating their module loads the real model
+	const std::lock_guard<std::mutex> lock(lateRegistrationMutex);
+#endif
+	return parallelSafeModels.find(model) != parallelSafeModels.end();
+}
+
+
+#ifdef CARDINAL_SHARED_PLUGINS
+/** Plugin families built as separately loadable modules, see SHARED_PLUGINS.
+The plugin list only has placeholders for them, created from the manifest.
+A module is opened when the first of its models is instantiated, and kept until static plugins are destroyed.
+Modules and module widgets belong to the loaded model, so code comparing models keeps working as before.
+*/
+struct DeferredPlugin {
+	std::string dirname;
+	std::mutex mutex;
+	void* handle = nullptr;
+	Plugin* plugin = nullptr;
+	bool failed = false;
+};
+static std::mutex deferredPluginsMutex;
+static std::map<std::string, std::unique_ptr<DeferredPlugin>> deferredPlugins;
+
+
+static Plugin* loadDeferredPlugin(DeferredPlugin* const deferred) {
+	const std::lock_guard<std::mutex> lock(deferred->mutex);
+
+	if (deferred->plugin != nullptr || deferred->failed)
+		return deferred->plugin;
+
+	const double startTime = system::getTime();
+	const std::string path = asset::pluginModule(deferred->dirname);
+
+	void* const handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (handle == nullptr) {
+		WARN("Could not load plugin module %s: %s", path.c_str(), dlerror());
+		deferred->failed = true;
+		return nullptr;
+	}
+
+	typedef Plugin* (*InitCallback)();
+	const InitCallback initCallback = reinterpret_cast<InitCallback>(dlsym(handle, "cardinalPluginModuleInit"));
+	if (initCallback == nullptr) {
+		WARN("Plugin module %s has no entry point", path.c_str());
+		dlclose(handle);
+		deferred->failed = true;
+		return nullptr;
+	}
+
+	Plugin* plugin = nullptr;
+	try {
+		plugin = initCallback();
+	}
+	catch (Exception& e) {
+		WARN("Could not initialize plugin module %s: %s", path.c_str(), e.what());
+	}
+
+	// not closed on failure, it might have registered callbacks already
+	deferred->handle = handle;
+
+	if (plugin == nullptr) {
+		deferred->failed = true;
+		return nullptr;
+	}
+
+	deferred->plugin = plugin;
+	INFO("Loaded plugin module %s in %.1f ms", deferred->dirname.c_str(), (system::getTime() - startTime) * 1000.0);
+	return plugin;
+}
+
+
+struct DeferredModel : CardinalPluginModelHelper {
+	DeferredPlugin* const deferred;
+	std::atomic<Model*> loadedModel;
+
+	DeferredModel(DeferredPlugin* const deferred, const std::string& slug)
+		: deferred(deferred),
+		  loadedModel(nullptr) {
+		this->slug = slug;
+	}
+
+	Model* load() {
+		if (Model* const model = loadedModel.load())
+			return model;
+
+		Plugin* const loadedPlugin = loadDeferredPlugin(deferred);
+		if (loadedPlugin == nullptr)
+			return nullptr;
+
+		Model* const model = loadedPlugin->getModel(slug);
+		if (model == nullptr)
+			WARN("Plugin module %s has no module %s", deferred->dirname.c_str(), slug.c_str());
+
+		loadedModel = model;
+		return model;
+	}
+
+	engine::Module* createModule() override {
+		Model* const model = load();
+		if (model == nullptr)
+			throw Exception("Could not load module %s/%s", plugin->slug.c_str(), slug.c_str());
+		return model->createModule();
+	}
+
+	app::ModuleWidget* createModuleWidget(engine::Module* const m) override {
+		// modules are created by the loaded model, so are their widgets
+		if (m != nullptr)
+			return m->model->createModuleWidget(m);
+
+#ifndef HEADLESS
+		// browser previews, do not load anything for them if possible
+		if (app::ModuleWidget* const thumbnail = window::createModuleThumbnail(this))
+			return thumbnail;
+#endif
+
+		Model* const model = load();
+		return model != nullptr ? model->createModuleWidget(nullptr) : nullptr;
+	}
+
+	app::ModuleWidget* createModuleWidgetFromEngineLoad(engine::Module* const m) override {
+		CardinalPluginModelHelper* const helper = dynamic_cast<CardinalPluginModelHelper*>(m->model);
+		DISTRHO_SAFE_ASSERT_RETURN(helper != nullptr && helper != this, nullptr);
+		return helper->createModuleWidgetFromEngineLoad(m);
+	}
+
+	void removeCachedModuleWidget(engine::Module* const m) override {
+		CardinalPluginModelHelper* const helper = dynamic_cast<CardinalPluginModelHelper*>(m->model);
+		DISTRHO_SAFE_ASSERT_RETURN(helper != nullptr && helper != this,);
+		helper->removeCachedModuleWidget(m);
+	}
+};
+
+
+#ifndef HEADLESS
+static Model* getLoadedDeferredModel(const Model* const model) {
+	const DeferredModel* const deferredModel = dynamic_cast<const DeferredModel*>(model);
+	return deferredModel != nullptr ? deferredModel->loadedModel.load() : nullptr;
+}
+#endif
+
+
+void addDeferredModel(Plugin* const plugin, const char* const dirname, const char* const slug) {
+	DeferredPlugin* deferred;
+	{
+		const std::lock_guard<std::mutex> lock(deferredPluginsMutex);
+		std::unique_ptr<DeferredPlugin>& entry(deferredPlugins[dirname]);
+		if (!entry) {
+			entry.reset(new DeferredPlugin);
+			entry->dirname = dirname;
+		}
+		deferred = entry.get();
+	}
+	plugin->addModel(new DeferredModel(deferred, slug));
+}
+
+
+void destroyDeferredPlugins() {
+	const std::lock_guard<std::mutex> lock(deferredPluginsMutex);
+
+	for (auto& entry : deferredPlugins) {
+		DeferredPlugin* const deferred = entry.second.get();
+
+		if (Plugin* const loadedPlugin = deferred->plugin) {
+			// registrations point into the module, which is about to be closed
+			const std::lock_guard<std::mutex> lock2(lateRegistrationMutex);
+			lazyPluginInits.erase(loadedPlugin);
+#ifndef HEADLESS
+			for (Model* const model : loadedPlugin->models)
+				modelsNeedingWidgetOnEngineLoad.erase(model);
+#endif
+			delete loadedPlugin;
+		}
+
+		if (deferred->handle != nullptr)
+			dlclose(deferred->handle);
+	}
+
+	deferredPlugins.clear();
+}
+#endif
+
+
 std::vector<Plugin*> plugins;
 
 